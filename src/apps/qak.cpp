@@ -1,11 +1,31 @@
 #include <stdio.h>
+#include <string.h>
 #include "qak.h"
 
 void printHelp() {
-    printf("Usage: qak <file.qak>");
+    printf("Usage: qak <file.qak>\n");
+    printf("       qak transpile <file.qak> <file.c>   Writes the module as a C99 source file.\n");
+}
+
+/* Transpiles the module to C, see qak_module_transpile(). */
+int transpile(const char *inputFile, const char *outputFile) {
+    qak_compiler compiler = qak_compiler_new();
+    qak_module module = qak_compiler_compile_file(compiler, inputFile);
+    if (!module) {
+        printf("Couldn't read file %s.\n", inputFile);
+        qak_compiler_delete(compiler);
+        return 1;
+    }
+
+    int result = qak_module_transpile(module, outputFile);
+    if (!result) qak_module_print_errors(module);
+    qak_module_delete(module);
+    qak_compiler_delete(compiler);
+    return result ? 0 : 1;
 }
 
 int main(int argc, char **argv) {
+    if (argc == 4 && strcmp(argv[1], "transpile") == 0) return transpile(argv[2], argv[3]);
     if (argc != 2) {
         printHelp();
         return 0;
@@ -12,7 +12,21 @@
 #define QAK_CHECK(expr, ...) { if (!(expr)) { fprintf(stdout, "ERROR: "); fprintf(stdout, __VA_ARGS__); fprintf(stdout, " (%s:%d)\n", __FILE__, __LINE__); fflush(stdout); exit(-1); } }
 
 #ifdef __cplusplus
+#include <string.h>
+#include "array.h"
+
 namespace qak {
+    /* Writes the header, the term repeated count times, and a line break to the text, which is
+     * null-terminated. A header ending in an operand followed by a term like " + x" gives a chain
+     * of binary operations, which nests its left operands as deep as it is long, so passes must
+     * not recurse into them. */
+    static inline void generateChain(Array<char> &text, const char *header, const char *term, int count) {
+        text.addAll(header, strlen(header));
+        size_t length = strlen(term);
+        for (int i = 0; i < count; i++) text.addAll(term, length);
+        text.addAll("\n", 2);
+    }
+
     struct Test {
         const char *name;
 
@@ -14,6 +14,11 @@ static void printSpan(const char *label, qak_span *span) {
 
 static void printAstNodeRecursive(qak_module module, qak_ast_node *node, int indent) {
     switch (node->type) {
+        case QakAstError: {
+            printIndent(indent);
+            printSpan("Error: ", &node->span);
+            break;
+        }
         case QakAstTypeSpecifier: {
             printIndent(indent);
             printSpan("Type: ", &node->data.typeSpecifier.name);
@@ -32,7 +37,7 @@ static void printAstNodeRecursive(qak_module module, qak_ast_node *node, int ind
                 printIndent(indent + INDENT);
                 printf("Parameters:\n");
                 for (size_t i = 0; i < node->data.function.parameters.numNodes; i++)
-                    printAstNodeRecursive(module, qak_module_get_ast_node(module, node->data.function.parameters.nodes[i]), indent + INDENT * 2);
+                    printAstNodeRecursive(module, qak_module_get_ast_list_node(module, &node->data.function.parameters, i), indent + INDENT * 2);
             }
             if (node->data.function.returnType >= 0) {
                 printIndent(indent + INDENT);
@@ -44,7 +49,7 @@ static void printAstNodeRecursive(qak_module module, qak_ast_node *node, int ind
                 printIndent(indent + INDENT);
                 printf("Statements:\n");
                 for (size_t i = 0; i < node->data.function.statements.numNodes; i++) {
-                    printAstNodeRecursive(module, qak_module_get_ast_node(module, node->data.function.statements.nodes[i]), indent + INDENT * 2);
+                    printAstNodeRecursive(module, qak_module_get_ast_list_node(module, &node->data.function.statements, i), indent + INDENT * 2);
                 }
             }
             break;
@@ -73,7 +78,7 @@ static void printAstNodeRecursive(qak_module module, qak_ast_node *node, int ind
                 printIndent(indent + INDENT);
                 printf("Statements: \n");
                 for (size_t i = 0; i < node->data.whileNode.statements.numNodes; i++) {
-                    printAstNodeRecursive(module, qak_module_get_ast_node(module, node->data.whileNode.statements.nodes[i]), indent + INDENT * 2);
+                    printAstNodeRecursive(module, qak_module_get_ast_list_node(module, &node->data.whileNode.statements, i), indent + INDENT * 2);
                 }
             }
             break;
@@ -90,7 +95,7 @@ static void printAstNodeRecursive(qak_module module, qak_ast_node *node, int ind
                 printIndent(indent + INDENT);
                 printf("True-block statements: \n");
                 for (size_t i = 0; i < node->data.ifNode.trueBlock.numNodes; i++) {
-                    printAstNodeRecursive(module, qak_module_get_ast_node(module, node->data.ifNode.trueBlock.nodes[i]), indent + INDENT * 2);
+                    printAstNodeRecursive(module, qak_module_get_ast_list_node(module, &node->data.ifNode.trueBlock, i), indent + INDENT * 2);
                 }
             }
 
@@ -98,7 +103,7 @@ static void printAstNodeRecursive(qak_module module, qak_ast_node *node, int ind
                 printIndent(indent + INDENT);
                 printf("False-block statements: \n");
                 for (size_t i = 0; i < node->data.ifNode.falseBlock.numNodes; i++) {
-                    printAstNodeRecursive(module, qak_module_get_ast_node(module, node->data.ifNode.falseBlock.nodes[i]), indent + INDENT * 2);
+                    printAstNodeRecursive(module, qak_module_get_ast_list_node(module, &node->data.ifNode.falseBlock, i), indent + INDENT * 2);
                 }
             }
             break;
@@ -154,7 +159,7 @@ static void printAstNodeRecursive(qak_module module, qak_ast_node *node, int ind
                 printIndent(indent + INDENT);
                 printf("Arguments:\n");
                 for (size_t i = 0; i < node->data.functionCall.arguments.numNodes; i++) {
-                    printAstNodeRecursive(module, qak_module_get_ast_node(module, node->data.functionCall.arguments.nodes[i]), indent + INDENT * 2);
+                    printAstNodeRecursive(module, qak_module_get_ast_list_node(module, &node->data.functionCall.arguments, i), indent + INDENT * 2);
                 }
             }
             break;
@@ -167,15 +172,32 @@ static void printAstNodeRecursive(qak_module module, qak_ast_node *node, int ind
                 printIndent(indent + INDENT);
                 printf("Module statements:\n");
                 for (size_t i = 0; i < node->data.module.statements.numNodes; i++) {
-                    printAstNodeRecursive(module, qak_module_get_ast_node(module, node->data.module.statements.nodes[i]), indent + INDENT * 2);
+                    printAstNodeRecursive(module, qak_module_get_ast_list_node(module, &node->data.module.statements, i), indent + INDENT * 2);
                 }
             }
 
             for (size_t i = 0; i < node->data.module.functions.numNodes; i++) {
-                printAstNodeRecursive(module, qak_module_get_ast_node(module, node->data.module.functions.nodes[i]), indent + INDENT);
+                printAstNodeRecursive(module, qak_module_get_ast_list_node(module, &node->data.module.functions, i), indent + INDENT);
+            }
+            for (size_t i = 0; i < node->data.module.types.numNodes; i++) {
+                printAstNodeRecursive(module, qak_module_get_ast_list_node(module, &node->data.module.types, i), indent + INDENT);
+            }
+            break;
+        }
+        case QakAstTypeDeclaration: {
+            printIndent(indent);
+            printSpan("Type: ", &node->data.typeDeclaration.name);
+            for (size_t i = 0; i < node->data.typeDeclaration.fields.numNodes; i++) {
+                printAstNodeRecursive(module, qak_module_get_ast_list_node(module, &node->data.typeDeclaration.fields, i), indent + INDENT);
             }
             break;
         }
+        case QakAstField: {
+            printIndent(indent);
+            printSpan("Field: ", &node->data.field.name);
+            printAstNodeRecursive(module, qak_module_get_ast_node(module, node->data.field.typeSpecifier), indent + INDENT);
+            break;
+        }
     }
 }
 
@@ -193,19 +215,31 @@ int main() {
 
     printf("Functions: %i\n", astModule->functions.numNodes);
     for (size_t i = 0; i < astModule->functions.numNodes; i++) {
-        printAstNodeRecursive(module, qak_module_get_ast_node(module, astModule->functions.nodes[i]), 1);
+        printAstNodeRecursive(module, qak_module_get_ast_list_node(module, &astModule->functions, i), 1);
     }
 
     printf("Variables: %i\n", astModule->variables.numNodes);
     for (size_t i = 0; i < astModule->variables.numNodes; i++) {
-        printAstNodeRecursive(module, qak_module_get_ast_node(module, astModule->variables.nodes[i]), 1);
+        printAstNodeRecursive(module, qak_module_get_ast_list_node(module, &astModule->variables, i), 1);
     }
 
     printf("Statements: %i\n", astModule->statements.numNodes);
     for (size_t i = 0; i < astModule->statements.numNodes; i++) {
-        printAstNodeRecursive(module, qak_module_get_ast_node(module, astModule->statements.nodes[i]), 1);
+        printAstNodeRecursive(module, qak_module_get_ast_list_node(module, &astModule->statements, i), 1);
     }
 
+    if (astModule->types.numNodes > 0) {
+        printf("Types: %i\n", astModule->types.numNodes);
+        for (size_t i = 0; i < astModule->types.numNodes; i++) {
+            printAstNodeRecursive(module, qak_module_get_ast_list_node(module, &astModule->types, i), 1);
+        }
+    }
+
+    qak_string string;
+    int numStrings = qak_module_get_num_string_literals(module);
+    QAK_CHECK(!qak_module_get_string_literal(module, -1, &string), "Expected negative string index to be out of range");
+    QAK_CHECK(!qak_module_get_string_literal(module, numStrings, &string), "Expected string index %i to be out of range", numStrings);
+
     qak_module_delete(module);
 
     qak_compiler_delete(compiler);
@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include "io.h"
+#include "cache.h"
+#include "test.h"
+
+using namespace qak;
+using namespace qak::ast;
+
+static void checkSameSpan(qak_span &expected, qak_span &actual) {
+    QAK_CHECK(expected.start == actual.start && expected.end == actual.end && expected.startLine == actual.startLine &&
+              expected.endLine == actual.endLine && expected.data.data == actual.data.data && expected.data.length == actual.data.length,
+              "Expected span %u-%u, got %u-%u", expected.start, expected.end, actual.start, actual.end);
+}
+
+static void checkSameNode(qak_ast_node &expected, qak_ast_node &actual) {
+    QAK_CHECK(expected.type == actual.type, "Expected node type %i, got %i", expected.type, actual.type);
+    checkSameSpan(expected.span, actual.span);
+    if (expected.type == QakAstLiteral) {
+        checkSameSpan(expected.data.literal.value, actual.data.literal.value);
+        QAK_CHECK(memcmp(&expected.data.literal.decodedValue, &actual.data.literal.decodedValue, sizeof(qak_literal_value)) == 0,
+                  "Expected same literal value.");
+    } else if (expected.type == QakAstFunction) {
+        checkSameSpan(expected.data.function.name, actual.data.function.name);
+        QAK_CHECK(memcmp(&expected.data.function.parameters, &actual.data.function.parameters, sizeof(qak_ast_node_list)) == 0 &&
+                  memcmp(&expected.data.function.statements, &actual.data.function.statements, sizeof(qak_ast_node_list)) == 0 &&
+                  expected.data.function.returnType == actual.data.function.returnType, "Expected same function.");
+    } else if (expected.type == QakAstBinaryOperation) {
+        checkSameSpan(expected.data.binaryOperation.op, actual.data.binaryOperation.op);
+        QAK_CHECK(expected.data.binaryOperation.left == actual.data.binaryOperation.left &&
+                  expected.data.binaryOperation.right == actual.data.binaryOperation.right, "Expected same binary operation.");
+    }
+}
+
+void testRoundTrip(const char *fileName) {
+    Test test(fileName);
+    HeapAllocator mem;
+    {
+        Source *source = io::readFile(fileName, mem);
+        QAK_CHECK(source != nullptr, "Couldn't read test file %s", fileName);
+
+        Parser parser(mem);
+        BumpAllocator bumpMem(mem);
+        FlatModule module(mem, bumpMem);
+        Errors errors(mem, bumpMem);
+        parser.parse(*source, errors, module);
+        Array<Token> &tokens = parser.tokens();
+
+        uint64_t key = cache::key(*source);
+        char *entryFileName = cache::entryFileName("data", key, mem);
+        QAK_CHECK(cache::write(entryFileName, key, *source, tokens, module, errors, mem), "Couldn't write cache entry %s", entryFileName);
+
+        // The entry only matches the key it was written for.
+        Array<Token> cachedTokens(mem);
+        BumpAllocator cachedMem(mem);
+        FlatModule cachedModule(mem, cachedMem);
+        Errors cachedErrors(mem, cachedMem);
+        QAK_CHECK(!cache::read(entryFileName, key + 1, *source, cachedTokens, cachedModule, cachedErrors, mem), "Expected key mismatch.");
+        QAK_CHECK(!cache::read("data/missing.qakc", key, *source, cachedTokens, cachedModule, cachedErrors, mem), "Expected missing entry.");
+        QAK_CHECK(cache::read(entryFileName, key, *source, cachedTokens, cachedModule, cachedErrors, mem), "Couldn't read cache entry.");
+
+        QAK_CHECK(cachedTokens.size() == tokens.size(), "Expected %zu tokens, got %zu", tokens.size(), cachedTokens.size());
+        for (size_t i = 0; i < tokens.size(); i++) {
+            QAK_CHECK(tokens[i].type == cachedTokens[i].type && tokens[i].start == cachedTokens[i].start && tokens[i].end == cachedTokens[i].end &&
+                      tokens[i].startLine == cachedTokens[i].startLine && tokens[i].endLine == cachedTokens[i].endLine &&
+                      tokens[i].literalIndex == cachedTokens[i].literalIndex, "Expected same token.");
+        }
+
+        QAK_CHECK(cachedModule.nodes.size() == module.nodes.size(), "Expected %zu nodes, got %zu", module.nodes.size(), cachedModule.nodes.size());
+        // The data pointers of spans are not stored in the entry, they are set on first access.
+        QAK_CHECK(module.nodes.size() == 0 || cachedModule.nodes[0].span.data.data == nullptr, "Expected spans without data pointers.");
+        for (size_t i = 0; i < module.nodes.size(); i++) checkSameNode(module.nodes[i], cachedModule.node((qak_ast_node_index) i, *source));
+        QAK_CHECK(cachedModule.lists.size() == module.lists.size(), "Expected %zu list entries, got %zu", module.lists.size(),
+                  cachedModule.lists.size());
+        for (size_t i = 0; i < module.lists.size(); i++) QAK_CHECK(module.lists[i] == cachedModule.lists[i], "Expected same list entry.");
+
+        QAK_CHECK(cachedModule.strings.size() == module.strings.size(), "Expected %zu strings, got %zu", module.strings.size(),
+                  cachedModule.strings.size());
+        for (size_t i = 0; i < module.strings.size(); i++) {
+            InternedString &string = module.strings[i], &cachedString = cachedModule.strings[i];
+            QAK_CHECK(string.length == cachedString.length && string.hash == cachedString.hash &&
+                      (string.length == 0 || memcmp(string.data, cachedString.data, string.length) == 0) && cachedString.data[string.length] == 0,
+                      "Expected same null-terminated string.");
+        }
+
+        Array<Error> &errorList = errors.getErrors(), &cachedErrorList = cachedErrors.getErrors();
+        QAK_CHECK(cachedErrorList.size() == errorList.size(), "Expected %zu errors, got %zu", errorList.size(), cachedErrorList.size());
+        for (size_t i = 0; i < errorList.size(); i++) {
+            QAK_CHECK(errorList[i].span.start == cachedErrorList[i].span.start && strcmp(errorList[i].message, cachedErrorList[i].message) == 0,
+                      "Expected error '%s', got '%s'", errorList[i].message, cachedErrorList[i].message);
+        }
+
+        remove(entryFileName);
+        mem.free(entryFileName, QAK_SRC_LOC);
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+/* Overwrites each 32-bit word after the magic of an entry in turn. Every read of a corrupted entry must
+ * either fail or produce a module whose indices and strings lie within it. */
+void testCorruptEntries(const char *fileName) {
+    Test test("Corrupt entries");
+    HeapAllocator mem;
+    {
+        Source *source = io::readFile(fileName, mem);
+        QAK_CHECK(source != nullptr, "Couldn't read test file %s", fileName);
+
+        Parser parser(mem);
+        BumpAllocator bumpMem(mem);
+        FlatModule module(mem, bumpMem);
+        Errors errors(mem, bumpMem);
+        parser.parse(*source, errors, module);
+
+        uint64_t key = cache::key(*source);
+        char *entryFileName = cache::entryFileName("data", key, mem);
+        QAK_CHECK(cache::write(entryFileName, key, *source, parser.tokens(), module, errors, mem), "Couldn't write cache entry %s", entryFileName);
+        Source *entry = io::readFile(entryFileName, mem);
+        QAK_CHECK(entry != nullptr, "Couldn't read cache entry %s", entryFileName);
+
+        size_t numRejected = 0;
+        for (size_t offset = 4; offset + 4 <= entry->size; offset += 4) {
+            uint32_t word;
+            memcpy(&word, entry->data + offset, 4);
+            uint32_t corrupted = 0x7fffffff;
+            memcpy(entry->data + offset, &corrupted, 4);
+            QAK_CHECK(io::writeFile(entryFileName, entry->data, entry->size, mem), "Couldn't write cache entry %s", entryFileName);
+            memcpy(entry->data + offset, &word, 4);
+
+            Array<Token> cachedTokens(mem);
+            BumpAllocator cachedMem(mem);
+            FlatModule cachedModule(mem, cachedMem);
+            Errors cachedErrors(mem, cachedMem);
+            if (!cache::read(entryFileName, key, *source, cachedTokens, cachedModule, cachedErrors, mem)) {
+                QAK_CHECK(cachedTokens.size() == 0 && cachedModule.nodes.size() == 0 && cachedErrors.getErrors().size() == 0,
+                          "Expected a rejected entry to leave the module unchanged.");
+                numRejected++;
+                continue;
+            }
+
+            QAK_CHECK(cachedModule.nodes.size() == 0 || cachedModule.nodes[cachedModule.root()].type == QakAstModule, "Expected a module node.");
+            for (size_t i = 0; i < cachedModule.lists.size(); i++) {
+                QAK_CHECK(cachedModule.lists[i] >= 0 && (size_t) cachedModule.lists[i] < cachedModule.nodes.size(), "Expected list entry in range.");
+            }
+            for (size_t i = 0; i < cachedModule.strings.size(); i++) {
+                QAK_CHECK(cachedModule.strings[i].data[cachedModule.strings[i].length] == 0, "Expected null-terminated string.");
+            }
+        }
+        QAK_CHECK(numRejected > 0, "Expected corrupt entries to be rejected.");
+        printf("Rejected %zu of %zu corrupted entries\n", numRejected, entry->size / 4 - 1);
+
+        remove(entryFileName);
+        mem.freeObject(entry, QAK_SRC_LOC);
+        mem.free(entryFileName, QAK_SRC_LOC);
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+void testCompileFile() {
+    Test test("C API cache");
+    HeapAllocator mem;
+    const char *fileName = "data/parser_errors.qak";
+    Source *source = io::readFile(fileName, mem);
+    QAK_CHECK(source != nullptr, "Couldn't read test file %s", fileName);
+    char *entryFileName = cache::entryFileName("data", cache::key(*source), mem);
+    remove(entryFileName);
+
+    qak_compiler compiler = qak_compiler_new();
+    qak_module module = qak_compiler_compile_file(compiler, fileName);
+    qak_compiler_set_cache_directory(compiler, "data");
+    qak_module missed = qak_compiler_compile_file(compiler, fileName);
+    FILE *entry = fopen(entryFileName, "rb");
+    QAK_CHECK(entry != nullptr, "Expected cache entry %s", entryFileName);
+    fclose(entry);
+    qak_module cached = qak_compiler_compile_file(compiler, fileName);
+
+    qak_module modules[] = {missed, cached};
+    for (int i = 0; i < 2; i++) {
+        QAK_CHECK(qak_module_get_num_tokens(modules[i]) == qak_module_get_num_tokens(module), "Expected same number of tokens.");
+        QAK_CHECK(qak_module_get_num_errors(modules[i]) == qak_module_get_num_errors(module), "Expected same number of errors.");
+        QAK_CHECK(qak_module_get_num_string_literals(modules[i]) == qak_module_get_num_string_literals(module), "Expected same strings.");
+        qak_ast_module *ast = qak_module_get_ast(modules[i]), *expectedAst = qak_module_get_ast(module);
+        QAK_CHECK(ast && expectedAst && ast->statements.numNodes == expectedAst->statements.numNodes &&
+                  ast->functions.numNodes == expectedAst->functions.numNodes, "Expected same module.");
+        QAK_CHECK(ast->name.data.length == expectedAst->name.data.length &&
+                  memcmp(ast->name.data.data, expectedAst->name.data.data, ast->name.data.length) == 0, "Expected same module name.");
+        qak_ast_node *statement = qak_module_get_ast_list_node(modules[i], &ast->statements, 0);
+        qak_ast_node *expectedStatement = qak_module_get_ast_list_node(module, &expectedAst->statements, 0);
+        QAK_CHECK(statement->span.data.length == expectedStatement->span.data.length &&
+                  memcmp(statement->span.data.data, expectedStatement->span.data.data, statement->span.data.length) == 0,
+                  "Expected same statement.");
+    }
+    qak_module_print_errors(cached);
+
+    qak_module_delete(cached);
+    qak_module_delete(missed);
+    qak_module_delete(module);
+    qak_compiler_delete(compiler);
+
+    remove(entryFileName);
+    mem.free(entryFileName, QAK_SRC_LOC);
+    mem.freeObject(source, QAK_SRC_LOC);
+}
+
+int main() {
+    testRoundTrip("data/parser_v_0_1.qak");
+    testRoundTrip("data/parser_strings.qak");
+    testRoundTrip("data/parser_errors.qak");
+    testCorruptEntries("data/parser_strings.qak");
+    testCompileFile();
+    return 0;
+}
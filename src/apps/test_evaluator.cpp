@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <string.h>
+#include "io.h"
+#include "resolver.h"
+#include "folder.h"
+#include "evaluator.h"
+#include "qak.h"
+#include "test.h"
+
+using namespace qak;
+using namespace qak::ast;
+
+/* Evaluates the file with the Evaluator, then compiles and runs it with the Interpreter. Both must
+ * succeed or fail alike, and agree on the result and the values of all module variables. */
+static void differential(const char *fileName, bool expectError) {
+    HeapAllocator mem;
+    {
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        TypeTable types(mem);
+        Source *source = io::readFile(fileName, mem);
+        QAK_CHECK(source != nullptr, "Couldn't read test file %s", fileName);
+
+        Parser parser(mem);
+        FlatModule flat(mem, moduleMem);
+        bool parsed = parser.parse(*source, errors, flat);
+        if (errors.hasErrors()) errors.print();
+        QAK_CHECK(parsed, "Expected a flat module.");
+        Module *module = parser.parse(*source, errors, &moduleMem);
+        QAK_CHECK(module && !errors.hasErrors(), "Expected module without parse errors.");
+        Resolver resolver(mem);
+        QAK_CHECK(resolver.resolve(module, errors), "Expected module without resolver errors.");
+        TypeChecker checker(mem);
+        bool checked = checker.check(module, types, errors);
+        if (errors.hasErrors()) errors.print();
+        QAK_CHECK(checked, "Expected module without type errors.");
+
+        Evaluator evaluator(mem, 64 * 1024);
+        Errors evaluatorErrors(mem, moduleMem);
+        bool evaluated = evaluator.evaluate(flat, module, types, evaluatorErrors);
+
+        ConstantFolder folder(mem);
+        folder.fold(module);
+        BytecodeCompiler compiler(mem);
+        bytecode::Program *program = compiler.compile(module, types, errors);
+        QAK_CHECK(program != nullptr, "Expected a program.");
+        Interpreter interpreter(mem, 64 * 1024);
+        Errors interpreterErrors(mem, moduleMem);
+        bool ran = interpreter.run(program, interpreterErrors);
+
+        QAK_CHECK(evaluated == !expectError && ran == !expectError, "%s: expected %s, evaluator %s, interpreter %s", fileName,
+                  expectError ? "an error" : "no error", evaluated ? "succeeded" : "failed", ran ? "succeeded" : "failed");
+        if (expectError) {
+            evaluatorErrors.print();
+            Error &expected = interpreterErrors.getErrors()[0], &actual = evaluatorErrors.getErrors()[0];
+            QAK_CHECK(strcmp(expected.message, actual.message) == 0, "Expected error '%s', got '%s'", expected.message, actual.message);
+            QAK_CHECK(expected.span.startLine == actual.span.startLine, "Expected error on line %u, got %u", expected.span.startLine,
+                      actual.span.startLine);
+        } else {
+            QAK_CHECK(interpreter.resultType() == evaluator.resultType(), "Expected result type %s, got %s", types.name(interpreter.resultType()),
+                      types.name(evaluator.resultType()));
+            QAK_CHECK(interpreter.result().i == evaluator.result().i, "Expected result %lld, got %lld", (long long) interpreter.result().i,
+                      (long long) evaluator.result().i);
+            for (uint32_t i = 0; i < module->variables.size(); i++) {
+                Token &name = module->tokens[module->variables[i]->name];
+                QAK_CHECK(interpreter.global(i).i == evaluator.global(i).i, "Expected '%.*s' to be %lld (%g), got %lld (%g)", (int) name.length(),
+                          (const char *) name.source.data + name.start, (long long) interpreter.global(i).i, interpreter.global(i).f,
+                          (long long) evaluator.global(i).i, evaluator.global(i).f);
+            }
+        }
+        printf("%s: evaluator and interpreter agree\n", fileName);
+
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+void testDifferential() {
+    Test test("Evaluator - differential");
+    differential("data/evaluator.qak", false);
+    differential("data/interpreter.qak", false);
+    differential("data/folder.qak", true);
+    differential("data/interpreter_errors.qak", true);
+    differential("data/interpreter_overflow.qak", true);
+}
+
+void testCApi() {
+    Test test("Evaluator - C API");
+    qak_compiler compiler = qak_compiler_new();
+    qak_module module = qak_compiler_compile_file(compiler, "data/interpreter.qak");
+    QAK_CHECK(module, "Expected a module.");
+    qak_value result;
+    QAK_CHECK(qak_module_eval(module, &result), "Expected the module to evaluate.");
+    QAK_CHECK(result.type == QakValueInt32 && result.value.intValue == 9165, "Expected 9165, got %i", result.value.intValue);
+
+    // Running compiles a tree of its own, the module can still be evaluated afterwards.
+    QAK_CHECK(qak_module_run(module, &result), "Expected the module to run.");
+    QAK_CHECK(qak_module_eval(module, &result), "Expected the module to evaluate.");
+    QAK_CHECK(result.type == QakValueInt32 && result.value.intValue == 9165, "Expected 9165, got %i", result.value.intValue);
+    qak_module_delete(module);
+
+    module = qak_compiler_compile_source(compiler, "errors.qak", "module errors\nvar x: int32 = true");
+    QAK_CHECK(!qak_module_eval(module, &result), "Expected the module to fail.");
+    QAK_CHECK(!qak_module_run(module, &result), "Expected the module to fail.");
+    QAK_CHECK(qak_module_get_num_errors(module) == 1, "Expected 1 error, got %i", qak_module_get_num_errors(module));
+    qak_module_delete(module);
+
+    // The minimum of an integer type is written as the negation of a literal one larger than the maximum.
+    module = qak_compiler_compile_source(compiler, "minimum.qak", "module minimum\nvar x = -2147483648\nreturn x");
+    QAK_CHECK(qak_module_eval(module, &result), "Expected the module to evaluate.");
+    QAK_CHECK(result.type == QakValueInt32 && result.value.intValue == INT32_MIN, "Expected INT32_MIN, got %i", result.value.intValue);
+    QAK_CHECK(qak_module_run(module, &result), "Expected the module to run.");
+    QAK_CHECK(result.type == QakValueInt32 && result.value.intValue == INT32_MIN, "Expected INT32_MIN, got %i", result.value.intValue);
+    qak_module_delete(module);
+
+    module = qak_compiler_compile_source(compiler, "minimum.qak", "module minimum\nvar x = -9223372036854775808l\nreturn x - 2147483648");
+    QAK_CHECK(!qak_module_eval(module, &result), "Expected the module to fail.");
+    QAK_CHECK(qak_module_get_num_errors(module) == 1, "Expected 1 error, got %i", qak_module_get_num_errors(module));
+    qak_module_print_errors(module);
+    qak_module_delete(module);
+
+    // Runtime errors are not compile errors, the module can still be evaluated and queried afterwards.
+    module = qak_compiler_compile_source(compiler, "runtime.qak",
+                                         "module runtime\ntype Point\n    x: int32\nend\nvar zero = 0\nvar x = 10 / zero");
+    QAK_CHECK(!qak_module_run(module, &result), "Expected the module to fail.");
+    QAK_CHECK(qak_module_get_num_errors(module) == 1, "Expected 1 error, got %i", qak_module_get_num_errors(module));
+    QAK_CHECK(!qak_module_eval(module, &result), "Expected the module to fail.");
+    QAK_CHECK(qak_module_get_num_errors(module) == 2, "Expected 2 errors, got %i", qak_module_get_num_errors(module));
+    QAK_CHECK(qak_module_get_num_types(module) == 1, "Expected 1 type, got %i", qak_module_get_num_types(module));
+    qak_module_delete(module);
+    qak_compiler_delete(compiler);
+}
+
+static void benchmark(const char *fileName) {
+    HeapAllocator mem;
+    {
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        TypeTable types(mem);
+        Source *source = io::readFile(fileName, mem);
+        QAK_CHECK(source != nullptr, "Couldn't read test file %s", fileName);
+        Parser parser(mem);
+        FlatModule flat(mem, moduleMem);
+        parser.parse(*source, errors, flat);
+        Module *module = parser.parse(*source, errors, &moduleMem);
+        Resolver resolver(mem);
+        resolver.resolve(module, errors);
+        TypeChecker checker(mem);
+        checker.check(module, types, errors);
+        QAK_CHECK(!errors.hasErrors(), "Expected no errors.");
+
+        Evaluator evaluator(mem);
+        double start = io::timeMillis();
+        QAK_CHECK(evaluator.evaluate(flat, module, types, errors), "Expected the module to evaluate.");
+        double evaluatorTime = io::timeMillis() - start;
+
+        ConstantFolder folder(mem);
+        folder.fold(module);
+        BytecodeCompiler compiler(mem);
+        bytecode::Program *program = compiler.compile(module, types, errors);
+        Interpreter interpreter(mem);
+        start = io::timeMillis();
+        QAK_CHECK(interpreter.run(program, errors), "Expected the program to run.");
+        double interpreterTime = io::timeMillis() - start;
+        QAK_CHECK(interpreter.result().i == evaluator.result().i, "Expected the same result.");
+        printf("%s: evaluator %f ms, interpreter %f ms (%.1fx)\n", fileName, evaluatorTime, interpreterTime, evaluatorTime / interpreterTime);
+
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+void testBenchmark() {
+    Test test("Evaluator - benchmark");
+    benchmark("data/interpreter_benchmark_arithmetic.qak");
+    benchmark("data/interpreter_benchmark_calls.qak");
+}
+
+int main() {
+    testDifferential();
+    testCApi();
+    testBenchmark();
+    return 0;
+}
@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <string.h>
+#include "io.h"
+#include "resolver.h"
+#include "folder.h"
+#include "visitor.h"
+#include "test.h"
+
+using namespace qak;
+using namespace qak::ast;
+
+static Module *parseAndCheck(const char *fileName, HeapAllocator &mem, BumpAllocator &moduleMem, TypeTable &types, Errors &errors, Source **source) {
+    *source = io::readFile(fileName, mem);
+    QAK_CHECK(*source != nullptr, "Couldn't read test file %s", fileName);
+    Parser parser(mem);
+    Module *module = parser.parse(**source, errors, &moduleMem);
+    QAK_CHECK(module != nullptr, "Expected a module.");
+    Resolver resolver(mem);
+    resolver.resolve(module, errors);
+    TypeChecker checker(mem);
+    checker.check(module, types, errors);
+    return module;
+}
+
+/* Counts the nodes of a tree. */
+struct NodeCounter : public Walker<NodeCounter> {
+    size_t numNodes;
+
+    NodeCounter(HeapAllocator &mem) : Walker<NodeCounter>(mem), numNodes(0) {}
+
+    bool visitNode(AstNode *) {
+        numNodes++;
+        return true;
+    }
+};
+
+static size_t countNodes(AstNode *node, HeapAllocator &mem) {
+    NodeCounter counter(mem);
+    counter.walk(node);
+    return counter.numNodes;
+}
+
+static Literal *checkLiteral(Expression *expression, TokenType type) {
+    QAK_CHECK(expression->astType == AstLiteral, "Expected a literal, got node type %i", expression->astType);
+    Literal *literal = (Literal *) expression;
+    QAK_CHECK(literal->type == type, "Expected literal type %s, got %s", tokenizer::tokenTypeToString(type), tokenizer::tokenTypeToString(literal->type));
+    return literal;
+}
+
+static void checkInteger(Expression *expression, TokenType type, int64_t expected) {
+    Literal *literal = checkLiteral(expression, type);
+    int64_t value = type == ByteLiteral ? literal->decodedValue.byteValue : type == IntegerLiteral ? literal->decodedValue.intValue
+                                                                                                      : literal->decodedValue.longValue;
+    QAK_CHECK(value == expected, "Expected %lld, got %lld", (long long) expected, (long long) value);
+}
+
+static void checkFloat(Expression *expression, float expected) {
+    Literal *literal = checkLiteral(expression, FloatLiteral);
+    QAK_CHECK(literal->decodedValue.floatValue == expected, "Expected %f, got %f", expected, literal->decodedValue.floatValue);
+}
+
+static Expression *initializer(Module *module, size_t variable) {
+    return module->variables[variable]->initializerExpression;
+}
+
+void testFold() {
+    Test test("Constant folder - folding");
+    HeapAllocator mem;
+    {
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        TypeTable types(mem);
+        Source *source;
+        Module *module = parseAndCheck("data/folder.qak", mem, moduleMem, types, errors, &source);
+        QAK_CHECK(!errors.hasErrors(), "Expected no errors.");
+        if (errors.hasErrors()) errors.print();
+        QAK_CHECK(module->statements.size() == 19, "Expected 19 statements, got %zu", module->statements.size());
+
+        ConstantFolder folder(mem);
+        folder.fold(module);
+        {
+            HeapAllocator printMem;
+            parser::printAstNode(module, printMem);
+        }
+
+        // Integer arithmetic wraps around, integers widen to floats.
+        checkInteger(initializer(module, 0), ByteLiteral, -128);
+        checkInteger(initializer(module, 1), IntegerLiteral, 14);
+        checkFloat(initializer(module, 2), 3);
+        checkFloat(initializer(module, 3), 1.5f);
+        QAK_CHECK(checkLiteral(initializer(module, 4), BooleanLiteral)->decodedValue.booleanValue, "Expected true.");
+        checkInteger(initializer(module, 5), IntegerLiteral, 15);
+        checkInteger(initializer(module, 6), LongLiteral, INT64_MIN);
+        checkInteger(initializer(module, 7), LongLiteral, INT64_MIN);
+        QAK_CHECK(initializer(module, 8)->astType == AstBinaryOperation, "Expected division by zero to not be folded.");
+        checkInteger(initializer(module, 11), IntegerLiteral, 20);
+        checkFloat(initializer(module, 12), 1);
+
+        // Variables without an initializer are propagated with their type's default value.
+        Literal *offset = checkLiteral(initializer(module, 14), ShortLiteral);
+        QAK_CHECK(offset->decodedValue.shortValue == 3, "Expected 3, got %i", offset->decodedValue.shortValue);
+
+        // Folded literals keep the type of the expression they replace.
+        QAK_CHECK(module->expressionTypes[initializer(module, 0)->id] == TypeInt8, "Expected int8 literal.");
+
+        // The while statement is removed, the first if statement is replaced by its true block.
+        QAK_CHECK(module->statements.size() == 18, "Expected 18 statements, got %zu", module->statements.size());
+        BinaryOperation *assignment = (BinaryOperation *) module->statements[15];
+        QAK_CHECK(assignment->astType == AstBinaryOperation, "Expected the assignment of the if statement.");
+        checkInteger(((BinaryOperation *) assignment->right)->right, IntegerLiteral, 20);
+
+        // The if statement declaring a variable in its else block is kept without its true block.
+        If *ifNode = (If *) module->statements[16];
+        QAK_CHECK(ifNode->astType == AstIf, "Expected an if statement.");
+        QAK_CHECK(ifNode->trueBlock.size() == 0 && ifNode->falseBlock.size() == 2, "Expected only the else block.");
+        checkInteger(((BinaryOperation *) ((BinaryOperation *) ifNode->falseBlock[1])->right)->right, IntegerLiteral, 4);
+
+        // Assigned variables are not propagated, module variables are not propagated to functions.
+        While *loop = (While *) module->statements[17];
+        BinaryOperation *condition = (BinaryOperation *) loop->condition;
+        QAK_CHECK(condition->left->astType == AstVariableAccess, "Expected assigned variable to be kept.");
+        checkInteger(condition->right, IntegerLiteral, 10);
+        Return *returnValue = (Return *) module->functions[0]->statements[1];
+        BinaryOperation *sum = (BinaryOperation *) returnValue->returnValue;
+        checkInteger(((BinaryOperation *) sum->left)->right, IntegerLiteral, 2);
+        QAK_CHECK(sum->right->astType == AstVariableAccess, "Expected module variable to be kept in function.");
+
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+/* A chain of additions of literals folds into a single literal without recursion, see generateChain(). */
+void testDeepExpression() {
+    Test test("Constant folder - deep expression");
+    HeapAllocator mem;
+    {
+        Array<char> text(mem);
+        generateChain(text, "module deep\nvar x = 1", " + 1", 200000);
+        Source *source = Source::fromMemory(mem, "deep.qak", text.buffer());
+        Parser parser(mem);
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        Module *module = parser.parse(*source, errors, &moduleMem);
+        Resolver resolver(mem);
+        QAK_CHECK(module && resolver.resolve(module, errors), "Expected module without errors.");
+        TypeTable types(mem);
+        TypeChecker checker(mem);
+        QAK_CHECK(checker.check(module, types, errors), "Expected no type errors.");
+
+        ConstantFolder folder(mem);
+        folder.fold(module);
+        checkInteger(initializer(module, 0), IntegerLiteral, 200001);
+
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+void testBenchmark() {
+    Test test("Constant folder - benchmark");
+    HeapAllocator mem;
+    {
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        TypeTable types(mem);
+        Source *source;
+
+        // The benchmark has unknown variables and functions, their expressions are not folded.
+        Module *module = parseAndCheck("data/parser_benchmark.qak", mem, moduleMem, types, errors, &source);
+        size_t numNodes = countNodes(module, mem);
+        ConstantFolder folder(mem);
+        folder.fold(module);
+        size_t numFolded = countNodes(module, mem);
+        QAK_CHECK(numFolded < numNodes, "Expected fewer nodes after folding.");
+        printf("Nodes before folding: %zu, after folding: %zu (%.1f%% fewer)\n", numNodes, numFolded, 100.0 * (numNodes - numFolded) / numNodes);
+
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+int main() {
+    testFold();
+    testDeepExpression();
+    testBenchmark();
+    return 0;
+}
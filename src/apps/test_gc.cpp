@@ -0,0 +1,375 @@
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include "io.h"
+#include "gc.h"
+#include "test.h"
+
+using namespace qak;
+using namespace qak::gc;
+
+struct Node {
+    int64_t value;
+    void *next;
+    void *other;
+};
+
+static const uint32_t nodeReferences[] = {offsetof(Node, next), offsetof(Node, other)};
+
+static uint32_t addNodeType(GcHeap &heap) {
+    return heap.addType("Node", sizeof(Node), nodeReferences, 2);
+}
+
+/* Allocates a node referencing the next node. */
+static void *allocNode(GcHeap &heap, uint32_t type, int64_t value, void **next) {
+    Node *node = (Node *) heap.alloc(type);
+    node->value = value;
+    heap.write(node, &node->next, *next);
+    return node;
+}
+
+/* Returns the sum of the values of the nodes reachable from the node. */
+static int64_t sumTree(HeapAllocator &mem, void *root) {
+    int64_t sum = 0;
+    Array<Node *> stack(mem);
+    if (root) stack.add((Node *) root);
+    while (stack.size() > 0) {
+        Node *node = stack[stack.size() - 1];
+        stack.removeAt(stack.size() - 1);
+        sum += node->value;
+        if (node->next) stack.add((Node *) node->next);
+        if (node->other) stack.add((Node *) node->other);
+    }
+    return sum;
+}
+
+/* Builds a complete binary tree of count nodes, rooted in the slot. */
+static void buildTree(GcHeap &heap, uint32_t type, size_t count, void **root) {
+    void *nodes = heap.alloc(TypeReferences, (uint32_t) (count * sizeof(void *)));
+    heap.addRoot(&nodes);
+    for (size_t i = count; i > 0; i--) {
+        size_t index = i - 1;
+        Node *node = (Node *) heap.alloc(type);
+        void **slots = (void **) nodes;
+        node->value = (int64_t) index;
+        if (index * 2 + 1 < count) heap.write(node, &node->next, slots[index * 2 + 1]);
+        if (index * 2 + 2 < count) heap.write(node, &node->other, slots[index * 2 + 2]);
+        heap.write(nodes, &slots[index], node);
+    }
+    *root = ((void **) nodes)[0];
+    heap.removeRoot(&nodes);
+}
+
+void testAllocation() {
+    Test test("GC - allocation");
+    HeapAllocator mem;
+    {
+        GcHeap heap(mem, 64 * 1024);
+        uint32_t type = addNodeType(heap);
+        void *head = nullptr;
+        heap.addRoot(&head);
+        for (int64_t i = 0; i < 10000; i++) {
+            head = allocNode(heap, type, i, &head);
+            for (int j = 0; j < 5; j++) heap.alloc(TypeBytes, 40);
+        }
+        QAK_CHECK(heap.pauses().size() > 0, "Expected collections.");
+        QAK_CHECK(heap.oldBytes() > 0, "Expected promoted nodes.");
+
+        int64_t expected = 9999;
+        for (Node *node = (Node *) head; node; node = (Node *) node->next) {
+            QAK_CHECK(node->value == expected, "Expected value %lli, got %lli.", (long long) expected, (long long) node->value);
+            QAK_CHECK(GcHeap::type(node) == type, "Expected a node.");
+            expected--;
+        }
+        QAK_CHECK(expected == -1, "Expected 10000 nodes.");
+
+        Node *node = (Node *) heap.alloc(type);
+        QAK_CHECK(node->value == 0 && node->next == nullptr && node->other == nullptr, "Expected a zeroed object.");
+        QAK_CHECK(GcHeap::size(heap.alloc(TypeBytes, 3)) == 8, "Expected the size to be rounded up to 8 bytes.");
+        heap.removeRoot(&head);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+void testWriteBarrier() {
+    Test test("GC - write barrier");
+    HeapAllocator mem;
+    {
+        GcHeap heap(mem, 64 * 1024);
+        uint32_t type = addNodeType(heap);
+        Node *parent = (Node *) heap.alloc(type);
+        heap.addRoot((void **) &parent);
+        QAK_CHECK(heap.isYoung(parent), "Expected a nursery object.");
+        heap.collect(false);
+        QAK_CHECK(!heap.isYoung(parent), "Expected the object to be promoted.");
+
+        // The child is only referenced by the old parent, which the barrier remembers.
+        Node *child = (Node *) heap.alloc(type);
+        child->value = 42;
+        heap.write(parent, &parent->next, child);
+        heap.write(parent, &parent->other, child);
+        heap.collect(false);
+        child = (Node *) parent->next;
+        QAK_CHECK(!heap.isYoung(child), "Expected the child to be promoted.");
+        QAK_CHECK(child->value == 42, "Expected the value of the child to be kept.");
+        QAK_CHECK(parent->other == child, "Expected both references to be updated.");
+
+        // Old objects referencing old objects are not remembered.
+        size_t promoted = heap.pauses()[heap.pauses().size() - 1].promotedBytes;
+        QAK_CHECK(promoted == sizeof(Node) + sizeof(Header), "Expected only the child to be promoted, got %zu bytes.", promoted);
+        heap.write(parent, &parent->other, nullptr);
+        heap.collect(false);
+        QAK_CHECK(heap.pauses()[heap.pauses().size() - 1].promotedBytes == 0, "Expected nothing to be promoted.");
+        heap.removeRoot((void **) &parent);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+void testMajor() {
+    Test test("GC - major collection");
+    HeapAllocator mem;
+    {
+        GcHeap heap(mem, 64 * 1024);
+        uint32_t type = addNodeType(heap);
+        size_t nodeSize = sizeof(Node) + sizeof(Header);
+        void *kept = nullptr, *garbage = nullptr;
+        heap.addRoot(&kept);
+        heap.addRoot(&garbage);
+        for (int64_t i = 0; i < 1000; i++) kept = allocNode(heap, type, i, &kept);
+        for (int64_t i = 0; i < 5000; i++) garbage = allocNode(heap, type, i, &garbage);
+
+        // Two old objects referencing each other.
+        Node *a = (Node *) heap.alloc(type);
+        heap.write(garbage, &((Node *) garbage)->other, a);
+        Node *b = (Node *) heap.alloc(type);
+        a = (Node *) ((Node *) garbage)->other;
+        heap.write(a, &a->next, b);
+        heap.write(b, &b->next, a);
+        heap.collect(false);
+        QAK_CHECK(heap.oldBytes() == 6002 * nodeSize, "Expected all nodes to be promoted, got %zu bytes.", heap.oldBytes());
+
+        garbage = nullptr;
+        heap.collect(true);
+        Pause &pause = heap.pauses()[heap.pauses().size() - 1];
+        QAK_CHECK(pause.isMajor, "Expected a major collection.");
+        QAK_CHECK(heap.oldBytes() == 1000 * nodeSize, "Expected only the kept nodes to survive, got %zu bytes.", heap.oldBytes());
+        QAK_CHECK(pause.freedBytes == 5002 * nodeSize, "Expected the garbage to be freed, got %zu bytes.", pause.freedBytes);
+        QAK_CHECK(sumTree(mem, kept) == 999 * 1000 / 2, "Expected the kept nodes to be intact.");
+
+        // Freed cells are reused for promoted objects.
+        for (int64_t i = 0; i < 1000; i++) garbage = allocNode(heap, type, i, &garbage);
+        heap.collect(false);
+        QAK_CHECK(heap.oldBytes() == 2000 * nodeSize, "Expected 2000 nodes, got %zu bytes.", heap.oldBytes());
+        QAK_CHECK(sumTree(mem, garbage) == 999 * 1000 / 2, "Expected the reused cells to hold the promoted nodes.");
+        heap.removeRoot(&garbage);
+        heap.removeRoot(&kept);
+        heap.collect(true);
+        QAK_CHECK(heap.oldBytes() == 0, "Expected an empty heap, got %zu bytes.", heap.oldBytes());
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+void testLargeObjects() {
+    Test test("GC - large objects");
+    HeapAllocator mem;
+    {
+        GcHeap heap(mem, 64 * 1024);
+        uint32_t type = addNodeType(heap);
+        void *array = heap.alloc(TypeReferences, 100 * sizeof(void *));
+        heap.addRoot(&array);
+        QAK_CHECK(!heap.isYoung(array), "Expected large objects to be allocated in the old generation.");
+        for (int64_t i = 0; i < 100; i++) {
+            Node *node = (Node *) heap.alloc(type);
+            node->value = i;
+            heap.write(array, &((void **) array)[i], node);
+        }
+        heap.alloc(TypeBytes, 4096);
+        heap.collect(true);
+
+        void **slots = (void **) array;
+        for (int64_t i = 0; i < 100; i++) {
+            QAK_CHECK(!heap.isYoung(slots[i]), "Expected the element to be promoted.");
+            QAK_CHECK(((Node *) slots[i])->value == i, "Expected the value of element %lli to be kept.", (long long) i);
+        }
+        size_t expected = 100 * sizeof(void *) + sizeof(Header) + 100 * (sizeof(Node) + sizeof(Header));
+        QAK_CHECK(heap.oldBytes() == expected, "Expected the unreferenced large object to be freed, got %zu bytes.", heap.oldBytes());
+        heap.removeRoot(&array);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+void testRoots() {
+    Test test("GC - roots");
+    HeapAllocator mem;
+    {
+        GcHeap heap(mem, 64 * 1024);
+        uint32_t type = addNodeType(heap);
+        void *registers[16];
+        memset(registers, 0, sizeof(registers));
+        heap.addRoots(registers, 16);
+        void *single = nullptr;
+        heap.addRoot(&single);
+        for (int64_t i = 0; i < 16; i++) {
+            Node *node = (Node *) heap.alloc(type);
+            node->value = i;
+            registers[i] = node;
+        }
+        single = heap.alloc(type);
+        heap.collect(true);
+        size_t nodeSize = sizeof(Node) + sizeof(Header);
+        QAK_CHECK(heap.oldBytes() == 17 * nodeSize, "Expected all rooted nodes to survive, got %zu bytes.", heap.oldBytes());
+        for (int64_t i = 0; i < 16; i++) QAK_CHECK(((Node *) registers[i])->value == i, "Expected the register to be updated.");
+
+        heap.removeRoots(registers);
+        heap.collect(true);
+        QAK_CHECK(heap.oldBytes() == nodeSize, "Expected the unregistered nodes to be freed, got %zu bytes.", heap.oldBytes());
+        heap.removeRoot(&single);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+/* Runs the workers one after the other on the calling thread, counting them. */
+static void runSequentially(void (*work)(void *data, uint32_t worker), void *data, uint32_t numWorkers, void *userData) {
+    for (uint32_t i = 0; i < numWorkers; i++) {
+        work(data, i);
+        (*(uint32_t *) userData)++;
+    }
+}
+
+void testParallelMarking() {
+    Test test("GC - parallel marking");
+    HeapAllocator mem;
+    {
+        GcHeap heap(mem);
+        uint32_t type = addNodeType(heap);
+        size_t count = 100000;
+        void *tree = nullptr, *garbage = nullptr;
+        heap.addRoot(&tree);
+        heap.addRoot(&garbage);
+        buildTree(heap, type, count, &tree);
+        int64_t expectedSum = (int64_t) (count * (count - 1) / 2);
+        size_t expected = count * (sizeof(Node) + sizeof(Header));
+
+        uint32_t numThreads[] = {1, 2, 4, 8};
+        for (size_t i = 0; i < sizeof(numThreads) / sizeof(numThreads[0]); i++) {
+            heap.setMarkThreads(numThreads[i]);
+            buildTree(heap, type, 20000, &garbage);
+            garbage = nullptr;
+            heap.collect(true);
+            QAK_CHECK(heap.oldBytes() == expected, "Expected only the tree to survive with %u threads, got %zu bytes.", numThreads[i],
+                      heap.oldBytes());
+            QAK_CHECK(sumTree(mem, tree) == expectedSum, "Expected the tree to be intact with %u threads.", numThreads[i]);
+        }
+
+        uint32_t numRuns = 0;
+        heap.setMarkThreads(3, runSequentially, &numRuns);
+        buildTree(heap, type, 20000, &garbage);
+        garbage = nullptr;
+        heap.collect(true);
+        QAK_CHECK(numRuns == 3, "Expected 3 workers to run, got %u.", numRuns);
+        QAK_CHECK(heap.oldBytes() == expected, "Expected only the tree to survive, got %zu bytes.", heap.oldBytes());
+        QAK_CHECK(sumTree(mem, tree) == expectedSum, "Expected the tree to be intact.");
+        heap.removeRoot(&garbage);
+        heap.removeRoot(&tree);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+void testAllocationBenchmark() {
+    Test test("GC - allocation benchmark");
+    HeapAllocator mem;
+    {
+        size_t count = 5000000;
+        GcHeap heap(mem);
+        uint32_t type = addNodeType(heap);
+
+        // Every 100th node is kept for a while in a ring of 4096 slots, so some survive minor collections.
+        void *ring = heap.alloc(TypeReferences, 4096 * sizeof(void *));
+        heap.addRoot(&ring);
+        double start = io::timeMillis();
+        for (size_t i = 0; i < count; i++) {
+            Node *node = (Node *) heap.alloc(type);
+            node->value = (int64_t) i;
+            if (i % 100 == 0) heap.write(ring, &((void **) ring)[(i / 100) % 4096], node);
+        }
+        double gcTime = io::timeMillis() - start;
+        heap.removeRoot(&ring);
+
+        start = io::timeMillis();
+        int64_t sum = 0;
+        {
+            BumpAllocator bumpMem(mem, 1024 * 1024);
+            for (size_t i = 0; i < count; i++) {
+                Node *node = bumpMem.alloc<Node>(1);
+                node->value = (int64_t) i;
+                sum += node->value;
+            }
+        }
+        double bumpTime = io::timeMillis() - start;
+
+        // Like the nodes of the heap, each node lives until 4096 more were allocated.
+        Node *nodes[4096];
+        memset(nodes, 0, sizeof(nodes));
+        start = io::timeMillis();
+        for (size_t i = 0; i < count; i++) {
+            Node *&node = nodes[i % 4096];
+            if (node) ::free(node);
+            node = (Node *) ::malloc(sizeof(Node));
+            node->value = (int64_t) i;
+            sum += node->value;
+        }
+        for (size_t i = 0; i < 4096; i++) ::free(nodes[i]);
+        double mallocTime = io::timeMillis() - start;
+        QAK_CHECK(sum == (int64_t) (count * (count - 1)), "Expected all nodes to be written.");
+
+        printf("%zu nodes: gc %f ms, bump allocator %f ms, malloc/free %f ms\n", count, gcTime, bumpTime, mallocTime);
+        heap.printStats();
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+void testCollectionBenchmark() {
+    Test test("GC - collection benchmark");
+    HeapAllocator mem;
+    {
+        GcHeap heap(mem);
+        uint32_t type = addNodeType(heap);
+        void *tree = nullptr, *garbage = nullptr;
+        heap.addRoot(&tree);
+        heap.addRoot(&garbage);
+        buildTree(heap, type, 1000000, &tree);
+
+        uint32_t numThreads[] = {1, 2, 4};
+        for (size_t i = 0; i < sizeof(numThreads) / sizeof(numThreads[0]); i++) {
+            heap.setMarkThreads(numThreads[i]);
+            double markMillis = 0, sweepMillis = 0, millis = 0;
+            for (int j = 0; j < 5; j++) {
+                buildTree(heap, type, 200000, &garbage);
+                garbage = nullptr;
+                heap.collect(true);
+                Pause &pause = heap.pauses()[heap.pauses().size() - 1];
+                markMillis += pause.markMillis;
+                sweepMillis += pause.sweepMillis;
+                millis += pause.millis;
+            }
+            printf("%u threads: major pause %f ms, mark %f ms, sweep %f ms (average of 5)\n", numThreads[i], millis / 5, markMillis / 5,
+                   sweepMillis / 5);
+        }
+        heap.printStats();
+        heap.removeRoot(&garbage);
+        heap.removeRoot(&tree);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+int main() {
+    testAllocation();
+    testWriteBarrier();
+    testMajor();
+    testLargeObjects();
+    testRoots();
+    testParallelMarking();
+    testAllocationBenchmark();
+    testCollectionBenchmark();
+    return 0;
+}
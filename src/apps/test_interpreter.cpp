@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <string.h>
+#include "io.h"
+#include "resolver.h"
+#include "folder.h"
+#include "interpreter.h"
+#include "qak.h"
+#include "test.h"
+
+using namespace qak;
+using namespace qak::ast;
+using namespace qak::bytecode;
+
+static Program *compile(const char *fileName, HeapAllocator &mem, BumpAllocator &moduleMem, TypeTable &types, Errors &errors, Source **source) {
+    *source = io::readFile(fileName, mem);
+    QAK_CHECK(*source != nullptr, "Couldn't read test file %s", fileName);
+    Parser parser(mem);
+    Module *module = parser.parse(**source, errors, &moduleMem);
+    QAK_CHECK(module && !errors.hasErrors(), "Expected module without parse errors.");
+    Resolver resolver(mem);
+    QAK_CHECK(resolver.resolve(module, errors), "Expected module without resolver errors.");
+    TypeChecker checker(mem);
+    QAK_CHECK(checker.check(module, types, errors), "Expected module without type errors.");
+    ConstantFolder folder(mem);
+    folder.fold(module);
+    BytecodeCompiler compiler(mem);
+    Program *program = compiler.compile(module, types, errors);
+    if (errors.hasErrors()) errors.print();
+    QAK_CHECK(program != nullptr, "Expected a program.");
+    return program;
+}
+
+static void checkInteger(Interpreter &interpreter, uint32_t slot, int64_t expected) {
+    int64_t value = interpreter.global(slot).i;
+    QAK_CHECK(value == expected, "Expected global %u to be %lld, got %lld", slot, (long long) expected, (long long) value);
+}
+
+static void checkFloat(Interpreter &interpreter, uint32_t slot, double expected) {
+    double value = interpreter.global(slot).f;
+    QAK_CHECK(value == expected, "Expected global %u to be %f, got %f", slot, expected, value);
+}
+
+static void checkError(const char *fileName, const char *message, uint32_t line) {
+    HeapAllocator mem;
+    {
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        TypeTable types(mem);
+        Source *source;
+        Program *program = compile(fileName, mem, moduleMem, types, errors, &source);
+
+        Interpreter interpreter(mem, 4096);
+        QAK_CHECK(!interpreter.run(program, errors), "Expected a runtime error.");
+        errors.print();
+        Array<Error> &errorList = errors.getErrors();
+        QAK_CHECK(errorList.size() == 1, "Expected 1 error, got %zu", errorList.size());
+        QAK_CHECK(strcmp(errorList[0].message, message) == 0, "Expected error '%s', got '%s'", message, errorList[0].message);
+        QAK_CHECK(errorList[0].span.startLine == line, "Expected error on line %u, got %u", line, errorList[0].span.startLine);
+
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+void testRun() {
+    Test test("Interpreter - run");
+    HeapAllocator mem;
+    {
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        TypeTable types(mem);
+        Source *source;
+        Program *program = compile("data/interpreter.qak", mem, moduleMem, types, errors, &source);
+        printProgram(program);
+
+        Interpreter interpreter(mem);
+        QAK_CHECK(interpreter.run(program, errors), "Expected the program to run without errors.");
+
+        // Integer arithmetic wraps around at the width of the type.
+        checkInteger(interpreter, 0, -128);
+        checkInteger(interpreter, 1, 15);
+        checkInteger(interpreter, 2, INT32_MIN);
+        checkInteger(interpreter, 3, INT64_MIN);
+        checkInteger(interpreter, 4, -1);
+        checkFloat(interpreter, 5, 3.5);
+        checkFloat(interpreter, 6, (float) (1 / 3.0f));
+        checkInteger(interpreter, 7, -5536);
+        checkInteger(interpreter, 8, 1);
+        checkInteger(interpreter, 9, 'q');
+
+        // Loops, calls and conversions of arguments.
+        checkInteger(interpreter, 10, 2400);
+        checkInteger(interpreter, 12, 6765);
+        checkFloat(interpreter, 13, 3.5);
+        checkInteger(interpreter, 14, 'q');
+
+        // The module's statements return a value.
+        QAK_CHECK(interpreter.resultType() == TypeInt32, "Expected an int32 result, got %s", types.name(interpreter.resultType()));
+        QAK_CHECK(interpreter.result().i == 9165, "Expected 9165, got %lld", (long long) interpreter.result().i);
+
+        // Running again starts with zeroed module variables.
+        QAK_CHECK(interpreter.run(program, errors), "Expected the program to run without errors.");
+        checkInteger(interpreter, 10, 2400);
+
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+void testErrors() {
+    Test test("Interpreter - errors");
+    checkError("data/interpreter_errors.qak", "Division by zero.", 4);
+    checkError("data/interpreter_overflow.qak", "Stack overflow.", 4);
+}
+
+void testCApi() {
+    Test test("Interpreter - C API");
+    qak_compiler compiler = qak_compiler_new();
+    qak_module module = qak_compiler_compile_file(compiler, "data/interpreter.qak");
+    QAK_CHECK(module, "Expected a module.");
+    qak_value result;
+    QAK_CHECK(qak_module_run(module, &result), "Expected the module to run.");
+    QAK_CHECK(result.type == QakValueInt32 && result.value.intValue == 9165, "Expected 9165, got %i", result.value.intValue);
+    qak_module_delete(module);
+
+    module = qak_compiler_compile_source(compiler, "float.qak", "module float\nvar x = 1.5\nreturn x * 3");
+    QAK_CHECK(qak_module_run(module, &result), "Expected the module to run.");
+    QAK_CHECK(result.type == QakValueFloat32 && result.value.floatValue == 4.5f, "Expected 4.5, got %f", result.value.floatValue);
+    qak_module_delete(module);
+
+    module = qak_compiler_compile_source(compiler, "errors.qak", "module errors\nvar x: int32 = true");
+    QAK_CHECK(!qak_module_run(module, &result), "Expected the module to fail.");
+    QAK_CHECK(qak_module_get_num_errors(module) == 1, "Expected 1 error, got %i", qak_module_get_num_errors(module));
+    qak_module_print_errors(module);
+    qak_module_delete(module);
+    qak_compiler_delete(compiler);
+}
+
+/* Chains of binary operations are compiled without recursion, see generateChain(). */
+void testDeepExpression() {
+    Test test("Interpreter - deep expression");
+    HeapAllocator mem;
+    {
+        // The variable is assigned so the chain is not folded.
+        Array<char> text(mem);
+        generateChain(text, "module deep\nvar x = 0\nx = 1\nreturn 0.5 + x", " + x", 200000);
+        qak_compiler compiler = qak_compiler_new();
+        qak_module module = qak_compiler_compile_source(compiler, "deep.qak", text.buffer());
+        qak_value result;
+        QAK_CHECK(qak_module_run(module, &result), "Expected the module to run.");
+        QAK_CHECK(result.type == QakValueFloat32 && result.value.floatValue == 200001.5f, "Expected 200001.5, got %f", result.value.floatValue);
+        qak_module_delete(module);
+        qak_compiler_delete(compiler);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+static void benchmark(const char *fileName, int64_t expected) {
+    HeapAllocator mem;
+    {
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        TypeTable types(mem);
+        Source *source;
+        Program *program = compile(fileName, mem, moduleMem, types, errors, &source);
+
+        Interpreter interpreter(mem);
+        double start = io::timeMillis();
+        QAK_CHECK(interpreter.run(program, errors), "Expected the program to run without errors.");
+        double time = io::timeMillis() - start;
+        QAK_CHECK(interpreter.result().i == expected, "Expected %lld, got %lld", (long long) expected, (long long) interpreter.result().i);
+        printf("%s: %f ms\n", fileName, time);
+
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+void testBenchmark() {
+    Test test("Interpreter - benchmark");
+    benchmark("data/interpreter_benchmark_arithmetic.qak", 2027005011ll);
+    benchmark("data/interpreter_benchmark_calls.qak", 196418 + 499999500000ll);
+}
+
+int main() {
+    testRun();
+    testErrors();
+    testCApi();
+    testDeepExpression();
+    testBenchmark();
+    return 0;
+}
@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <string.h>
+#include "io.h"
+#include "resolver.h"
+#include "folder.h"
+#include "jit.h"
+#include "test.h"
+
+using namespace qak;
+using namespace qak::ast;
+using namespace qak::bytecode;
+using namespace qak::jit;
+
+static Program *compile(const char *fileName, HeapAllocator &mem, BumpAllocator &moduleMem, TypeTable &types, Errors &errors, Source **source) {
+    *source = io::readFile(fileName, mem);
+    QAK_CHECK(*source != nullptr, "Couldn't read test file %s", fileName);
+    Parser parser(mem);
+    Module *module = parser.parse(**source, errors, &moduleMem);
+    QAK_CHECK(module && !errors.hasErrors(), "Expected module without parse errors.");
+    Resolver resolver(mem);
+    QAK_CHECK(resolver.resolve(module, errors), "Expected module without resolver errors.");
+    TypeChecker checker(mem);
+    QAK_CHECK(checker.check(module, types, errors), "Expected module without type errors.");
+    ConstantFolder folder(mem);
+    folder.fold(module);
+    BytecodeCompiler compiler(mem);
+    Program *program = compiler.compile(module, types, errors);
+    if (errors.hasErrors()) errors.print();
+    QAK_CHECK(program != nullptr, "Expected a program.");
+    return program;
+}
+
+static const char *modeName(MemoryMode mode) {
+    switch (mode) {
+        case MemoryAuto:
+            return "auto";
+        case MemoryProtect:
+            return "protect";
+        case MemoryDualMap:
+            return "dual map";
+        case MemoryInterpreter:
+            return "interpreter";
+    }
+    return "unknown";
+}
+
+/* Runs the file with the Interpreter and the Jit with the memory mode. The module variables, the
+ * result and errors must be the same, bit for bit. */
+static void differential(const char *fileName, MemoryMode mode, size_t stackSize = QAK_DEFAULT_STACK_SIZE) {
+    HeapAllocator mem;
+    {
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        TypeTable types(mem);
+        Source *source;
+        Program *program = compile(fileName, mem, moduleMem, types, errors, &source);
+
+        Interpreter interpreter(mem, stackSize);
+        Errors interpreterErrors(mem, moduleMem);
+        bool interpreterResult = interpreter.run(program, interpreterErrors);
+
+        Jit jit(mem, stackSize, mode);
+        bool isNative = jit.compile(program);
+        QAK_CHECK(isNative || mode == MemoryInterpreter, "%s: expected machine code with memory mode %s.", fileName, modeName(mode));
+        QAK_CHECK(!isNative || mode != MemoryInterpreter, "%s: expected no machine code with memory mode %s.", fileName, modeName(mode));
+
+        // Runs twice, module variables start zeroed on each run.
+        for (int run = 0; run < 2; run++) {
+            Errors jitErrors(mem, moduleMem);
+            bool jitResult = jit.run(program, jitErrors);
+            QAK_CHECK(jitResult == interpreterResult, "%s: expected the Jit to %s.", fileName, interpreterResult ? "succeed" : "fail");
+
+            if (!jitResult) {
+                Error &expected = interpreterErrors.getErrors()[0];
+                Error &actual = jitErrors.getErrors()[0];
+                QAK_CHECK(jitErrors.getErrors().size() == 1, "%s: expected 1 error, got %zu", fileName, jitErrors.getErrors().size());
+                QAK_CHECK(strcmp(expected.message, actual.message) == 0, "%s: expected error '%s', got '%s'", fileName, expected.message,
+                          actual.message);
+                QAK_CHECK(expected.span.start == actual.span.start, "%s: expected the error at %u, got %u", fileName, expected.span.start,
+                          actual.span.start);
+                continue;
+            }
+
+            for (uint32_t i = 0; i < program->numGlobals; i++) {
+                QAK_CHECK(interpreter.global(i).i == jit.global(i).i, "%s: expected global %u to be %llx, got %llx", fileName, i,
+                          (unsigned long long) interpreter.global(i).i, (unsigned long long) jit.global(i).i);
+            }
+            QAK_CHECK(interpreter.resultType() == jit.resultType(), "%s: expected a result of type %s, got %s", fileName,
+                      types.name(interpreter.resultType()), types.name(jit.resultType()));
+            QAK_CHECK(interpreter.result().i == jit.result().i, "%s: expected the result %llx, got %llx", fileName,
+                      (unsigned long long) interpreter.result().i, (unsigned long long) jit.result().i);
+        }
+        printf("%s: Jit (%s) and interpreter agree\n", fileName, modeName(mode));
+
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+void testDifferential() {
+    Test test("Jit - differential");
+    MemoryMode modes[] = {MemoryAuto, MemoryDualMap, MemoryInterpreter};
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        differential("data/jit.qak", modes[i]);
+        differential("data/interpreter.qak", modes[i]);
+        differential("data/evaluator.qak", modes[i]);
+        differential("data/transpiler.qak", modes[i]);
+        differential("data/folder.qak", modes[i]);
+        differential("data/interpreter_errors.qak", modes[i], 4096);
+        differential("data/interpreter_overflow.qak", modes[i], 4096);
+    }
+}
+
+void testPerfMap() {
+    Test test("Jit - perf map");
+    HeapAllocator mem;
+    {
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        TypeTable types(mem);
+        Source *source;
+        Program *program = compile("data/interpreter_benchmark_calls.qak", mem, moduleMem, types, errors, &source);
+
+        const char *fileName = "test_jit_perf.map";
+        remove(fileName);
+        Jit jit(mem);
+        QAK_CHECK(jit.compile(program), "Expected machine code.");
+        QAK_CHECK(jit.writePerfMap(fileName), "Expected the perf map to be written.");
+        Source *map = io::readFile(fileName, mem);
+        QAK_CHECK(map != nullptr, "Couldn't read the perf map.");
+        printf("%.*s", (int) map->size, map->data);
+        Array<char> text(mem);
+        text.addAll((const char *) map->data, map->size);
+        text.add(0);
+        QAK_CHECK(strstr(text.buffer(), " qak::benchmarkCalls::fib\n"), "Expected an entry for fib.");
+        QAK_CHECK(strstr(text.buffer(), " qak::benchmarkCalls\n"), "Expected an entry for the module's statements.");
+        remove(fileName);
+
+        Jit interpreted(mem, QAK_DEFAULT_STACK_SIZE, MemoryInterpreter);
+        interpreted.compile(program);
+        QAK_CHECK(!interpreted.writePerfMap(fileName), "Expected no perf map without machine code.");
+
+        mem.freeObject(map, QAK_SRC_LOC);
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+/* The benchmark programs written in C++. The bounds are volatile so the compiler can't compute the results
+ * while compiling. */
+static volatile int32_t arithmeticRows = 2000;
+static volatile int32_t calls = 1000000;
+static volatile double accumulatorSink;
+
+static int64_t nativeArithmetic() {
+    int64_t total = 0;
+    double accumulator = 0;
+    int32_t rows = arithmeticRows;
+    for (int32_t i = 0; i < rows; i++) {
+        for (int32_t j = 0; j < 1000; j++) {
+            total = total + i * j % 7 + (i ^ j);
+            accumulator = accumulator + j * 0.5 - i / 3.0;
+        }
+    }
+    accumulatorSink = accumulator;
+    return total;
+}
+
+static int32_t fib(int32_t n) {
+    if (n < 2) return n;
+    return fib(n - 1) + fib(n - 2);
+}
+
+static int64_t nativeCalls() {
+    int64_t total = 0;
+    int32_t n = calls;
+    for (int32_t i = 0; i < n; i++) total = total + i;
+    return fib(27) + total;
+}
+
+static void benchmark(const char *fileName, int64_t expected, int64_t (*native)()) {
+    HeapAllocator mem;
+    {
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        TypeTable types(mem);
+        Source *source;
+        Program *program = compile(fileName, mem, moduleMem, types, errors, &source);
+
+        Interpreter interpreter(mem);
+        double start = io::timeMillis();
+        QAK_CHECK(interpreter.run(program, errors), "Expected the program to run without errors.");
+        double interpreterTime = io::timeMillis() - start;
+        QAK_CHECK(interpreter.result().i == expected, "Expected %lld, got %lld", (long long) expected, (long long) interpreter.result().i);
+
+        Jit jit(mem);
+        start = io::timeMillis();
+        QAK_CHECK(jit.compile(program), "Expected machine code.");
+        double compileTime = io::timeMillis() - start;
+        start = io::timeMillis();
+        QAK_CHECK(jit.run(program, errors), "Expected the program to run without errors.");
+        double jitTime = io::timeMillis() - start;
+        QAK_CHECK(jit.result().i == expected, "Expected %lld, got %lld", (long long) expected, (long long) jit.result().i);
+
+        start = io::timeMillis();
+        int64_t result = native();
+        double nativeTime = io::timeMillis() - start;
+        QAK_CHECK(result == expected, "Expected %lld, got %lld", (long long) expected, (long long) result);
+
+        printf("%s: interpreter %f ms, jit %f ms (compiled in %f ms), C++ %f ms\n", fileName, interpreterTime, jitTime, compileTime, nativeTime);
+
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+void testBenchmark() {
+    Test test("Jit - benchmark");
+    benchmark("data/interpreter_benchmark_arithmetic.qak", 2027005011ll, nativeArithmetic);
+    benchmark("data/interpreter_benchmark_calls.qak", 196418 + 499999500000ll, nativeCalls);
+}
+
+int main() {
+    testDifferential();
+    testPerfMap();
+    testBenchmark();
+    return 0;
+}
@@ -0,0 +1,423 @@
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include "io.h"
+#include "layout.h"
+#include "qak.h"
+#include "test.h"
+
+using namespace qak;
+using namespace qak::ast;
+
+/* The C structs the C-compatible and packed types of data/layout.qak are laid out like. */
+struct Vec3 {
+    float x, y, z;
+};
+
+struct CHeader {
+    int8_t tag;
+    int32_t length;
+    int16_t checksum;
+};
+
+#pragma pack(push, 1)
+struct Header {
+    int8_t tag;
+    int32_t length;
+    int16_t checksum;
+};
+#pragma pack(pop)
+
+/* Parses the source and lays out its types. Returns nullptr if there were errors. */
+static Module *layout(Source *source, HeapAllocator &mem, BumpAllocator &moduleMem, TypeTable &types, Errors &errors) {
+    Parser parser(mem);
+    Module *module = parser.parse(*source, errors, &moduleMem);
+    if (!module || errors.hasErrors()) return nullptr;
+    LayoutEngine engine(mem);
+    if (!engine.layout(module, types, errors)) return nullptr;
+    return module;
+}
+
+static TypeDeclaration *findType(Module *module, const char *name) {
+    int32_t index = LayoutEngine::find(module, (const uint8_t *) name, (uint32_t) strlen(name));
+    QAK_CHECK(index >= 0, "Expected type %s.", name);
+    return module->types[(size_t) index];
+}
+
+static Field *findField(Module *module, TypeDeclaration *type, const char *name) {
+    for (size_t i = 0; i < type->fields.size(); i++) {
+        Token &fieldName = module->tokens[type->fields[i]->firstToken];
+        if (fieldName.length() == strlen(name) && memcmp(fieldName.source.data + fieldName.start, name, fieldName.length()) == 0)
+            return type->fields[i];
+    }
+    QAK_CHECK(false, "Expected field %s.", name);
+    return nullptr;
+}
+
+static void checkType(Module *module, const char *name, uint32_t size, uint32_t alignment) {
+    TypeDeclaration *type = findType(module, name);
+    QAK_CHECK(type->size == size && type->alignment == alignment, "Expected %s to have size %u and alignment %u, got %u and %u", name, size,
+              alignment, type->size, type->alignment);
+}
+
+static void checkField(Module *module, const char *typeName, const char *name, uint32_t offset, uint32_t size) {
+    Field *field = findField(module, findType(module, typeName), name);
+    QAK_CHECK(field->offset == offset && field->size == size, "Expected %s.%s at offset %u with size %u, got %u and %u", typeName, name, offset,
+              size, field->offset, field->size);
+}
+
+void testParse() {
+    Test test("Layout - parse");
+    HeapAllocator mem;
+    {
+        Source *source = io::readFile("data/layout.qak", mem);
+        QAK_CHECK(source != nullptr, "Couldn't read test file data/layout.qak");
+
+        Parser parser(mem);
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        Module *module = parser.parse(*source, errors, &moduleMem);
+        if (errors.hasErrors()) errors.print();
+        QAK_CHECK(module && !errors.hasErrors(), "Expected module without errors.");
+        QAK_CHECK(module->types.size() == 6, "Expected 6 types, got %zu", module->types.size());
+        QAK_CHECK(module->functions.size() == 1, "Expected 1 function, got %zu", module->functions.size());
+        QAK_CHECK(module->statements.size() == 2, "Expected 2 statements, got %zu", module->statements.size());
+        HeapAllocator printMem;
+        parser::printAstNode(module, printMem);
+
+        TypeDeclaration *packet = findType(module, "Packet");
+        QAK_CHECK(packet->isPacked && packet->isCCompatible && !packet->isStructureOfArrays, "Expected Packet to be packed and c.");
+        QAK_CHECK(findType(module, "Vertex")->isStructureOfArrays, "Expected Vertex to be stored as structure-of-arrays.");
+        QAK_CHECK(packet->fields.size() == 3, "Expected 3 fields, got %zu", packet->fields.size());
+
+        // The flat module stores the same types.
+        BumpAllocator flatMem(mem);
+        FlatModule flatModule(mem, flatMem);
+        QAK_CHECK(parser.parse(*source, errors, flatModule), "Expected flat module.");
+        qak_ast_module &flatRoot = flatModule.nodes[flatModule.root()].data.module;
+        QAK_CHECK(flatRoot.types.numNodes == module->types.size(), "Expected %zu flat types, got %u", module->types.size(), flatRoot.types.numNodes);
+        QAK_CHECK(flatRoot.statements.numNodes == module->statements.size(), "Expected %zu flat statements, got %u", module->statements.size(),
+                  flatRoot.statements.numNodes);
+        for (uint32_t i = 0; i < flatRoot.types.numNodes; i++) {
+            qak_ast_node &node = flatModule.nodes[flatModule.listNode(flatRoot.types, i)];
+            TypeDeclaration *type = module->types[i];
+            Span span = module->span(type);
+            QAK_CHECK(node.type == QakAstTypeDeclaration, "Expected a type declaration, got %i", node.type);
+            QAK_CHECK(node.span.start == span.start && node.span.end == span.end, "Expected same span as tree node.");
+            QAK_CHECK(node.data.typeDeclaration.fields.numNodes == type->fields.size(), "Expected %zu fields, got %u", type->fields.size(),
+                      node.data.typeDeclaration.fields.numNodes);
+            QAK_CHECK(node.data.typeDeclaration.isPacked == type->isPacked && node.data.typeDeclaration.isCCompatible == type->isCCompatible &&
+                      node.data.typeDeclaration.isStructureOfArrays == type->isStructureOfArrays, "Expected same modifiers as tree node.");
+            for (uint32_t j = 0; j < node.data.typeDeclaration.fields.numNodes; j++) {
+                qak_ast_node &field = flatModule.nodes[flatModule.listNode(node.data.typeDeclaration.fields, j)];
+                Span fieldSpan = module->span(type->fields[j]);
+                QAK_CHECK(field.type == QakAstField, "Expected a field, got %i", field.type);
+                QAK_CHECK(field.span.start == fieldSpan.start && field.span.end == fieldSpan.end, "Expected same span as tree node.");
+            }
+        }
+
+        // Fields named like modifiers are fields.
+        Source *modifiers = Source::fromMemory(mem, "modifiers.qak", "module modifiers\ntype T packed\n    c: int32\n    soa: int8\nend\n");
+        Module *modifiersModule = parser.parse(*modifiers, errors, &moduleMem);
+        QAK_CHECK(modifiersModule && !errors.hasErrors(), "Expected module without errors.");
+        TypeDeclaration *type = modifiersModule->types[0];
+        QAK_CHECK(type->isPacked && !type->isCCompatible && !type->isStructureOfArrays, "Expected only packed.");
+        QAK_CHECK(type->fields.size() == 2, "Expected 2 fields, got %zu", type->fields.size());
+
+        mem.freeObject(modifiers, QAK_SRC_LOC);
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+void testLayout() {
+    Test test("Layout - offsets");
+    HeapAllocator mem;
+    {
+        Source *source = io::readFile("data/layout.qak", mem);
+        QAK_CHECK(source != nullptr, "Couldn't read test file data/layout.qak");
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        TypeTable types(mem);
+        Module *module = layout(source, mem, moduleMem, types, errors);
+        if (errors.hasErrors()) errors.print();
+        QAK_CHECK(module, "Expected module without errors.");
+
+        for (size_t i = 0; i < module->types.size(); i++) {
+            TypeDeclaration *type = module->types[i];
+            Token &name = module->tokens[type->name];
+            printf("%.*s: size %u, alignment %u\n", (int) name.length(), (const char *) name.source.data + name.start, type->size, type->alignment);
+            for (size_t j = 0; j < type->fields.size(); j++) {
+                Field *field = type->fields[j];
+                Token &fieldName = module->tokens[field->firstToken];
+                printf("   %.*s: offset %u, size %u\n", (int) fieldName.length(), (const char *) fieldName.source.data + fieldName.start,
+                       field->offset, field->size);
+            }
+        }
+
+        // Reordering leaves only the end of the type padded.
+        checkType(module, "Particle", 32, 8);
+        checkField(module, "Particle", "position", 0, 8);
+        checkField(module, "Particle", "velocity", 8, 8);
+        checkField(module, "Particle", "id", 16, 4);
+        checkField(module, "Particle", "mass", 20, 4);
+        checkField(module, "Particle", "flags", 24, 1);
+        checkField(module, "Particle", "alive", 25, 1);
+
+        checkType(module, "Vertex", 32, 4);
+        checkField(module, "Vertex", "normal", 0, 12);
+        checkField(module, "Vertex", "color", 12, 4);
+        checkField(module, "Vertex", "position", 16, 12);
+        checkField(module, "Vertex", "u", 28, 2);
+
+        checkType(module, "Packet", 40, 1);
+        checkField(module, "Packet", "header", 0, 7);
+        checkField(module, "Packet", "flags", 7, 1);
+        checkField(module, "Packet", "payload", 8, 32);
+
+        // C-compatible and packed types match the C structs.
+        checkType(module, "Vec3", sizeof(Vec3), alignof(Vec3));
+        checkField(module, "Vec3", "x", offsetof(Vec3, x), 4);
+        checkField(module, "Vec3", "y", offsetof(Vec3, y), 4);
+        checkField(module, "Vec3", "z", offsetof(Vec3, z), 4);
+        checkType(module, "CHeader", sizeof(CHeader), alignof(CHeader));
+        checkField(module, "CHeader", "tag", offsetof(CHeader, tag), 1);
+        checkField(module, "CHeader", "length", offsetof(CHeader, length), 4);
+        checkField(module, "CHeader", "checksum", offsetof(CHeader, checksum), 2);
+        checkType(module, "Header", sizeof(Header), 1);
+        checkField(module, "Header", "tag", offsetof(Header, tag), 1);
+        checkField(module, "Header", "length", offsetof(Header, length), 4);
+        checkField(module, "Header", "checksum", offsetof(Header, checksum), 2);
+
+        Field *header = findField(module, findType(module, "Packet"), "header");
+        QAK_CHECK(header->type == TypeError && module->types[(size_t) header->valueType] == findType(module, "Header"),
+                  "Expected the header to be of type Header.");
+        Field *id = findField(module, findType(module, "Particle"), "id");
+        QAK_CHECK(id->type == TypeInt32 && id->valueType == -1, "Expected the id to be an int32.");
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+/* Checks that the values of all fields of an array are aligned, within the array and do not overlap. */
+static void checkArray(Module *module, TypeDeclaration *type, size_t count, HeapAllocator &mem) {
+    Array<uint8_t> used(mem);
+    used.setSize(type->size * count, 0);
+    for (size_t i = 0; i < count; i++) {
+        for (size_t j = 0; j < type->fields.size(); j++) {
+            Field *field = type->fields[j];
+            size_t offset = LayoutEngine::arrayFieldOffset(type, field, i, count);
+            QAK_CHECK(offset + field->size <= used.size(), "Expected field %s of element %zu within the array.",
+                      module->tokens[field->firstToken].toCString(mem), i);
+            QAK_CHECK(offset % field->alignment == 0, "Expected field %s of element %zu to be aligned.", module->tokens[field->firstToken].toCString(mem),
+                      i);
+            for (size_t k = offset; k < offset + field->size; k++) {
+                QAK_CHECK(!used[k], "Expected byte %zu to be used once.", k);
+                used[k] = 1;
+            }
+        }
+    }
+}
+
+void testStructureOfArrays() {
+    Test test("Layout - structure-of-arrays");
+    HeapAllocator mem;
+    {
+        Source *source = io::readFile("data/layout.qak", mem);
+        QAK_CHECK(source != nullptr, "Couldn't read test file data/layout.qak");
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        TypeTable types(mem);
+        Module *module = layout(source, mem, moduleMem, types, errors);
+        QAK_CHECK(module, "Expected module without errors.");
+
+        for (size_t i = 0; i < module->types.size(); i++) {
+            checkArray(module, module->types[i], 1, mem);
+            checkArray(module, module->types[i], 7, mem);
+        }
+
+        // The values of a field follow each other.
+        TypeDeclaration *vertex = findType(module, "Vertex");
+        Field *color = findField(module, vertex, "color");
+        QAK_CHECK(LayoutEngine::arrayFieldOffset(vertex, color, 0, 100) == 1200, "Expected the colors to start at 1200.");
+        QAK_CHECK(LayoutEngine::arrayFieldOffset(vertex, color, 99, 100) == 1596, "Expected the last color at 1596.");
+        TypeDeclaration *particle = findType(module, "Particle");
+        Field *mass = findField(module, particle, "mass");
+        QAK_CHECK(LayoutEngine::arrayFieldOffset(particle, mass, 2, 100) == 84, "Expected the mass of the third particle at 84.");
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+static void checkError(const char *sourceCode, const char *expected) {
+    HeapAllocator mem;
+    {
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        TypeTable types(mem);
+        Source *source = Source::fromMemory(mem, "errors.qak", sourceCode);
+        QAK_CHECK(layout(source, mem, moduleMem, types, errors) == nullptr, "Expected errors for: %s", sourceCode);
+        errors.print();
+        QAK_CHECK(strcmp(errors.getErrors()[0].message, expected) == 0, "Expected error '%s', got '%s'", expected, errors.getErrors()[0].message);
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+void testErrors() {
+    Test test("Layout - errors");
+    checkError("module errors\ntype A\n    x: int32\nend\ntype A\n    y: int32\nend\n", "Type 'A' is already declared.");
+    checkError("module errors\ntype int32\n    x: int32\nend\n", "Type 'int32' is already declared.");
+    checkError("module errors\ntype A\n    x: int32\n    x: int8\nend\n", "Field 'x' is already declared.");
+    checkError("module errors\ntype A\n    x: B\nend\n", "Unknown type 'B'.");
+    checkError("module errors\ntype A\n    x: string\nend\n", "Fields of type string are not supported.");
+    checkError("module errors\ntype A\n    b: B\nend\ntype B\n    a: A\nend\n", "Type 'A' can not contain itself.");
+    checkError("module errors\ntype A\n    a: A\nend\n", "Type 'A' can not contain itself.");
+    checkError("module errors\ntype A\n    x int32\nend\n", "Expected ':', but got 'int32'");
+
+    // A type that fails to parse is skipped up to its end, the statements after it are parsed.
+    HeapAllocator mem;
+    {
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        Source *source = Source::fromMemory(mem, "recover.qak", "module recover\ntype A\n    x int32\n    y: int8\nend\nvar a = 1\n");
+        Parser parser(mem);
+        Module *module = parser.parse(*source, errors, &moduleMem);
+        QAK_CHECK(module, "Expected a partial module.");
+        QAK_CHECK(errors.getErrors().size() == 1, "Expected 1 error, got %zu", errors.getErrors().size());
+        QAK_CHECK(module->statements.size() == 2 && module->statements[0]->astType == AstError && module->statements[1]->astType == AstVariable,
+                  "Expected an error node and a variable.");
+        errors.print();
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+/* Types are reused by reparses like functions, and reparsed if the edit changed them. */
+void testReparse() {
+    Test test("Layout - reparse");
+    HeapAllocator mem;
+    {
+        Source *source = io::readFile("data/layout.qak", mem);
+        QAK_CHECK(source != nullptr, "Couldn't read test file data/layout.qak");
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        TypeTable types(mem);
+        Parser parser(mem);
+        Module *module = parser.parse(*source, errors, &moduleMem);
+        QAK_CHECK(module && !errors.hasErrors(), "Expected module without errors.");
+        TypeDeclaration *particle = module->types[0];
+        TypeDeclaration *packet = module->types[5];
+
+        // Changes the x of Vec3 to a float64.
+        const char *field = strstr((const char *) source->data, "x: float32");
+        QAK_CHECK(field, "Expected field x.");
+        uint32_t start = (uint32_t) (field - (const char *) source->data) + 8;
+        Array<char> edited(mem);
+        edited.addAll((const char *) source->data, start);
+        edited.addAll("64", 2);
+        edited.addAll((const char *) source->data + start + 2, source->size - start - 2);
+        edited.add(0);
+        Source *editedSource = Source::fromMemory(mem, "layout.qak", edited.buffer());
+        BumpAllocator reparsedMem(mem);
+        module = parser.reparse(module, *editedSource, SourceEdit(start, start + 2, 2), errors, &reparsedMem);
+        QAK_CHECK(module && !errors.hasErrors(), "Expected reparsed module without errors.");
+        moduleMem.free();
+        QAK_CHECK(module->types.size() == 6, "Expected 6 types, got %zu", module->types.size());
+        QAK_CHECK(module->types[0] == particle && module->types[5] == packet, "Expected the types before and after the edit to be reused.");
+        QAK_CHECK(module->statements.size() == 2 && module->functions.size() == 1, "Expected the statements and function to be kept.");
+
+        LayoutEngine engine(mem);
+        QAK_CHECK(engine.layout(module, types, errors), "Expected the reparsed module to be laid out.");
+        checkType(module, "Vec3", 16, 8);
+        checkField(module, "Vec3", "x", 0, 8);
+        checkField(module, "Vec3", "z", 12, 4);
+        checkType(module, "Vertex", 40, 8);
+        checkType(module, "Packet", 48, 1);
+        mem.freeObject(editedSource, QAK_SRC_LOC);
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+/* The host writes particles into memory laid out by the module, without converting them. */
+void testCApi() {
+    Test test("Layout - C API");
+    qak_compiler compiler = qak_compiler_new();
+    qak_module module = qak_compiler_compile_file(compiler, "data/layout.qak");
+    QAK_CHECK(module, "Expected a module.");
+    QAK_CHECK(qak_module_get_num_types(module) == 6, "Expected 6 types, got %i", qak_module_get_num_types(module));
+    QAK_CHECK(qak_module_find_type(module, "Unknown") == -1, "Expected no type Unknown.");
+
+    int particleIndex = qak_module_find_type(module, "Particle");
+    QAK_CHECK(particleIndex == 0, "Expected Particle to be type 0, got %i", particleIndex);
+    qak_type_layout particle;
+    QAK_CHECK(qak_module_get_type_layout(module, particleIndex, &particle), "Expected the layout of Particle.");
+    QAK_CHECK(particle.size == 32 && particle.alignment == 8 && particle.numFields == 6, "Expected 6 fields in 32 bytes.");
+    QAK_CHECK(!particle.isPacked && !particle.isCCompatible && !particle.isStructureOfArrays, "Expected no modifiers.");
+    printf("%.*s: size %u, alignment %u\n", (int) particle.name.data.length, particle.name.data.data, particle.size, particle.alignment);
+
+    qak_field_layout id, mass;
+    QAK_CHECK(qak_module_get_field_layout(module, particleIndex, 2, &id), "Expected the layout of id.");
+    QAK_CHECK(qak_module_get_field_layout(module, particleIndex, 5, &mass), "Expected the layout of mass.");
+    QAK_CHECK(!qak_module_get_field_layout(module, particleIndex, 6, &mass), "Expected no field 6.");
+    QAK_CHECK(!qak_module_get_field_layout(module, particleIndex, -1, &mass), "Expected no field -1.");
+    QAK_CHECK(id.type == QakValueInt32 && id.valueType == -1 && id.offset == 16 && id.size == 4, "Expected id to be an int32 at 16.");
+    QAK_CHECK(mass.type == QakValueFloat32 && mass.offset == 20 && mass.alignment == 4, "Expected mass to be a float32 at 20.");
+
+    int vertexIndex = qak_module_find_type(module, "Vertex");
+    qak_type_layout vertex;
+    QAK_CHECK(qak_module_get_type_layout(module, vertexIndex, &vertex), "Expected the layout of Vertex.");
+    QAK_CHECK(!qak_module_get_type_layout(module, -1, &vertex), "Expected no type -1.");
+    QAK_CHECK(!qak_module_get_type_layout(module, 6, &vertex), "Expected no type 6.");
+    QAK_CHECK(vertex.isStructureOfArrays, "Expected Vertex to be stored as structure-of-arrays.");
+    qak_field_layout normal, color;
+    qak_module_get_field_layout(module, vertexIndex, 1, &normal);
+    qak_module_get_field_layout(module, vertexIndex, 2, &color);
+    QAK_CHECK(normal.type == QakValueNothing && normal.valueType == qak_module_find_type(module, "Vec3"), "Expected normal to be a Vec3.");
+
+    // Writes the fields in place, like a host sharing the memory with a script would.
+    const size_t count = 16;
+    uint8_t *particles = (uint8_t *) calloc(count, particle.size);
+    for (size_t i = 0; i < count; i++) {
+        *(int32_t *) (particles + qak_array_field_offset(&particle, &id, i, count)) = (int32_t) i;
+        *(float *) (particles + qak_array_field_offset(&particle, &mass, i, count)) = (float) i * 0.5f;
+    }
+    for (size_t i = 0; i < count; i++) {
+        QAK_CHECK(*(int32_t *) (particles + i * particle.size + id.offset) == (int32_t) i, "Expected id %zu.", i);
+        QAK_CHECK(*(float *) (particles + i * particle.size + mass.offset) == (float) i * 0.5f, "Expected mass of %zu.", i);
+    }
+    free(particles);
+
+    uint8_t *vertices = (uint8_t *) calloc(count, vertex.size);
+    for (size_t i = 0; i < count; i++) *(int32_t *) (vertices + qak_array_field_offset(&vertex, &color, i, count)) = (int32_t) i * 3;
+    int32_t *colors = (int32_t *) (vertices + color.offset * count);
+    for (size_t i = 0; i < count; i++) QAK_CHECK(colors[i] == (int32_t) i * 3, "Expected color %zu.", i);
+    free(vertices);
+    printf("Host wrote %zu particles and vertices in place\n", count);
+
+    // Types do not change how the module runs.
+    qak_value result;
+    QAK_CHECK(qak_module_run(module, &result), "Expected the module to run.");
+    QAK_CHECK(result.type == QakValueFloat32 && result.value.floatValue == 18, "Expected 18, got %g", result.value.floatValue);
+    qak_module_delete(module);
+
+    module = qak_compiler_compile_source(compiler, "errors.qak", "module errors\ntype A\n    x: B\nend\n");
+    QAK_CHECK(qak_module_get_num_types(module) == 0, "Expected no types for a module with errors.");
+    QAK_CHECK(!qak_module_get_type_layout(module, 0, &particle), "Expected no layout for a module with errors.");
+    QAK_CHECK(!qak_module_get_field_layout(module, 0, 0, &id), "Expected no layout for a module with errors.");
+    QAK_CHECK(!qak_module_run(module, &result), "Expected the module to fail.");
+    qak_module_print_errors(module);
+    qak_module_delete(module);
+    qak_compiler_delete(compiler);
+}
+
+int main() {
+    testParse();
+    testLayout();
+    testStructureOfArrays();
+    testErrors();
+    testReparse();
+    testCApi();
+    return 0;
+}
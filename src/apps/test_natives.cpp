@@ -0,0 +1,381 @@
+#include <stdio.h>
+#include <string.h>
+#include "io.h"
+#include "resolver.h"
+#include "folder.h"
+#include "evaluator.h"
+#include "transpiler.h"
+#include "ssa.h"
+#include "jit.h"
+#include "qak.h"
+#include "test.h"
+
+using namespace qak;
+using namespace qak::ast;
+using namespace qak::jit;
+using qak::bytecode::Value;
+
+/* The state of the host the natives of a run share: the values printed and the number of frames. */
+struct Host {
+    Array<int64_t> printed;
+    int32_t frames;
+
+    Host(HeapAllocator &mem) : printed(mem), frames(0) {}
+
+    void reset() {
+        printed.clear();
+        frames = 0;
+    }
+};
+
+static Value print(Value *arguments, void *userData) {
+    ((Host *) userData)->printed.add(arguments[0].i);
+    Value result;
+    result.i = 0;
+    return result;
+}
+
+/* Asks to stop every fifth frame. */
+static Value shouldWeStop(Value *, void *userData) {
+    Host *host = (Host *) userData;
+    Value result;
+    result.i = ++host->frames % 5 == 0 ? 1 : 0;
+    return result;
+}
+
+static Value clamp(Value *arguments, void *) {
+    Value result;
+    result.i = arguments[0].i < arguments[1].i ? arguments[0].i : arguments[1].i;
+    return result;
+}
+
+static Value scale(Value *arguments, void *) {
+    Value result;
+    result.f = arguments[0].f * (double) arguments[1].i;
+    return result;
+}
+
+static Value sum(Value *arguments, void *) {
+    Value result;
+    result.i = arguments[0].i + arguments[1].i + arguments[2].i;
+    return result;
+}
+
+/* Shadowed by the function of the same name in data/natives.qak. */
+static Value twice(Value *arguments, void *) {
+    Value result;
+    result.i = arguments[0].i * 3;
+    return result;
+}
+
+static Value negate(Value *arguments, void *) {
+    Value result;
+    result.i = arguments[0].i ? 0 : 1;
+    return result;
+}
+
+static void addNatives(NativeFunctions &natives, Host &host) {
+    TypeId printParameters[] = {TypeInt64};
+    TypeId clampParameters[] = {TypeInt64, TypeInt64};
+    TypeId scaleParameters[] = {TypeFloat32, TypeInt64};
+    TypeId sumParameters[] = {TypeInt8, TypeInt16, TypeInt32};
+    TypeId twiceParameters[] = {TypeInt32};
+    TypeId negateParameters[] = {TypeBoolean};
+    QAK_CHECK(natives.add("print", TypeNothing, printParameters, 1, print, &host) == 0, "Expected print to be native 0.");
+    QAK_CHECK(natives.add("shouldWeStop", TypeBoolean, nullptr, 0, shouldWeStop, &host) == 1, "Expected shouldWeStop to be native 1.");
+    QAK_CHECK(natives.add("clamp", TypeInt64, clampParameters, 2, clamp, nullptr) == 2, "Expected clamp to be native 2.");
+    QAK_CHECK(natives.add("scale", TypeFloat64, scaleParameters, 2, scale, nullptr) == 3, "Expected scale to be native 3.");
+    QAK_CHECK(natives.add("sum", TypeInt64, sumParameters, 3, sum, nullptr) == 4, "Expected sum to be native 4.");
+    QAK_CHECK(natives.add("twice", TypeInt32, twiceParameters, 1, twice, nullptr) == 5, "Expected twice to be native 5.");
+    QAK_CHECK(natives.add("negate", TypeBoolean, negateParameters, 1, negate, nullptr) == 6, "Expected negate to be native 6.");
+}
+
+/* Parses, resolves and type checks the source with the natives. */
+static Module *check(Source *source, HeapAllocator &mem, BumpAllocator &moduleMem, TypeTable &types, NativeFunctions *natives, Errors &errors) {
+    Parser parser(mem);
+    Module *module = parser.parse(*source, errors, &moduleMem);
+    QAK_CHECK(module && !errors.hasErrors(), "Expected module without parse errors.");
+    Resolver resolver(mem);
+    if (!resolver.resolve(module, errors, natives)) return nullptr;
+    TypeChecker checker(mem);
+    if (!checker.check(module, types, errors)) return nullptr;
+    return module;
+}
+
+static void checkSameGlobals(Module *module, Value *expected, Value *actual, const char *engine) {
+    for (uint32_t i = 0; i < module->variables.size(); i++) {
+        Token &name = module->tokens[module->variables[i]->name];
+        QAK_CHECK(expected[i].i == actual[i].i, "%s: expected '%.*s' to be %lld, got %lld", engine, (int) name.length(),
+                  (const char *) name.source.data + name.start, (long long) expected[i].i, (long long) actual[i].i);
+    }
+}
+
+static void checkSamePrinted(Array<int64_t> &expected, Array<int64_t> &actual, const char *engine) {
+    QAK_CHECK(expected.size() == actual.size(), "%s: expected %zu values printed, got %zu", engine, expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        QAK_CHECK(expected[i] == actual[i], "%s: expected printed value %zu to be %lld, got %lld", engine, i, (long long) expected[i],
+                  (long long) actual[i]);
+    }
+}
+
+/* Runs data/natives.qak with the Interpreter, the Jit in all memory modes and the Evaluator. All must
+ * call the natives with the same arguments and agree on the module variables and the result. */
+void testDifferential() {
+    Test test("Natives - differential");
+    HeapAllocator mem;
+    {
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        TypeTable types(mem);
+        Host host(mem);
+        NativeFunctions natives(mem, types);
+        addNatives(natives, host);
+        Source *source = io::readFile("data/natives.qak", mem);
+        QAK_CHECK(source != nullptr, "Couldn't read test file data/natives.qak");
+
+        Parser parser(mem);
+        FlatModule flat(mem, moduleMem);
+        QAK_CHECK(parser.parse(*source, errors, flat), "Expected a flat module.");
+        Module *module = check(source, mem, moduleMem, types, &natives, errors);
+        if (errors.hasErrors()) errors.print();
+        QAK_CHECK(module != nullptr, "Expected module without errors.");
+
+        Evaluator evaluator(mem);
+        QAK_CHECK(evaluator.evaluate(flat, module, types, errors), "Expected the evaluator to succeed.");
+        Array<Value> evaluatorGlobals(mem);
+        for (uint32_t i = 0; i < module->variables.size(); i++) evaluatorGlobals.add(evaluator.global(i));
+        Array<int64_t> evaluatorPrinted(mem);
+        evaluatorPrinted.addAll(host.printed);
+
+        ConstantFolder folder(mem);
+        folder.fold(module);
+        BytecodeCompiler compiler(mem);
+        bytecode::Program *program = compiler.compile(module, types, errors);
+        QAK_CHECK(program != nullptr, "Expected a program.");
+        bytecode::printProgram(program);
+
+        host.reset();
+        Interpreter interpreter(mem);
+        QAK_CHECK(interpreter.run(program, errors), "Expected the interpreter to succeed.");
+        QAK_CHECK(interpreter.resultType() == TypeFloat64 && interpreter.result().f == 14, "Expected the result 14, got %g",
+                  interpreter.result().f);
+        int64_t expectedPrinted[] = {42, 70341, 6};
+        QAK_CHECK(host.printed.size() == 3, "Expected 3 values printed, got %zu", host.printed.size());
+        for (size_t i = 0; i < 3; i++) {
+            QAK_CHECK(host.printed[i] == expectedPrinted[i], "Expected %lld printed, got %lld", (long long) expectedPrinted[i],
+                      (long long) host.printed[i]);
+        }
+        Array<Value> interpreterGlobals(mem);
+        for (uint32_t i = 0; i < program->numGlobals; i++) interpreterGlobals.add(interpreter.global(i));
+        QAK_CHECK(interpreter.global(3).i == 42, "Expected the module's twice() to shadow the native.");
+
+        checkSameGlobals(module, interpreterGlobals.buffer(), evaluatorGlobals.buffer(), "Evaluator");
+        checkSamePrinted(host.printed, evaluatorPrinted, "Evaluator");
+        QAK_CHECK(evaluator.result().i == interpreter.result().i, "Evaluator: expected the result %g, got %g", interpreter.result().f,
+                  evaluator.result().f);
+
+        MemoryMode modes[] = {MemoryAuto, MemoryDualMap, MemoryInterpreter};
+        for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+            Jit jit(mem, QAK_DEFAULT_STACK_SIZE, modes[i]);
+            jit.compile(program);
+            Array<int64_t> interpreterPrinted(mem);
+            interpreterPrinted.addAll(host.printed);
+            host.reset();
+            QAK_CHECK(jit.run(program, errors), "Expected the Jit to succeed.");
+            Array<Value> jitGlobals(mem);
+            for (uint32_t j = 0; j < program->numGlobals; j++) jitGlobals.add(jit.global(j));
+            checkSameGlobals(module, interpreterGlobals.buffer(), jitGlobals.buffer(), "Jit");
+            checkSamePrinted(interpreterPrinted, host.printed, "Jit");
+            QAK_CHECK(jit.result().i == interpreter.result().i, "Jit: expected the result %g, got %g", interpreter.result().f, jit.result().f);
+            printf("Jit (%s) calls natives like the interpreter\n", jit.isNative() ? "machine code" : "interpreter");
+        }
+        printf("Evaluator, interpreter and Jit agree\n");
+
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+static void checkError(const char *sourceCode, bool withNatives, const char *expected) {
+    HeapAllocator mem;
+    {
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        TypeTable types(mem);
+        Host host(mem);
+        NativeFunctions natives(mem, types);
+        addNatives(natives, host);
+        Source *source = Source::fromMemory(mem, "errors.qak", sourceCode);
+        QAK_CHECK(check(source, mem, moduleMem, types, withNatives ? &natives : nullptr, errors) == nullptr, "Expected errors for: %s",
+                  sourceCode);
+        errors.print();
+        QAK_CHECK(strcmp(errors.getErrors()[0].message, expected) == 0, "Expected error '%s', got '%s'", expected, errors.getErrors()[0].message);
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+void testErrors() {
+    Test test("Natives - errors");
+    checkError("module errors\nprint(1, 2)\n", true, "Expected 1 arguments, got 2.");
+    checkError("module errors\nprint(1.5)\n", true, "Expected a value of type int64, got float32.");
+    checkError("module errors\nvar x = print(1)\n", true, "Can not infer the type of 'x' from an expression without a value.");
+    checkError("module errors\nvar x = print\n", true, "Unknown variable 'print'.");
+    checkError("module errors\nprint(1)\n", false, "Unknown function 'print'.");
+    checkError("module errors\nprint = 3\n", true, "Unknown variable 'print'.");
+    checkError("module errors\nunknown()\n", true, "Unknown function 'unknown'.");
+
+    HeapAllocator mem;
+    {
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        TypeTable types(mem);
+        Host host(mem);
+        NativeFunctions natives(mem, types);
+        addNatives(natives, host);
+        TypeId parameters[] = {TypeInt32, TypeNothing};
+        QAK_CHECK(natives.add("print", TypeNothing, parameters, 1, print, &host) < 0, "Expected a duplicate name to be rejected.");
+        QAK_CHECK(natives.add("other", TypeNothing, parameters, 2, print, &host) < 0, "Expected a nothing parameter to be rejected.");
+        QAK_CHECK(natives.add("other", TypeError, parameters, 1, print, &host) < 0, "Expected an invalid return type to be rejected.");
+        TypeId function = types.function(TypeInt32, parameters, 1);
+        QAK_CHECK(natives.add("other", function, parameters, 1, print, &host) < 0, "Expected a function return type to be rejected.");
+        QAK_CHECK(natives.add("", TypeNothing, parameters, 1, print, &host) < 0, "Expected an empty name to be rejected.");
+        QAK_CHECK(natives.add("other", TypeNothing, parameters, 1, print, &host) == 7, "Expected other to be native 7.");
+
+        // Modules calling natives only run in the host process.
+        Source *source = Source::fromMemory(mem, "transpile.qak", "module transpile\nprint(1)\n");
+        Module *module = check(source, mem, moduleMem, types, &natives, errors);
+        QAK_CHECK(module != nullptr, "Expected module without errors.");
+        CTranspiler transpiler(mem);
+        Array<char> output(mem);
+        QAK_CHECK(!transpiler.transpile(module, types, errors, output), "Expected the transpiler to fail.");
+        errors.print();
+        QAK_CHECK(strcmp(errors.getErrors()[0].message, "Native functions can not be transpiled.") == 0, "Expected a transpiler error.");
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+/* Native calls have effects, so they stay in the SSA form when their value is not used. */
+void testSsa() {
+    Test test("Natives - SSA");
+    HeapAllocator mem;
+    {
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        TypeTable types(mem);
+        Host host(mem);
+        NativeFunctions natives(mem, types);
+        addNatives(natives, host);
+        Source *source = io::readFile("data/natives.qak", mem);
+        QAK_CHECK(source != nullptr, "Couldn't read test file data/natives.qak");
+        Module *module = check(source, mem, moduleMem, types, &natives, errors);
+        QAK_CHECK(module != nullptr, "Expected module without errors.");
+
+        SsaBuilder builder(mem);
+        ssa::Program *program = builder.build(module, types, errors);
+        QAK_CHECK(program != nullptr, "Expected an SSA program.");
+        SsaOptimizer optimizer(mem);
+        optimizer.optimize(program);
+        Array<char> output(mem);
+        ssa::dump(program, types, output, mem);
+        output.add(0);
+        printf("%s", output.buffer());
+        QAK_CHECK(strstr(output.buffer(), "call_native shouldWeStop\n"), "Expected a call of shouldWeStop.");
+        QAK_CHECK(strstr(output.buffer(), "call_native print, v"), "Expected the calls of print to be kept.");
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+static void cPrint(const qak_value *arguments, int numArguments, qak_value *result, void *userData) {
+    QAK_CHECK(numArguments == 1 && arguments[0].type == QakValueInt32, "Expected an int32 argument.");
+    QAK_CHECK(result->type == QakValueNothing, "Expected a result of type nothing.");
+    *(int32_t *) userData += arguments[0].value.intValue;
+}
+
+static void cAverage(const qak_value *arguments, int numArguments, qak_value *result, void *) {
+    QAK_CHECK(numArguments == 2 && arguments[0].type == QakValueFloat32 && arguments[1].type == QakValueInt8, "Expected float32 and int8 arguments.");
+    QAK_CHECK(result->type == QakValueFloat32 && result->value.floatValue == 0, "Expected a zero float32 result.");
+    result->value.floatValue = (arguments[0].value.floatValue + (float) arguments[1].value.byteValue) / 2;
+}
+
+void testCApi() {
+    Test test("Natives - C API");
+    int32_t printed = 0;
+    qak_compiler compiler = qak_compiler_new();
+    qak_value_type printParameters[] = {QakValueInt32};
+    qak_value_type averageParameters[] = {QakValueFloat32, QakValueInt8};
+    QAK_CHECK(qak_compiler_register_native(compiler, "print", QakValueNothing, printParameters, 1, cPrint, &printed), "Expected print.");
+    QAK_CHECK(qak_compiler_register_native(compiler, "average", QakValueFloat32, averageParameters, 2, cAverage, nullptr), "Expected average.");
+    QAK_CHECK(!qak_compiler_register_native(compiler, "print", QakValueNothing, printParameters, 1, cPrint, nullptr), "Expected a duplicate.");
+    QAK_CHECK(!qak_compiler_register_native(compiler, "many", QakValueNothing, printParameters, QAK_MAX_NATIVE_PARAMETERS + 1, cPrint, nullptr),
+              "Expected too many parameters to be rejected.");
+
+    const char *source = "module capi\nvar i = 0\nwhile i < 10\n    print(i)\n    i = i + 1\nend\nreturn average(2.5, 4b) * 2\n";
+    qak_module module = qak_compiler_compile_source(compiler, "capi.qak", source);
+    QAK_CHECK(module, "Expected a module.");
+    qak_value result;
+    QAK_CHECK(qak_module_run(module, &result), "Expected the module to run.");
+    QAK_CHECK(result.type == QakValueFloat32 && result.value.floatValue == 6.5f, "Expected 6.5, got %g", result.value.floatValue);
+    QAK_CHECK(printed == 45, "Expected 45 printed, got %i", printed);
+    QAK_CHECK(qak_module_eval(module, &result), "Expected the module to evaluate.");
+    QAK_CHECK(result.type == QakValueFloat32 && result.value.floatValue == 6.5f, "Expected 6.5, got %g", result.value.floatValue);
+    QAK_CHECK(printed == 90, "Expected 90 printed, got %i", printed);
+    printf("Module run and evaluated with C natives\n");
+    qak_module_delete(module);
+
+    module = qak_compiler_compile_source(compiler, "capi.qak", "module capi\nprint(1.5)\n");
+    QAK_CHECK(!qak_module_run(module, &result), "Expected a type error.");
+    qak_module_print_errors(module);
+    qak_module_delete(module);
+    qak_compiler_delete(compiler);
+}
+
+/* Calls a native once per frame, like a per-frame script polling the host. */
+void testBenchmark() {
+    Test test("Natives - benchmark");
+    HeapAllocator mem;
+    {
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        TypeTable types(mem);
+        Host host(mem);
+        NativeFunctions natives(mem, types);
+        addNatives(natives, host);
+        const char *sourceCode = "module benchmark\nvar total = 0l\nvar i = 0\nwhile i < 1000000\n"
+                                 "    total = total + clamp(i, 500000)\n    i = i + 1\nend\nreturn total\n";
+        Source *source = Source::fromMemory(mem, "benchmark.qak", sourceCode);
+        Module *module = check(source, mem, moduleMem, types, &natives, errors);
+        QAK_CHECK(module != nullptr, "Expected module without errors.");
+        BytecodeCompiler compiler(mem);
+        bytecode::Program *program = compiler.compile(module, types, errors);
+        QAK_CHECK(program != nullptr, "Expected a program.");
+        int64_t expected = 500000ll * 499999ll / 2 + 500000ll * 500000ll;
+
+        Interpreter interpreter(mem);
+        double start = io::timeMillis();
+        QAK_CHECK(interpreter.run(program, errors), "Expected the interpreter to succeed.");
+        double interpreterTime = io::timeMillis() - start;
+        QAK_CHECK(interpreter.result().i == expected, "Expected %lld, got %lld", (long long) expected, (long long) interpreter.result().i);
+
+        Jit jit(mem);
+        jit.compile(program);
+        start = io::timeMillis();
+        QAK_CHECK(jit.run(program, errors), "Expected the Jit to succeed.");
+        double jitTime = io::timeMillis() - start;
+        QAK_CHECK(jit.result().i == expected, "Expected %lld, got %lld", (long long) expected, (long long) jit.result().i);
+        printf("1000000 native calls, interpreter: %f ms, jit: %f ms\n", interpreterTime, jitTime);
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+int main() {
+    testDifferential();
+    testErrors();
+    testSsa();
+    testCApi();
+    testBenchmark();
+    return 0;
+}
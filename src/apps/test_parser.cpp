@@ -1,11 +1,160 @@
 #include <stdio.h>
 #include "io.h"
 #include "parser.h"
+#include "visitor.h"
 #include "test.h"
 
 using namespace qak;
 using namespace qak::ast;
 
+/* AstField is the last node type, see AstType. */
+static const int NumAstTypes = AstField + 1;
+
+/* The number of nodes and bytes of each node type, see measureAstMemory(). */
+struct AstMemoryReport {
+    size_t numNodes[NumAstTypes];
+    size_t nodeBytes[NumAstTypes];
+    size_t listBytes;
+
+    AstMemoryReport() : listBytes(0) {
+        for (int i = 0; i < NumAstTypes; i++) numNodes[i] = nodeBytes[i] = 0;
+    }
+};
+
+/* Adds the size of each node and list of a tree to a report. */
+struct AstMemoryMeasurer : public Walker<AstMemoryMeasurer> {
+    AstMemoryReport &report;
+
+    AstMemoryMeasurer(HeapAllocator &mem, AstMemoryReport &report) : Walker<AstMemoryMeasurer>(mem), report(report) {}
+
+    template<typename T>
+    bool measure(T *node) {
+        report.numNodes[node->astType]++;
+        report.nodeBytes[node->astType] += sizeof(T);
+        return true;
+    }
+
+    template<typename T>
+    void measureList(FixedArray<T *> &list) {
+        report.listBytes += list.size() * sizeof(T *);
+    }
+
+    bool visitTypeSpecifier(TypeSpecifier *node) { return measure(node); }
+
+    bool visitParameter(Parameter *node) { return measure(node); }
+
+    bool visitFunction(Function *node) {
+        measureList(node->parameters);
+        measureList(node->statements);
+        return measure(node);
+    }
+
+    bool visitTernaryOperation(TernaryOperation *node) { return measure(node); }
+
+    bool visitBinaryOperation(BinaryOperation *node) { return measure(node); }
+
+    bool visitUnaryOperation(UnaryOperation *node) { return measure(node); }
+
+    bool visitLiteral(Literal *node) { return measure(node); }
+
+    bool visitVariableAccess(VariableAccess *node) { return measure(node); }
+
+    bool visitFunctionCall(FunctionCall *node) {
+        measureList(node->arguments);
+        return measure(node);
+    }
+
+    bool visitVariable(Variable *node) { return measure(node); }
+
+    bool visitWhile(While *node) {
+        measureList(node->statements);
+        return measure(node);
+    }
+
+    bool visitIf(If *node) {
+        measureList(node->trueBlock);
+        measureList(node->falseBlock);
+        return measure(node);
+    }
+
+    bool visitReturn(Return *node) { return measure(node); }
+
+    bool visitModule(Module *node) {
+        // Variables are also module statements, only count their list.
+        measureList(node->variables);
+        measureList(node->functions);
+        measureList(node->statements);
+        return measure(node);
+    }
+
+    bool visitError(ErrorNode *node) { return measure(node); }
+};
+
+static void measureAstMemory(AstNode *node, AstMemoryReport &report) {
+    HeapAllocator mem;
+    AstMemoryMeasurer measurer(mem, report);
+    measurer.walk(node);
+}
+
+static size_t bumpAllocatorBytes(BumpAllocator &mem) {
+    size_t bytes = 0;
+    for (Block *block = mem.head; block; block = block->next) bytes += block->nextFree - block->base;
+    return bytes;
+}
+
+static void printAstMemoryReport(Module *module, Source *source, BumpAllocator &moduleMem) {
+    const char *names[] = {"TypeSpecifier", "Parameter", "Function", "TernaryOperation", "BinaryOperation", "UnaryOperation",
+                           "Literal", "VariableAccess", "FunctionCall", "Variable", "While", "If", "Return", "Module", "Error",
+                           "TypeDeclaration", "Field"};
+    static_assert(sizeof(names) / sizeof(names[0]) == NumAstTypes, "Expected a name for each AST node type.");
+    AstMemoryReport report;
+    measureAstMemory(module, report);
+
+    size_t totalNodes = 0, totalBytes = report.listBytes;
+    printf("%-18s %8s %6s %10s\n", "Node", "Count", "Size", "Bytes");
+    for (int i = 0; i < NumAstTypes; i++) {
+        if (report.numNodes[i] == 0) continue;
+        printf("%-18s %8zu %6zu %10zu\n", names[i], report.numNodes[i], report.nodeBytes[i] / report.numNodes[i], report.nodeBytes[i]);
+        totalNodes += report.numNodes[i];
+        totalBytes += report.nodeBytes[i];
+    }
+    printf("%-18s %8s %6s %10zu\n", "Lists", "", "", report.listBytes);
+    printf("%-18s %8zu %6s %10zu\n", "Total", totalNodes, "", totalBytes);
+    printf("AST bytes per source KB: %.1f\n", totalBytes / (source->size / 1024.0));
+    size_t tokenBytes = module->tokens.size() * sizeof(Token);
+    printf("Token bytes per source KB: %.1f (%zu tokens)\n", tokenBytes / (source->size / 1024.0), module->tokens.size());
+    printf("Bump allocator bytes, including tokens and strings: %zu\n", bumpAllocatorBytes(moduleMem));
+}
+
+/* Generates a module with the given number of functions, each with the statements of the
+ * source as its body. The source must start with its module declaration. */
+static Source *generateFunctionsSource(HeapAllocator &mem, Source *source, size_t numFunctions) {
+    const char *moduleStart = strstr((const char *) source->data, "module ");
+    const char *body = strchr(moduleStart, '\n');
+    const char *header = "module functions\n", *functionStart = "fun f()\n", *functionEnd = "\nend\n";
+    size_t bodyLength = source->size - (body - (const char *) source->data);
+    size_t headerLength = strlen(header), startLength = strlen(functionStart), endLength = strlen(functionEnd);
+    size_t length = headerLength + numFunctions * (startLength + bodyLength + endLength);
+    char *sourceCode = mem.alloc<char>(length + 1, QAK_SRC_LOC);
+    char *cursor = sourceCode;
+    memcpy(cursor, header, headerLength);
+    cursor += headerLength;
+    for (size_t i = 0; i < numFunctions; i++) {
+        memcpy(cursor, functionStart, startLength);
+        cursor += startLength;
+        memcpy(cursor, body, bodyLength);
+        cursor += bodyLength;
+        memcpy(cursor, functionEnd, endLength);
+        cursor += endLength;
+    }
+    *cursor = 0;
+    Source *functionsSource = Source::fromMemory(mem, "functions.qak", sourceCode);
+    mem.free(sourceCode, QAK_SRC_LOC);
+    return functionsSource;
+}
+
+static Source *editSource(HeapAllocator &mem, Source *source, const char *text, const char *replacement, SourceEdit &edit);
+
 void testBench() {
     Test test("Parser - Benchmark");
     HeapAllocator mem;
@@ -20,6 +169,13 @@ void testBench() {
 
     printf("Total allocations before benchmark: %zu\n", mem.totalAllocations());
 
+    {
+        BumpAllocator moduleMem(mem);
+        Module *module = parser.parse(*source, errors, &moduleMem);
+        QAK_CHECK(module, "Expected module, got nullptr.");
+        printAstMemoryReport(module, source, moduleMem);
+    }
+
     uint32_t iterations = 100000;
     for (uint32_t i = 0; i < iterations; i++) {
         BumpAllocator moduleMem(mem);
@@ -35,6 +191,93 @@ void testBench() {
     printf("Took %f\n", time);
     printf("Throughput %f MB/s\n", throughput);
 
+    start = io::timeMillis();
+    BumpAllocator flatMem(mem);
+    FlatModule flatModule(mem, flatMem);
+    for (uint32_t i = 0; i < iterations; i++) {
+        QAK_CHECK(parser.parse(*source, errors, flatModule), "Expected flat module.");
+    }
+    time = (io::timeMillis() - start) / 1000.0;
+    throughput = (double) source->size * iterations / time / 1024 / 1024;
+    printf("Flat took %f\n", time);
+    printf("Flat throughput %f MB/s\n", throughput);
+
+    Source *functionsSource = generateFunctionsSource(mem, source, 10);
+    for (int lazy = 0; lazy < 2; lazy++) {
+        parser.setLazyFunctionBodies(lazy != 0);
+        start = io::timeMillis();
+        for (uint32_t i = 0; i < iterations / 10; i++) {
+            BumpAllocator moduleMem(mem);
+            Module *module = parser.parse(*functionsSource, errors, &moduleMem);
+            QAK_CHECK(module && module->functions.size() == 10, "Expected module with 10 functions.");
+        }
+        time = (io::timeMillis() - start) / 1000.0;
+        printf("%s function bodies took %f\n", lazy ? "Lazy" : "Eager", time);
+    }
+    parser.setLazyFunctionBodies(false);
+
+    Source *parallelSource = generateFunctionsSource(mem, source, 100);
+    for (uint32_t numThreads = 1; numThreads <= 4; numThreads *= 2) {
+        parser.setNumThreads(numThreads);
+        start = io::timeMillis();
+        for (uint32_t i = 0; i < iterations / 100; i++) {
+            BumpAllocator moduleMem(mem);
+            Module *module = parser.parse(*parallelSource, errors, &moduleMem);
+            QAK_CHECK(module && module->functions.size() == 100, "Expected module with 100 functions.");
+        }
+        time = (io::timeMillis() - start) / 1000.0;
+        printf("Function bodies on %u threads took %f\n", numThreads, time);
+    }
+    parser.setNumThreads(1);
+
+    // Edits the first of 100 functions, and reverts the edit on every other reparse.
+    SourceEdit edit(0, 0, 0);
+    Source *editedSource = editSource(mem, parallelSource, "var foo = 123\nvar bar", "var foo = 123 + 1\nvar bar", edit);
+    SourceEdit revert(edit.start, edit.start + edit.newLength, edit.end - edit.start);
+    start = io::timeMillis();
+    for (uint32_t i = 0; i < iterations / 500; i++) {
+        BumpAllocator moduleMem(mem), reparsedMem(mem);
+        Module *module = parser.parse(*parallelSource, errors, &moduleMem);
+        for (uint32_t j = 0; j < 10; j++) {
+            BumpAllocator &previousMem = j % 2 == 0 ? moduleMem : reparsedMem;
+            module = parser.reparse(module, j % 2 == 0 ? *editedSource : *parallelSource, j % 2 == 0 ? edit : revert, errors,
+                                    j % 2 == 0 ? &reparsedMem : &moduleMem);
+            QAK_CHECK(module && module->functions.size() == 100, "Expected module with 100 functions.");
+            previousMem.free();
+        }
+    }
+    time = (io::timeMillis() - start) / 1000.0;
+    printf("Parse and 10 reparses took %f\n", time);
+
+    // Reparsing the same edit costs about the same in a source with 10 times as many functions.
+    size_t numFunctions[] = {100, 1000};
+    double reparseTimes[] = {0, 0};
+    for (size_t i = 0; i < 2; i++) {
+        Source *sizedSource = i == 0 ? parallelSource : generateFunctionsSource(mem, source, numFunctions[i]);
+        SourceEdit sizedEdit(0, 0, 0);
+        Source *sizedEditedSource = editSource(mem, sizedSource, "var foo = 123\nvar bar", "var foo = 123 + 1\nvar bar", sizedEdit);
+        SourceEdit sizedRevert(sizedEdit.start, sizedEdit.start + sizedEdit.newLength, sizedEdit.end - sizedEdit.start);
+        BumpAllocator moduleMem(mem), reparsedMem(mem);
+        Module *module = parser.parse(*sizedSource, errors, &moduleMem);
+        for (uint32_t j = 0; j < 100; j++) {
+            BumpAllocator &previousMem = j % 2 == 0 ? moduleMem : reparsedMem;
+            start = io::timeMillis();
+            module = parser.reparse(module, j % 2 == 0 ? *sizedEditedSource : *sizedSource, j % 2 == 0 ? sizedEdit : sizedRevert, errors,
+                                    j % 2 == 0 ? &reparsedMem : &moduleMem);
+            time = io::timeMillis() - start;
+            QAK_CHECK(module && module->functions.size() == numFunctions[i], "Expected module with %zu functions.", numFunctions[i]);
+            previousMem.free();
+            if (j == 0 || time < reparseTimes[i]) reparseTimes[i] = time;
+        }
+        mem.freeObject(sizedEditedSource, QAK_SRC_LOC);
+        if (i > 0) mem.freeObject(sizedSource, QAK_SRC_LOC);
+    }
+    printf("Reparse of %zu functions took %f ms, of %zu functions %f ms\n", numFunctions[0], reparseTimes[0], numFunctions[1], reparseTimes[1]);
+    QAK_CHECK(reparseTimes[1] < 3 * reparseTimes[0], "Expected reparse cost not to grow with the size of the source.");
+    mem.freeObject(editedSource, QAK_SRC_LOC);
+    mem.freeObject(parallelSource, QAK_SRC_LOC);
+    mem.freeObject(functionsSource, QAK_SRC_LOC);
+
     printf("Total allocations after benchmark: %zu\n", mem.totalAllocations());
     printf("Total frees: %zu\n", mem.totalFrees());
     printf("Allocations after benchmark: %zu\n", mem.numAllocations());
@@ -138,6 +381,699 @@ void testV01() {
     QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
 }
 
+static Literal *getInitializerLiteral(Module *module, size_t variableIndex) {
+    Expression *initializer = module->variables[variableIndex]->initializerExpression;
+    QAK_CHECK(initializer && initializer->astType == AstLiteral, "Expected literal initializer for variable %zu", variableIndex);
+    return static_cast<Literal *>(initializer);
+}
+
+void testStringLiterals() {
+    Test test("Parser - string literals");
+    HeapAllocator mem;
+
+    Source *source = io::readFile("data/parser_strings.qak", mem);
+    QAK_CHECK(source != nullptr, "Couldn't read test file data/parser_strings.qak");
+
+    Parser parser(mem);
+    BumpAllocator moduleMem(mem);
+    Errors errors(mem, moduleMem);
+    Module *module = parser.parse(*source, errors, &moduleMem);
+    if (errors.hasErrors()) errors.print();
+    QAK_CHECK(module, "Expected module, got nullptr.");
+
+    const char *expected[] = {
+            "Hello world",
+            "Tab\tseparated \"quoted\" text with a backslash \\ and a newline\n",
+            "A long string literal without any escape sequences that spans more than 32 bytes",
+            "A long string literal without any escape sequences that spans more than 32 bytes\n",
+            ""
+    };
+    QAK_CHECK(module->strings.size() == 5, "Expected 5 pooled strings, got %zu", module->strings.size());
+    for (size_t i = 0; i < 5; i++) {
+        InternedString &string = module->strings[i];
+        QAK_CHECK(string.length == strlen(expected[i]) && memcmp(string.data, expected[i], string.length) == 0,
+                  "Expected pooled string '%s', got '%.*s'", expected[i], (int) string.length, string.data);
+        QAK_CHECK(string.data[string.length] == 0, "Expected null terminated pooled string");
+    }
+
+    uint32_t stringIndices[] = {0, 0, 1, 2, 3, 4};
+    for (size_t i = 0; i < 6; i++) {
+        Literal *literal = getInitializerLiteral(module, i);
+        QAK_CHECK(literal->decodedValue.stringIndex == stringIndices[i], "Expected string index %u, got %u", stringIndices[i],
+                  literal->decodedValue.stringIndex);
+    }
+
+    uint32_t characters[] = {'c', '\n', 0xd55c};
+    for (size_t i = 0; i < 3; i++) {
+        Literal *literal = getInitializerLiteral(module, 6 + i);
+        QAK_CHECK(literal->decodedValue.characterValue == characters[i], "Expected character %x, got %x", characters[i],
+                  literal->decodedValue.characterValue);
+    }
+
+    uint32_t codePoint = 0;
+    QAK_CHECK(literals::decodeUtf8((const uint8_t *) "\xf4\x8f\xbf\xbf", 4, &codePoint) == 4 && codePoint == 0x10ffff,
+              "Expected U+10FFFF, got %x", codePoint);
+    QAK_CHECK(literals::decodeUtf8((const uint8_t *) "\xc0\xaf", 2, &codePoint) == 0, "Expected overlong 2 byte encoding to be invalid");
+    QAK_CHECK(literals::decodeUtf8((const uint8_t *) "\xe0\x80\xaf", 3, &codePoint) == 0, "Expected overlong 3 byte encoding to be invalid");
+    QAK_CHECK(literals::decodeUtf8((const uint8_t *) "\xf0\x80\x80\xaf", 4, &codePoint) == 0, "Expected overlong 4 byte encoding to be invalid");
+    QAK_CHECK(literals::decodeUtf8((const uint8_t *) "\xed\xa0\x80", 3, &codePoint) == 0, "Expected high surrogate to be invalid");
+    QAK_CHECK(literals::decodeUtf8((const uint8_t *) "\xed\xbf\xbf", 3, &codePoint) == 0, "Expected low surrogate to be invalid");
+    QAK_CHECK(literals::decodeUtf8((const uint8_t *) "\xf4\x90\x80\x80", 4, &codePoint) == 0, "Expected code point beyond U+10FFFF to be invalid");
+
+    FunctionCall *call = static_cast<FunctionCall *>(module->statements[module->statements.size() - 1]);
+    Literal *argument = static_cast<Literal *>(call->arguments[0]);
+    QAK_CHECK(argument->decodedValue.stringIndex == 0, "Expected string index 0, got %u", argument->decodedValue.stringIndex);
+
+    Source *invalidSource = Source::fromMemory(mem, "invalid.qak", "module invalid var a = \"unknown \\q escape\"");
+    BumpAllocator invalidMem(mem);
+    Errors invalidErrors(mem, invalidMem);
+    Module *invalidModule = parser.parse(*invalidSource, invalidErrors, &invalidMem);
+    QAK_CHECK(invalidModule, "Expected partial module for invalid escape sequence.");
+    QAK_CHECK(invalidErrors.getErrors().size() == 1, "Expected 1 error, got %zu", invalidErrors.getErrors().size());
+    QAK_CHECK(invalidModule->statements[0]->astType == AstError, "Expected error node for invalid escape sequence.");
+    invalidErrors.print();
+}
+
+template<typename T>
+static void checkFlatList(FlatModule &flatModule, qak_ast_node_list &list, Module *module, FixedArray<T *> &nodes) {
+    QAK_CHECK(list.numNodes == nodes.size(), "Expected %zu nodes in list, got %u", nodes.size(), list.numNodes);
+    for (uint32_t i = 0; i < list.numNodes; i++) {
+        qak_ast_node_index index = flatModule.listNode(list, i);
+        qak_ast_node &node = flatModule.nodes[index];
+        QAK_CHECK(index < flatModule.root(), "Expected child to be stored before the module node.");
+        QAK_CHECK((int) node.type == (int) nodes[i]->astType, "Expected node type %i, got %i", nodes[i]->astType, node.type);
+        Span span = module->span(nodes[i]);
+        QAK_CHECK(node.span.start == span.start && node.span.end == span.end, "Expected same span as tree node.");
+    }
+}
+
+void testFlatModule() {
+    Test test("Parser - flat module");
+    HeapAllocator mem;
+    {
+        Source *source = io::readFile("data/parser_v_0_1.qak", mem);
+        QAK_CHECK(source != nullptr, "Couldn't read test file data/parser_v_0_1.qak");
+
+        Parser parser(mem);
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        Module *module = parser.parse(*source, errors, &moduleMem);
+        if (errors.hasErrors()) errors.print();
+        QAK_CHECK(module, "Expected module, got nullptr.");
+
+        BumpAllocator flatMem(mem);
+        FlatModule flatModule(mem, flatMem);
+        QAK_CHECK(parser.parse(*source, errors, flatModule), "Expected flat module.");
+        QAK_CHECK(flatModule.root() >= 0, "Expected module node.");
+        qak_ast_node &moduleNode = flatModule.nodes[flatModule.root()];
+        QAK_CHECK(moduleNode.type == QakAstModule, "Expected module node, got %i", moduleNode.type);
+        checkFlatList(flatModule, moduleNode.data.module.variables, module, module->variables);
+        checkFlatList(flatModule, moduleNode.data.module.functions, module, module->functions);
+        checkFlatList(flatModule, moduleNode.data.module.statements, module, module->statements);
+        QAK_CHECK(flatModule.strings.size() == module->strings.size(), "Expected %zu strings, got %zu", module->strings.size(),
+                  flatModule.strings.size());
+
+        Source *invalidSource = Source::fromMemory(mem, "invalid.qak", "module invalid var a = (1 + ");
+        QAK_CHECK(!parser.parse(*invalidSource, errors, flatModule), "Expected parse error.");
+        QAK_CHECK(flatModule.root() >= 0, "Expected partial flat module after parse error.");
+        qak_ast_module &invalidModule = flatModule.nodes[flatModule.root()].data.module;
+        QAK_CHECK(invalidModule.statements.numNodes == 1, "Expected 1 statement, got %u", invalidModule.statements.numNodes);
+        QAK_CHECK(flatModule.nodes[flatModule.listNode(invalidModule.statements, 0)].type == QakAstError, "Expected error node.");
+
+        mem.freeObject(invalidSource, QAK_SRC_LOC);
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+/* Generates a module with a variable whose initializer is nested the given number of times, e.g. ((1)) or --1. */
+static Source *generateNestedSource(HeapAllocator &mem, const char *open, const char *close, size_t nesting) {
+    const char *prefix = "module deep var a = ";
+    size_t openLength = strlen(open), closeLength = strlen(close), prefixLength = strlen(prefix);
+    size_t length = prefixLength + nesting * (openLength + closeLength) + 1;
+    char *sourceCode = mem.alloc<char>(length + 1, QAK_SRC_LOC);
+    char *cursor = sourceCode;
+    memcpy(cursor, prefix, prefixLength);
+    cursor += prefixLength;
+    for (size_t i = 0; i < nesting; i++, cursor += openLength) memcpy(cursor, open, openLength);
+    *cursor++ = '1';
+    for (size_t i = 0; i < nesting; i++, cursor += closeLength) memcpy(cursor, close, closeLength);
+    *cursor = 0;
+    Source *source = Source::fromMemory(mem, "deep.qak", sourceCode);
+    mem.free(sourceCode, QAK_SRC_LOC);
+    return source;
+}
+
+void testNesting() {
+    Test test("Parser - nesting");
+    HeapAllocator mem;
+    {
+        Parser parser(mem);
+
+        // Nesting deeper than the maximum must produce a single error instead of overflowing the stack.
+        const char *opens[] = {"(", "-"};
+        const char *closes[] = {")", ""};
+        for (size_t i = 0; i < 2; i++) {
+            Source *source = generateNestedSource(mem, opens[i], closes[i], 500000);
+            BumpAllocator moduleMem(mem);
+            Errors errors(mem, moduleMem);
+            QAK_CHECK(parser.parse(*source, errors, &moduleMem) == nullptr, "Expected nullptr for too deeply nested expression.");
+            QAK_CHECK(errors.getErrors().size() == 1, "Expected 1 error, got %zu", errors.getErrors().size());
+            QAK_CHECK(strstr(errors.getErrors()[0].message, "Maximum nesting depth"), "Expected nesting error, got '%s'",
+                      errors.getErrors()[0].message);
+            mem.freeObject(source, QAK_SRC_LOC);
+        }
+
+        // Nesting up to a raised maximum parses.
+        parser.setMaxNestingDepth(5000);
+        Source *source = generateNestedSource(mem, "(", ")", 2000);
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        Module *module = parser.parse(*source, errors, &moduleMem);
+        if (errors.hasErrors()) errors.print();
+        QAK_CHECK(module, "Expected module, got nullptr.");
+
+        Expression *expression = module->variables[0]->initializerExpression;
+        QAK_CHECK(expression && expression->astType == AstLiteral, "Expected literal, parentheses do not produce nodes.");
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+template<typename T>
+static void checkAstTypes(FixedArray<T *> &nodes, AstType *types, size_t numTypes) {
+    QAK_CHECK(nodes.size() == numTypes, "Expected %zu nodes, got %zu", numTypes, nodes.size());
+    for (size_t i = 0; i < numTypes; i++) {
+        QAK_CHECK(nodes[i]->astType == types[i], "Expected node type %i, got %i", types[i], nodes[i]->astType);
+    }
+}
+
+void testErrorRecovery() {
+    Test test("Parser - error recovery");
+    HeapAllocator mem;
+    {
+        Source *source = io::readFile("data/parser_errors.qak", mem);
+        QAK_CHECK(source != nullptr, "Couldn't read test file data/parser_errors.qak");
+
+        // All errors are reported in a single pass, statements that could
+        // not be parsed are replaced by error nodes.
+        Parser parser(mem);
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        Module *module = parser.parse(*source, errors, &moduleMem);
+        errors.print();
+        QAK_CHECK(module, "Expected partial module, got nullptr.");
+        QAK_CHECK(errors.getErrors().size() == 7, "Expected 7 errors, got %zu", errors.getErrors().size());
+        HeapAllocator printMem;
+        parser::printAstNode(module, printMem);
+
+        AstType moduleStatements[] = {AstError, AstVariable, AstIf, AstVariable};
+        checkAstTypes(module->statements, moduleStatements, 4);
+        QAK_CHECK(module->variables.size() == 2, "Expected 2 variables, got %zu", module->variables.size());
+
+        Function *function = module->functions[0];
+        QAK_CHECK(function->parameters.size() == 1, "Expected 1 parameter, got %zu", function->parameters.size());
+        AstType functionStatements[] = {AstError, AstWhile, AstReturn};
+        checkAstTypes(function->statements, functionStatements, 3);
+        While *whileNode = (While *) function->statements[1];
+        QAK_CHECK(whileNode->condition->astType == AstError, "Expected error node as while condition.");
+        AstType whileStatements[] = {AstError};
+        checkAstTypes(whileNode->statements, whileStatements, 1);
+
+        If *ifNode = (If *) module->statements[2];
+        AstType blockStatements[] = {AstError};
+        checkAstTypes(ifNode->trueBlock, blockStatements, 1);
+        checkAstTypes(ifNode->falseBlock, blockStatements, 1);
+
+        // The flat module has the same error nodes.
+        BumpAllocator flatMem(mem);
+        FlatModule flatModule(mem, flatMem);
+        Errors flatErrors(mem, flatMem);
+        QAK_CHECK(!parser.parse(*source, flatErrors, flatModule), "Expected parse errors.");
+        QAK_CHECK(flatErrors.getErrors().size() == 7, "Expected 7 errors, got %zu", flatErrors.getErrors().size());
+        qak_ast_node &moduleNode = flatModule.nodes[flatModule.root()];
+        checkFlatList(flatModule, moduleNode.data.module.statements, module, module->statements);
+        checkFlatList(flatModule, moduleNode.data.module.functions, module, module->functions);
+
+        // Parsing stops at the maximum number of errors.
+        parser.setMaxErrors(3);
+        BumpAllocator cappedMem(mem);
+        Errors cappedErrors(mem, cappedMem);
+        Module *cappedModule = parser.parse(*source, cappedErrors, &cappedMem);
+        QAK_CHECK(cappedModule, "Expected partial module, got nullptr.");
+        QAK_CHECK(cappedErrors.getErrors().size() == 3, "Expected 3 errors, got %zu", cappedErrors.getErrors().size());
+
+        // A ternary operator without ':' is reported, not only replaced by an error node.
+        Source *ternarySource = Source::fromMemory(mem, "ternary.qak", "module ternary var a = true ? 1\nvar b = 2");
+        BumpAllocator ternaryMem(mem);
+        Errors ternaryErrors(mem, ternaryMem);
+        parser.setMaxErrors(QAK_MAX_ERRORS);
+        Module *ternaryModule = parser.parse(*ternarySource, ternaryErrors, &ternaryMem);
+        QAK_CHECK(ternaryModule, "Expected partial module, got nullptr.");
+        QAK_CHECK(ternaryErrors.getErrors().size() == 1, "Expected 1 error, got %zu", ternaryErrors.getErrors().size());
+        QAK_CHECK(strstr(ternaryErrors.getErrors()[0].message, "Expected ':'"), "Expected missing ':' error, got '%s'",
+                  ternaryErrors.getErrors()[0].message);
+        mem.freeObject(ternarySource, QAK_SRC_LOC);
+
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+void testLazyFunctionBodies() {
+    Test test("Parser - lazy function bodies");
+    HeapAllocator mem;
+    {
+        Source *source = io::readFile("data/parser_lazy.qak", mem);
+        QAK_CHECK(source != nullptr, "Couldn't read test file data/parser_lazy.qak");
+
+        Parser parser(mem);
+        BumpAllocator eagerMem(mem);
+        Errors errors(mem, eagerMem);
+        Module *eagerModule = parser.parse(*source, errors, &eagerMem);
+        QAK_CHECK(eagerModule, "Expected module, got nullptr.");
+
+        Parser lazyParser(mem);
+        lazyParser.setLazyFunctionBodies(true);
+        BumpAllocator lazyMem(mem);
+        Module *lazyModule = lazyParser.parse(*source, errors, &lazyMem);
+        QAK_CHECK(lazyModule, "Expected module, got nullptr.");
+        QAK_CHECK(lazyModule->strings.size() == eagerModule->strings.size(), "Expected %zu strings, got %zu",
+                  eagerModule->strings.size(), lazyModule->strings.size());
+        QAK_CHECK(lazyModule->functions.size() == 4, "Expected 4 functions, got %zu", lazyModule->functions.size());
+        for (size_t i = 0; i < lazyModule->functions.size(); i++) {
+            Function *function = lazyModule->functions[i];
+            QAK_CHECK(!function->isBodyParsed && function->statements.size() == 0, "Expected skipped function body.");
+            QAK_CHECK(function->lastToken == eagerModule->functions[i]->lastToken, "Expected function to end at its end token.");
+        }
+
+        // The first body is parsed by the parser that parsed the module, the others
+        // by a parser that has to copy the module's tokens first.
+        Parser bodyParser(mem);
+        for (size_t i = 0; i < lazyModule->functions.size(); i++) {
+            Parser &functionParser = i == 0 ? lazyParser : bodyParser;
+            QAK_CHECK(functionParser.parseFunctionBody(lazyModule, lazyModule->functions[i], errors), "Expected function body.");
+            QAK_CHECK(lazyModule->functions[i]->isBodyParsed, "Expected parsed function body.");
+        }
+        if (errors.hasErrors()) errors.print();
+        QAK_CHECK(!errors.hasErrors(), "Expected no errors.");
+
+        AstMemoryReport eagerReport, lazyReport;
+        measureAstMemory(eagerModule, eagerReport);
+        measureAstMemory(lazyModule, lazyReport);
+        for (int i = 0; i < NumAstTypes; i++) {
+            QAK_CHECK(eagerReport.numNodes[i] == lazyReport.numNodes[i], "Expected %zu nodes of type %i, got %zu", eagerReport.numNodes[i], i,
+                      lazyReport.numNodes[i]);
+        }
+        Function *eagerCount = eagerModule->functions[1], *lazyCount = lazyModule->functions[1];
+        for (size_t i = 0; i < eagerCount->statements.size(); i++) {
+            Statement *eagerStatement = eagerCount->statements[i], *lazyStatement = lazyCount->statements[i];
+            QAK_CHECK(eagerStatement->astType == lazyStatement->astType && eagerStatement->firstToken == lazyStatement->firstToken &&
+                      eagerStatement->lastToken == lazyStatement->lastToken, "Expected same statement as eagerly parsed.");
+        }
+        HeapAllocator printMem;
+        parser::printAstNode(lazyModule, printMem);
+
+        // Syntax errors in a skipped body are reported once the body is parsed.
+        Source *invalidSource = Source::fromMemory(mem, "invalid.qak", "module invalid fun f() var = 1 end var x = 2");
+        BumpAllocator invalidMem(mem);
+        Errors invalidErrors(mem, invalidMem);
+        Module *invalidModule = lazyParser.parse(*invalidSource, invalidErrors, &invalidMem);
+        QAK_CHECK(invalidModule && !invalidErrors.hasErrors(), "Expected module without errors.");
+        QAK_CHECK(!lazyParser.parseFunctionBody(invalidModule, invalidModule->functions[0], invalidErrors), "Expected error.");
+        QAK_CHECK(invalidErrors.getErrors().size() == 1, "Expected 1 error, got %zu", invalidErrors.getErrors().size());
+        QAK_CHECK(invalidModule->functions[0]->statements[0]->astType == AstError, "Expected error node.");
+        QAK_CHECK(!invalidModule->isReusable[0] && invalidModule->isReusable[1], "Expected only the function to be parsed again by reparses.");
+
+        mem.freeObject(invalidSource, QAK_SRC_LOC);
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+static void checkSameErrors(Errors &expected, Errors &actual) {
+    QAK_CHECK(expected.getErrors().size() == actual.getErrors().size(), "Expected %zu errors, got %zu", expected.getErrors().size(),
+              actual.getErrors().size());
+    for (size_t i = 0; i < expected.getErrors().size(); i++) {
+        Error &expectedError = expected.getErrors()[i], &actualError = actual.getErrors()[i];
+        QAK_CHECK(expectedError.span.start == actualError.span.start && strcmp(expectedError.message, actualError.message) == 0,
+                  "Expected error '%s' at %u, got '%s' at %u", expectedError.message, expectedError.span.start, actualError.message,
+                  actualError.span.start);
+    }
+}
+
+static void checkSameNodes(Module *expected, Module *actual) {
+    AstMemoryReport expectedReport, actualReport;
+    measureAstMemory(expected, expectedReport);
+    measureAstMemory(actual, actualReport);
+    for (int i = 0; i < NumAstTypes; i++) {
+        QAK_CHECK(expectedReport.numNodes[i] == actualReport.numNodes[i], "Expected %zu nodes of type %i, got %zu", expectedReport.numNodes[i], i,
+                  actualReport.numNodes[i]);
+    }
+}
+
+void testParallelFunctionBodies() {
+    Test test("Parser - parallel function bodies");
+    HeapAllocator mem;
+    {
+        Source *benchmarkSource = io::readFile("data/parser_benchmark.qak", mem);
+        QAK_CHECK(benchmarkSource != nullptr, "Couldn't read test file data/parser_benchmark.qak");
+        Source *source = generateFunctionsSource(mem, benchmarkSource, 50);
+
+        Parser parser(mem);
+        BumpAllocator eagerMem(mem);
+        Errors errors(mem, eagerMem);
+        Module *eagerModule = parser.parse(*source, errors, &eagerMem);
+        QAK_CHECK(eagerModule, "Expected module, got nullptr.");
+
+        Parser parallelParser(mem);
+        parallelParser.setNumThreads(4);
+        BumpAllocator parallelMem(mem);
+        Module *parallelModule = parallelParser.parse(*source, errors, &parallelMem);
+        QAK_CHECK(parallelModule, "Expected module, got nullptr.");
+        QAK_CHECK(!errors.hasErrors(), "Expected no errors.");
+        QAK_CHECK(parallelModule->functions.size() == 50, "Expected 50 functions, got %zu", parallelModule->functions.size());
+        for (size_t i = 0; i < parallelModule->functions.size(); i++) {
+            QAK_CHECK(parallelModule->functions[i]->isBodyParsed, "Expected parsed function body.");
+        }
+        checkSameNodes(eagerModule, parallelModule);
+
+        // Errors in the bodies are reported in source order, between the errors of the module.
+        Source *invalidSource = Source::fromMemory(mem, "invalid.qak",
+                                                   "module invalid\n"
+                                                   "fun a()\n var = 1\n return )\nend\n"
+                                                   "var x = )\n"
+                                                   "fun b()\n var y: = 2\n while )\n end\nend\n"
+                                                   "var z = 3 +\n"
+                                                   "fun c()\n return 1 +\nend\n");
+        BumpAllocator invalidEagerMem(mem);
+        Errors eagerErrors(mem, invalidEagerMem);
+        Module *invalidEagerModule = parser.parse(*invalidSource, eagerErrors, &invalidEagerMem);
+        QAK_CHECK(invalidEagerModule, "Expected module, got nullptr.");
+        QAK_CHECK(eagerErrors.getErrors().size() >= 5, "Expected at least 5 errors, got %zu", eagerErrors.getErrors().size());
+
+        BumpAllocator invalidParallelMem(mem);
+        Errors parallelErrors(mem, invalidParallelMem);
+        Module *invalidParallelModule = parallelParser.parse(*invalidSource, parallelErrors, &invalidParallelMem);
+        QAK_CHECK(invalidParallelModule, "Expected module, got nullptr.");
+        checkSameErrors(eagerErrors, parallelErrors);
+        checkSameNodes(invalidEagerModule, invalidParallelModule);
+        for (size_t i = 0; i < invalidEagerModule->items.size(); i++) {
+            QAK_CHECK(invalidEagerModule->isReusable[i] == invalidParallelModule->isReusable[i], "Expected item %zu to be reusable alike.", i);
+        }
+
+        // The maximum number of errors applies to the merged errors.
+        parser.setMaxErrors(3);
+        parallelParser.setMaxErrors(3);
+        BumpAllocator cappedEagerMem(mem);
+        Errors cappedEagerErrors(mem, cappedEagerMem);
+        QAK_CHECK(parser.parse(*invalidSource, cappedEagerErrors, &cappedEagerMem), "Expected module, got nullptr.");
+        BumpAllocator cappedParallelMem(mem);
+        Errors cappedParallelErrors(mem, cappedParallelMem);
+        QAK_CHECK(parallelParser.parse(*invalidSource, cappedParallelErrors, &cappedParallelMem), "Expected module, got nullptr.");
+        checkSameErrors(cappedEagerErrors, cappedParallelErrors);
+
+        mem.freeObject(invalidSource, QAK_SRC_LOC);
+        mem.freeObject(source, QAK_SRC_LOC);
+        mem.freeObject(benchmarkSource, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+/* Replaces the first occurrence of the text in the source and returns the edited source. */
+static Source *editSource(HeapAllocator &mem, Source *source, const char *text, const char *replacement, SourceEdit &edit) {
+    const char *data = (const char *) source->data;
+    const char *found = strstr(data, text);
+    QAK_CHECK(found, "Couldn't find '%s' in source.", text);
+    size_t textLength = strlen(text), replacementLength = strlen(replacement), offset = found - data;
+    char *editedCode = mem.alloc<char>(source->size - textLength + replacementLength + 1, QAK_SRC_LOC);
+    memcpy(editedCode, data, offset);
+    memcpy(editedCode + offset, replacement, replacementLength);
+    memcpy(editedCode + offset + replacementLength, found + textLength, source->size - offset - textLength);
+    editedCode[source->size - textLength + replacementLength] = 0;
+    Source *edited = Source::fromMemory(mem, source->fileName, editedCode);
+    mem.free(editedCode, QAK_SRC_LOC);
+    edit = SourceEdit((uint32_t) offset, (uint32_t) (offset + textLength), (uint32_t) replacementLength);
+    return edited;
+}
+
+/* Reparses the module into the other of the two bump allocators, then frees the one it was allocated in. */
+static Module *reparse(Parser &parser, Module *module, Source *source, SourceEdit edit, Errors &errors, BumpAllocator &first,
+                       BumpAllocator &second) {
+    BumpAllocator &previousMem = &module->mem == &first ? first : second;
+    module = parser.reparse(module, *source, edit, errors, &previousMem == &first ? &second : &first);
+    previousMem.free();
+    return module;
+}
+
+/* Records the nodes of a tree in pre-order and post-order by recursion, see WalkRecorder. */
+struct RecursiveRecorder {
+    Array<AstNode *> &preOrder;
+    Array<AstNode *> &postOrder;
+
+    RecursiveRecorder(Array<AstNode *> &preOrder, Array<AstNode *> &postOrder) : preOrder(preOrder), postOrder(postOrder) {}
+
+    void operator()(AstNode *node) {
+        preOrder.add(node);
+        forEachChild(node, *this);
+        postOrder.add(node);
+    }
+};
+
+/* Collects the indices of the module's tokens in source order, the tokens of its header followed by the tokens of its items. */
+static void collectTokens(Module *module, Array<uint32_t> &tokens) {
+    tokens.add(module->firstToken);
+    tokens.add(module->name);
+    for (size_t i = 0; i < module->itemTokens.size(); i++) {
+        for (uint32_t j = module->itemTokens[i].firstToken; j <= module->itemTokens[i].lastToken; j++) tokens.add(j);
+    }
+}
+
+static bool isSameSpan(Span a, Span b) {
+    return a.start == b.start && a.end == b.end && a.startLine == b.startLine && a.endLine == b.endLine;
+}
+
+/* Checks that the reparsed module has the same tokens, nodes and errors as the module parsed from scratch. Token indices
+ * of reparsed modules differ, so tokens are compared in source order and nodes by their spans. */
+static void checkReparse(Module *reparsed, Errors &reparseErrors, Source *source, HeapAllocator &mem) {
+    Parser parser(mem);
+    BumpAllocator expectedMem(mem);
+    Errors expectedErrors(mem, expectedMem);
+    Module *expected = parser.parse(*source, expectedErrors, &expectedMem);
+    QAK_CHECK(expected && reparsed, "Expected module, got nullptr.");
+    checkSameErrors(expectedErrors, reparseErrors);
+    checkSameNodes(expected, reparsed);
+
+    Array<uint32_t> expectedTokens(mem), tokens(mem);
+    collectTokens(expected, expectedTokens);
+    collectTokens(reparsed, tokens);
+    QAK_CHECK(expected->tokens.size() == reparsed->tokens.size(), "Expected %zu tokens, got %zu", expected->tokens.size(), reparsed->tokens.size());
+    QAK_CHECK(expectedTokens.size() == expected->tokens.size() && tokens.size() == expectedTokens.size(), "Expected items to cover all tokens.");
+    for (size_t i = 0; i < expectedTokens.size(); i++) {
+        Token &expectedToken = expected->tokens[expectedTokens[i]], &token = reparsed->tokens[tokens[i]];
+        QAK_CHECK(expectedToken.type == token.type && isSameSpan(expectedToken, token), "Expected same token %zu.", i);
+    }
+
+    QAK_CHECK(expected->functions.size() == reparsed->functions.size() && expected->statements.size() == reparsed->statements.size() &&
+              expected->variables.size() == reparsed->variables.size() && expected->types.size() == reparsed->types.size() &&
+              expected->items.size() == reparsed->items.size(), "Expected same number of items.");
+    for (size_t i = 0; i < expected->items.size(); i++) {
+        QAK_CHECK(expected->isReusable[i] == reparsed->isReusable[i], "Expected item %zu to be reusable alike.", i);
+        QAK_CHECK(isSameSpan(expected->span(expected->items[i]), reparsed->span(reparsed->items[i])), "Expected item %zu at the same tokens.", i);
+    }
+    for (size_t i = 0; i < expected->functions.size(); i++) {
+        Function *expectedFunction = expected->functions[i], *function = reparsed->functions[i];
+        QAK_CHECK(isSameSpan(expected->span(expectedFunction), reparsed->span(function)) &&
+                  isSameSpan(expected->token(expectedFunction->name), reparsed->token(function->name)) &&
+                  isSameSpan(expected->token(expectedFunction->bodyFirstToken), reparsed->token(function->bodyFirstToken)),
+                  "Expected function at the same tokens.");
+    }
+    for (size_t i = 0; i < expected->statements.size(); i++) {
+        QAK_CHECK(isSameSpan(expected->span(expected->statements[i]), reparsed->span(reparsed->statements[i])), "Expected statement at the same tokens.");
+    }
+
+    Array<AstNode *> expectedNodes(mem), expectedPostOrder(mem), nodes(mem), postOrder(mem);
+    RecursiveRecorder expectedRecorder(expectedNodes, expectedPostOrder), recorder(nodes, postOrder);
+    expectedRecorder(expected);
+    recorder(reparsed);
+    QAK_CHECK(expectedNodes.size() == nodes.size(), "Expected %zu nodes, got %zu", expectedNodes.size(), nodes.size());
+    for (size_t i = 0; i < expectedNodes.size(); i++) {
+        QAK_CHECK(expectedNodes[i]->astType == nodes[i]->astType && isSameSpan(expected->span(expectedNodes[i]), reparsed->span(nodes[i])),
+                  "Expected node %zu at the same tokens.", i);
+    }
+}
+
+void testIncrementalReparse() {
+    Test test("Parser - incremental reparse");
+    HeapAllocator mem;
+    {
+        Source *source = io::readFile("data/parser_lazy.qak", mem);
+        QAK_CHECK(source != nullptr, "Couldn't read test file data/parser_lazy.qak");
+
+        Parser parser(mem);
+        BumpAllocator moduleMem(mem), reparsedMem(mem), errorMem(mem);
+        Errors errors(mem, errorMem);
+        Module *module = parser.parse(*source, errors, &moduleMem);
+        QAK_CHECK(module && !errors.hasErrors(), "Expected module without errors.");
+
+        // An edit inside a function only reparses that function, the items after it keep their token indices.
+        Function *fibonacci = module->functions[0], *count = module->functions[1], *greet = module->functions[2];
+        uint32_t greetName = greet->name;
+        Statement *greeting = module->statements[0], *print = module->statements[1];
+        SourceEdit edit(0, 0, 0);
+        Source *edited = editSource(mem, source, "print('o', i)", "print('o', i, limit - i)", edit);
+        Errors editErrors(mem, errorMem);
+        module = reparse(parser, module, edited, edit, editErrors, moduleMem, reparsedMem);
+        checkReparse(module, editErrors, edited, mem);
+        QAK_CHECK(module->functions[0] == fibonacci && module->functions[2] == greet, "Expected reused functions.");
+        QAK_CHECK(module->functions[1] != count, "Expected reparsed function.");
+        QAK_CHECK(greet->name == greetName && module->token(greet->name).matches(QAK_STR("greet")), "Expected reused function at its tokens.");
+        QAK_CHECK(module->statements[0] == greeting && module->statements[1] == print, "Expected reused statements.");
+        FunctionCall *greetCall = (FunctionCall *) ((FunctionCall *) print)->arguments[0];
+        InternedString &lazyString = module->strings[((Literal *) greetCall->arguments[0])->decodedValue.stringIndex];
+        QAK_CHECK(lazyString.length == 4 && memcmp(lazyString.data, "lazy", 4) == 0, "Expected string literal of reused statement.");
+        mem.freeObject(source, QAK_SRC_LOC);
+        source = edited;
+
+        // Errors of reparsed items are reported, items with errors are reparsed on the next edit.
+        edited = editSource(mem, source, "return greeting", "var = greeting", edit);
+        Errors invalidErrors(mem, errorMem);
+        module = reparse(parser, module, edited, edit, invalidErrors, moduleMem, reparsedMem);
+        checkReparse(module, invalidErrors, edited, mem);
+        QAK_CHECK(invalidErrors.getErrors().size() == 1, "Expected 1 error, got %zu", invalidErrors.getErrors().size());
+        mem.freeObject(source, QAK_SRC_LOC);
+        source = edited;
+
+        edited = editSource(mem, source, "n < 2", "n <= 1", edit);
+        Errors stillInvalidErrors(mem, errorMem);
+        module = reparse(parser, module, edited, edit, stillInvalidErrors, moduleMem, reparsedMem);
+        checkReparse(module, stillInvalidErrors, edited, mem);
+        QAK_CHECK(stillInvalidErrors.getErrors().size() == 1, "Expected 1 error, got %zu", stillInvalidErrors.getErrors().size());
+        mem.freeObject(source, QAK_SRC_LOC);
+        source = edited;
+
+        // Edits between items and of the module header.
+        edited = editSource(mem, source, "fun empty()", "var x = 1\nfun empty()", edit);
+        Errors betweenErrors(mem, errorMem);
+        module = reparse(parser, module, edited, edit, betweenErrors, moduleMem, reparsedMem);
+        checkReparse(module, betweenErrors, edited, mem);
+        mem.freeObject(source, QAK_SRC_LOC);
+        source = edited;
+
+        // An edit that changes the tokens after it, here by commenting out the rest of a line.
+        edited = editSource(mem, source, "fun greet", "# fun greet", edit);
+        Errors commentErrors(mem, errorMem);
+        module = reparse(parser, module, edited, edit, commentErrors, moduleMem, reparsedMem);
+        checkReparse(module, commentErrors, edited, mem);
+        mem.freeObject(source, QAK_SRC_LOC);
+        source = edited;
+
+        edited = editSource(mem, source, "module lazy", "module eager", edit);
+        Errors headerErrors(mem, errorMem);
+        module = reparse(parser, module, edited, edit, headerErrors, moduleMem, reparsedMem);
+        checkReparse(module, headerErrors, edited, mem);
+        mem.freeObject(source, QAK_SRC_LOC);
+        source = edited;
+
+        // Reparses keep the nodes of replaced items in the bump allocator they take over, until
+        // it grows too large and the source is parsed from scratch.
+        edited = editSource(mem, source, "print('o', i, limit - i)", "print('o', i, limit - i - 1)", edit);
+        SourceEdit revert(edit.start, edit.start + edit.newLength, edit.end - edit.start);
+        size_t numReused = 0, numParsed = 0;
+        for (uint32_t i = 0; i < 100; i++) {
+            AstNode *first = module->items[0];
+            Errors repeatedErrors(mem, errorMem);
+            module = reparse(parser, module, i % 2 == 0 ? edited : source, i % 2 == 0 ? edit : revert, repeatedErrors, moduleMem, reparsedMem);
+            checkReparse(module, repeatedErrors, i % 2 == 0 ? edited : source, mem);
+            QAK_CHECK(module->mem.numBytes <= (QAK_MAX_REPARSE_GROWTH + 1) * module->numParsedBytes, "Expected at most %zu bytes, got %zu",
+                      (QAK_MAX_REPARSE_GROWTH + 1) * module->numParsedBytes, module->mem.numBytes);
+            if (module->items[0] == first) numReused++;
+            else numParsed++;
+        }
+        QAK_CHECK(numReused > 0 && numParsed > 0, "Expected reused and parsed items, got %zu and %zu.", numReused, numParsed);
+
+        // Reparsing into the previous module's bump allocator is limited the same way.
+        numReused = numParsed = 0;
+        for (uint32_t i = 0; i < 100; i++) {
+            AstNode *first = module->items[0];
+            Errors repeatedErrors(mem, errorMem);
+            module = parser.reparse(module, i % 2 == 0 ? *edited : *source, i % 2 == 0 ? edit : revert, repeatedErrors, &module->mem);
+            checkReparse(module, repeatedErrors, i % 2 == 0 ? edited : source, mem);
+            QAK_CHECK(module->mem.numBytes <= (QAK_MAX_REPARSE_GROWTH + 1) * module->numParsedBytes, "Expected at most %zu bytes, got %zu",
+                      (QAK_MAX_REPARSE_GROWTH + 1) * module->numParsedBytes, module->mem.numBytes);
+            if (module->items[0] == first) numReused++;
+            else numParsed++;
+        }
+        QAK_CHECK(numReused > 0 && numParsed > 0, "Expected reused and parsed items, got %zu and %zu.", numReused, numParsed);
+
+        mem.freeObject(edited, QAK_SRC_LOC);
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+/* Records the order in which a Walker enters and leaves nodes. Children of nodes of
+ * the skipped type are not walked. */
+struct WalkRecorder : public Walker<WalkRecorder> {
+    static const bool hasLeave = true;
+
+    Array<AstNode *> entered;
+    Array<AstNode *> left;
+    int skippedType;
+
+    WalkRecorder(HeapAllocator &mem, int skippedType) : Walker<WalkRecorder>(mem), entered(mem), left(mem), skippedType(skippedType) {}
+
+    bool visitNode(AstNode *node) {
+        entered.add(node);
+        return node->astType != skippedType;
+    }
+
+    void leave(AstNode *node) {
+        left.add(node);
+    }
+};
+
+static void checkSameOrder(Array<AstNode *> &expected, Array<AstNode *> &actual) {
+    QAK_CHECK(expected.size() == actual.size(), "Expected %zu nodes, got %zu", expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); i++) QAK_CHECK(expected[i] == actual[i], "Expected same node at %zu", i);
+}
+
+void testWalker() {
+    Test test("Parser - walker");
+    HeapAllocator mem;
+    const char *fileNames[] = {"data/parser_v_0_1.qak", "data/parser_errors.qak"};
+    for (size_t i = 0; i < 2; i++) {
+        Source *source = io::readFile(fileNames[i], mem);
+        QAK_CHECK(source != nullptr, "Couldn't read test file %s", fileNames[i]);
+
+        Parser parser(mem);
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        Module *module = parser.parse(*source, errors, &moduleMem);
+        QAK_CHECK(module, "Expected module.");
+
+        // The walk visits the same nodes in the same order as a recursive traversal.
+        Array<AstNode *> preOrder(mem), postOrder(mem);
+        RecursiveRecorder recursive(preOrder, postOrder);
+        recursive(module);
+        WalkRecorder recorder(mem, -1);
+        recorder.walk(module);
+        checkSameOrder(preOrder, recorder.entered);
+        checkSameOrder(postOrder, recorder.left);
+
+        // Returning false from the pre hook skips the children, but still leaves the node.
+        preOrder.clear();
+        postOrder.clear();
+        forEachChild(module->statements, recursive);
+        WalkRecorder skipper(mem, AstFunction);
+        skipper.walk(module);
+        size_t expectedNodes = 1 + module->functions.size() + preOrder.size();
+        QAK_CHECK(skipper.entered.size() == expectedNodes, "Expected %zu nodes, got %zu", expectedNodes, skipper.entered.size());
+        QAK_CHECK(skipper.left.size() == expectedNodes, "Expected %zu nodes, got %zu", expectedNodes, skipper.left.size());
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+}
+
 void testEOL() {
     Test test("Parser - EOL");
     HeapAllocator mem;
@@ -163,6 +1099,14 @@ int main() {
     testModuleVariable();
     testFunction();
     testV01();
+    testStringLiterals();
+    testNesting();
+    testFlatModule();
+    testErrorRecovery();
+    testLazyFunctionBodies();
+    testParallelFunctionBodies();
+    testIncrementalReparse();
+    testWalker();
     testBench();
     return 0;
 }
\ No newline at end of file
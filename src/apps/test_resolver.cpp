@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <string.h>
+#include "io.h"
+#include "resolver.h"
+#include "test.h"
+
+using namespace qak;
+using namespace qak::ast;
+
+static Module *parseFile(const char *fileName, Parser &parser, HeapAllocator &mem, BumpAllocator &moduleMem, Errors &errors, Source **source) {
+    *source = io::readFile(fileName, mem);
+    QAK_CHECK(*source != nullptr, "Couldn't read test file %s", fileName);
+    Module *module = parser.parse(**source, errors, &moduleMem);
+    QAK_CHECK(module && !errors.hasErrors(), "Expected module without parse errors.");
+    return module;
+}
+
+static Symbol &checkSymbol(Module *module, int32_t symbol, SymbolType type, AstNode *declaration, uint32_t slot) {
+    QAK_CHECK(symbol >= 0 && (size_t) symbol < module->symbols.size(), "Expected resolved symbol, got %i", symbol);
+    Symbol &resolved = module->symbols[symbol];
+    QAK_CHECK(resolved.type == type, "Expected symbol type %i, got %i", type, resolved.type);
+    QAK_CHECK(resolved.declaration == declaration, "Expected symbol declared by node at token %u", declaration->firstToken);
+    QAK_CHECK(resolved.slot == slot, "Expected slot %u, got %u", slot, resolved.slot);
+    return resolved;
+}
+
+void testResolve() {
+    Test test("Resolver - slots");
+    HeapAllocator mem;
+    {
+        Parser parser(mem);
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        Source *source;
+        Module *module = parseFile("data/resolver.qak", parser, mem, moduleMem, errors, &source);
+
+        Resolver resolver(mem);
+        QAK_CHECK(resolver.resolve(module, errors), "Expected no resolver errors.");
+        if (errors.hasErrors()) errors.print();
+
+        // Module variables take the first slots, block variables share the slots after them.
+        Variable *total = module->variables[0], *count = module->variables[1];
+        checkSymbol(module, total->symbol, SymbolModuleVariable, total, 0);
+        checkSymbol(module, count->symbol, SymbolModuleVariable, count, 1);
+        While *loop = (While *) module->statements[1];
+        Variable *step = (Variable *) loop->statements[0];
+        If *ifNode = (If *) loop->statements[1];
+        Variable *big = (Variable *) ifNode->trueBlock[0], *small = (Variable *) ifNode->falseBlock[0];
+        checkSymbol(module, step->symbol, SymbolLocalVariable, step, 2);
+        checkSymbol(module, big->symbol, SymbolLocalVariable, big, 3);
+        checkSymbol(module, small->symbol, SymbolLocalVariable, small, 3);
+        QAK_CHECK(module->numSlots == 4, "Expected 4 module slots, got %u", module->numSlots);
+
+        // Statements can call functions declared after them.
+        Function *add = module->functions[0], *countDown = module->functions[1];
+        checkSymbol(module, add->symbol, SymbolFunction, add, 0);
+        checkSymbol(module, countDown->symbol, SymbolFunction, countDown, 1);
+        FunctionCall *call = (FunctionCall *) step->initializerExpression;
+        checkSymbol(module, ((VariableAccess *) call->variableAccess)->symbol, SymbolFunction, add, 0);
+        checkSymbol(module, ((VariableAccess *) call->arguments[0])->symbol, SymbolModuleVariable, total, 0);
+
+        // Parameters take the first slots of a function's frame, functions access module variables.
+        Parameter *a = add->parameters[0], *b = add->parameters[1];
+        checkSymbol(module, a->symbol, SymbolParameter, a, 0);
+        checkSymbol(module, b->symbol, SymbolParameter, b, 1);
+        Variable *sum = (Variable *) add->statements[0];
+        checkSymbol(module, sum->symbol, SymbolLocalVariable, sum, 2);
+        BinaryOperation *sumValue = (BinaryOperation *) sum->initializerExpression;
+        checkSymbol(module, ((VariableAccess *) sumValue->left)->symbol, SymbolParameter, a, 0);
+        checkSymbol(module, ((VariableAccess *) sumValue->right)->symbol, SymbolParameter, b, 1);
+        BinaryOperation *assignment = (BinaryOperation *) add->statements[1];
+        checkSymbol(module, ((VariableAccess *) assignment->left)->symbol, SymbolModuleVariable, total, 0);
+        QAK_CHECK(add->numSlots == 3, "Expected 3 slots, got %u", add->numSlots);
+
+        // A block variable shadows the parameter, its initializer still refers to the parameter.
+        Parameter *n = countDown->parameters[0];
+        While *countLoop = (While *) countDown->statements[0];
+        Variable *shadow = (Variable *) countLoop->statements[0];
+        checkSymbol(module, shadow->symbol, SymbolLocalVariable, shadow, 1);
+        checkSymbol(module, ((VariableAccess *) ((BinaryOperation *) shadow->initializerExpression)->left)->symbol, SymbolParameter, n, 0);
+        BinaryOperation *countAssignment = (BinaryOperation *) countLoop->statements[1];
+        checkSymbol(module, ((VariableAccess *) countAssignment->left)->symbol, SymbolModuleVariable, count, 1);
+        checkSymbol(module, ((VariableAccess *) countAssignment->right)->symbol, SymbolLocalVariable, shadow, 1);
+        QAK_CHECK(countDown->numSlots == 2, "Expected 2 slots, got %u", countDown->numSlots);
+
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+void testErrors() {
+    Test test("Resolver - errors");
+    HeapAllocator mem;
+    {
+        Parser parser(mem);
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        Source *source;
+        Module *module = parseFile("data/resolver_errors.qak", parser, mem, moduleMem, errors, &source);
+
+        Resolver resolver(mem);
+        QAK_CHECK(!resolver.resolve(module, errors), "Expected resolver errors.");
+        errors.print();
+
+        const char *messages[] = {"Duplicate declaration of 'twice'.", "Unknown variable 'later'.", "Duplicate declaration of 'later'.",
+                                  "Unknown function 'undefined'.", "Duplicate declaration of 'a'."};
+        uint32_t lines[] = {8, 12, 14, 15, 4};
+        Array<Error> &errorList = errors.getErrors();
+        QAK_CHECK(errorList.size() == 5, "Expected 5 errors, got %zu", errorList.size());
+        for (size_t i = 0; i < errorList.size(); i++) {
+            QAK_CHECK(strcmp(errorList[i].message, messages[i]) == 0, "Expected error '%s', got '%s'", messages[i], errorList[i].message);
+            QAK_CHECK(errorList[i].span.startLine == lines[i], "Expected error on line %u, got %u", lines[i], errorList[i].span.startLine);
+        }
+
+        // The block variable shadows the module variable, its initializer refers to the module variable.
+        Variable *later = module->variables[1];
+        While *loop = (While *) module->statements[4];
+        Variable *shadow = (Variable *) loop->statements[0];
+        checkSymbol(module, shadow->symbol, SymbolLocalVariable, shadow, 3);
+        checkSymbol(module, ((VariableAccess *) ((BinaryOperation *) shadow->initializerExpression)->left)->symbol, SymbolModuleVariable, later, 1);
+        QAK_CHECK(module->variables[2]->symbol == -1, "Expected duplicate variable without symbol.");
+
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+/* Returns a source declaring the variable x, followed by the statement, repeated the given number of times. */
+static Source *generateSource(HeapAllocator &mem, const char *header, const char *statement, int count, const char *footer) {
+    Array<char> text(mem);
+    text.addAll(header, strlen(header));
+    char buffer[128];
+    for (int i = 0; i < count; i++) {
+        int length = snprintf(buffer, sizeof(buffer), statement, i);
+        text.addAll(buffer, (size_t) length);
+    }
+    text.addAll(footer, strlen(footer) + 1);
+    return Source::fromMemory(mem, "generated.qak", text.buffer());
+}
+
+/* Chains of binary operations are parsed without recursion, their depth is only limited by the size
+ * of the source. They are resolved without recursion as well, see generateChain(). */
+void testDeepExpression() {
+    Test test("Resolver - deep expression");
+    HeapAllocator mem;
+    {
+        Array<char> text(mem);
+        generateChain(text, "module deep\nvar x = 1\nvar y = x", " + x", 200000);
+        Source *source = Source::fromMemory(mem, "deep.qak", text.buffer());
+        Parser parser(mem);
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        Module *module = parser.parse(*source, errors, &moduleMem);
+        QAK_CHECK(module && !errors.hasErrors(), "Expected module without parse errors.");
+
+        Resolver resolver(mem);
+        QAK_CHECK(resolver.resolve(module, errors), "Expected module without resolver errors.");
+        Expression *expression = module->variables[1]->initializerExpression;
+        while (expression->astType == AstBinaryOperation) expression = static_cast<BinaryOperation *>(expression)->left;
+        checkSymbol(module, static_cast<VariableAccess *>(expression)->symbol, SymbolModuleVariable, module->variables[0], 0);
+
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+/* Names are looked up in a hash table, so resolving takes time linear in the size of the module. */
+void testBenchmark() {
+    Test test("Resolver - benchmark");
+    HeapAllocator mem;
+    int counts[] = {2000, 20000, 40000};
+    for (int i = 0; i < 3; i++) {
+        Source *source = generateSource(mem, "module functions\n", "fun f%i(a: int32): int32\n    var b = a + 1\n    return b\nend\n",
+                                        counts[i], "var x = f0(1)\n");
+        Parser parser(mem);
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        double start = io::timeMillis();
+        Module *module = parser.parse(*source, errors, &moduleMem);
+        double parseTime = io::timeMillis() - start;
+        QAK_CHECK(module && !errors.hasErrors(), "Expected module without parse errors.");
+
+        Resolver resolver(mem);
+        start = io::timeMillis();
+        QAK_CHECK(resolver.resolve(module, errors), "Expected module without resolver errors.");
+        double resolveTime = io::timeMillis() - start;
+        printf("%i functions: parse %f ms, resolve %f ms\n", counts[i], parseTime, resolveTime);
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+int main() {
+    testResolve();
+    testErrors();
+    testDeepExpression();
+    testBenchmark();
+    return 0;
+}
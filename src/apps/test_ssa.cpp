@@ -0,0 +1,434 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "io.h"
+#include "resolver.h"
+#include "interpreter.h"
+#include "ssa.h"
+#include "test.h"
+
+using namespace qak;
+using namespace qak::ast;
+using namespace qak::ssa;
+
+/* The maximum depth of calls run by the Evaluator, deeper calls fail with a stack overflow. */
+#define MAX_DEPTH 2048
+
+static Module *check(const char *fileName, HeapAllocator &mem, BumpAllocator &moduleMem, TypeTable &types, Errors &errors, Source **source) {
+    *source = io::readFile(fileName, mem);
+    QAK_CHECK(*source != nullptr, "Couldn't read test file %s", fileName);
+    Parser parser(mem);
+    Module *module = parser.parse(**source, errors, &moduleMem);
+    QAK_CHECK(module && !errors.hasErrors(), "Expected module without parse errors.");
+    Resolver resolver(mem);
+    QAK_CHECK(resolver.resolve(module, errors), "Expected module without resolver errors.");
+    TypeChecker checker(mem);
+    QAK_CHECK(checker.check(module, types, errors), "Expected module without type errors.");
+    return module;
+}
+
+static ssa::Program *build(Module *module, HeapAllocator &mem, TypeTable &types, Errors &errors) {
+    SsaBuilder builder(mem);
+    ssa::Program *program = builder.build(module, types, errors);
+    if (errors.hasErrors()) errors.print();
+    QAK_CHECK(program != nullptr, "Expected a program.");
+    return program;
+}
+
+/* Runs ssa::Programs with the semantics of the Interpreter, so the SSA form can be compared against
+ * the bytecode the BytecodeCompiler compiles from the same module. */
+struct Evaluator {
+    HeapAllocator &mem;
+    ssa::Program *program;
+    Errors &errors;
+    Array<bytecode::Value> globals;
+    bytecode::Value result;
+    TypeId resultType;
+    uint32_t depth;
+
+    Evaluator(HeapAllocator &mem, ssa::Program *program, Errors &errors) : mem(mem), program(program), errors(errors), globals(mem),
+                                                                          resultType(TypeNothing), depth(0) {
+        result.i = 0;
+    }
+
+    static int64_t narrow(TypeId type, int64_t value) {
+        switch (type) {
+            case TypeInt8:
+                return (int8_t) (uint8_t) value;
+            case TypeInt16:
+                return (int16_t) (uint16_t) value;
+            case TypeInt32:
+                return (int32_t) (uint32_t) value;
+            default:
+                return value;
+        }
+    }
+
+    static bool isFloat(TypeId type) {
+        return type == TypeFloat32 || type == TypeFloat64;
+    }
+
+    bool fail(ssa::Instruction &instruction, const char *message) {
+        errors.add(program->module->tokens[instruction.token], message);
+        return false;
+    }
+
+    /* Computes the value of an instruction that is not a phi or terminator. Returns false on errors. */
+    bool compute(ssa::Function *function, ssa::Instruction &instruction, Array<bytecode::Value> &values, bytecode::Value *arguments,
+                 bytecode::Value &value) {
+        bytecode::Value a, b;
+        a.i = b.i = 0;
+        if (instruction.numOperands > 0) a = values[function->operand(instruction, 0)];
+        if (instruction.numOperands > 1) b = values[function->operand(instruction, 1)];
+        TypeId type = instruction.type;
+        TypeId operandType = instruction.numOperands > 0 ? function->instructions[function->operand(instruction, 0)].type : (TypeId) TypeNothing;
+        switch (instruction.op) {
+            case OpConstant:
+                value = instruction.immediate;
+                break;
+            case OpParameter:
+                value = arguments[instruction.immediate.i];
+                break;
+            case OpCopy:
+                value = a;
+                break;
+            case OpGetGlobal:
+                value = globals[instruction.immediate.i];
+                break;
+            case OpSetGlobal:
+                globals[instruction.immediate.i] = a;
+                break;
+            case OpCall: {
+                if (depth >= MAX_DEPTH) return fail(instruction, "Stack overflow.");
+                Array<bytecode::Value> callArguments(mem);
+                for (uint32_t i = 0; i < instruction.numOperands; i++) callArguments.add(values[function->operand(instruction, i)]);
+                depth++;
+                bool isOk = run(program->functions[instruction.immediate.i], callArguments.buffer(), value);
+                depth--;
+                if (!isOk) return false;
+                break;
+            }
+            case OpAdd:
+            case OpSub:
+            case OpMul:
+            case OpDiv:
+            case OpRem:
+                if (isFloat(type)) {
+                    double x = a.f, y = b.f;
+                    double r = instruction.op == OpAdd ? x + y : instruction.op == OpSub ? x - y : instruction.op == OpMul ? x * y :
+                                                                                                     instruction.op == OpDiv ? x / y : fmod(x, y);
+                    value.f = type == TypeFloat32 ? (double) (float) r : r;
+                } else {
+                    uint64_t x = (uint64_t) a.i, y = (uint64_t) b.i;
+                    if (instruction.op == OpAdd) value.i = narrow(type, (int64_t) (x + y));
+                    else if (instruction.op == OpSub) value.i = narrow(type, (int64_t) (x - y));
+                    else if (instruction.op == OpMul) value.i = narrow(type, (int64_t) (x * y));
+                    else if (b.i == 0) return fail(instruction, "Division by zero.");
+                    else if (b.i == -1) value.i = instruction.op == OpDiv ? narrow(type, (int64_t) (0 - x)) : 0;
+                    else value.i = narrow(type, instruction.op == OpDiv ? a.i / b.i : a.i % b.i);
+                }
+                break;
+            case OpAnd:
+                value.i = a.i & b.i;
+                break;
+            case OpOr:
+                value.i = a.i | b.i;
+                break;
+            case OpXor:
+                value.i = a.i ^ b.i;
+                break;
+            case OpNeg:
+                if (isFloat(type)) value.f = -a.f;
+                else value.i = narrow(type, (int64_t) (0 - (uint64_t) a.i));
+                break;
+            case OpNot:
+                value.i = a.i ^ 1;
+                break;
+            case OpToFloat:
+                value.f = type == TypeFloat32 ? (double) (float) (double) a.i : (double) a.i;
+                break;
+            case OpEq:
+                value.i = isFloat(operandType) ? a.f == b.f : a.i == b.i;
+                break;
+            case OpNe:
+                value.i = isFloat(operandType) ? a.f != b.f : a.i != b.i;
+                break;
+            case OpLt:
+                value.i = isFloat(operandType) ? a.f < b.f : a.i < b.i;
+                break;
+            case OpLe:
+                value.i = isFloat(operandType) ? a.f <= b.f : a.i <= b.i;
+                break;
+            default:
+                QAK_CHECK(false, "Unexpected opcode %s", opcodeToString((Opcode) instruction.op));
+        }
+        return true;
+    }
+
+    /* Runs the function, evaluating the phis of a block at once when it is entered. */
+    bool run(ssa::Function *function, bytecode::Value *arguments, bytecode::Value &returnValue) {
+        Array<bytecode::Value> values(mem);
+        bytecode::Value zero;
+        zero.i = 0;
+        values.setSize(function->instructions.size(), zero);
+        Array<bytecode::Value> phis(mem);
+        uint32_t block = 0, previous = 0;
+        while (true) {
+            ssa::Block &b = function->blocks[block];
+            uint32_t first = 0;
+            phis.clear();
+            for (; first < b.numInstructions; first++) {
+                ssa::Instruction &phi = function->instructions[function->schedule[b.firstInstruction + first]];
+                if (phi.op != OpPhi) break;
+                uint32_t index = 0;
+                while (function->predecessor(b, index) != previous) index++;
+                phis.add(values[function->operand(phi, index)]);
+            }
+            for (uint32_t i = 0; i < first; i++) values[function->schedule[b.firstInstruction + i]] = phis[i];
+
+            for (uint32_t i = first; i < b.numInstructions; i++) {
+                uint32_t id = function->schedule[b.firstInstruction + i];
+                ssa::Instruction &instruction = function->instructions[id];
+                if (instruction.op == OpJump) {
+                    previous = block;
+                    block = b.successors[0];
+                } else if (instruction.op == OpBranch) {
+                    previous = block;
+                    block = b.successors[values[function->operand(instruction, 0)].i ? 0 : 1];
+                } else if (instruction.op == OpReturn) {
+                    returnValue = instruction.numOperands > 0 ? values[function->operand(instruction, 0)] : zero;
+                    if (function == program->statements) resultType = instruction.numOperands > 0 ? instruction.type : (TypeId) TypeNothing;
+                    return true;
+                } else if (!compute(function, instruction, values, arguments, values[id])) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    bool run() {
+        bytecode::Value zero;
+        zero.i = 0;
+        globals.clear();
+        globals.setSize(program->module->variables.size(), zero);
+        result = zero;
+        resultType = TypeNothing;
+        return run(program->statements, nullptr, result);
+    }
+};
+
+/* Runs the file with the Interpreter and the Evaluator, on the SSA form as built and optimized by the
+ * passes. The module variables, the result and errors must be the same, bit for bit. */
+static void differential(const char *fileName, uint32_t passes, size_t stackSize = QAK_DEFAULT_STACK_SIZE) {
+    HeapAllocator mem;
+    {
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        TypeTable types(mem);
+        Source *source;
+        Module *module = check(fileName, mem, moduleMem, types, errors, &source);
+
+        BytecodeCompiler compiler(mem);
+        bytecode::Program *bytecode = compiler.compile(module, types, errors);
+        QAK_CHECK(bytecode != nullptr, "Expected a bytecode program.");
+        Interpreter interpreter(mem, stackSize);
+        Errors interpreterErrors(mem, moduleMem);
+        bool interpreterResult = interpreter.run(bytecode, interpreterErrors);
+
+        ssa::Program *program = build(module, mem, types, errors);
+        SsaOptimizer optimizer(mem);
+        optimizer.optimize(program, passes);
+        Errors evaluatorErrors(mem, moduleMem);
+        Evaluator evaluator(mem, program, evaluatorErrors);
+        bool evaluatorResult = evaluator.run();
+        QAK_CHECK(evaluatorResult == interpreterResult, "%s: expected the evaluator to %s.", fileName, interpreterResult ? "succeed" : "fail");
+
+        if (!evaluatorResult) {
+            Error &expected = interpreterErrors.getErrors()[0];
+            Error &actual = evaluatorErrors.getErrors()[0];
+            QAK_CHECK(strcmp(expected.message, actual.message) == 0, "%s: expected error '%s', got '%s'", fileName, expected.message, actual.message);
+            QAK_CHECK(expected.span.start == actual.span.start, "%s: expected the error at %u, got %u", fileName, expected.span.start,
+                      actual.span.start);
+        } else {
+            for (uint32_t i = 0; i < bytecode->numGlobals; i++) {
+                QAK_CHECK(interpreter.global(i).i == evaluator.globals[i].i, "%s: expected global %u to be %llx, got %llx", fileName, i,
+                          (unsigned long long) interpreter.global(i).i, (unsigned long long) evaluator.globals[i].i);
+            }
+            QAK_CHECK(interpreter.resultType() == evaluator.resultType, "%s: expected a result of type %s, got %s", fileName,
+                      types.name(interpreter.resultType()), types.name(evaluator.resultType));
+            QAK_CHECK(interpreter.result().i == evaluator.result.i, "%s: expected the result %llx, got %llx", fileName,
+                      (unsigned long long) interpreter.result().i, (unsigned long long) evaluator.result.i);
+        }
+        printf("%s: SSA (passes %u) and interpreter agree\n", fileName, passes);
+
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+void testDifferential() {
+    Test test("SSA - differential");
+    const char *files[] = {"data/ssa.qak", "data/jit.qak", "data/interpreter.qak", "data/evaluator.qak", "data/transpiler.qak", "data/folder.qak",
+                           "data/interpreter_errors.qak", "data/interpreter_overflow.qak"};
+    uint32_t passes[] = {0, PassUnreachableCode, PassCopyPropagation, PassValueNumbering, PassLoopInvariants, PassDeadCode,
+                         PassUnreachableCode | PassCopyPropagation, PassAll};
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        for (size_t j = 0; j < sizeof(passes) / sizeof(passes[0]); j++) differential(files[i], passes[j]);
+    }
+}
+
+/* Compares the text form of the SSA form of data/ssa.qak as built and optimized with the expected text. */
+static void golden(const char *expectedFileName, uint32_t passes) {
+    HeapAllocator mem;
+    {
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        TypeTable types(mem);
+        Source *source;
+        Module *module = check("data/ssa.qak", mem, moduleMem, types, errors, &source);
+        ssa::Program *program = build(module, mem, types, errors);
+        SsaOptimizer optimizer(mem);
+        optimizer.optimize(program, passes);
+
+        Array<char> output(mem);
+        dump(program, types, output, mem);
+        printf("%.*s\n", (int) output.size(), output.buffer());
+        Source *expected = io::readFile(expectedFileName, mem);
+        QAK_CHECK(expected != nullptr, "Couldn't read expected file %s", expectedFileName);
+        QAK_CHECK(expected->size == output.size() && memcmp(expected->data, output.buffer(), output.size()) == 0,
+                  "Expected the text form to match %s", expectedFileName);
+
+        mem.freeObject(expected, QAK_SRC_LOC);
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+void testGolden() {
+    Test test("SSA - golden");
+    golden("data/ssa.txt", 0);
+    golden("data/ssa_optimized.txt", PassAll);
+}
+
+void testErrors() {
+    Test test("SSA - errors");
+    HeapAllocator mem;
+    {
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        TypeTable types(mem);
+        Source *source = Source::fromMemory(mem, "errors.qak", "module errors\nvar text = \"a\" + 1\n");
+        Parser parser(mem);
+        Module *module = parser.parse(*source, errors, &moduleMem);
+        Resolver resolver(mem);
+        QAK_CHECK(resolver.resolve(module, errors), "Expected module without resolver errors.");
+        TypeChecker checker(mem);
+        QAK_CHECK(checker.check(module, types, errors), "Expected module without type errors.");
+        SsaBuilder builder(mem);
+        QAK_CHECK(builder.build(module, types, errors) == nullptr, "Expected no program.");
+        QAK_CHECK(errors.getErrors().size() == 1, "Expected 1 error, got %zu", errors.getErrors().size());
+        errors.print();
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+/* Chains of binary operations are built and optimized without recursion, see generateChain(). */
+void testDeepExpression() {
+    Test test("SSA - deep expression");
+    HeapAllocator mem;
+    {
+        Array<char> text(mem);
+        generateChain(text, "module deep\nvar x = 1\nreturn 0.5 + x", " + x", 200000);
+        Source *source = Source::fromMemory(mem, "deep.qak", text.buffer());
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        TypeTable types(mem);
+        Parser parser(mem);
+        Module *module = parser.parse(*source, errors, &moduleMem);
+        Resolver resolver(mem);
+        QAK_CHECK(module && resolver.resolve(module, errors), "Expected module without errors.");
+        TypeChecker checker(mem);
+        QAK_CHECK(checker.check(module, types, errors), "Expected module without type errors.");
+
+        ssa::Program *program = build(module, mem, types, errors);
+        SsaOptimizer optimizer(mem);
+        optimizer.optimize(program);
+        Evaluator evaluator(mem, program, errors);
+        QAK_CHECK(evaluator.run(), "Expected the program to run.");
+        QAK_CHECK(evaluator.resultType == TypeFloat32 && evaluator.result.f == 200001.5, "Expected 200001.5, got %f", evaluator.result.f);
+
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+/* Each pass must change data/ssa.qak, the timings of passes that are not run stay zero. */
+void testTimings() {
+    Test test("SSA - pass timings");
+    HeapAllocator mem;
+    {
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        TypeTable types(mem);
+        Source *source;
+        Module *module = check("data/ssa.qak", mem, moduleMem, types, errors, &source);
+        ssa::Program *program = build(module, mem, types, errors);
+        SsaOptimizer optimizer(mem);
+        optimizer.optimize(program, PassAll & ~PassDeadCode);
+        optimizer.printTimings();
+        for (uint32_t i = 0; i < QAK_SSA_NUM_PASSES - 1; i++) {
+            QAK_CHECK(optimizer.timings()[i].numChanges > 0, "Expected %s to change the program.", optimizer.timings()[i].name);
+        }
+        QAK_CHECK(optimizer.timings()[QAK_SSA_NUM_PASSES - 1].numChanges == 0, "Expected dead code to be left.");
+        QAK_CHECK(optimizer.timings()[QAK_SSA_NUM_PASSES - 1].millis == 0, "Expected dead code elimination not to run.");
+        optimizer.resetTimings();
+        optimizer.optimize(program, PassDeadCode);
+        QAK_CHECK(optimizer.timings()[QAK_SSA_NUM_PASSES - 1].numChanges > 0, "Expected dead code to be removed.");
+        QAK_CHECK(optimizer.timings()[0].numChanges == 0, "Expected the timings to be reset.");
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+void testBenchmark() {
+    Test test("SSA - benchmark");
+    const char *files[] = {"data/ssa.qak", "data/interpreter.qak", "data/jit.qak", "data/transpiler.qak", "data/interpreter_benchmark_arithmetic.qak"};
+    HeapAllocator mem;
+    {
+        SsaOptimizer optimizer(mem);
+        double buildTime = 0;
+        uint32_t numInstructions = 0, numOptimized = 0;
+        for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+            BumpAllocator moduleMem(mem);
+            Errors errors(mem, moduleMem);
+            TypeTable types(mem);
+            Source *source;
+            Module *module = check(files[i], mem, moduleMem, types, errors, &source);
+            for (int j = 0; j < 1000; j++) {
+                double start = io::timeMillis();
+                ssa::Program *program = build(module, mem, types, errors);
+                buildTime += io::timeMillis() - start;
+                for (size_t k = 0; k < program->functions.size(); k++) numInstructions += program->functions[k]->size();
+                numInstructions += program->statements->size();
+                optimizer.optimize(program);
+                for (size_t k = 0; k < program->functions.size(); k++) numOptimized += program->functions[k]->size();
+                numOptimized += program->statements->size();
+            }
+            mem.freeObject(source, QAK_SRC_LOC);
+        }
+        printf("build %f ms, %u instructions, %u after optimization\n", buildTime, numInstructions, numOptimized);
+        optimizer.printTimings();
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+int main() {
+    testDifferential();
+    testGolden();
+    testErrors();
+    testDeepExpression();
+    testTimings();
+    testBenchmark();
+    return 0;
+}
@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <functional>
+#include "io.h"
+#include "stringheap.h"
+#include "test.h"
+
+using namespace qak;
+
+static bool hasBytes(StringHeap &heap, const String &string, const char *expected) {
+    uint32_t length = (uint32_t) strlen(expected);
+    return string.length() == length && memcmp(heap.data(string), expected, length) == 0;
+}
+
+static String copy(StringHeap &heap, const char *text) {
+    return heap.copy((const uint8_t *) text, (uint32_t) strlen(text));
+}
+
+void testSmallStrings() {
+    Test test("String heap - small strings");
+    HeapAllocator mem;
+    {
+        StringHeap heap(mem);
+        String empty = copy(heap, "");
+        QAK_CHECK(empty.isSmall() && empty.length() == 0, "Expected an empty small string.");
+        QAK_CHECK(heap.equals(empty, String()), "Expected the default string to be empty.");
+
+        String hello = copy(heap, "hello");
+        QAK_CHECK(hello.isSmall(), "Expected a small string.");
+        QAK_CHECK(hasBytes(heap, hello, "hello"), "Expected the bytes to be stored inline.");
+
+        String fifteen = copy(heap, "123456789012345");
+        QAK_CHECK(fifteen.isSmall() && fifteen.length() == 15, "Expected 15 bytes to be stored inline.");
+        String sixteen = copy(heap, "1234567890123456");
+        QAK_CHECK(!sixteen.isSmall() && sixteen.length() == 16, "Expected 16 bytes to be stored in a buffer.");
+        QAK_CHECK(hasBytes(heap, sixteen, "1234567890123456"), "Expected the bytes to be copied.");
+        QAK_CHECK(mem.numAllocations() == 1, "Expected a single block of the arena, got %zu allocations.", mem.numAllocations());
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+void testConcatenation() {
+    Test test("String heap - concatenation");
+    HeapAllocator mem;
+    {
+        StringHeap heap(mem);
+        String small = heap.concat(copy(heap, "hello "), copy(heap, "world"));
+        QAK_CHECK(small.isSmall() && hasBytes(heap, small, "hello world"), "Expected a small string.");
+        String flat = heap.concat(small, copy(heap, ", hello qak"));
+        QAK_CHECK(!flat.isSmall() && hasBytes(heap, flat, "hello world, hello qak"), "Expected a flat string.");
+        QAK_CHECK(heap.equals(heap.concat(flat, String()), flat), "Expected concatenating an empty string to return the string.");
+
+        // Appending builds a rope as deep as the number of appends, which is flattened once.
+        Array<uint8_t> expected(mem);
+        String string;
+        for (int i = 0; i < 100000; i++) {
+            char piece[16];
+            int length = snprintf(piece, sizeof(piece), "%i,", i);
+            expected.addAll((const uint8_t *) piece, (size_t) length);
+            string = heap.concat(string, heap.copy((const uint8_t *) piece, (uint32_t) length));
+        }
+        QAK_CHECK(string.length() == expected.size(), "Expected %zu bytes, got %u.", expected.size(), string.length());
+        const uint8_t *bytes = heap.data(string);
+        QAK_CHECK(memcmp(bytes, expected.buffer(), expected.size()) == 0, "Expected the appended bytes.");
+        QAK_CHECK(heap.data(string) == bytes, "Expected the rope to be flattened once.");
+
+        // Ropes of ropes, on both sides.
+        String twice = heap.concat(string, string);
+        String wrapped = heap.concat(copy(heap, "["), heap.concat(twice, copy(heap, "]")));
+        QAK_CHECK(wrapped.length() == expected.size() * 2 + 2, "Expected the lengths to add up.");
+        bytes = heap.data(wrapped);
+        QAK_CHECK(bytes[0] == '[' && bytes[wrapped.length() - 1] == ']', "Expected the brackets around the strings.");
+        QAK_CHECK(memcmp(bytes + 1, expected.buffer(), expected.size()) == 0 &&
+                  memcmp(bytes + 1 + expected.size(), expected.buffer(), expected.size()) == 0, "Expected the string twice.");
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+void testLiterals() {
+    Test test("String heap - literals");
+    HeapAllocator mem;
+    {
+        StringHeap heap(mem);
+        const char *source = "var a = \"a literal that is long\"\nvar b = \"a literal that is long\"\nvar c = \"short\"";
+        const uint8_t *first = (const uint8_t *) strstr(source, "a literal");
+        const uint8_t *second = (const uint8_t *) strstr((const char *) first + 1, "a literal");
+        uint32_t length = (uint32_t) strlen("a literal that is long");
+
+        String a = heap.literal(first, length);
+        String b = heap.literal(second, length);
+        QAK_CHECK(!a.isSmall() && a.large.buffer == b.large.buffer, "Expected the literals to be interned.");
+        QAK_CHECK(heap.data(a) == first, "Expected the bytes of the source to be referenced, not copied.");
+        QAK_CHECK(heap.numLiterals() == 1, "Expected a single interned literal.");
+        String c = heap.literal((const uint8_t *) strstr(source, "short"), 5);
+        QAK_CHECK(c.isSmall() && hasBytes(heap, c, "short"), "Expected short literals to be stored inline.");
+
+        // Literals decoded by the parser keep their hash.
+        BumpAllocator bumpMem(mem);
+        StringPool pool(mem);
+        pool.reset(bumpMem);
+        for (int i = 0; i < 1000; i++) {
+            char text[64];
+            int textLength = snprintf(text, sizeof(text), "the literal number %i", i);
+            pool.intern((const uint8_t *) text, (uint32_t) textLength);
+        }
+        for (size_t i = 0; i < pool.strings().size(); i++) {
+            InternedString &interned = pool.strings()[i];
+            String literal = heap.literal(interned);
+            QAK_CHECK(heap.hash(literal) == interned.hash, "Expected the hash of the pool.");
+            QAK_CHECK(heap.data(literal) == interned.data, "Expected the decoded bytes to be referenced.");
+            QAK_CHECK(heap.literal(interned.data, interned.length).large.buffer == literal.large.buffer, "Expected the literal to be interned.");
+        }
+        QAK_CHECK(heap.numLiterals() == 1001, "Expected 1001 literals, got %zu.", heap.numLiterals());
+
+        heap.reset();
+        QAK_CHECK(heap.numLiterals() == 0, "Expected no literals after a reset.");
+        String again = heap.literal(first, length);
+        QAK_CHECK(heap.numLiterals() == 1 && heap.data(again) == first, "Expected the literal to be interned again.");
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+void testComparison() {
+    Test test("String heap - comparison and hashing");
+    HeapAllocator mem;
+    {
+        StringHeap heap(mem);
+        const char *text = "a string that is long enough to be a rope once concatenated with itself";
+        String flat = copy(heap, text);
+        String literal = heap.literal((const uint8_t *) text, (uint32_t) strlen(text));
+        String rope = heap.concat(copy(heap, "a string that is long enough to be a rope"), copy(heap, " once concatenated with itself"));
+        QAK_CHECK(heap.equals(flat, literal) && heap.equals(literal, rope) && heap.equals(rope, flat), "Expected equal strings.");
+        QAK_CHECK(heap.hash(flat) == heap.hash(literal) && heap.hash(literal) == heap.hash(rope), "Expected equal hashes.");
+        QAK_CHECK(heap.compare(flat, rope) == 0, "Expected equal strings to compare as equal.");
+
+        String other = copy(heap, "a string that is long enough to be a rope once concatenated with itselF");
+        heap.hash(other);
+        QAK_CHECK(!heap.equals(flat, other), "Expected strings with different bytes to differ.");
+        QAK_CHECK(heap.compare(other, flat) < 0 && heap.compare(flat, other) > 0, "Expected 'F' to be smaller than 'f'.");
+        QAK_CHECK(!heap.equals(copy(heap, "a string that is"), flat), "Expected a small and a long string to differ.");
+        QAK_CHECK(heap.compare(copy(heap, "a string"), flat) < 0, "Expected a prefix to be smaller.");
+        QAK_CHECK(heap.compare(copy(heap, "abc"), copy(heap, "abd")) < 0, "Expected 'abc' to be smaller than 'abd'.");
+        QAK_CHECK(heap.compare(copy(heap, "b"), copy(heap, "abd")) > 0, "Expected 'b' to be larger than 'abd'.");
+        QAK_CHECK(heap.hash(copy(heap, "abc")) != heap.hash(copy(heap, "abd")), "Expected different hashes.");
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+void testBenchmark() {
+    Test test("String heap - benchmark");
+    HeapAllocator mem;
+    {
+        StringHeap heap(mem);
+        const char *piece = "some bytes, ";
+        uint32_t pieceLength = (uint32_t) strlen(piece);
+        int numAppends = 20000;
+
+        // Concatenation: s = s + piece, then reading the result once.
+        double start = io::timeMillis();
+        std::string stdString;
+        for (int i = 0; i < numAppends; i++) stdString = stdString + piece;
+        double stdTime = io::timeMillis() - start;
+
+        start = io::timeMillis();
+        std::string stdAppended;
+        for (int i = 0; i < numAppends; i++) stdAppended += piece;
+        double stdAppendTime = io::timeMillis() - start;
+
+        start = io::timeMillis();
+        String string;
+        String pieceString = heap.literal((const uint8_t *) piece, pieceLength);
+        for (int i = 0; i < numAppends; i++) string = heap.concat(string, pieceString);
+        const uint8_t *bytes = heap.data(string);
+        double heapTime = io::timeMillis() - start;
+        QAK_CHECK(string.length() == stdString.size() && memcmp(bytes, stdString.data(), stdString.size()) == 0, "Expected the same bytes.");
+        QAK_CHECK(stdAppended == stdString, "Expected the same bytes.");
+        printf("Concatenation of %i pieces: std::string + %f ms, std::string += %f ms, rope %f ms\n", numAppends, stdTime, stdAppendTime,
+               heapTime);
+
+        // Comparison and hashing of short keys and long strings. Half of the compared pairs are equal.
+        size_t numStrings = 10000;
+        Array<String> strings(mem);
+        std::string *stdStrings = new std::string[numStrings];
+        for (size_t i = 0; i < numStrings; i++) {
+            char text[128];
+            int length = i % 2 == 0 ? snprintf(text, sizeof(text), "key%zu", i % 100)
+                                    : snprintf(text, sizeof(text), "a longer string that does not fit inline %zu", i % 100);
+            strings.add(heap.copy((const uint8_t *) text, (uint32_t) length));
+            stdStrings[i] = std::string(text, (size_t) length);
+        }
+
+        int numRounds = 20;
+        size_t stdEqual = 0, heapEqual = 0;
+        start = io::timeMillis();
+        for (int round = 0; round < numRounds; round++) {
+            for (size_t i = 0; i + 200 < numStrings; i++) stdEqual += stdStrings[i] == stdStrings[i + 100 + i % 2 * 50];
+        }
+        stdTime = io::timeMillis() - start;
+        start = io::timeMillis();
+        for (int round = 0; round < numRounds; round++) {
+            for (size_t i = 0; i + 200 < numStrings; i++) heapEqual += heap.equals(strings[i], strings[i + 100 + i % 2 * 50]);
+        }
+        heapTime = io::timeMillis() - start;
+        QAK_CHECK(stdEqual == heapEqual, "Expected the same number of equal strings, got %zu and %zu.", stdEqual, heapEqual);
+        printf("Comparison of %zu pairs: std::string %f ms, String %f ms\n", (numStrings - 200) * numRounds, stdTime, heapTime);
+
+        size_t stdHash = 0, heapHash = 0;
+        std::hash<std::string> hashFunction;
+        start = io::timeMillis();
+        for (int round = 0; round < numRounds; round++) {
+            for (size_t i = 0; i < numStrings; i++) stdHash += hashFunction(stdStrings[i]);
+        }
+        stdTime = io::timeMillis() - start;
+        start = io::timeMillis();
+        for (int round = 0; round < numRounds; round++) {
+            for (size_t i = 0; i < numStrings; i++) heapHash += heap.hash(strings[i]);
+        }
+        heapTime = io::timeMillis() - start;
+        QAK_CHECK(stdHash != 0 && heapHash != 0, "Expected hashes.");
+        printf("Hashing of %zu strings: std::string %f ms, String %f ms\n", numStrings * numRounds, stdTime, heapTime);
+        delete[] stdStrings;
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+int main() {
+    testSmallStrings();
+    testConcatenation();
+    testLiterals();
+    testComparison();
+    testBenchmark();
+    return 0;
+}
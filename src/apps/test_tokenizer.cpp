@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <locale.h>
 #include "io.h"
 #include "tokenizer.h"
 #include "test.h"
@@ -14,11 +15,13 @@ void testBench() {
     QAK_CHECK(source != nullptr, "Couldn't read test file data/parser_benchmark.qak");
 
     Array<Token> tokens(mem);
+    Array<LiteralValue> literalValues(mem);
     Errors errors(mem, bumpMem);
     uint32_t iterations = 100000;
     for (uint32_t i = 0; i < iterations; i++) {
         tokens.clear();
-        tokenizer::tokenize(*source, tokens, errors);
+        literalValues.clear();
+        tokenizer::tokenize(*source, tokens, literalValues, errors);
     }
 
     double time = (io::timeMillis() - start) / 1000.0;
@@ -36,9 +39,10 @@ void testTokenizer() {
     QAK_CHECK(source != nullptr, "Couldn't read test file data/tokens.qak");
 
     Array<Token> tokens(mem);
+    Array<LiteralValue> literalValues(mem);
     Errors errors(mem, bumpMem);
 
-    tokenizer::tokenize(*source, tokens, errors);
+    tokenizer::tokenize(*source, tokens, literalValues, errors);
 
     QAK_CHECK(tokens.size() == 42, "Expected 42 tokens, got %zu", tokens.size())
     if (errors.hasErrors()) errors.print();
@@ -58,14 +62,137 @@ void testError() {
     QAK_CHECK(source != nullptr, "Couldn't read test file data/tokens_error.qak");
 
     Array<Token> tokens(mem);
+    Array<LiteralValue> literalValues(mem);
     Errors errors(mem, bumpMem);
 
-    tokenizer::tokenize(*source, tokens, errors);
+    tokenizer::tokenize(*source, tokens, literalValues, errors);
     QAK_CHECK(errors.getErrors().size() == 1, "Expected 1 error, got %zu", errors.getErrors().size());
 
     errors.getErrors()[0].print();
 }
 
+void testLiterals() {
+    Test test("Tokenizer - literal values");
+    HeapAllocator mem;
+    BumpAllocator bumpMem(mem);
+    Source *source = io::readFile("data/tokens_literals.qak", mem);
+    QAK_CHECK(source != nullptr, "Couldn't read test file data/tokens_literals.qak");
+
+    Array<Token> tokens(mem);
+    Array<LiteralValue> literalValues(mem);
+    Errors errors(mem, bumpMem);
+
+    tokenizer::tokenize(*source, tokens, literalValues, errors);
+    if (errors.hasErrors()) errors.print();
+    QAK_CHECK(errors.getErrors().size() == 0, "Expected 0 errors, got %zu", errors.getErrors().size());
+    QAK_CHECK(tokens.size() == 23, "Expected 23 tokens, got %zu", tokens.size());
+    QAK_CHECK(literalValues.size() == 23, "Expected 23 literal values, got %zu", literalValues.size());
+
+    int32_t ints[] = {0, 123, 2147483647, -1, 2147483647};
+    for (int i = 0; i < 5; i++) {
+        QAK_CHECK(tokens[i].type == IntegerLiteral, "Expected integer literal");
+        QAK_CHECK(literalValues[tokens[i].literalIndex].intValue == ints[i], "Expected %i, got %i", ints[i], literalValues[tokens[i].literalIndex].intValue);
+    }
+
+    QAK_CHECK(tokens[5].type == ByteLiteral && literalValues[tokens[5].literalIndex].byteValue == 127, "Expected byte literal 127");
+    QAK_CHECK(tokens[6].type == ShortLiteral && literalValues[tokens[6].literalIndex].shortValue == 0x7f, "Expected short literal 127");
+    QAK_CHECK(tokens[7].type == ShortLiteral && literalValues[tokens[7].literalIndex].shortValue == 32767, "Expected short literal 32767");
+    QAK_CHECK(tokens[8].type == ShortLiteral && literalValues[tokens[8].literalIndex].shortValue == -1, "Expected short literal -1");
+
+    QAK_CHECK(tokens[9].type == LongLiteral && literalValues[tokens[9].literalIndex].longValue == INT64_MAX, "Expected long literal INT64_MAX");
+    QAK_CHECK(tokens[10].type == LongLiteral && literalValues[tokens[10].literalIndex].longValue == -1, "Expected long literal -1");
+    QAK_CHECK(tokens[11].type == LongLiteral && literalValues[tokens[11].literalIndex].longValue == 42, "Expected long literal 42");
+
+    float floats[] = {0.1f, 1.5f, 123.25f, 16777217.0f};
+    for (int i = 0; i < 4; i++) {
+        QAK_CHECK(tokens[12 + i].type == FloatLiteral, "Expected float literal");
+        QAK_CHECK(literalValues[tokens[12 + i].literalIndex].floatValue == floats[i], "Expected %.9g, got %.9g", floats[i],
+                  literalValues[tokens[12 + i].literalIndex].floatValue);
+    }
+
+    double doubles[] = {0.1, 123.456, 3.141592653589793, 12345678901234567890.5, 0.000000000000000000000001};
+    for (int i = 0; i < 5; i++) {
+        QAK_CHECK(tokens[16 + i].type == DoubleLiteral, "Expected double literal");
+        QAK_CHECK(literalValues[tokens[16 + i].literalIndex].doubleValue == doubles[i], "Expected %.17g, got %.17g", doubles[i],
+                  literalValues[tokens[16 + i].literalIndex].doubleValue);
+    }
+
+    QAK_CHECK(tokens[21].type == BooleanLiteral && literalValues[tokens[21].literalIndex].booleanValue, "Expected boolean literal true");
+    QAK_CHECK(tokens[22].type == BooleanLiteral && !literalValues[tokens[22].literalIndex].booleanValue, "Expected boolean literal false");
+}
+
+void testLiteralRangeErrors() {
+    Test test("Tokenizer - literal range errors");
+    HeapAllocator mem;
+    const char *literals[] = {
+            "129b", "32769s", "2147483649", "0x100000000", "9223372036854775809l", "0x10000000000000000l", "99999999999999999999999l",
+            "1" "00000000000000000000000000000000000000000.0f", "0x"
+    };
+
+    for (size_t i = 0; i < sizeof(literals) / sizeof(literals[0]); i++) {
+        BumpAllocator bumpMem(mem);
+        Source *source = Source::fromMemory(mem, "literal.qak", literals[i]);
+        Array<Token> tokens(mem);
+        Array<LiteralValue> literalValues(mem);
+        Errors errors(mem, bumpMem);
+
+        tokenizer::tokenize(*source, tokens, literalValues, errors);
+        QAK_CHECK(errors.getErrors().size() == 1, "Expected 1 error for %s, got %zu", literals[i], errors.getErrors().size());
+        errors.getErrors()[0].print();
+        printf("\n");
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+}
+
+/* Decimal literals one larger than the maximum of their type are decoded as the minimum of the type,
+ * the parser only accepts them as the operand of a unary minus. */
+void testMinimumLiterals() {
+    Test test("Tokenizer - minimum literals");
+    HeapAllocator mem;
+    BumpAllocator bumpMem(mem);
+    Source *source = Source::fromMemory(mem, "minimum.qak", "128b 32768s 2147483648 9223372036854775808l");
+    Array<Token> tokens(mem);
+    Array<LiteralValue> literalValues(mem);
+    Errors errors(mem, bumpMem);
+
+    tokenizer::tokenize(*source, tokens, literalValues, errors);
+    QAK_CHECK(!errors.hasErrors(), "Expected no errors.");
+    QAK_CHECK(literalValues[tokens[0].literalIndex].byteValue == INT8_MIN, "Expected byte literal INT8_MIN");
+    QAK_CHECK(literalValues[tokens[1].literalIndex].shortValue == INT16_MIN, "Expected short literal INT16_MIN");
+    QAK_CHECK(literalValues[tokens[2].literalIndex].intValue == INT32_MIN, "Expected integer literal INT32_MIN");
+    QAK_CHECK(literalValues[tokens[3].literalIndex].longValue == INT64_MIN, "Expected long literal INT64_MIN");
+    mem.freeObject(source, QAK_SRC_LOC);
+}
+
+/* Float and double literals are decoded the same in locales with a decimal comma. The test is skipped
+ * if none of these locales is installed. */
+void testLiteralLocale() {
+    Test test("Tokenizer - literal locale");
+    const char *locales[] = {"de_DE.UTF-8", "de_DE.utf8", "de_DE", "fr_FR.UTF-8", "fr_FR.utf8", "fr_FR"};
+    const char *locale = nullptr;
+    for (size_t i = 0; i < sizeof(locales) / sizeof(locales[0]) && !locale; i++) locale = setlocale(LC_NUMERIC, locales[i]);
+    if (!locale) {
+        printf("No locale with a decimal comma installed, skipping.\n");
+        return;
+    }
+
+    HeapAllocator mem;
+    {
+        BumpAllocator bumpMem(mem);
+        Source *source = Source::fromMemory(mem, "locale.qak", "3.14159265358979323846d 0.100000000000000000001f");
+        Array<Token> tokens(mem);
+        Array<LiteralValue> literalValues(mem);
+        Errors errors(mem, bumpMem);
+
+        tokenizer::tokenize(*source, tokens, literalValues, errors);
+        setlocale(LC_NUMERIC, "C");
+        QAK_CHECK(!errors.hasErrors(), "Expected no errors.");
+        QAK_CHECK(literalValues[tokens[0].literalIndex].doubleValue == 3.14159265358979323846, "Expected pi in locale %s", locale);
+        QAK_CHECK(literalValues[tokens[1].literalIndex].floatValue == 0.1f, "Expected 0.1 in locale %s", locale);
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+}
+
 void generateLiteralToTokenArray() {
     HeapAllocator mem;
     uint32_t type = Period;
@@ -100,6 +227,10 @@ void generateLiteralToTokenArray() {
 int main() {
     testTokenizer();
     testError();
+    testLiterals();
+    testLiteralRangeErrors();
+    testMinimumLiterals();
+    testLiteralLocale();
     testBench();
     return 0;
 }
@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "io.h"
+#include "resolver.h"
+#include "evaluator.h"
+#include "transpiler.h"
+#include "qak.h"
+#include "test.h"
+
+using namespace qak;
+using namespace qak::ast;
+
+#define OUTPUT_NAME "test_transpiler_out"
+
+static void append(Array<char> &text, const char *format, ...) {
+    char buffer[1024];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    text.addAll(buffer, length);
+}
+
+/* Formats the value like qak_print() of the generated code does. */
+static void appendValue(Array<char> &text, Module *module, TypeTable &types, int nameLength, const char *name, TypeId type,
+                        bytecode::Value value) {
+    append(text, "%.*s: %s", nameLength, name, types.name(type));
+    switch (type) {
+        case TypeNothing:
+            append(text, "\n");
+            break;
+        case TypeBoolean:
+            append(text, " = %s\n", value.i ? "true" : "false");
+            break;
+        case TypeFloat32:
+            append(text, " = %.9g\n", value.f);
+            break;
+        case TypeFloat64:
+            append(text, " = %.17g\n", value.f);
+            break;
+        case TypeString:
+            append(text, " = \"%.*s\"\n", (int) module->strings[value.i].length, (const char *) module->strings[value.i].data);
+            break;
+        default:
+            append(text, " = %lld\n", (long long) value.i);
+            break;
+    }
+}
+
+/* Transpiles the file to C, compiles it with the system's C compiler, or the one in the CC environment
+ * variable, and runs it. Its output must match the module variables and result of the Evaluator, or
+ * the Evaluator's error. */
+static void differential(const char *fileName) {
+    HeapAllocator mem;
+    {
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        TypeTable types(mem);
+        Source *source = io::readFile(fileName, mem);
+        QAK_CHECK(source != nullptr, "Couldn't read test file %s", fileName);
+
+        Parser parser(mem);
+        FlatModule flat(mem, moduleMem);
+        QAK_CHECK(parser.parse(*source, errors, flat), "Expected a flat module.");
+        Module *module = parser.parse(*source, errors, &moduleMem);
+        QAK_CHECK(module && !errors.hasErrors(), "Expected module without parse errors.");
+        Resolver resolver(mem);
+        QAK_CHECK(resolver.resolve(module, errors), "Expected module without resolver errors.");
+        TypeChecker checker(mem);
+        QAK_CHECK(checker.check(module, types, errors), "Expected module without type errors.");
+
+        Array<char> expected(mem);
+        Evaluator evaluator(mem);
+        Errors evaluatorErrors(mem, moduleMem);
+        if (evaluator.evaluate(flat, module, types, evaluatorErrors)) {
+            for (uint32_t i = 0; i < module->variables.size(); i++) {
+                Variable *variable = module->variables[i];
+                Token &name = module->tokens[variable->name];
+                appendValue(expected, module, types, (int) name.length(), (const char *) name.source.data + name.start,
+                            module->symbolTypes[variable->symbol], evaluator.global(i));
+            }
+            appendValue(expected, module, types, 6, "result", evaluator.resultType(), evaluator.result());
+        } else {
+            Error &error = evaluatorErrors.getErrors()[0];
+            append(expected, "Error (%s:%u): %s\n", fileName, source->lines()[error.span.startLine].lineNumber, error.message);
+        }
+
+        Array<char> output(mem);
+        CTranspiler transpiler(mem);
+        QAK_CHECK(transpiler.transpile(module, types, errors, output), "Expected the module to transpile.");
+        QAK_CHECK(io::writeFile(OUTPUT_NAME ".c", (const uint8_t *) output.buffer(), output.size(), mem), "Couldn't write the C file.");
+
+        char command[1024];
+        const char *cc = getenv("CC") ? getenv("CC") : "cc";
+        snprintf(command, sizeof(command), "%s -std=c99 -pedantic-errors -O2 -o " OUTPUT_NAME " " OUTPUT_NAME ".c -lm", cc);
+        QAK_CHECK(system(command) == 0, "Couldn't compile the C file of %s with '%s'.", fileName, command);
+        double start = io::timeMillis();
+        system("./" OUTPUT_NAME " > " OUTPUT_NAME ".txt");
+        double time = io::timeMillis() - start;
+
+        Source *actual = io::readFile(OUTPUT_NAME ".txt", mem);
+        QAK_CHECK(actual != nullptr, "Couldn't read the output of %s.", fileName);
+        bool isSame = actual->size == expected.size() && memcmp(actual->data, expected.buffer(), expected.size()) == 0;
+        if (!isSame) printf("Expected:\n%.*s\nActual:\n%.*s\n", (int) expected.size(), expected.buffer(), (int) actual->size, actual->data);
+        QAK_CHECK(isSame, "%s: expected the output of the C program to match the evaluator.", fileName);
+        printf("%s: C program and evaluator agree, ran in %f ms\n", fileName, time);
+
+        remove(OUTPUT_NAME ".c");
+        remove(OUTPUT_NAME);
+        remove(OUTPUT_NAME ".txt");
+        mem.freeObject(actual, QAK_SRC_LOC);
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+void testDifferential() {
+    Test test("Transpiler - differential");
+    differential("data/transpiler.qak");
+    differential("data/evaluator.qak");
+    differential("data/interpreter.qak");
+    differential("data/folder.qak");
+    differential("data/interpreter_errors.qak");
+    differential("data/interpreter_overflow.qak");
+    differential("data/interpreter_benchmark_arithmetic.qak");
+    differential("data/interpreter_benchmark_calls.qak");
+}
+
+void testCApi() {
+    Test test("Transpiler - C API");
+    qak_compiler compiler = qak_compiler_new();
+    qak_module module = qak_compiler_compile_file(compiler, "data/interpreter.qak");
+    QAK_CHECK(module, "Expected a module.");
+    QAK_CHECK(qak_module_transpile(module, OUTPUT_NAME ".c"), "Expected the module to transpile.");
+    remove(OUTPUT_NAME ".c");
+    qak_module_delete(module);
+
+    module = qak_compiler_compile_source(compiler, "errors.qak", "module errors\nvar x: int32 = true");
+    QAK_CHECK(!qak_module_transpile(module, OUTPUT_NAME ".c"), "Expected the module to fail.");
+    QAK_CHECK(qak_module_get_num_errors(module) == 1, "Expected 1 error, got %i", qak_module_get_num_errors(module));
+    qak_module_delete(module);
+    qak_compiler_delete(compiler);
+}
+
+/* Chains of binary operations are transpiled without recursion, see generateChain(). */
+void testDeepExpression() {
+    Test test("Transpiler - deep expression");
+    HeapAllocator mem;
+    {
+        Array<char> text(mem);
+        generateChain(text, "module deep\nvar x = 0\nx = 1\nreturn 0.5 + x", " + x", 200000);
+        qak_compiler compiler = qak_compiler_new();
+        qak_module module = qak_compiler_compile_source(compiler, "deep.qak", text.buffer());
+        QAK_CHECK(qak_module_transpile(module, OUTPUT_NAME ".c"), "Expected the module to transpile.");
+        Source *output = io::readFile(OUTPUT_NAME ".c", mem);
+        QAK_CHECK(output != nullptr, "Couldn't read the C file.");
+        // Each of the 200001 terms is read into a temporary, converted to float and added.
+        const char *code = (const char *) output->data;
+        QAK_CHECK(strstr(code, "float t600002 = ") && !strstr(code, " t600003 = "), "Expected 600003 temporaries.");
+        remove(OUTPUT_NAME ".c");
+        mem.freeObject(output, QAK_SRC_LOC);
+        qak_module_delete(module);
+        qak_compiler_delete(compiler);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+int main() {
+    testDifferential();
+    testCApi();
+    testDeepExpression();
+    return 0;
+}
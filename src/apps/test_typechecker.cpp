@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <string.h>
+#include "io.h"
+#include "resolver.h"
+#include "typechecker.h"
+#include "test.h"
+
+using namespace qak;
+using namespace qak::ast;
+
+static Module *parseAndResolve(const char *fileName, HeapAllocator &mem, BumpAllocator &moduleMem, Errors &errors, Source **source) {
+    *source = io::readFile(fileName, mem);
+    QAK_CHECK(*source != nullptr, "Couldn't read test file %s", fileName);
+    Parser parser(mem);
+    Module *module = parser.parse(**source, errors, &moduleMem);
+    QAK_CHECK(module && !errors.hasErrors(), "Expected module without parse errors.");
+    Resolver resolver(mem);
+    QAK_CHECK(resolver.resolve(module, errors), "Expected module without resolver errors.");
+    return module;
+}
+
+static void checkType(TypeTable &types, TypeId expected, TypeId actual) {
+    QAK_CHECK(expected == actual, "Expected type %s, got %s", types.name(expected), types.name(actual));
+}
+
+static void checkVariableType(Module *module, TypeTable &types, size_t variable, TypeId expected) {
+    checkType(types, expected, module->symbolTypes[module->variables[variable]->symbol]);
+}
+
+void testTypeTable() {
+    Test test("Type checker - type table");
+    HeapAllocator mem;
+    {
+        TypeTable types(mem);
+        QAK_CHECK(types.size() == QAK_NUM_PRIMITIVE_TYPES, "Expected %i primitive types, got %zu", QAK_NUM_PRIMITIVE_TYPES, types.size());
+        checkType(types, TypeInt32, types.named((const uint8_t *) "int32", 5));
+        checkType(types, TypeString, types.named((const uint8_t *) "string", 6));
+        checkType(types, TypeError, types.named((const uint8_t *) "int", 3));
+        checkType(types, TypeError, types.named((const uint8_t *) "<error>", 7));
+
+        // Function types are interned by their signature.
+        TypeId parameters[] = {TypeInt32, TypeFloat64};
+        TypeId function = types.function(TypeFloat64, parameters, 2);
+        QAK_CHECK(types.get(function).kind == TypeFunction, "Expected function type.");
+        checkType(types, function, types.function(TypeFloat64, parameters, 2));
+        QAK_CHECK(types.function(TypeFloat64, parameters, 1) != function, "Expected different function type.");
+        QAK_CHECK(types.function(TypeNothing, parameters, 2) != function, "Expected different function type.");
+
+        // The table grows past its initial capacity.
+        for (uint32_t i = 0; i < 100; i++) {
+            TypeId many[] = {TypeInt8, (TypeId) i};
+            types.function(TypeNothing, many, 2);
+        }
+        checkType(types, function, types.function(TypeFloat64, parameters, 2));
+        checkType(types, TypeBoolean, types.named((const uint8_t *) "boolean", 7));
+        QAK_CHECK(types.size() == QAK_NUM_PRIMITIVE_TYPES + 103, "Expected %i types, got %zu", QAK_NUM_PRIMITIVE_TYPES + 103, types.size());
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+void testInference() {
+    Test test("Type checker - inference");
+    HeapAllocator mem;
+    {
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        Source *source;
+        Module *module = parseAndResolve("data/typechecker.qak", mem, moduleMem, errors, &source);
+
+        TypeTable types(mem);
+        TypeChecker checker(mem);
+        QAK_CHECK(checker.check(module, types, errors), "Expected no type errors.");
+        if (errors.hasErrors()) errors.print();
+
+        checkVariableType(module, types, 0, TypeInt32);
+        checkVariableType(module, types, 1, TypeInt8);
+        checkVariableType(module, types, 2, TypeInt64);
+        checkVariableType(module, types, 3, TypeFloat32);
+        checkVariableType(module, types, 4, TypeFloat64);
+        checkVariableType(module, types, 5, TypeBoolean);
+        checkVariableType(module, types, 6, TypeString);
+        checkVariableType(module, types, 7, TypeCharacter);
+        checkVariableType(module, types, 8, TypeInt64);
+
+        // Parameters and functions have types, the integer operand of a float multiplication is widened.
+        Function *scale = module->functions[0], *log = module->functions[1];
+        TypeId parameters[] = {TypeInt32, TypeFloat64};
+        checkType(types, types.function(TypeFloat64, parameters, 2), module->symbolTypes[scale->symbol]);
+        TypeId logParameters[] = {TypeString};
+        checkType(types, types.function(TypeNothing, logParameters, 1), module->symbolTypes[log->symbol]);
+        checkType(types, TypeFloat64, module->symbolTypes[scale->parameters[1]->symbol]);
+        BinaryOperation *product = (BinaryOperation *) ((Return *) scale->statements[0])->returnValue;
+        checkType(types, TypeFloat64, module->expressionTypes[product->id]);
+        checkType(types, TypeInt32, module->expressionTypes[product->left->id]);
+
+        // Every expression has a type.
+        While *loop = (While *) module->statements[module->statements.size() - 1];
+        checkType(types, TypeBoolean, module->expressionTypes[loop->condition->id]);
+        FunctionCall *logCall = (FunctionCall *) loop->statements[1];
+        checkType(types, TypeNothing, module->expressionTypes[logCall->id]);
+        BinaryOperation *message = (BinaryOperation *) logCall->arguments[0];
+        checkType(types, TypeString, module->expressionTypes[message->id]);
+        checkType(types, TypeFloat64, module->expressionTypes[message->right->id]);
+
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+void testErrors() {
+    Test test("Type checker - errors");
+    HeapAllocator mem;
+    {
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        Source *source;
+        Module *module = parseAndResolve("data/typechecker_errors.qak", mem, moduleMem, errors, &source);
+
+        TypeTable types(mem);
+        TypeChecker checker(mem);
+        QAK_CHECK(!checker.check(module, types, errors), "Expected type errors.");
+        errors.print();
+
+        const char *messages[] = {"Expected a value of type int32, got string.",
+                                  "Expected a value of type int8, got int32.",
+                                  "Unknown type 'integer'.",
+                                  "Expected a boolean condition, got int32.",
+                                  "Expected 2 arguments, got 1.",
+                                  "Operator '+' can not be applied to int32 and boolean.",
+                                  "'count' is not a function.",
+                                  "Can not assign to function 'add'.",
+                                  "Can not infer the type of 'value' from an expression without a value.",
+                                  "Operator '!' can not be applied to int32.",
+                                  "Expected a value of type int32, got boolean.",
+                                  "Function 'reset' can not return a value."};
+        uint32_t lines[] = {3, 4, 5, 15, 16, 18, 19, 20, 21, 22, 8, 12};
+        Array<Error> &errorList = errors.getErrors();
+        QAK_CHECK(errorList.size() == 12, "Expected 12 errors, got %zu", errorList.size());
+        for (size_t i = 0; i < errorList.size(); i++) {
+            QAK_CHECK(strcmp(errorList[i].message, messages[i]) == 0, "Expected error '%s', got '%s'", messages[i], errorList[i].message);
+            QAK_CHECK(errorList[i].span.startLine == lines[i], "Expected error on line %u, got %u", lines[i], errorList[i].span.startLine);
+        }
+
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+/* The types of a chain of binary operations are inferred without recursion, see generateChain(). */
+void testDeepExpression() {
+    Test test("Type checker - deep expression");
+    HeapAllocator mem;
+    {
+        Array<char> text(mem);
+        generateChain(text, "module deep\nvar x = 1\nvar y = 0.5 + x", " + x", 200000);
+        Source *source = Source::fromMemory(mem, "deep.qak", text.buffer());
+        Parser parser(mem);
+        BumpAllocator moduleMem(mem);
+        Errors errors(mem, moduleMem);
+        Module *module = parser.parse(*source, errors, &moduleMem);
+        Resolver resolver(mem);
+        QAK_CHECK(module && resolver.resolve(module, errors), "Expected module without errors.");
+
+        TypeTable types(mem);
+        TypeChecker checker(mem);
+        QAK_CHECK(checker.check(module, types, errors), "Expected no type errors.");
+        checkVariableType(module, types, 1, TypeFloat32);
+
+        mem.freeObject(source, QAK_SRC_LOC);
+    }
+    QAK_CHECK(mem.numAllocations() == 0, "Expected all memory to be deallocated, but %zu allocations remaining.", mem.numAllocations());
+}
+
+int main() {
+    testTypeTable();
+    testInference();
+    testErrors();
+    testDeepExpression();
+    return 0;
+}
@@ -48,6 +48,11 @@ namespace qak {
             _size = 0;
         }
 
+        /* Removes the elements from the index on, keeping the ones before it. */
+        QAK_FORCE_INLINE void truncate(size_t newSize) {
+            while (_size > newSize) destroy(_buffer + --_size);
+        }
+
         QAK_FORCE_INLINE void freeObjects() {
             for (int32_t i = (int32_t) size() - 1; i >= 0; i--) {
                 _mem.freeObject(_buffer[i], QAK_SRC_LOC);
@@ -107,6 +112,18 @@ namespace qak {
             }
         }
 
+        QAK_FORCE_INLINE void addAll(const T *values, size_t num) {
+            if (_size + num > _capacity) {
+                size_t newCapacity = (size_t) (_size * 1.75f);
+                if (newCapacity < _size + num) newCapacity = _size + num;
+                if (newCapacity < 8) newCapacity = 8;
+                ensureCapacity(newCapacity);
+            }
+            for (size_t i = 0; i < num; i++) {
+                construct(_buffer + _size++, values[i]);
+            }
+        }
+
         QAK_FORCE_INLINE void removeAt(size_t inIndex) {
             --_size;
 
@@ -183,6 +200,14 @@ namespace qak {
             }
         }
 
+        /* Uses the buffer as the storage of the array without copying it. The buffer must
+         * live as long as the array, e.g. by being allocated in the same BumpAllocator. See
+         * FixedArrayBuilder. */
+        QAK_FORCE_INLINE void set(T *buffer, size_t size) {
+            _buffer = buffer;
+            _size = size;
+        }
+
         QAK_FORCE_INLINE T &operator[](size_t inIndex) {
             return _buffer[inIndex];
         }
@@ -192,6 +217,76 @@ namespace qak {
         }
     };
 
+#define QAK_FIXED_ARRAY_BUILDER_CAPACITY 4
+
+    /* Collects values in a BumpAllocator when their number is not known up front, e.g. the
+     * statements of a block during parsing. The values are stored in segments of doubling
+     * capacity. If all values fit into the first segment, it is used as is and each value is
+     * written exactly once. Otherwise the segments are compacted into a single buffer once
+     * the values are requested. Unlike an Array, nothing is allocated on the heap. */
+    template<typename T>
+    class FixedArrayBuilder {
+    private:
+        /* A full segment, followed by at least one other segment. */
+        struct Segment {
+            Segment *previous;
+            T *values;
+            size_t size;
+        };
+
+        BumpAllocator *_mem;
+        Segment *_previous;
+        T *_values;
+        size_t _segmentSize;
+        size_t _segmentCapacity;
+        size_t _size;
+
+        void addSegment() {
+            if (_values) {
+                Segment *segment = _mem->allocObject<Segment>();
+                segment->previous = _previous;
+                segment->values = _values;
+                segment->size = _segmentSize;
+                _previous = segment;
+            }
+            _segmentCapacity = _segmentCapacity == 0 ? QAK_FIXED_ARRAY_BUILDER_CAPACITY : _segmentCapacity * 2;
+            _values = _mem->alloc<T>(_segmentCapacity);
+            _segmentSize = 0;
+        }
+
+    public:
+        FixedArrayBuilder(BumpAllocator &mem) : _mem(&mem), _previous(nullptr), _values(nullptr), _segmentSize(0), _segmentCapacity(0),
+                                                _size(0) {}
+
+        QAK_FORCE_INLINE void add(const T &value) {
+            if (_segmentSize == _segmentCapacity) addSegment();
+            new(_values + _segmentSize++) T(value);
+            _size++;
+        }
+
+        QAK_FORCE_INLINE size_t size() const {
+            return _size;
+        }
+
+        /* Returns the values in a single buffer allocated in the BumpAllocator. */
+        T *values() {
+            if (_previous == nullptr) return _values;
+
+            T *values = _mem->alloc<T>(_size);
+            size_t index = _size - _segmentSize;
+            memcpy(values + index, _values, _segmentSize * sizeof(T));
+            for (Segment *segment = _previous; segment; segment = segment->previous) {
+                index -= segment->size;
+                memcpy(values + index, segment->values, segment->size * sizeof(T));
+            }
+
+            _previous = nullptr;
+            _values = values;
+            _segmentSize = _segmentCapacity = _size;
+            return values;
+        }
+    };
+
     template<typename T>
     class ArrayPool {
     private:
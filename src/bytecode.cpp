@@ -0,0 +1,620 @@
+#include "bytecode.h"
+#include "visitor.h"
+
+using namespace qak;
+
+using namespace qak::ast;
+
+using namespace qak::bytecode;
+
+/* Marks that an expression may be compiled into any register, see NodeCompiler::compile(). */
+#define QAK_ANY_REGISTER 0xffffffffu
+
+/* The largest register index an instruction can encode. */
+#define QAK_MAX_REGISTERS 0xffffu
+
+#define QAK_TOKEN_TEXT(token) (int) (token).length(), (const char *) (token).source.data + (token).start
+
+static QAK_FORCE_INLINE bool isInteger(TypeId type) {
+    return type >= TypeInt8 && type <= TypeInt64;
+}
+
+static QAK_FORCE_INLINE bool isFloat(TypeId type) {
+    return type == TypeFloat32 || type == TypeFloat64;
+}
+
+static QAK_FORCE_INLINE bool isNumeric(TypeId type) {
+    return type >= TypeInt8 && type <= TypeFloat64;
+}
+
+/* Returns the numeric type operands are widened to. Numeric types are ordered from narrowest to widest. */
+static QAK_FORCE_INLINE TypeId widen(TypeId a, TypeId b) {
+    return a > b ? a : b;
+}
+
+static Value constantValue(Literal *literal) {
+    Value value;
+    value.i = 0;
+    LiteralValue &decoded = literal->decodedValue;
+    switch (literal->type) {
+        case BooleanLiteral:
+            value.i = decoded.booleanValue ? 1 : 0;
+            break;
+        case ByteLiteral:
+            value.i = decoded.byteValue;
+            break;
+        case ShortLiteral:
+            value.i = decoded.shortValue;
+            break;
+        case IntegerLiteral:
+            value.i = decoded.intValue;
+            break;
+        case LongLiteral:
+            value.i = decoded.longValue;
+            break;
+        case FloatLiteral:
+            value.f = decoded.floatValue;
+            break;
+        case DoubleLiteral:
+            value.f = decoded.doubleValue;
+            break;
+        case CharacterLiteral:
+            value.i = decoded.characterValue;
+            break;
+        case StringLiteral:
+            value.i = decoded.stringIndex;
+            break;
+        default:
+            break;
+    }
+    return value;
+}
+
+/* Returns the opcode of an arithmetic operator for operands of the type, or OpLast if there is none. */
+static Opcode arithmeticOpcode(TokenType op, TypeId type) {
+    static const Opcode i32[] = {OpAddI32, OpSubI32, OpMulI32, OpDivI32, OpRemI32};
+    static const Opcode i64[] = {OpAddI64, OpSubI64, OpMulI64, OpDivI64, OpRemI64};
+    static const Opcode f32[] = {OpAddF32, OpSubF32, OpMulF32, OpDivF32, OpRemF32};
+    static const Opcode f64[] = {OpAddF64, OpSubF64, OpMulF64, OpDivF64, OpRemF64};
+    if (op < Plus || op > Percentage) return OpLast;
+    size_t index = op - Plus;
+    if (type == TypeInt64) return i64[index];
+    if (isInteger(type)) return i32[index];
+    if (type == TypeFloat32) return f32[index];
+    if (type == TypeFloat64) return f64[index];
+    return OpLast;
+}
+
+/* Compiles statements and expressions, see BytecodeCompiler::compile(). Visiting an expression
+ * compiles it into the register in target and returns the register holding its value. Statements
+ * return QAK_ANY_REGISTER. */
+struct BytecodeCompiler::NodeCompiler : public Visitor<NodeCompiler, uint32_t> {
+    BytecodeCompiler &compiler;
+    Module *module;
+    TypeId returnType;
+    bool isModule;
+    uint32_t target;
+
+    NodeCompiler(BytecodeCompiler &compiler, TypeId returnType, bool isModule) : compiler(compiler), module(compiler._module),
+                                                                                 returnType(returnType), isModule(isModule),
+                                                                                 target(QAK_ANY_REGISTER) {}
+
+    QAK_FORCE_INLINE TypeId typeOf(Expression *expression) {
+        return module->expressionTypes[expression->id];
+    }
+
+    QAK_FORCE_INLINE size_t emit(Opcode op, uint32_t a, uint32_t b, uint32_t c, uint32_t token) {
+        compiler._code.add(Instruction(op, a, b, c));
+        compiler._tokens.add(token);
+        return compiler._code.size() - 1;
+    }
+
+    QAK_FORCE_INLINE size_t emitWide(Opcode op, uint32_t a, uint32_t bx, uint32_t token) {
+        Instruction instruction(op, a, 0, 0);
+        instruction.setBx(bx);
+        compiler._code.add(instruction);
+        compiler._tokens.add(token);
+        return compiler._code.size() - 1;
+    }
+
+    /* Makes the jump continue at the next instruction that is emitted. */
+    QAK_FORCE_INLINE void patch(size_t jump) {
+        compiler._code[jump].setBx((uint32_t) compiler._code.size());
+    }
+
+    QAK_FORCE_INLINE uint32_t allocate() {
+        uint32_t reg = compiler._numRegisters++;
+        if (compiler._numRegisters > compiler._maxRegisters) compiler._maxRegisters = compiler._numRegisters;
+        return reg;
+    }
+
+    /* Returns the register the value of the expression being compiled is stored in. */
+    QAK_FORCE_INLINE uint32_t destination() {
+        return target == QAK_ANY_REGISTER ? allocate() : target;
+    }
+
+    QAK_FORCE_INLINE bool isLocal(Symbol &symbol) {
+        return symbol.type == SymbolLocalVariable || symbol.type == SymbolParameter;
+    }
+
+    QAK_FORCE_INLINE uint32_t localRegister(Symbol &symbol) {
+        return symbol.slot - compiler._firstSlot;
+    }
+
+    uint32_t unsupported(AstNode *node, const char *message) {
+        compiler._errors->add(module->span(node), message);
+        return target == QAK_ANY_REGISTER ? allocate() : target;
+    }
+
+    /* Compiles the expression into the target register, or into any register if the target is
+     * QAK_ANY_REGISTER. Returns the register holding the value, which is a local variable's register
+     * or a new temporary register if the target is QAK_ANY_REGISTER. */
+    uint32_t compile(Expression *expression, uint32_t into) {
+        uint32_t saved = target;
+        target = into;
+        uint32_t reg = visit(expression);
+        target = saved;
+        return reg;
+    }
+
+    /* Compiles the expression like compile() and converts its value to the type, which is the
+     * expression's type or a type it can be assigned to. Integers only need to be converted to floats,
+     * all other conversions keep the stored value. */
+    uint32_t compileAs(Expression *expression, TypeId type, uint32_t into) {
+        TypeId valueType = typeOf(expression);
+        if (!isInteger(valueType) || !isFloat(type)) return compile(expression, into);
+
+        // Literals are converted at compile time.
+        if (expression->astType == AstLiteral) {
+            Value value;
+            int64_t integer = constantValue(static_cast<Literal *>(expression)).i;
+            value.f = type == TypeFloat32 ? (double) (float) integer : (double) integer;
+            uint32_t saved = target;
+            target = into;
+            uint32_t reg = destination();
+            target = saved;
+            emitWide(OpLoadConstant, reg, compiler.addConstant(value), expression->firstToken);
+            return reg;
+        }
+
+        uint32_t reg = compile(expression, into);
+        uint32_t converted = into != QAK_ANY_REGISTER ? into : (reg < compiler._numLocals ? allocate() : reg);
+        emit(type == TypeFloat32 ? OpIntToF32 : OpIntToF64, converted, reg, 0, expression->firstToken);
+        return converted;
+    }
+
+    void compileBlock(FixedArray<Statement *> &statements) {
+        for (size_t i = 0; i < statements.size(); i++) {
+            uint32_t mark = compiler._numRegisters;
+            visit(statements[i]);
+            compiler._numRegisters = mark;
+        }
+    }
+
+    uint32_t visitNode(AstNode *node) {
+        return unsupported(node, "Can not compile this statement.");
+    }
+
+    uint32_t visitLiteral(Literal *node) {
+        uint32_t reg = destination();
+        emitWide(OpLoadConstant, reg, compiler.addConstant(constantValue(node)), node->firstToken);
+        return reg;
+    }
+
+    uint32_t visitVariableAccess(VariableAccess *node) {
+        Symbol &symbol = module->symbols[node->symbol];
+        if (symbol.type == SymbolFunction) return unsupported(node, "Functions can only be called.");
+        if (symbol.type == SymbolModuleVariable) {
+            uint32_t reg = destination();
+            emitWide(OpGetGlobal, reg, symbol.slot, node->firstToken);
+            return reg;
+        }
+
+        uint32_t local = localRegister(symbol);
+        if (target == QAK_ANY_REGISTER || target == local) return local;
+        emit(OpMove, target, local, 0, node->firstToken);
+        return target;
+    }
+
+    uint32_t visitUnaryOperation(UnaryOperation *node) {
+        TokenType op = module->tokens[node->firstToken].type;
+        if (op == Plus) return compile(node->value, target);
+
+        TypeId type = typeOf(node);
+        uint32_t mark = compiler._numRegisters;
+        uint32_t value = compile(node->value, QAK_ANY_REGISTER);
+        compiler._numRegisters = mark;
+        uint32_t reg = destination();
+        if (op == Not) {
+            emit(OpNot, reg, value, 0, node->firstToken);
+        } else if (isFloat(type)) {
+            emit(OpNegF, reg, value, 0, node->firstToken);
+        } else {
+            emit(type == TypeInt64 ? OpNegI64 : OpNegI32, reg, value, 0, node->firstToken);
+            if (type == TypeInt8 || type == TypeInt16) emit(type == TypeInt8 ? OpNarrow8 : OpNarrow16, reg, reg, 0, node->firstToken);
+        }
+        return reg;
+    }
+
+    uint32_t compileAssignment(BinaryOperation *node) {
+        Symbol &symbol = module->symbols[static_cast<VariableAccess *>(node->left)->symbol];
+        TypeId type = typeOf(node->left);
+        if (isLocal(symbol)) {
+            uint32_t local = localRegister(symbol);
+            compileAs(node->right, type, local);
+            if (target == QAK_ANY_REGISTER || target == local) return local;
+            emit(OpMove, target, local, 0, node->op);
+            return target;
+        }
+
+        uint32_t reg = compileAs(node->right, type, target);
+        emitWide(OpSetGlobal, reg, symbol.slot, node->op);
+        return reg;
+    }
+
+    /* Chooses the opcode and operand type of the operation. Returns an error message if the
+     * operation can not be compiled, nullptr otherwise. */
+    const char *prepare(BinaryOperation *node, Operation &operation) {
+        TokenType op = module->tokens[node->op].type;
+        TypeId type = typeOf(node);
+        TypeId leftType = typeOf(node->left), rightType = typeOf(node->right);
+        operation.node = node;
+        operation.operandType = type;
+        operation.isSwapped = false;
+        switch (op) {
+            case Plus:
+            case Minus:
+            case Asterisk:
+            case ForwardSlash:
+            case Percentage:
+                if (type == TypeString) return "String concatenation is not supported.";
+                operation.opcode = arithmeticOpcode(op, type);
+                break;
+            case And:
+                operation.opcode = OpAnd;
+                break;
+            case Or:
+                operation.opcode = OpOr;
+                break;
+            case Xor:
+                operation.opcode = OpXor;
+                break;
+            default: {
+                // Comparisons of numbers widen the operands, other values are compared as is.
+                operation.operandType = isNumeric(leftType) && isNumeric(rightType) ? widen(leftType, rightType) : leftType;
+                bool isFloatComparison = isFloat(operation.operandType);
+                switch (op) {
+                    case Equal:
+                        operation.opcode = isFloatComparison ? OpEqF : OpEqI;
+                        break;
+                    case NotEqual:
+                        operation.opcode = isFloatComparison ? OpNeF : OpNeI;
+                        break;
+                    case Greater:
+                        operation.isSwapped = true;
+                        // Falls through.
+                    case Less:
+                        operation.opcode = isFloatComparison ? OpLtF : OpLtI;
+                        break;
+                    case GreaterEqual:
+                        operation.isSwapped = true;
+                        // Falls through.
+                    case LessEqual:
+                        operation.opcode = isFloatComparison ? OpLeF : OpLeI;
+                        break;
+                    default:
+                        return "Can not compile this operator.";
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    /* Chains like a + b + c nest their left operands as deep as they are long, so the operations
+     * along the left operands are compiled in a loop. Their instructions are emitted in the same
+     * order as if each left operand was compiled with compileAs(). */
+    uint32_t visitBinaryOperation(BinaryOperation *node) {
+        if (module->tokens[node->op].type == Assignment) return compileAssignment(node);
+        Array<Operation> &operations = compiler._operations;
+        size_t base = operations.size();
+        Operation operation;
+        const char *error = prepare(node, operation);
+        if (error) return unsupported(node, error);
+
+        // Collects the operations, the innermost left operand that is not one of them is compiled first.
+        uint32_t mark = compiler._numRegisters;
+        operation.target = target;
+        operations.add(operation);
+        Expression *expression = node->left;
+        while (expression->astType == AstBinaryOperation) {
+            BinaryOperation *left = static_cast<BinaryOperation *>(expression);
+            if (module->tokens[left->op].type == Assignment || prepare(left, operation)) break;
+            operation.target = QAK_ANY_REGISTER;
+            operations.add(operation);
+            expression = left->left;
+        }
+        uint32_t left = compileAs(expression, operations[operations.size() - 1].operandType, QAK_ANY_REGISTER);
+
+        uint32_t reg = QAK_ANY_REGISTER;
+        while (operations.size() > base) {
+            operation = operations[operations.size() - 1];
+            operations.removeAt(operations.size() - 1);
+            uint32_t right = compileAs(operation.node->right, operation.operandType, QAK_ANY_REGISTER);
+            compiler._numRegisters = mark;
+            reg = operation.target == QAK_ANY_REGISTER ? allocate() : operation.target;
+            if (operation.isSwapped) emit(operation.opcode, reg, right, left, operation.node->op);
+            else emit(operation.opcode, reg, left, right, operation.node->op);
+            TypeId type = typeOf(operation.node);
+            if (type == TypeInt8 || type == TypeInt16) {
+                if (operation.opcode != OpAnd && operation.opcode != OpOr && operation.opcode != OpXor)
+                    emit(type == TypeInt8 ? OpNarrow8 : OpNarrow16, reg, reg, 0, operation.node->op);
+            }
+            left = reg;
+
+            // Converts the value to the operand type of the enclosing operation, like compileAs().
+            if (operations.size() > base && isInteger(type) && isFloat(operations[operations.size() - 1].operandType)) {
+                left = reg < compiler._numLocals ? allocate() : reg;
+                emit(operations[operations.size() - 1].operandType == TypeFloat32 ? OpIntToF32 : OpIntToF64, left, reg, 0,
+                     operation.node->firstToken);
+            }
+        }
+        return reg;
+    }
+
+    uint32_t visitTernaryOperation(TernaryOperation *node) {
+        TypeId type = typeOf(node);
+        uint32_t mark = compiler._numRegisters;
+        uint32_t condition = compile(node->condition, QAK_ANY_REGISTER);
+        compiler._numRegisters = mark;
+        size_t toFalse = emitWide(OpJumpIfFalse, condition, 0, node->firstToken);
+        uint32_t reg = destination();
+        compileAs(node->trueValue, type, reg);
+        size_t toEnd = emitWide(OpJump, 0, 0, node->firstToken);
+        patch(toFalse);
+        compileAs(node->falseValue, type, reg);
+        patch(toEnd);
+        return reg;
+    }
+
+    uint32_t visitFunctionCall(FunctionCall *node) {
+        Expression *callee = node->variableAccess;
+        if (callee->astType != AstVariableAccess) return unsupported(node, "Only functions can be called.");
+        Symbol &symbol = module->symbols[static_cast<VariableAccess *>(callee)->symbol];
+        if (symbol.type != SymbolFunction && symbol.type != SymbolNative) return unsupported(node, "Only functions can be called.");
+        uint32_t index = symbol.slot;
+
+        // The arguments are stored in consecutive registers, which become the first registers of the called function.
+        uint32_t base = compiler._numRegisters;
+        uint32_t numArguments = (uint32_t) node->arguments.size();
+        for (uint32_t i = 0; i < (numArguments > 0 ? numArguments : 1); i++) allocate();
+        if (symbol.type == SymbolNative) {
+            TypeTable &types = module->natives->types();
+            Type &native = types.get(module->natives->get(index).type);
+            for (uint32_t i = 0; i < numArguments; i++) compileAs(node->arguments[i], types.parameter(native, i), base + i);
+        } else {
+            ast::Function *function = module->functions[index];
+            for (uint32_t i = 0; i < numArguments; i++) {
+                compileAs(node->arguments[i], module->symbolTypes[function->parameters[i]->symbol], base + i);
+            }
+        }
+        emitWide(symbol.type == SymbolNative ? OpCallNative : OpCall, base, index, node->firstToken);
+        compiler._numRegisters = base;
+
+        uint32_t reg = destination();
+        if (reg != base) emit(OpMove, reg, base, 0, node->firstToken);
+        return reg;
+    }
+
+    uint32_t visitVariable(Variable *node) {
+        Symbol &symbol = module->symbols[node->symbol];
+        TypeId type = module->symbolTypes[node->symbol];
+        if (symbol.type == SymbolModuleVariable) {
+            // Globals are zero before the module's statements run.
+            if (node->initializerExpression) {
+                uint32_t reg = compileAs(node->initializerExpression, type, QAK_ANY_REGISTER);
+                emitWide(OpSetGlobal, reg, symbol.slot, node->name);
+            }
+        } else if (node->initializerExpression) {
+            compileAs(node->initializerExpression, type, localRegister(symbol));
+        } else {
+            // Variables declared in loops are zeroed on each iteration.
+            Value zero;
+            zero.i = 0;
+            emitWide(OpLoadConstant, localRegister(symbol), compiler.addConstant(zero), node->name);
+        }
+        return QAK_ANY_REGISTER;
+    }
+
+    uint32_t visitWhile(While *node) {
+        // The condition follows the body, so each iteration takes a single jump.
+        size_t toCondition = emitWide(OpJump, 0, 0, node->firstToken);
+        uint32_t body = (uint32_t) compiler._code.size();
+        compileBlock(node->statements);
+        patch(toCondition);
+        Expression *condition = node->condition;
+        if (condition->astType == AstLiteral && static_cast<Literal *>(condition)->decodedValue.booleanValue) {
+            emitWide(OpJump, 0, body, node->firstToken);
+        } else {
+            uint32_t reg = compile(condition, QAK_ANY_REGISTER);
+            emitWide(OpJumpIfTrue, reg, body, node->firstToken);
+        }
+        return QAK_ANY_REGISTER;
+    }
+
+    uint32_t visitIf(If *node) {
+        uint32_t mark = compiler._numRegisters;
+        uint32_t condition = compile(node->condition, QAK_ANY_REGISTER);
+        compiler._numRegisters = mark;
+        size_t toFalse = emitWide(OpJumpIfFalse, condition, 0, node->firstToken);
+        compileBlock(node->trueBlock);
+        if (node->falseBlock.size() > 0) {
+            size_t toEnd = emitWide(OpJump, 0, 0, node->firstToken);
+            patch(toFalse);
+            compileBlock(node->falseBlock);
+            patch(toEnd);
+        } else {
+            patch(toFalse);
+        }
+        return QAK_ANY_REGISTER;
+    }
+
+    uint32_t visitReturn(Return *node) {
+        if (!node->returnValue) {
+            emit(OpReturnNothing, 0, 0, 0, node->firstToken);
+            return QAK_ANY_REGISTER;
+        }
+
+        // The module's statements can return values of any type.
+        TypeId type = isModule ? typeOf(node->returnValue) : returnType;
+        uint32_t reg = compileAs(node->returnValue, type, QAK_ANY_REGISTER);
+        emit(OpReturn, reg, type, 0, node->firstToken);
+        return QAK_ANY_REGISTER;
+    }
+
+    uint32_t visitError(ErrorNode *node) {
+        return unsupported(node, "Can not compile a module with errors.");
+    }
+};
+
+uint32_t BytecodeCompiler::addConstant(Value value) {
+    MapEntry<int64_t, uint32_t> *entry = _constantIndices->get(value.i);
+    if (entry) return entry->value;
+    uint32_t index = (uint32_t) _constants.size();
+    _constants.add(value);
+    _constantIndices->put(value.i, index);
+    return index;
+}
+
+bytecode::Function *BytecodeCompiler::compileFunction(uint32_t name, uint32_t numParameters, FixedArray<Statement *> &statements, uint32_t firstSlot,
+                                            uint32_t numSlots, TypeId returnType, bool isModule) {
+    _code.clear();
+    _tokens.clear();
+    _firstSlot = firstSlot;
+    _numLocals = numSlots;
+    _numRegisters = numSlots;
+    _maxRegisters = numSlots > 0 ? numSlots : 1;
+
+    NodeCompiler compiler(*this, returnType, isModule);
+    compiler.compileBlock(statements);
+
+    // Functions that end without a return statement return the zero value of their return type.
+    if (returnType == TypeNothing) {
+        compiler.emit(OpReturnNothing, 0, 0, 0, name);
+    } else {
+        Value zero;
+        zero.i = 0;
+        compiler.emitWide(OpLoadConstant, 0, addConstant(zero), name);
+        compiler.emit(OpReturn, 0, returnType, 0, name);
+    }
+
+    Token &nameToken = _module->tokens[name];
+    if (_maxRegisters > QAK_MAX_REGISTERS) _errors->add(nameToken, "'%.*s' needs too many registers.", QAK_TOKEN_TEXT(nameToken));
+
+    bytecode::Function *function = _module->mem.allocObject<bytecode::Function>(_module->mem, name, numParameters);
+    function->numRegisters = _maxRegisters;
+    function->code.set(_code);
+    function->tokens.set(_tokens);
+    return function;
+}
+
+Program *BytecodeCompiler::compile(Module *module, TypeTable &types, Errors &errors) {
+    size_t numErrors = errors.getErrors().size();
+    Map<int64_t, uint32_t, ConstantHash> constantIndices(_mem, 256);
+    _module = module;
+    _errors = &errors;
+    _constantIndices = &constantIndices;
+    _constants.clear();
+
+    Program *program = module->mem.allocObject<Program>(module);
+    Array<bytecode::Function *> functions(_mem);
+    for (size_t i = 0; i < module->functions.size(); i++) {
+        ast::Function *function = module->functions[i];
+        TypeId returnType = types.get(module->symbolTypes[function->symbol]).returnType;
+        functions.add(compileFunction(function->name, (uint32_t) function->parameters.size(), function->statements, 0, function->numSlots, returnType,
+                                      false));
+    }
+    program->functions.set(functions);
+    program->numGlobals = (uint32_t) module->variables.size();
+    program->statements = compileFunction(module->name, 0, module->statements, program->numGlobals, module->numSlots - program->numGlobals,
+                                          TypeNothing, true);
+    program->constants.set(_constants);
+    if (module->natives && module->natives->size() > 0) {
+        size_t numNatives = module->natives->size();
+        Native *natives = module->mem.alloc<Native>(numNatives);
+        for (size_t i = 0; i < numNatives; i++) new(natives + i) Native(module->natives->get(i));
+        program->natives.set(natives, numNatives);
+    }
+
+    _module = nullptr;
+    _errors = nullptr;
+    _constantIndices = nullptr;
+    return errors.getErrors().size() == numErrors ? program : nullptr;
+}
+
+#define QAK_OPCODE_NAME(name) #name,
+
+const char *bytecode::opcodeToString(Opcode op) {
+    static const char *names[] = {QAK_OPCODES(QAK_OPCODE_NAME) "Last"};
+    return names[op];
+}
+
+#undef QAK_OPCODE_NAME
+
+static void printFunction(Program *program, bytecode::Function *function) {
+    Module *module = program->module;
+    printf("%.*s (parameters: %u, registers: %u)\n", QAK_TOKEN_TEXT(module->tokens[function->name]), function->numParameters, function->numRegisters);
+    for (size_t i = 0; i < function->code.size(); i++) {
+        Instruction &instruction = function->code[i];
+        Opcode op = (Opcode) instruction.op;
+        printf("   %4zu  %-14s", i, opcodeToString(op));
+        switch (op) {
+            case OpLoadConstant: {
+                Value &constant = program->constants[instruction.bx()];
+                printf("r%u, k%u (%lld, %g)\n", instruction.a, instruction.bx(), (long long) constant.i, constant.f);
+                break;
+            }
+            case OpGetGlobal:
+            case OpSetGlobal:
+                printf("r%u, g%u\n", instruction.a, instruction.bx());
+                break;
+            case OpJump:
+                printf("%u\n", instruction.bx());
+                break;
+            case OpJumpIfFalse:
+            case OpJumpIfTrue:
+                printf("r%u, %u\n", instruction.a, instruction.bx());
+                break;
+            case OpCall:
+                printf("r%u, %.*s\n", instruction.a, QAK_TOKEN_TEXT(module->tokens[program->functions[instruction.bx()]->name]));
+                break;
+            case OpCallNative:
+                printf("r%u, %s\n", instruction.a, program->natives[instruction.bx()].name);
+                break;
+            case OpReturn:
+                printf("r%u\n", instruction.a);
+                break;
+            case OpReturnNothing:
+                printf("\n");
+                break;
+            case OpMove:
+            case OpNegI32:
+            case OpNegI64:
+            case OpNegF:
+            case OpNot:
+            case OpNarrow8:
+            case OpNarrow16:
+            case OpIntToF32:
+            case OpIntToF64:
+                printf("r%u, r%u\n", instruction.a, instruction.b);
+                break;
+            default:
+                printf("r%u, r%u, r%u\n", instruction.a, instruction.b, instruction.c);
+                break;
+        }
+    }
+}
+
+void bytecode::printProgram(Program *program) {
+    for (size_t i = 0; i < program->functions.size(); i++) printFunction(program, program->functions[i]);
+    printFunction(program, program->statements);
+}
@@ -0,0 +1,213 @@
+#ifndef QAK_BYTECODE_H
+#define QAK_BYTECODE_H
+
+#include "natives.h"
+#include "map.h"
+
+namespace qak {
+    namespace bytecode {
+        /* The opcodes of the instruction set, see Opcode. Kept as a list so the interpreter's
+         * dispatch table and the disassembler stay in the order of the enum.
+         *
+         * Registers hold 64-bit Values. Integers of all sizes are stored sign-extended in
+         * Value::i, booleans as 0 or 1, characters as their code point and strings as the
+         * index of the string in ast::Module::strings. Floats of both sizes are stored in
+         * Value::f, float32 values are rounded to float32 precision after each operation.
+         *
+         * Operands named a, b and c are registers unless noted otherwise. bx is the 32-bit
+         * operand formed by b and c, see Instruction::bx(). */
+#define QAK_OPCODES(X) \
+    X(LoadConstant)  /* a = constants[bx] */ \
+    X(Move)          /* a = b */ \
+    X(GetGlobal)     /* a = globals[bx] */ \
+    X(SetGlobal)     /* globals[bx] = a */ \
+    X(AddI32)        /* a = b + c, wrapped to 32 bits */ \
+    X(SubI32) \
+    X(MulI32) \
+    X(DivI32)        /* Fails if c is zero. */ \
+    X(RemI32) \
+    X(AddI64) \
+    X(SubI64) \
+    X(MulI64) \
+    X(DivI64) \
+    X(RemI64) \
+    X(AddF32)        /* a = b + c, rounded to float32 */ \
+    X(SubF32) \
+    X(MulF32) \
+    X(DivF32) \
+    X(RemF32) \
+    X(AddF64) \
+    X(SubF64) \
+    X(MulF64) \
+    X(DivF64) \
+    X(RemF64) \
+    X(And)           /* a = b & c, on integers and booleans */ \
+    X(Or) \
+    X(Xor) \
+    X(NegI32)        /* a = -b */ \
+    X(NegI64) \
+    X(NegF) \
+    X(Not)           /* a = !b on booleans */ \
+    X(Narrow8)       /* a = b wrapped to 8 bits */ \
+    X(Narrow16) \
+    X(IntToF32)      /* a = b converted to float32 */ \
+    X(IntToF64) \
+    X(EqI)           /* a = b == c, on integers, booleans, characters and strings */ \
+    X(NeI) \
+    X(LtI) \
+    X(LeI) \
+    X(EqF) \
+    X(NeF) \
+    X(LtF) \
+    X(LeF) \
+    X(Jump)          /* Continues at instruction bx. */ \
+    X(JumpIfFalse)   /* Continues at instruction bx if a is false. */ \
+    X(JumpIfTrue) \
+    X(Call)          /* Calls functions[bx] with the arguments starting at a, its return value is stored in a. */ \
+    X(CallNative)    /* Calls natives[bx] like Call. */ \
+    X(Return)        /* Returns a. b is the TypeId of a. */ \
+    X(ReturnNothing)
+
+#define QAK_OPCODE_ENUM(name) Op##name,
+
+        enum Opcode {
+            QAK_OPCODES(QAK_OPCODE_ENUM)
+            OpLast
+        };
+
+#undef QAK_OPCODE_ENUM
+
+        /* The value of a register, global or constant. See QAK_OPCODES for how values of each type are stored. */
+        union Value {
+            int64_t i;
+            double f;
+        };
+
+        struct Instruction {
+            uint16_t op;
+            uint16_t a;
+            uint16_t b;
+            uint16_t c;
+
+            Instruction(Opcode op, uint32_t a, uint32_t b, uint32_t c) : op((uint16_t) op), a((uint16_t) a), b((uint16_t) b), c((uint16_t) c) {}
+
+            QAK_FORCE_INLINE uint32_t bx() const {
+                return (uint32_t) b | ((uint32_t) c << 16);
+            }
+
+            QAK_FORCE_INLINE void setBx(uint32_t bx) {
+                b = (uint16_t) bx;
+                c = (uint16_t) (bx >> 16);
+            }
+        };
+
+        /* A function or the statements of a module. The registers of a function start with its
+         * parameters, followed by its local variables, see ast::Symbol::slot, followed by the
+         * temporary values of expressions. */
+        struct Function {
+            /* The name token of the function, or of the module for the module's statements. */
+            uint32_t name;
+            uint32_t numParameters;
+            uint32_t numRegisters;
+            FixedArray<Instruction> code;
+
+            /* The token each instruction was compiled from, used to report errors while running. */
+            FixedArray<uint32_t> tokens;
+
+            Function(BumpAllocator &mem, uint32_t name, uint32_t numParameters) : name(name), numParameters(numParameters), numRegisters(0),
+                                                                                   code(mem), tokens(mem) {}
+        };
+
+        /* The compiled functions and module statements of a module. Module variables are stored in
+         * globals, by their ast::Symbol::slot. */
+        struct Program {
+            ast::Module *module;
+
+            /* The functions by their index in ast::Module::functions. */
+            FixedArray<Function *> functions;
+            Function *statements;
+            FixedArray<Value> constants;
+            uint32_t numGlobals;
+
+            /* The natives the module was resolved with, see ast::Module::natives, copied so they are
+             * called without going through the NativeFunctions. */
+            FixedArray<Native> natives;
+
+            Program(ast::Module *module) : module(module), functions(module->mem), statements(nullptr), constants(module->mem), numGlobals(0),
+                                           natives(module->mem) {}
+        };
+
+        /* Returns the name of the opcode, e.g. "AddI32". */
+        const char *opcodeToString(Opcode op);
+
+        /* Prints the instructions of each function of the program. */
+        void printProgram(Program *program);
+    }
+
+    /* Compiles a type checked module to bytecode, see bytecode::Program. Constants are stored once
+     * per program. Local variables live in fixed registers, so reading them needs no instruction,
+     * and temporary registers are reused once the expression that needs them is compiled.
+     *
+     * Module variables are only accessible through their name, functions can not be stored in
+     * variables or passed as values. String concatenation is not supported. */
+    class BytecodeCompiler {
+    private:
+        struct NodeCompiler;
+
+        /* Spreads the bits of a constant over the hash, the low bits of doubles are often zero. */
+        struct ConstantHash {
+            int64_t operator()(const int64_t &bits) const {
+                return (int64_t) (((uint64_t) bits * 0x9e3779b97f4a7c15ull) >> 32);
+            }
+        };
+
+        /* A binary operation along the left operands of a chain, see NodeCompiler::visitBinaryOperation(). */
+        struct Operation {
+            ast::BinaryOperation *node;
+            bytecode::Opcode opcode;
+            TypeId operandType;
+            bool isSwapped;
+            uint32_t target;
+        };
+
+        HeapAllocator &_mem;
+        Array<bytecode::Instruction> _code;
+        Array<uint32_t> _tokens;
+        Array<bytecode::Value> _constants;
+
+        /* The operations of the chains being compiled. */
+        Array<Operation> _operations;
+
+        // Set on each call to compile.
+        ast::Module *_module;
+        Errors *_errors;
+
+        /* The index of each constant in _constants, by the constant's bits. */
+        Map<int64_t, uint32_t, ConstantHash> *_constantIndices;
+
+        /* The slot of the first local variable of the function being compiled, which is stored in
+         * register 0, and the number of registers that hold local variables. */
+        uint32_t _firstSlot;
+        uint32_t _numLocals;
+
+        /* The next free temporary register and the number of registers used so far. */
+        uint32_t _numRegisters;
+        uint32_t _maxRegisters;
+
+        uint32_t addConstant(bytecode::Value value);
+
+        bytecode::Function *compileFunction(uint32_t name, uint32_t numParameters, FixedArray<ast::Statement *> &statements, uint32_t firstSlot,
+                                            uint32_t numSlots, TypeId returnType, bool isModule);
+
+    public:
+        BytecodeCompiler(HeapAllocator &mem) : _mem(mem), _code(mem), _tokens(mem), _constants(mem), _operations(mem), _module(nullptr), _errors(nullptr),
+                                               _constantIndices(nullptr), _firstSlot(0), _numLocals(0), _numRegisters(0), _maxRegisters(0) {}
+
+        /* Compiles the module, which must be type checked without errors with the types, see
+         * TypeChecker::check(). Unsupported constructs are reported in the errors, in which case
+         * nullptr is returned. The program is allocated in the module's memory. */
+        bytecode::Program *compile(ast::Module *module, TypeTable &types, Errors &errors);
+    };
+}
+
+#endif //QAK_BYTECODE_H
@@ -0,0 +1,316 @@
+#include "cache.h"
+#include "io.h"
+#include <cstdio>
+
+using namespace qak;
+
+using namespace qak::ast;
+
+#define QAK_CACHE_MAGIC 0x434b4151 // "QAKC"
+
+/** The header of a cache entry, followed by the sections in the order of the counts. */
+struct CacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint32_t nodeSize;
+    uint32_t sourceSize;
+    uint32_t numNodes;
+    uint32_t numTokens;
+    uint32_t numLists;
+    uint32_t numStrings;
+    uint32_t numErrors;
+    uint32_t numBytes;
+};
+
+struct CacheSpan {
+    uint32_t start;
+    uint32_t end;
+    uint32_t startLine;
+    uint32_t endLine;
+};
+
+struct CacheToken {
+    CacheSpan span;
+    uint32_t type;
+    uint32_t literalIndex;
+};
+
+/** A string literal or error message, stored null-terminated in the bytes section at the offset. */
+struct CacheString {
+    uint32_t offset;
+    uint32_t length;
+    uint32_t hash;
+};
+
+struct CacheError {
+    CacheSpan span;
+    uint32_t message;
+};
+
+/** The byte offsets of the sections of an entry, computed from its header. */
+struct CacheLayout {
+    size_t nodes, tokens, lists, strings, errors, bytes, size;
+
+    CacheLayout(CacheHeader &header) {
+        nodes = sizeof(CacheHeader);
+        tokens = nodes + (size_t) header.numNodes * sizeof(qak_ast_node);
+        lists = tokens + (size_t) header.numTokens * sizeof(CacheToken);
+        strings = lists + (size_t) header.numLists * sizeof(qak_ast_node_index);
+        errors = strings + (size_t) header.numStrings * sizeof(CacheString);
+        bytes = errors + (size_t) header.numErrors * sizeof(CacheError);
+        size = bytes + header.numBytes;
+    }
+};
+
+static CacheSpan toCacheSpan(Span &span) {
+    return {span.start, span.end, span.startLine, span.endLine};
+}
+
+static Span toSpan(Source &source, CacheSpan &span) {
+    return Span(source, span.start, span.startLine, span.end, span.endLine);
+}
+
+static void clearSpanData(qak_span &span) {
+    span.data.data = nullptr;
+}
+
+/* Returns whether the span lies within the source. */
+static bool isValidSpan(CacheSpan &span, uint32_t sourceSize) {
+    return span.start <= span.end && span.end <= sourceSize && span.startLine <= span.endLine;
+}
+
+/* Accumulates whether the spans of a node lie within the source. The entry stores no data
+ * pointers, FlatModule::node() only sets them if the node's span has none. */
+struct NodeSpanValidator {
+    uint32_t sourceSize;
+    bool &isValid;
+
+    NodeSpanValidator(uint32_t sourceSize, bool &isValid) : sourceSize(sourceSize), isValid(isValid) {}
+
+    void operator()(qak_span &span) {
+        isValid = isValid && span.data.data == nullptr && span.start <= span.end && span.end <= sourceSize &&
+                  span.data.length == span.end - span.start && span.startLine <= span.endLine;
+    }
+};
+
+/* Children are stored before their parent, see FlatModule, so a node may only reference nodes
+ * with a lower index. This also rules out cycles. */
+static bool isValidChild(qak_ast_node_index child, qak_ast_node_index parent, bool isOptional) {
+    return (isOptional && child == -1) || (child >= 0 && child < parent);
+}
+
+static bool isValidList(qak_ast_node_list &list, qak_ast_node_index parent, const qak_ast_node_index *lists, uint32_t numLists) {
+    if (list.start > numLists || list.numNodes > numLists - list.start) return false;
+    for (uint32_t i = 0; i < list.numNodes; i++) {
+        if (!isValidChild(lists[list.start + i], parent, false)) return false;
+    }
+    return true;
+}
+
+static bool isValidNode(qak_ast_node &node, qak_ast_node_index index, const qak_ast_node_index *lists, CacheHeader &header) {
+    uint32_t numLists = header.numLists;
+    switch (node.type) {
+        case QakAstTypeSpecifier:
+        case QakAstVariableAccess:
+        case QakAstError:
+            return true;
+        case QakAstParameter:
+            return isValidChild(node.data.parameter.typeSpecifier, index, false);
+        case QakAstFunction:
+            return isValidList(node.data.function.parameters, index, lists, numLists) && isValidChild(node.data.function.returnType, index, true) &&
+                   isValidList(node.data.function.statements, index, lists, numLists);
+        case QakAstTernaryOperation:
+            return isValidChild(node.data.ternaryOperation.condition, index, false) && isValidChild(node.data.ternaryOperation.trueValue, index, false) &&
+                   isValidChild(node.data.ternaryOperation.falseValue, index, false);
+        case QakAstBinaryOperation:
+            return isValidChild(node.data.binaryOperation.left, index, false) && isValidChild(node.data.binaryOperation.right, index, false);
+        case QakAstUnaryOperation:
+            return isValidChild(node.data.unaryOperation.value, index, false);
+        case QakAstLiteral:
+            if ((uint32_t) node.data.literal.type > QakTokenIdentifier) return false;
+            return node.data.literal.type != QakTokenStringLiteral || node.data.literal.decodedValue.stringIndex < header.numStrings;
+        case QakAstFunctionCall:
+            return isValidChild(node.data.functionCall.variableAccess, index, false) && isValidList(node.data.functionCall.arguments, index, lists, numLists);
+        case QakAstVariable:
+            return isValidChild(node.data.variable.typeSpecifier, index, true) && isValidChild(node.data.variable.initializerExpression, index, true);
+        case QakAstWhile:
+            return isValidChild(node.data.whileNode.condition, index, false) && isValidList(node.data.whileNode.statements, index, lists, numLists);
+        case QakAstIf:
+            return isValidChild(node.data.ifNode.condition, index, false) && isValidList(node.data.ifNode.trueBlock, index, lists, numLists) &&
+                   isValidList(node.data.ifNode.falseBlock, index, lists, numLists);
+        case QakAstReturn:
+            return isValidChild(node.data.returnNode.returnValue, index, true);
+        case QakAstModule:
+            return isValidList(node.data.module.variables, index, lists, numLists) && isValidList(node.data.module.functions, index, lists, numLists) &&
+                   isValidList(node.data.module.statements, index, lists, numLists) && isValidList(node.data.module.types, index, lists, numLists);
+        case QakAstTypeDeclaration:
+            return isValidList(node.data.typeDeclaration.fields, index, lists, numLists);
+        case QakAstField:
+            return isValidChild(node.data.field.typeSpecifier, index, false);
+        default:
+            return false;
+    }
+}
+
+/* Returns whether every span, offset and index of the entry lies within the source or the entry, so
+ * a corrupt entry is a cache miss instead of an out of bounds access. The header must match the
+ * entry's size, see CacheLayout. The literal indices of tokens are not checked, the literal values
+ * they refer to are not part of the entry and never read. */
+static bool isValidEntry(const uint8_t *data, CacheHeader &header, Source &source) {
+    CacheLayout layout(header);
+    uint32_t sourceSize = header.sourceSize;
+
+    CacheToken *tokens = (CacheToken *) (data + layout.tokens);
+    for (uint32_t i = 0; i < header.numTokens; i++) {
+        if (tokens[i].type > Identifier || !isValidSpan(tokens[i].span, sourceSize)) return false;
+    }
+
+    // The module node is the last node, see FlatModule::root().
+    qak_ast_node *nodes = (qak_ast_node *) (data + layout.nodes);
+    if (header.numNodes > 0 && nodes[header.numNodes - 1].type != QakAstModule) return false;
+    const qak_ast_node_index *lists = (const qak_ast_node_index *) (data + layout.lists);
+    bool isValid = true;
+    for (uint32_t i = 0; i < header.numNodes && isValid; i++) {
+        isValid = isValidNode(nodes[i], (qak_ast_node_index) i, lists, header);
+        if (isValid) forEachSpan(nodes[i], NodeSpanValidator(sourceSize, isValid));
+    }
+    if (!isValid) return false;
+
+    // Strings are stored back to back at the start of the bytes section, each followed by a null.
+    const uint8_t *bytes = data + layout.bytes;
+    CacheString *strings = (CacheString *) (data + layout.strings);
+    uint32_t offset = 0;
+    for (uint32_t i = 0; i < header.numStrings; i++) {
+        if (strings[i].offset != offset || strings[i].length >= header.numBytes - offset || bytes[offset + strings[i].length] != 0) return false;
+        offset += strings[i].length + 1;
+    }
+
+    // Error messages are added to the errors as is, so they must be null-terminated within the entry. Errors
+    // are printed with the line of their start, see Error::getLine().
+    CacheError *errors = (CacheError *) (data + layout.errors);
+    for (uint32_t i = 0; i < header.numErrors; i++) {
+        CacheError &error = errors[i];
+        if (!isValidSpan(error.span, sourceSize) || error.span.startLine >= source.lines().size()) return false;
+        if (error.message >= header.numBytes || memchr(bytes + error.message, 0, header.numBytes - error.message) == nullptr) return false;
+    }
+    return true;
+}
+
+uint64_t cache::key(Source &source) {
+    // 64-bit FNV-1a over the compiler version and the source data.
+    uint32_t version = QAK_COMPILER_VERSION;
+    uint64_t hash = hashBytes64((const uint8_t *) &version, sizeof(version));
+    return hashBytes64(source.data, source.size, hash);
+}
+
+char *cache::entryFileName(const char *directory, uint64_t key, HeapAllocator &mem) {
+    size_t length = strlen(directory) + 1 + 16 + strlen(".qakc") + 1;
+    char *fileName = mem.alloc<char>(length, QAK_SRC_LOC);
+    snprintf(fileName, length, "%s/%016llx.qakc", directory, (unsigned long long) key);
+    return fileName;
+}
+
+bool cache::write(const char *fileName, uint64_t key, Source &source, Array<Token> &tokens, FlatModule &module, Errors &errors,
+                  HeapAllocator &mem) {
+    Array<Error> &errorList = errors.getErrors();
+    CacheHeader header;
+    header.magic = QAK_CACHE_MAGIC;
+    header.version = QAK_COMPILER_VERSION;
+    header.key = key;
+    header.nodeSize = (uint32_t) sizeof(qak_ast_node);
+    header.sourceSize = (uint32_t) source.size;
+    header.numNodes = (uint32_t) module.nodes.size();
+    header.numTokens = (uint32_t) tokens.size();
+    header.numLists = (uint32_t) module.lists.size();
+    header.numStrings = (uint32_t) module.strings.size();
+    header.numErrors = (uint32_t) errorList.size();
+    header.numBytes = 0;
+    for (size_t i = 0; i < module.strings.size(); i++) header.numBytes += module.strings[i].length + 1;
+    for (size_t i = 0; i < errorList.size(); i++) header.numBytes += (uint32_t) strlen(errorList[i].message) + 1;
+
+    CacheLayout layout(header);
+    uint8_t *data = mem.calloc<uint8_t>(layout.size, QAK_SRC_LOC);
+    memcpy(data, &header, sizeof(CacheHeader));
+
+    qak_ast_node *nodes = (qak_ast_node *) (data + layout.nodes);
+    if (header.numNodes > 0) memcpy(nodes, module.nodes.buffer(), header.numNodes * sizeof(qak_ast_node));
+    for (uint32_t i = 0; i < header.numNodes; i++) forEachSpan(nodes[i], clearSpanData);
+
+    CacheToken *cacheTokens = (CacheToken *) (data + layout.tokens);
+    for (uint32_t i = 0; i < header.numTokens; i++) cacheTokens[i] = {toCacheSpan(tokens[i]), (uint32_t) tokens[i].type, tokens[i].literalIndex};
+
+    if (header.numLists > 0) memcpy(data + layout.lists, module.lists.buffer(), header.numLists * sizeof(qak_ast_node_index));
+
+    uint32_t offset = 0;
+    CacheString *strings = (CacheString *) (data + layout.strings);
+    for (uint32_t i = 0; i < header.numStrings; i++) {
+        InternedString &string = module.strings[i];
+        strings[i] = {offset, string.length, string.hash};
+        if (string.length > 0) memcpy(data + layout.bytes + offset, string.data, string.length);
+        offset += string.length + 1;
+    }
+
+    CacheError *cacheErrors = (CacheError *) (data + layout.errors);
+    for (uint32_t i = 0; i < header.numErrors; i++) {
+        Error &error = errorList[i];
+        cacheErrors[i] = {toCacheSpan(error.span), offset};
+        size_t length = strlen(error.message) + 1;
+        memcpy(data + layout.bytes + offset, error.message, length);
+        offset += (uint32_t) length;
+    }
+
+    bool success = io::writeFile(fileName, data, layout.size, mem);
+    mem.free(data, QAK_SRC_LOC);
+    return success;
+}
+
+bool cache::read(const char *fileName, uint64_t key, Source &source, Array<Token> &tokens, FlatModule &module, Errors &errors,
+                 HeapAllocator &mem) {
+    // The entry is read like a source file, the sections are copied out of its data below.
+    Source *file = io::readFile(fileName, mem);
+    if (!file) return false;
+
+    const uint8_t *data = file->data;
+    CacheHeader header;
+    bool isValid = file->size >= sizeof(CacheHeader);
+    if (isValid) {
+        memcpy(&header, data, sizeof(CacheHeader));
+        isValid = header.magic == QAK_CACHE_MAGIC && header.version == QAK_COMPILER_VERSION && header.key == key &&
+                  header.nodeSize == sizeof(qak_ast_node) && header.sourceSize == source.size && CacheLayout(header).size == file->size &&
+                  isValidEntry(data, header, source);
+    }
+    if (!isValid) {
+        mem.freeObject(file, QAK_SRC_LOC);
+        return false;
+    }
+    CacheLayout layout(header);
+
+    // The nodes are copied as is, the data pointers of their spans are set on access, see FlatModule::node().
+    module.nodes.clear();
+    module.nodes.addAll((qak_ast_node *) (data + layout.nodes), header.numNodes);
+
+    module.lists.clear();
+    module.lists.addAll((qak_ast_node_index *) (data + layout.lists), header.numLists);
+
+    CacheToken *cacheTokens = (CacheToken *) (data + layout.tokens);
+    tokens.ensureCapacity(tokens.size() + header.numTokens);
+    for (uint32_t i = 0; i < header.numTokens; i++) tokens.add(Token((TokenType) cacheTokens[i].type, toSpan(source, cacheTokens[i].span), cacheTokens[i].literalIndex));
+
+    // The bytes of the string literals are copied at once, then referenced by the interned strings.
+    CacheString *strings = (CacheString *) (data + layout.strings);
+    uint32_t numStringBytes = header.numStrings > 0 ? strings[header.numStrings - 1].offset + strings[header.numStrings - 1].length + 1 : 0;
+    uint8_t *bytes = module.mem.alloc<uint8_t>(numStringBytes);
+    if (numStringBytes > 0) memcpy(bytes, data + layout.bytes, numStringBytes);
+    InternedString *internedStrings = module.mem.alloc<InternedString>(header.numStrings);
+    for (uint32_t i = 0; i < header.numStrings; i++)
+        new(internedStrings + i) InternedString(bytes + strings[i].offset, strings[i].length, strings[i].hash);
+    module.strings.set(internedStrings, header.numStrings);
+
+    CacheError *cacheErrors = (CacheError *) (data + layout.errors);
+    for (uint32_t i = 0; i < header.numErrors; i++)
+        errors.add(toSpan(source, cacheErrors[i].span), "%s", (const char *) data + layout.bytes + cacheErrors[i].message);
+
+    mem.freeObject(file, QAK_SRC_LOC);
+    return true;
+}
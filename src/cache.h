@@ -0,0 +1,40 @@
+#ifndef QAK_CACHE_H
+#define QAK_CACHE_H
+
+#include "parser.h"
+
+/* Version of the compiler. Cache entries written by other versions are ignored. Increment
+ * whenever the tokens, AST or errors produced for a source change. */
+#define QAK_COMPILER_VERSION 3
+
+namespace qak {
+    /* A cache entry stores the tokens, flat AST and errors of a compiled source in a single file.
+     * The entry does not contain pointers, the nodes and lists reference each other by index and
+     * spans are byte offsets into the source. Reading an entry copies the nodes and lists as is,
+     * without visiting them. Nodes are loaded without the source data pointers of their spans,
+     * which are set when a node is first accessed through ast::FlatModule::node().
+     *
+     * Entries are keyed by a hash of the source and the compiler version, see cache::key(). They
+     * are only valid on the platform that wrote them, as they store qak_ast_node as is. */
+    namespace cache {
+        /* Returns the hash of the source's data and QAK_COMPILER_VERSION. */
+        uint64_t key(Source &source);
+
+        /* Returns the file name of the entry for the key in the directory. The
+         * caller frees the file name through the HeapAllocator. */
+        char *entryFileName(const char *directory, uint64_t key, HeapAllocator &mem);
+
+        /* Writes the tokens, flat module and errors of the source to the file. Returns false
+         * if the file could not be written. */
+        bool write(const char *fileName, uint64_t key, Source &source, Array<Token> &tokens, ast::FlatModule &module, Errors &errors,
+                   HeapAllocator &mem);
+
+        /* Reads the entry for the source from the file into the tokens, flat module and errors. Returns
+         * false if the file does not exist, is invalid, or was written for a different key, compiler
+         * version or platform. The tokens, module and errors are left unchanged in that case. */
+        bool read(const char *fileName, uint64_t key, Source &source, Array<Token> &tokens, ast::FlatModule &module, Errors &errors,
+                  HeapAllocator &mem);
+    }
+}
+
+#endif //QAK_CACHE_H
@@ -35,10 +35,13 @@ void Errors::add(Error error) {
 void Errors::add(Span span, const char *msg...) {
     va_list args;
     va_start(args, msg);
+    va_list argsCopy;
+    va_copy(argsCopy, args);
     char scratch[1];
     int len = vsnprintf(scratch, 1, msg, args);
     char *buffer = bumpMem.alloc<char>(len + 1);
-    vsnprintf(buffer, len + 1, msg, args);
+    vsnprintf(buffer, len + 1, msg, argsCopy);
+    va_end(argsCopy);
     va_end(args);
     add({span, buffer});
 }
@@ -0,0 +1,597 @@
+#include <math.h>
+#include "evaluator.h"
+
+using namespace qak;
+
+using namespace qak::ast;
+
+using qak::bytecode::Value;
+
+/* How far the evaluation of a work item's node has progressed, see Evaluator::Work. */
+enum Step {
+    // The node is visited for the first time, its children are pushed.
+    StepEnter,
+
+    // The values of the node's children are on the value stack.
+    StepExit,
+
+    // The value of the taken branch of a ternary operation is on the value stack.
+    StepTrueValue,
+    StepFalseValue,
+
+    // The value of an expression statement is dropped.
+    StepDiscard,
+
+    // The statements of the function ended without a return statement.
+    StepFunctionEnd
+};
+
+struct LinkItem {
+    AstNode *node;
+    qak_ast_node_index flat;
+
+    LinkItem(AstNode *node, qak_ast_node_index flat) : node(node), flat(flat) {}
+};
+
+static QAK_FORCE_INLINE bool isInteger(TypeId type) {
+    return type >= TypeInt8 && type <= TypeInt64;
+}
+
+static QAK_FORCE_INLINE bool isFloat(TypeId type) {
+    return type == TypeFloat32 || type == TypeFloat64;
+}
+
+static QAK_FORCE_INLINE bool isNumeric(TypeId type) {
+    return type >= TypeInt8 && type <= TypeFloat64;
+}
+
+static QAK_FORCE_INLINE TypeId widen(TypeId a, TypeId b) {
+    return a > b ? a : b;
+}
+
+static QAK_FORCE_INLINE bool isExpression(qak_ast_type type) {
+    return type >= QakAstTernaryOperation && type <= QakAstFunctionCall;
+}
+
+/* Wraps an integer to the width of the type. */
+static QAK_FORCE_INLINE int64_t narrow(uint64_t value, TypeId type) {
+    switch (type) {
+        case TypeInt8:
+            return (int8_t) (uint8_t) value;
+        case TypeInt16:
+            return (int16_t) (uint16_t) value;
+        case TypeInt64:
+            return (int64_t) value;
+        default:
+            return (int32_t) (uint32_t) value;
+    }
+}
+
+/* Converts a value to a type it can be assigned to. Only integers converted to floats change. */
+static QAK_FORCE_INLINE Value convert(Value value, TypeId from, TypeId to) {
+    if (!isInteger(from) || !isFloat(to)) return value;
+    Value converted;
+    converted.f = to == TypeFloat32 ? (double) (float) (double) value.i : (double) value.i;
+    return converted;
+}
+
+static Value literalValue(qak_ast_literal &literal) {
+    Value value;
+    value.i = 0;
+    qak_literal_value &decoded = literal.decodedValue;
+    switch ((TokenType) literal.type) {
+        case BooleanLiteral:
+            value.i = decoded.booleanValue ? 1 : 0;
+            break;
+        case ByteLiteral:
+            value.i = decoded.byteValue;
+            break;
+        case ShortLiteral:
+            value.i = decoded.shortValue;
+            break;
+        case IntegerLiteral:
+            value.i = decoded.intValue;
+            break;
+        case LongLiteral:
+            value.i = decoded.longValue;
+            break;
+        case FloatLiteral:
+            value.f = decoded.floatValue;
+            break;
+        case DoubleLiteral:
+            value.f = decoded.doubleValue;
+            break;
+        case CharacterLiteral:
+            value.i = decoded.characterValue;
+            break;
+        case StringLiteral:
+            value.i = decoded.stringIndex;
+            break;
+        default:
+            break;
+    }
+    return value;
+}
+
+/* Applies an arithmetic operator to operands of the type. Returns false on an integer division by zero. */
+static bool arithmetic(TokenType op, TypeId type, Value left, Value right, Value &result) {
+    if (isFloat(type)) {
+        double value;
+        switch (op) {
+            case Plus:
+                value = left.f + right.f;
+                break;
+            case Minus:
+                value = left.f - right.f;
+                break;
+            case Asterisk:
+                value = left.f * right.f;
+                break;
+            case ForwardSlash:
+                value = left.f / right.f;
+                break;
+            default:
+                value = fmod(left.f, right.f);
+                break;
+        }
+        result.f = type == TypeFloat32 ? (double) (float) value : value;
+        return true;
+    }
+
+    // Dividing the smallest value by -1 overflows in C++, it wraps around to the smallest value.
+    uint64_t a = (uint64_t) left.i, b = (uint64_t) right.i;
+    switch (op) {
+        case Plus:
+            result.i = narrow(a + b, type);
+            break;
+        case Minus:
+            result.i = narrow(a - b, type);
+            break;
+        case Asterisk:
+            result.i = narrow(a * b, type);
+            break;
+        case ForwardSlash:
+            if (right.i == 0) return false;
+            result.i = narrow(right.i == -1 ? 0 - a : (uint64_t) (left.i / right.i), type);
+            break;
+        default:
+            if (right.i == 0) return false;
+            result.i = right.i == -1 ? 0 : narrow((uint64_t) (left.i % right.i), type);
+            break;
+    }
+    return true;
+}
+
+static Value compare(TokenType op, bool isFloatComparison, Value left, Value right) {
+    bool result;
+    if (isFloatComparison) {
+        switch (op) {
+            case Equal:
+                result = left.f == right.f;
+                break;
+            case NotEqual:
+                result = left.f != right.f;
+                break;
+            case Less:
+                result = left.f < right.f;
+                break;
+            case LessEqual:
+                result = left.f <= right.f;
+                break;
+            case Greater:
+                result = left.f > right.f;
+                break;
+            default:
+                result = left.f >= right.f;
+                break;
+        }
+    } else {
+        switch (op) {
+            case Equal:
+                result = left.i == right.i;
+                break;
+            case NotEqual:
+                result = left.i != right.i;
+                break;
+            case Less:
+                result = left.i < right.i;
+                break;
+            case LessEqual:
+                result = left.i <= right.i;
+                break;
+            case Greater:
+                result = left.i > right.i;
+                break;
+            default:
+                result = left.i >= right.i;
+                break;
+        }
+    }
+    Value value;
+    value.i = result ? 1 : 0;
+    return value;
+}
+
+static QAK_FORCE_INLINE Span toSpan(Source &source, qak_span &span) {
+    return Span(source, span.start, span.startLine, span.end, span.endLine);
+}
+
+template<typename T>
+static void linkList(Array<LinkItem> &stack, FlatModule &flat, FixedArray<T *> &nodes, qak_ast_node_list &list) {
+    for (size_t i = 0; i < nodes.size(); i++) stack.add(LinkItem(nodes[i], flat.listNode(list, (uint32_t) i)));
+}
+
+Evaluator::Evaluator(HeapAllocator &mem, size_t stackSize) : _mem(mem), _stackSize(stackSize), _info(mem), _work(mem), _values(mem), _slots(mem),
+                                                             _frames(mem), _resultType(TypeNothing) {
+    _result.i = 0;
+}
+
+void Evaluator::link(FlatModule &flat, Module *module, TypeTable &types) {
+    NodeInfo none;
+    _info.clear();
+    _info.setSize(flat.nodes.size(), none);
+
+    // Both trees are built by the same parse functions, so their nodes correspond one to one.
+    Array<LinkItem> stack(_mem);
+    qak_ast_module &root = flat.nodes[flat.root()].data.module;
+    linkList(stack, flat, module->functions, root.functions);
+    linkList(stack, flat, module->statements, root.statements);
+    while (stack.size() > 0) {
+        LinkItem item = stack[stack.size() - 1];
+        stack.removeAt(stack.size() - 1);
+        qak_ast_node &node = flat.nodes[item.flat];
+        NodeInfo &info = _info[item.flat];
+        switch (item.node->astType) {
+            case AstFunction: {
+                Function *function = static_cast<Function *>(item.node);
+                info.type = types.get(module->symbolTypes[function->symbol]).returnType;
+                info.slot = function->numSlots;
+                linkList(stack, flat, function->parameters, node.data.function.parameters);
+                linkList(stack, flat, function->statements, node.data.function.statements);
+                break;
+            }
+            case AstParameter:
+                info.type = module->symbolTypes[static_cast<Parameter *>(item.node)->symbol];
+                break;
+            case AstVariable: {
+                Variable *variable = static_cast<Variable *>(item.node);
+                Symbol &symbol = module->symbols[variable->symbol];
+                info.type = module->symbolTypes[variable->symbol];
+                info.slot = symbol.slot;
+                info.isGlobal = symbol.type == SymbolModuleVariable;
+                if (variable->initializerExpression) stack.add(LinkItem(variable->initializerExpression, node.data.variable.initializerExpression));
+                break;
+            }
+            case AstWhile: {
+                While *loop = static_cast<While *>(item.node);
+                stack.add(LinkItem(loop->condition, node.data.whileNode.condition));
+                linkList(stack, flat, loop->statements, node.data.whileNode.statements);
+                break;
+            }
+            case AstIf: {
+                If *ifNode = static_cast<If *>(item.node);
+                stack.add(LinkItem(ifNode->condition, node.data.ifNode.condition));
+                linkList(stack, flat, ifNode->trueBlock, node.data.ifNode.trueBlock);
+                linkList(stack, flat, ifNode->falseBlock, node.data.ifNode.falseBlock);
+                break;
+            }
+            case AstReturn: {
+                Return *returnNode = static_cast<Return *>(item.node);
+                if (returnNode->returnValue) stack.add(LinkItem(returnNode->returnValue, node.data.returnNode.returnValue));
+                break;
+            }
+            case AstTernaryOperation: {
+                TernaryOperation *ternary = static_cast<TernaryOperation *>(item.node);
+                info.type = module->expressionTypes[ternary->id];
+                stack.add(LinkItem(ternary->condition, node.data.ternaryOperation.condition));
+                stack.add(LinkItem(ternary->trueValue, node.data.ternaryOperation.trueValue));
+                stack.add(LinkItem(ternary->falseValue, node.data.ternaryOperation.falseValue));
+                break;
+            }
+            case AstBinaryOperation: {
+                BinaryOperation *operation = static_cast<BinaryOperation *>(item.node);
+                info.type = module->expressionTypes[operation->id];
+                info.slot = module->tokens[operation->op].type;
+                stack.add(LinkItem(operation->left, node.data.binaryOperation.left));
+                stack.add(LinkItem(operation->right, node.data.binaryOperation.right));
+                break;
+            }
+            case AstUnaryOperation: {
+                UnaryOperation *operation = static_cast<UnaryOperation *>(item.node);
+                info.type = module->expressionTypes[operation->id];
+                info.slot = module->tokens[operation->firstToken].type;
+                stack.add(LinkItem(operation->value, node.data.unaryOperation.value));
+                break;
+            }
+            case AstLiteral:
+                info.type = module->expressionTypes[static_cast<Literal *>(item.node)->id];
+                break;
+            case AstVariableAccess: {
+                VariableAccess *access = static_cast<VariableAccess *>(item.node);
+                Symbol &symbol = module->symbols[access->symbol];
+                info.type = module->expressionTypes[access->id];
+                info.slot = symbol.slot;
+                info.isGlobal = symbol.type == SymbolModuleVariable;
+                break;
+            }
+            case AstFunctionCall: {
+                // The slot of a call is the index of the called function, see Symbol::slot.
+                FunctionCall *call = static_cast<FunctionCall *>(item.node);
+                info.type = module->expressionTypes[call->id];
+                stack.add(LinkItem(call->variableAccess, node.data.functionCall.variableAccess));
+                linkList(stack, flat, call->arguments, node.data.functionCall.arguments);
+                if (call->variableAccess->astType == AstVariableAccess) {
+                    Symbol &symbol = module->symbols[static_cast<VariableAccess *>(call->variableAccess)->symbol];
+                    info.slot = symbol.slot;
+                    info.isNative = symbol.type == SymbolNative;
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+void Evaluator::pushBlock(FlatModule &flat, qak_ast_node_list &statements) {
+    // The first statement is pushed last, so it is evaluated first.
+    for (uint32_t i = statements.numNodes; i > 0; i--) {
+        qak_ast_node_index statement = flat.listNode(statements, i - 1);
+        if (isExpression(flat.nodes[statement].type)) _work.add(Work(statement, StepDiscard));
+        _work.add(Work(statement, StepEnter));
+    }
+}
+
+bool Evaluator::evaluate(FlatModule &flat, Module *module, TypeTable &types, Errors &errors) {
+    link(flat, module, types);
+
+    Value zero;
+    zero.i = 0;
+    _work.clear();
+    _values.clear();
+    _slots.clear();
+    _frames.clear();
+    _result = zero;
+    _resultType = TypeNothing;
+
+    // The module's frame holds the module variables, followed by the variables of its blocks.
+    Source &source = module->tokens[module->name].source;
+    qak_ast_node *nodes = flat.nodes.buffer();
+    NodeInfo *info = _info.buffer();
+    qak_ast_node_index root = flat.root();
+    if (module->numSlots > _stackSize) {
+        errors.add(toSpan(source, nodes[root].data.module.name), "Stack overflow.");
+        return false;
+    }
+    _slots.setSize(module->numSlots, zero);
+    _frames.add(Frame(root, 0, 0));
+    pushBlock(flat, nodes[root].data.module.statements);
+
+    while (_work.size() > 0) {
+        Work work = _work[_work.size() - 1];
+        _work.removeAt(_work.size() - 1);
+        qak_ast_node &node = nodes[work.node];
+        NodeInfo &nodeInfo = info[work.node];
+        Frame &frame = _frames[_frames.size() - 1];
+
+        if (work.step == StepDiscard) {
+            _values.removeAt(_values.size() - 1);
+            continue;
+        }
+
+        // A function that ends without a return statement returns the zero value of its return type.
+        bool isReturn = work.step == StepFunctionEnd;
+        Value returnValue = zero;
+        TypeId returnType = TypeNothing;
+
+        switch (node.type) {
+            case QakAstLiteral:
+                _values.add(literalValue(node.data.literal));
+                break;
+            case QakAstVariableAccess:
+                _values.add(_slots[nodeInfo.isGlobal ? nodeInfo.slot : frame.base + nodeInfo.slot]);
+                break;
+            case QakAstUnaryOperation: {
+                if (work.step == StepEnter) {
+                    _work.add(Work(work.node, StepExit));
+                    _work.add(Work(node.data.unaryOperation.value, StepEnter));
+                    break;
+                }
+                Value &value = _values[_values.size() - 1];
+                TokenType op = (TokenType) nodeInfo.slot;
+                if (op == Not) value.i ^= 1;
+                else if (op == Minus && isFloat(nodeInfo.type)) value.f = -value.f;
+                else if (op == Minus) value.i = narrow(0 - (uint64_t) value.i, nodeInfo.type);
+                break;
+            }
+            case QakAstBinaryOperation: {
+                qak_ast_binary_operation &operation = node.data.binaryOperation;
+                TokenType op = (TokenType) nodeInfo.slot;
+                if (work.step == StepEnter) {
+                    _work.add(Work(work.node, StepExit));
+                    _work.add(Work(operation.right, StepEnter));
+                    if (op != Assignment) _work.add(Work(operation.left, StepEnter));
+                    break;
+                }
+
+                if (op == Assignment) {
+                    NodeInfo &variable = info[operation.left];
+                    Value &value = _values[_values.size() - 1];
+                    value = convert(value, info[operation.right].type, variable.type);
+                    _slots[variable.isGlobal ? variable.slot : frame.base + variable.slot] = value;
+                    break;
+                }
+
+                Value right = _values[_values.size() - 1];
+                _values.removeAt(_values.size() - 1);
+                Value &left = _values[_values.size() - 1];
+                TypeId leftType = info[operation.left].type, rightType = info[operation.right].type;
+                switch (op) {
+                    case Plus:
+                    case Minus:
+                    case Asterisk:
+                    case ForwardSlash:
+                    case Percentage:
+                        if (!arithmetic(op, nodeInfo.type, convert(left, leftType, nodeInfo.type), convert(right, rightType, nodeInfo.type), left)) {
+                            errors.add(toSpan(source, operation.op), "Division by zero.");
+                            return false;
+                        }
+                        break;
+                    case And:
+                        left.i &= right.i;
+                        break;
+                    case Or:
+                        left.i |= right.i;
+                        break;
+                    case Xor:
+                        left.i ^= right.i;
+                        break;
+                    default: {
+                        // Comparisons of numbers widen the operands, other values are compared as is.
+                        TypeId operandType = isNumeric(leftType) && isNumeric(rightType) ? widen(leftType, rightType) : leftType;
+                        left = compare(op, isFloat(operandType), convert(left, leftType, operandType), convert(right, rightType, operandType));
+                        break;
+                    }
+                }
+                break;
+            }
+            case QakAstTernaryOperation: {
+                qak_ast_ternary_operation &ternary = node.data.ternaryOperation;
+                if (work.step == StepEnter) {
+                    _work.add(Work(work.node, StepExit));
+                    _work.add(Work(ternary.condition, StepEnter));
+                } else if (work.step == StepExit) {
+                    bool condition = _values[_values.size() - 1].i != 0;
+                    _values.removeAt(_values.size() - 1);
+                    _work.add(Work(work.node, condition ? StepTrueValue : StepFalseValue));
+                    _work.add(Work(condition ? ternary.trueValue : ternary.falseValue, StepEnter));
+                } else {
+                    TypeId valueType = info[work.step == StepTrueValue ? ternary.trueValue : ternary.falseValue].type;
+                    Value &value = _values[_values.size() - 1];
+                    value = convert(value, valueType, nodeInfo.type);
+                }
+                break;
+            }
+            case QakAstFunctionCall: {
+                qak_ast_function_call &call = node.data.functionCall;
+                if (work.step == StepEnter) {
+                    _work.add(Work(work.node, StepExit));
+                    for (uint32_t i = call.arguments.numNodes; i > 0; i--) _work.add(Work(flat.listNode(call.arguments, i - 1), StepEnter));
+                    break;
+                }
+
+                // Natives are called with the arguments on the value stack, their result replaces the arguments.
+                if (nodeInfo.isNative) {
+                    Native &native = module->natives->get(nodeInfo.slot);
+                    Type &nativeType = types.get(native.type);
+                    size_t arguments = _values.size() - call.arguments.numNodes;
+                    for (uint32_t i = 0; i < call.arguments.numNodes; i++) {
+                        _values[arguments + i] = convert(_values[arguments + i], info[flat.listNode(call.arguments, i)].type,
+                                                         types.parameter(nativeType, i));
+                    }
+                    Value result = native.function(_values.buffer() + arguments, native.userData);
+                    _values.setSize(arguments, zero);
+                    _values.add(result);
+                    break;
+                }
+
+                // The arguments on the value stack become the first slots of the called function's frame.
+                qak_ast_node_index functionIndex = flat.listNode(nodes[root].data.module.functions, nodeInfo.slot);
+                qak_ast_function &function = nodes[functionIndex].data.function;
+                size_t base = _slots.size(), numSlots = info[functionIndex].slot;
+                if (base + numSlots > _stackSize || _frames.size() >= _stackSize) {
+                    errors.add(toSpan(source, nodes[call.variableAccess].span), "Stack overflow.");
+                    return false;
+                }
+                _slots.setSize(base + numSlots, zero);
+                size_t arguments = _values.size() - call.arguments.numNodes;
+                for (uint32_t i = 0; i < call.arguments.numNodes; i++) {
+                    TypeId parameterType = info[flat.listNode(function.parameters, i)].type;
+                    _slots[base + i] = convert(_values[arguments + i], info[flat.listNode(call.arguments, i)].type, parameterType);
+                }
+                _values.setSize(arguments, zero);
+                _frames.add(Frame(functionIndex, base, _work.size()));
+                _work.add(Work(functionIndex, StepFunctionEnd));
+                pushBlock(flat, function.statements);
+                break;
+            }
+            case QakAstVariable: {
+                qak_ast_variable &variable = node.data.variable;
+                if (work.step == StepEnter && variable.initializerExpression >= 0) {
+                    _work.add(Work(work.node, StepExit));
+                    _work.add(Work(variable.initializerExpression, StepEnter));
+                    break;
+                }
+
+                // Variables without an initializer are zeroed, also on each iteration of a loop declaring them.
+                Value value = zero;
+                if (variable.initializerExpression >= 0) {
+                    value = convert(_values[_values.size() - 1], info[variable.initializerExpression].type, nodeInfo.type);
+                    _values.removeAt(_values.size() - 1);
+                }
+                _slots[nodeInfo.isGlobal ? nodeInfo.slot : frame.base + nodeInfo.slot] = value;
+                break;
+            }
+            case QakAstWhile: {
+                qak_ast_while &loop = node.data.whileNode;
+                if (work.step == StepEnter) {
+                    _work.add(Work(work.node, StepExit));
+                    _work.add(Work(loop.condition, StepEnter));
+                    break;
+                }
+                bool condition = _values[_values.size() - 1].i != 0;
+                _values.removeAt(_values.size() - 1);
+                if (condition) {
+                    _work.add(Work(work.node, StepEnter));
+                    pushBlock(flat, loop.statements);
+                }
+                break;
+            }
+            case QakAstIf: {
+                qak_ast_if &ifNode = node.data.ifNode;
+                if (work.step == StepEnter) {
+                    _work.add(Work(work.node, StepExit));
+                    _work.add(Work(ifNode.condition, StepEnter));
+                    break;
+                }
+                bool condition = _values[_values.size() - 1].i != 0;
+                _values.removeAt(_values.size() - 1);
+                pushBlock(flat, condition ? ifNode.trueBlock : ifNode.falseBlock);
+                break;
+            }
+            case QakAstReturn: {
+                qak_ast_node_index returnValueNode = node.data.returnNode.returnValue;
+                if (work.step == StepEnter && returnValueNode >= 0) {
+                    _work.add(Work(work.node, StepExit));
+                    _work.add(Work(returnValueNode, StepEnter));
+                    break;
+                }
+                isReturn = true;
+                if (returnValueNode >= 0) {
+                    returnValue = _values[_values.size() - 1];
+                    returnType = info[returnValueNode].type;
+                    _values.removeAt(_values.size() - 1);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+
+        if (!isReturn) continue;
+
+        // The module's statements can return values of any type.
+        if (_frames.size() == 1) {
+            _result = returnValue;
+            _resultType = returnType;
+            return true;
+        }
+
+        // The value is converted to the function's return type and replaces the arguments of the call.
+        _values.add(convert(returnValue, returnType, info[frame.function].type));
+        _work.setSize(frame.workDepth, Work(-1, StepEnter));
+        _slots.setSize(frame.base, zero);
+        _frames.removeAt(_frames.size() - 1);
+    }
+    return true;
+}
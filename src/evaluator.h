@@ -0,0 +1,90 @@
+#ifndef QAK_EVALUATOR_H
+#define QAK_EVALUATOR_H
+
+#include "interpreter.h"
+
+namespace qak {
+    /* Evaluates a module by walking the nodes of its ast::FlatModule. Nodes are visited through
+     * an explicit stack of work items instead of recursion, so deeply nested expressions and
+     * deep call chains do not overflow the C stack. Values are bytecode::Values and follow the
+     * semantics of the Interpreter, so the evaluator serves as the reference engine that faster
+     * backends are tested against.
+     *
+     * The flat nodes carry no symbols or types. Before evaluating, the evaluator walks the flat
+     * module and the resolved and type checked ast::Module tree of the same source side by side,
+     * and stores the type, slot and operator of each flat node in a table indexed like the nodes.
+     * Variables are then accessed by their slot, see ast::Symbol::slot, without name lookups. */
+    class Evaluator {
+    private:
+        /* The type of a node's value, the slot of variables, parameters and functions or the
+         * operator of operations, see link(). Calls of natives store the native's index. */
+        struct NodeInfo {
+            TypeId type;
+            uint32_t slot;
+            bool isGlobal;
+            bool isNative;
+
+            NodeInfo() : type(TypeNothing), slot(0), isGlobal(false), isNative(false) {}
+        };
+
+        /* A node to visit. step tells how far the node's evaluation has progressed. */
+        struct Work {
+            qak_ast_node_index node;
+            uint32_t step;
+
+            Work(qak_ast_node_index node, uint32_t step) : node(node), step(step) {}
+        };
+
+        /* A called function. Its slots start at base, its statements' work items above workDepth. */
+        struct Frame {
+            qak_ast_node_index function;
+            size_t base;
+            size_t workDepth;
+
+            Frame(qak_ast_node_index function, size_t base, size_t workDepth) : function(function), base(base), workDepth(workDepth) {}
+        };
+
+        HeapAllocator &_mem;
+        size_t _stackSize;
+        Array<NodeInfo> _info;
+        Array<Work> _work;
+        Array<bytecode::Value> _values;
+        Array<bytecode::Value> _slots;
+        Array<Frame> _frames;
+        bytecode::Value _result;
+        TypeId _resultType;
+
+        Evaluator(const Evaluator &other) = delete;
+
+        void link(ast::FlatModule &flat, ast::Module *module, TypeTable &types);
+
+        void pushBlock(ast::FlatModule &flat, qak_ast_node_list &statements);
+
+    public:
+        /* The stack size limits the number of slots and frames of active functions. */
+        Evaluator(HeapAllocator &mem, size_t stackSize = QAK_DEFAULT_STACK_SIZE);
+
+        /* Evaluates the statements of the flat module, after setting all module variables to zero.
+         * The module must be the tree of the same source, resolved and type checked without errors
+         * with the types, but not folded, see ConstantFolder. Errors while evaluating are reported like
+         * Interpreter::run() does. Returns false if there was an error. */
+        bool evaluate(ast::FlatModule &flat, ast::Module *module, TypeTable &types, Errors &errors);
+
+        /* Returns the value of the module variable with the slot, see ast::Symbol::slot. */
+        QAK_FORCE_INLINE bytecode::Value global(uint32_t slot) {
+            return _slots[slot];
+        }
+
+        /* Returns the value returned by the module's statements and its type, which is TypeNothing if
+         * they returned no value. */
+        QAK_FORCE_INLINE bytecode::Value result() {
+            return _result;
+        }
+
+        QAK_FORCE_INLINE TypeId resultType() {
+            return _resultType;
+        }
+    };
+}
+
+#endif //QAK_EVALUATOR_H
@@ -0,0 +1,472 @@
+#include <math.h>
+#include "folder.h"
+#include "visitor.h"
+
+using namespace qak;
+
+using namespace qak::ast;
+
+static QAK_FORCE_INLINE bool isInteger(TypeId type) {
+    return type >= TypeInt8 && type <= TypeInt64;
+}
+
+static QAK_FORCE_INLINE bool isFloat(TypeId type) {
+    return type == TypeFloat32 || type == TypeFloat64;
+}
+
+/* Returns whether values of the type can be folded. Strings and characters are not folded. */
+static QAK_FORCE_INLINE bool isFoldable(TypeId type) {
+    return type >= TypeBoolean && type <= TypeFloat64;
+}
+
+/* Returns the numeric type operands are widened to. Numeric types are ordered from narrowest to widest. */
+static QAK_FORCE_INLINE TypeId widen(TypeId a, TypeId b) {
+    return a > b ? a : b;
+}
+
+static TokenType literalType(TypeId type) {
+    switch (type) {
+        case TypeBoolean:
+            return BooleanLiteral;
+        case TypeInt8:
+            return ByteLiteral;
+        case TypeInt16:
+            return ShortLiteral;
+        case TypeInt32:
+            return IntegerLiteral;
+        case TypeInt64:
+            return LongLiteral;
+        case TypeFloat32:
+            return FloatLiteral;
+        case TypeFloat64:
+            return DoubleLiteral;
+        default:
+            return NothingLiteral;
+    }
+}
+
+static int64_t integerValue(Literal *literal) {
+    switch (literal->type) {
+        case ByteLiteral:
+            return literal->decodedValue.byteValue;
+        case ShortLiteral:
+            return literal->decodedValue.shortValue;
+        case IntegerLiteral:
+            return literal->decodedValue.intValue;
+        case LongLiteral:
+            return literal->decodedValue.longValue;
+        default:
+            return 0;
+    }
+}
+
+/* Returns the value of a numeric literal converted to the float type. */
+static double floatValue(Literal *literal, TypeId type) {
+    double value;
+    if (literal->type == FloatLiteral) value = literal->decodedValue.floatValue;
+    else if (literal->type == DoubleLiteral) value = literal->decodedValue.doubleValue;
+    else value = (double) integerValue(literal);
+    return type == TypeFloat32 ? (double) (float) value : value;
+}
+
+/* Truncates the value to the integer type, wrapping around on overflow. */
+static LiteralValue integerResult(TypeId type, uint64_t value) {
+    LiteralValue result;
+    result.longValue = 0;
+    switch (type) {
+        case TypeInt8:
+            result.byteValue = (int8_t) (uint8_t) value;
+            break;
+        case TypeInt16:
+            result.shortValue = (int16_t) (uint16_t) value;
+            break;
+        case TypeInt32:
+            result.intValue = (int32_t) (uint32_t) value;
+            break;
+        default:
+            result.longValue = (int64_t) value;
+            break;
+    }
+    return result;
+}
+
+/* Rounds the value to the float type. Computing float32 arithmetic in double precision and rounding
+ * the result gives the same result as computing it in single precision. */
+static LiteralValue floatResult(TypeId type, double value) {
+    LiteralValue result;
+    result.longValue = 0;
+    if (type == TypeFloat32) result.floatValue = (float) value;
+    else result.doubleValue = value;
+    return result;
+}
+
+/* Converts the value of a foldable literal to the type, which is the literal's type or wider. */
+static LiteralValue convert(Literal *literal, TypeId type) {
+    if (isInteger(type)) return integerResult(type, (uint64_t) integerValue(literal));
+    if (isFloat(type)) return floatResult(type, floatValue(literal, type));
+    return literal->decodedValue;
+}
+
+static bool foldInteger(TokenType op, TypeId type, int64_t a, int64_t b, LiteralValue &result) {
+    uint64_t value;
+    switch (op) {
+        case Plus:
+            value = (uint64_t) a + (uint64_t) b;
+            break;
+        case Minus:
+            value = (uint64_t) a - (uint64_t) b;
+            break;
+        case Asterisk:
+            value = (uint64_t) a * (uint64_t) b;
+            break;
+        case ForwardSlash:
+            if (b == 0) return false;
+            // Dividing the smallest value by -1 overflows in C++, it wraps around to the smallest value.
+            value = b == -1 ? 0 - (uint64_t) a : (uint64_t) (a / b);
+            break;
+        case Percentage:
+            if (b == 0) return false;
+            value = b == -1 ? 0 : (uint64_t) (a % b);
+            break;
+        case And:
+            value = (uint64_t) (a & b);
+            break;
+        case Or:
+            value = (uint64_t) (a | b);
+            break;
+        case Xor:
+            value = (uint64_t) (a ^ b);
+            break;
+        default:
+            return false;
+    }
+    result = integerResult(type, value);
+    return true;
+}
+
+static bool foldFloat(TokenType op, TypeId type, double a, double b, LiteralValue &result) {
+    double value;
+    switch (op) {
+        case Plus:
+            value = a + b;
+            break;
+        case Minus:
+            value = a - b;
+            break;
+        case Asterisk:
+            value = a * b;
+            break;
+        case ForwardSlash:
+            value = a / b;
+            break;
+        case Percentage:
+            value = fmod(a, b);
+            break;
+        default:
+            return false;
+    }
+    result = floatResult(type, value);
+    return true;
+}
+
+template<typename T>
+static bool compare(TokenType op, T a, T b, LiteralValue &result) {
+    switch (op) {
+        case Less:
+            result.booleanValue = a < b;
+            return true;
+        case LessEqual:
+            result.booleanValue = a <= b;
+            return true;
+        case Greater:
+            result.booleanValue = a > b;
+            return true;
+        case GreaterEqual:
+            result.booleanValue = a >= b;
+            return true;
+        case Equal:
+            result.booleanValue = a == b;
+            return true;
+        case NotEqual:
+            result.booleanValue = a != b;
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Folds comparisons and boolean operators. The operands are compared in the type they are widened to. */
+static bool foldBoolean(TokenType op, TypeId operandType, Literal *left, Literal *right, LiteralValue &result) {
+    result.longValue = 0;
+    if (isInteger(operandType)) return compare(op, integerValue(left), integerValue(right), result);
+    if (isFloat(operandType)) return compare(op, floatValue(left, operandType), floatValue(right, operandType), result);
+
+    bool a = left->decodedValue.booleanValue, b = right->decodedValue.booleanValue;
+    switch (op) {
+        case And:
+            result.booleanValue = a && b;
+            return true;
+        case Or:
+            result.booleanValue = a || b;
+            return true;
+        case Xor:
+            result.booleanValue = a != b;
+            return true;
+        default:
+            return compare(op, a, b, result);
+    }
+}
+
+static QAK_FORCE_INLINE Literal *constant(Expression *expression) {
+    return expression->astType == AstLiteral ? static_cast<Literal *>(expression) : nullptr;
+}
+
+static QAK_FORCE_INLINE Literal *constantCondition(Expression *condition) {
+    Literal *literal = constant(condition);
+    return literal && literal->type == BooleanLiteral ? literal : nullptr;
+}
+
+static bool declaresVariables(FixedArray<Statement *> &statements) {
+    for (size_t i = 0; i < statements.size(); i++) {
+        if (statements[i]->astType == AstVariable) return true;
+    }
+    return false;
+}
+
+/* Returns whether the statement is removed from its block or replaced by the statements of one of its blocks. */
+static bool isPruned(Statement *statement) {
+    if (statement->astType == AstWhile) {
+        Literal *condition = constantCondition(static_cast<While *>(statement)->condition);
+        return condition && !condition->decodedValue.booleanValue;
+    }
+    if (statement->astType == AstIf) {
+        If *node = static_cast<If *>(statement);
+        Literal *condition = constantCondition(node->condition);
+        return condition && !declaresVariables(condition->decodedValue.booleanValue ? node->trueBlock : node->falseBlock);
+    }
+    return false;
+}
+
+/* Marks the variables that are the target of an assignment, see ConstantFolder::fold(). */
+struct AssignmentCollector : public Walker<AssignmentCollector> {
+    Module *module;
+    Array<bool> &isAssigned;
+
+    AssignmentCollector(HeapAllocator &mem, Module *module, Array<bool> &isAssigned) : Walker<AssignmentCollector>(mem), module(module), isAssigned(isAssigned) {}
+
+    bool visitBinaryOperation(BinaryOperation *node) {
+        if (module->tokens[node->op].type == Assignment && node->left->astType == AstVariableAccess) {
+            int32_t symbol = static_cast<VariableAccess *>(node->left)->symbol;
+            if (symbol >= 0) isAssigned[symbol] = true;
+        }
+        return true;
+    }
+};
+
+/* Folds the expressions of statements, see ConstantFolder::fold(). Visiting an expression returns
+ * the expression that replaces it, which may be the expression itself. Statements are folded in
+ * place and return nullptr. */
+struct ConstantFolder::NodeFolder : public Visitor<NodeFolder, Expression *> {
+    ConstantFolder &folder;
+    Module *module;
+
+    NodeFolder(ConstantFolder &folder) : folder(folder), module(folder._module) {}
+
+    QAK_FORCE_INLINE TypeId typeOf(Expression *expression) {
+        return module->expressionTypes[expression->id];
+    }
+
+    /* Returns a literal with the value and type that replaces the expression. */
+    Literal *replace(Expression *expression, TypeId type, LiteralValue value) {
+        Literal *literal = module->mem.allocObject<Literal>(literalType(type), expression->firstToken, value);
+        literal->lastToken = expression->lastToken;
+        literal->id = expression->id;
+        return literal;
+    }
+
+    Expression *visitNode(AstNode *) {
+        return nullptr;
+    }
+
+    Expression *visitError(ErrorNode *node) {
+        return node;
+    }
+
+    Expression *visitLiteral(Literal *node) {
+        return node;
+    }
+
+    Expression *visitVariableAccess(VariableAccess *node) {
+        if (node->symbol < 0) return node;
+        Literal *value = folder._constants[node->symbol];
+        if (!value || (folder._isInFunction && module->symbols[node->symbol].type == SymbolModuleVariable)) return node;
+        return replace(node, typeOf(node), convert(value, typeOf(node)));
+    }
+
+    Expression *visitUnaryOperation(UnaryOperation *node) {
+        node->value = visit(node->value);
+        Literal *value = constant(node->value);
+        TypeId type = typeOf(node);
+        if (!value || !isFoldable(type)) return node;
+
+        LiteralValue result = value->decodedValue;
+        switch (module->tokens[node->firstToken].type) {
+            case Not:
+                result.booleanValue = !value->decodedValue.booleanValue;
+                break;
+            case Minus:
+                if (isInteger(type)) result = integerResult(type, 0 - (uint64_t) integerValue(value));
+                else result = floatResult(type, -floatValue(value, type));
+                break;
+            default:
+                break;
+        }
+        return replace(node, type, result);
+    }
+
+    /* Chains like a + b + c nest their left operands as deep as they are long, so the operations
+     * along the left operands are folded in a loop, innermost first. */
+    Expression *visitBinaryOperation(BinaryOperation *node) {
+        // The target of an assignment is not a value, only the assigned value is folded.
+        Array<BinaryOperation *> &operations = folder._operations;
+        size_t base = operations.size();
+        BinaryOperation *operation = node;
+        while (module->tokens[operation->op].type != Assignment && operation->left->astType == AstBinaryOperation) {
+            operations.add(operation);
+            operation = static_cast<BinaryOperation *>(operation->left);
+        }
+        if (module->tokens[operation->op].type != Assignment) operation->left = visit(operation->left);
+        Expression *result = foldOperation(operation);
+        while (operations.size() > base) {
+            operation = operations[operations.size() - 1];
+            operations.removeAt(operations.size() - 1);
+            operation->left = result;
+            result = foldOperation(operation);
+        }
+        return result;
+    }
+
+    /* Folds the right operand of the operation, then the operation itself if both of its operands are
+     * constant. The left operand is already folded. */
+    Expression *foldOperation(BinaryOperation *node) {
+        TokenType op = module->tokens[node->op].type;
+        node->right = visit(node->right);
+        Literal *left = constant(node->left), *right = constant(node->right);
+        TypeId type = typeOf(node);
+        if (op == Assignment || !left || !right || !isFoldable(type)) return node;
+        TypeId leftType = typeOf(left), rightType = typeOf(right);
+        if (!isFoldable(leftType) || !isFoldable(rightType)) return node;
+
+        LiteralValue result;
+        bool isFolded;
+        if (type == TypeBoolean) isFolded = foldBoolean(op, widen(leftType, rightType), left, right, result);
+        else if (isInteger(type)) isFolded = foldInteger(op, type, integerValue(left), integerValue(right), result);
+        else isFolded = foldFloat(op, type, floatValue(left, type), floatValue(right, type), result);
+        if (!isFolded) return node;
+        return replace(node, type, result);
+    }
+
+    Expression *visitTernaryOperation(TernaryOperation *node) {
+        node->condition = visit(node->condition);
+        node->trueValue = visit(node->trueValue);
+        node->falseValue = visit(node->falseValue);
+        Literal *condition = constantCondition(node->condition);
+        TypeId type = typeOf(node);
+        if (!condition || type == TypeError) return node;
+
+        // The chosen value replaces the operation if it has the operation's type, literals are widened to it.
+        Expression *value = condition->decodedValue.booleanValue ? node->trueValue : node->falseValue;
+        if (typeOf(value) == type) return value;
+        Literal *literal = constant(value);
+        if (!literal || !isFoldable(type) || !isFoldable(typeOf(literal))) return node;
+        return replace(node, type, convert(literal, type));
+    }
+
+    Expression *visitFunctionCall(FunctionCall *node) {
+        for (size_t i = 0; i < node->arguments.size(); i++) node->arguments[i] = visit(node->arguments[i]);
+        return node;
+    }
+
+    Expression *visitVariable(Variable *node) {
+        if (node->initializerExpression) node->initializerExpression = visit(node->initializerExpression);
+        if (node->symbol < 0 || folder._isAssigned[node->symbol] || !isFoldable(module->symbolTypes[node->symbol])) return nullptr;
+
+        // Variables without an initializer have the default value of their type, which is zero or false.
+        if (!node->initializerExpression) {
+            LiteralValue zero;
+            zero.longValue = 0;
+            folder._constants[node->symbol] = module->mem.allocObject<Literal>(literalType(module->symbolTypes[node->symbol]), node->name, zero);
+            return nullptr;
+        }
+        Literal *value = constant(node->initializerExpression);
+        if (value && isFoldable(typeOf(value))) folder._constants[node->symbol] = value;
+        return nullptr;
+    }
+
+    Expression *visitWhile(While *node) {
+        node->condition = visit(node->condition);
+        folder.foldBlock(node->statements);
+        return nullptr;
+    }
+
+    Expression *visitIf(If *node) {
+        // The block that is not run is removed without being folded.
+        node->condition = visit(node->condition);
+        Literal *condition = constantCondition(node->condition);
+        if (!condition || condition->decodedValue.booleanValue) folder.foldBlock(node->trueBlock);
+        else node->trueBlock.set(nullptr, 0);
+        if (!condition || !condition->decodedValue.booleanValue) folder.foldBlock(node->falseBlock);
+        else node->falseBlock.set(nullptr, 0);
+        return nullptr;
+    }
+
+    Expression *visitReturn(Return *node) {
+        if (node->returnValue) node->returnValue = visit(node->returnValue);
+        return nullptr;
+    }
+};
+
+void ConstantFolder::foldBlock(FixedArray<Statement *> &statements) {
+    NodeFolder folder(*this);
+    size_t numPruned = 0;
+    for (size_t i = 0; i < statements.size(); i++) {
+        Expression *folded = folder.visit(statements[i]);
+        if (folded) statements[i] = folded;
+        if (isPruned(statements[i])) numPruned++;
+    }
+    if (numPruned == 0) return;
+
+    // Pruned while statements are removed, pruned if statements are replaced by the statements of the block that is run.
+    FixedArrayBuilder<Statement *> block(_module->mem);
+    for (size_t i = 0; i < statements.size(); i++) {
+        Statement *statement = statements[i];
+        if (!isPruned(statement)) {
+            block.add(statement);
+        } else if (statement->astType == AstIf) {
+            If *node = static_cast<If *>(statement);
+            FixedArray<Statement *> &run = node->trueBlock.size() > 0 ? node->trueBlock : node->falseBlock;
+            for (size_t j = 0; j < run.size(); j++) block.add(run[j]);
+        }
+    }
+    statements.set(block.values(), block.size());
+}
+
+void ConstantFolder::fold(Module *module) {
+    _module = module;
+    _isAssigned.clear();
+    _isAssigned.setSize(module->symbols.size(), false);
+    _constants.clear();
+    _constants.setSize(module->symbols.size(), nullptr);
+
+    // Assignments may follow the accesses of a variable, e.g. in a loop, so all of them are known before folding.
+    AssignmentCollector collector(_mem, module, _isAssigned);
+    collector.walk(module);
+
+    _isInFunction = false;
+    foldBlock(module->statements);
+    _isInFunction = true;
+    FixedArray<Function *> &functions = module->functions;
+    for (size_t i = 0; i < functions.size(); i++) foldBlock(functions[i]->statements);
+    _isInFunction = false;
+    _module = nullptr;
+}
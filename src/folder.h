@@ -0,0 +1,52 @@
+#ifndef QAK_FOLDER_H
+#define QAK_FOLDER_H
+
+#include "typechecker.h"
+
+namespace qak {
+    /* Folds the constant expressions of a type checked module, see TypeChecker::check(). Unary,
+     * binary and ternary operations on boolean and numeric literals are replaced by a literal of
+     * the operation's type. Integer arithmetic wraps around like two's complement arithmetic of the
+     * operation's type, e.g. 127b + 1b is -128b. Integer division and remainder by zero are not
+     * folded, so they fail when the module is run. Float arithmetic follows IEEE 754 at the
+     * precision of the operation's type.
+     *
+     * Variables that are never assigned and initialized with a constant, or not initialized and thus
+     * zero, are propagated to their accesses. Module variables are only propagated to module
+     * statements, as functions may be called before a module variable is initialized.
+     *
+     * While statements with a false condition are removed. If statements with a constant condition
+     * are replaced by the statements of the block that is run, unless the block declares variables.
+     * Then only the other block is removed. Expressions whose type could not be checked are kept. */
+    class ConstantFolder {
+    private:
+        struct NodeFolder;
+
+        HeapAllocator &_mem;
+
+        /* Whether each symbol is the target of an assignment, by the symbol's index. */
+        Array<bool> _isAssigned;
+
+        /* The constant initializer of each symbol that is never assigned, or nullptr, by the symbol's index. */
+        Array<ast::Literal *> _constants;
+
+        /* The binary operations along the left operands of the chains being folded, see NodeFolder::visitBinaryOperation(). */
+        Array<ast::BinaryOperation *> _operations;
+
+        // Set on each call to fold.
+        ast::Module *_module;
+        bool _isInFunction;
+
+        void foldBlock(FixedArray<ast::Statement *> &statements);
+
+    public:
+        ConstantFolder(HeapAllocator &mem) : _mem(mem), _isAssigned(mem), _constants(mem), _operations(mem), _module(nullptr), _isInFunction(false) {}
+
+        /* Folds the module in place. Folded and propagated literals are allocated in the module's
+         * memory and keep the Expression::id of the expression they replace. Their tokens are those
+         * of the replaced expression, see parser::printAstNode(). */
+        void fold(ast::Module *module);
+    };
+}
+
+#endif //QAK_FOLDER_H
@@ -0,0 +1,459 @@
+#include "gc.h"
+#include "io.h"
+
+#ifndef WASM
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#endif
+
+using namespace qak;
+using namespace qak::gc;
+
+#define QAK_GC_HEADER_SIZE ((uint32_t) sizeof(Header))
+
+/* Calls f(slot) for each slot of the object holding a reference. */
+template<typename F>
+static QAK_FORCE_INLINE void forEachReference(Array<Type *> &types, Header *header, F &f) {
+    uint8_t *payload = header->payload();
+    if (header->type == TypeReferences) {
+        void **slots = (void **) payload;
+        for (uint32_t i = 0, n = header->size / 8; i < n; i++) f(slots + i);
+        return;
+    }
+    Array<uint32_t> &references = types[header->type]->references;
+    for (size_t i = 0; i < references.size(); i++) f((void **) (payload + references[i]));
+}
+
+/* Replaces references to nursery objects with references to their promoted copies. */
+struct GcHeap::Evacuate {
+    GcHeap &heap;
+    Pause &pause;
+
+    Evacuate(GcHeap &heap, Pause &pause) : heap(heap), pause(pause) {}
+
+    QAK_FORCE_INLINE void operator()(void **slot) {
+        *slot = heap.evacuate(*slot, pause);
+    }
+};
+
+/* Marks the unmarked objects referenced by an object and pushes them on the stack of gray objects. */
+struct Mark {
+    Array<Header *> &gray;
+
+    Mark(Array<Header *> &gray) : gray(gray) {}
+
+    QAK_FORCE_INLINE void operator()(void **slot) {
+        void *object = *slot;
+        if (!object) return;
+        Header *header = Header::of(object);
+        if (header->mark.load(std::memory_order_relaxed)) return;
+        if (header->mark.exchange(1, std::memory_order_relaxed)) return;
+        gray.add(header);
+    }
+};
+
+GcHeap::GcHeap(HeapAllocator &mem, size_t nurserySize) : _mem(mem), _types(mem), _roots(mem), _chunks(mem), _largeObjects(mem),
+                                                         _remembered(mem), _gray(mem), _numMarkThreads(1), _runWorkers(nullptr),
+                                                         _runWorkersUserData(nullptr), _oldBytes(0), _majorThreshold(QAK_GC_MIN_OLD_SIZE),
+                                                         _allocatedBytes(0), _pauses(mem) {
+    _nursery = mem.allocObject<Block>(QAK_SRC_LOC, (nurserySize + 7) & ~(size_t) 7);
+    memset(_freeLists, 0, sizeof(_freeLists));
+    _types.add(mem.allocObject<Type>(QAK_SRC_LOC, mem, "free", 0));
+    _types.add(mem.allocObject<Type>(QAK_SRC_LOC, mem, "bytes", 0));
+    _types.add(mem.allocObject<Type>(QAK_SRC_LOC, mem, "references", 0));
+}
+
+GcHeap::~GcHeap() {
+    _mem.freeObject(_nursery, QAK_SRC_LOC);
+    _chunks.freeObjects();
+    _largeObjects.freeObjects();
+    _types.freeObjects();
+}
+
+uint32_t GcHeap::addType(const char *name, uint32_t size, const uint32_t *references, uint32_t numReferences) {
+    Type *type = _mem.allocObject<Type>(QAK_SRC_LOC, _mem, name, size);
+    type->references.addAll(references, numReferences);
+    _types.add(type);
+    return (uint32_t) _types.size() - 1;
+}
+
+void *GcHeap::alloc(uint32_t type, uint32_t size) {
+    if (type >= NumBuiltinTypes) size = _types[type]->size;
+    size = (size + 7) & ~7u;
+    if (size < 8) size = 8;
+    uint32_t total = size + QAK_GC_HEADER_SIZE;
+
+    uint8_t *cell;
+    if (total <= QAK_GC_MAX_SMALL_SIZE) {
+        if (!_nursery->canStore(total)) collect(false);
+        cell = _nursery->alloc(total);
+    } else {
+        if (_oldBytes + total > _majorThreshold) collect(true);
+        cell = allocOld(total);
+    }
+    memset(cell, 0, total);
+    new(cell) Header(size, (uint16_t) type);
+    _allocatedBytes += total;
+    return cell + QAK_GC_HEADER_SIZE;
+}
+
+/* Returns a cell of the old generation of the given size, header included. Small cells are taken
+ * from their free list, or bump allocated in the last chunk. */
+uint8_t *GcHeap::allocOld(uint32_t size) {
+    _oldBytes += size;
+    if (size <= QAK_GC_MAX_SMALL_SIZE) {
+        Header *&freeList = _freeLists[size / 8];
+        if (freeList) {
+            Header *cell = freeList;
+            freeList = *(Header **) cell->payload();
+            return (uint8_t *) cell;
+        }
+        if (_chunks.size() == 0 || !_chunks[_chunks.size() - 1]->canStore(size))
+            _chunks.add(_mem.allocObject<Block>(QAK_SRC_LOC, QAK_GC_CHUNK_SIZE));
+        return _chunks[_chunks.size() - 1]->alloc(size);
+    }
+
+    Block *block = _mem.allocObject<Block>(QAK_SRC_LOC, size);
+    _largeObjects.add(block);
+    return block->alloc(size);
+}
+
+void GcHeap::remember(void *object) {
+    Header *header = Header::of(object);
+    if (header->flags & FlagRemembered) return;
+    header->flags |= FlagRemembered;
+    _remembered.add(header);
+}
+
+void GcHeap::addRoots(void **slots, size_t count) {
+    _roots.add(Roots(slots, count));
+}
+
+void GcHeap::removeRoots(void **slots) {
+    for (size_t i = _roots.size(); i > 0; i--) {
+        if (_roots[i - 1].slots != slots) continue;
+        _roots.removeAt(i - 1);
+        return;
+    }
+}
+
+/* Promotes the nursery object to the old generation, unless it was already. The first word of the
+ * nursery object is overwritten with the address of the copy, which is scanned later. */
+void *GcHeap::evacuate(void *object, Pause &pause) {
+    if (!object || !isYoung(object)) return object;
+    Header *header = Header::of(object);
+    if (header->flags & FlagForwarded) return *(void **) object;
+
+    uint32_t total = header->size + QAK_GC_HEADER_SIZE;
+    uint8_t *cell = allocOld(total);
+    Header *copy = new(cell) Header(header->size, header->type);
+    memcpy(copy->payload(), object, header->size);
+    header->flags |= FlagForwarded;
+    *(void **) object = copy->payload();
+    _gray.add(copy);
+    pause.promotedBytes += total;
+    return copy->payload();
+}
+
+void GcHeap::scavenge(Header *header, Pause &pause) {
+    Evacuate evacuate(*this, pause);
+    forEachReference(_types, header, evacuate);
+}
+
+/* Promotes the nursery objects reachable from the roots and the remembered set, then empties the
+ * nursery. Promoted objects are scanned in turn, so they reference no nursery objects. */
+void GcHeap::collectNursery(Pause &pause) {
+    for (size_t i = 0; i < _roots.size(); i++) {
+        Roots &roots = _roots[i];
+        for (size_t j = 0; j < roots.count; j++) roots.slots[j] = evacuate(roots.slots[j], pause);
+    }
+
+    for (size_t i = 0; i < _remembered.size(); i++) {
+        _remembered[i]->flags &= ~FlagRemembered;
+        scavenge(_remembered[i], pause);
+    }
+    _remembered.clear();
+
+    while (_gray.size() > 0) {
+        Header *header = _gray[_gray.size() - 1];
+        _gray.removeAt(_gray.size() - 1);
+        scavenge(header, pause);
+    }
+
+    _nursery->nextFree = _nursery->base;
+}
+
+void GcHeap::markSerial() {
+    Mark mark(_gray);
+    while (_gray.size() > 0) {
+        Header *header = _gray[_gray.size() - 1];
+        _gray.removeAt(_gray.size() - 1);
+        forEachReference(_types, header, mark);
+    }
+}
+
+#ifndef WASM
+
+/* A thread marking objects. Its stack of gray objects is allocated by its own allocator,
+ * as HeapAllocator is not thread-safe. */
+struct MarkWorker {
+    HeapAllocator mem;
+    Array<Header *> gray;
+
+    MarkWorker() : gray(mem) {}
+};
+
+/* The state shared by the marking threads. Gray objects are shared through the pool. A thread
+ * holding more than one gray object hands half of them to the pool if other threads wait for work.
+ * Marking is done once the pool is empty and no thread is active, that is has gray objects left. */
+struct GcHeap::MarkState {
+    GcHeap &heap;
+    Array<MarkWorker *> workers;
+    Array<Header *> &pool;
+    std::mutex mutex;
+    std::condition_variable condition;
+    uint32_t active;
+    std::atomic<uint32_t> waiting;
+
+    MarkState(GcHeap &heap) : heap(heap), workers(heap._mem), pool(heap._gray), active(0), waiting(0) {}
+};
+
+/* Takes up to a batch of gray objects from the end of the pool. */
+static void takeBatch(Array<Header *> &pool, Array<Header *> &gray) {
+    size_t count = pool.size() < QAK_GC_MARK_BATCH ? pool.size() : QAK_GC_MARK_BATCH;
+    gray.addAll(pool.buffer() + pool.size() - count, count);
+    pool.setSize(pool.size() - count, nullptr);
+}
+
+/* Moves the older half of the gray objects to the pool. These were pushed first, their
+ * subgraphs are likely the largest left to mark. */
+static void shareHalf(Array<Header *> &gray, Array<Header *> &pool) {
+    size_t count = gray.size() / 2;
+    pool.addAll(gray.buffer(), count);
+    memmove(gray.buffer(), gray.buffer() + count, (gray.size() - count) * sizeof(Header *));
+    gray.setSize(gray.size() - count, nullptr);
+}
+
+void GcHeap::markWorker(void *data, uint32_t workerIndex) {
+    MarkState &state = *(MarkState *) data;
+    Array<Header *> &gray = state.workers[workerIndex]->gray;
+    Mark mark(gray);
+
+    std::unique_lock<std::mutex> lock(state.mutex);
+    state.active++;
+    while (true) {
+        if (state.pool.size() > 0) {
+            takeBatch(state.pool, gray);
+            lock.unlock();
+            while (gray.size() > 0) {
+                Header *header = gray[gray.size() - 1];
+                gray.removeAt(gray.size() - 1);
+                forEachReference(state.heap._types, header, mark);
+
+                if (gray.size() >= 2 && state.waiting.load(std::memory_order_relaxed) > 0) {
+                    lock.lock();
+                    shareHalf(gray, state.pool);
+                    lock.unlock();
+                    state.condition.notify_one();
+                }
+            }
+            lock.lock();
+            continue;
+        }
+
+        state.active--;
+        if (state.active == 0) {
+            state.condition.notify_all();
+            return;
+        }
+        state.waiting++;
+        while (state.pool.size() == 0 && state.active != 0) state.condition.wait(lock);
+        state.waiting--;
+        if (state.pool.size() == 0) return;
+        state.active++;
+    }
+}
+
+/* Runs the marking threads on std::threads, the calling thread included. */
+static void runThreads(void (*work)(void *data, uint32_t worker), void *data, uint32_t numWorkers, void *userData) {
+    HeapAllocator &mem = *(HeapAllocator *) userData;
+    std::thread *threads = mem.alloc<std::thread>(numWorkers - 1, QAK_SRC_LOC);
+    for (uint32_t i = 1; i < numWorkers; i++)
+        new(&threads[i - 1]) std::thread(work, data, i);
+    work(data, 0);
+    for (uint32_t i = 1; i < numWorkers; i++) {
+        threads[i - 1].join();
+        threads[i - 1].~thread();
+    }
+    if (threads) mem.free(threads, QAK_SRC_LOC);
+}
+
+void GcHeap::markParallel() {
+    MarkState state(*this);
+    for (uint32_t i = 0; i < _numMarkThreads; i++)
+        state.workers.add(_mem.allocObject<MarkWorker>(QAK_SRC_LOC));
+    if (_runWorkers)
+        _runWorkers(markWorker, &state, _numMarkThreads, _runWorkersUserData);
+    else
+        runThreads(markWorker, &state, _numMarkThreads, &_mem);
+    state.workers.freeObjects();
+}
+
+#endif
+
+/* Frees the unmarked objects of the old generation and clears the marks. Free cells of chunks are put
+ * in the free list of their size. Chunks without marked objects are freed. */
+void GcHeap::sweep(Pause &pause) {
+    memset(_freeLists, 0, sizeof(_freeLists));
+    size_t freed = 0;
+
+    size_t numChunks = 0;
+    for (size_t i = 0; i < _chunks.size(); i++) {
+        Block *chunk = _chunks[i];
+        bool isLive = false;
+        size_t used = 0;
+        for (uint8_t *cell = chunk->base; cell < chunk->nextFree; cell += ((Header *) cell)->size + QAK_GC_HEADER_SIZE) {
+            Header *header = (Header *) cell;
+            if (header->type == TypeFree) continue;
+            used += header->size + QAK_GC_HEADER_SIZE;
+            if (header->mark.load(std::memory_order_relaxed)) isLive = true;
+        }
+        if (!isLive) {
+            freed += used;
+            _mem.freeObject(chunk, QAK_SRC_LOC);
+            continue;
+        }
+
+        for (uint8_t *cell = chunk->base; cell < chunk->nextFree; cell += ((Header *) cell)->size + QAK_GC_HEADER_SIZE) {
+            Header *header = (Header *) cell;
+            uint32_t total = header->size + QAK_GC_HEADER_SIZE;
+            if (header->type != TypeFree) {
+                if (header->mark.load(std::memory_order_relaxed)) {
+                    header->mark.store(0, std::memory_order_relaxed);
+                    continue;
+                }
+                freed += total;
+                header->type = TypeFree;
+                header->flags = 0;
+            }
+            *(Header **) header->payload() = _freeLists[total / 8];
+            _freeLists[total / 8] = header;
+        }
+        _chunks[numChunks++] = chunk;
+    }
+    _chunks.setSize(numChunks, nullptr);
+
+    size_t numLargeObjects = 0;
+    for (size_t i = 0; i < _largeObjects.size(); i++) {
+        Block *block = _largeObjects[i];
+        Header *header = (Header *) block->base;
+        if (header->mark.load(std::memory_order_relaxed)) {
+            header->mark.store(0, std::memory_order_relaxed);
+            _largeObjects[numLargeObjects++] = block;
+            continue;
+        }
+        freed += header->size + QAK_GC_HEADER_SIZE;
+        _mem.freeObject(block, QAK_SRC_LOC);
+    }
+    _largeObjects.setSize(numLargeObjects, nullptr);
+
+    _oldBytes -= freed;
+    pause.freedBytes = freed;
+}
+
+/* Marks the old objects reachable from the roots and sweeps the others. The nursery is empty. */
+void GcHeap::collectOld(Pause &pause) {
+    double start = io::timeMillis();
+    Mark mark(_gray);
+    for (size_t i = 0; i < _roots.size(); i++) {
+        Roots &roots = _roots[i];
+        for (size_t j = 0; j < roots.count; j++) mark(roots.slots + j);
+    }
+#ifndef WASM
+    if (_numMarkThreads > 1)
+        markParallel();
+    else
+        markSerial();
+#else
+    markSerial();
+#endif
+    double sweepStart = io::timeMillis();
+    pause.markMillis = sweepStart - start;
+
+    sweep(pause);
+    pause.sweepMillis = io::timeMillis() - sweepStart;
+    pause.markedBytes = _oldBytes;
+    _majorThreshold = _oldBytes * 2 > QAK_GC_MIN_OLD_SIZE ? _oldBytes * 2 : QAK_GC_MIN_OLD_SIZE;
+}
+
+void GcHeap::collect(bool major) {
+    Pause pause;
+    memset(&pause, 0, sizeof(Pause));
+    double start = io::timeMillis();
+
+    collectNursery(pause);
+    pause.minorMillis = io::timeMillis() - start;
+    if (_oldBytes > _majorThreshold) major = true;
+    if (major) collectOld(pause);
+
+    pause.isMajor = major;
+    pause.millis = io::timeMillis() - start;
+    pause.oldBytes = _oldBytes;
+    _pauses.add(pause);
+}
+
+void GcHeap::setMarkThreads(uint32_t numThreads, RunWorkers runWorkers, void *userData) {
+    _numMarkThreads = numThreads > 0 ? numThreads : 1;
+    _runWorkers = runWorkers;
+    _runWorkersUserData = userData;
+}
+
+static int compareMillis(const void *a, const void *b) {
+    double millisA = *(const double *) a, millisB = *(const double *) b;
+    return millisA < millisB ? -1 : millisA > millisB ? 1 : 0;
+}
+
+Stats GcHeap::stats() {
+    Stats stats;
+    memset(&stats, 0, sizeof(Stats));
+    stats.allocatedBytes = _allocatedBytes;
+    stats.oldBytes = _oldBytes;
+
+    Array<double> millis(_mem);
+    for (size_t i = 0; i < _pauses.size(); i++) {
+        Pause &pause = _pauses[i];
+        if (pause.isMajor) {
+            stats.numMajor++;
+            stats.averageMajorMillis += pause.millis;
+            if (pause.millis > stats.maxMajorMillis) stats.maxMajorMillis = pause.millis;
+        } else {
+            stats.numMinor++;
+            stats.averageMinorMillis += pause.millis;
+            if (pause.millis > stats.maxMinorMillis) stats.maxMinorMillis = pause.millis;
+        }
+        stats.promotedBytes += pause.promotedBytes;
+        stats.freedBytes += pause.freedBytes;
+        stats.totalMillis += pause.millis;
+        millis.add(pause.millis);
+    }
+    if (stats.numMinor > 0) stats.averageMinorMillis /= (double) stats.numMinor;
+    if (stats.numMajor > 0) stats.averageMajorMillis /= (double) stats.numMajor;
+
+    if (millis.size() > 0) {
+        qsort(millis.buffer(), millis.size(), sizeof(double), compareMillis);
+        stats.p50Millis = millis[(millis.size() - 1) * 50 / 100];
+        stats.p90Millis = millis[(millis.size() - 1) * 90 / 100];
+        stats.p99Millis = millis[(millis.size() - 1) * 99 / 100];
+    }
+    return stats;
+}
+
+void GcHeap::printStats() {
+    Stats stats = this->stats();
+    printf("Minor collections: %zu, average %f ms, max %f ms\n", stats.numMinor, stats.averageMinorMillis, stats.maxMinorMillis);
+    printf("Major collections: %zu, average %f ms, max %f ms\n", stats.numMajor, stats.averageMajorMillis, stats.maxMajorMillis);
+    printf("Pauses: total %f ms, p50 %f ms, p90 %f ms, p99 %f ms\n", stats.totalMillis, stats.p50Millis, stats.p90Millis, stats.p99Millis);
+    printf("Allocated: %zu bytes, promoted: %zu bytes, freed: %zu bytes, old generation: %zu bytes\n", stats.allocatedBytes,
+           stats.promotedBytes, stats.freedBytes, stats.oldBytes);
+}
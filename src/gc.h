@@ -0,0 +1,253 @@
+#ifndef QAK_GC_H
+#define QAK_GC_H
+
+#include "array.h"
+#include <atomic>
+
+// Default size of the nursery, in which new objects are bump allocated.
+#define QAK_GC_NURSERY_SIZE (512 * 1024)
+
+// Size of the chunks of the old generation small objects are promoted to.
+#define QAK_GC_CHUNK_SIZE (256 * 1024)
+
+// Largest size of an object, header included, stored in the nursery and in chunks. Larger objects are
+// allocated in the old generation directly, each in a block of its own.
+#define QAK_GC_MAX_SMALL_SIZE 256
+
+// Bytes in use by the old generation below which no major collection is done.
+#define QAK_GC_MIN_OLD_SIZE (4 * 1024 * 1024)
+
+// Most gray objects a marking thread takes from the shared pool at once.
+#define QAK_GC_MARK_BATCH 64
+
+namespace qak {
+    namespace gc {
+        /* Built-in types. Objects of TypeBytes hold no references, objects of TypeReferences hold
+         * nothing but references. Both are allocated with an explicit size. */
+        enum BuiltinType {
+            TypeFree,
+            TypeBytes,
+            TypeReferences,
+            NumBuiltinTypes
+        };
+
+        enum HeaderFlags {
+            /* A nursery object that was promoted, its first word points to the promoted copy. */
+            FlagForwarded = 1,
+            /* An old object in the remembered set, see GcHeap::write(). */
+            FlagRemembered = 2
+        };
+
+        /* Precedes every object. Pointers to objects point to the byte after the header. The mark is
+         * set atomically, so threads can mark the same object at once, see GcHeap::setMarkThreads(). */
+        struct Header {
+            uint32_t size;
+            uint16_t type;
+            uint8_t flags;
+            std::atomic<uint8_t> mark;
+
+            Header(uint32_t size, uint16_t type) : size(size), type(type), flags(0), mark(0) {}
+
+            QAK_FORCE_INLINE uint8_t *payload() {
+                return (uint8_t *) (this + 1);
+            }
+
+            static QAK_FORCE_INLINE Header *of(void *object) {
+                return ((Header *) object) - 1;
+            }
+        };
+
+        /* The layout of the objects of a type: their size and the offsets of their references. */
+        struct Type {
+            const char *name;
+            uint32_t size;
+            Array<uint32_t> references;
+
+            Type(HeapAllocator &mem, const char *name, uint32_t size) : name(name), size(size), references(mem) {}
+        };
+
+        /* A range of slots the host stores references to objects in, see GcHeap::addRoots(). */
+        struct Roots {
+            void **slots;
+            size_t count;
+
+            Roots(void **slots, size_t count) : slots(slots), count(count) {}
+        };
+
+        /* A stop-the-world pause. Major pauses include the minor collection preceding them. */
+        struct Pause {
+            bool isMajor;
+            double millis;
+            double minorMillis;
+            double markMillis;
+            double sweepMillis;
+            size_t promotedBytes;
+            size_t markedBytes;
+            size_t freedBytes;
+            size_t oldBytes;
+        };
+
+        /* Summary of the pauses so far, see GcHeap::stats(). Percentiles are over the duration of all pauses. */
+        struct Stats {
+            size_t numMinor;
+            size_t numMajor;
+            size_t allocatedBytes;
+            size_t promotedBytes;
+            size_t freedBytes;
+            size_t oldBytes;
+            double totalMillis;
+            double maxMinorMillis;
+            double maxMajorMillis;
+            double averageMinorMillis;
+            double averageMajorMillis;
+            double p50Millis;
+            double p90Millis;
+            double p99Millis;
+        };
+
+        /* Runs work(data, i) for every worker index i below numWorkers, concurrently, and returns once all
+         * calls returned. The calls may also run one after the other, marking then happens on one of them. */
+        typedef void (*RunWorkers)(void (*work)(void *data, uint32_t worker), void *data, uint32_t numWorkers, void *userData);
+    }
+
+    /* A generational garbage-collected heap for objects holding references to other objects.
+     *
+     * New objects are bump allocated in the nursery. Once it is full, a minor collection promotes the
+     * objects reachable from the roots and the remembered set to the old generation, then empties the
+     * nursery. Small objects of the old generation are stored in chunks, free cells of each size are
+     * kept in a free list. Larger objects are allocated in the old generation directly, each in a
+     * block of its own. Once the old generation has grown to twice its size after the last major
+     * collection, the minor collection is followed by a major one, which marks the objects reachable
+     * from the roots and sweeps the rest. Marking can run on several threads, see setMarkThreads().
+     *
+     * Collection is precise. The host registers the slots it holds references in as roots and stores
+     * references in objects with write(), which records old objects referencing nursery objects.
+     * References are pointers to the first byte after an object's header, or nullptr. Collections
+     * only happen in alloc() and collect(), and move nursery objects, updating the roots and the
+     * references in objects. All collections stop the world, their pauses are recorded, see stats(). */
+    class GcHeap {
+    private:
+        struct Evacuate;
+        struct MarkState;
+
+        HeapAllocator &_mem;
+        Array<gc::Type *> _types;
+        Array<gc::Roots> _roots;
+
+        Block *_nursery;
+        Array<Block *> _chunks;
+        Array<Block *> _largeObjects;
+        gc::Header *_freeLists[QAK_GC_MAX_SMALL_SIZE / 8 + 1];
+
+        Array<gc::Header *> _remembered;
+        Array<gc::Header *> _gray;
+
+        uint32_t _numMarkThreads;
+        gc::RunWorkers _runWorkers;
+        void *_runWorkersUserData;
+
+        size_t _oldBytes;
+        size_t _majorThreshold;
+        size_t _allocatedBytes;
+        Array<gc::Pause> _pauses;
+
+        uint8_t *allocOld(uint32_t size);
+
+        void *evacuate(void *object, gc::Pause &pause);
+
+        void scavenge(gc::Header *header, gc::Pause &pause);
+
+        void collectNursery(gc::Pause &pause);
+
+        void collectOld(gc::Pause &pause);
+
+        void markSerial();
+
+        void markParallel();
+
+        void sweep(gc::Pause &pause);
+
+        void remember(void *object);
+
+        static void markWorker(void *data, uint32_t worker);
+
+    public:
+        GcHeap(HeapAllocator &mem, size_t nurserySize = QAK_GC_NURSERY_SIZE);
+
+        GcHeap(const GcHeap &other) = delete;
+
+        ~GcHeap();
+
+        /* Registers a type of objects of the given size, holding references at the given offsets, which
+         * must be multiples of 8. Returns the type to pass to alloc(). */
+        uint32_t addType(const char *name, uint32_t size, const uint32_t *references, uint32_t numReferences);
+
+        /* Returns a new object of the type, with all bytes set to 0. Objects of the built-in types
+         * gc::TypeBytes and gc::TypeReferences take their size in bytes, other types their registered
+         * size. May collect before allocating, moving nursery objects. */
+        void *alloc(uint32_t type, uint32_t size = 0);
+
+        /* Stores the reference in the field of the object. All stores of references in objects must go
+         * through this write barrier, which remembers old objects referencing nursery objects. */
+        QAK_FORCE_INLINE void write(void *object, void **field, void *value) {
+            *field = value;
+            if (value && isYoung(value) && !isYoung(object)) remember(object);
+        }
+
+        /* Registers count slots holding references, or nullptr, as roots. Collections update the slots
+         * when they move objects. */
+        void addRoots(void **slots, size_t count);
+
+        void addRoot(void **slot) {
+            addRoots(slot, 1);
+        }
+
+        /* Unregisters the most recently added roots starting at the slot. */
+        void removeRoots(void **slots);
+
+        void removeRoot(void **slot) {
+            removeRoots(slot);
+        }
+
+        /* Collects the nursery, followed by the old generation if major is true. */
+        void collect(bool major);
+
+        /* Sets the number of threads marking the old generation, the calling thread included, and how
+         * they are run. With no runWorkers function, threads are started for each major collection.
+         * Ignored in WASM builds, which mark on the calling thread. Defaults to 1. */
+        void setMarkThreads(uint32_t numThreads, gc::RunWorkers runWorkers = nullptr, void *userData = nullptr);
+
+        QAK_FORCE_INLINE bool isYoung(void *object) {
+            return (uint8_t *) object >= _nursery->base && (uint8_t *) object < _nursery->end;
+        }
+
+        /* Returns the size of the object in bytes, without its header. */
+        static QAK_FORCE_INLINE uint32_t size(void *object) {
+            return gc::Header::of(object)->size;
+        }
+
+        static QAK_FORCE_INLINE uint32_t type(void *object) {
+            return gc::Header::of(object)->type;
+        }
+
+        /* Bytes in use by objects of the old generation, headers included. */
+        size_t oldBytes() {
+            return _oldBytes;
+        }
+
+        /* Bytes in use by objects of the nursery, headers included. */
+        size_t youngBytes() {
+            return (size_t) (_nursery->nextFree - _nursery->base);
+        }
+
+        Array<gc::Pause> &pauses() {
+            return _pauses;
+        }
+
+        gc::Stats stats();
+
+        void printStats();
+    };
+}
+
+#endif //QAK_GC_H
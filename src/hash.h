@@ -0,0 +1,110 @@
+#ifndef QAK_HASH_H
+#define QAK_HASH_H
+
+#include "memory.h"
+#include "array.h"
+
+namespace qak {
+
+    /* Returns the 32-bit FNV-1a hash of the bytes. Hashing continues from the given hash, so
+     * the bytes of several values can be hashed as one. */
+    static QAK_FORCE_INLINE uint32_t hashBytes(const uint8_t *data, size_t length, uint32_t hash = 2166136261u) {
+        for (size_t i = 0; i < length; i++) {
+            hash ^= data[i];
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    /* Returns the 64-bit FNV-1a hash of the bytes, see hashBytes(). */
+    static QAK_FORCE_INLINE uint64_t hashBytes64(const uint8_t *data, size_t length, uint64_t hash = 14695981039346656037ull) {
+        for (size_t i = 0; i < length; i++) {
+            hash ^= data[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    /* The finalizer of MurmurHash3. Every bit of the value affects every bit of the result, so
+     * values built from small numbers, like indices, can be masked into a table. */
+    static QAK_FORCE_INLINE uint64_t mixHash(uint64_t hash) {
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ull;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    /* Returns the hash stored in an entry of a HashIndex. */
+    template<typename T>
+    struct EntryHash {
+        uint32_t operator()(const T &entry) const {
+            return entry.hash;
+        }
+    };
+
+    /* Open addressing hash table of indices into an array of entries, e.g. the strings of a
+     * StringPool. The entries store their hashes, so the table grows without hashing them
+     * again. Lookups and insertions probe the slots linearly, the load factor is kept below
+     * 0.5 so probe sequences stay short. The slots are kept when the table is cleared, so it
+     * can be reused without allocating. */
+    template<typename T, typename H = EntryHash<T>>
+    class HashIndex {
+    private:
+        /* Indices into the entries, -1 marks empty slots. The size is always a power of 2. */
+        Array<int32_t> _slots;
+        H _hashFunc;
+
+        HashIndex(const HashIndex &other) = delete;
+
+    public:
+        HashIndex(HeapAllocator &mem) : _slots(mem) {}
+
+        /* Removes all indices. */
+        void clear() {
+            for (size_t i = 0; i < _slots.size(); i++) _slots[i] = -1;
+        }
+
+        /* Resizes the table to hold one more than the entries, and inserts all of them. */
+        void rehash(Array<T> &entries) {
+            size_t size = _slots.size() == 0 ? 64 : _slots.size();
+            while ((entries.size() + 1) * 2 > size) size *= 2;
+            _slots.setSize(size, -1);
+            clear();
+
+            size_t mask = size - 1;
+            for (size_t i = 0; i < entries.size(); i++) {
+                size_t slot = _hashFunc(entries[i]) & mask;
+                while (_slots[slot] != -1) slot = (slot + 1) & mask;
+                _slots[slot] = (int32_t) i;
+            }
+        }
+
+        /* Grows the table if adding another entry would fill half of it. Must be called before
+         * find() if the entry is added to the slot it returns. */
+        QAK_FORCE_INLINE void reserve(Array<T> &entries) {
+            if ((entries.size() + 1) * 2 > _slots.size()) rehash(entries);
+        }
+
+        /* Returns the index of the first entry with the hash that isEntry(entry) accepts, or -1.
+         * The slot is set to the empty slot that ended the search, see set(). */
+        template<typename E>
+        QAK_FORCE_INLINE int32_t find(Array<T> &entries, uint32_t hash, E isEntry, size_t &slot) {
+            if (_slots.size() == 0) rehash(entries);
+            size_t mask = _slots.size() - 1;
+            for (slot = hash & mask; _slots[slot] != -1; slot = (slot + 1) & mask) {
+                T &entry = entries[(size_t) _slots[slot]];
+                if (_hashFunc(entry) == hash && isEntry(entry)) return _slots[slot];
+            }
+            return -1;
+        }
+
+        /* Stores the index of an entry in the empty slot found by find(). */
+        QAK_FORCE_INLINE void set(size_t slot, int32_t index) {
+            _slots[slot] = index;
+        }
+    };
+}
+
+#endif //QAK_HASH_H
@@ -0,0 +1,316 @@
+#include <math.h>
+#include "interpreter.h"
+
+using namespace qak;
+
+using namespace qak::bytecode;
+
+#if defined(__GNUC__) || defined(__clang__)
+#define QAK_THREADED_DISPATCH
+#endif
+
+Interpreter::Interpreter(HeapAllocator &mem, size_t stackSize) : _stack(mem, stackSize), _frames(mem), _globals(mem), _resultType(TypeNothing) {
+    Value zero;
+    zero.i = 0;
+    _stack.setSize(stackSize, zero);
+    _result = zero;
+}
+
+// Taking the address of a label is a GCC extension, which Clang supports as well.
+#ifdef QAK_THREADED_DISPATCH
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+bool Interpreter::run(Program *program, Errors &errors) {
+    Value zero;
+    zero.i = 0;
+    _globals.clear();
+    _globals.setSize(program->numGlobals, zero);
+    _frames.clear();
+    _result = zero;
+    _resultType = TypeNothing;
+
+    Function *function = program->statements;
+    Value *registers = _stack.buffer();
+    Value *stackEnd = _stack.buffer() + _stack.size();
+    Value *globals = _globals.buffer();
+    Value *constants = program->constants.size() > 0 ? &program->constants[0] : nullptr;
+    Function **functions = program->functions.size() > 0 ? &program->functions[0] : nullptr;
+    Native *natives = program->natives.size() > 0 ? &program->natives[0] : nullptr;
+    const Instruction *code = &function->code[0];
+    const Instruction *pc = code;
+    const Instruction *ip = pc;
+    const char *error = "Stack overflow.";
+    if (registers + function->numRegisters > stackEnd) goto fail;
+    _frames.add(Frame(function, pc, registers));
+
+#ifdef QAK_THREADED_DISPATCH
+#define QAK_LABEL_ADDRESS(name) &&label##name,
+    static void *labels[] = {QAK_OPCODES(QAK_LABEL_ADDRESS)};
+#undef QAK_LABEL_ADDRESS
+#define QAK_OPCODE(name) label##name:
+#define QAK_NEXT() ip = pc++; goto *labels[ip->op]
+    QAK_NEXT();
+#else
+#define QAK_OPCODE(name) case Op##name:
+#define QAK_NEXT() continue
+    while (true) {
+        ip = pc++;
+        switch (ip->op) {
+#endif
+
+    QAK_OPCODE(LoadConstant)
+    registers[ip->a] = constants[ip->bx()];
+    QAK_NEXT();
+
+    QAK_OPCODE(Move)
+    registers[ip->a] = registers[ip->b];
+    QAK_NEXT();
+
+    QAK_OPCODE(GetGlobal)
+    registers[ip->a] = globals[ip->bx()];
+    QAK_NEXT();
+
+    QAK_OPCODE(SetGlobal)
+    globals[ip->bx()] = registers[ip->a];
+    QAK_NEXT();
+
+    // Integers narrower than 64 bits are sign-extended, so their results can be computed in 64 bits and wrapped.
+    QAK_OPCODE(AddI32)
+    registers[ip->a].i = (int32_t) (uint32_t) ((uint64_t) registers[ip->b].i + (uint64_t) registers[ip->c].i);
+    QAK_NEXT();
+
+    QAK_OPCODE(SubI32)
+    registers[ip->a].i = (int32_t) (uint32_t) ((uint64_t) registers[ip->b].i - (uint64_t) registers[ip->c].i);
+    QAK_NEXT();
+
+    QAK_OPCODE(MulI32)
+    registers[ip->a].i = (int32_t) (uint32_t) ((uint64_t) registers[ip->b].i * (uint64_t) registers[ip->c].i);
+    QAK_NEXT();
+
+    QAK_OPCODE(DivI32)
+    if (registers[ip->c].i == 0) goto divisionByZero;
+    registers[ip->a].i = (int32_t) (uint32_t) (registers[ip->b].i / registers[ip->c].i);
+    QAK_NEXT();
+
+    QAK_OPCODE(RemI32)
+    if (registers[ip->c].i == 0) goto divisionByZero;
+    registers[ip->a].i = registers[ip->b].i % registers[ip->c].i;
+    QAK_NEXT();
+
+    QAK_OPCODE(AddI64)
+    registers[ip->a].i = (int64_t) ((uint64_t) registers[ip->b].i + (uint64_t) registers[ip->c].i);
+    QAK_NEXT();
+
+    QAK_OPCODE(SubI64)
+    registers[ip->a].i = (int64_t) ((uint64_t) registers[ip->b].i - (uint64_t) registers[ip->c].i);
+    QAK_NEXT();
+
+    QAK_OPCODE(MulI64)
+    registers[ip->a].i = (int64_t) ((uint64_t) registers[ip->b].i * (uint64_t) registers[ip->c].i);
+    QAK_NEXT();
+
+    // Dividing the smallest value by -1 overflows in C++, it wraps around to the smallest value.
+    QAK_OPCODE(DivI64)
+    if (registers[ip->c].i == 0) goto divisionByZero;
+    if (registers[ip->c].i == -1) registers[ip->a].i = (int64_t) (0 - (uint64_t) registers[ip->b].i);
+    else registers[ip->a].i = registers[ip->b].i / registers[ip->c].i;
+    QAK_NEXT();
+
+    QAK_OPCODE(RemI64)
+    if (registers[ip->c].i == 0) goto divisionByZero;
+    if (registers[ip->c].i == -1) registers[ip->a].i = 0;
+    else registers[ip->a].i = registers[ip->b].i % registers[ip->c].i;
+    QAK_NEXT();
+
+    QAK_OPCODE(AddF32)
+    registers[ip->a].f = (float) (registers[ip->b].f + registers[ip->c].f);
+    QAK_NEXT();
+
+    QAK_OPCODE(SubF32)
+    registers[ip->a].f = (float) (registers[ip->b].f - registers[ip->c].f);
+    QAK_NEXT();
+
+    QAK_OPCODE(MulF32)
+    registers[ip->a].f = (float) (registers[ip->b].f * registers[ip->c].f);
+    QAK_NEXT();
+
+    QAK_OPCODE(DivF32)
+    registers[ip->a].f = (float) (registers[ip->b].f / registers[ip->c].f);
+    QAK_NEXT();
+
+    QAK_OPCODE(RemF32)
+    registers[ip->a].f = (float) fmod(registers[ip->b].f, registers[ip->c].f);
+    QAK_NEXT();
+
+    QAK_OPCODE(AddF64)
+    registers[ip->a].f = registers[ip->b].f + registers[ip->c].f;
+    QAK_NEXT();
+
+    QAK_OPCODE(SubF64)
+    registers[ip->a].f = registers[ip->b].f - registers[ip->c].f;
+    QAK_NEXT();
+
+    QAK_OPCODE(MulF64)
+    registers[ip->a].f = registers[ip->b].f * registers[ip->c].f;
+    QAK_NEXT();
+
+    QAK_OPCODE(DivF64)
+    registers[ip->a].f = registers[ip->b].f / registers[ip->c].f;
+    QAK_NEXT();
+
+    QAK_OPCODE(RemF64)
+    registers[ip->a].f = fmod(registers[ip->b].f, registers[ip->c].f);
+    QAK_NEXT();
+
+    QAK_OPCODE(And)
+    registers[ip->a].i = registers[ip->b].i & registers[ip->c].i;
+    QAK_NEXT();
+
+    QAK_OPCODE(Or)
+    registers[ip->a].i = registers[ip->b].i | registers[ip->c].i;
+    QAK_NEXT();
+
+    QAK_OPCODE(Xor)
+    registers[ip->a].i = registers[ip->b].i ^ registers[ip->c].i;
+    QAK_NEXT();
+
+    QAK_OPCODE(NegI32)
+    registers[ip->a].i = (int32_t) (uint32_t) (0 - (uint64_t) registers[ip->b].i);
+    QAK_NEXT();
+
+    QAK_OPCODE(NegI64)
+    registers[ip->a].i = (int64_t) (0 - (uint64_t) registers[ip->b].i);
+    QAK_NEXT();
+
+    QAK_OPCODE(NegF)
+    registers[ip->a].f = -registers[ip->b].f;
+    QAK_NEXT();
+
+    QAK_OPCODE(Not)
+    registers[ip->a].i = registers[ip->b].i ^ 1;
+    QAK_NEXT();
+
+    QAK_OPCODE(Narrow8)
+    registers[ip->a].i = (int8_t) (uint8_t) registers[ip->b].i;
+    QAK_NEXT();
+
+    QAK_OPCODE(Narrow16)
+    registers[ip->a].i = (int16_t) (uint16_t) registers[ip->b].i;
+    QAK_NEXT();
+
+    QAK_OPCODE(IntToF32)
+    registers[ip->a].f = (float) (double) registers[ip->b].i;
+    QAK_NEXT();
+
+    QAK_OPCODE(IntToF64)
+    registers[ip->a].f = (double) registers[ip->b].i;
+    QAK_NEXT();
+
+    QAK_OPCODE(EqI)
+    registers[ip->a].i = registers[ip->b].i == registers[ip->c].i;
+    QAK_NEXT();
+
+    QAK_OPCODE(NeI)
+    registers[ip->a].i = registers[ip->b].i != registers[ip->c].i;
+    QAK_NEXT();
+
+    QAK_OPCODE(LtI)
+    registers[ip->a].i = registers[ip->b].i < registers[ip->c].i;
+    QAK_NEXT();
+
+    QAK_OPCODE(LeI)
+    registers[ip->a].i = registers[ip->b].i <= registers[ip->c].i;
+    QAK_NEXT();
+
+    QAK_OPCODE(EqF)
+    registers[ip->a].i = registers[ip->b].f == registers[ip->c].f;
+    QAK_NEXT();
+
+    QAK_OPCODE(NeF)
+    registers[ip->a].i = registers[ip->b].f != registers[ip->c].f;
+    QAK_NEXT();
+
+    QAK_OPCODE(LtF)
+    registers[ip->a].i = registers[ip->b].f < registers[ip->c].f;
+    QAK_NEXT();
+
+    QAK_OPCODE(LeF)
+    registers[ip->a].i = registers[ip->b].f <= registers[ip->c].f;
+    QAK_NEXT();
+
+    QAK_OPCODE(Jump)
+    pc = code + ip->bx();
+    QAK_NEXT();
+
+    QAK_OPCODE(JumpIfFalse)
+    if (!registers[ip->a].i) pc = code + ip->bx();
+    QAK_NEXT();
+
+    QAK_OPCODE(JumpIfTrue)
+    if (registers[ip->a].i) pc = code + ip->bx();
+    QAK_NEXT();
+
+    QAK_OPCODE(Call)
+    function = functions[ip->bx()];
+    if (registers + ip->a + function->numRegisters > stackEnd || _frames.size() >= _stack.size()) goto fail;
+    _frames[_frames.size() - 1].pc = pc;
+    registers += ip->a;
+    code = pc = &function->code[0];
+    _frames.add(Frame(function, pc, registers));
+    QAK_NEXT();
+
+    // Natives run on the caller's registers and need no frame.
+    QAK_OPCODE(CallNative)
+    registers[ip->a] = natives[ip->bx()].function(&registers[ip->a], natives[ip->bx()].userData);
+    QAK_NEXT();
+
+    // The return value is stored in the first register of the returning function, which is the call's register in the caller.
+    QAK_OPCODE(Return)
+    if (_frames.size() == 1) {
+        _result = registers[ip->a];
+        _resultType = ip->b;
+        return true;
+    }
+    registers[0] = registers[ip->a];
+    _frames.removeAt(_frames.size() - 1);
+    function = _frames[_frames.size() - 1].function;
+    registers = _frames[_frames.size() - 1].registers;
+    pc = _frames[_frames.size() - 1].pc;
+    code = &function->code[0];
+    QAK_NEXT();
+
+    QAK_OPCODE(ReturnNothing)
+    if (_frames.size() == 1) return true;
+    _frames.removeAt(_frames.size() - 1);
+    function = _frames[_frames.size() - 1].function;
+    registers = _frames[_frames.size() - 1].registers;
+    pc = _frames[_frames.size() - 1].pc;
+    code = &function->code[0];
+    QAK_NEXT();
+
+#ifndef QAK_THREADED_DISPATCH
+            default:
+                break;
+        }
+    }
+#endif
+
+#undef QAK_OPCODE
+#undef QAK_NEXT
+
+    divisionByZero:
+    error = "Division by zero.";
+
+    fail:
+    // Errors are reported at the token of the failing instruction in the function that is running.
+    function = _frames.size() > 0 ? _frames[_frames.size() - 1].function : function;
+    code = &function->code[0];
+    errors.add(program->module->tokens[function->tokens[ip - code]], error);
+    return false;
+}
+
+#ifdef QAK_THREADED_DISPATCH
+#pragma GCC diagnostic pop
+#endif
@@ -0,0 +1,62 @@
+#ifndef QAK_INTERPRETER_H
+#define QAK_INTERPRETER_H
+
+#include "bytecode.h"
+
+namespace qak {
+    /* The default number of registers available to all active functions of an Interpreter. */
+#define QAK_DEFAULT_STACK_SIZE (256 * 1024)
+
+    /* Runs bytecode::Programs. The instructions are dispatched through a table of label addresses
+     * when compiled with GCC or Clang, so each instruction jumps straight to the next instruction's
+     * handler. Other compilers dispatch through a switch in a loop.
+     *
+     * Calls do not recurse on the C stack. The registers of all active functions live on a single
+     * register stack, the registers of a called function start at the register holding its first
+     * argument. */
+    class Interpreter {
+    private:
+        struct Frame {
+            bytecode::Function *function;
+            const bytecode::Instruction *pc;
+            bytecode::Value *registers;
+
+            Frame(bytecode::Function *function, const bytecode::Instruction *pc, bytecode::Value *registers) : function(function), pc(pc),
+                                                                                                             registers(registers) {}
+        };
+
+        Array<bytecode::Value> _stack;
+        Array<Frame> _frames;
+        Array<bytecode::Value> _globals;
+        bytecode::Value _result;
+        TypeId _resultType;
+
+        Interpreter(const Interpreter &other) = delete;
+
+    public:
+        /* The stack size limits the number of registers and frames of active functions. */
+        Interpreter(HeapAllocator &mem, size_t stackSize = QAK_DEFAULT_STACK_SIZE);
+
+        /* Runs the statements of the program's module, after setting all module variables to zero.
+         * Errors while running, e.g. a division by zero, are reported in the errors and stop the
+         * program. Returns false if there was an error. */
+        bool run(bytecode::Program *program, Errors &errors);
+
+        /* Returns the value of the module variable with the slot, see ast::Symbol::slot. */
+        QAK_FORCE_INLINE bytecode::Value global(uint32_t slot) {
+            return _globals[slot];
+        }
+
+        /* Returns the value returned by the module's statements and its type, which is TypeNothing if
+         * they returned no value. */
+        QAK_FORCE_INLINE bytecode::Value result() {
+            return _result;
+        }
+
+        QAK_FORCE_INLINE TypeId resultType() {
+            return _resultType;
+        }
+    };
+}
+
+#endif //QAK_INTERPRETER_H
@@ -2,6 +2,12 @@
 
 #include <cstdio>
 
+#if !defined(WASM) && (defined(__unix__) || defined(__APPLE__))
+#define QAK_POSIX
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #define SOKOL_IMPL
 
 #include "3rdparty/sokol_time.h"
@@ -21,8 +27,11 @@ Source *io::readFile(const char *fileName, HeapAllocator &mem) {
     size_t size = ftell(file);
     fseek(file, 0L, SEEK_SET);
 
-    uint8_t *data = mem.alloc<uint8_t>(size, QAK_SRC_LOC);
+    // The data is null terminated like Source::fromMemory(), the tokenizer relies on it to stop decoding
+    // UTF-8 characters at the end of the data.
+    uint8_t *data = mem.alloc<uint8_t>(size + 1, QAK_SRC_LOC);
     fread(data, sizeof(uint8_t), size, file);
+    data[size] = 0;
     fclose(file);
 
     size_t fileNameLength = strlen(fileName) + 1;
@@ -31,6 +40,54 @@ Source *io::readFile(const char *fileName, HeapAllocator &mem) {
     return mem.allocObject<Source>(QAK_SRC_LOC, mem, fileNameCopy, data, size);
 }
 
+/* Opens a new temporary file next to the file for writing and stores its name in tempFileName, which
+ * has room for the file name plus 32 bytes. The name is unique, so concurrent writers of the same file
+ * never write to the same temporary file. */
+static FILE *openTempFile(const char *fileName, char *tempFileName, size_t length) {
+#ifdef QAK_POSIX
+    snprintf(tempFileName, length, "%s.XXXXXX", fileName);
+    int fd = mkstemp(tempFileName);
+    if (fd < 0) return nullptr;
+    // mkstemp() creates the file readable by the owner only.
+    fchmod(fd, 0644);
+    FILE *file = fdopen(fd, "wb");
+    if (file == nullptr) {
+        close(fd);
+        remove(tempFileName);
+    }
+    return file;
+#else
+    static uint32_t counter = 0;
+    for (int i = 0; i < 64; i++) {
+        snprintf(tempFileName, length, "%s.%x.tmp", fileName, counter++);
+        // "x" fails if the file exists, e.g. if another writer picked the same name, which is then skipped.
+        FILE *file = fopen(tempFileName, "wbx");
+        if (file != nullptr) return file;
+    }
+    return nullptr;
+#endif
+}
+
+bool io::writeFile(const char *fileName, const uint8_t *data, size_t size, HeapAllocator &mem) {
+    size_t length = strlen(fileName) + 32;
+    char *tempFileName = mem.alloc<char>(length, QAK_SRC_LOC);
+
+    bool success = false;
+    FILE *file = openTempFile(fileName, tempFileName, length);
+    if (file != nullptr) {
+        success = fwrite(data, sizeof(uint8_t), size, file) == size;
+        success = fclose(file) == 0 && success;
+#ifdef _WIN32
+        // Windows does not replace existing files on rename.
+        if (success) remove(fileName);
+#endif
+        success = success && rename(tempFileName, fileName) == 0;
+        if (!success) remove(tempFileName);
+    }
+    mem.free(tempFileName, QAK_SRC_LOC);
+    return success;
+}
+
 static bool isTimeSetup = false;
 
 double io::timeMillis() {
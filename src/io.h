@@ -7,6 +7,10 @@ namespace qak {
     namespace io {
         Source *readFile(const char *fileName, HeapAllocator &mem);
 
+        /* Writes the bytes to a temporary file, which then replaces the file, so readers never see a
+         * partially written file. Returns false if the file could not be written. */
+        bool writeFile(const char *fileName, const uint8_t *data, size_t size, HeapAllocator &mem);
+
         double timeMillis();
     }
 }
@@ -0,0 +1,600 @@
+#include <math.h>
+#include <cstdio>
+#include <cstring>
+#include "jit.h"
+
+#ifdef QAK_JIT_X64
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace qak;
+
+using namespace qak::bytecode;
+
+using namespace qak::jit;
+
+/* Set in the status returned by the compiled code if it failed. The other bits are the index of the jit::Site. */
+#define QAK_JIT_ERROR 0x80000000u
+
+#ifdef QAK_JIT_X64
+
+/* What a hole of a stencil is patched with. Register and global offsets and immediates are patched
+ * when a stencil is copied. Jump and call targets are 32-bit offsets relative to the end of the
+ * hole, patched once the offsets of all instructions and functions are known. */
+enum HoleKind {
+    HoleA,          // The offset of register a, 32 bits.
+    HoleB,
+    HoleC,
+    HoleGlobal,     // The offset of global bx, 32 bits.
+    HoleConstant,   // The bits of constant bx, 64 bits.
+    HoleTarget,     // Jump to instruction bx.
+    HoleFunction,   // Call of function bx.
+    HoleSite,       // QAK_JIT_ERROR and the index of the instruction's jit::Site, 32 bits.
+    HoleErrorExit,  // Jump to the error exit of the entry stub.
+    HoleFrameEnd,   // The offset of the end of the registers of the function called by instruction a, 32 bits.
+    HoleType,       // The TypeId in b, 32 bits.
+    HoleFmod,       // The address of fmod(), 64 bits.
+    HoleNative,     // The address of the function of native bx, 64 bits.
+    HoleNativeData  // The user data of native bx, 64 bits.
+};
+
+struct Hole {
+    uint32_t offset;
+    HoleKind kind;
+};
+
+struct Stencil {
+    const uint8_t *code;
+    uint32_t size;
+    const Hole *holes;
+    uint32_t numHoles;
+
+    Stencil(const uint8_t *code, uint32_t size, const Hole *holes, uint32_t numHoles) : code(code), size(size), holes(holes), numHoles(numHoles) {}
+};
+
+/* The compiled code runs with these registers set by the entry stub:
+ *
+ *   rbx  the first register of the running function
+ *   r12  the globals
+ *   r13  the end of the register stack
+ *   r14  the number of calls that may still be made before the stack overflows
+ *   rbp  the stack pointer to unwind to on errors
+ *
+ * Stencils only use rax, rcx, rdx, rsi, rdi and xmm0 to xmm1 besides, which calls to C functions may change.
+ * Each function reserves 8 bytes of stack so the stack is 16-byte aligned for those calls.
+ *
+ * uint32_t entry(Value *registers, Value *globals, Value *stackEnd, uint64_t calls, const uint8_t *function)
+ * returns the TypeId of the module's result, or QAK_JIT_ERROR and the index of the failing site. */
+static const uint8_t entryCode[] = {
+        0x53,                               // push rbx
+        0x41, 0x54,                         // push r12
+        0x41, 0x55,                         // push r13
+        0x41, 0x56,                         // push r14
+        0x55,                               // push rbp
+        0x48, 0x89, 0xFB,                   // mov rbx, rdi
+        0x49, 0x89, 0xF4,                   // mov r12, rsi
+        0x49, 0x89, 0xD5,                   // mov r13, rdx
+        0x49, 0x89, 0xCE,                   // mov r14, rcx
+        0x48, 0x89, 0xE5,                   // mov rbp, rsp
+        0x41, 0xFF, 0xD0,                   // call r8
+        0x5D,                               // exit: pop rbp
+        0x41, 0x5E,                         // pop r14
+        0x41, 0x5D,                         // pop r13
+        0x41, 0x5C,                         // pop r12
+        0x5B,                               // pop rbx
+        0xC3,                               // ret
+        0x48, 0x89, 0xEC,                   // errorExit: mov rsp, rbp
+        0xEB, 0xF2                          // jmp exit
+};
+
+/* The offset of errorExit in entryCode. */
+#define QAK_JIT_ERROR_EXIT 35
+
+static const uint8_t prologueCode[] = {
+        0x48, 0x83, 0xEC, 0x08              // sub rsp, 8
+};
+
+/* Stencils are listed with the instructions they consist of. Holes are zero bytes. */
+#define QAK_LOAD_RAX_B 0x48, 0x8B, 0x83, 0, 0, 0, 0          /* mov rax, [rbx + b] */
+#define QAK_LOAD_RCX_C 0x48, 0x8B, 0x8B, 0, 0, 0, 0          /* mov rcx, [rbx + c] */
+#define QAK_STORE_RAX_A 0x48, 0x89, 0x83, 0, 0, 0, 0         /* mov [rbx + a], rax */
+#define QAK_LOAD_XMM0(reg) 0xF2, 0x0F, 0x10, 0x83, 0, 0, 0, 0 /* movsd xmm0, [rbx + reg] */
+#define QAK_STORE_XMM0_A 0xF2, 0x0F, 0x11, 0x83, 0, 0, 0, 0  /* movsd [rbx + a], xmm0 */
+#define QAK_ROUND_XMM0 0xF2, 0x0F, 0x5A, 0xC0, 0xF3, 0x0F, 0x5A, 0xC0 /* cvtsd2ss xmm0, xmm0; cvtss2sd xmm0, xmm0 */
+#define QAK_FAIL 0xB8, 0, 0, 0, 0, 0xE9, 0, 0, 0, 0          /* mov eax, site; jmp errorExit */
+#define QAK_CHECK_DIVISOR QAK_LOAD_RAX_B, QAK_LOAD_RCX_C, 0x48, 0x85, 0xC9, 0x75, 0x0A, QAK_FAIL /* test rcx, rcx; jnz +10 */
+
+static const uint8_t loadConstantCode[] = {0x48, 0xB8, 0, 0, 0, 0, 0, 0, 0, 0, QAK_STORE_RAX_A}; // mov rax, constant
+static const Hole loadConstantHoles[] = {{2, HoleConstant}, {13, HoleA}};
+
+static const uint8_t moveCode[] = {QAK_LOAD_RAX_B, QAK_STORE_RAX_A};
+static const Hole moveHoles[] = {{3, HoleB}, {10, HoleA}};
+
+static const uint8_t getGlobalCode[] = {0x49, 0x8B, 0x84, 0x24, 0, 0, 0, 0, QAK_STORE_RAX_A}; // mov rax, [r12 + global]
+static const Hole getGlobalHoles[] = {{4, HoleGlobal}, {11, HoleA}};
+
+static const uint8_t setGlobalCode[] = {0x48, 0x8B, 0x83, 0, 0, 0, 0, 0x49, 0x89, 0x84, 0x24, 0, 0, 0, 0}; // mov rax, [rbx + a]; mov [r12 + global], rax
+static const Hole setGlobalHoles[] = {{3, HoleA}, {11, HoleGlobal}};
+
+// op rax, [rbx + c]; movsxd rax, eax
+static const uint8_t addI32Code[] = {QAK_LOAD_RAX_B, 0x48, 0x03, 0x83, 0, 0, 0, 0, 0x48, 0x63, 0xC0, QAK_STORE_RAX_A};
+static const uint8_t subI32Code[] = {QAK_LOAD_RAX_B, 0x48, 0x2B, 0x83, 0, 0, 0, 0, 0x48, 0x63, 0xC0, QAK_STORE_RAX_A};
+static const Hole arithmeticI32Holes[] = {{3, HoleB}, {10, HoleC}, {20, HoleA}};
+static const uint8_t mulI32Code[] = {QAK_LOAD_RAX_B, 0x48, 0x0F, 0xAF, 0x83, 0, 0, 0, 0, 0x48, 0x63, 0xC0, QAK_STORE_RAX_A};
+static const Hole mulI32Holes[] = {{3, HoleB}, {11, HoleC}, {21, HoleA}};
+
+// cqo; idiv rcx; movsxd rax, eax or mov rax, rdx
+static const uint8_t divI32Code[] = {QAK_CHECK_DIVISOR, 0x48, 0x99, 0x48, 0xF7, 0xF9, 0x48, 0x63, 0xC0, QAK_STORE_RAX_A};
+static const uint8_t remI32Code[] = {QAK_CHECK_DIVISOR, 0x48, 0x99, 0x48, 0xF7, 0xF9, 0x48, 0x89, 0xD0, QAK_STORE_RAX_A};
+static const Hole divisionI32Holes[] = {{3, HoleB}, {10, HoleC}, {20, HoleSite}, {25, HoleErrorExit}, {40, HoleA}};
+
+// op rax, [rbx + c]
+static const uint8_t addI64Code[] = {QAK_LOAD_RAX_B, 0x48, 0x03, 0x83, 0, 0, 0, 0, QAK_STORE_RAX_A};
+static const uint8_t subI64Code[] = {QAK_LOAD_RAX_B, 0x48, 0x2B, 0x83, 0, 0, 0, 0, QAK_STORE_RAX_A};
+static const uint8_t andCode[] = {QAK_LOAD_RAX_B, 0x48, 0x23, 0x83, 0, 0, 0, 0, QAK_STORE_RAX_A};
+static const uint8_t orCode[] = {QAK_LOAD_RAX_B, 0x48, 0x0B, 0x83, 0, 0, 0, 0, QAK_STORE_RAX_A};
+static const uint8_t xorCode[] = {QAK_LOAD_RAX_B, 0x48, 0x33, 0x83, 0, 0, 0, 0, QAK_STORE_RAX_A};
+static const Hole binaryI64Holes[] = {{3, HoleB}, {10, HoleC}, {17, HoleA}};
+static const uint8_t mulI64Code[] = {QAK_LOAD_RAX_B, 0x48, 0x0F, 0xAF, 0x83, 0, 0, 0, 0, QAK_STORE_RAX_A};
+static const Hole mulI64Holes[] = {{3, HoleB}, {11, HoleC}, {18, HoleA}};
+
+// The quotient of the smallest value and -1 overflows idiv, dividing by -1 negates instead.
+// cmp rcx, -1; jne +5; neg rax; jmp +5; cqo; idiv rcx
+static const uint8_t divI64Code[] = {QAK_CHECK_DIVISOR, 0x48, 0x83, 0xF9, 0xFF, 0x75, 0x05, 0x48, 0xF7, 0xD8, 0xEB, 0x05, 0x48, 0x99, 0x48, 0xF7, 0xF9,
+                                     QAK_STORE_RAX_A};
+static const Hole divI64Holes[] = {{3, HoleB}, {10, HoleC}, {20, HoleSite}, {25, HoleErrorExit}, {48, HoleA}};
+// cmp rcx, -1; jne +4; xor eax, eax; jmp +8; cqo; idiv rcx; mov rax, rdx
+static const uint8_t remI64Code[] = {QAK_CHECK_DIVISOR, 0x48, 0x83, 0xF9, 0xFF, 0x75, 0x04, 0x31, 0xC0, 0xEB, 0x08, 0x48, 0x99, 0x48, 0xF7, 0xF9,
+                                     0x48, 0x89, 0xD0, QAK_STORE_RAX_A};
+static const Hole remI64Holes[] = {{3, HoleB}, {10, HoleC}, {20, HoleSite}, {25, HoleErrorExit}, {50, HoleA}};
+
+// opsd xmm0, [rbx + c], then rounded to float32
+static const uint8_t addF32Code[] = {QAK_LOAD_XMM0(b), 0xF2, 0x0F, 0x58, 0x83, 0, 0, 0, 0, QAK_ROUND_XMM0, QAK_STORE_XMM0_A};
+static const uint8_t subF32Code[] = {QAK_LOAD_XMM0(b), 0xF2, 0x0F, 0x5C, 0x83, 0, 0, 0, 0, QAK_ROUND_XMM0, QAK_STORE_XMM0_A};
+static const uint8_t mulF32Code[] = {QAK_LOAD_XMM0(b), 0xF2, 0x0F, 0x59, 0x83, 0, 0, 0, 0, QAK_ROUND_XMM0, QAK_STORE_XMM0_A};
+static const uint8_t divF32Code[] = {QAK_LOAD_XMM0(b), 0xF2, 0x0F, 0x5E, 0x83, 0, 0, 0, 0, QAK_ROUND_XMM0, QAK_STORE_XMM0_A};
+static const Hole arithmeticF32Holes[] = {{4, HoleB}, {12, HoleC}, {28, HoleA}};
+static const uint8_t addF64Code[] = {QAK_LOAD_XMM0(b), 0xF2, 0x0F, 0x58, 0x83, 0, 0, 0, 0, QAK_STORE_XMM0_A};
+static const uint8_t subF64Code[] = {QAK_LOAD_XMM0(b), 0xF2, 0x0F, 0x5C, 0x83, 0, 0, 0, 0, QAK_STORE_XMM0_A};
+static const uint8_t mulF64Code[] = {QAK_LOAD_XMM0(b), 0xF2, 0x0F, 0x59, 0x83, 0, 0, 0, 0, QAK_STORE_XMM0_A};
+static const uint8_t divF64Code[] = {QAK_LOAD_XMM0(b), 0xF2, 0x0F, 0x5E, 0x83, 0, 0, 0, 0, QAK_STORE_XMM0_A};
+static const Hole arithmeticF64Holes[] = {{4, HoleB}, {12, HoleC}, {20, HoleA}};
+
+// movsd xmm1, [rbx + c]; mov rax, fmod; call rax
+static const uint8_t remF32Code[] = {QAK_LOAD_XMM0(b), 0xF2, 0x0F, 0x10, 0x8B, 0, 0, 0, 0, 0x48, 0xB8, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xD0, QAK_ROUND_XMM0,
+                                     QAK_STORE_XMM0_A};
+static const Hole remF32Holes[] = {{4, HoleB}, {12, HoleC}, {18, HoleFmod}, {40, HoleA}};
+static const uint8_t remF64Code[] = {QAK_LOAD_XMM0(b), 0xF2, 0x0F, 0x10, 0x8B, 0, 0, 0, 0, 0x48, 0xB8, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xD0,
+                                     QAK_STORE_XMM0_A};
+static const Hole remF64Holes[] = {{4, HoleB}, {12, HoleC}, {18, HoleFmod}, {32, HoleA}};
+
+static const uint8_t negI32Code[] = {QAK_LOAD_RAX_B, 0x48, 0xF7, 0xD8, 0x48, 0x63, 0xC0, QAK_STORE_RAX_A}; // neg rax; movsxd rax, eax
+static const Hole negI32Holes[] = {{3, HoleB}, {16, HoleA}};
+static const uint8_t negI64Code[] = {QAK_LOAD_RAX_B, 0x48, 0xF7, 0xD8, QAK_STORE_RAX_A}; // neg rax
+static const Hole negI64Holes[] = {{3, HoleB}, {13, HoleA}};
+static const uint8_t negFCode[] = {QAK_LOAD_RAX_B, 0x48, 0x0F, 0xBA, 0xF8, 0x3F, QAK_STORE_RAX_A}; // btc rax, 63
+static const Hole negFHoles[] = {{3, HoleB}, {15, HoleA}};
+
+// xor rax, 1 or movsx rax, al or movsx rax, ax
+static const uint8_t notCode[] = {QAK_LOAD_RAX_B, 0x48, 0x83, 0xF0, 0x01, QAK_STORE_RAX_A};
+static const uint8_t narrow8Code[] = {QAK_LOAD_RAX_B, 0x48, 0x0F, 0xBE, 0xC0, QAK_STORE_RAX_A};
+static const uint8_t narrow16Code[] = {QAK_LOAD_RAX_B, 0x48, 0x0F, 0xBF, 0xC0, QAK_STORE_RAX_A};
+static const Hole unaryHoles[] = {{3, HoleB}, {14, HoleA}};
+
+// cvtsi2sd xmm0, rax
+static const uint8_t intToF32Code[] = {QAK_LOAD_RAX_B, 0xF2, 0x48, 0x0F, 0x2A, 0xC0, QAK_ROUND_XMM0, QAK_STORE_XMM0_A};
+static const Hole intToF32Holes[] = {{3, HoleB}, {24, HoleA}};
+static const uint8_t intToF64Code[] = {QAK_LOAD_RAX_B, 0xF2, 0x48, 0x0F, 0x2A, 0xC0, QAK_STORE_XMM0_A};
+static const Hole intToF64Holes[] = {{3, HoleB}, {16, HoleA}};
+
+// cmp rax, [rbx + c]; setcc al; movzx eax, al
+#define QAK_COMPARE_I(setcc) QAK_LOAD_RAX_B, 0x48, 0x3B, 0x83, 0, 0, 0, 0, 0x0F, setcc, 0xC0, 0x0F, 0xB6, 0xC0, QAK_STORE_RAX_A
+static const uint8_t eqICode[] = {QAK_COMPARE_I(0x94)};
+static const uint8_t neICode[] = {QAK_COMPARE_I(0x95)};
+static const uint8_t ltICode[] = {QAK_COMPARE_I(0x9C)};
+static const uint8_t leICode[] = {QAK_COMPARE_I(0x9E)};
+static const Hole compareIHoles[] = {{3, HoleB}, {10, HoleC}, {23, HoleA}};
+
+// Unordered operands, i.e. NaNs, set the parity flag and are only not equal.
+// ucomisd xmm0, [rbx + c]; sete al; setnp cl; and al, cl or setne al; setp cl; or al, cl
+#define QAK_COMPARE_F_EQUALITY(setcc, setParity, combine) QAK_LOAD_XMM0(b), 0x66, 0x0F, 0x2E, 0x83, 0, 0, 0, 0, 0x0F, setcc, 0xC0, 0x0F, setParity, 0xC1, \
+    combine, 0xC8, 0x0F, 0xB6, 0xC0, QAK_STORE_RAX_A
+static const uint8_t eqFCode[] = {QAK_COMPARE_F_EQUALITY(0x94, 0x9B, 0x20)};
+static const uint8_t neFCode[] = {QAK_COMPARE_F_EQUALITY(0x95, 0x9A, 0x08)};
+static const Hole compareFEqualityHoles[] = {{4, HoleB}, {12, HoleC}, {30, HoleA}};
+
+// b < c is computed as c > b, which is false for unordered operands.
+// movsd xmm0, [rbx + c]; ucomisd xmm0, [rbx + b]; seta al or setae al
+#define QAK_COMPARE_F_ORDER(setcc) QAK_LOAD_XMM0(c), 0x66, 0x0F, 0x2E, 0x83, 0, 0, 0, 0, 0x0F, setcc, 0xC0, 0x0F, 0xB6, 0xC0, QAK_STORE_RAX_A
+static const uint8_t ltFCode[] = {QAK_COMPARE_F_ORDER(0x97)};
+static const uint8_t leFCode[] = {QAK_COMPARE_F_ORDER(0x93)};
+static const Hole compareFOrderHoles[] = {{4, HoleC}, {12, HoleB}, {25, HoleA}};
+
+static const uint8_t jumpCode[] = {0xE9, 0, 0, 0, 0}; // jmp target
+static const Hole jumpHoles[] = {{1, HoleTarget}};
+
+// cmp qword [rbx + a], 0; je target or jne target
+static const uint8_t jumpIfFalseCode[] = {0x48, 0x83, 0xBB, 0, 0, 0, 0, 0x00, 0x0F, 0x84, 0, 0, 0, 0};
+static const uint8_t jumpIfTrueCode[] = {0x48, 0x83, 0xBB, 0, 0, 0, 0, 0x00, 0x0F, 0x85, 0, 0, 0, 0};
+static const Hole jumpIfHoles[] = {{3, HoleA}, {10, HoleTarget}};
+
+// The called function's registers must fit on the register stack and the number of calls must
+// not exceed the stack size, like in the Interpreter.
+static const uint8_t callCode[] = {
+        0x48, 0x8D, 0x83, 0, 0, 0, 0,       // lea rax, [rbx + frame end]
+        0x4C, 0x39, 0xE8,                   // cmp rax, r13
+        0x76, 0x0A,                         // jbe +10
+        QAK_FAIL,
+        0x49, 0x83, 0xEE, 0x01,             // sub r14, 1
+        0x73, 0x0A,                         // jae +10
+        QAK_FAIL,
+        0x48, 0x81, 0xC3, 0, 0, 0, 0,       // add rbx, a
+        0xE8, 0, 0, 0, 0,                   // call function
+        0x48, 0x81, 0xEB, 0, 0, 0, 0,       // sub rbx, a
+        0x49, 0x83, 0xC6, 0x01              // add r14, 1
+};
+static const Hole callHoles[] = {{3, HoleFrameEnd}, {13, HoleSite}, {18, HoleErrorExit}, {29, HoleSite}, {34, HoleErrorExit}, {41, HoleA},
+                                 {46, HoleFunction}, {53, HoleA}};
+
+// Natives are C functions taking the address of their arguments and their user data, see NativeFunction.
+static const uint8_t callNativeCode[] = {
+        0x48, 0x8D, 0xBB, 0, 0, 0, 0,       // lea rdi, [rbx + a]
+        0x48, 0xBE, 0, 0, 0, 0, 0, 0, 0, 0, // mov rsi, user data
+        0x48, 0xB8, 0, 0, 0, 0, 0, 0, 0, 0, // mov rax, function
+        0xFF, 0xD0,                         // call rax
+        QAK_STORE_RAX_A
+};
+static const Hole callNativeHoles[] = {{3, HoleA}, {9, HoleNativeData}, {19, HoleNative}, {32, HoleA}};
+
+// The return value is stored in the first register of the returning function, which is the call's
+// register in the caller. eax is the type of the module's result.
+static const uint8_t returnCode[] = {
+        0x48, 0x8B, 0x83, 0, 0, 0, 0,       // mov rax, [rbx + a]
+        0x48, 0x89, 0x83, 0, 0, 0, 0,       // mov [rbx], rax
+        0xB8, 0, 0, 0, 0,                   // mov eax, type
+        0x48, 0x83, 0xC4, 0x08,             // add rsp, 8
+        0xC3                                // ret
+};
+static const Hole returnHoles[] = {{3, HoleA}, {15, HoleType}};
+
+static const uint8_t returnNothingCode[] = {
+        0xB8, TypeNothing, 0, 0, 0,         // mov eax, TypeNothing
+        0x48, 0x83, 0xC4, 0x08,             // add rsp, 8
+        0xC3                                // ret
+};
+
+#define QAK_STENCIL(op, code, holes) case op: return Stencil(code, sizeof(code), holes, sizeof(holes) / sizeof(Hole))
+#define QAK_STENCIL_NO_HOLES(op, code) case op: return Stencil(code, sizeof(code), nullptr, 0)
+
+static Stencil stencil(Opcode op) {
+    switch (op) {
+        QAK_STENCIL(OpLoadConstant, loadConstantCode, loadConstantHoles);
+        QAK_STENCIL(OpMove, moveCode, moveHoles);
+        QAK_STENCIL(OpGetGlobal, getGlobalCode, getGlobalHoles);
+        QAK_STENCIL(OpSetGlobal, setGlobalCode, setGlobalHoles);
+        QAK_STENCIL(OpAddI32, addI32Code, arithmeticI32Holes);
+        QAK_STENCIL(OpSubI32, subI32Code, arithmeticI32Holes);
+        QAK_STENCIL(OpMulI32, mulI32Code, mulI32Holes);
+        QAK_STENCIL(OpDivI32, divI32Code, divisionI32Holes);
+        QAK_STENCIL(OpRemI32, remI32Code, divisionI32Holes);
+        QAK_STENCIL(OpAddI64, addI64Code, binaryI64Holes);
+        QAK_STENCIL(OpSubI64, subI64Code, binaryI64Holes);
+        QAK_STENCIL(OpMulI64, mulI64Code, mulI64Holes);
+        QAK_STENCIL(OpDivI64, divI64Code, divI64Holes);
+        QAK_STENCIL(OpRemI64, remI64Code, remI64Holes);
+        QAK_STENCIL(OpAddF32, addF32Code, arithmeticF32Holes);
+        QAK_STENCIL(OpSubF32, subF32Code, arithmeticF32Holes);
+        QAK_STENCIL(OpMulF32, mulF32Code, arithmeticF32Holes);
+        QAK_STENCIL(OpDivF32, divF32Code, arithmeticF32Holes);
+        QAK_STENCIL(OpRemF32, remF32Code, remF32Holes);
+        QAK_STENCIL(OpAddF64, addF64Code, arithmeticF64Holes);
+        QAK_STENCIL(OpSubF64, subF64Code, arithmeticF64Holes);
+        QAK_STENCIL(OpMulF64, mulF64Code, arithmeticF64Holes);
+        QAK_STENCIL(OpDivF64, divF64Code, arithmeticF64Holes);
+        QAK_STENCIL(OpRemF64, remF64Code, remF64Holes);
+        QAK_STENCIL(OpAnd, andCode, binaryI64Holes);
+        QAK_STENCIL(OpOr, orCode, binaryI64Holes);
+        QAK_STENCIL(OpXor, xorCode, binaryI64Holes);
+        QAK_STENCIL(OpNegI32, negI32Code, negI32Holes);
+        QAK_STENCIL(OpNegI64, negI64Code, negI64Holes);
+        QAK_STENCIL(OpNegF, negFCode, negFHoles);
+        QAK_STENCIL(OpNot, notCode, unaryHoles);
+        QAK_STENCIL(OpNarrow8, narrow8Code, unaryHoles);
+        QAK_STENCIL(OpNarrow16, narrow16Code, unaryHoles);
+        QAK_STENCIL(OpIntToF32, intToF32Code, intToF32Holes);
+        QAK_STENCIL(OpIntToF64, intToF64Code, intToF64Holes);
+        QAK_STENCIL(OpEqI, eqICode, compareIHoles);
+        QAK_STENCIL(OpNeI, neICode, compareIHoles);
+        QAK_STENCIL(OpLtI, ltICode, compareIHoles);
+        QAK_STENCIL(OpLeI, leICode, compareIHoles);
+        QAK_STENCIL(OpEqF, eqFCode, compareFEqualityHoles);
+        QAK_STENCIL(OpNeF, neFCode, compareFEqualityHoles);
+        QAK_STENCIL(OpLtF, ltFCode, compareFOrderHoles);
+        QAK_STENCIL(OpLeF, leFCode, compareFOrderHoles);
+        QAK_STENCIL(OpJump, jumpCode, jumpHoles);
+        QAK_STENCIL(OpJumpIfFalse, jumpIfFalseCode, jumpIfHoles);
+        QAK_STENCIL(OpJumpIfTrue, jumpIfTrueCode, jumpIfHoles);
+        QAK_STENCIL(OpCall, callCode, callHoles);
+        QAK_STENCIL(OpCallNative, callNativeCode, callNativeHoles);
+        QAK_STENCIL(OpReturn, returnCode, returnHoles);
+        QAK_STENCIL_NO_HOLES(OpReturnNothing, returnNothingCode);
+        default:
+            return Stencil(nullptr, 0, nullptr, 0);
+    }
+}
+
+#undef QAK_STENCIL
+#undef QAK_STENCIL_NO_HOLES
+
+static QAK_FORCE_INLINE void patch32(Array<uint8_t> &code, size_t offset, uint32_t value) {
+    memcpy(code.buffer() + offset, &value, 4);
+}
+
+static QAK_FORCE_INLINE void patch64(Array<uint8_t> &code, size_t offset, uint64_t value) {
+    memcpy(code.buffer() + offset, &value, 8);
+}
+
+/* A hole whose target is only known after all instructions or functions are copied. */
+struct Relocation {
+    size_t offset;
+    uint32_t target;
+
+    Relocation(size_t offset, uint32_t target) : offset(offset), target(target) {}
+};
+
+static QAK_FORCE_INLINE void patchRelative(Array<uint8_t> &code, size_t offset, size_t target) {
+    patch32(code, offset, (uint32_t) (int32_t) ((int64_t) target - (int64_t) (offset + 4)));
+}
+
+/* Copies the stencils of the function's instructions and patches their holes. Calls are added to
+ * the calls to be patched once all functions are copied. */
+static void compileFunction(Program *program, Function *function, Array<uint8_t> &code, Array<uint32_t> &instructionOffsets,
+                            Array<Relocation> &jumps, Array<Relocation> &calls, Array<Site> &sites) {
+    double (*fmodAddress)(double, double) = fmod;
+    instructionOffsets.clear();
+    jumps.clear();
+    code.addAll(prologueCode, sizeof(prologueCode));
+    for (size_t i = 0; i < function->code.size(); i++) {
+        const Instruction &instruction = function->code[i];
+        Stencil s = stencil((Opcode) instruction.op);
+        size_t start = code.size();
+        instructionOffsets.add((uint32_t) start);
+        code.addAll(s.code, s.size);
+
+        bool isSite = false;
+        for (uint32_t j = 0; j < s.numHoles; j++) {
+            size_t offset = start + s.holes[j].offset;
+            switch (s.holes[j].kind) {
+                case HoleA:
+                    patch32(code, offset, (uint32_t) instruction.a * sizeof(Value));
+                    break;
+                case HoleB:
+                    patch32(code, offset, (uint32_t) instruction.b * sizeof(Value));
+                    break;
+                case HoleC:
+                    patch32(code, offset, (uint32_t) instruction.c * sizeof(Value));
+                    break;
+                case HoleGlobal:
+                    patch32(code, offset, instruction.bx() * (uint32_t) sizeof(Value));
+                    break;
+                case HoleConstant:
+                    patch64(code, offset, (uint64_t) program->constants[instruction.bx()].i);
+                    break;
+                case HoleTarget:
+                    jumps.add(Relocation(offset, instruction.bx()));
+                    break;
+                case HoleFunction:
+                    calls.add(Relocation(offset, instruction.bx()));
+                    break;
+                case HoleSite:
+                    patch32(code, offset, QAK_JIT_ERROR | (uint32_t) sites.size());
+                    isSite = true;
+                    break;
+                case HoleErrorExit:
+                    patchRelative(code, offset, QAK_JIT_ERROR_EXIT);
+                    break;
+                case HoleFrameEnd:
+                    patch32(code, offset, ((uint32_t) instruction.a + program->functions[instruction.bx()]->numRegisters) * (uint32_t) sizeof(Value));
+                    break;
+                case HoleType:
+                    patch32(code, offset, instruction.b);
+                    break;
+                case HoleFmod: {
+                    uint64_t address;
+                    memcpy(&address, &fmodAddress, sizeof(address));
+                    patch64(code, offset, address);
+                    break;
+                }
+                case HoleNative: {
+                    uint64_t address;
+                    memcpy(&address, &program->natives[instruction.bx()].function, sizeof(address));
+                    patch64(code, offset, address);
+                    break;
+                }
+                case HoleNativeData:
+                    patch64(code, offset, (uint64_t) (uintptr_t) program->natives[instruction.bx()].userData);
+                    break;
+            }
+        }
+        if (isSite) sites.add(Site(function, (uint32_t) i));
+    }
+
+    for (size_t i = 0; i < jumps.size(); i++) patchRelative(code, jumps[i].offset, instructionOffsets[jumps[i].target]);
+}
+
+#endif
+
+Jit::Jit(HeapAllocator &mem, size_t stackSize, MemoryMode mode) : _mem(mem), _stackSize(stackSize), _mode(mode), _stack(mem), _globals(mem),
+                                                                  _interpreter(nullptr), _program(nullptr), _code(nullptr), _codeSize(0),
+                                                                  _mappedSize(0), _functionOffsets(mem), _sites(mem), _isNative(false),
+                                                                  _resultType(TypeNothing) {
+    _result.i = 0;
+}
+
+Jit::~Jit() {
+    unmapCode();
+    if (_interpreter) _mem.freeObject(_interpreter, QAK_SRC_LOC);
+}
+
+bool Jit::mapCode(Array<uint8_t> &code) {
+#ifdef QAK_JIT_X64
+    size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+    size_t size = (code.size() + pageSize - 1) / pageSize * pageSize;
+
+    if (_mode == MemoryAuto || _mode == MemoryProtect) {
+        void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory != MAP_FAILED) {
+            memcpy(memory, code.buffer(), code.size());
+            if (mprotect(memory, size, PROT_READ | PROT_EXEC) == 0) {
+                _code = (uint8_t *) memory;
+                _mappedSize = size;
+                return true;
+            }
+            munmap(memory, size);
+        }
+    }
+
+#ifdef SYS_memfd_create
+    // The writable view is unmapped once the code is written, only the executable view remains.
+    if (_mode == MemoryAuto || _mode == MemoryDualMap) {
+        int file = (int) syscall(SYS_memfd_create, "qak-jit", 0);
+        if (file >= 0) {
+            if (ftruncate(file, (off_t) size) == 0) {
+                void *writable = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+                void *executable = mmap(nullptr, size, PROT_READ | PROT_EXEC, MAP_SHARED, file, 0);
+                if (writable != MAP_FAILED) {
+                    memcpy(writable, code.buffer(), code.size());
+                    munmap(writable, size);
+                }
+                if (writable != MAP_FAILED && executable != MAP_FAILED) {
+                    close(file);
+                    _code = (uint8_t *) executable;
+                    _mappedSize = size;
+                    return true;
+                }
+                if (executable != MAP_FAILED) munmap(executable, size);
+            }
+            close(file);
+        }
+    }
+#endif
+#else
+    (void) code;
+#endif
+    return false;
+}
+
+void Jit::unmapCode() {
+#ifdef QAK_JIT_X64
+    if (_code) munmap(_code, _mappedSize);
+#endif
+    _code = nullptr;
+    _codeSize = 0;
+    _mappedSize = 0;
+}
+
+bool Jit::compile(Program *program) {
+    unmapCode();
+    _program = program;
+    _isNative = false;
+    _functionOffsets.clear();
+    _sites.clear();
+
+#ifdef QAK_JIT_X64
+    if (_mode != MemoryInterpreter) {
+        Array<uint8_t> code(_mem);
+        Array<uint32_t> instructionOffsets(_mem);
+        Array<Relocation> jumps(_mem);
+        Array<Relocation> calls(_mem);
+        code.addAll(entryCode, sizeof(entryCode));
+
+        // The module's statements are compiled after the functions.
+        for (size_t i = 0; i <= program->functions.size(); i++) {
+            Function *function = i < program->functions.size() ? program->functions[i] : program->statements;
+            _functionOffsets.add((uint32_t) code.size());
+            compileFunction(program, function, code, instructionOffsets, jumps, calls, _sites);
+        }
+        for (size_t i = 0; i < calls.size(); i++) patchRelative(code, calls[i].offset, _functionOffsets[calls[i].target]);
+
+        if (mapCode(code)) {
+            _codeSize = code.size();
+            _isNative = true;
+        }
+    }
+#endif
+
+    if (!_isNative && !_interpreter) _interpreter = _mem.allocObject<Interpreter>(QAK_SRC_LOC, _mem, _stackSize);
+    return _isNative;
+}
+
+bool Jit::run(Program *program, Errors &errors) {
+    if (program != _program) compile(program);
+    if (!_isNative) return _interpreter->run(program, errors);
+
+#ifdef QAK_JIT_X64
+    Value zero;
+    zero.i = 0;
+    if (_stack.size() != _stackSize) _stack.setSize(_stackSize, zero);
+    _globals.clear();
+    _globals.setSize(program->numGlobals, zero);
+    _result = zero;
+    _resultType = TypeNothing;
+
+    Function *statements = program->statements;
+    if (statements->numRegisters > _stackSize) {
+        errors.add(program->module->tokens[statements->tokens[0]], "Stack overflow.");
+        return false;
+    }
+
+    typedef uint32_t (*Entry)(Value *registers, Value *globals, Value *stackEnd, uint64_t calls, const uint8_t *function);
+    Entry entry;
+    memcpy(&entry, &_code, sizeof(entry));
+    uint32_t status = entry(_stack.buffer(), _globals.buffer(), _stack.buffer() + _stackSize, _stackSize - 1,
+                            _code + _functionOffsets[program->functions.size()]);
+
+    if (status & QAK_JIT_ERROR) {
+        Site &site = _sites[status & ~QAK_JIT_ERROR];
+        bool isCall = site.function->code[site.instruction].op == OpCall;
+        errors.add(program->module->tokens[site.function->tokens[site.instruction]], isCall ? "Stack overflow." : "Division by zero.");
+        return false;
+    }
+    _resultType = status;
+    if (_resultType != TypeNothing) _result = _stack[0];
+    return true;
+#else
+    (void) errors;
+    return false;
+#endif
+}
+
+bool Jit::writePerfMap(const char *fileName) {
+#ifdef QAK_JIT_X64
+    if (!_isNative) return false;
+    char defaultName[64];
+    if (!fileName) {
+        snprintf(defaultName, sizeof(defaultName), "/tmp/perf-%d.map", (int) getpid());
+        fileName = defaultName;
+    }
+    FILE *file = fopen(fileName, "a");
+    if (!file) return false;
+
+    Token &moduleName = _program->module->tokens[_program->module->name];
+    fprintf(file, "%lx %lx qak::entry\n", (unsigned long) (uintptr_t) _code, (unsigned long) _functionOffsets[0]);
+    for (size_t i = 0; i < _functionOffsets.size(); i++) {
+        size_t end = i + 1 < _functionOffsets.size() ? _functionOffsets[i + 1] : _codeSize;
+        fprintf(file, "%lx %lx qak::%.*s", (unsigned long) (uintptr_t) (_code + _functionOffsets[i]), (unsigned long) (end - _functionOffsets[i]),
+                (int) moduleName.length(), (const char *) moduleName.source.data + moduleName.start);
+        if (i < _program->functions.size()) {
+            Token &name = _program->module->tokens[_program->functions[i]->name];
+            fprintf(file, "::%.*s", (int) name.length(), (const char *) name.source.data + name.start);
+        }
+        fprintf(file, "\n");
+    }
+    return fclose(file) == 0;
+#else
+    (void) fileName;
+    return false;
+#endif
+}
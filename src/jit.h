@@ -0,0 +1,114 @@
+#ifndef QAK_JIT_H
+#define QAK_JIT_H
+
+#include "interpreter.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#define QAK_JIT_X64
+#endif
+
+namespace qak {
+    namespace jit {
+        /* How a Jit gets executable memory for the code it compiles. Memory is never writable and
+         * executable at the same time. MemoryProtect writes the code to private memory, then makes
+         * it executable. MemoryDualMap maps a shared memory file twice, once writable and once
+         * executable, which works where making written memory executable is forbidden. MemoryAuto
+         * tries both in that order. If no executable memory can be had, or the platform is not
+         * x86-64 Linux, the Jit runs programs with the Interpreter instead. */
+        enum MemoryMode {
+            MemoryAuto,
+            MemoryProtect,
+            MemoryDualMap,
+            MemoryInterpreter
+        };
+
+        /* Where an instruction that can fail was compiled to, see Jit::run(). */
+        struct Site {
+            bytecode::Function *function;
+            uint32_t instruction;
+
+            Site(bytecode::Function *function, uint32_t instruction) : function(function), instruction(instruction) {}
+        };
+    }
+
+    /* Compiles bytecode::Programs to x86-64 machine code by copy and patch, then runs them. Each
+     * opcode has a stencil, a precompiled sequence of machine code with holes for its operands.
+     * A function is compiled by copying the stencil of each of its instructions and patching the
+     * holes with register offsets, constants, and the offsets of jump targets and called functions.
+     *
+     * The compiled code works on the same register stack as the Interpreter and follows its
+     * semantics, including its errors. Calls are native calls, taking 16 bytes of the native stack
+     * each, so the native stack must hold 16 bytes per entry of the register stack. Errors jump to a
+     * stub that unwinds the native stack of all active functions at once.
+     *
+     * Programs are run with the Interpreter if no executable memory is available, see
+     * jit::MemoryMode. */
+    class Jit {
+    private:
+        HeapAllocator &_mem;
+        size_t _stackSize;
+        jit::MemoryMode _mode;
+        Array<bytecode::Value> _stack;
+        Array<bytecode::Value> _globals;
+
+        /* Runs programs if there is no executable memory, allocated on first use. */
+        Interpreter *_interpreter;
+
+        // The compiled program and its code, see compile().
+        bytecode::Program *_program;
+        uint8_t *_code;
+        size_t _codeSize;
+        size_t _mappedSize;
+        Array<uint32_t> _functionOffsets;
+        Array<jit::Site> _sites;
+
+        bool _isNative;
+        bytecode::Value _result;
+        TypeId _resultType;
+
+        Jit(const Jit &other) = delete;
+
+        bool mapCode(Array<uint8_t> &code);
+
+        void unmapCode();
+
+    public:
+        Jit(HeapAllocator &mem, size_t stackSize = QAK_DEFAULT_STACK_SIZE, jit::MemoryMode mode = jit::MemoryAuto);
+
+        ~Jit();
+
+        /* Compiles the program to machine code. Returns false if executable memory is not available,
+         * then run() uses the Interpreter. Compiling is done by run() if needed. */
+        bool compile(bytecode::Program *program);
+
+        /* Runs the program like Interpreter::run(), compiling it first unless it was the program
+         * compiled last. */
+        bool run(bytecode::Program *program, Errors &errors);
+
+        /* Returns whether the program compiled last runs as machine code. */
+        bool isNative() {
+            return _isNative;
+        }
+
+        /* Appends the address, size and name of each compiled function to the perf map file, by
+         * default /tmp/perf-<pid>.map, so perf can name the functions in its reports. Returns false
+         * if nothing was compiled or the file could not be written. */
+        bool writePerfMap(const char *fileName = nullptr);
+
+        /* Returns the value of the module variable with the slot, see ast::Symbol::slot. */
+        bytecode::Value global(uint32_t slot) {
+            return _isNative ? _globals[slot] : _interpreter->global(slot);
+        }
+
+        /* Returns the value returned by the module's statements and its type, see Interpreter::result(). */
+        bytecode::Value result() {
+            return _isNative ? _result : _interpreter->result();
+        }
+
+        TypeId resultType() {
+            return _isNative ? _resultType : _interpreter->resultType();
+        }
+    };
+}
+
+#endif //QAK_JIT_H
@@ -0,0 +1,177 @@
+#include "layout.h"
+
+using namespace qak;
+
+using namespace qak::ast;
+
+#define QAK_TOKEN_TEXT(token) (int) (token).length(), (const char *) (token).source.data + (token).start
+
+/* The largest alignment of a field, the alignment of 8 byte primitives. */
+#define QAK_MAX_ALIGNMENT 8
+
+/* Returns the size and alignment of the primitive type, or 0 if values of the type can not be stored in fields. */
+static uint32_t primitiveSize(TypeId type) {
+    switch (type) {
+        case TypeBoolean:
+        case TypeInt8:
+            return 1;
+        case TypeInt16:
+            return 2;
+        case TypeInt32:
+        case TypeFloat32:
+        case TypeCharacter:
+            return 4;
+        case TypeInt64:
+        case TypeFloat64:
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+static QAK_FORCE_INLINE bool isSameName(Token &a, Token &b) {
+    return a.length() == b.length() && memcmp(a.source.data + a.start, b.source.data + b.start, a.length()) == 0;
+}
+
+int32_t LayoutEngine::find(Module *module, const uint8_t *name, uint32_t length) {
+    for (size_t i = 0; i < module->types.size(); i++) {
+        Token &typeName = module->tokens[module->types[i]->name];
+        if (typeName.length() == length && memcmp(typeName.source.data + typeName.start, name, length) == 0) return (int32_t) i;
+    }
+    return -1;
+}
+
+/* Reports types that are declared twice or shadow a primitive type, and fields that are declared
+ * twice in the same type, then resolves the types of the fields. */
+void LayoutEngine::declareTypes() {
+    FixedArray<TypeDeclaration *> &types = _module->types;
+    for (size_t i = 0; i < types.size(); i++) {
+        TypeDeclaration *type = types[i];
+        Token &name = _module->tokens[type->name];
+        if (_types->named(name.source.data + name.start, name.length()) != TypeError ||
+            find(_module, name.source.data + name.start, name.length()) != (int32_t) i) {
+            _errors->add(name, "Type '%.*s' is already declared.", QAK_TOKEN_TEXT(name));
+        }
+
+        for (size_t j = 0; j < type->fields.size(); j++) {
+            Field *field = type->fields[j];
+            Token &fieldName = _module->tokens[field->firstToken];
+            for (size_t k = 0; k < j; k++) {
+                if (!isSameName(fieldName, _module->tokens[type->fields[k]->firstToken])) continue;
+                _errors->add(fieldName, "Field '%.*s' is already declared.", QAK_TOKEN_TEXT(fieldName));
+                break;
+            }
+            resolveField(field);
+        }
+    }
+}
+
+/* Sets the type of the field, and the size and alignment of fields of a primitive type. */
+void LayoutEngine::resolveField(Field *field) {
+    Token &name = _module->tokens[field->typeSpecifier->firstToken];
+    field->type = TypeError;
+    field->valueType = -1;
+    field->offset = field->size = 0;
+    field->alignment = 1;
+
+    TypeId type = _types->named(name.source.data + name.start, name.length());
+    if (type != TypeError) {
+        uint32_t size = primitiveSize(type);
+        if (size == 0) {
+            _errors->add(name, "Fields of type %s are not supported.", _types->name(type));
+            return;
+        }
+        field->type = type;
+        field->size = field->alignment = size;
+        return;
+    }
+
+    field->valueType = find(_module, name.source.data + name.start, name.length());
+    if (field->valueType < 0) _errors->add(name, "Unknown type '%.*s'.", QAK_TOKEN_TEXT(name));
+}
+
+/* Sets the offsets of the fields and the size and alignment of the type. The value types of its fields are laid out. */
+void LayoutEngine::layoutType(TypeDeclaration *type) {
+    FixedArray<Field *> &fields = type->fields;
+    for (size_t i = 0; i < fields.size(); i++) {
+        Field *field = fields[i];
+        if (field->valueType < 0) continue;
+        TypeDeclaration *valueType = _module->types[(size_t) field->valueType];
+        field->size = valueType->size;
+        field->alignment = valueType->alignment;
+    }
+
+    uint32_t offset = 0;
+    if (type->isPacked) {
+        for (size_t i = 0; i < fields.size(); i++) {
+            fields[i]->alignment = 1;
+            fields[i]->offset = offset;
+            offset += fields[i]->size;
+        }
+        type->size = offset;
+        type->alignment = 1;
+        return;
+    }
+
+    // Fields are placed by decreasing alignment, unless the order of their declaration must be kept.
+    uint32_t alignment = 1;
+    for (uint32_t fieldAlignment = QAK_MAX_ALIGNMENT; fieldAlignment > 0; fieldAlignment /= 2) {
+        for (size_t i = 0; i < fields.size(); i++) {
+            Field *field = fields[i];
+            if (!type->isCCompatible && field->alignment != fieldAlignment) continue;
+            offset = (offset + field->alignment - 1) & ~(field->alignment - 1);
+            field->offset = offset;
+            offset += field->size;
+            if (field->alignment > alignment) alignment = field->alignment;
+        }
+        if (type->isCCompatible) break;
+    }
+    type->size = (offset + alignment - 1) & ~(alignment - 1);
+    type->alignment = alignment;
+}
+
+bool LayoutEngine::layout(Module *module, TypeTable &types, Errors &errors) {
+    _module = module;
+    _types = &types;
+    _errors = &errors;
+    size_t numErrors = errors.getErrors().size();
+    declareTypes();
+
+    // The value types of fields are laid out before the types containing them, by a depth-first
+    // walk over the fields. A field of a type that is still being visited closes a cycle.
+    _states.clear();
+    _states.setSize(module->types.size(), Unvisited);
+    for (size_t i = 0; i < module->types.size(); i++) {
+        if (_states[i] != Unvisited) continue;
+        _states[i] = Visiting;
+        _stack.clear();
+        _stack.add(Item((uint32_t) i, 0));
+        while (_stack.size() > 0) {
+            size_t top = _stack.size() - 1;
+            TypeDeclaration *type = module->types[_stack[top].type];
+            if (_stack[top].nextField == type->fields.size()) {
+                layoutType(type);
+                _states[_stack[top].type] = Done;
+                _stack.removeAt(top);
+                continue;
+            }
+
+            Field *field = type->fields[_stack[top].nextField++];
+            if (field->valueType < 0) continue;
+            State &state = _states[(size_t) field->valueType];
+            if (state == Visiting) {
+                Token &name = module->tokens[field->typeSpecifier->firstToken];
+                _errors->add(name, "Type '%.*s' can not contain itself.", QAK_TOKEN_TEXT(name));
+                field->valueType = -1;
+            } else if (state == Unvisited) {
+                state = Visiting;
+                _stack.add(Item((uint32_t) field->valueType, 0));
+            }
+        }
+    }
+
+    _module = nullptr;
+    _types = nullptr;
+    _errors = nullptr;
+    return errors.getErrors().size() == numErrors;
+}
@@ -0,0 +1,73 @@
+#ifndef QAK_LAYOUT_H
+#define QAK_LAYOUT_H
+
+#include "typechecker.h"
+
+namespace qak {
+    /* Computes the memory layout of the value types of a module, see ast::TypeDeclaration. The offset,
+     * size and alignment of each field and the size and alignment of each type are stored in the nodes.
+     * Fields are of the primitive types boolean, integers, floats and character, stored at their natural
+     * size and alignment, or of value types of the module, which are laid out first.
+     *
+     * Fields of packed types are stored in the order of their declaration without padding, the type and
+     * its fields have an alignment of 1. Fields of C-compatible types are stored in the order of their
+     * declaration at their natural alignment, like a C compiler lays out a struct with the same members.
+     * Fields of other types are ordered by decreasing alignment, keeping the order of their declaration
+     * for fields of the same alignment. As alignments are powers of two, only the end of such a type is
+     * padded to a multiple of its alignment.
+     *
+     * Arrays of count elements of a type take count * size bytes. Arrays of types stored as
+     * structure-of-arrays store the values of each field one after the other, starting at count times
+     * the offset of the field, so the values of a field are aligned and can be accessed with a stride
+     * of the field's size, see arrayFieldOffset(). */
+    class LayoutEngine {
+    private:
+        /* A type whose fields are being laid out, by its index in Module::types, and the next of its fields to visit. */
+        struct Item {
+            uint32_t type;
+            uint32_t nextField;
+
+            Item(uint32_t type, uint32_t nextField) : type(type), nextField(nextField) {}
+        };
+
+        enum State {
+            Unvisited,
+            Visiting,
+            Done
+        };
+
+        Array<State> _states;
+        Array<Item> _stack;
+
+        // Set on each call to layout.
+        ast::Module *_module;
+        TypeTable *_types;
+        Errors *_errors;
+
+        void declareTypes();
+
+        void resolveField(ast::Field *field);
+
+        void layoutType(ast::TypeDeclaration *type);
+
+    public:
+        LayoutEngine(HeapAllocator &mem) : _states(mem), _stack(mem), _module(nullptr), _types(nullptr), _errors(nullptr) {}
+
+        /* Lays out the value types of the module. Unknown, unsupported and duplicate names and value
+         * types containing themselves are reported in the errors. Returns false if there were errors,
+         * in which case the fields that could not be laid out have a size of 0. */
+        bool layout(ast::Module *module, TypeTable &types, Errors &errors);
+
+        /* Returns the index of the value type with the given name in Module::types, or -1 if there is none. */
+        static int32_t find(ast::Module *module, const uint8_t *name, uint32_t length);
+
+        /* Returns the offset of the field of the element at the index of an array of count elements of the
+         * type, relative to the start of the array. See qak_array_field_offset(). */
+        static QAK_FORCE_INLINE size_t arrayFieldOffset(ast::TypeDeclaration *type, ast::Field *field, size_t index, size_t count) {
+            if (type->isStructureOfArrays) return field->offset * count + index * field->size;
+            return index * type->size + field->offset;
+        }
+    };
+}
+
+#endif //QAK_LAYOUT_H
@@ -0,0 +1,289 @@
+#include "literals.h"
+#include "memory.h"
+#include <cmath>
+#include <locale>
+#include <sstream>
+
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#  define QAK_AVX2
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define QAK_SSE2
+#endif
+
+#ifdef _MSC_VER
+#  include <intrin.h>
+static QAK_FORCE_INLINE uint32_t countTrailingZeros(uint32_t value) {
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return (uint32_t) index;
+}
+#else
+static QAK_FORCE_INLINE uint32_t countTrailingZeros(uint32_t value) {
+    return (uint32_t) __builtin_ctz(value);
+}
+#endif
+
+using namespace qak;
+
+/* Powers of ten that are exactly representable as a double (5^22 < 2^53). */
+static const double doublePowersOfTen[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* Powers of ten that are exactly representable as a float (5^10 < 2^24). */
+static const float floatPowersOfTen[] = {
+        1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
+
+/* The decimal digits of a number of the form [0-9]+(.[0-9]*)?, with leading zeros
+ * removed. The number equals mantissa / 10^numFractionDigits if numDigits <= 19. */
+struct DecimalDigits {
+    uint64_t mantissa;
+    uint32_t numDigits;
+    uint32_t numFractionDigits;
+};
+
+static QAK_FORCE_INLINE void scanDecimalDigits(const uint8_t *data, uint32_t length, DecimalDigits &digits) {
+    digits.mantissa = 0;
+    digits.numDigits = 0;
+    digits.numFractionDigits = 0;
+    bool isFraction = false;
+    for (uint32_t i = 0; i < length; i++) {
+        uint8_t c = data[i];
+        if (c == '.') {
+            isFraction = true;
+            continue;
+        }
+        digits.numFractionDigits += isFraction;
+        if (digits.numDigits == 0 && c == '0') continue;
+        // Accumulating more than 19 digits overflows, in which case we
+        // use the slow path anyways, see parseDouble() and parseFloat().
+        digits.mantissa = digits.mantissa * 10 + (c - '0');
+        digits.numDigits++;
+    }
+}
+
+/* Parses the bytes with the classic "C" locale. strtod() and strtof() expect the decimal point of the
+ * current locale, e.g. a comma in a German locale, and would stop at the '.' of a literal. */
+template<typename T>
+static bool parseClassic(const uint8_t *data, uint32_t length, T *value) {
+    std::istringstream stream(std::string((const char *) data, length));
+    stream.imbue(std::locale::classic());
+    stream >> *value;
+    return !stream.fail() && std::isfinite(*value);
+}
+
+bool literals::parseDecimal(const uint8_t *data, uint32_t length, uint64_t *value) {
+    uint32_t i = 0;
+    while (i < length && data[i] == '0') i++;
+
+    // Up to 19 digits always fit into 64-bits, so we don't need
+    // to check for overflow on each digit.
+    uint32_t numDigits = length - i;
+    if (numDigits > 20) return false;
+
+    uint64_t result = 0;
+    uint32_t uncheckedEnd = numDigits == 20 ? length - 1 : length;
+    for (; i < uncheckedEnd; i++) {
+        result = result * 10 + (data[i] - '0');
+    }
+
+    if (uncheckedEnd != length) {
+        uint64_t lastDigit = data[length - 1] - '0';
+        if (result > (UINT64_MAX - lastDigit) / 10) return false;
+        result = result * 10 + lastDigit;
+    }
+
+    *value = result;
+    return true;
+}
+
+bool literals::parseHex(const uint8_t *data, uint32_t length, uint64_t *value) {
+    uint32_t i = 0;
+    while (i < length && data[i] == '0') i++;
+    if (length - i > 16) return false;
+
+    uint64_t result = 0;
+    for (; i < length; i++) {
+        // Maps [0-9] to 0-9 and [a-fA-F] to 10-15 without branching.
+        uint8_t c = data[i];
+        result = (result << 4) | (uint64_t) ((c & 0xf) + 9 * (c >> 6));
+    }
+    *value = result;
+    return true;
+}
+
+bool literals::parseDouble(const uint8_t *data, uint32_t length, double *value) {
+    DecimalDigits digits;
+    scanDecimalDigits(data, length, digits);
+
+    // Fast path (Clinger): if both the mantissa and the power of ten are
+    // exactly representable as doubles, a single division is correctly rounded.
+    if (digits.numDigits <= 19 && digits.mantissa <= (1ull << 53) && digits.numFractionDigits <= 22) {
+        *value = (double) digits.mantissa / doublePowersOfTen[digits.numFractionDigits];
+        return true;
+    }
+
+    return parseClassic(data, length, value);
+}
+
+bool literals::parseFloat(const uint8_t *data, uint32_t length, float *value) {
+    DecimalDigits digits;
+    scanDecimalDigits(data, length, digits);
+
+    // Same as the fast path in parseDouble(), going through a double
+    // would round twice and could give a different result.
+    if (digits.numDigits <= 19 && digits.mantissa <= (1ull << 24) && digits.numFractionDigits <= 10) {
+        *value = (float) digits.mantissa / floatPowersOfTen[digits.numFractionDigits];
+        return true;
+    }
+
+    return parseClassic(data, length, value);
+}
+
+/* Returns the index of the first backslash in data[index, length), or length if there
+ * is none. Checks 32 or 16 bytes at a time if AVX2 or SSE2 are available. */
+static QAK_FORCE_INLINE uint32_t findBackslash(const uint8_t *data, uint32_t index, uint32_t length) {
+#ifdef QAK_AVX2
+    const __m256i backslashes32 = _mm256_set1_epi8('\\');
+    while (index + 32 <= length) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *) (data + index));
+        uint32_t mask = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, backslashes32));
+        if (mask != 0) return index + countTrailingZeros(mask);
+        index += 32;
+    }
+#endif
+#ifdef QAK_SSE2
+    const __m128i backslashes16 = _mm_set1_epi8('\\');
+    while (index + 16 <= length) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *) (data + index));
+        uint32_t mask = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, backslashes16));
+        if (mask != 0) return index + countTrailingZeros(mask);
+        index += 16;
+    }
+#endif
+    const uint8_t *backslash = (const uint8_t *) memchr(data + index, '\\', length - index);
+    return backslash ? (uint32_t) (backslash - data) : length;
+}
+
+int32_t literals::decodeEscapes(const uint8_t *data, uint32_t length, Array<uint8_t> &decoded) {
+    uint32_t index = 0;
+    while (index < length) {
+        // Copy the run of bytes up to the next escape sequence in one go.
+        uint32_t backslash = findBackslash(data, index, length);
+        decoded.addAll(data + index, backslash - index);
+        if (backslash == length) break;
+
+        if (backslash + 1 == length) return (int32_t) backslash;
+        uint8_t c;
+        switch (data[backslash + 1]) {
+            case 'n':
+                c = '\n';
+                break;
+            case 'r':
+                c = '\r';
+                break;
+            case 't':
+                c = '\t';
+                break;
+            case '0':
+                c = 0;
+                break;
+            case '\\':
+            case '"':
+            case '\'':
+                c = data[backslash + 1];
+                break;
+            default:
+                return (int32_t) backslash;
+        }
+        decoded.add(c);
+        index = backslash + 2;
+    }
+    return -1;
+}
+
+uint32_t literals::decodeUtf8(const uint8_t *data, uint32_t length, uint32_t *codePoint) {
+    if (length == 0) return 0;
+    uint8_t c = data[0];
+    uint32_t numBytes;
+    uint32_t result;
+    uint32_t minCodePoint;
+    if (c < 0x80) {
+        *codePoint = c;
+        return 1;
+    } else if ((c & 0xe0) == 0xc0) {
+        numBytes = 2;
+        result = c & 0x1f;
+        minCodePoint = 0x80;
+    } else if ((c & 0xf0) == 0xe0) {
+        numBytes = 3;
+        result = c & 0x0f;
+        minCodePoint = 0x800;
+    } else if ((c & 0xf8) == 0xf0) {
+        numBytes = 4;
+        result = c & 0x07;
+        minCodePoint = 0x10000;
+    } else {
+        return 0;
+    }
+    if (numBytes > length) return 0;
+    for (uint32_t i = 1; i < numBytes; i++) {
+        if ((data[i] & 0xc0) != 0x80) return 0;
+        result = (result << 6) | (data[i] & 0x3f);
+    }
+
+    // Overlong encodings, UTF-16 surrogates and code points beyond U+10FFFF are not characters.
+    if (result < minCodePoint) return 0;
+    if (result >= 0xd800 && result <= 0xdfff) return 0;
+    if (result > 0x10ffff) return 0;
+    *codePoint = result;
+    return numBytes;
+}
+
+/* Accepts the interned string with the bytes, see HashIndex::find(). */
+struct IsString {
+    const uint8_t *data;
+    uint32_t length;
+
+    IsString(const uint8_t *data, uint32_t length) : data(data), length(length) {}
+
+    QAK_FORCE_INLINE bool operator()(InternedString &string) const {
+        return string.length == length && (length == 0 || memcmp(string.data, data, length) == 0);
+    }
+};
+
+void StringPool::reset(BumpAllocator &mem) {
+    _mem = &mem;
+    _strings.clear();
+    _table.clear();
+}
+
+void StringPool::reset(BumpAllocator &mem, FixedArray<InternedString> &strings) {
+    _mem = &mem;
+    _strings.clear();
+    if (strings.size() > 0) _strings.addAll(&strings[0], strings.size());
+    _table.rehash(_strings);
+}
+
+uint32_t StringPool::intern(const uint8_t *data, uint32_t length) {
+    _table.reserve(_strings);
+    uint32_t hash = hashBytes(data, length);
+    size_t slot;
+    int32_t found = _table.find(_strings, hash, IsString(data, length), slot);
+    if (found >= 0) return (uint32_t) found;
+
+    uint8_t *copy = _mem->alloc<uint8_t>(length + 1);
+    if (length > 0) memcpy(copy, data, length);
+    copy[length] = 0;
+
+    uint32_t index = (uint32_t) _strings.size();
+    _strings.add(InternedString(copy, length, hash));
+    _table.set(slot, (int32_t) index);
+    return index;
+}
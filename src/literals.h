@@ -0,0 +1,110 @@
+#ifndef QAK_LITERALS_H
+#define QAK_LITERALS_H
+
+#include "types.h"
+#include "array.h"
+#include "hash.h"
+
+namespace qak {
+
+    /* The decoded value of a literal token. Which member is valid depends on the
+     * type of the token, e.g. a ByteLiteral stores its value in byteValue, a
+     * DoubleLiteral stores its value in doubleValue. See tokenizer::tokenize(). */
+    union LiteralValue {
+        bool booleanValue;
+        int8_t byteValue;
+        int16_t shortValue;
+        int32_t intValue;
+        int64_t longValue;
+        float floatValue;
+        double doubleValue;
+
+        /* The Unicode code point of a character literal. */
+        uint32_t characterValue;
+
+        /* The index of the decoded string literal in its StringPool. */
+        uint32_t stringIndex;
+    };
+
+    /* A string stored in a StringPool. The bytes are followed by a null terminator which is not
+     * included in the length. */
+    struct InternedString {
+        const uint8_t *data;
+        uint32_t length;
+        uint32_t hash;
+
+        InternedString(const uint8_t *data, uint32_t length, uint32_t hash) : data(data), length(length), hash(hash) {}
+    };
+
+    /* A StringPool stores each distinct string exactly once. The bytes of the strings are
+     * allocated in a BumpAllocator, e.g. the arena of a module, and stay valid as long as
+     * that allocator. Each string is identified by its index in the pool, see StringPool::intern().
+     * The pool's lookup structures are kept between calls to StringPool::reset() so they can
+     * be reused without allocating. */
+    class StringPool {
+    private:
+        BumpAllocator *_mem;
+        Array<InternedString> _strings;
+
+        /* The indices of _strings by their hashes. */
+        HashIndex<InternedString> _table;
+
+        StringPool(const StringPool &other) = delete;
+
+    public:
+        StringPool(HeapAllocator &mem) : _mem(nullptr), _strings(mem), _table(mem) {}
+
+        /* Removes all strings from the pool. New strings will be allocated in the
+         * given BumpAllocator. */
+        void reset(BumpAllocator &mem);
+
+        /* Removes all strings from the pool and adds the strings, which keep their indices.
+         * Their bytes and hashes are used as is. New strings will be allocated in the given
+         * BumpAllocator. */
+        void reset(BumpAllocator &mem, FixedArray<InternedString> &strings);
+
+        /* Allocates new strings in the given BumpAllocator, keeping the strings in the pool. */
+        void setMem(BumpAllocator &mem) {
+            _mem = &mem;
+        }
+
+        /* Returns the index of the string in the pool. The bytes are copied to the
+         * BumpAllocator if the pool does not contain the string yet. */
+        uint32_t intern(const uint8_t *data, uint32_t length);
+
+        /* Returns the strings in the pool, in the order they were first added. */
+        Array<InternedString> &strings() {
+            return _strings;
+        }
+    };
+
+    namespace literals {
+        /* Parses a sequence of decimal digits ([0-9]+) into an unsigned 64-bit value.
+         * Returns false if the value does not fit into 64-bits. */
+        bool parseDecimal(const uint8_t *data, uint32_t length, uint64_t *value);
+
+        /* Parses a sequence of hexadecimal digits ([0-9a-fA-F]+), without the 0x prefix,
+         * into an unsigned 64-bit value. Returns false if the value does not fit into 64-bits. */
+        bool parseHex(const uint8_t *data, uint32_t length, uint64_t *value);
+
+        /* Parses a decimal number of the form [0-9]+(.[0-9]*)? into the nearest double.
+         * Returns false if the value is not finite. */
+        bool parseDouble(const uint8_t *data, uint32_t length, double *value);
+
+        /* Parses a decimal number of the form [0-9]+(.[0-9]*)? into the nearest float.
+         * Returns false if the value is not finite. */
+        bool parseFloat(const uint8_t *data, uint32_t length, float *value);
+
+        /* Decodes the escape sequences \n, \r, \t, \0, \\, \" and \' in the bytes, and appends the
+         * result to decoded. Returns -1 on success, or the offset of the first invalid escape
+         * sequence in the bytes. */
+        int32_t decodeEscapes(const uint8_t *data, uint32_t length, Array<uint8_t> &decoded);
+
+        /* Decodes the first UTF-8 character in the bytes and returns the number of bytes
+         * it occupies, or 0 if the bytes do not start with a valid UTF-8 character. Overlong
+         * encodings, surrogates and code points beyond U+10FFFF are invalid. */
+        uint32_t decodeUtf8(const uint8_t *data, uint32_t length, uint32_t *codePoint);
+    }
+}
+
+#endif //QAK_LITERALS_H
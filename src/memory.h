@@ -3,6 +3,7 @@
 
 #include "types.h"
 #include <map>
+#include <stdlib.h>
 #include <string.h>
 #include <cstdio>
 
@@ -104,6 +105,20 @@ namespace qak {
             }
         }
 
+        /* Moves the record of an allocation to another allocator, which then frees it. Not
+         * thread-safe, neither allocator may be used concurrently. */
+        void transfer(void *ptr, HeapAllocator &to) {
+            std::map<void *, Allocation>::iterator it = _allocations.find(ptr);
+            if (it == _allocations.end()) {
+                printf("(address %p): Transfer of memory not allocated through qak::memory\n", ptr);
+                return;
+            }
+            to._allocations[ptr] = it->second;
+            to._totalAllocations++;
+            _allocations.erase(it);
+            _totalFrees++;
+        }
+
         void printAllocations() {
             if (_allocations.size() > 0) {
                 uint64_t totalSize = 0;
@@ -161,12 +176,18 @@ namespace qak {
     struct BumpAllocator {
         HeapAllocator &mem;
         Block *head;
+
+        /* The last block, so adopting the blocks of an allocator does not walk them. */
+        Block *tail;
         size_t blockSize;
 
-        BumpAllocator(HeapAllocator &mem) : mem(mem), head(nullptr), blockSize(QAK_BLOCK_SIZE) {
+        /* The number of bytes allocated so far, including those of adopted allocators. */
+        size_t numBytes;
+
+        BumpAllocator(HeapAllocator &mem) : mem(mem), head(nullptr), tail(nullptr), blockSize(QAK_BLOCK_SIZE), numBytes(0) {
         }
 
-        BumpAllocator(HeapAllocator &mem, size_t blockSize) : mem(mem), head(nullptr), blockSize(blockSize) {
+        BumpAllocator(HeapAllocator &mem, size_t blockSize) : mem(mem), head(nullptr), tail(nullptr), blockSize(blockSize), numBytes(0) {
         };
 
         BumpAllocator(BumpAllocator const &) = delete;
@@ -189,18 +210,46 @@ namespace qak {
             if (head == nullptr || !head->canStore(size)) {
                 Block *newHead = mem.allocObject<Block>(QAK_SRC_LOC, blockSize < size ? size * 2 : blockSize);
                 newHead->next = head;
+                if (head == nullptr) tail = newHead;
                 head = newHead;
             }
 
+            numBytes += size;
             return (T *) head->alloc(size);
         }
 
+        /* Takes ownership of the blocks of the other allocator, which is left empty. The
+         * blocks are appended after the current head, so allocation continues in it. Blocks
+         * are only walked and transferred if the allocators use different heap allocators. */
+        void adopt(BumpAllocator &other) {
+            if (other.head == nullptr) return;
+
+            if (&other.mem != &mem) {
+                for (Block *block = other.head; block; block = block->next) other.mem.transfer(block, mem);
+            }
+
+            if (head == nullptr) {
+                head = other.head;
+                tail = other.tail;
+            } else {
+                other.tail->next = head->next;
+                if (head->next == nullptr) tail = other.tail;
+                head->next = other.head;
+            }
+            other.head = nullptr;
+            other.tail = nullptr;
+            numBytes += other.numBytes;
+            other.numBytes = 0;
+        }
+
         void free() {
             while (head) {
                 Block *block = head;
                 head = block->next;
                 mem.freeObject<Block>(block, QAK_SRC_LOC);
             }
+            tail = nullptr;
+            numBytes = 0;
         }
     };
 }
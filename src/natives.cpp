@@ -0,0 +1,48 @@
+#include "natives.h"
+
+using namespace qak;
+
+/* Accepts the native with the name, see HashIndex::find(). */
+struct IsNative {
+    const uint8_t *name;
+    uint32_t length;
+
+    IsNative(const uint8_t *name, uint32_t length) : name(name), length(length) {}
+
+    QAK_FORCE_INLINE bool operator()(Native &native) const {
+        return native.nameLength == length && memcmp(native.name, name, length) == 0;
+    }
+};
+
+static QAK_FORCE_INLINE bool isValueType(TypeId type) {
+    return type >= TypeBoolean && type <= TypeString;
+}
+
+NativeFunctions::~NativeFunctions() {
+    for (size_t i = 0; i < _natives.size(); i++) _mem.free((void *) _natives[i].name, QAK_SRC_LOC);
+}
+
+int32_t NativeFunctions::add(const char *name, TypeId returnType, TypeId *parameterTypes, uint32_t numParameters, NativeFunction function,
+                             void *userData) {
+    uint32_t length = (uint32_t) strlen(name);
+    uint32_t hash = hashBytes((const uint8_t *) name, length);
+    _table.reserve(_natives);
+    size_t slot;
+    if (length == 0 || function == nullptr || _table.find(_natives, hash, IsNative((const uint8_t *) name, length), slot) >= 0) return -1;
+    if (returnType != TypeNothing && !isValueType(returnType)) return -1;
+    for (uint32_t i = 0; i < numParameters; i++) {
+        if (!isValueType(parameterTypes[i])) return -1;
+    }
+
+    char *nameCopy = _mem.alloc<char>(length + 1, QAK_SRC_LOC);
+    memcpy(nameCopy, name, length + 1);
+    TypeId type = _types.function(returnType, parameterTypes, numParameters);
+    _table.set(slot, (int32_t) _natives.size());
+    _natives.add(Native(nameCopy, length, hash, type, function, userData));
+    return (int32_t) _natives.size() - 1;
+}
+
+int32_t NativeFunctions::find(const uint8_t *name, uint32_t length) {
+    size_t slot;
+    return _table.find(_natives, hashBytes(name, length), IsNative(name, length), slot);
+}
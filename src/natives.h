@@ -0,0 +1,84 @@
+#ifndef QAK_NATIVES_H
+#define QAK_NATIVES_H
+
+#include "typechecker.h"
+
+namespace qak {
+    namespace bytecode {
+        union Value;
+    }
+
+    /* A function of the host called by Qak code. The arguments are stored like registers, see
+     * bytecode::Value, one per parameter, converted to the parameter types. The function may
+     * overwrite them. It returns a value of its return type, which is ignored for TypeNothing. */
+    typedef bytecode::Value (*NativeFunction)(bytecode::Value *arguments, void *userData);
+
+    /* A native function registered with NativeFunctions::add(). The type is a function type of
+     * the TypeTable the functions were added with. */
+    struct Native {
+        const char *name;
+        uint32_t nameLength;
+        uint32_t nameHash;
+        TypeId type;
+        NativeFunction function;
+        void *userData;
+
+        Native(const char *name, uint32_t nameLength, uint32_t nameHash, TypeId type, NativeFunction function, void *userData) :
+                name(name), nameLength(nameLength), nameHash(nameHash), type(type), function(function), userData(userData) {}
+    };
+
+    /* Returns the hash of the name of a native, see HashIndex. */
+    struct NativeHash {
+        uint32_t operator()(const Native &native) const {
+            return native.nameHash;
+        }
+    };
+
+    /* The native functions modules can call, by their index. Calls are bound to the index when a
+     * module is resolved, see Resolver::resolve(), so the name is only looked up at compile time and
+     * the backends call natives through the dense table of functions, see bytecode::Program::natives.
+     * Functions of a module shadow natives of the same name.
+     *
+     * Parameters and return values are of the primitive types boolean, integers, floats, character
+     * and string. Natives that return nothing have the return type TypeNothing. */
+    class NativeFunctions {
+    private:
+        HeapAllocator &_mem;
+        TypeTable &_types;
+        Array<Native> _natives;
+
+        /* The indices of _natives by the hashes of their names. */
+        HashIndex<Native, NativeHash> _table;
+
+        NativeFunctions(const NativeFunctions &other) = delete;
+
+    public:
+        NativeFunctions(HeapAllocator &mem, TypeTable &types) : _mem(mem), _types(types), _natives(mem), _table(mem) {}
+
+        ~NativeFunctions();
+
+        /* Adds the native and returns its index, or -1 if a native of the same name was added before
+         * or a type is not supported. The name is copied. */
+        int32_t add(const char *name, TypeId returnType, TypeId *parameterTypes, uint32_t numParameters, NativeFunction function,
+                    void *userData);
+
+        /* Returns the index of the native with the name, or -1 if there is none. */
+        int32_t find(const uint8_t *name, uint32_t length);
+
+        QAK_FORCE_INLINE Native &get(uint32_t index) {
+            return _natives[index];
+        }
+
+        QAK_FORCE_INLINE size_t size() {
+            return _natives.size();
+        }
+
+        /* Returns the table the types of the natives are interned in. Modules calling natives must
+         * be type checked with the same table. */
+        QAK_FORCE_INLINE TypeTable &types() {
+            return _types;
+        }
+    };
+}
+
+#endif //QAK_NATIVES_H
@@ -1,125 +1,1385 @@
 #include "parser.h"
+#include "visitor.h"
+#include <atomic>
+
+#ifndef WASM
+#include <thread>
+#endif
 
 using namespace qak;
 
 using namespace qak::ast;
 
-/** Used to keep track of obtained arrays from
- * an ArrayPool. Frees them when the monitor is
- * destructed. Can keep track of a maximum of
- * 4 arrays. */
-template<typename T>
-struct ArrayPoolMonitor {
-    ArrayPool<T> &pool;
-    Array<T> *tracked[4];
-    size_t numTracked;
+/** Increments the nesting depth of the parser on construction
+ * and decrements it on destruction. See Parser::isNestingTooDeep(). */
+struct NestingMonitor {
+    uint32_t &depth;
+
+    NestingMonitor(uint32_t &depth) : depth(depth) { depth++; }
+
+    ~NestingMonitor() { depth--; }
+};
+
+void ModuleTokens::setSpans(TokenChunk *chunk) {
+    for (uint32_t i = 0; i < chunk->size; i++) {
+        Token &token = chunk->tokens[i];
+        uint32_t start = i < chunk->split ? chunk->starts[i] : _end - chunk->starts[i];
+        uint32_t startLine = i < chunk->split ? chunk->startLines[i] : _endLine - chunk->startLines[i];
+        Span span(*_source, start, startLine, start + (token.end - token.start), startLine + (token.endLine - token.startLine));
 
-    ArrayPoolMonitor(ArrayPool<T> &pool) : pool(pool), numTracked(0) {}
+        // Tokens refer to their source, so they are constructed again instead of assigned.
+        new(&token) Token(token.type, span, token.literalIndex);
+    }
+    chunk->version = _version;
+}
 
-    ~ArrayPoolMonitor() {
-        for (size_t i = 0; i < numTracked; i++) {
-            pool.free(tracked[i]);
+/* Assigns the slots following the last slot to the chunk, growing the slots in the bump
+ * allocator if needed. Slots are shared with the previous module, which does not use the
+ * slots after its own. */
+void ModuleTokens::addSlots(TokenChunk *chunk) {
+    uint32_t numSlots = (chunk->size + (1 << QAK_TOKEN_SLOT_BITS) - 1) >> QAK_TOKEN_SLOT_BITS;
+    if (numSlots == 0) numSlots = 1;
+    if (_numSlots + numSlots > _slotCapacity) {
+        uint32_t capacity = _slotCapacity == 0 ? numSlots : _slotCapacity * 2;
+        while (capacity < _numSlots + numSlots) capacity *= 2;
+        TokenChunk **slots = _mem.alloc<TokenChunk *>(capacity);
+        if (_numSlots > 0) memcpy(slots, _slots, _numSlots * sizeof(TokenChunk *));
+        _slots = slots;
+        _slotCapacity = capacity;
+    }
+    for (uint32_t i = 0; i < numSlots; i++) _slots[_numSlots++] = chunk;
+}
+
+void ModuleTokens::set(Source &source, Array<Token> &tokens, Array<LiteralValue> &literalValues) {
+    _source = &source;
+    _slots = nullptr;
+    _numSlots = _slotCapacity = 0;
+    _size = (uint32_t) tokens.size();
+    _end = (uint32_t) source.size;
+    _endLine = 0;
+    _gap = 0;
+    _version = 0;
+    add(tokens, literalValues, false);
+}
+
+void ModuleTokens::edit(ModuleTokens &previous, Source &source, int32_t byteDelta, int32_t lineDelta) {
+    _source = &source;
+    _slots = previous._slots;
+    _numSlots = previous._numSlots;
+    _slotCapacity = previous._slotCapacity;
+    _size = previous._size;
+    _end = previous._end + (uint32_t) byteDelta;
+    _endLine = previous._endLine + (uint32_t) lineDelta;
+    _gap = previous._gap;
+    _version = previous._version + 1;
+}
+
+void ModuleTokens::add(Array<Token> &tokens, Array<LiteralValue> &literalValues, bool isAfterGap) {
+    TokenChunk *chunk = _mem.allocObject<TokenChunk>();
+    uint32_t size = (uint32_t) tokens.size();
+    chunk->firstIndex = nextIndex();
+    chunk->size = size;
+    chunk->tokens = _mem.alloc<Token>(size);
+    chunk->literalValues = _mem.alloc<LiteralValue>(literalValues.size());
+    chunk->numLiteralValues = (uint32_t) literalValues.size();
+    chunk->starts = _mem.alloc<uint32_t>(size);
+    chunk->startLines = _mem.alloc<uint32_t>(size);
+    chunk->split = isAfterGap ? 0 : size;
+    chunk->version = _version;
+    for (uint32_t i = 0; i < size; i++) {
+        Token &token = tokens[i];
+        new(chunk->tokens + i) Token(token);
+        chunk->starts[i] = isAfterGap ? _end - token.start : token.start;
+        chunk->startLines[i] = isAfterGap ? _endLine - token.startLine : token.startLine;
+    }
+    if (literalValues.size() > 0) memcpy(chunk->literalValues, literalValues.buffer(), literalValues.size() * sizeof(LiteralValue));
+    addSlots(chunk);
+}
+
+void ModuleTokens::moveBeforeGap(uint32_t first, uint32_t last) {
+    TokenChunk *chunk = this->chunk(first);
+    for (uint32_t i = first - chunk->firstIndex; i <= last - chunk->firstIndex; i++) {
+        chunk->starts[i] = _end - chunk->starts[i];
+        chunk->startLines[i] = _endLine - chunk->startLines[i];
+    }
+    if (chunk->split < last + 1 - chunk->firstIndex) chunk->split = last + 1 - chunk->firstIndex;
+}
+
+void ModuleTokens::moveAfterGap(uint32_t first, uint32_t last) {
+    TokenChunk *chunk = this->chunk(first);
+    for (uint32_t i = first - chunk->firstIndex; i <= last - chunk->firstIndex; i++) {
+        chunk->starts[i] = _end - chunk->starts[i];
+        chunk->startLines[i] = _endLine - chunk->startLines[i];
+    }
+    if (chunk->split > first - chunk->firstIndex) chunk->split = first - chunk->firstIndex;
+}
+
+/** Creates the nodes of an ast::Module tree in a bump allocator. The
+ * nodes of lists are collected in the bump allocator as well, so a list
+ * becomes the FixedArray of its parent node without being copied. */
+class TreeBuilder {
+private:
+    BumpAllocator &_mem;
+    Array<Token> &_tokens;
+    uint32_t _firstIndex;
+
+    QAK_FORCE_INLINE uint32_t index(Token &token) {
+        return _firstIndex + (uint32_t) (&token - _tokens.buffer());
+    }
+
+    template<typename T>
+    QAK_FORCE_INLINE void setList(FixedArray<T *> &list, AstNode **nodes, size_t size) {
+        // All node types derive from AstNode through single inheritance, so a
+        // pointer to an AstNode is also a valid pointer to the derived type.
+        list.set(reinterpret_cast<T **>(nodes), size);
+    }
+
+public:
+    typedef AstNode *Node;
+
+    /** A list of nodes built in the bump allocator of the builder. */
+    class List : public FixedArrayBuilder<AstNode *> {
+    public:
+        List(TreeBuilder &builder) : FixedArrayBuilder<AstNode *>(builder._mem) {}
+    };
+
+    /* The tokens are stored at the first index of the module's tokens, see ModuleTokens. */
+    TreeBuilder(BumpAllocator &mem, Array<Token> &tokens, uint32_t firstIndex) : _mem(mem), _tokens(tokens), _firstIndex(firstIndex) {}
+
+    /* Creates the module. Its tokens are set by the parser, see Parser::parse(). */
+    Node module(Token &moduleToken, Token &name, List &items, Array<InternedString> &strings) {
+        Module *module = _mem.allocObject<Module>(_mem, index(moduleToken), _firstIndex + (uint32_t) _tokens.size() - 1, index(name));
+
+        // The items are the functions, types and statements of the module in source order.
+        // Variables are statements too. The items are kept in source order for reparsing.
+        // The statements are compacted in place, the variables, functions and types are
+        // copied to buffers of their exact size.
+        AstNode **nodes = items.values();
+        size_t numItems = items.size(), numVariables = 0, numFunctions = 0, numTypes = 0, numStatements = 0;
+        AstNode **ordered = _mem.alloc<AstNode *>(numItems);
+        for (size_t i = 0; i < numItems; i++) ordered[i] = nodes[i];
+        module->items.set(ordered, numItems);
+        for (size_t i = 0; i < numItems; i++) {
+            if (nodes[i]->astType == AstVariable) numVariables++;
+            else if (nodes[i]->astType == AstFunction) numFunctions++;
+            else if (nodes[i]->astType == AstTypeDeclaration) numTypes++;
+        }
+        AstNode **variables = _mem.alloc<AstNode *>(numVariables);
+        AstNode **functions = _mem.alloc<AstNode *>(numFunctions);
+        AstNode **types = _mem.alloc<AstNode *>(numTypes);
+        numVariables = numFunctions = numTypes = 0;
+        for (size_t i = 0; i < numItems; i++) {
+            AstNode *node = nodes[i];
+            if (node->astType == AstFunction) {
+                functions[numFunctions++] = node;
+                continue;
+            }
+            if (node->astType == AstTypeDeclaration) {
+                types[numTypes++] = node;
+                continue;
+            }
+            if (node->astType == AstVariable) variables[numVariables++] = node;
+            nodes[numStatements++] = node;
         }
+
+        setList(module->variables, variables, numVariables);
+        setList(module->functions, functions, numFunctions);
+        setList(module->statements, nodes, numStatements);
+        setList(module->types, types, numTypes);
+        module->strings.set(strings);
+        return module;
+    }
+
+    Node function(Token &funToken, Token &name, List &parameters, Node returnType, uint32_t bodyFirstToken, List &statements,
+                  Token &endToken, bool isBodyParsed) {
+        Function *function = _mem.allocObject<Function>(_mem, index(funToken), index(endToken), index(name),
+                                                        static_cast<TypeSpecifier *>(returnType), _firstIndex + bodyFirstToken, isBodyParsed);
+        setList(function->parameters, parameters.values(), parameters.size());
+        setList(function->statements, statements.values(), statements.size());
+        return function;
+    }
+
+    /* Sets the statements of a function whose body was skipped, see Parser::parseFunctionBody(). */
+    void functionBody(Function *function, List &statements) {
+        setList(function->statements, statements.values(), statements.size());
+        function->isBodyParsed = true;
+    }
+
+    Node parameter(Token &name, Node typeSpecifier) {
+        return _mem.allocObject<Parameter>(index(name), static_cast<TypeSpecifier *>(typeSpecifier));
+    }
+
+    Node typeDeclaration(Token &typeToken, Token &name, bool isPacked, bool isCCompatible, bool isStructureOfArrays, List &fields,
+                         Token &endToken) {
+        TypeDeclaration *type = _mem.allocObject<TypeDeclaration>(_mem, index(typeToken), index(endToken), index(name), isPacked,
+                                                                  isCCompatible, isStructureOfArrays);
+        setList(type->fields, fields.values(), fields.size());
+        return type;
+    }
+
+    Node field(Token &name, Node typeSpecifier) {
+        return _mem.allocObject<Field>(index(name), static_cast<TypeSpecifier *>(typeSpecifier));
+    }
+
+    Node variable(Token &varToken, Token &name, Node typeSpecifier, Node initializer) {
+        uint32_t lastToken = initializer ? initializer->lastToken : typeSpecifier ? typeSpecifier->lastToken : index(name);
+        return _mem.allocObject<Variable>(index(varToken), lastToken, index(name), static_cast<TypeSpecifier *>(typeSpecifier),
+                                          static_cast<Expression *>(initializer));
+    }
+
+    Node whileNode(Token &whileToken, Token &endToken, Node condition, List &statements) {
+        While *whileNode = _mem.allocObject<While>(_mem, index(whileToken), index(endToken), static_cast<Expression *>(condition));
+        setList(whileNode->statements, statements.values(), statements.size());
+        return whileNode;
+    }
+
+    Node ifNode(Token &ifToken, Token &endToken, Node condition, List &trueBlock, List &falseBlock) {
+        If *ifNode = _mem.allocObject<If>(_mem, index(ifToken), index(endToken), static_cast<Expression *>(condition));
+        setList(ifNode->trueBlock, trueBlock.values(), trueBlock.size());
+        setList(ifNode->falseBlock, falseBlock.values(), falseBlock.size());
+        return ifNode;
+    }
+
+    Node returnNode(Token &returnToken, Node value) {
+        return _mem.allocObject<Return>(index(returnToken), value ? value->lastToken : index(returnToken), static_cast<Expression *>(value));
+    }
+
+    Node typeSpecifier(Token &name) {
+        return _mem.allocObject<TypeSpecifier>(index(name));
+    }
+
+    Node ternaryOperation(Node condition, Node trueValue, Node falseValue) {
+        return _mem.allocObject<TernaryOperation>(static_cast<Expression *>(condition), static_cast<Expression *>(trueValue),
+                                                  static_cast<Expression *>(falseValue));
+    }
+
+    Node binaryOperation(Token &op, Node left, Node right) {
+        return _mem.allocObject<BinaryOperation>(index(op), static_cast<Expression *>(left), static_cast<Expression *>(right));
+    }
+
+    Node unaryOperation(Token &op, Node value) {
+        return _mem.allocObject<UnaryOperation>(index(op), static_cast<Expression *>(value));
+    }
+
+    Node literal(Token &token, LiteralValue value) {
+        return _mem.allocObject<Literal>(token.type, index(token), value);
+    }
+
+    Node variableAccess(Token &name) {
+        return _mem.allocObject<VariableAccess>(index(name));
     }
 
-    QAK_FORCE_INLINE Array<T> *obtain(const char *file, int32_t line) {
-        Array<T> *result = pool.obtain(file, line);
-        tracked[numTracked++] = result;
-        return result;
+    Node error(Token &firstToken, Token &lastToken) {
+        return _mem.allocObject<ErrorNode>(index(firstToken), index(lastToken));
+    }
+
+    Node functionCall(Token &name, Token &closingParenthesis, Node variableAccess, List &arguments) {
+        FunctionCall *call = _mem.allocObject<FunctionCall>(_mem, index(name), index(closingParenthesis),
+                                                            static_cast<Expression *>(variableAccess));
+        setList(call->arguments, arguments.values(), arguments.size());
+        return call;
     }
 };
 
-Module *Parser::parse(Source &source, Errors &errors, BumpAllocator *bumpMem) {
-    _source = &source;
-    _errors = &errors;
-    _bumpMem = bumpMem;
+static void toQakSpan(Span &span, qak_span &qakSpan) {
+    qakSpan.data.data = (const char *) span.source.data + span.start;
+    qakSpan.data.length = span.end - span.start;
+    qakSpan.start = span.start;
+    qakSpan.end = span.end;
+    qakSpan.startLine = span.startLine;
+    qakSpan.endLine = span.endLine;
+}
 
-    ArrayPoolMonitor<Function *> functionArrays(_functionArrayPool);
-    ArrayPoolMonitor<Statement *> statementArrays(_statementArrayPool);
-    ArrayPoolMonitor<Variable *> variableArrays(_variableArrayPool);
+/* Sets the result to the span from the start of the first span to the end of the second span. */
+static void joinQakSpans(qak_span &start, qak_span &end, qak_span &result) {
+    result.data.data = start.data.data;
+    result.data.length = end.end - start.start;
+    result.start = start.start;
+    result.end = end.end;
+    result.startLine = start.startLine;
+    result.endLine = end.endLine;
+}
 
-    _tokens.clear();
-    tokenizer::tokenize(source, _tokens, errors);
-    if (_errors->hasErrors()) return nullptr;
+/** A node of an ast::FlatModule, identified by its index. Converts from nullptr
+ * and to bool like a pointer, so the parse functions can treat tree and flat nodes
+ * the same way. */
+struct FlatNode {
+    qak_ast_node_index index;
 
-    TokenStream stream(source, _tokens, errors);
-    _stream = &stream;
+    FlatNode(std::nullptr_t) : index(-1) {}
+
+    explicit FlatNode(qak_ast_node_index index) : index(index) {}
+
+    explicit operator bool() const { return index >= 0; }
+};
+
+/** Creates the nodes of an ast::FlatModule. The nodes are appended to the
+ * nodes of the flat module. The nodes of lists are collected on a list stack,
+ * then appended to the lists of the flat module by the node owning them. */
+class FlatBuilder {
+private:
+    FlatModule &_module;
+    Array<Token> &_tokens;
+    Array<qak_ast_node_index> &_lists;
+
+    QAK_FORCE_INLINE void init(qak_ast_node &node, qak_ast_type type) {
+        memset(&node, 0, sizeof(qak_ast_node));
+        node.type = type;
+    }
+
+    QAK_FORCE_INLINE void init(qak_ast_node &node, qak_ast_type type, Span &span) {
+        init(node, type);
+        toQakSpan(span, node.span);
+    }
+
+    QAK_FORCE_INLINE void init(qak_ast_node &node, qak_ast_type type, Span &start, Span &end) {
+        init(node, type);
+        Span span(start.source, start.start, start.startLine, end.end, end.endLine);
+        toQakSpan(span, node.span);
+    }
+
+    QAK_FORCE_INLINE FlatNode add(qak_ast_node &node) {
+        _module.nodes.add(node);
+        return FlatNode((qak_ast_node_index) _module.nodes.size() - 1);
+    }
+
+    QAK_FORCE_INLINE void setList(qak_ast_node_list &list, size_t start, size_t size) {
+        list.numNodes = (uint32_t) size;
+        list.start = (uint32_t) _module.lists.size();
+        _module.lists.addAll(_lists.buffer() + start, size);
+    }
+
+    QAK_FORCE_INLINE qak_ast_node &get(FlatNode node) {
+        return _module.nodes[node.index];
+    }
+
+public:
+    typedef FlatNode Node;
+
+    /** A list of nodes on the list stack of the builder. Lists are created and
+     * destructed in LIFO order by the parse functions. A list removes its nodes
+     * from the stack on destruction, including when a parse function returns
+     * early due to an error. */
+    class List {
+    private:
+        Array<qak_ast_node_index> &_lists;
+        size_t _start;
+        size_t _size;
+
+    public:
+        List(FlatBuilder &builder) : _lists(builder._lists), _start(builder._lists.size()), _size(0) {}
+
+        ~List() {
+            _lists.setSize(_start, -1);
+        }
+
+        QAK_FORCE_INLINE void add(Node node) {
+            _lists.add(node.index);
+            _size++;
+        }
+
+        QAK_FORCE_INLINE size_t start() const {
+            return _start;
+        }
+
+        QAK_FORCE_INLINE size_t size() const {
+            return _size;
+        }
+    };
+
+    FlatBuilder(FlatModule &module, Array<Token> &tokens, Array<qak_ast_node_index> &lists) : _module(module), _tokens(tokens), _lists(lists) {
+        _lists.clear();
+    }
+
+    Node module(Token &moduleToken, Token &name, List &items, Array<InternedString> &strings) {
+        qak_ast_node node;
+        init(node, QakAstModule, moduleToken, _tokens[_tokens.size() - 1]);
+        toQakSpan(name, node.data.module.name);
+
+        // See TreeBuilder::module(). The items are sorted into lists on top of the stack.
+        size_t start = items.start(), end = start + items.size();
+        size_t variables = _lists.size();
+        for (size_t i = start; i < end; i++) if (_module.nodes[_lists[i]].type == QakAstVariable) _lists.add(_lists[i]);
+        size_t functions = _lists.size();
+        for (size_t i = start; i < end; i++) if (_module.nodes[_lists[i]].type == QakAstFunction) _lists.add(_lists[i]);
+        size_t statements = _lists.size();
+        for (size_t i = start; i < end; i++) {
+            qak_ast_type type = _module.nodes[_lists[i]].type;
+            if (type != QakAstFunction && type != QakAstTypeDeclaration) _lists.add(_lists[i]);
+        }
+        size_t types = _lists.size();
+        for (size_t i = start; i < end; i++) if (_module.nodes[_lists[i]].type == QakAstTypeDeclaration) _lists.add(_lists[i]);
+
+        setList(node.data.module.variables, variables, functions - variables);
+        setList(node.data.module.functions, functions, statements - functions);
+        setList(node.data.module.statements, statements, types - statements);
+        setList(node.data.module.types, types, _lists.size() - types);
+        _module.strings.set(strings);
+        return add(node);
+    }
+
+    /* Flat modules are always parsed completely, so the body of a function is always parsed. */
+    Node function(Token &funToken, Token &name, List &parameters, Node returnType, uint32_t, List &statements, Token &endToken, bool) {
+        qak_ast_node node;
+        init(node, QakAstFunction, funToken, endToken);
+        toQakSpan(name, node.data.function.name);
+        setList(node.data.function.parameters, parameters.start(), parameters.size());
+        node.data.function.returnType = returnType.index;
+        setList(node.data.function.statements, statements.start(), statements.size());
+        return add(node);
+    }
+
+    Node parameter(Token &name, Node typeSpecifier) {
+        qak_ast_node node;
+        init(node, QakAstParameter, name);
+        joinQakSpans(node.span, get(typeSpecifier).span, node.span);
+        toQakSpan(name, node.data.parameter.name);
+        node.data.parameter.typeSpecifier = typeSpecifier.index;
+        return add(node);
+    }
+
+    Node typeDeclaration(Token &typeToken, Token &name, bool isPacked, bool isCCompatible, bool isStructureOfArrays, List &fields,
+                         Token &endToken) {
+        qak_ast_node node;
+        init(node, QakAstTypeDeclaration, typeToken, endToken);
+        toQakSpan(name, node.data.typeDeclaration.name);
+        setList(node.data.typeDeclaration.fields, fields.start(), fields.size());
+        node.data.typeDeclaration.isPacked = isPacked;
+        node.data.typeDeclaration.isCCompatible = isCCompatible;
+        node.data.typeDeclaration.isStructureOfArrays = isStructureOfArrays;
+        return add(node);
+    }
+
+    Node field(Token &name, Node typeSpecifier) {
+        qak_ast_node node;
+        init(node, QakAstField, name);
+        joinQakSpans(node.span, get(typeSpecifier).span, node.span);
+        toQakSpan(name, node.data.field.name);
+        node.data.field.typeSpecifier = typeSpecifier.index;
+        return add(node);
+    }
 
-    Module *module = parseModule();
+    Node variable(Token &varToken, Token &name, Node typeSpecifier, Node initializer) {
+        qak_ast_node node;
+        init(node, QakAstVariable, varToken, name);
+        if (initializer) joinQakSpans(node.span, get(initializer).span, node.span);
+        else if (typeSpecifier) joinQakSpans(node.span, get(typeSpecifier).span, node.span);
+        toQakSpan(name, node.data.variable.name);
+        node.data.variable.typeSpecifier = typeSpecifier.index;
+        node.data.variable.initializerExpression = initializer.index;
+        return add(node);
+    }
+
+    Node whileNode(Token &whileToken, Token &endToken, Node condition, List &statements) {
+        qak_ast_node node;
+        init(node, QakAstWhile, whileToken, endToken);
+        node.data.whileNode.condition = condition.index;
+        setList(node.data.whileNode.statements, statements.start(), statements.size());
+        return add(node);
+    }
+
+    Node ifNode(Token &ifToken, Token &endToken, Node condition, List &trueBlock, List &falseBlock) {
+        qak_ast_node node;
+        init(node, QakAstIf, ifToken, endToken);
+        node.data.ifNode.condition = condition.index;
+        setList(node.data.ifNode.trueBlock, trueBlock.start(), trueBlock.size());
+        setList(node.data.ifNode.falseBlock, falseBlock.start(), falseBlock.size());
+        return add(node);
+    }
+
+    Node returnNode(Token &returnToken, Node value) {
+        qak_ast_node node;
+        init(node, QakAstReturn, returnToken);
+        if (value) joinQakSpans(node.span, get(value).span, node.span);
+        node.data.returnNode.returnValue = value.index;
+        return add(node);
+    }
+
+    Node typeSpecifier(Token &name) {
+        qak_ast_node node;
+        init(node, QakAstTypeSpecifier, name);
+        toQakSpan(name, node.data.typeSpecifier.name);
+        return add(node);
+    }
+
+    Node ternaryOperation(Node condition, Node trueValue, Node falseValue) {
+        qak_ast_node node;
+        init(node, QakAstTernaryOperation);
+        joinQakSpans(get(condition).span, get(falseValue).span, node.span);
+        node.data.ternaryOperation.condition = condition.index;
+        node.data.ternaryOperation.trueValue = trueValue.index;
+        node.data.ternaryOperation.falseValue = falseValue.index;
+        return add(node);
+    }
+
+    Node binaryOperation(Token &op, Node left, Node right) {
+        qak_ast_node node;
+        init(node, QakAstBinaryOperation);
+        joinQakSpans(get(left).span, get(right).span, node.span);
+        toQakSpan(op, node.data.binaryOperation.op);
+        node.data.binaryOperation.left = left.index;
+        node.data.binaryOperation.right = right.index;
+        return add(node);
+    }
+
+    Node unaryOperation(Token &op, Node value) {
+        qak_ast_node node;
+        init(node, QakAstUnaryOperation, op);
+        joinQakSpans(node.span, get(value).span, node.span);
+        toQakSpan(op, node.data.unaryOperation.op);
+        node.data.unaryOperation.value = value.index;
+        return add(node);
+    }
+
+    Node literal(Token &token, LiteralValue value) {
+        qak_ast_node node;
+        init(node, QakAstLiteral, token);
+        node.data.literal.type = (qak_token_type) token.type;
+        toQakSpan(token, node.data.literal.value);
+        memcpy(&node.data.literal.decodedValue, &value, sizeof(qak_literal_value));
+        return add(node);
+    }
+
+    Node variableAccess(Token &name) {
+        qak_ast_node node;
+        init(node, QakAstVariableAccess, name);
+        toQakSpan(name, node.data.variableAccess.name);
+        return add(node);
+    }
+
+    Node error(Token &firstToken, Token &lastToken) {
+        qak_ast_node node;
+        init(node, QakAstError, firstToken, lastToken);
+        return add(node);
+    }
+
+    Node functionCall(Token &name, Token &closingParenthesis, Node variableAccess, List &arguments) {
+        qak_ast_node node;
+        init(node, QakAstFunctionCall, name, closingParenthesis);
+        node.data.functionCall.variableAccess = variableAccess.index;
+        setList(node.data.functionCall.arguments, arguments.start(), arguments.size());
+        return add(node);
+    }
+};
+
+Module *Parser::parse(Source &source, Errors &errors, BumpAllocator *bumpMem) {
+    bool isParallel = !_lazyFunctionBodies && _numThreads > 1;
+    _lazyModule = nullptr;
+    _skipFunctionBodies = _lazyFunctionBodies || isParallel;
+    size_t numBytes = bumpMem->numBytes;
+    TreeBuilder builder(*bumpMem, _tokens, 0);
+    Module *module = static_cast<Module *>(parse(source, errors, *bumpMem, builder));
+
+    // Skipped function bodies are parsed from the module's tokens and literal values later.
     if (!module) return nullptr;
+    module->tokens.set(source, _tokens, _literalValues);
+    module->tokens.setGap((uint32_t) module->items.size());
+    module->itemTokens.set(_itemTokens);
+    module->isReusable.set(_reusableItems);
+    if (_lazyFunctionBodies) module->numUnparsedBodies = module->functions.size();
+    if (_skipFunctionBodies) _lazyModule = module;
+    _stringPoolModule = module;
+    if (isParallel && !parseFunctionBodiesInParallel(module, errors)) return nullptr;
+    module->numParsedBytes = bumpMem->numBytes - numBytes;
+    return module;
+}
 
-    Array<Function *> *functions = functionArrays.obtain(QAK_SRC_LOC);
-    Array<Statement *> *statements = statementArrays.obtain(QAK_SRC_LOC);
-    Array<Variable *> *variables = variableArrays.obtain(QAK_SRC_LOC);
+/* Marks the item of a function whose body was parsed with errors as not reusable. The items
+ * are in source order, so the function is found by the offset of its first token. */
+static void markNotReusable(Module *module, Function *function) {
+    ModuleTokens &tokens = module->tokens;
+    uint32_t start = tokens.start(function->firstToken);
+    size_t low = 0, high = module->items.size();
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (tokens.start(module->itemTokens[middle].firstToken) < start) low = middle + 1;
+        else high = middle;
+    }
+    if (low < module->items.size() && module->items[low] == function) module->isReusable[low] = false;
+}
 
-    while (_stream->hasMore()) {
-        if (_stream->match(QAK_STR("fun"), false)) {
-            Function *function = parseFunction();
-            if (!function) return nullptr;
+/** The state of a call to Parser::reparse(). Offsets and lines before the edit are the same in
+ * both sources, offsets and lines after it are moved by byteDelta and lineDelta. */
+struct Parser::Reparse {
+    Module *previous;
+    Module *module;
+    BumpAllocator &bumpMem;
+    SourceEdit edit;
+    int32_t byteDelta;
+    int32_t lineDelta;
+
+    /* Whether tokenizing the edit stopped at a token of the previous source. If not, every token
+     * after the edit was tokenized again. */
+    bool isSynchronized;
+
+    /* Whether the tokens of the edit were added to the tokens being parsed, see addReparsedTokens(). */
+    bool isEditAdded;
+
+    /* Whether the range of items with the edit was parsed, after which chunks are after the gap. */
+    bool isEditParsed;
+
+    /* The number of tokens of the new module. */
+    size_t numTokens;
+
+    /* Whether parsing stopped at the maximum number of errors, and the last token of the source. */
+    bool isStopped;
+    uint32_t lastToken;
+
+    Reparse(Module *previous, Module *module, BumpAllocator &bumpMem, SourceEdit edit, int32_t byteDelta, int32_t lineDelta,
+            bool isSynchronized) : previous(previous), module(module), bumpMem(bumpMem), edit(edit), byteDelta(byteDelta),
+                                   lineDelta(lineDelta), isSynchronized(isSynchronized), isEditAdded(false), isEditParsed(false),
+                                   numTokens(previous->tokens.size()), isStopped(false), lastToken(0) {}
+};
+
+/* Returns whether the tokenizer decoded the value of a literal token of the type, see Token::literalIndex. */
+static QAK_FORCE_INLINE bool hasDecodedValue(TokenType type) {
+    return type >= BooleanLiteral && type <= ByteLiteral;
+}
+
+/* Returns the first index from low up to high for which isBefore() returns false, or high. */
+template<typename P>
+static uint32_t lowerBound(uint32_t low, uint32_t high, P isBefore) {
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (isBefore(middle)) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+/* Appends the tokens of the edit to the tokens reparseItems() parses. */
+void Parser::addEditTokens(Reparse &reparse) {
+    for (size_t i = 0; i < _editTokens.size(); i++) {
+        Token token = _editTokens[i];
+        if (hasDecodedValue(token.type)) {
+            _literalValues.add(_editLiteralValues[token.literalIndex]);
+            token.literalIndex = (uint32_t) _literalValues.size() - 1;
+        }
+        _tokens.add(token);
+    }
+    reparse.isEditAdded = true;
+}
+
+/* Appends the tokens from first to last of the previous module, which belong to one chunk, to the
+ * tokens reparseItems() parses. Tokens after the edit are moved, edited tokens are replaced by the
+ * tokens of the edit. The values of boolean and numeric literals are copied, the values of character
+ * and string literals are decoded again when they are parsed. */
+void Parser::addReparsedTokens(Reparse &reparse, uint32_t first, uint32_t last) {
+    ModuleTokens &tokens = reparse.previous->tokens;
+    TokenChunk *chunk = tokens.chunk(first);
+    for (uint32_t i = first; i <= last; i++) {
+        uint32_t start = tokens.start(i), startLine = tokens.startLine(i);
+        bool isBefore = tokens.end(i) < reparse.edit.start;
+        if (!isBefore) {
+            if (!reparse.isEditAdded) addEditTokens(reparse);
+            if (!reparse.isSynchronized || start < reparse.edit.end) continue;
+            start += reparse.byteDelta;
+            startLine += reparse.lineDelta;
+        }
+
+        Token &token = chunk->tokens[i - chunk->firstIndex];
+        uint32_t literalIndex = token.literalIndex;
+        if (hasDecodedValue(token.type)) {
+            literalIndex = (uint32_t) _literalValues.size();
+            _literalValues.add(chunk->literalValues[token.literalIndex]);
+        }
+        Span span(*_source, start, startLine, start + (token.end - token.start), startLine + (token.endLine - token.startLine));
+        _tokens.add(Token(token.type, span, literalIndex));
+    }
+}
+
+/* Parses the items of a range of the previous module again, from the token before them up to the
+ * first token of the item after them. Parsing a range with the edit may not end there, e.g. if the
+ * edit opened a block. Then the range is extended by as many items as it had and parsed again, until
+ * it reaches the first token of an item or the end of the source. Ranges that the extended range
+ * reaches are merged into it. Returns false if parsing stopped. */
+bool Parser::reparseItems(Reparse &reparse, size_t rangeIndex) {
+    Module *previous = reparse.previous;
+    FixedArray<ItemTokens> &itemTokens = previous->itemTokens;
+    uint32_t numItems = (uint32_t) previous->items.size();
+    ReparsedRange &range = _reparsedRanges[rangeIndex];
+    range.firstReparsedItem = (uint32_t) _reparsedItems.size();
+    size_t numErrors = _errors->getErrors().size();
+    while (true) {
+        uint32_t firstItem = range.firstItem, endItem = range.endItem;
+        _tokens.clear();
+        _literalValues.clear();
+        reparse.isEditAdded = !range.hasEdit;
+        uint32_t context = firstItem > 0 ? itemTokens[firstItem - 1].lastToken : previous->name;
+        addReparsedTokens(reparse, context, context);
+        for (uint32_t i = firstItem; i < endItem; i++) addReparsedTokens(reparse, itemTokens[i].firstToken, itemTokens[i].lastToken);
+        if (!reparse.isEditAdded) addEditTokens(reparse);
+        size_t windowEnd = _tokens.size();
+        if (endItem < numItems) addReparsedTokens(reparse, itemTokens[endItem].firstToken, itemTokens[endItem].firstToken);
+
+        uint32_t firstIndex = reparse.module->tokens.nextIndex();
+        TokenStream stream(*_source, _tokens, 1, _tokens.size(), *_errors);
+        _stream = &stream;
+        _streamLiteralValues = &_literalValues;
+        TreeBuilder builder(reparse.bumpMem, _tokens, firstIndex);
+        bool isStopped = false;
+        while (stream.getIndex() < windowEnd) {
+            size_t startIndex = stream.getIndex(), numItemErrors = _errors->getErrors().size();
+            TreeBuilder::Node item = parseStatementOrRecover(builder, true);
+            if (!item) {
+                isStopped = true;
+                break;
+            }
+            _reparsedItems.add(item);
+            _reusableItems.add(_errors->getErrors().size() == numItemErrors);
+            _itemTokens.add(ItemTokens(firstIndex + (uint32_t) startIndex, firstIndex + (uint32_t) stream.getIndex() - 1));
+        }
+        _stream = nullptr;
+        if (_aborted) return false;
+
+        if (stream.getIndex() > windowEnd) {
+            _reparsedItems.truncate(range.firstReparsedItem);
+            _reusableItems.truncate(range.firstReparsedItem);
+            _itemTokens.truncate(range.firstReparsedItem);
+            _errors->getErrors().truncate(numErrors);
+
+            uint32_t numRangeItems = endItem - firstItem;
+            range.endItem = endItem + (numRangeItems > 1 ? numRangeItems : 1);
+            if (range.endItem > numItems) range.endItem = numItems;
+            while (rangeIndex + 1 < _reparsedRanges.size() && _reparsedRanges[rangeIndex + 1].firstItem <= range.endItem) {
+                ReparsedRange &next = _reparsedRanges[rangeIndex + 1];
+                if (next.endItem > range.endItem) range.endItem = next.endItem;
+                range.hasEdit = range.hasEdit || next.hasEdit;
+                _reparsedRanges.removeAt(rangeIndex + 1);
+            }
+            continue;
+        }
+
+        range.endReparsedItem = (uint32_t) _reparsedItems.size();
+        reparse.module->tokens.add(_tokens, _literalValues, reparse.isEditParsed);
+        if (range.hasEdit) reparse.isEditParsed = true;
+        reparse.numTokens += windowEnd - 1;
+        for (uint32_t i = firstItem; i < endItem; i++) reparse.numTokens -= itemTokens[i].lastToken - itemTokens[i].firstToken + 1;
+
+        // Like parsing from scratch, the items after the one parsing stopped at are dropped.
+        if (isStopped) {
+            reparse.isStopped = true;
+            reparse.lastToken = endItem < numItems ? previous->lastToken : firstIndex + (uint32_t) windowEnd - 1;
+            range.endItem = numItems;
+            while (_reparsedRanges.size() > rangeIndex + 1) _reparsedRanges.removeAt(_reparsedRanges.size() - 1);
+            return false;
+        }
+        return true;
+    }
+}
+
+/* Adds a range of items to parse again after the ranges added before, merging it with the last
+ * range if they touch, see reparse(). */
+void Parser::addReparsedRange(uint32_t firstItem, uint32_t endItem, bool hasEdit) {
+    if (_reparsedRanges.size() > 0) {
+        ReparsedRange &last = _reparsedRanges[_reparsedRanges.size() - 1];
+        if (last.endItem >= firstItem) {
+            if (last.endItem < endItem) last.endItem = endItem;
+            last.hasEdit = last.hasEdit || hasEdit;
+            return;
+        }
+    }
+    ReparsedRange range = {firstItem, endItem, 0, 0, hasEdit};
+    _reparsedRanges.add(range);
+}
+
+/* Sets the result to the items of the previous module, with the items of each range replaced by the
+ * items parsed from it. If every range was parsed into as many items as it had, the items are
+ * replaced in place, as the previous module is not used anymore. */
+template<typename T>
+void Parser::spliceItems(FixedArray<T> &items, Array<T> &reparsedItems, FixedArray<T> &result, BumpAllocator &bumpMem) {
+    size_t size = items.size();
+    bool isInPlace = true;
+    for (size_t i = 0; i < _reparsedRanges.size(); i++) {
+        ReparsedRange &range = _reparsedRanges[i];
+        size_t numItems = range.endItem - range.firstItem, numReparsedItems = range.endReparsedItem - range.firstReparsedItem;
+        if (numItems != numReparsedItems) isInPlace = false;
+        size = size - numItems + numReparsedItems;
+    }
 
-            functions->add(function);
+    T *values = isInPlace && size > 0 ? &items[0] : bumpMem.alloc<T>(size);
+    size_t from = 0, to = 0;
+    for (size_t i = 0; i < _reparsedRanges.size(); i++) {
+        ReparsedRange &range = _reparsedRanges[i];
+        if (!isInPlace) {
+            for (; from < range.firstItem; from++) new(values + to++) T(items[from]);
         } else {
-            Statement *statement = parseStatement();
-            if (!statement) return nullptr;
+            to += range.firstItem - from;
+        }
+        for (uint32_t j = range.firstReparsedItem; j < range.endReparsedItem; j++) new(values + to++) T(reparsedItems[j]);
+        from = range.endItem;
+    }
+    if (!isInPlace) {
+        for (; from < items.size(); from++) new(values + to++) T(items[from]);
+    }
+    result.set(values, size);
+}
 
-            if (statement->astType == AstVariable) variables->add(static_cast<Variable *>(statement));
-            statements->add(statement);
+/* Sets the result to a list of the previous module, e.g. its functions, with the nodes of each range
+ * of items replaced by the nodes parsed from it that isNode() accepts, like spliceItems(). The nodes
+ * of a list are in source order, so the nodes of a range start at the first node at or after the
+ * range's first token. Ranges are replaced from last to first, so only nodes before the replaced
+ * ones are searched, which are still nodes of the previous module. */
+template<typename T, typename F>
+void Parser::spliceNodes(Reparse &reparse, FixedArray<T *> &nodes, FixedArray<T *> &result, F isNode) {
+    Module *previous = reparse.previous;
+    ModuleTokens &tokens = previous->tokens;
+    size_t size = nodes.size();
+    bool isInPlace = true;
+    for (size_t i = 0; i < _reparsedRanges.size(); i++) {
+        ReparsedRange &range = _reparsedRanges[i];
+        uint32_t numNodes = 0, numReparsedNodes = 0;
+        for (uint32_t j = range.firstItem; j < range.endItem; j++) numNodes += isNode(previous->items[j]);
+        for (uint32_t j = range.firstReparsedItem; j < range.endReparsedItem; j++) numReparsedNodes += isNode(_reparsedItems[j]);
+        if (numNodes != numReparsedNodes) isInPlace = false;
+        size = size - numNodes + numReparsedNodes;
+    }
+
+    T **values = isInPlace && size > 0 ? &nodes[0] : reparse.bumpMem.alloc<T *>(size);
+    size_t end = nodes.size(), to = size;
+    for (size_t i = _reparsedRanges.size(); i > 0; i--) {
+        ReparsedRange &range = _reparsedRanges[i - 1];
+        uint32_t first = (uint32_t) end;
+        if (range.firstItem < previous->items.size()) {
+            uint32_t start = tokens.start(previous->itemTokens[range.firstItem].firstToken);
+            first = lowerBound(0, (uint32_t) end, [&](uint32_t index) { return tokens.start(nodes[index]->firstToken) < start; });
+        }
+        uint32_t numNodes = 0;
+        for (uint32_t j = range.firstItem; j < range.endItem; j++) numNodes += isNode(previous->items[j]);
+        if (!isInPlace) {
+            for (size_t j = end; j > first + numNodes; j--) values[--to] = nodes[j - 1];
+        } else {
+            to -= end - (first + numNodes);
         }
+        for (uint32_t j = range.endReparsedItem; j > range.firstReparsedItem; j--) {
+            if (isNode(_reparsedItems[j - 1])) values[--to] = static_cast<T *>(_reparsedItems[j - 1]);
+        }
+        end = first;
+    }
+    if (!isInPlace) {
+        for (size_t j = end; j > 0; j--) values[--to] = nodes[j - 1];
+    }
+    result.set(values, size);
+}
+
+/* Returns whether the item is one of the statements of a module, see Module::statements. */
+static bool isStatement(AstNode *item) {
+    return item->astType != AstFunction && item->astType != AstTypeDeclaration;
+}
+
+Module *Parser::reparse(Module *previous, Source &source, SourceEdit edit, Errors &errors, BumpAllocator *bumpMem) {
+    // Reused items keep replaced ones alive in the blocks taken over from the previous module.
+    // Parsing from scratch instead leaves them behind in the previous bump allocator. If that is
+    // the bump allocator to parse into, its blocks are set aside and freed once parsing succeeded.
+    bool isAdopting = bumpMem != &previous->mem;
+    if (previous->mem.numBytes > QAK_MAX_REPARSE_GROWTH * previous->numParsedBytes) {
+        if (isAdopting) return parse(source, errors, bumpMem);
+        BumpAllocator previousMem(bumpMem->mem);
+        previousMem.adopt(*bumpMem);
+        Module *module = parse(source, errors, bumpMem);
+        if (!module) bumpMem->adopt(previousMem);
+        return module;
     }
 
-    module->variables.set(*variables);
-    module->statements.set(*statements);
-    module->functions.set(*functions);
+    // An edit of the module header changes every item. A module whose parse stopped early, and
+    // a module whose token indices are used up, are parsed from scratch as well.
+    ModuleTokens &tokens = previous->tokens;
+    FixedArray<AstNode *> &items = previous->items;
+    FixedArray<ItemTokens> &itemTokens = previous->itemTokens;
+    uint32_t numItems = (uint32_t) items.size();
+    uint32_t lastItemToken = numItems > 0 ? itemTokens[numItems - 1].lastToken : previous->name;
+    if (tokens.end(previous->name) >= edit.start || lastItemToken != previous->lastToken || tokens.isFull())
+        return parse(source, errors, bumpMem);
+
+    _lazyModule = nullptr;
+    _skipFunctionBodies = false;
+    _source = &source;
+    _errors = &errors;
+    _nestingDepth = 0;
+    _aborted = false;
+    _isParsingFunctionBody = false;
+
+    // Items before the edit are reused if the first token of the next item, which ended them, ends
+    // before the edit. Items after the edit are reused if they start after it.
+    uint32_t firstEdited = lowerBound(0, numItems, [&](uint32_t i) {
+        return i + 1 < numItems && tokens.end(itemTokens[i + 1].firstToken) < edit.start;
+    });
+    uint32_t endEdited = lowerBound(firstEdited, numItems, [&](uint32_t i) { return tokens.start(itemTokens[i].firstToken) < edit.end; });
+
+    // Tokenizing starts after the last token that ends before the edit, and stops at the first token
+    // after the edit that starts where a token after the edit started in the old source.
+    uint32_t lastBefore = firstEdited > 0 ? itemTokens[firstEdited - 1].lastToken : previous->name;
+    if (firstEdited < numItems) {
+        ItemTokens &item = itemTokens[firstEdited];
+        uint32_t token = lowerBound(item.firstToken, item.lastToken + 1, [&](uint32_t i) { return tokens.end(i) < edit.start; });
+        if (token > item.firstToken) lastBefore = token - 1;
+    }
+    uint32_t firstAfter = 0;
+    bool hasFirstAfter = false;
+    uint32_t lastEdited = lowerBound(firstEdited, endEdited, [&](uint32_t i) { return tokens.start(itemTokens[i].lastToken) < edit.end; });
+    if (lastEdited < endEdited) {
+        ItemTokens &item = itemTokens[lastEdited];
+        firstAfter = lowerBound(item.firstToken, item.lastToken, [&](uint32_t i) { return tokens.start(i) < edit.end; });
+        hasFirstAfter = true;
+    } else if (endEdited < numItems) {
+        firstAfter = itemTokens[endEdited].firstToken;
+        hasFirstAfter = true;
+    }
 
+    int32_t byteDelta = (int32_t) edit.newLength - (int32_t) (edit.end - edit.start);
+    uint32_t line = tokens.endLine(lastBefore);
+    uint32_t end = hasFirstAfter ? (uint32_t) ((int32_t) tokens.start(firstAfter) + byteDelta) : (uint32_t) source.size;
+    _editTokens.clear();
+    _editLiteralValues.clear();
+    uint32_t index = tokenizer::tokenize(source, tokens.end(lastBefore), line, end, _editTokens, _editLiteralValues, errors);
+    if (_errors->hasErrors()) return nullptr;
+
+    // The edit changed the tokens after it, e.g. by opening a string literal.
+    bool isSynchronized = hasFirstAfter && index == end;
+    if (index != end) {
+        endEdited = numItems;
+        tokenizer::tokenize(source, index, line, (uint32_t) source.size, _editTokens, _editLiteralValues, errors);
+        if (_errors->hasErrors()) return nullptr;
+    }
+    int32_t lineDelta = isSynchronized ? (int32_t) line - (int32_t) tokens.startLine(firstAfter) : 0;
+
+    // Items whose parse reported errors and functions with unparsed bodies are parsed again along
+    // with the edited items, each range from the item before it up to the item after it.
+    _reparsedRanges.clear();
+    bool isEditRangeAdded = false;
+    for (uint32_t i = 0;; i++) {
+        if (previous->numUnparsedBodies > 0) {
+            while (i < numItems && previous->isReusable[i] &&
+                   (items[i]->astType != AstFunction || static_cast<Function *>(items[i])->isBodyParsed))
+                i++;
+        } else if (i < numItems) {
+            const bool *isReusable = &previous->isReusable[0];
+            const void *notReusable = memchr(isReusable + i, 0, numItems - i);
+            i = notReusable ? (uint32_t) ((const bool *) notReusable - isReusable) : numItems;
+        }
+        if (!isEditRangeAdded && i >= firstEdited) {
+            addReparsedRange(firstEdited, endEdited, true);
+            isEditRangeAdded = true;
+        }
+        if (i >= numItems) break;
+        addReparsedRange(i, i + 1, false);
+    }
+
+    // Tokens of items before the gap store their offsets relative to the start of the source, the
+    // others relative to its end. The gap is moved to the edit, so the edit moves neither.
+    uint32_t gap = tokens.gap();
+    for (size_t i = 0; i < _reparsedRanges.size(); i++) {
+        ReparsedRange &range = _reparsedRanges[i];
+        if (!range.hasEdit) continue;
+        for (; gap < range.firstItem; gap++) tokens.moveBeforeGap(itemTokens[gap].firstToken, itemTokens[gap].lastToken);
+        for (; gap > range.endItem; gap--) tokens.moveAfterGap(itemTokens[gap - 1].firstToken, itemTokens[gap - 1].lastToken);
+    }
+    tokens.setGap(gap);
+
+    Module *module = bumpMem->allocObject<Module>(*bumpMem, previous->firstToken, previous->lastToken, previous->name);
+    module->tokens.edit(tokens, source, byteDelta, lineDelta);
+
+    // The strings of the previous module keep their indices, as reused literals refer to them.
+    if (_stringPoolModule == previous) _stringPool.setMem(*bumpMem);
+    else _stringPool.reset(*bumpMem, previous->strings);
+    _stringPoolModule = nullptr;
+
+    _reparsedItems.clear();
+    _reusableItems.clear();
+    _itemTokens.clear();
+    Reparse reparse(previous, module, *bumpMem, edit, byteDelta, lineDelta, isSynchronized);
+    for (size_t i = 0; i < _reparsedRanges.size(); i++) {
+        if (!reparseItems(reparse, i)) break;
+    }
+    if (_aborted) return nullptr;
+
+    // The lists are spliced before the items, whose previous items they look at.
+    spliceNodes(reparse, previous->variables, module->variables, [](AstNode *item) { return item->astType == AstVariable; });
+    spliceNodes(reparse, previous->functions, module->functions, [](AstNode *item) { return item->astType == AstFunction; });
+    spliceNodes(reparse, previous->statements, module->statements, isStatement);
+    spliceNodes(reparse, previous->types, module->types, [](AstNode *item) { return item->astType == AstTypeDeclaration; });
+    spliceItems(previous->items, _reparsedItems, module->items, *bumpMem);
+    spliceItems(previous->itemTokens, _itemTokens, module->itemTokens, *bumpMem);
+    spliceItems(previous->isReusable, _reusableItems, module->isReusable, *bumpMem);
+
+    // The gap follows the items parsed from the range with the edit.
+    gap = 0;
+    for (size_t i = 0; i < _reparsedRanges.size(); i++) {
+        ReparsedRange &range = _reparsedRanges[i];
+        if (!range.hasEdit) continue;
+        gap = range.endItem;
+        for (size_t j = 0; j <= i; j++) gap = gap - (_reparsedRanges[j].endItem - _reparsedRanges[j].firstItem) +
+                                              (_reparsedRanges[j].endReparsedItem - _reparsedRanges[j].firstReparsedItem);
+    }
+    module->tokens.setGap(gap);
+    module->tokens.setSize(reparse.numTokens);
+    size_t numModuleItems = module->items.size();
+    if (reparse.isStopped) module->lastToken = reparse.lastToken;
+    else module->lastToken = numModuleItems > 0 ? module->itemTokens[numModuleItems - 1].lastToken : previous->name;
+
+    // Strings are only added by edits of string literals, otherwise the previous strings are shared.
+    Array<InternedString> &strings = _stringPool.strings();
+    if (strings.size() == previous->strings.size() && strings.size() > 0) module->strings.set(&previous->strings[0], strings.size());
+    else module->strings.set(strings);
+    _stringPoolModule = module;
+    module->numParsedBytes = previous->numParsedBytes;
+    if (isAdopting) bumpMem->adopt(previous->mem);
     return module;
 }
 
-Module *Parser::parseModule() {
+bool Parser::parse(Source &source, Errors &errors, FlatModule &module) {
+    _lazyModule = nullptr;
+    _skipFunctionBodies = false;
+    module.nodes.clear();
+    module.lists.clear();
+    FlatBuilder builder(module, _tokens, _flatListStack);
+    if (parse(source, errors, module.mem, builder)) return !errors.hasErrors();
+
+    module.nodes.clear();
+    module.lists.clear();
+    return false;
+}
+
+template<typename Builder>
+typename Builder::Node Parser::parse(Source &source, Errors &errors, BumpAllocator &bumpMem, Builder &builder) {
+    _source = &source;
+    _errors = &errors;
+    _nestingDepth = 0;
+    _aborted = false;
+    _isParsingFunctionBody = false;
+
+    _tokens.clear();
+    _literalValues.clear();
+    tokenizer::tokenize(source, _tokens, _literalValues, errors);
+    if (_errors->hasErrors()) return nullptr;
+
+    _stringPool.reset(bumpMem);
+    _stringPoolModule = nullptr;
+
+    TokenStream stream(source, _tokens, errors);
+    _stream = &stream;
+    _streamLiteralValues = &_literalValues;
+
+    return parseModule(builder);
+}
+
+template<typename Builder>
+typename Builder::Node Parser::parseModule(Builder &builder) {
     Token *moduleKeyword = _stream->expect(QAK_STR("module"));
     if (!moduleKeyword) return nullptr;
 
     Token *moduleName = _stream->expect(Identifier);
     if (!moduleName) return nullptr;
 
-    Module *module = _bumpMem->allocObject<Module>(*_bumpMem, *moduleName);
-    return module;
+    // If the parser stops recovering from errors, the items parsed so
+    // far make up the module, unless the source nests too deeply.
+    typename Builder::List items(builder);
+    _itemTokens.clear();
+    _reusableItems.clear();
+    while (_stream->hasMore()) {
+        size_t startIndex = _stream->getIndex(), numErrors = _errors->getErrors().size();
+        typename Builder::Node item = parseStatementOrRecover(builder, true);
+        if (!item) break;
+
+        items.add(item);
+        _itemTokens.add(ItemTokens((uint32_t) startIndex, (uint32_t) _stream->getIndex() - 1));
+        _reusableItems.add(_errors->getErrors().size() == numErrors);
+    }
+    if (_aborted) return nullptr;
+
+    return builder.module(*moduleKeyword, *moduleName, items, _stringPool.strings());
 }
 
-Function *Parser::parseFunction() {
-    _stream->expect(QAK_STR("fun"));
+template<typename Builder>
+typename Builder::Node Parser::parseFunction(Builder &builder) {
+    Token *funToken = _stream->expect(QAK_STR("fun"));
 
     Token *name = _stream->expect(Identifier);
     if (!name) return nullptr;
 
-    ArrayPoolMonitor<Parameter *> parameterArrays(_parameterArrayPool);
-    Array<Parameter *> *parameters = parameterArrays.obtain(QAK_SRC_LOC);
-    if (!parseParameters(*parameters)) return nullptr;
+    // Errors in the parameters or return type skip the rest of the signature,
+    // so the body is still parsed as part of the function.
+    typename Builder::List parameters(builder);
+    if (!parseParameters(builder, parameters) && !synchronize()) return nullptr;
 
-    TypeSpecifier *returnType = nullptr;
+    typename Builder::Node returnType = nullptr;
     if (_stream->match(QAK_STR(":"), true)) {
-        returnType = parseTypeSpecifier();
-        if (!returnType) return nullptr;
+        returnType = parseTypeSpecifier(builder);
+        if (!returnType && !synchronize()) return nullptr;
+    }
+
+    uint32_t bodyFirstToken = (uint32_t) _stream->getIndex();
+    typename Builder::List statements(builder);
+    if (_skipFunctionBodies) {
+        Token *endToken = skipFunctionBody();
+        if (!endToken) return nullptr;
+
+        return builder.function(*funToken, *name, parameters, returnType, bodyFirstToken, statements, *endToken, false);
     }
 
-    ArrayPoolMonitor<Statement *> statementArrays(_statementArrayPool);
-    Array<Statement *> *statements = statementArrays.obtain(QAK_SRC_LOC);
     while (_stream->hasMore() && !_stream->match(QAK_STR("end"), false)) {
-        Statement *statement = parseStatement();
+        typename Builder::Node statement = parseStatementOrRecover(builder, false);
         if (!statement) return nullptr;
-        statements->add(statement);
+        statements.add(statement);
+    }
+
+    Token *endToken = expectEnd();
+    if (!endToken) return nullptr;
+
+    return builder.function(*funToken, *name, parameters, returnType, bodyFirstToken, statements, *endToken, true);
+}
+
+/* Parses a value type, "type Name [packed] [c] [soa]" followed by its fields and "end". The
+ * modifiers are the identifiers after the name that are not followed by ":", which would make
+ * them the name of the first field. A field that fails to parse skips the rest of the type, so
+ * its fields are not parsed as statements, and the type is recovered as a whole. */
+template<typename Builder>
+typename Builder::Node Parser::parseTypeDeclaration(Builder &builder) {
+    Token *typeToken = _stream->expect(QAK_STR("type"));
+
+    Token *name = _stream->expect(Identifier);
+    if (!name) return nullptr;
+
+    bool isPacked = false, isCCompatible = false, isStructureOfArrays = false;
+    Array<Token> &tokens = _stream->getTokens();
+    while (_stream->match(Identifier, false)) {
+        size_t next = _stream->getIndex() + 1;
+        if (next < tokens.size() && tokens[next].matches(QAK_STR(":"))) break;
+        if (_stream->match(QAK_STR("packed"), true)) isPacked = true;
+        else if (_stream->match(QAK_STR("c"), true)) isCCompatible = true;
+        else if (_stream->match(QAK_STR("soa"), true)) isStructureOfArrays = true;
+        else break;
+    }
+
+    typename Builder::List fields(builder);
+    while (_stream->hasMore() && !_stream->match(QAK_STR("end"), false)) {
+        typename Builder::Node field = parseField(builder);
+        if (!field) {
+            while (_stream->hasMore() && !_stream->match(QAK_STR("end"), true)) _stream->consume();
+            return nullptr;
+        }
+        fields.add(field);
+    }
+
+    Token *endToken = expectEnd();
+    if (!endToken) return nullptr;
+
+    return builder.typeDeclaration(*typeToken, *name, isPacked, isCCompatible, isStructureOfArrays, fields, *endToken);
+}
+
+template<typename Builder>
+typename Builder::Node Parser::parseField(Builder &builder) {
+    Token *name = _stream->expect(Identifier);
+    if (!name) return nullptr;
+    if (!_stream->expect(QAK_STR(":"))) return nullptr;
+    typename Builder::Node type = parseTypeSpecifier(builder);
+    if (!type) return nullptr;
+
+    return builder.field(*name, type);
+}
+
+/* Skips the body of a function up to and including its "end", by matching each "while",
+ * "if" and "fun" with an "end". Decodes the character and string literals of the body, so
+ * the strings of the module are complete without parsing the body. Returns the "end" token,
+ * or nullptr if parsing must stop. */
+Token *Parser::skipFunctionBody() {
+    uint32_t depth = 1;
+    while (_stream->hasMore()) {
+        Token *token = _stream->consume();
+        if (token->type == Identifier) {
+            if (token->matches(QAK_STR("while")) || token->matches(QAK_STR("if")) || token->matches(QAK_STR("fun"))) depth++;
+            else if (token->matches(QAK_STR("end")) && --depth == 0) return token;
+        } else if (token->type == StringLiteral || token->type == CharacterLiteral) {
+            LiteralValue value;
+            value.longValue = 0;
+            if (!decodeCharacterOrString(*token, value) && !canRecover()) return nullptr;
+            token->literalIndex = (uint32_t) _literalValues.size();
+            _literalValues.add(value);
+        }
+    }
+    return expectEnd();
+}
+
+bool Parser::parseFunctionBody(Module *module, Function *function, Errors &errors) {
+    if (function->isBodyParsed) return true;
+
+    TokenChunk *chunk = module->tokens.chunk(function->firstToken);
+    if (_lazyModule != module || _tokens.size() != chunk->size) {
+        _tokens.clear();
+        _tokens.addAll(&module->tokens[chunk->firstIndex], chunk->size);
+        _literalValues.clear();
+        _literalValues.addAll(chunk->literalValues, chunk->numLiteralValues);
+        _lazyModule = module;
+    }
+    bool isParsed = parseFunctionBody(function, _tokens, chunk->firstIndex, _literalValues, errors, module->mem);
+    if (module->numUnparsedBodies > 0) module->numUnparsedBodies--;
+    if (!isParsed) markNotReusable(module, function);
+    return isParsed;
+}
+
+/* Parses the statements of a function from the tokens and literal values of its chunk, which
+ * starts at the first index of the module's tokens. They are only read, so threads can parse
+ * the bodies of different functions from the same arrays. */
+bool Parser::parseFunctionBody(Function *function, Array<Token> &tokens, uint32_t firstIndex, Array<LiteralValue> &literalValues,
+                               Errors &errors, BumpAllocator &bumpMem) {
+    if (function->isBodyParsed) return true;
+
+    _source = &tokens[0].source;
+    _streamLiteralValues = &literalValues;
+    _errors = &errors;
+    _nestingDepth = 0;
+    _aborted = false;
+    _isParsingFunctionBody = true;
+    size_t numErrors = errors.getErrors().size();
+
+    TokenStream stream(*_source, tokens, function->bodyFirstToken - firstIndex, function->lastToken + 1 - firstIndex, errors);
+    _stream = &stream;
+
+    TreeBuilder builder(bumpMem, tokens, firstIndex);
+    TreeBuilder::List statements(builder);
+    while (_stream->hasMore() && !_stream->match(QAK_STR("end"), false)) {
+        TreeBuilder::Node statement = parseStatementOrRecover(builder, false);
+        if (!statement) break;
+        statements.add(statement);
+    }
+    builder.functionBody(function, statements);
+
+    _isParsingFunctionBody = false;
+    _stream = nullptr;
+    return errors.getErrors().size() == numErrors;
+}
+
+/** The errors of a function body parsed by a worker, stored consecutively in the worker's errors. */
+struct FunctionBodyErrors {
+    uint32_t worker;
+    uint32_t start;
+    uint32_t size;
+};
+
+/** A thread parsing function bodies. The nodes and error messages of the bodies are
+ * allocated in the worker's bump allocator, which the module takes over once all
+ * bodies are parsed. */
+struct FunctionBodyWorker {
+    HeapAllocator mem;
+    BumpAllocator bumpMem;
+    Errors errors;
+    bool aborted;
+
+    FunctionBodyWorker() : bumpMem(mem), errors(mem, bumpMem), aborted(false) {}
+};
+
+struct Parser::ParallelParse {
+    Parser &parser;
+    Module *module;
+    Array<FunctionBodyWorker *> workers;
+    Array<FunctionBodyErrors> functionErrors;
+    std::atomic<size_t> nextFunction;
+
+    ParallelParse(Parser &parser, Module *module) : parser(parser), module(module), workers(parser._mem), functionErrors(parser._mem), nextFunction(0) {}
+};
+
+/* Parses the bodies of functions until none are left. Each worker takes the next function from
+ * the shared counter and records the errors of its body, so they can be reported in source order. */
+void Parser::parseFunctionBodies(ParallelParse *parallelParse, uint32_t workerIndex) {
+    FunctionBodyWorker &worker = *parallelParse->workers[workerIndex];
+    FixedArray<Function *> &functions = parallelParse->module->functions;
+
+    Parser parser(worker.mem);
+    parser._maxNestingDepth = parallelParse->parser._maxNestingDepth;
+    parser._maxErrors = parallelParse->parser._maxErrors;
+
+    while (true) {
+        size_t index = parallelParse->nextFunction++;
+        if (index >= functions.size()) break;
+
+        Errors bodyErrors(worker.mem, worker.bumpMem);
+        parser.parseFunctionBody(functions[index], parallelParse->parser._tokens, 0, parallelParse->parser._literalValues, bodyErrors,
+                                 worker.bumpMem);
+        if (parser._aborted) worker.aborted = true;
+
+        FunctionBodyErrors &result = parallelParse->functionErrors[index];
+        result.worker = workerIndex;
+        result.start = (uint32_t) worker.errors.getErrors().size();
+        result.size = (uint32_t) bodyErrors.getErrors().size();
+        worker.errors.addAll(bodyErrors);
     }
+}
 
-    if (!_stream->expect(QAK_STR("end"))) return nullptr;
+/* Parses the skipped bodies of the module's functions on up to _numThreads threads, the calling
+ * thread included. The errors of the bodies are merged with the errors of the module by their
+ * position in the source, and capped at _maxErrors. Returns false if a body nests too deeply. */
+bool Parser::parseFunctionBodiesInParallel(Module *module, Errors &errors) {
+    FixedArray<Function *> &functions = module->functions;
+    if (functions.size() == 0) return true;
+
+    // Errors at the end of the source look up its last line. Scan the
+    // lines now, as Source::lines() is not thread-safe.
+    _source->lines();
+
+    ParallelParse parallelParse(*this, module);
+    FunctionBodyErrors noErrors = {0, 0, 0};
+    parallelParse.functionErrors.setSize(functions.size(), noErrors);
+
+    uint32_t numWorkers = _numThreads < functions.size() ? _numThreads : (uint32_t) functions.size();
+#ifdef WASM
+    numWorkers = 1;
+#endif
+    for (uint32_t i = 0; i < numWorkers; i++)
+        parallelParse.workers.add(_mem.allocObject<FunctionBodyWorker>(QAK_SRC_LOC));
+
+#ifndef WASM
+    std::thread *threads = _mem.alloc<std::thread>(numWorkers - 1, QAK_SRC_LOC);
+    for (uint32_t i = 1; i < numWorkers; i++)
+        new(&threads[i - 1]) std::thread(parseFunctionBodies, &parallelParse, i);
+#endif
+    parseFunctionBodies(&parallelParse, 0);
+#ifndef WASM
+    for (uint32_t i = 1; i < numWorkers; i++) {
+        threads[i - 1].join();
+        threads[i - 1].~thread();
+    }
+    if (threads) _mem.free(threads, QAK_SRC_LOC);
+#endif
+
+    // Errors of the bodies are inserted before the first error of the module that follows
+    // them. Like sequential parsing, no more than _maxErrors errors are reported.
+    Array<Error> moduleErrors(_mem);
+    moduleErrors.addAll(errors.getErrors());
+    errors.getErrors().clear();
+    size_t nextModuleError = 0;
+    for (size_t i = 0; i < functions.size(); i++) {
+        FunctionBodyErrors &result = parallelParse.functionErrors[i];
+        Array<Error> &workerErrors = parallelParse.workers[result.worker]->errors.getErrors();
+        if (result.size > 0) markNotReusable(module, functions[i]);
+        for (uint32_t j = 0; j < result.size; j++) {
+            Error &error = workerErrors[result.start + j];
+            while (nextModuleError < moduleErrors.size() && moduleErrors[nextModuleError].span.start <= error.span.start) {
+                if (errors.getErrors().size() < _maxErrors) errors.add(moduleErrors[nextModuleError]);
+                nextModuleError++;
+            }
+            if (errors.getErrors().size() < _maxErrors) errors.add(error.span, "%s", error.message);
+        }
+    }
+    for (; nextModuleError < moduleErrors.size(); nextModuleError++) {
+        if (errors.getErrors().size() < _maxErrors) errors.add(moduleErrors[nextModuleError]);
+    }
 
-    Function *function = _bumpMem->allocObject<Function>(*_bumpMem, *name, *parameters, returnType, *statements);
-    return function;
+    bool aborted = false;
+    for (uint32_t i = 0; i < numWorkers; i++) {
+        FunctionBodyWorker *worker = parallelParse.workers[i];
+        if (worker->aborted) aborted = true;
+        module->mem.adopt(worker->bumpMem);
+        _mem.freeObject(worker, QAK_SRC_LOC);
+    }
+    return !aborted;
 }
 
-bool Parser::parseParameters(Array<Parameter *> &parameters) {
+template<typename Builder>
+bool Parser::parseParameters(Builder &builder, typename Builder::List &parameters) {
     if (!_stream->expect(QAK_STR("("))) return false;
 
     while (_stream->match(Identifier, false)) {
-        Parameter *parameter = parseParameter();
+        typename Builder::Node parameter = parseParameter(builder);
         if (!parameter) return false;
 
         parameters.add(parameter);
@@ -130,211 +1390,406 @@ bool Parser::parseParameters(Array<Parameter *> &parameters) {
     return _stream->expect(QAK_STR(")"));
 }
 
-ast::Parameter *Parser::parseParameter() {
+template<typename Builder>
+typename Builder::Node Parser::parseParameter(Builder &builder) {
     Token *name = _stream->consume();
     if (!_stream->expect(QAK_STR(":"))) return nullptr;
-    TypeSpecifier *type = parseTypeSpecifier();
+    typename Builder::Node type = parseTypeSpecifier(builder);
     if (!type) return nullptr;
 
-    Parameter *parameter = _bumpMem->allocObject<Parameter>(*name, type);
-    return parameter;
+    return builder.parameter(*name, type);
+}
+
+void Parser::setMaxNestingDepth(uint32_t maxNestingDepth) {
+    _maxNestingDepth = maxNestingDepth;
+}
+
+void Parser::setMaxErrors(uint32_t maxErrors) {
+    _maxErrors = maxErrors;
+}
+
+void Parser::setLazyFunctionBodies(bool lazyFunctionBodies) {
+    _lazyFunctionBodies = lazyFunctionBodies;
+}
+
+void Parser::setNumThreads(uint32_t numThreads) {
+    _numThreads = numThreads;
 }
 
-Statement *Parser::parseStatement() {
+/* Returns whether the current nesting depth exceeds the maximum nesting depth, and
+ * adds an error if so. Each recursive step of the parser that can be repeated by the
+ * source, like nested blocks, parentheses or unary operators, must check this. */
+bool Parser::isNestingTooDeep() {
+    if (_nestingDepth <= _maxNestingDepth) return false;
+
+    Array<Token> &tokens = _stream->getTokens();
+    Token *token = _stream->hasMore() ? _stream->peek() : &tokens[tokens.size() - 1];
+    _errors->add(*token, "Maximum nesting depth of %u exceeded.", _maxNestingDepth);
+    _aborted = true;
+    return true;
+}
+
+/* Returns whether the token is a keyword starting a statement or ending a block. Keywords
+ * are tokenized as identifiers. */
+static bool isStatementKeyword(Token &token) {
+    return token.matches(QAK_STR("var")) || token.matches(QAK_STR("while")) || token.matches(QAK_STR("if")) ||
+           token.matches(QAK_STR("else")) || token.matches(QAK_STR("return")) || token.matches(QAK_STR("fun")) ||
+           token.matches(QAK_STR("type")) || token.matches(QAK_STR("end"));
+}
+
+/* Returns whether the parser can continue after an error. It can not once the
+ * nesting depth was exceeded or the maximum number of errors was reached. */
+bool Parser::canRecover() {
+    return !_aborted && _errors->getErrors().size() < _maxErrors;
+}
+
+/* Returns whether the next token is where parsing can resume after an error: the
+ * first token on a new line, or a keyword starting a statement or ending a block. */
+bool Parser::isSynchronizationPoint() {
+    Array<Token> &tokens = _stream->getTokens();
+    size_t index = _stream->getIndex();
+    if (index > 0 && tokens[index].startLine > tokens[index - 1].endLine) return true;
+
+    return isStatementKeyword(tokens[index]);
+}
+
+/* Skips tokens up to the next synchronization point after an error. Returns false
+ * if parsing must stop instead, see canRecover(). */
+bool Parser::synchronize() {
+    if (!canRecover()) return false;
+
+    while (_stream->hasMore() && !isSynchronizationPoint()) _stream->consume();
+    return true;
+}
+
+/* Expects the "end" closing a block. The statement loops of blocks only stop at "end"
+ * or at the end of the source, so a missing "end" is reported and the block is closed
+ * at the last token instead. Returns nullptr if parsing must stop. */
+Token *Parser::expectEnd() {
+    Token *endToken = _stream->expect(QAK_STR("end"));
+    if (endToken) return endToken;
+    if (!canRecover()) return nullptr;
+
+    Array<Token> &tokens = _stream->getTokens();
+    return &tokens[tokens.size() - 1];
+}
+
+/* Parses a statement, or a function or type if allowed. If that fails, recovers from the
+ * error, see recover(). The token the statement failed on is skipped if the statement did
+ * not consume any tokens, so the statement loops make progress. */
+template<typename Builder>
+typename Builder::Node Parser::parseStatementOrRecover(Builder &builder, bool isFunctionAllowed) {
+    size_t startIndex = _stream->getIndex();
+    typename Builder::Node statement = nullptr;
+    if (isFunctionAllowed && _stream->match(QAK_STR("fun"), false)) statement = parseFunction(builder);
+    else if (isFunctionAllowed && _stream->match(QAK_STR("type"), false)) statement = parseTypeDeclaration(builder);
+    else statement = parseStatement(builder);
+    if (statement) return statement;
+
+    if (_stream->getIndex() == startIndex) _stream->consume();
+    return recover(builder, startIndex);
+}
+
+/* Skips the remaining tokens of a statement or expression that failed to parse, and
+ * returns an error node covering its tokens, starting at the given token index. Returns
+ * nullptr if parsing must stop instead, see canRecover(). */
+template<typename Builder>
+typename Builder::Node Parser::recover(Builder &builder, size_t startIndex) {
+    if (!synchronize()) return nullptr;
+
+    // If the error occurred at the end of the source, no tokens were skipped. The
+    // error node then covers the token before it.
+    Array<Token> &tokens = _stream->getTokens();
+    size_t endIndex = _stream->getIndex();
+    if (endIndex == startIndex) return builder.error(tokens[startIndex - 1], tokens[startIndex - 1]);
+    return builder.error(tokens[startIndex], tokens[endIndex - 1]);
+}
+
+template<typename Builder>
+typename Builder::Node Parser::parseStatement(Builder &builder) {
+    NestingMonitor nesting(_nestingDepth);
+    if (isNestingTooDeep()) return nullptr;
+
     if (_stream->match(QAK_STR("var"), false)) {
-        return parseVariable();
+        return parseVariable(builder);
     } else if (_stream->match(QAK_STR("while"), false)) {
-        return parseWhile();
+        return parseWhile(builder);
     } else if (_stream->match(QAK_STR("if"), false)) {
-        return parseIf();
+        return parseIf(builder);
     } else if (_stream->match(QAK_STR("return"), false)) {
-        return parseReturn();
+        return parseReturn(builder);
     } else {
-        return parseExpression();
+        return parseExpression(builder);
     }
 }
 
-Variable *Parser::parseVariable() {
-    _stream->expect(QAK_STR("var"));
+template<typename Builder>
+typename Builder::Node Parser::parseVariable(Builder &builder) {
+    Token *varToken = _stream->expect(QAK_STR("var"));
 
     Token *name = _stream->expect(Identifier);
     if (!name) return nullptr;
 
-    TypeSpecifier *type = nullptr;
+    typename Builder::Node type = nullptr;
     if (_stream->match(QAK_STR(":"), true)) {
-        type = parseTypeSpecifier();
+        type = parseTypeSpecifier(builder);
         if (!type) return nullptr;
     }
 
-    Expression *expression = nullptr;
+    typename Builder::Node expression = nullptr;
     if (_stream->match(QAK_STR("="), true)) {
-        expression = parseExpression();
+        expression = parseExpression(builder);
         if (!expression) return nullptr;
     }
 
-    Variable *variable = _bumpMem->allocObject<Variable>(*name, type, expression);
-    return variable;
+    return builder.variable(*varToken, *name, type, expression);
 }
 
-While *Parser::parseWhile() {
+template<typename Builder>
+typename Builder::Node Parser::parseWhile(Builder &builder) {
     Token *whileToken = _stream->expect(QAK_STR("while"));
 
-    Expression *condition = parseExpression();
-    if (!condition) return nullptr;
+    size_t conditionIndex = _stream->getIndex();
+    typename Builder::Node condition = parseExpression(builder);
+    if (!condition) {
+        condition = recover(builder, conditionIndex);
+        if (!condition) return nullptr;
+    }
 
-    ArrayPoolMonitor<Statement *> statementArrays(_statementArrayPool);
-    Array<Statement *> *statements = statementArrays.obtain(QAK_SRC_LOC);
+    typename Builder::List statements(builder);
     while (_stream->hasMore() && !_stream->match(QAK_STR("end"), false)) {
-        Statement *statement = parseStatement();
-        if (statement == nullptr) return nullptr;
-        statements->add(statement);
+        typename Builder::Node statement = parseStatementOrRecover(builder, false);
+        if (!statement) return nullptr;
+        statements.add(statement);
     }
 
     // BOZO expect should also take a custom error string, so we can
     // say something like "Expected a closing 'end' for 'while' statement".
     // Fix this up anywhere else we use expect() as well.
-    Token *endToken = _stream->expect(QAK_STR("end"));
+    Token *endToken = expectEnd();
     if (!endToken) return nullptr;
 
-    While *whileStmt = _bumpMem->allocObject<While>(*_bumpMem, *whileToken, *endToken, condition, *statements);
-
-    return whileStmt;
+    return builder.whileNode(*whileToken, *endToken, condition, statements);
 }
 
-If *Parser::parseIf() {
+template<typename Builder>
+typename Builder::Node Parser::parseIf(Builder &builder) {
     Token *ifToken = _stream->expect(QAK_STR("if"));
 
-    Expression *condition = parseExpression();
-    if (!condition) return nullptr;
+    size_t conditionIndex = _stream->getIndex();
+    typename Builder::Node condition = parseExpression(builder);
+    if (!condition) {
+        condition = recover(builder, conditionIndex);
+        if (!condition) return nullptr;
+    }
 
-    ArrayPoolMonitor<Statement *> statementArrays(_statementArrayPool);
-    Array<Statement *> *trueBlock = statementArrays.obtain(QAK_SRC_LOC);
+    typename Builder::List trueBlock(builder);
     while (_stream->hasMore() && !_stream->match(QAK_STR("end"), false) && !_stream->match(QAK_STR("else"), false)) {
-        Statement *statement = parseStatement();
-        if (statement == nullptr) return nullptr;
-        trueBlock->add(statement);
+        typename Builder::Node statement = parseStatementOrRecover(builder, false);
+        if (!statement) return nullptr;
+        trueBlock.add(statement);
     }
 
-    Array<Statement *> *falseBlock = statementArrays.obtain(QAK_SRC_LOC);
+    typename Builder::List falseBlock(builder);
     if (_stream->match(QAK_STR("else"), true)) {
         while (_stream->hasMore() && !_stream->match(QAK_STR("end"), false)) {
-            Statement *statement = parseStatement();
-            if (statement == nullptr) return nullptr;
-            falseBlock->add(statement);
+            typename Builder::Node statement = parseStatementOrRecover(builder, false);
+            if (!statement) return nullptr;
+            falseBlock.add(statement);
         }
     }
 
-    Token *endToken = _stream->expect(QAK_STR("end"));
+    Token *endToken = expectEnd();
     if (!endToken) return nullptr;
 
-    If *ifStmt = _bumpMem->allocObject<If>(*_bumpMem, *ifToken, *endToken, condition, *trueBlock, *falseBlock);
-    return ifStmt;
+    return builder.ifNode(*ifToken, *endToken, condition, trueBlock, falseBlock);
 }
 
-Return *Parser::parseReturn() {
+template<typename Builder>
+typename Builder::Node Parser::parseReturn(Builder &builder) {
     Token *returnToken = _stream->expect(QAK_STR("return"));
 
     if (_stream->match(QAK_STR(";"), true)) {
-        return _bumpMem->allocObject<Return>(*returnToken, *returnToken, nullptr);
+        return builder.returnNode(*returnToken, nullptr);
     } else {
-        Expression *returnValue = parseExpression();
+        typename Builder::Node returnValue = parseExpression(builder);
         if (!returnValue) return nullptr;
-        return _bumpMem->allocObject<Return>(*returnToken, returnValue->span, returnValue);
+        return builder.returnNode(*returnToken, returnValue);
     }
 }
 
-TypeSpecifier *Parser::parseTypeSpecifier() {
+template<typename Builder>
+typename Builder::Node Parser::parseTypeSpecifier(Builder &builder) {
     Token *name = _stream->expect(Identifier);
     if (!name) return nullptr;
 
-    TypeSpecifier *type = _bumpMem->allocObject<TypeSpecifier>(*name);
-    return type;
+    return builder.typeSpecifier(*name);
 }
 
-Expression *Parser::parseExpression() {
-    return parseTernaryOperator();
+template<typename Builder>
+typename Builder::Node Parser::parseExpression(Builder &builder) {
+    NestingMonitor nesting(_nestingDepth);
+    if (isNestingTooDeep()) return nullptr;
+
+    return parseTernaryOperator(builder);
 }
 
-Expression *Parser::parseTernaryOperator() {
-    Expression *condition = parseBinaryOperator(0);
+template<typename Builder>
+typename Builder::Node Parser::parseTernaryOperator(Builder &builder) {
+    typename Builder::Node condition = parseBinaryOperator(builder, 1);
     if (!condition) return nullptr;
 
     if (_stream->match(QAK_STR("?"), true)) {
-        Expression *trueValue = parseTernaryOperator();
+        typename Builder::Node trueValue = parseExpression(builder);
         if (!trueValue) return nullptr;
-        if (!_stream->match(QAK_STR(":"), true)) return nullptr;
-        Expression *falseValue = parseTernaryOperator();
+        if (!_stream->expect(QAK_STR(":"))) return nullptr;
+        typename Builder::Node falseValue = parseExpression(builder);
         if (!falseValue) return nullptr;
-        TernaryOperation *ternary = _bumpMem->allocObject<TernaryOperation>(condition, trueValue, falseValue);
-        return ternary;
+        return builder.ternaryOperation(condition, trueValue, falseValue);
     } else {
         return condition;
     }
 }
 
 #define OPERATOR_END (TokenType)0xffff
-#define OPERATOR_NUM_GROUPS 6
-
-static TokenType binaryOperators[OPERATOR_NUM_GROUPS][5] = {
-        {Assignment, OPERATOR_END},
-        {Or,           And,       Xor,        OPERATOR_END},
-        {Equal,        NotEqual, OPERATOR_END},
-        {Less,         LessEqual, Greater, GreaterEqual, OPERATOR_END},
-        {Plus,         Minus,    OPERATOR_END},
-        {ForwardSlash, Asterisk,  Percentage, OPERATOR_END}
-};
-
-Expression *Parser::parseBinaryOperator(uint32_t level) {
-    int nextLevel = level + 1;
 
-    Expression *left = nextLevel == OPERATOR_NUM_GROUPS ? parseUnaryOperator() : parseBinaryOperator(nextLevel);
+/* The precedence of each binary operator, indexed by TokenType. Higher values
+ * bind tighter. 0 marks token types that are not binary operators. All binary
+ * operators are left-associative. */
+static const uint8_t binaryOperatorPrecedence[] = {
+        0, // .
+        0, // ,
+        0, // ;
+        0, // :
+        5, // +
+        5, // -
+        6, // *
+        6, // /
+        6, // %
+        0, // (
+        0, // )
+        0, // [
+        0, // ]
+        0, // {
+        0, // }
+        4, // <=
+        4, // >=
+        3, // !=
+        3, // ==
+        4, // <
+        4, // >
+        1, // =
+        2, // &
+        2, // |
+        2, // ^
+        0, // !
+        0, // #
+        0, // ?
+        0, // Unknown
+        0, // BooleanLiteral
+        0, // DoubleLiteral
+        0, // FloatLiteral
+        0, // LongLiteral
+        0, // IntegerLiteral
+        0, // ShortLiteral
+        0, // ByteLiteral
+        0, // CharacterLiteral
+        0, // StringLiteral
+        0, // NothingLiteral
+        0, // Identifier
+};
+static_assert(sizeof(binaryOperatorPrecedence) / sizeof(binaryOperatorPrecedence[0]) == Identifier + 1,
+              "Expected a precedence for each token type.");
+
+/* Parses a sequence of binary operations with operators of at least the given precedence
+ * (precedence climbing). Operators of the same precedence are folded into the left
+ * operand, operators of higher precedence are parsed by the recursive call for the
+ * right operand. */
+template<typename Builder>
+typename Builder::Node Parser::parseBinaryOperator(Builder &builder, uint32_t minPrecedence) {
+    typename Builder::Node left = parseUnaryOperator(builder);
     if (!left) return nullptr;
 
     while (_stream->hasMore()) {
-        TokenType *op = binaryOperators[level];
-        while (*op != OPERATOR_END) {
-            if (_stream->match(*op, false)) break;
-            op++;
-        }
-        if (*op == OPERATOR_END) break;
+        uint32_t precedence = binaryOperatorPrecedence[_stream->peek()->type];
+        if (precedence < minPrecedence || precedence == 0) break;
 
         Token *opToken = _stream->consume();
-        Expression *right = nextLevel == OPERATOR_NUM_GROUPS ? parseUnaryOperator() : parseBinaryOperator(nextLevel);
-        if (right == nullptr) return nullptr;
+        typename Builder::Node right = parseBinaryOperator(builder, precedence + 1);
+        if (!right) return nullptr;
 
-        left = _bumpMem->allocObject<BinaryOperation>(*opToken, left, right);
+        left = builder.binaryOperation(*opToken, left, right);
     }
     return left;
 }
 
 static TokenType unaryOperators[] = {Not, Plus, Minus, OPERATOR_END};
 
-Expression *Parser::parseUnaryOperator() {
+/* Returns the decoded value of an integer literal token, sign extended to 64 bits. */
+static int64_t integerLiteralValue(Token &token, LiteralValue &value) {
+    switch (token.type) {
+        case ByteLiteral:
+            return value.byteValue;
+        case ShortLiteral:
+            return value.shortValue;
+        case LongLiteral:
+            return value.longValue;
+        default:
+            return value.intValue;
+    }
+}
+
+/* Returns whether the token is a decimal integer literal one larger than the maximum of its type,
+ * e.g. 2147483648. The tokenizer decodes these as the minimum of the type, they are only valid as
+ * the operand of a unary minus, see parseUnaryOperator(). */
+static bool isMinimumIntegerLiteral(Token &token, Array<LiteralValue> &literalValues) {
+    switch (token.type) {
+        case ByteLiteral:
+        case ShortLiteral:
+        case IntegerLiteral:
+        case LongLiteral:
+            break;
+        default:
+            return false;
+    }
+    if (token.end - token.start > 1 && token.source.data[token.start + 1] == 'x') return false;
+    return integerLiteralValue(token, literalValues[token.literalIndex]) < 0;
+}
+
+template<typename Builder>
+typename Builder::Node Parser::parseUnaryOperator(Builder &builder) {
     TokenType *op = unaryOperators;
     while (*op != OPERATOR_END) {
         if (_stream->match(*op, false)) break;
         op++;
     }
     if (*op != OPERATOR_END) {
+        NestingMonitor nesting(_nestingDepth);
+        if (isNestingTooDeep()) return nullptr;
+
         Token *op = _stream->consume();
-        Expression *expression = parseUnaryOperator();
+        if (op->type == Minus && _stream->hasMore() && isMinimumIntegerLiteral(*_stream->peek(), *_streamLiteralValues)) {
+            Token *token = _stream->consume();
+            return builder.unaryOperation(*op, builder.literal(*token, (*_streamLiteralValues)[token->literalIndex]));
+        }
+        typename Builder::Node expression = parseUnaryOperator(builder);
         if (!expression) return nullptr;
-        UnaryOperation *operation = _bumpMem->allocObject<UnaryOperation>(*op, expression);
-        return operation;
+        return builder.unaryOperation(*op, expression);
     } else {
         if (_stream->match(QAK_STR("("), true)) {
-            Expression *expression = parseExpression();
+            typename Builder::Node expression = parseExpression(builder);
             if (!expression) return nullptr;
             if (!_stream->expect(QAK_STR(")"))) return nullptr;
             return expression;
         } else {
-            return parseAccessOrCallOrLiteral();
+            return parseAccessOrCallOrLiteral(builder);
         }
     }
     return nullptr;
 }
 
-Expression *Parser::parseAccessOrCallOrLiteral() {
+template<typename Builder>
+typename Builder::Node Parser::parseAccessOrCallOrLiteral(Builder &builder) {
     if (!_stream->hasMore()) {
         if (_stream->getTokens().size() > 0) {
             Token token = _stream->getTokens()[_stream->getTokens().size() - 1];
@@ -349,257 +1804,380 @@ Expression *Parser::parseAccessOrCallOrLiteral() {
 
     switch (tokenType) {
         case StringLiteral:
+        case CharacterLiteral: {
+            Token *token = _stream->consume();
+            // The literals of skipped function bodies were decoded by skipFunctionBody().
+            if (_isParsingFunctionBody) return builder.literal(*token, (*_streamLiteralValues)[token->literalIndex]);
+
+            LiteralValue value;
+            value.longValue = 0;
+            if (!decodeCharacterOrString(*token, value)) return nullptr;
+            return builder.literal(*token, value);
+        }
+
+        case NothingLiteral: {
+            Token *token = _stream->consume();
+            LiteralValue value;
+            value.longValue = 0;
+            return builder.literal(*token, value);
+        }
+
         case BooleanLiteral:
         case DoubleLiteral:
         case FloatLiteral:
         case ByteLiteral:
         case ShortLiteral:
         case IntegerLiteral:
-        case LongLiteral:
-        case CharacterLiteral:
-        case NothingLiteral: {
+        case LongLiteral: {
             Token *token = _stream->consume();
-            Literal *literal = _bumpMem->allocObject<Literal>(token->type, *token);
-            return literal;
+            LiteralValue &value = (*_streamLiteralValues)[token->literalIndex];
+            if (isMinimumIntegerLiteral(*token, *_streamLiteralValues)) {
+                _errors->add(*token, "%s is out of range, the maximum value is %llu.", tokenizer::tokenTypeToString(token->type),
+                             (unsigned long long) -(integerLiteralValue(*token, value) + 1));
+                return nullptr;
+            }
+            return builder.literal(*token, value);
         }
 
         case Identifier:
-            return parseAccessOrCall();
+            // Keywords are tokenized as identifiers, but can not be accessed or called.
+            if (isStatementKeyword(*_stream->peek())) break;
+            return parseAccessOrCall(builder);
 
         default:
-            _errors->add(*_stream->peek(), "Expected a variable, field, array, function call, method call, or literal.");
-            return nullptr;
+            break;
     }
+
+    _errors->add(*_stream->peek(), "Expected a variable, field, array, function call, method call, or literal.");
+    return nullptr;
 }
 
-Expression *Parser::parseAccessOrCall() {
+/* Decodes the escape sequences of a character or string literal token. Character literals
+ * store their code point in the value. String literals are interned in the module's
+ * string pool and store the index of the pooled string in the value. */
+bool Parser::decodeCharacterOrString(Token &token, LiteralValue &value) {
+    // Skip the quotes
+    const uint8_t *data = _source->data + token.start + 1;
+    uint32_t length = token.length() - 2;
+
+    _decodedBytes.clear();
+    int32_t invalidEscape = literals::decodeEscapes(data, length, _decodedBytes);
+    if (invalidEscape >= 0) {
+        uint32_t escapeStart = token.start + 1 + (uint32_t) invalidEscape;
+        uint32_t escapeEnd = escapeStart + 2 < token.end ? escapeStart + 2 : token.end;
+        _errors->add(Span(*_source, escapeStart, token.startLine, escapeEnd, token.endLine), "Unknown escape sequence.");
+        return false;
+    }
+
+    if (token.type == StringLiteral) {
+        value.stringIndex = _stringPool.intern(_decodedBytes.buffer(), (uint32_t) _decodedBytes.size());
+    } else {
+        uint32_t numBytes = literals::decodeUtf8(_decodedBytes.buffer(), (uint32_t) _decodedBytes.size(), &value.characterValue);
+        if (numBytes == 0 || numBytes != _decodedBytes.size()) {
+            _errors->add(token, "Character literal must contain exactly one character.");
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename Builder>
+typename Builder::Node Parser::parseAccessOrCall(Builder &builder) {
     Token *name = _stream->expect(Identifier);
     if (!name) return nullptr;
 
-    Expression *result = _bumpMem->allocObject<VariableAccess>(*name);
+    typename Builder::Node result = builder.variableAccess(*name);
 
     // If the next token is "(", we have a function call.
     if (_stream->match(QAK_STR("("), true)) {
-        ArrayPoolMonitor<Expression *> expressionArrays(_expressionArrayPool);
-        Array<Expression *> *arguments = parseArguments(expressionArrays.obtain(QAK_SRC_LOC));
-        if (!arguments) return nullptr;
+        typename Builder::List arguments(builder);
+        if (!parseArguments(builder, arguments)) return nullptr;
 
         Token *closingParan = _stream->expect(QAK_STR(")"));
         if (!closingParan) return nullptr;
 
-        result = _bumpMem->allocObject<FunctionCall>(*_bumpMem, *name, *closingParan, result, *arguments);
+        result = builder.functionCall(*name, *closingParan, result, arguments);
     }
     return result;
 }
 
-
-Array<ast::Expression *> *Parser::parseArguments(Array<Expression *> *arguments) {
+template<typename Builder>
+bool Parser::parseArguments(Builder &builder, typename Builder::List &arguments) {
     while (_stream->hasMore() && !_stream->match(QAK_STR(")"), false)) {
-        Expression *argument = parseExpression();
-        if (!argument) return nullptr;
-        arguments->add(argument);
+        typename Builder::Node argument = parseExpression(builder);
+        if (!argument) return false;
+        arguments.add(argument);
 
         if (!_stream->match(QAK_STR(")"), false)) {
             if (!_stream->hasMore()) {
                 Token token = _stream->getTokens()[_stream->getTokens().size() - 1];
                 _errors->add(token, "Expected ) or , but reached end of file.");
-                return nullptr;
+                return false;
             }
-            if (!_stream->expect(QAK_STR(","))) return nullptr;
+            if (!_stream->expect(QAK_STR(","))) return false;
         }
     }
 
-    return arguments;
+    return true;
 }
 
 Array<Token> &Parser::tokens() {
     return _tokens;
 }
 
+Array<LiteralValue> &Parser::literalValues() {
+    return _literalValues;
+}
+
 static void printIndent(int indent) {
     printf("%*s", indent, "");
 }
 
-static void printAstNodeRecursive(ast::AstNode *node, int indent, HeapAllocator &mem) {
-    switch (node->astType) {
-        case AstTypeSpecifier: {
-            TypeSpecifier *n = (TypeSpecifier *) (node);
-            printIndent(indent);
-            printf("type: %s\n", n->name.toCString(mem));
-            break;
-        }
-        case AstParameter: {
-            Parameter *n = (Parameter *) (node);
-            printIndent(indent);
-            printf("Parameter: %s\n", n->name.toCString(mem));
-            printAstNodeRecursive(n->typeSpecifier, indent + QAK_AST_INDENT, mem);
-            break;
+/* An item on the work stack of parser::printAstNode(). Either a node or a
+ * label, printed at the given indentation. */
+struct PrintItem {
+    AstNode *node;
+    const char *label;
+    int indent;
+
+    PrintItem(AstNode *node, const char *label, int indent) : node(node), label(label), indent(indent) {}
+};
+
+/* Collects the items to be printed after a node, in the order they should be printed. */
+struct PrintItems {
+    Array<PrintItem> &items;
+
+    PrintItems(Array<PrintItem> &items) : items(items) {}
+
+    void label(const char *label, int indent) {
+        items.add(PrintItem(nullptr, label, indent));
+    }
+
+    void node(AstNode *node, int indent) {
+        items.add(PrintItem(node, nullptr, indent));
+    }
+
+    template<typename T>
+    void nodes(FixedArray<T *> &nodes, int indent) {
+        for (size_t i = 0; i < nodes.size(); i++) {
+            node(nodes[i], indent);
         }
-        case AstFunction: {
-            Function *n = (Function *) (node);
-            printIndent(indent);
-            printf("Function: %s\n", n->name.toCString(mem));
-            if (n->parameters.size() > 0) {
-                printIndent(indent + QAK_AST_INDENT);
-                printf("Parameters:\n");
-                for (size_t i = 0; i < n->parameters.size(); i++)
-                    printAstNodeRecursive(n->parameters[i], indent + QAK_AST_INDENT * 2, mem);
-            }
-            if (n->returnType) {
-                printIndent(indent + QAK_AST_INDENT);
-                printf("Return type:\n");
-                printAstNodeRecursive(n->returnType, indent + QAK_AST_INDENT * 2, mem);
-            }
+    }
+};
 
-            if (n->statements.size() > 0) {
-                printIndent(indent + QAK_AST_INDENT);
-                printf("Statements:\n");
-                for (size_t i = 0; i < n->statements.size(); i++) {
-                    printAstNodeRecursive(n->statements[i], indent + QAK_AST_INDENT * 2, mem);
-                }
-            }
-            break;
+/* Prints the line describing a node and adds the items for its children. */
+struct PrintVisitor : public Visitor<PrintVisitor> {
+    ModuleTokens &tokens;
+    HeapAllocator &mem;
+    PrintItems &children;
+    int indent;
+
+    PrintVisitor(ModuleTokens &tokens, HeapAllocator &mem, PrintItems &children) : tokens(tokens), mem(mem), children(children), indent(0) {}
+
+    void visitTypeSpecifier(TypeSpecifier *n) {
+        printIndent(indent);
+        printf("type: %s\n", tokens[n->firstToken].toCString(mem));
+    }
+
+    void visitParameter(Parameter *n) {
+        printIndent(indent);
+        printf("Parameter: %s\n", tokens[n->firstToken].toCString(mem));
+        children.node(n->typeSpecifier, indent + QAK_AST_INDENT);
+    }
+
+    void visitFunction(Function *n) {
+        printIndent(indent);
+        printf("Function: %s\n", tokens[n->name].toCString(mem));
+        if (n->parameters.size() > 0) {
+            children.label("Parameters:\n", indent + QAK_AST_INDENT);
+            children.nodes(n->parameters, indent + QAK_AST_INDENT * 2);
         }
-        case AstVariable: {
-            Variable *n = (Variable *) (node);
-            printIndent(indent);
-            printf("Variable: %s\n", n->name.toCString(mem));
-            if (n->typeSpecifier) printAstNodeRecursive(n->typeSpecifier, indent + QAK_AST_INDENT, mem);
-            if (n->initializerExpression) {
-                printIndent(indent + QAK_AST_INDENT);
-                printf("Initializer: \n");
-                printAstNodeRecursive(n->initializerExpression, indent + QAK_AST_INDENT * 2, mem);
-            }
-            break;
+        if (n->returnType) {
+            children.label("Return type:\n", indent + QAK_AST_INDENT);
+            children.node(n->returnType, indent + QAK_AST_INDENT * 2);
         }
-        case AstWhile: {
-            While *n = (While *) (node);
-            printIndent(indent);
-            printf("While\n");
-
-            printIndent(indent + QAK_AST_INDENT);
-            printf("Condition: \n");
-            printAstNodeRecursive(n->condition, indent + QAK_AST_INDENT * 2, mem);
-
-            if (n->statements.size() > 0) {
-                printIndent(indent + QAK_AST_INDENT);
-                printf("Statements: \n");
-                for (size_t i = 0; i < n->statements.size(); i++) {
-                    printAstNodeRecursive(n->statements[i], indent + QAK_AST_INDENT * 2, mem);
-                }
-            }
-            break;
+        if (n->statements.size() > 0) {
+            children.label("Statements:\n", indent + QAK_AST_INDENT);
+            children.nodes(n->statements, indent + QAK_AST_INDENT * 2);
         }
-        case AstIf: {
-            If *n = (If *) (node);
-            printIndent(indent);
-            printf("If\n");
-
-            printIndent(indent + QAK_AST_INDENT);
-            printf("Condition: \n");
-            printAstNodeRecursive(n->condition, indent + QAK_AST_INDENT * 2, mem);
-
-            if (n->trueBlock.size() > 0) {
-                printIndent(indent + QAK_AST_INDENT);
-                printf("True-block statements: \n");
-                for (size_t i = 0; i < n->trueBlock.size(); i++) {
-                    printAstNodeRecursive(n->trueBlock[i], indent + QAK_AST_INDENT * 2, mem);
-                }
-            }
+    }
 
-            if (n->falseBlock.size() > 0) {
-                printIndent(indent + QAK_AST_INDENT);
-                printf("False-block statements: \n");
-                for (size_t i = 0; i < n->falseBlock.size(); i++) {
-                    printAstNodeRecursive(n->falseBlock[i], indent + QAK_AST_INDENT * 2, mem);
-                }
-            }
-            break;
+    void visitVariable(Variable *n) {
+        printIndent(indent);
+        printf("Variable: %s\n", tokens[n->name].toCString(mem));
+        if (n->typeSpecifier) children.node(n->typeSpecifier, indent + QAK_AST_INDENT);
+        if (n->initializerExpression) {
+            children.label("Initializer: \n", indent + QAK_AST_INDENT);
+            children.node(n->initializerExpression, indent + QAK_AST_INDENT * 2);
         }
-        case AstReturn: {
-            Return *n = (Return *) node;
-            printIndent(indent);
-            printf("Return:\n");
+    }
 
-            if (n->returnValue) {
-                printIndent(indent + QAK_AST_INDENT);
-                printf("Value:\n");
-                printAstNodeRecursive(n->returnValue, indent + QAK_AST_INDENT * 2, mem);
-            }
+    void visitWhile(While *n) {
+        printIndent(indent);
+        printf("While\n");
+        children.label("Condition: \n", indent + QAK_AST_INDENT);
+        children.node(n->condition, indent + QAK_AST_INDENT * 2);
+        if (n->statements.size() > 0) {
+            children.label("Statements: \n", indent + QAK_AST_INDENT);
+            children.nodes(n->statements, indent + QAK_AST_INDENT * 2);
+        }
+    }
 
-            break;
+    void visitIf(If *n) {
+        printIndent(indent);
+        printf("If\n");
+        children.label("Condition: \n", indent + QAK_AST_INDENT);
+        children.node(n->condition, indent + QAK_AST_INDENT * 2);
+        if (n->trueBlock.size() > 0) {
+            children.label("True-block statements: \n", indent + QAK_AST_INDENT);
+            children.nodes(n->trueBlock, indent + QAK_AST_INDENT * 2);
         }
-        case AstTernaryOperation: {
-            TernaryOperation *n = (TernaryOperation *) node;
-            printIndent(indent);
-            printf("Ternary operator:\n");
-            printAstNodeRecursive(n->condition, indent + QAK_AST_INDENT, mem);
-            printAstNodeRecursive(n->trueValue, indent + QAK_AST_INDENT, mem);
-            printAstNodeRecursive(n->falseValue, indent + QAK_AST_INDENT, mem);
-            break;
+        if (n->falseBlock.size() > 0) {
+            children.label("False-block statements: \n", indent + QAK_AST_INDENT);
+            children.nodes(n->falseBlock, indent + QAK_AST_INDENT * 2);
         }
-        case AstBinaryOperation: {
-            BinaryOperation *n = (BinaryOperation *) node;
-            printIndent(indent);
-            printf("Binary operator: %s\n", n->op.toCString(mem));
-            printAstNodeRecursive(n->left, indent + QAK_AST_INDENT, mem);
-            printAstNodeRecursive(n->right, indent + QAK_AST_INDENT, mem);
-            break;
+    }
+
+    void visitReturn(Return *n) {
+        printIndent(indent);
+        printf("Return:\n");
+        if (n->returnValue) {
+            children.label("Value:\n", indent + QAK_AST_INDENT);
+            children.node(n->returnValue, indent + QAK_AST_INDENT * 2);
         }
-        case AstUnaryOperation: {
-            UnaryOperation *n = (UnaryOperation *) node;
-            printIndent(indent);
-            printf("Unary op: %s\n", n->op.toCString(mem));
-            printAstNodeRecursive(n->value, indent + QAK_AST_INDENT, mem);
-            break;
+    }
+
+    void visitTernaryOperation(TernaryOperation *n) {
+        printIndent(indent);
+        printf("Ternary operator:\n");
+        children.node(n->condition, indent + QAK_AST_INDENT);
+        children.node(n->trueValue, indent + QAK_AST_INDENT);
+        children.node(n->falseValue, indent + QAK_AST_INDENT);
+    }
+
+    void visitBinaryOperation(BinaryOperation *n) {
+        printIndent(indent);
+        printf("Binary operator: %s\n", tokens[n->op].toCString(mem));
+        children.node(n->left, indent + QAK_AST_INDENT);
+        children.node(n->right, indent + QAK_AST_INDENT);
+    }
+
+    void visitUnaryOperation(UnaryOperation *n) {
+        printIndent(indent);
+        printf("Unary op: %s\n", tokens[n->firstToken].toCString(mem));
+        children.node(n->value, indent + QAK_AST_INDENT);
+    }
+
+    void visitLiteral(Literal *n) {
+        printIndent(indent);
+        // Literals created by the ConstantFolder cover the tokens of the expression they replace, their value is printed instead.
+        if (n->firstToken == n->lastToken && tokens[n->firstToken].type == n->type) {
+            printf("%s: %s\n", tokenizer::tokenTypeToString(n->type), tokens[n->firstToken].toCString(mem));
+            return;
         }
-        case AstLiteral: {
-            Literal *n = (Literal *) node;
-            printIndent(indent);
-            printf("%s: %s\n", tokenizer::tokenTypeToString(n->type), n->value.toCString(mem));
-            break;
+        printf("%s: ", tokenizer::tokenTypeToString(n->type));
+        LiteralValue &value = n->decodedValue;
+        switch (n->type) {
+            case BooleanLiteral:
+                printf("%s\n", value.booleanValue ? "true" : "false");
+                break;
+            case ByteLiteral:
+                printf("%ib\n", value.byteValue);
+                break;
+            case ShortLiteral:
+                printf("%is\n", value.shortValue);
+                break;
+            case IntegerLiteral:
+                printf("%i\n", value.intValue);
+                break;
+            case LongLiteral:
+                printf("%lldl\n", (long long) value.longValue);
+                break;
+            case FloatLiteral:
+                printf("%gf\n", value.floatValue);
+                break;
+            case DoubleLiteral:
+                printf("%gd\n", value.doubleValue);
+                break;
+            default:
+                printf("%s\n", tokens[n->firstToken].toCString(mem));
+                break;
         }
-        case AstVariableAccess: {
-            VariableAccess *n = (VariableAccess *) node;
-            printIndent(indent);
-            printf("Variable access: %s\n", n->name.toCString(mem));
-            break;
+    }
+
+    void visitVariableAccess(VariableAccess *n) {
+        printIndent(indent);
+        printf("Variable access: %s\n", tokens[n->firstToken].toCString(mem));
+    }
+
+    void visitFunctionCall(FunctionCall *n) {
+        printIndent(indent);
+        printf("Function call: %s(%s)\n", tokens[n->variableAccess->firstToken].toCString(mem), n->arguments.size() > 0 ? "..." : "");
+        if (n->arguments.size() > 0) {
+            children.label("Arguments:\n", indent + QAK_AST_INDENT);
+            children.nodes(n->arguments, indent + QAK_AST_INDENT * 2);
         }
-        case AstFunctionCall: {
-            FunctionCall *n = (FunctionCall *) node;
-            printIndent(indent);
-            printf("Function call: %s(%s)\n", n->variableAccess->span.toCString(mem), n->arguments.size() > 0 ? "..." : "");
-
-            if (n->arguments.size() > 0) {
-                printIndent(indent + QAK_AST_INDENT);
-                printf("Arguments:\n");
-                for (size_t i = 0; i < n->arguments.size(); i++) {
-                    printAstNodeRecursive(n->arguments[i], indent + QAK_AST_INDENT * 2, mem);
-                }
-            }
-            break;
+    }
+
+    void visitError(ErrorNode *n) {
+        Token &first = tokens[n->firstToken], &last = tokens[n->lastToken];
+        printIndent(indent);
+        printf("Error: %.*s\n", (int) (last.end - first.start), (const char *) first.source.data + first.start);
+    }
+
+    void visitTypeDeclaration(TypeDeclaration *n) {
+        printIndent(indent);
+        printf("Type: %s%s%s%s\n", tokens[n->name].toCString(mem), n->isPacked ? " packed" : "", n->isCCompatible ? " c" : "",
+               n->isStructureOfArrays ? " soa" : "");
+        children.nodes(n->fields, indent + QAK_AST_INDENT);
+    }
+
+    void visitField(Field *n) {
+        printIndent(indent);
+        printf("Field: %s\n", tokens[n->firstToken].toCString(mem));
+        children.node(n->typeSpecifier, indent + QAK_AST_INDENT);
+    }
+
+    void visitModule(Module *n) {
+        printIndent(indent);
+        printf("Module: %s\n", tokens[n->name].toCString(mem));
+        if (n->statements.size() > 0) {
+            children.label("Module statements:\n", indent + QAK_AST_INDENT);
+            children.nodes(n->statements, indent + QAK_AST_INDENT * 2);
         }
-        case AstModule: {
-            Module *n = (Module *) node;
-            printIndent(indent);
-            printf("Module: %s\n", n->name.toCString(mem));
-
-            if (n->statements.size() > 0) {
-                printIndent(indent + QAK_AST_INDENT);
-                printf("Module statements:\n");
-                for (size_t i = 0; i < n->statements.size(); i++) {
-                    printAstNodeRecursive(n->statements[i], indent + QAK_AST_INDENT * 2, mem);
-                }
-            }
+        children.nodes(n->functions, indent + QAK_AST_INDENT);
+        children.nodes(n->types, indent + QAK_AST_INDENT);
+    }
+};
 
-            for (size_t i = 0; i < n->functions.size(); i++) {
-                printAstNodeRecursive(n->functions[i], indent + QAK_AST_INDENT, mem);
-            }
-            break;
+/* Prints the tree in pre-order using an explicit stack instead of recursion,
+ * so deeply nested trees can not overflow the native stack. */
+void parser::printAstNode(ast::AstNode *node, ModuleTokens &tokens, HeapAllocator &mem) {
+    Array<PrintItem> stack(mem);
+    Array<PrintItem> childItems(mem);
+    PrintItems children(childItems);
+    PrintVisitor printer(tokens, mem, children);
+
+    stack.add(PrintItem(node, nullptr, 0));
+    while (stack.size() > 0) {
+        PrintItem item = stack[stack.size() - 1];
+        stack.removeAt(stack.size() - 1);
+
+        if (item.label) {
+            printIndent(item.indent);
+            printf("%s", item.label);
+            continue;
+        }
+
+        childItems.clear();
+        printer.indent = item.indent;
+        printer.visit(item.node);
+        for (size_t i = childItems.size(); i > 0; i--) {
+            stack.add(childItems[i - 1]);
         }
     }
 }
 
-void parser::printAstNode(ast::AstNode *node, HeapAllocator &mem) {
-    printAstNodeRecursive(node, 0, mem);
-}
\ No newline at end of file
+void parser::printAstNode(ast::Module *module, HeapAllocator &mem) {
+    printAstNode(module, module->tokens, mem);
+}
@@ -2,11 +2,28 @@
 #define QAK_PARSER_H
 
 #include "tokenizer.h"
+#include "qak.h"
 
 namespace qak {
+    class NativeFunctions;
+
     namespace ast {
 #define QAK_AST_INDENT 3
 
+/* Default maximum nesting depth of statements and expressions, see Parser::setMaxNestingDepth(). */
+#define QAK_MAX_NESTING_DEPTH 256
+
+/* Default maximum number of errors after which the parser stops, see Parser::setMaxErrors(). */
+#define QAK_MAX_ERRORS 100
+
+/* Parser::reparse() parses the source from scratch once the bump allocator of the previous module
+ * holds this many times the bytes the module took when it was last parsed from scratch. */
+#define QAK_MAX_REPARSE_GROWTH 4
+
+/* The tokens of a module are looked up by their slot, a block of 1 << QAK_TOKEN_SLOT_BITS token
+ * indices, see ModuleTokens. */
+#define QAK_TOKEN_SLOT_BITS 8
+
         enum AstType {
             AstTypeSpecifier,
             AstParameter,
@@ -21,81 +38,129 @@ namespace qak {
             AstWhile,
             AstIf,
             AstReturn,
-            AstModule
+            AstModule,
+            AstError,
+            AstTypeDeclaration,
+            AstField
         };
 
+        /* Nodes reference their tokens by index into Module::tokens instead of storing
+         * spans. A node covers all tokens from firstToken to lastToken, inclusive. Use
+         * Module::span() and Module::token() to get the source text of a node. Indices
+         * only increase within a top-level item, see ModuleTokens. */
         struct AstNode {
             AstType astType;
-            Span span;
+            uint32_t firstToken;
+            uint32_t lastToken;
 
-            AstNode(AstType astType, Span &start, Span &end) :
+            AstNode(AstType astType, uint32_t firstToken, uint32_t lastToken) :
                     astType(astType),
-                    span(start.source, start.start, start.startLine, end.end, end.endLine) {}
+                    firstToken(firstToken),
+                    lastToken(lastToken) {}
+        };
 
-            AstNode(AstType astType, Span &span) : astType(astType), span(span) {}
+        enum SymbolType {
+            SymbolModuleVariable,
+            SymbolLocalVariable,
+            SymbolParameter,
+            SymbolFunction,
+            SymbolNative
         };
 
-        struct TypeSpecifier : public AstNode {
-            Span name;
+        /* A declared variable, parameter or function, stored in Module::symbols by
+         * Resolver::resolve(). Nodes reference symbols by their index in that array, or
+         * store -1 if they were not resolved. Variables and parameters are stored in a slot
+         * of a frame: module variables in the module's frame, see Module::numSlots, local
+         * variables and parameters in the frame of their function, see Function::numSlots.
+         * The slot of a function is its index in Module::functions. Natives have no declaration,
+         * their slot is their index in Module::natives. */
+        struct Symbol {
+            SymbolType type;
+            AstNode *declaration;
+            uint32_t slot;
+
+            Symbol(SymbolType type, AstNode *declaration, uint32_t slot) : type(type), declaration(declaration), slot(slot) {}
+        };
 
-            TypeSpecifier(Span name) :
-                    AstNode(AstTypeSpecifier, name),
-                    name(name) {}
+        /* The name of the type is the first token. */
+        struct TypeSpecifier : public AstNode {
+            TypeSpecifier(uint32_t name) : AstNode(AstTypeSpecifier, name, name) {}
         };
 
         struct Statement : public AstNode {
-            Statement(AstType astType, Span start, Span end) : AstNode(astType, start, end) {}
+            Statement(AstType astType, uint32_t firstToken, uint32_t lastToken) : AstNode(astType, firstToken, lastToken) {}
         };
 
+        /* The name of the parameter is the first token. */
         struct Parameter : public AstNode {
-            Span name;
             TypeSpecifier *typeSpecifier;
+            int32_t symbol;
 
-            Parameter(Span name, TypeSpecifier *typeSpecifier) :
-                    AstNode(AstParameter, name, typeSpecifier->span),
-                    name(name),
-                    typeSpecifier(typeSpecifier) {}
+            Parameter(uint32_t name, TypeSpecifier *typeSpecifier) :
+                    AstNode(AstParameter, name, typeSpecifier->lastToken),
+                    typeSpecifier(typeSpecifier),
+                    symbol(-1) {}
         };
 
         struct Function : public AstNode {
-            Span name;
+            uint32_t name;
             FixedArray<Parameter *> parameters;
             TypeSpecifier *returnType;
             FixedArray<Statement *> statements;
 
-            Function(BumpAllocator &bumpMem, Span name, Array<Parameter *> &parameters, TypeSpecifier *returnType,
-                     Array<Statement *> &statements) :
-                    AstNode(AstFunction, name, name),
+            /* The body spans from this token to the "end" of the function. If the body was
+             * skipped by a parse with lazy function bodies, isBodyParsed is false and the
+             * statements are empty until Parser::parseFunctionBody() is called. */
+            uint32_t bodyFirstToken;
+            bool isBodyParsed;
+
+            /* Set by Resolver::resolve(). The number of slots of the function's frame covers the
+             * parameters and the local variables that are in scope at the same time. */
+            int32_t symbol;
+            uint32_t numSlots;
+
+            Function(BumpAllocator &bumpMem, uint32_t firstToken, uint32_t lastToken, uint32_t name, TypeSpecifier *returnType,
+                     uint32_t bodyFirstToken, bool isBodyParsed) :
+                    AstNode(AstFunction, firstToken, lastToken),
                     name(name),
-                    parameters(bumpMem, parameters),
+                    parameters(bumpMem),
                     returnType(returnType),
-                    statements(bumpMem, statements) {}
+                    statements(bumpMem),
+                    bodyFirstToken(bodyFirstToken),
+                    isBodyParsed(isBodyParsed),
+                    symbol(-1),
+                    numSlots(0) {}
         };
 
         struct Expression : public Statement {
-            Expression(AstType astType, Span start, Span end) : Statement(astType, start, end) {}
+            /* The index of the expression in Module::expressionTypes, set by TypeChecker::check(). */
+            uint32_t id;
+
+            Expression(AstType astType, uint32_t firstToken, uint32_t lastToken) : Statement(astType, firstToken, lastToken), id(0) {}
         };
 
         struct Variable : public Statement {
-            Span name;
+            uint32_t name;
             TypeSpecifier *typeSpecifier;
             Expression *initializerExpression;
+            int32_t symbol;
 
-            Variable(Span name, TypeSpecifier *type, Expression *expression) :
-                    Statement(AstVariable, name, name),
+            Variable(uint32_t firstToken, uint32_t lastToken, uint32_t name, TypeSpecifier *type, Expression *expression) :
+                    Statement(AstVariable, firstToken, lastToken),
                     name(name),
                     typeSpecifier(type),
-                    initializerExpression(expression) {}
+                    initializerExpression(expression),
+                    symbol(-1) {}
         };
 
         struct While : public Statement {
             Expression *condition;
             FixedArray<Statement *> statements;
 
-            While(BumpAllocator &bumpMem, Span start, Span end, Expression *condition, Array<Statement *> &statements) :
-                    Statement(AstWhile, start, end),
+            While(BumpAllocator &bumpMem, uint32_t firstToken, uint32_t lastToken, Expression *condition) :
+                    Statement(AstWhile, firstToken, lastToken),
                     condition(condition),
-                    statements(bumpMem, statements) {}
+                    statements(bumpMem) {}
         };
 
         struct If : public Statement {
@@ -103,19 +168,18 @@ namespace qak {
             FixedArray<Statement *> trueBlock;
             FixedArray<Statement *> falseBlock;
 
-            If(BumpAllocator &bumpMem, Span start, Span end, Expression *condition, Array<Statement *> &trueBlock,
-               Array<Statement *> &falseBlock) :
-                    Statement(AstIf, start, end),
+            If(BumpAllocator &bumpMem, uint32_t firstToken, uint32_t lastToken, Expression *condition) :
+                    Statement(AstIf, firstToken, lastToken),
                     condition(condition),
-                    trueBlock(bumpMem, trueBlock),
-                    falseBlock(bumpMem, falseBlock) {}
+                    trueBlock(bumpMem),
+                    falseBlock(bumpMem) {}
         };
 
         struct Return : public Statement {
             Expression *returnValue;
 
-            Return(Span start, Span end, Expression *returnValue) :
-                    Statement(AstReturn, start, end),
+            Return(uint32_t firstToken, uint32_t lastToken, Expression *returnValue) :
+                    Statement(AstReturn, firstToken, lastToken),
                     returnValue(returnValue) {}
         };
 
@@ -125,147 +189,730 @@ namespace qak {
             Expression *falseValue;
 
             TernaryOperation(Expression *condition, Expression *trueValue, Expression *falseValue) :
-                    Expression(AstTernaryOperation, condition->span, falseValue->span),
+                    Expression(AstTernaryOperation, condition->firstToken, falseValue->lastToken),
                     condition(condition),
                     trueValue(trueValue),
                     falseValue(falseValue) {}
         };
 
         struct BinaryOperation : public Expression {
-            Span op;
+            uint32_t op;
             Expression *left;
             Expression *right;
 
-            BinaryOperation(Span op, Expression *left, Expression *right) :
-                    Expression(AstBinaryOperation, left->span, right->span),
+            BinaryOperation(uint32_t op, Expression *left, Expression *right) :
+                    Expression(AstBinaryOperation, left->firstToken, right->lastToken),
                     op(op), left(left),
                     right(right) {}
         };
 
+        /* The operator is the first token. */
         struct UnaryOperation : public Expression {
-            Span op;
             Expression *value;
 
-            UnaryOperation(Span op, Expression *value) :
-                    Expression(AstUnaryOperation, op, op),
-                    op(op), value(value) {}
+            UnaryOperation(uint32_t op, Expression *value) :
+                    Expression(AstUnaryOperation, op, value->lastToken),
+                    value(value) {}
         };
 
+        /* The literal is the first token. */
         struct Literal : public Expression {
             TokenType type;
-            Span value;
 
-            Literal(TokenType type, Span value) :
+            /* The decoded value of the literal. Boolean and numeric literals are decoded
+             * by tokenizer::tokenize(). Escape sequences in character and string literals are
+             * decoded by the parser. String literals store the index of the decoded string in
+             * Module::strings. */
+            LiteralValue decodedValue;
+
+            Literal(TokenType type, uint32_t value, LiteralValue decodedValue) :
                     Expression(AstLiteral, value, value),
                     type(type),
-                    value(value) {}
+                    decodedValue(decodedValue) {}
         };
 
+        /* Stands in for a statement or expression that could not be parsed. Covers the
+         * tokens skipped by the parser to recover from the error. */
+        struct ErrorNode : public Expression {
+            ErrorNode(uint32_t firstToken, uint32_t lastToken) : Expression(AstError, firstToken, lastToken) {}
+        };
+
+        /* The name of the variable is the first token. */
         struct VariableAccess : public Expression {
-            Span name;
+            /* The symbol the name refers to, see Resolver::resolve(). */
+            int32_t symbol;
 
-            VariableAccess(Span name) :
-                    Expression(AstVariableAccess, name, name),
-                    name(name) {}
+            VariableAccess(uint32_t name) : Expression(AstVariableAccess, name, name), symbol(-1) {}
         };
 
         struct FunctionCall : public Expression {
             Expression *variableAccess;
             FixedArray<Expression *> arguments;
 
-            FunctionCall(BumpAllocator &mem, Span start, Span end, Expression *variableAccess, Array<Expression *> &arguments) :
-                    Expression(AstFunctionCall, start, end),
+            FunctionCall(BumpAllocator &mem, uint32_t firstToken, uint32_t lastToken, Expression *variableAccess) :
+                    Expression(AstFunctionCall, firstToken, lastToken),
                     variableAccess(variableAccess),
-                    arguments(mem, arguments) {}
+                    arguments(mem) {}
+        };
+
+        /* The name of the field is the first token. */
+        struct Field : public AstNode {
+            TypeSpecifier *typeSpecifier;
+
+            /* Set by LayoutEngine::layout(). Fields of a primitive type store its TypeId and a valueType
+             * of -1, fields of a value type store TypeError and the index of their type in Module::types.
+             * The offset is relative to the start of a value of the declaring type. */
+            uint32_t type;
+            int32_t valueType;
+            uint32_t offset;
+            uint32_t size;
+            uint32_t alignment;
+
+            Field(uint32_t name, TypeSpecifier *typeSpecifier) :
+                    AstNode(AstField, name, typeSpecifier->lastToken),
+                    typeSpecifier(typeSpecifier),
+                    type(0),
+                    valueType(-1),
+                    offset(0),
+                    size(0),
+                    alignment(1) {}
+        };
+
+        /* A value type, declared with "type Name [packed] [c] [soa]" followed by its fields and "end".
+         * The fields of packed and C-compatible ("c") types are stored in the order of their declaration,
+         * the fields of other types are reordered to minimize padding. Arrays of "soa" types store each
+         * field in an array of its own. See LayoutEngine. */
+        struct TypeDeclaration : public AstNode {
+            uint32_t name;
+            FixedArray<Field *> fields;
+            bool isPacked;
+            bool isCCompatible;
+            bool isStructureOfArrays;
+
+            /* Set by LayoutEngine::layout(). The size is a multiple of the alignment. */
+            uint32_t size;
+            uint32_t alignment;
+
+            TypeDeclaration(BumpAllocator &bumpMem, uint32_t firstToken, uint32_t lastToken, uint32_t name, bool isPacked, bool isCCompatible,
+                            bool isStructureOfArrays) :
+                    AstNode(AstTypeDeclaration, firstToken, lastToken),
+                    name(name),
+                    fields(bumpMem),
+                    isPacked(isPacked),
+                    isCCompatible(isCCompatible),
+                    isStructureOfArrays(isStructureOfArrays),
+                    size(0),
+                    alignment(1) {}
+        };
+
+        /* Tokens of a module that were tokenized together, and the decoded values of their literals,
+         * see Token::literalIndex. */
+        struct TokenChunk {
+            /* The index of the first token, the first index of a slot, see ModuleTokens. */
+            uint32_t firstIndex;
+            uint32_t size;
+            Token *tokens;
+            LiteralValue *literalValues;
+            uint32_t numLiteralValues;
+
+            /* The start offset and line of each token. The tokens before the split store them
+             * relative to the start of the source, the others relative to its end. */
+            uint32_t *starts;
+            uint32_t *startLines;
+            uint32_t split;
+
+            /* The ModuleTokens::version the spans of the tokens were last set for. */
+            uint32_t version;
+        };
+
+        /* The first and last token a top-level item was parsed from. These include tokens its node
+         * does not cover, like the parentheses around an expression statement. */
+        struct ItemTokens {
+            uint32_t firstToken;
+            uint32_t lastToken;
+
+            ItemTokens(uint32_t firstToken, uint32_t lastToken) : firstToken(firstToken), lastToken(lastToken) {}
+        };
+
+        /* The tokens of a module by index. A module parsed from scratch stores its tokens in a single
+         * chunk. Parser::reparse() adds a chunk for each range of top-level items it parses again, and
+         * keeps the chunks of the items it reuses, so their nodes keep their token indices. Each slot
+         * of token indices belongs to a single chunk, so a token is found in constant time.
+         *
+         * Like the text of a gap buffer, the tokens of items before the gap store their offsets and lines
+         * relative to the start of the source, the tokens of the other items relative to its end. An edit
+         * at the gap changes neither. Moving the gap to the next edit converts the tokens of the items it
+         * passes. The spans of a chunk's tokens are set for the current source once one of them is read. */
+        class ModuleTokens {
+        private:
+            BumpAllocator &_mem;
+            Source *_source;
+            TokenChunk **_slots;
+            uint32_t _numSlots;
+            uint32_t _slotCapacity;
+            uint32_t _size;
+
+            /* The offset and line the tokens after the gap are stored relative to. Moved along with
+             * the end of the source by each edit, lines wrap around. */
+            uint32_t _end;
+            uint32_t _endLine;
+
+            /* The index of the first item after the gap, see Module::items. */
+            uint32_t _gap;
+
+            /* Incremented by each reparse, see TokenChunk::version. */
+            uint32_t _version;
+
+            ModuleTokens(const ModuleTokens &other) = delete;
+
+            void setSpans(TokenChunk *chunk);
+
+            void addSlots(TokenChunk *chunk);
+
+        public:
+            ModuleTokens(BumpAllocator &mem) : _mem(mem), _source(nullptr), _slots(nullptr), _numSlots(0), _slotCapacity(0), _size(0),
+                                               _end(0), _endLine(0), _gap(0), _version(0) {}
+
+            /* Returns the token at the index, setting the spans of its chunk's tokens first if needed. */
+            QAK_FORCE_INLINE Token &operator[](size_t index) {
+                TokenChunk *chunk = _slots[index >> QAK_TOKEN_SLOT_BITS];
+                if (chunk->version != _version) setSpans(chunk);
+                return chunk->tokens[index - chunk->firstIndex];
+            }
+
+            /* Returns the number of tokens of the module. */
+            QAK_FORCE_INLINE size_t size() const {
+                return _size;
+            }
+
+            /* Returns the chunk of the token at the index. Its tokens' spans may be out of date. */
+            QAK_FORCE_INLINE TokenChunk *chunk(uint32_t index) {
+                return _slots[index >> QAK_TOKEN_SLOT_BITS];
+            }
+
+            /* Returns the start offset of the token at the index, without setting the spans of its chunk. */
+            QAK_FORCE_INLINE uint32_t start(uint32_t index) {
+                TokenChunk *chunk = this->chunk(index);
+                uint32_t i = index - chunk->firstIndex;
+                return i < chunk->split ? chunk->starts[i] : _end - chunk->starts[i];
+            }
+
+            /* Returns the start line of the token at the index, see start(). */
+            QAK_FORCE_INLINE uint32_t startLine(uint32_t index) {
+                TokenChunk *chunk = this->chunk(index);
+                uint32_t i = index - chunk->firstIndex;
+                return i < chunk->split ? chunk->startLines[i] : _endLine - chunk->startLines[i];
+            }
+
+            /* Returns the end offset of the token at the index, see start(). */
+            QAK_FORCE_INLINE uint32_t end(uint32_t index) {
+                TokenChunk *chunk = this->chunk(index);
+                Token &token = chunk->tokens[index - chunk->firstIndex];
+                return start(index) + (token.end - token.start);
+            }
+
+            /* Returns the end line of the token at the index, see start(). */
+            QAK_FORCE_INLINE uint32_t endLine(uint32_t index) {
+                TokenChunk *chunk = this->chunk(index);
+                Token &token = chunk->tokens[index - chunk->firstIndex];
+                return startLine(index) + (token.endLine - token.startLine);
+            }
+
+            /* Returns the index of the first token of the next chunk added by add(). */
+            QAK_FORCE_INLINE uint32_t nextIndex() const {
+                return _numSlots << QAK_TOKEN_SLOT_BITS;
+            }
+
+            /* Returns whether the token indices are used up, in which case the module has to be
+             * parsed from scratch instead of reparsed. */
+            QAK_FORCE_INLINE bool isFull() const {
+                return _numSlots >= (1u << (31 - QAK_TOKEN_SLOT_BITS));
+            }
+
+            QAK_FORCE_INLINE uint32_t gap() const {
+                return _gap;
+            }
+
+            /* Sets the tokens of a module parsed from scratch. */
+            void set(Source &source, Array<Token> &tokens, Array<LiteralValue> &literalValues);
+
+            /* Sets the tokens to the chunks of the previous module, moved by the change in bytes and
+             * lines of an edit at its gap. The previous module keeps its tokens, as long as no chunks
+             * are added to either. */
+            void edit(ModuleTokens &previous, Source &source, int32_t byteDelta, int32_t lineDelta);
+
+            /* Adds a chunk of tokens starting at nextIndex(), storing their offsets relative to the
+             * start of the source if they are before the gap, or relative to its end otherwise. */
+            void add(Array<Token> &tokens, Array<LiteralValue> &literalValues, bool isAfterGap);
+
+            /* Moves the gap after the tokens from first to last, which belong to one chunk. */
+            void moveBeforeGap(uint32_t first, uint32_t last);
+
+            /* Moves the gap before the tokens from first to last, which belong to one chunk. */
+            void moveAfterGap(uint32_t first, uint32_t last);
+
+            void setGap(uint32_t gap) {
+                _gap = gap;
+            }
+
+            void setSize(size_t size) {
+                _size = (uint32_t) size;
+            }
         };
 
         struct Module : public AstNode {
             BumpAllocator &mem;
-            Span name;
+            uint32_t name;
             FixedArray<Variable *> variables;
             FixedArray<Function *> functions;
             FixedArray<Statement *> statements;
 
-            Module(BumpAllocator &mem, Span name) :
-                    AstNode(AstModule, name),
+            /* The value types declared by the module, in source order. */
+            FixedArray<TypeDeclaration *> types;
+
+            /* The functions, types and statements of the module in source order, the tokens each
+             * was parsed from, and whether Parser::reparse() can reuse each of them. Items whose
+             * parse reported errors are parsed again, so their errors are reported again. */
+            FixedArray<AstNode *> items;
+            FixedArray<ItemTokens> itemTokens;
+            FixedArray<bool> isReusable;
+
+            /* The number of functions whose bodies were skipped and not parsed yet, see
+             * Parser::parseFunctionBody(). Parser::reparse() parses them again. */
+            size_t numUnparsedBodies;
+
+            /* The number of bytes parsing the module from scratch allocated, see Parser::reparse(). */
+            size_t numParsedBytes;
+
+            /* The tokens of the module and the decoded values of their literals, see AstNode. */
+            ModuleTokens tokens;
+
+            /* The decoded string literals of the module, each stored once. See
+             * LiteralValue::stringIndex. */
+            FixedArray<InternedString> strings;
+
+            /* The symbols of the module and the number of slots of its frame, set by Resolver::resolve().
+             * Module variables take the first slots, followed by the variables declared in blocks of the
+             * module's statements. */
+            FixedArray<Symbol> symbols;
+            uint32_t numSlots;
+
+            /* The native functions the module was resolved with, or nullptr. */
+            NativeFunctions *natives;
+
+            /* The types of the expressions by Expression::id and of the symbols by their index in
+             * symbols, set by TypeChecker::check(). Types are indices into the TypeTable passed to
+             * the type checker. */
+            FixedArray<uint32_t> expressionTypes;
+            FixedArray<uint32_t> symbolTypes;
+
+            Module(BumpAllocator &mem, uint32_t firstToken, uint32_t lastToken, uint32_t name) :
+                    AstNode(AstModule, firstToken, lastToken),
                     mem(mem),
                     name(name),
                     variables(mem),
                     functions(mem),
-                    statements(mem) {
+                    statements(mem),
+                    types(mem),
+                    items(mem),
+                    itemTokens(mem),
+                    isReusable(mem),
+                    numUnparsedBodies(0),
+                    numParsedBytes(0),
+                    tokens(mem),
+                    strings(mem),
+                    symbols(mem),
+                    numSlots(0),
+                    natives(nullptr),
+                    expressionTypes(mem),
+                    symbolTypes(mem) {
+            }
+
+            QAK_FORCE_INLINE Token &token(uint32_t index) {
+                return tokens[index];
+            }
+
+            /* Returns the span from the start of the node's first token to the end of its last token. */
+            QAK_FORCE_INLINE Span span(AstNode *node) {
+                Token &first = tokens[node->firstToken];
+                Token &last = tokens[node->lastToken];
+                return Span(first.source, first.start, first.startLine, last.end, last.endLine);
+            }
+        };
+
+        /* Calls the function for each span of the flat node. */
+        template<typename F>
+        void forEachSpan(qak_ast_node &node, F function) {
+            function(node.span);
+            switch (node.type) {
+                case QakAstTypeSpecifier:
+                    function(node.data.typeSpecifier.name);
+                    break;
+                case QakAstParameter:
+                    function(node.data.parameter.name);
+                    break;
+                case QakAstFunction:
+                    function(node.data.function.name);
+                    break;
+                case QakAstVariable:
+                    function(node.data.variable.name);
+                    break;
+                case QakAstBinaryOperation:
+                    function(node.data.binaryOperation.op);
+                    break;
+                case QakAstUnaryOperation:
+                    function(node.data.unaryOperation.op);
+                    break;
+                case QakAstLiteral:
+                    function(node.data.literal.value);
+                    break;
+                case QakAstVariableAccess:
+                    function(node.data.variableAccess.name);
+                    break;
+                case QakAstModule:
+                    function(node.data.module.name);
+                    break;
+                case QakAstTypeDeclaration:
+                    function(node.data.typeDeclaration.name);
+                    break;
+                case QakAstField:
+                    function(node.data.field.name);
+                    break;
+                case QakAstTernaryOperation:
+                case QakAstFunctionCall:
+                case QakAstWhile:
+                case QakAstIf:
+                case QakAstReturn:
+                case QakAstError:
+                    break;
+            }
+        }
+
+        /* Sets the data pointer of a span from its start offset in the source. */
+        struct SpanDataRestorer {
+            const char *sourceData;
+
+            SpanDataRestorer(Source &source) : sourceData((const char *) source.data) {}
+
+            void operator()(qak_span &span) {
+                span.data.data = sourceData + span.start;
+            }
+        };
+
+        /* A module stored as a contiguous array of nodes in the layout of the C API, see
+         * qak_ast_node. Nodes reference their children by index. Node lists are ranges in
+         * the lists array, see qak_ast_node_list. Children are stored before their parent,
+         * so the module node is always the last node. */
+        struct FlatModule {
+            BumpAllocator &mem;
+            Array<qak_ast_node> nodes;
+            Array<qak_ast_node_index> lists;
+
+            /* The decoded string literals of the module, see Module::strings. */
+            FixedArray<InternedString> strings;
+
+            FlatModule(HeapAllocator &heapMem, BumpAllocator &mem) : mem(mem), nodes(heapMem), lists(heapMem), strings(mem) {}
+
+            /* Returns the index of the module node, or -1 if the module has not been parsed successfully. */
+            qak_ast_node_index root() {
+                return (qak_ast_node_index) nodes.size() - 1;
+            }
+
+            /* Returns the index of the node at the given position of the list. */
+            QAK_FORCE_INLINE qak_ast_node_index listNode(qak_ast_node_list &list, uint32_t index) {
+                return lists[list.start + index];
+            }
+
+            /* Returns the node at the index with the data pointers of its spans set. Nodes read from a
+             * cache entry only store the offsets of their spans, see cache::read(), the data pointers
+             * are set on first access. */
+            QAK_FORCE_INLINE qak_ast_node &node(qak_ast_node_index index, Source &source) {
+                qak_ast_node &node = nodes[index];
+                if (node.span.data.data == nullptr) forEachSpan(node, SpanDataRestorer(source));
+                return node;
             }
         };
     }
 
+    /* A change to a source. The bytes from start up to end of the old source were replaced
+     * by newLength bytes, starting at the same offset in the new source. */
+    struct SourceEdit {
+        uint32_t start;
+        uint32_t end;
+        uint32_t newLength;
+
+        SourceEdit(uint32_t start, uint32_t end, uint32_t newLength) : start(start), end(end), newLength(newLength) {}
+    };
+
     class Parser {
     private:
+        HeapAllocator &_mem;
         Array<Token> _tokens;
-        ArrayPool<ast::Variable *> _variableArrayPool;
-        ArrayPool<ast::Statement *> _statementArrayPool;
-        ArrayPool<ast::Function *> _functionArrayPool;
-        ArrayPool<ast::Parameter *> _parameterArrayPool;
-        ArrayPool<ast::Expression *> _expressionArrayPool;
+        Array<LiteralValue> _literalValues;
+        StringPool _stringPool;
+
+        /* The tokens and whether each top-level item parsed last can be reused, see ast::Module::isReusable. */
+        Array<ast::ItemTokens> _itemTokens;
+        Array<bool> _reusableItems;
+        Array<uint8_t> _decodedBytes;
+
+        /* The nodes of the lists that are currently being parsed into an ast::FlatModule,
+         * stacked on top of each other. See FlatBuilder in parser.cpp. */
+        Array<qak_ast_node_index> _flatListStack;
+
+        uint32_t _maxNestingDepth;
+        uint32_t _maxErrors;
+        bool _lazyFunctionBodies;
+        uint32_t _numThreads;
+
+        /* The module whose tokens and literal values the parser holds, if it was
+         * parsed with lazy function bodies. See parseFunctionBody(). */
+        ast::Module *_lazyModule;
+
+        /* The module whose strings the string pool holds, see reparse(). */
+        ast::Module *_stringPoolModule;
+
+        /* A range of top-level items of the previous module that reparse() parses again, and the
+         * range of the items parsed from it in _reparsedItems. The range with the edit replaces
+         * the tokens of the edit by the tokens in _editTokens. */
+        struct ReparsedRange {
+            uint32_t firstItem;
+            uint32_t endItem;
+            uint32_t firstReparsedItem;
+            uint32_t endReparsedItem;
+            bool hasEdit;
+        };
+
+        Array<Token> _editTokens;
+        Array<LiteralValue> _editLiteralValues;
+        Array<ReparsedRange> _reparsedRanges;
+        Array<ast::AstNode *> _reparsedItems;
 
         // Set on each call to parse.
         Source *_source;
         TokenStream *_stream;
+        Array<LiteralValue> *_streamLiteralValues;
         Errors *_errors;
-        BumpAllocator *_bumpMem;
+        uint32_t _nestingDepth;
+        bool _aborted;
+        bool _skipFunctionBodies;
+        bool _isParsingFunctionBody;
+
+        bool isNestingTooDeep();
+
+        bool canRecover();
+
+        bool isSynchronizationPoint();
+
+        bool synchronize();
+
+        Token *expectEnd();
+
+        /* The parse functions are templated on a builder that creates the nodes, either as an
+         * ast::Module tree or as an ast::FlatModule. See TreeBuilder and FlatBuilder in parser.cpp. */
+        template<typename Builder>
+        typename Builder::Node parse(Source &source, Errors &errors, BumpAllocator &bumpMem, Builder &builder);
+
+        template<typename Builder>
+        typename Builder::Node parseModule(Builder &builder);
+
+        template<typename Builder>
+        typename Builder::Node parseFunction(Builder &builder);
+
+        Token *skipFunctionBody();
+
+        template<typename Builder>
+        typename Builder::Node parseTypeDeclaration(Builder &builder);
+
+        template<typename Builder>
+        typename Builder::Node parseField(Builder &builder);
+
+        bool parseFunctionBody(ast::Function *function, Array<Token> &tokens, uint32_t firstIndex, Array<LiteralValue> &literalValues,
+                               Errors &errors, BumpAllocator &bumpMem);
 
-        ast::Module *parseModule();
+        /* The state of a call to reparse(), see parser.cpp. */
+        struct Reparse;
 
-        ast::Function *parseFunction();
+        void addEditTokens(Reparse &reparse);
 
-        bool parseParameters(Array<ast::Parameter *> &parameters);
+        void addReparsedTokens(Reparse &reparse, uint32_t first, uint32_t last);
 
-        ast::Parameter *parseParameter();
+        bool reparseItems(Reparse &reparse, size_t rangeIndex);
 
-        ast::Statement *parseStatement();
+        void addReparsedRange(uint32_t firstItem, uint32_t endItem, bool hasEdit);
 
-        ast::Variable *parseVariable();
+        template<typename T>
+        void spliceItems(FixedArray<T> &items, Array<T> &reparsedItems, FixedArray<T> &result, BumpAllocator &bumpMem);
 
-        ast::While *parseWhile();
+        template<typename T, typename F>
+        void spliceNodes(Reparse &reparse, FixedArray<T *> &nodes, FixedArray<T *> &result, F isNode);
 
-        ast::If *parseIf();
+        /* The state shared by the threads parsing function bodies, see parser.cpp. */
+        struct ParallelParse;
 
-        ast::Return *parseReturn();
+        static void parseFunctionBodies(ParallelParse *parallelParse, uint32_t workerIndex);
 
-        ast::TypeSpecifier *parseTypeSpecifier();
+        bool parseFunctionBodiesInParallel(ast::Module *module, Errors &errors);
 
-        ast::Expression *parseExpression();
+        template<typename Builder>
+        bool parseParameters(Builder &builder, typename Builder::List &parameters);
 
-        ast::Expression *parseTernaryOperator();
+        template<typename Builder>
+        typename Builder::Node parseParameter(Builder &builder);
 
-        ast::Expression *parseBinaryOperator(uint32_t level);
+        template<typename Builder>
+        typename Builder::Node parseStatement(Builder &builder);
 
-        ast::Expression *parseUnaryOperator();
+        template<typename Builder>
+        typename Builder::Node parseStatementOrRecover(Builder &builder, bool isFunctionAllowed);
 
-        ast::Expression *parseAccessOrCallOrLiteral();
+        template<typename Builder>
+        typename Builder::Node recover(Builder &builder, size_t startIndex);
 
-        ast::Expression *parseAccessOrCall();
+        template<typename Builder>
+        typename Builder::Node parseVariable(Builder &builder);
 
-        Array<ast::Expression *> *parseArguments(Array<ast::Expression *> *arguments);
+        template<typename Builder>
+        typename Builder::Node parseWhile(Builder &builder);
+
+        template<typename Builder>
+        typename Builder::Node parseIf(Builder &builder);
+
+        template<typename Builder>
+        typename Builder::Node parseReturn(Builder &builder);
+
+        template<typename Builder>
+        typename Builder::Node parseTypeSpecifier(Builder &builder);
+
+        template<typename Builder>
+        typename Builder::Node parseExpression(Builder &builder);
+
+        template<typename Builder>
+        typename Builder::Node parseTernaryOperator(Builder &builder);
+
+        template<typename Builder>
+        typename Builder::Node parseBinaryOperator(Builder &builder, uint32_t minPrecedence);
+
+        template<typename Builder>
+        typename Builder::Node parseUnaryOperator(Builder &builder);
+
+        template<typename Builder>
+        typename Builder::Node parseAccessOrCallOrLiteral(Builder &builder);
+
+        bool decodeCharacterOrString(Token &token, LiteralValue &value);
+
+        template<typename Builder>
+        typename Builder::Node parseAccessOrCall(Builder &builder);
+
+        template<typename Builder>
+        bool parseArguments(Builder &builder, typename Builder::List &arguments);
 
     public:
         Parser(HeapAllocator &mem) :
+                _mem(mem),
                 _tokens(mem),
-                _variableArrayPool(mem),
-                _statementArrayPool(mem),
-                _functionArrayPool(mem),
-                _parameterArrayPool(mem),
-                _expressionArrayPool(mem),
+                _literalValues(mem),
+                _stringPool(mem),
+                _itemTokens(mem),
+                _reusableItems(mem),
+                _decodedBytes(mem),
+                _flatListStack(mem),
+                _maxNestingDepth(QAK_MAX_NESTING_DEPTH),
+                _maxErrors(QAK_MAX_ERRORS),
+                _lazyFunctionBodies(false),
+                _numThreads(1),
+                _lazyModule(nullptr),
+                _stringPoolModule(nullptr),
+                _editTokens(mem),
+                _editLiteralValues(mem),
+                _reparsedRanges(mem),
+                _reparsedItems(mem),
                 _source(nullptr),
                 _stream(nullptr),
+                _streamLiteralValues(nullptr),
                 _errors(nullptr),
-                _bumpMem(nullptr) {}
-
+                _nestingDepth(0),
+                _aborted(false),
+                _skipFunctionBodies(false),
+                _isParsingFunctionBody(false) {}
+
+        /* Parses the source into a tree of ast:: nodes allocated in the bump allocator. A statement
+         * or expression that can not be parsed is reported to the errors and replaced by an
+         * ast::ErrorNode, after which parsing continues with the next statement. Returns nullptr
+         * if the source could not be tokenized, has no module header, or nests too deeply. */
         ast::Module *parse(Source &source, Errors &errors, BumpAllocator *bumpMem);
 
+        /* Parses the edited source of the previous module, reusing the top-level functions and
+         * statements whose tokens the edit did not change. Only the tokens around the edit are
+         * tokenized again, and only the items between the last reusable item before the edit and
+         * the first reusable item after it are parsed again. Items whose parse reported errors, and
+         * functions with unparsed bodies, are parsed again, so their errors are reported.
+         *
+         * The new module is allocated in the bump allocator, which takes over the blocks of the
+         * previous module's bump allocator, as reused items and strings stay where they are. The
+         * previous bump allocator is left empty and can be freed, everything else allocated in it
+         * moves along. Once the bump allocator would grow past QAK_MAX_REPARSE_GROWTH times what
+         * parsing from scratch took, the source is parsed from scratch instead, without taking
+         * over the previous blocks. Passing the previous module's bump allocator reuses it. Its
+         * nodes of replaced items are kept until it reaches the same limit, then the source is
+         * parsed from scratch into it and everything allocated in it before is freed.
+         *
+         * Each range of items parsed again gets a TokenChunk of its own, reused items keep their
+         * token indices and chunks. Positions after the edit are stored relative to the end of the
+         * source, see ModuleTokens, so the work done depends on the size of the edit and the items
+         * parsed again, not on the size of the source. The previous module must not be used
+         * afterwards, as its tokens are moved around the edit and shared with the new module.
+         * Returns nullptr like parse(), in which case the previous module is unchanged. */
+        ast::Module *reparse(ast::Module *previous, Source &source, SourceEdit edit, Errors &errors, BumpAllocator *bumpMem);
+
+        /* Parses the source into the flat module, without building the ast:: tree. Previous
+         * nodes of the flat module are removed. Returns false if there were errors. Like the
+         * tree, the flat module then holds the partially parsed module, or is empty if parsing
+         * did not produce a module. */
+        bool parse(Source &source, Errors &errors, ast::FlatModule &module);
+
+        /* Sets the maximum nesting depth of statements and expressions. Parsing a
+         * source that exceeds the depth fails with an error instead of overflowing
+         * the native stack. Defaults to QAK_MAX_NESTING_DEPTH. Chains of binary
+         * operations, like a + b + c, are parsed in a loop and are not limited. Their
+         * left operands nest as deep as the chain is long, so passes recursing into
+         * the tree visit them in a loop. */
+        void setMaxNestingDepth(uint32_t maxNestingDepth);
+
+        /* Sets the number of errors after which the parser stops recovering from errors.
+         * The module parsed up to that point is returned. Defaults to QAK_MAX_ERRORS. */
+        void setMaxErrors(uint32_t maxErrors);
+
+        /* Sets whether parsing into an ast:: tree skips the bodies of functions, only parsing
+         * their signatures. Character and string literals in skipped bodies are still decoded.
+         * Syntax errors in a body are reported once its body is parsed via parseFunctionBody().
+         * The flat module is always parsed completely. Defaults to false. */
+        void setLazyFunctionBodies(bool lazyFunctionBodies);
+
+        /* Sets the number of threads parsing the bodies of top-level functions when parsing
+         * into an ast:: tree. The bodies are skipped first, then parsed by the threads, each
+         * into its own bump allocator, which the module's bump allocator takes over afterwards.
+         * Errors are reported in source order. Ignored with lazy function bodies, and in WASM
+         * builds, which parse on the calling thread. Defaults to 1. */
+        void setNumThreads(uint32_t numThreads);
+
+        /* Parses the statements of a function whose body was skipped. Does nothing if the body
+         * was already parsed. The nodes are allocated in the module's bump allocator. The tokens
+         * of the module are copied to the parser, unless it was the last module it parsed.
+         * Returns false if there were errors, in which case the statements contain error nodes. */
+        bool parseFunctionBody(ast::Module *module, ast::Function *function, Errors &errors);
+
         Array<Token> &tokens();
+
+        /* The decoded values of the boolean and numeric literal tokens, see Token::literalIndex. */
+        Array<LiteralValue> &literalValues();
     };
 
     namespace parser {
-        void printAstNode(ast::AstNode *node, HeapAllocator &mem);
+        /* Prints the node and its children. The tokens are the tokens of the module the node belongs to. */
+        void printAstNode(ast::AstNode *node, ast::ModuleTokens &tokens, HeapAllocator &mem);
+
+        void printAstNode(ast::Module *module, HeapAllocator &mem);
     }
 }
 
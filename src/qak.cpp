@@ -1,6 +1,12 @@
 #include "qak.h"
 #include "io.h"
 #include "parser.h"
+#include "cache.h"
+#include "resolver.h"
+#include "layout.h"
+#include "folder.h"
+#include "evaluator.h"
+#include "transpiler.h"
 
 #ifdef WASM
 #include <emscripten/emscripten.h>
@@ -19,11 +25,35 @@ static void spanToQakSpan(Span &span, qak_span &qakSpan) {
     qakSpan.endLine = span.endLine;
 }
 
+/* A native registered through the C API, passed as the user data of its Native, see callNative(). */
+struct CNative {
+    qak_native_function function;
+    void *userData;
+    qak_value_type returnType;
+    qak_value_type parameterTypes[QAK_MAX_NATIVE_PARAMETERS];
+    int numParameters;
+};
+
 /** Keeps track of global memory allocated for Sources and Modules via a HeapAllocator **/
 struct Compiler {
     HeapAllocator *mem;
 
-    Compiler(HeapAllocator *mem) : mem(mem) {};
+    /* The directory of the cache of compiled modules, or nullptr if caching is disabled. */
+    char *cacheDirectory;
+
+    /* The types of all modules compiled to bytecode, see qak_module_run(). */
+    TypeTable types;
+
+    /* The natives registered with qak_compiler_register_native(), calling the CNatives. */
+    NativeFunctions natives;
+    Array<CNative *> cNatives;
+
+    Compiler(HeapAllocator *mem) : mem(mem), cacheDirectory(nullptr), types(*mem), natives(*mem, types), cNatives(*mem) {};
+
+    ~Compiler() {
+        if (cacheDirectory) mem->free(cacheDirectory, QAK_SRC_LOC);
+        cNatives.freeObjects();
+    }
 };
 
 /** Keeps track of results from all compilation stages for a module. The module itself
@@ -35,19 +65,34 @@ struct Module {
     BumpAllocator *bumpMem;
     Source *source;
     Array<Token> tokens;
+    ast::FlatModule flatAst;
     ast::Module *astModule;
-    Array<qak_ast_node> *astNodes;
     Errors errors;
+    TypeTable &types;
+    NativeFunctions &natives;
+
+    /* The bytecode of the module, or nullptr if it could not be compiled. */
+    bytecode::Program *program;
+
+    /* The resolved, type checked and laid out tree view, or nullptr if the module has compile errors.
+     * Runtime errors are added to the same errors, so the outcome of the checks is kept here. */
+    ast::Module *checkedAstModule;
+    bool isAstChecked;
+    bool isProgramCompiled;
 
-    Module(HeapAllocator &mem, BumpAllocator *bumpMem, Source *source, Array<Token> &tokens, ast::Module *astModule, Errors &errors) :
+    Module(HeapAllocator &mem, BumpAllocator *bumpMem, Source *source, TypeTable &types, NativeFunctions &natives) :
             mem(mem), bumpMem(bumpMem),
             source(source),
             tokens(mem),
-            astModule(astModule),
-            astNodes(nullptr),
-            errors(mem, *bumpMem) {
-        this->tokens.addAll(tokens);
-        this->errors.addAll(errors);
+            flatAst(mem, *bumpMem),
+            astModule(nullptr),
+            errors(mem, *bumpMem),
+            types(types),
+            natives(natives),
+            program(nullptr),
+            checkedAstModule(nullptr),
+            isAstChecked(false),
+            isProgramCompiled(false) {
     };
 
     ~Module() {
@@ -55,134 +100,61 @@ struct Module {
         // as the AST.
         if (bumpMem) mem.freeObject(bumpMem, QAK_SRC_LOC);
 
-        if (astNodes) mem.freeObject(astNodes, QAK_SRC_LOC);
-
         // Free all objects allocated through the heap allocator such
         // as the source.
         mem.freeObject(source, QAK_SRC_LOC);
     }
 
-    qak_ast_node_index linearizeAst() {
-        if (astNodes == nullptr) {
-            astNodes = mem.allocObject<Array<qak_ast_node>>(QAK_SRC_LOC, mem);
-            return linearizeAst(*astNodes, astModule);
-        } else {
-            return ((qak_ast_node_index)astNodes->size()) - 1;
+    /* Returns the ast:: tree view of the module, or nullptr if the module has errors. The
+     * tree is only needed by consumers of the C++ API, so it is parsed on first access. */
+    ast::Module *getAstModule() {
+        if (astModule == nullptr && flatAst.root() >= 0) {
+            Parser parser(mem);
+            Errors treeErrors(mem, *bumpMem);
+            astModule = parser.parse(*source, treeErrors, bumpMem);
         }
+        return astModule;
     }
 
-    template<typename T>
-    void fixedAstNodeArrayToQakAstNodeList(Array<qak_ast_node> &nodes, FixedArray<T *> &array, qak_ast_node_list &list) {
-        list.numNodes = (qak_ast_node_index)array.size();
-        if (list.numNodes > 0) {
-            list.nodes = bumpMem->alloc<qak_ast_node_index>(list.numNodes);
-            for (size_t i = 0; i < list.numNodes; i++) {
-                list.nodes[i] = linearizeAst(nodes, array[i]);
-            }
-        }
+    /* Returns the ast:: tree view of the module resolved, type checked and with its value types laid
+     * out, or nullptr if the module has errors. Errors are added to the module's errors on first access. */
+    ast::Module *getCheckedAstModule() {
+        if (isAstChecked) return checkedAstModule;
+        isAstChecked = true;
+        if (errors.hasErrors()) return nullptr;
+        ast::Module *module = getAstModule();
+        if (module == nullptr) return nullptr;
+
+        Resolver resolver(mem);
+        if (!resolver.resolve(module, errors, &natives)) return nullptr;
+        TypeChecker checker(mem);
+        if (!checker.check(module, types, errors)) return nullptr;
+        LayoutEngine layoutEngine(mem);
+        if (!layoutEngine.layout(module, types, errors)) return nullptr;
+        checkedAstModule = module;
+        return module;
     }
 
-    qak_ast_node_index linearizeAst(Array<qak_ast_node> &nodes, qak::ast::AstNode *node) {
-        if (node == nullptr) return -1;
-
-        qak_ast_node astNode;
-        astNode.type = (qak_ast_type) node->astType;
-        spanToQakSpan(node->span, astNode.span);
-
-        switch (node->astType) {
-            case qak::ast::AstTypeSpecifier: {
-                qak::ast::TypeSpecifier *n = (qak::ast::TypeSpecifier *) (node);
-                spanToQakSpan(n->name, astNode.data.typeSpecifier.name);
-                break;
-            }
-            case qak::ast::AstParameter: {
-                qak::ast::Parameter *n = (qak::ast::Parameter *) (node);
-                spanToQakSpan(n->name, astNode.data.parameter.name);
-                astNode.data.parameter.typeSpecifier = linearizeAst(nodes, n->typeSpecifier);
-                break;
-            }
-            case qak::ast::AstFunction: {
-                qak::ast::Function *n = (qak::ast::Function *) (node);
-                spanToQakSpan(n->name, astNode.data.function.name);
-                fixedAstNodeArrayToQakAstNodeList(nodes, n->parameters, astNode.data.function.parameters);
-                astNode.data.function.returnType = linearizeAst(nodes, n->returnType);
-                fixedAstNodeArrayToQakAstNodeList(nodes, n->statements, astNode.data.function.statements);
-                break;
-            }
-            case qak::ast::AstTernaryOperation: {
-                qak::ast::TernaryOperation *n = (qak::ast::TernaryOperation *) (node);
-                astNode.data.ternaryOperation.condition = linearizeAst(nodes, n->condition);
-                astNode.data.ternaryOperation.trueValue = linearizeAst(nodes, n->trueValue);
-                astNode.data.ternaryOperation.falseValue = linearizeAst(nodes, n->falseValue);
-                break;
-            }
-            case qak::ast::AstBinaryOperation: {
-                qak::ast::BinaryOperation *n = (qak::ast::BinaryOperation *) (node);
-                spanToQakSpan(n->op, astNode.data.binaryOperation.op);
-                astNode.data.binaryOperation.left = linearizeAst(nodes, n->left);
-                astNode.data.binaryOperation.right = linearizeAst(nodes, n->right);
-                break;
-            }
-            case qak::ast::AstUnaryOperation: {
-                qak::ast::UnaryOperation *n = (qak::ast::UnaryOperation *) (node);
-                spanToQakSpan(n->op, astNode.data.unaryOperation.op);
-                astNode.data.unaryOperation.value = linearizeAst(nodes, n->value);
-                break;
-            }
-            case qak::ast::AstLiteral: {
-                qak::ast::Literal *n = (qak::ast::Literal *) (node);
-                astNode.data.literal.type = (qak_token_type) n->type;
-                spanToQakSpan(n->value, astNode.data.literal.value);
-                break;
-            }
-            case qak::ast::AstVariableAccess: {
-                qak::ast::VariableAccess *n = (qak::ast::VariableAccess *) (node);
-                spanToQakSpan(n->name, astNode.data.variableAccess.name);
-                break;
-            }
-            case qak::ast::AstFunctionCall: {
-                qak::ast::FunctionCall *n = (qak::ast::FunctionCall *) (node);
-                astNode.data.functionCall.variableAccess = linearizeAst(nodes, n->variableAccess);
-                fixedAstNodeArrayToQakAstNodeList(nodes, n->arguments, astNode.data.functionCall.arguments);
-                break;
-            }
-            case qak::ast::AstVariable: {
-                qak::ast::Variable *n = (qak::ast::Variable *) (node);
-                spanToQakSpan(n->name, astNode.data.variable.name);
-                astNode.data.variable.typeSpecifier = linearizeAst(nodes, n->typeSpecifier);
-                astNode.data.variable.initializerExpression = linearizeAst(nodes, n->initializerExpression);
-                break;
-            }
-            case qak::ast::AstWhile: {
-                qak::ast::While *n = (qak::ast::While *) (node);
-                astNode.data.whileNode.condition = linearizeAst(nodes, n->condition);
-                fixedAstNodeArrayToQakAstNodeList(nodes, n->statements, astNode.data.whileNode.statements);
-                break;
-            }
-            case qak::ast::AstIf: {
-                qak::ast::If *n = (qak::ast::If *) (node);
-                astNode.data.ifNode.condition = linearizeAst(nodes, n->condition);
-                fixedAstNodeArrayToQakAstNodeList(nodes, n->trueBlock, astNode.data.ifNode.trueBlock);
-                fixedAstNodeArrayToQakAstNodeList(nodes, n->falseBlock, astNode.data.ifNode.falseBlock);
-                break;
-            }
-            case qak::ast::AstReturn: {
-                qak::ast::Return *n = (qak::ast::Return *) (node);
-                astNode.data.returnNode.returnValue = linearizeAst(nodes, n->returnValue);
-                break;
-            }
-            case qak::ast::AstModule: {
-                qak::ast::Module *n = (qak::ast::Module *) (node);
-                spanToQakSpan(n->name, astNode.data.module.name);
-                fixedAstNodeArrayToQakAstNodeList(nodes, n->variables, astNode.data.module.variables);
-                fixedAstNodeArrayToQakAstNodeList(nodes, n->functions, astNode.data.module.functions);
-                fixedAstNodeArrayToQakAstNodeList(nodes, n->statements, astNode.data.module.statements);
-                break;
-            }
-        }
-
-        nodes.add(astNode);
-        return ((qak_ast_node_index)nodes.size()) - 1;
+    /* Returns the bytecode of the module, or nullptr if the module has errors. The module is
+     * compiled on first access. Folding changes the tree it is compiled from, so it is compiled
+     * from a tree of its own, the tree view stays as parsed. */
+    bytecode::Program *getProgram() {
+        if (isProgramCompiled) return program;
+        isProgramCompiled = true;
+        if (getCheckedAstModule() == nullptr) return nullptr;
+
+        Parser parser(mem);
+        Errors treeErrors(mem, *bumpMem);
+        ast::Module *module = parser.parse(*source, treeErrors, bumpMem);
+        Resolver resolver(mem);
+        resolver.resolve(module, treeErrors, &natives);
+        TypeChecker checker(mem);
+        checker.check(module, types, treeErrors);
+        ConstantFolder folder(mem);
+        folder.fold(module);
+        BytecodeCompiler compiler(mem);
+        program = compiler.compile(module, types, errors);
+        return program;
     }
 };
 
@@ -205,30 +177,51 @@ EMSCRIPTEN_KEEPALIVE void qak_compiler_print_memory_usage(qak_compiler compilerH
     compiler->mem->printAllocations();
 }
 
-qak_module qak_compile(Compiler *compiler, Source *source) {
-    BumpAllocator *bumpMem = compiler->mem->allocObject<BumpAllocator>(QAK_SRC_LOC, *compiler->mem);
-    Array<Token> tokens(*compiler->mem);
-    Errors errors(*compiler->mem, *bumpMem);
+EMSCRIPTEN_KEEPALIVE void qak_compiler_set_cache_directory(qak_compiler compilerHandle, const char *directory) {
+    Compiler *compiler = (Compiler *) compilerHandle;
+    if (compiler->cacheDirectory) compiler->mem->free(compiler->cacheDirectory, QAK_SRC_LOC);
+    compiler->cacheDirectory = nullptr;
+    if (directory == nullptr) return;
 
-    qak::tokenizer::tokenize(*source, tokens, errors);
-    if (errors.hasErrors()) {
-        return (qak_module) compiler->mem->allocObject<Module>(QAK_SRC_LOC, *compiler->mem, bumpMem, source, tokens, nullptr, errors);;
-    }
+    size_t length = strlen(directory) + 1;
+    compiler->cacheDirectory = compiler->mem->alloc<char>(length, QAK_SRC_LOC);
+    memcpy(compiler->cacheDirectory, directory, length);
+}
 
+static Module *newModule(Compiler *compiler, Source *source) {
+    BumpAllocator *bumpMem = compiler->mem->allocObject<BumpAllocator>(QAK_SRC_LOC, *compiler->mem);
+    return compiler->mem->allocObject<Module>(QAK_SRC_LOC, *compiler->mem, bumpMem, source, compiler->types, compiler->natives);
+}
+
+static void parseModule(Compiler *compiler, Module *module) {
     qak::Parser parser(*compiler->mem);
-    ast::Module *astModule = parser.parse(*source, errors, bumpMem);
-    if (astModule == nullptr) {
-        return (qak_module) compiler->mem->allocObject<Module>(QAK_SRC_LOC, *compiler->mem, bumpMem, source, tokens, nullptr, errors);;
-    }
+    parser.parse(*module->source, module->errors, module->flatAst);
+    module->tokens.addAll(parser.tokens());
+}
 
-    return (qak_module) compiler->mem->allocObject<Module>(QAK_SRC_LOC, *compiler->mem, bumpMem, source, tokens, astModule, errors);
+qak_module qak_compile(Compiler *compiler, Source *source) {
+    Module *module = newModule(compiler, source);
+    parseModule(compiler, module);
+    return (qak_module) module;
 }
 
 EMSCRIPTEN_KEEPALIVE qak_module qak_compiler_compile_file(qak_compiler compilerHandle, const char *fileName) {
     Compiler *compiler = (Compiler *) compilerHandle;
-    Source *source = io::readFile(fileName, *compiler->mem);
+    HeapAllocator &mem = *compiler->mem;
+    Source *source = io::readFile(fileName, mem);
     if (source == nullptr) return nullptr;
-    return qak_compile(compiler, source);
+    if (compiler->cacheDirectory == nullptr) return qak_compile(compiler, source);
+
+    // Unchanged sources are loaded from the cache instead of being tokenized and parsed.
+    uint64_t key = cache::key(*source);
+    char *cacheFileName = cache::entryFileName(compiler->cacheDirectory, key, mem);
+    Module *module = newModule(compiler, source);
+    if (!cache::read(cacheFileName, key, *source, module->tokens, module->flatAst, module->errors, mem)) {
+        parseModule(compiler, module);
+        cache::write(cacheFileName, key, *source, module->tokens, module->flatAst, module->errors, mem);
+    }
+    mem.free(cacheFileName, QAK_SRC_LOC);
+    return (qak_module) module;
 }
 
 EMSCRIPTEN_KEEPALIVE qak_module qak_compiler_compile_source(qak_compiler compilerHandle, const char *fileName, const char *sourceData) {
@@ -296,26 +289,241 @@ EMSCRIPTEN_KEEPALIVE void qak_module_print_tokens(qak_module moduleHandle) {
 
 EMSCRIPTEN_KEEPALIVE qak_ast_module *qak_module_get_ast(qak_module moduleHandle) {
     Module *module = (Module *) moduleHandle;
-    qak_ast_node_index moduleIndex = module->linearizeAst();
-    if (moduleIndex >= 0) return &module->astNodes->buffer()[moduleIndex].data.module;
+    qak_ast_node_index moduleIndex = module->flatAst.root();
+    if (moduleIndex >= 0) return &module->flatAst.node(moduleIndex, *module->source).data.module;
     else return nullptr;
 }
 
 EMSCRIPTEN_KEEPALIVE qak_ast_node *qak_module_get_ast_node(qak_module moduleHandle, qak_ast_node_index nodeIndex) {
     Module *module = (Module *) moduleHandle;
     if (nodeIndex < 0) return nullptr;
-    module->linearizeAst();
-    return &module->astNodes->buffer()[nodeIndex];
+    return &module->flatAst.node(nodeIndex, *module->source);
+}
+
+EMSCRIPTEN_KEEPALIVE qak_ast_node *qak_module_get_ast_list_node(qak_module moduleHandle, qak_ast_node_list *list, int index) {
+    Module *module = (Module *) moduleHandle;
+    return &module->flatAst.node(module->flatAst.listNode(*list, (uint32_t) index), *module->source);
 }
 
 EMSCRIPTEN_KEEPALIVE void qak_module_print_ast(qak_module moduleHandle) {
     Module *module = (Module *) moduleHandle;
-    if (module->astModule) {
+    ast::Module *astModule = module->getAstModule();
+    if (astModule) {
         HeapAllocator mem;
-        parser::printAstNode(module->astModule, mem);
+        parser::printAstNode(astModule, mem);
     }
 }
 
+EMSCRIPTEN_KEEPALIVE int qak_module_get_num_string_literals(qak_module moduleHandle) {
+    Module *module = (Module *) moduleHandle;
+    return (int) module->flatAst.strings.size();
+}
+
+EMSCRIPTEN_KEEPALIVE int qak_module_get_string_literal(qak_module moduleHandle, int stringIndex, qak_string *string) {
+    Module *module = (Module *) moduleHandle;
+    if (stringIndex < 0 || (size_t) stringIndex >= module->flatAst.strings.size()) return 0;
+    InternedString &internedString = module->flatAst.strings[stringIndex];
+    string->data = (const char *) internedString.data;
+    string->length = internedString.length;
+    return 1;
+}
+
+/* Registers and slots hold all integers as int64 and all floats as double, see bytecode::Value. */
+static void toQakValue(bytecode::Value value, TypeId type, qak_value *result) {
+    result->type = (qak_value_type) type;
+    result->value.longValue = 0;
+    switch (type) {
+        case TypeBoolean:
+            result->value.booleanValue = (uint8_t) value.i;
+            break;
+        case TypeInt8:
+            result->value.byteValue = (int8_t) value.i;
+            break;
+        case TypeInt16:
+            result->value.shortValue = (int16_t) value.i;
+            break;
+        case TypeInt32:
+            result->value.intValue = (int32_t) value.i;
+            break;
+        case TypeInt64:
+            result->value.longValue = value.i;
+            break;
+        case TypeFloat32:
+            result->value.floatValue = (float) value.f;
+            break;
+        case TypeFloat64:
+            result->value.doubleValue = value.f;
+            break;
+        case TypeCharacter:
+            result->value.characterValue = (uint32_t) value.i;
+            break;
+        case TypeString:
+            result->value.stringIndex = (uint32_t) value.i;
+            break;
+        default:
+            break;
+    }
+}
+
+static bytecode::Value fromQakValue(qak_value &value, TypeId type) {
+    bytecode::Value result;
+    result.i = 0;
+    switch (type) {
+        case TypeBoolean:
+            result.i = value.value.booleanValue ? 1 : 0;
+            break;
+        case TypeInt8:
+            result.i = value.value.byteValue;
+            break;
+        case TypeInt16:
+            result.i = value.value.shortValue;
+            break;
+        case TypeInt32:
+            result.i = value.value.intValue;
+            break;
+        case TypeInt64:
+            result.i = value.value.longValue;
+            break;
+        case TypeFloat32:
+            result.f = value.value.floatValue;
+            break;
+        case TypeFloat64:
+            result.f = value.value.doubleValue;
+            break;
+        case TypeCharacter:
+            result.i = value.value.characterValue;
+            break;
+        case TypeString:
+            result.i = value.value.stringIndex;
+            break;
+        default:
+            break;
+    }
+    return result;
+}
+
+/* Converts the arguments to qak_values, calls the CNative in the user data and converts its result back. */
+static bytecode::Value callNative(bytecode::Value *arguments, void *userData) {
+    CNative *native = (CNative *) userData;
+    qak_value values[QAK_MAX_NATIVE_PARAMETERS];
+    for (int i = 0; i < native->numParameters; i++) toQakValue(arguments[i], native->parameterTypes[i], &values[i]);
+    qak_value result;
+    bytecode::Value zero;
+    zero.i = 0;
+    toQakValue(zero, native->returnType, &result);
+    native->function(values, native->numParameters, &result, native->userData);
+    return fromQakValue(result, native->returnType);
+}
+
+EMSCRIPTEN_KEEPALIVE int qak_compiler_register_native(qak_compiler compilerHandle, const char *name, qak_value_type returnType,
+                                                      const qak_value_type *parameterTypes, int numParameters, qak_native_function function,
+                                                      void *userData) {
+    Compiler *compiler = (Compiler *) compilerHandle;
+    if (numParameters < 0 || numParameters > QAK_MAX_NATIVE_PARAMETERS || function == nullptr) return 0;
+
+    CNative *native = compiler->mem->allocObject<CNative>(QAK_SRC_LOC);
+    native->function = function;
+    native->userData = userData;
+    native->returnType = returnType;
+    native->numParameters = numParameters;
+    TypeId types[QAK_MAX_NATIVE_PARAMETERS];
+    for (int i = 0; i < numParameters; i++) {
+        native->parameterTypes[i] = parameterTypes[i];
+        types[i] = (TypeId) parameterTypes[i];
+    }
+    if (compiler->natives.add(name, (TypeId) returnType, types, (uint32_t) numParameters, callNative, native) < 0) {
+        compiler->mem->freeObject(native, QAK_SRC_LOC);
+        return 0;
+    }
+    compiler->cNatives.add(native);
+    return 1;
+}
+
+EMSCRIPTEN_KEEPALIVE int qak_module_run(qak_module moduleHandle, qak_value *result) {
+    Module *module = (Module *) moduleHandle;
+    toQakValue(bytecode::Value(), TypeNothing, result);
+    bytecode::Program *program = module->getProgram();
+    if (program == nullptr) return 0;
+
+    Interpreter interpreter(module->mem);
+    if (!interpreter.run(program, module->errors)) return 0;
+    toQakValue(interpreter.result(), interpreter.resultType(), result);
+    return 1;
+}
+
+EMSCRIPTEN_KEEPALIVE int qak_module_eval(qak_module moduleHandle, qak_value *result) {
+    Module *module = (Module *) moduleHandle;
+    toQakValue(bytecode::Value(), TypeNothing, result);
+    ast::Module *astModule = module->getCheckedAstModule();
+    if (astModule == nullptr) return 0;
+
+    Evaluator evaluator(module->mem);
+    if (!evaluator.evaluate(module->flatAst, astModule, module->types, module->errors)) return 0;
+    toQakValue(evaluator.result(), evaluator.resultType(), result);
+    return 1;
+}
+
+EMSCRIPTEN_KEEPALIVE int qak_module_transpile(qak_module moduleHandle, const char *fileName) {
+    Module *module = (Module *) moduleHandle;
+    ast::Module *astModule = module->getCheckedAstModule();
+    if (astModule == nullptr) return 0;
+
+    Array<char> output(module->mem);
+    CTranspiler transpiler(module->mem);
+    if (!transpiler.transpile(astModule, module->types, module->errors, output)) return 0;
+    if (!io::writeFile(fileName, (const uint8_t *) output.buffer(), output.size(), module->mem)) {
+        module->errors.add(astModule->tokens[astModule->name], "Couldn't write file %s.", fileName);
+        return 0;
+    }
+    return 1;
+}
+
+EMSCRIPTEN_KEEPALIVE int qak_module_get_num_types(qak_module moduleHandle) {
+    Module *module = (Module *) moduleHandle;
+    ast::Module *astModule = module->getCheckedAstModule();
+    return astModule ? (int) astModule->types.size() : 0;
+}
+
+EMSCRIPTEN_KEEPALIVE int qak_module_find_type(qak_module moduleHandle, const char *name) {
+    Module *module = (Module *) moduleHandle;
+    ast::Module *astModule = module->getCheckedAstModule();
+    if (astModule == nullptr) return -1;
+    return LayoutEngine::find(astModule, (const uint8_t *) name, (uint32_t) strlen(name));
+}
+
+EMSCRIPTEN_KEEPALIVE int qak_module_get_type_layout(qak_module moduleHandle, int typeIndex, qak_type_layout *layout) {
+    Module *module = (Module *) moduleHandle;
+    ast::Module *astModule = module->getCheckedAstModule();
+    if (astModule == nullptr) return 0;
+    if (typeIndex < 0 || (size_t) typeIndex >= astModule->types.size()) return 0;
+    ast::TypeDeclaration *type = astModule->types[typeIndex];
+    spanToQakSpan(astModule->tokens[type->name], layout->name);
+    layout->size = type->size;
+    layout->alignment = type->alignment;
+    layout->numFields = (int) type->fields.size();
+    layout->isPacked = type->isPacked;
+    layout->isCCompatible = type->isCCompatible;
+    layout->isStructureOfArrays = type->isStructureOfArrays;
+    return 1;
+}
+
+EMSCRIPTEN_KEEPALIVE int qak_module_get_field_layout(qak_module moduleHandle, int typeIndex, int fieldIndex, qak_field_layout *layout) {
+    Module *module = (Module *) moduleHandle;
+    ast::Module *astModule = module->getCheckedAstModule();
+    if (astModule == nullptr) return 0;
+    if (typeIndex < 0 || (size_t) typeIndex >= astModule->types.size()) return 0;
+    ast::TypeDeclaration *type = astModule->types[typeIndex];
+    if (fieldIndex < 0 || (size_t) fieldIndex >= type->fields.size()) return 0;
+    ast::Field *field = type->fields[fieldIndex];
+    spanToQakSpan(astModule->tokens[field->firstToken], layout->name);
+    layout->type = field->valueType >= 0 ? QakValueNothing : (qak_value_type) field->type;
+    layout->valueType = field->valueType;
+    layout->offset = field->offset;
+    layout->size = field->size;
+    layout->alignment = field->alignment;
+    return 1;
+}
+
 #ifdef WASM
 EMSCRIPTEN_KEEPALIVE int main(int argc, char** argv) {
     return 0;
@@ -104,14 +104,19 @@ typedef enum qak_ast_type {
     QakAstWhile,
     QakAstIf,
     QakAstReturn,
-    QakAstModule
+    QakAstModule,
+    QakAstError,
+    QakAstTypeDeclaration,
+    QakAstField
 } qak_ast_type;
 
 typedef int32_t qak_ast_node_index;
 
+/** A list of numNodes nodes. The node indices are stored consecutively in the
+ * module's list storage, beginning at start. See qak_module_get_ast_list_node(). **/
 typedef struct qak_ast_node_list {
     uint32_t numNodes;
-    qak_ast_node_index *nodes;
+    uint32_t start;
 } qak_ast_node_list;
 
 typedef struct qak_ast_type_specifier {
@@ -168,9 +173,25 @@ typedef struct qak_ast_unary_operation {
     qak_ast_node_index value;
 } qak_ast_unary_operation;
 
+/** The decoded value of a literal. The member to read depends on the
+ * literal's token type. String literals store the index of the decoded
+ * string, see qak_module_get_string_literal(). **/
+typedef union qak_literal_value {
+    uint8_t booleanValue;
+    int8_t byteValue;
+    int16_t shortValue;
+    int32_t intValue;
+    int64_t longValue;
+    float floatValue;
+    double doubleValue;
+    uint32_t characterValue;
+    uint32_t stringIndex;
+} qak_literal_value;
+
 typedef struct qak_ast_literal {
     qak_token_type type;
     qak_span value;
+    qak_literal_value decodedValue;
 } qak_ast_literal;
 
 typedef struct qak_ast_variable_access {
@@ -182,11 +203,26 @@ typedef struct qak_ast_function_call {
     qak_ast_node_list arguments;
 } qak_ast_function_call;
 
+/** A value type declared with "type Name [packed] [c] [soa] ... end", see qak_module_get_type_layout(). **/
+typedef struct qak_ast_type_declaration {
+    qak_span name;
+    qak_ast_node_list fields;
+    uint8_t isPacked;
+    uint8_t isCCompatible;
+    uint8_t isStructureOfArrays;
+} qak_ast_type_declaration;
+
+typedef struct qak_ast_field {
+    qak_span name;
+    qak_ast_node_index typeSpecifier;
+} qak_ast_field;
+
 typedef struct qak_ast_module {
     qak_span name;
     qak_ast_node_list variables;
     qak_ast_node_list functions;
     qak_ast_node_list statements;
+    qak_ast_node_list types;
 } qak_ast_module;
 
 typedef struct qak_ast_node {
@@ -207,9 +243,76 @@ typedef struct qak_ast_node {
         qak_ast_variable_access variableAccess;
         qak_ast_function_call functionCall;
         qak_ast_module module;
+        qak_ast_type_declaration typeDeclaration;
+        qak_ast_field field;
     } data;
 } qak_ast_node;
 
+/** The type of a value returned by qak_module_run(). **/
+typedef enum qak_value_type {
+    QakValueNothing = 1,
+    QakValueBoolean,
+    QakValueInt8,
+    QakValueInt16,
+    QakValueInt32,
+    QakValueInt64,
+    QakValueFloat32,
+    QakValueFloat64,
+    QakValueCharacter,
+    QakValueString
+} qak_value_type;
+
+/** A value of the given type. The member of the value to read is the same as for a literal
+ * of the type, e.g. longValue for QakValueInt64. Strings store the index of a string literal,
+ * see qak_module_get_string_literal(). **/
+typedef struct qak_value {
+    qak_value_type type;
+    qak_literal_value value;
+} qak_value;
+
+/** The maximum number of parameters of a native function, see qak_compiler_register_native(). **/
+#define QAK_MAX_NATIVE_PARAMETERS 16
+
+/** A function of the host called by Qak code. The arguments have the parameter types the function
+ * was registered with. The function stores its return value in result, which is of the registered
+ * return type and zero when the function is called. **/
+typedef void (*qak_native_function)(const qak_value *arguments, int numArguments, qak_value *result, void *userData);
+
+/** The memory layout of a value type declared by a module, see qak_module_get_type_layout(). Values
+ * of the type take size bytes and must be stored at addresses that are a multiple of alignment. The
+ * host can read and write them in place at the offsets of their fields. **/
+typedef struct qak_type_layout {
+    qak_span name;
+    uint32_t size;
+    uint32_t alignment;
+    int numFields;
+    uint8_t isPacked;
+    uint8_t isCCompatible;
+    uint8_t isStructureOfArrays;
+} qak_type_layout;
+
+/** The memory layout of a field of a value type, see qak_module_get_field_layout(). Fields of a
+ * primitive type have that type and a valueType of -1. Fields of a value type have the type
+ * QakValueNothing and store the index of their value type in valueType. **/
+typedef struct qak_field_layout {
+    qak_span name;
+    qak_value_type type;
+    int valueType;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t alignment;
+} qak_field_layout;
+
+/** Returns the offset of a field of the element at the index of an array of count elements of the
+ * type, relative to the start of the array. Arrays of count elements take count * size bytes. Arrays
+ * of types that are not stored as structure-of-arrays store the elements one after the other. Arrays
+ * of types that are stored as structure-of-arrays store the values of each field one after the other,
+ * the values of a field start at count times its offset. **/
+static inline size_t qak_array_field_offset(const qak_type_layout *type, const qak_field_layout *field, size_t index, size_t count) {
+    if (type->isStructureOfArrays) return field->offset * count + index * field->size;
+    return index * type->size + field->offset;
+}
+
 typedef struct qak_error {
     qak_string errorMessage;
     qak_span span;
@@ -222,6 +325,20 @@ void qak_compiler_delete(qak_compiler compiler);
 
 void qak_compiler_print_memory_usage(qak_compiler compile);
 
+/** Sets the directory in which compiled modules are cached, keyed by a hash of their source and the
+ * compiler version. qak_compiler_compile_file() then loads the tokens, AST and errors of unchanged files
+ * from the cache instead of tokenizing and parsing them. The directory must exist. NULL disables the
+ * cache, which is the default. **/
+void qak_compiler_set_cache_directory(qak_compiler compiler, const char *directory);
+
+/** Registers a native function modules can call by its name. Calls are bound to the function and
+ * their arguments type checked when a module is resolved, so natives must be registered before the
+ * modules calling them are run, evaluated or transpiled. Functions of a module shadow natives of the
+ * same name. Parameters can be of any type but QakValueNothing. Returns 0 if a native of the same
+ * name was registered before or a type is not supported. **/
+int qak_compiler_register_native(qak_compiler compiler, const char *name, qak_value_type returnType, const qak_value_type *parameterTypes,
+                                 int numParameters, qak_native_function function, void *userData);
+
 qak_module qak_compiler_compile_file(qak_compiler compiler, const char *fileName);
 
 qak_module qak_compiler_compile_source(qak_compiler compiler, const char *fileName, const char *source);
@@ -243,12 +360,53 @@ void qak_module_get_token(qak_module moduleHandle, int tokenIndex, qak_token *to
 
 void qak_module_print_tokens(qak_module module);
 
+/** Returns the AST of the module, or NULL if the module could not be parsed. If the module
+ * has errors, statements and expressions that could not be parsed are QakAstError nodes. **/
 qak_ast_module *qak_module_get_ast(qak_module module);
 
 qak_ast_node *qak_module_get_ast_node(qak_module module, qak_ast_node_index nodeIndex);
 
+qak_ast_node *qak_module_get_ast_list_node(qak_module module, qak_ast_node_list *list, int index);
+
 void qak_module_print_ast(qak_module module);
 
+int qak_module_get_num_string_literals(qak_module module);
+
+/** Gets the decoded string literal. Returns 0 if the index is out of range, 1 otherwise. **/
+int qak_module_get_string_literal(qak_module module, int stringIndex, qak_string *string);
+
+/** Resolves, type checks and compiles the module to bytecode on first use, then runs its
+ * statements. The value returned by the statements is stored in result, which is of type
+ * QakValueNothing if they did not return a value. Returns 0 if compiling or running the
+ * module failed, the errors are added to the module's errors. **/
+int qak_module_run(qak_module module, qak_value *result);
+
+/** Like qak_module_run(), but evaluates the module by walking its AST instead of compiling
+ * it to bytecode. Slower, but available without a compile step, e.g. to preview results, and
+ * the reference the results of qak_module_run() are tested against. **/
+int qak_module_eval(qak_module module, qak_value *result);
+
+/** Resolves and type checks the module on first use, then writes it as a C99 source file with a
+ * main() that runs the module's statements and prints its variables and result. Returns 0 if the
+ * module has errors or the file could not be written, the errors are added to the module's errors. **/
+int qak_module_transpile(qak_module module, const char *fileName);
+
+/** Resolves, type checks and lays out the value types of the module on first use, then returns the
+ * number of value types it declares, or 0 if the module has errors. Types are indexed in the order of
+ * their declaration. **/
+int qak_module_get_num_types(qak_module module);
+
+/** Returns the index of the value type with the given name, or -1 if the module declares no such type or has errors. **/
+int qak_module_find_type(qak_module module, const char *name);
+
+/** Gets the layout of the type. Returns 0 if the module has errors or the index is out of range, 1 otherwise. **/
+int qak_module_get_type_layout(qak_module module, int typeIndex, qak_type_layout *layout);
+
+/** Gets the layout of a field of the type. Fields are indexed in the order of their declaration, which
+ * is not necessarily the order of their offsets. Returns 0 if the module has errors or an index is out
+ * of range, 1 otherwise. **/
+int qak_module_get_field_layout(qak_module module, int typeIndex, int fieldIndex, qak_field_layout *layout);
+
 #ifdef WASM
 void qak_print_struct_offsets();
 #endif
@@ -0,0 +1,275 @@
+#include "resolver.h"
+#include "visitor.h"
+
+using namespace qak;
+
+using namespace qak::ast;
+
+/* Accepts the name declared by the same token text, see HashIndex::find(). */
+struct Resolver::IsName {
+    ModuleTokens &tokens;
+    Token &name;
+
+    IsName(ModuleTokens &tokens, Token &name) : tokens(tokens), name(name) {}
+
+    QAK_FORCE_INLINE bool operator()(Name &entry) const {
+        Token &other = tokens[entry.token];
+        return name.length() == other.length() && memcmp(name.source.data + name.start, other.source.data + other.start, name.length()) == 0;
+    }
+};
+
+/* What is done with the node of a work item, see Resolver::resolveStatements(). */
+enum Step {
+    // The names in the node and its children are resolved.
+    StepResolve,
+
+    // The initializer of the variable is resolved, the variable is declared.
+    StepDeclare,
+
+    // The statements of a block follow or were resolved.
+    StepBeginBlock,
+    StepEndBlock
+};
+
+/* Pushes the children of a node onto the work stack. */
+struct Resolver::WorkPusher {
+    Array<Work> &work;
+
+    WorkPusher(Array<Work> &work) : work(work) {}
+
+    QAK_FORCE_INLINE void operator()(AstNode *node) {
+        work.add(Work(node, StepResolve));
+    }
+};
+
+int32_t Resolver::findName(uint32_t token, bool add) {
+    Token &name = _module->tokens[token];
+    uint32_t hash = hashBytes(name.source.data + name.start, name.length());
+    if (add) _nameTable.reserve(_names);
+    size_t slot;
+    int32_t index = _nameTable.find(_names, hash, IsName(_module->tokens, name), slot);
+    if (index >= 0 || !add) return index;
+
+    index = (int32_t) _names.size();
+    _nameTable.set(slot, index);
+    _names.add(Name(hash, token));
+    return index;
+}
+
+int32_t Resolver::lookup(uint32_t name) {
+    int32_t index = findName(name, false);
+    if (index < 0) return -1;
+    int32_t entry = _names[index].scopeEntry;
+    return entry < 0 ? -1 : (int32_t) _scope[entry].symbol;
+}
+
+int32_t Resolver::declare(uint32_t name, SymbolType type, AstNode *declaration, uint32_t slot) {
+    uint32_t index = (uint32_t) findName(name, true);
+    int32_t shadowed = _names[index].scopeEntry;
+    if (shadowed >= (int32_t) _blockStarts[_blockStarts.size() - 1]) {
+        Token &token = _module->tokens[name];
+        _errors->add(token, "Duplicate declaration of '%.*s'.", (int) token.length(), (const char *) token.source.data + token.start);
+        return -1;
+    }
+
+    uint32_t symbol = (uint32_t) _symbols.size();
+    _symbols.add(Symbol(type, declaration, slot));
+    _names[index].scopeEntry = (int32_t) _scope.size();
+    _scope.add(ScopeEntry(index, symbol, shadowed));
+    return (int32_t) symbol;
+}
+
+void Resolver::beginBlock() {
+    _blockStarts.add((uint32_t) _scope.size());
+}
+
+void Resolver::endBlock() {
+    // The slots of the block's local variables are reused by the blocks that follow it.
+    uint32_t start = _blockStarts[_blockStarts.size() - 1];
+    _blockStarts.removeAt(_blockStarts.size() - 1);
+    while (_scope.size() > start) {
+        ScopeEntry &entry = _scope[_scope.size() - 1];
+        if (_symbols[entry.symbol].type == SymbolLocalVariable) _numSlots--;
+        _names[entry.name].scopeEntry = entry.shadowed;
+        _scope.removeAt(_scope.size() - 1);
+    }
+}
+
+/* Pushes the statements of a block onto the work stack, between the work items beginning and ending the block. */
+void Resolver::pushBlock(FixedArray<Statement *> &statements) {
+    _work.add(Work(nullptr, StepEndBlock));
+    for (size_t i = statements.size(); i > 0; i--) _work.add(Work(statements[i - 1], StepResolve));
+    _work.add(Work(nullptr, StepBeginBlock));
+}
+
+/* Resolves the statements in the current block. Work items are popped from the top of the work
+ * stack, so nodes push their children in reverse order to resolve them in source order. */
+void Resolver::resolveStatements(FixedArray<Statement *> &statements) {
+    _work.clear();
+    for (size_t i = statements.size(); i > 0; i--) _work.add(Work(statements[i - 1], StepResolve));
+    while (_work.size() > 0) {
+        Work work = _work[_work.size() - 1];
+        _work.removeAt(_work.size() - 1);
+        switch (work.step) {
+            case StepResolve:
+                resolveNode(work.node);
+                break;
+            case StepDeclare:
+                declareVariable(static_cast<Variable *>(work.node));
+                break;
+            case StepBeginBlock:
+                beginBlock();
+                break;
+            case StepEndBlock:
+                endBlock();
+                break;
+        }
+    }
+}
+
+/* Resolves the names of the node, or pushes the work items resolving them. Blocks and variable
+ * declarations open scopes and declare symbols, all other nodes only resolve their children. */
+void Resolver::resolveNode(AstNode *node) {
+    switch (node->astType) {
+        case AstVariable: {
+            // The initializer can not refer to the variable itself, so it is resolved first.
+            Variable *variable = static_cast<Variable *>(node);
+            _work.add(Work(variable, StepDeclare));
+            if (variable->initializerExpression) _work.add(Work(variable->initializerExpression, StepResolve));
+            break;
+        }
+        case AstVariableAccess:
+            resolveAccess(static_cast<VariableAccess *>(node), "Unknown variable '%.*s'.");
+            break;
+        case AstFunctionCall: {
+            FunctionCall *call = static_cast<FunctionCall *>(node);
+            for (size_t i = call->arguments.size(); i > 0; i--) _work.add(Work(call->arguments[i - 1], StepResolve));
+            if (call->variableAccess->astType == AstVariableAccess) resolveCall(static_cast<VariableAccess *>(call->variableAccess));
+            else _work.add(Work(call->variableAccess, StepResolve));
+            break;
+        }
+        case AstWhile: {
+            While *whileNode = static_cast<While *>(node);
+            pushBlock(whileNode->statements);
+            _work.add(Work(whileNode->condition, StepResolve));
+            break;
+        }
+        case AstIf: {
+            If *ifNode = static_cast<If *>(node);
+            pushBlock(ifNode->falseBlock);
+            pushBlock(ifNode->trueBlock);
+            _work.add(Work(ifNode->condition, StepResolve));
+            break;
+        }
+        default: {
+            // Children are pushed in source order, then reversed so the first child is on top.
+            WorkPusher pusher(_work);
+            size_t first = _work.size();
+            forEachChild(node, pusher);
+            for (size_t i = first, j = _work.size(); i + 1 < j; i++, j--) {
+                Work tmp = _work[i];
+                _work[i] = _work[j - 1];
+                _work[j - 1] = tmp;
+            }
+            break;
+        }
+    }
+}
+
+void Resolver::declareVariable(Variable *variable) {
+    bool isModuleVariable = !_isInFunction && _blockStarts.size() == 1;
+    uint32_t slot = isModuleVariable ? _numModuleVariables : _numSlots;
+    variable->symbol = declare(variable->name, isModuleVariable ? SymbolModuleVariable : SymbolLocalVariable, variable, slot);
+    if (variable->symbol < 0) return;
+
+    if (isModuleVariable) {
+        _numModuleVariables++;
+    } else {
+        _numSlots++;
+        if (_numSlots > _maxSlots) _maxSlots = _numSlots;
+    }
+}
+
+void Resolver::resolveAccess(VariableAccess *access, const char *message) {
+    access->symbol = lookup(access->firstToken);
+    if (access->symbol < 0) {
+        Token &token = _module->tokens[access->firstToken];
+        _errors->add(token, message, (int) token.length(), (const char *) token.source.data + token.start);
+    }
+}
+
+void Resolver::resolveCall(VariableAccess *access) {
+    // Natives are only looked up if no function or variable of the name is in scope.
+    access->symbol = lookup(access->firstToken);
+    if (access->symbol >= 0) return;
+
+    Token &token = _module->tokens[access->firstToken];
+    int32_t native = _natives ? _natives->find(token.source.data + token.start, token.length()) : -1;
+    if (native < 0) {
+        _errors->add(token, "Unknown function '%.*s'.", (int) token.length(), (const char *) token.source.data + token.start);
+        return;
+    }
+    if (_nativeSymbols[native] < 0) {
+        _nativeSymbols[native] = (int32_t) _symbols.size();
+        _symbols.add(Symbol(SymbolNative, nullptr, (uint32_t) native));
+    }
+    access->symbol = _nativeSymbols[native];
+}
+
+void Resolver::resolveFunction(Function *function) {
+    if (!function->isBodyParsed) return;
+
+    // Parameters take the first slots of the frame and share a block with the function's statements.
+    _isInFunction = true;
+    _numSlots = 0;
+    _maxSlots = 0;
+    beginBlock();
+    for (size_t i = 0; i < function->parameters.size(); i++) {
+        Parameter *parameter = function->parameters[i];
+        parameter->symbol = declare(parameter->firstToken, SymbolParameter, parameter, _numSlots);
+        if (parameter->symbol >= 0) _numSlots++;
+    }
+    _maxSlots = _numSlots;
+    resolveStatements(function->statements);
+    endBlock();
+    function->numSlots = _maxSlots;
+}
+
+bool Resolver::resolve(Module *module, Errors &errors, NativeFunctions *natives) {
+    size_t numErrors = errors.getErrors().size();
+    _module = module;
+    _errors = &errors;
+    _natives = natives;
+    _scope.clear();
+    _names.clear();
+    _nameTable.clear();
+    _blockStarts.clear();
+    _symbols.clear();
+    _nativeSymbols.clear();
+    if (natives) _nativeSymbols.setSize(natives->size(), -1);
+    module->natives = natives;
+
+    // Functions can be called before they are declared, so they are declared first.
+    beginBlock();
+    FixedArray<Function *> &functions = module->functions;
+    for (size_t i = 0; i < functions.size(); i++) functions[i]->symbol = declare(functions[i]->name, SymbolFunction, functions[i], (uint32_t) i);
+
+    // Module variables are declared by the statements, so statements only see the variables declared
+    // before them. The variables declared in blocks of the statements take the slots after them.
+    _isInFunction = false;
+    _numModuleVariables = 0;
+    _numSlots = (uint32_t) module->variables.size();
+    _maxSlots = _numSlots;
+    resolveStatements(module->statements);
+    module->numSlots = _maxSlots;
+
+    // All module variables are declared now and visible in all functions.
+    for (size_t i = 0; i < functions.size(); i++) resolveFunction(functions[i]);
+    endBlock();
+
+    module->symbols.set(_symbols);
+    _module = nullptr;
+    _errors = nullptr;
+    _natives = nullptr;
+    return errors.getErrors().size() == numErrors;
+}
@@ -0,0 +1,126 @@
+#ifndef QAK_RESOLVER_H
+#define QAK_RESOLVER_H
+
+#include "natives.h"
+
+namespace qak {
+    /* Binds the names of a module to the variables, parameters and functions they refer to, see
+     * ast::Symbol. Functions and module variables are visible in all functions. Module statements
+     * can call all functions, but only access module variables declared before them. Variables
+     * declared in a block are visible from their declaration to the end of the block. Names may
+     * shadow the names of enclosing blocks, but not names declared in the same block.
+     *
+     * Calls of names that are not in scope are bound to the native function of the same name,
+     * see NativeFunctions. Each native called by the module gets a single symbol.
+     *
+     * The symbols in scope are kept on a single stack, innermost last. Each name has an entry in a
+     * hash table, which references the innermost symbol of the name on the stack. Symbols reference
+     * the symbol of the same name they shadow, which the name's entry references again once the
+     * block of the symbol ends.
+     *
+     * Statements and expressions are resolved with an explicit work stack instead of recursion, so
+     * deeply nested expressions, like long chains of binary operations, can not overflow the native
+     * stack. */
+    class Resolver {
+    private:
+        /* A symbol on the scope stack. shadowed is the index of the entry of the symbol of the same
+         * name it shadows, or -1. */
+        struct ScopeEntry {
+            uint32_t name;
+            uint32_t symbol;
+            int32_t shadowed;
+
+            ScopeEntry(uint32_t name, uint32_t symbol, int32_t shadowed) : name(name), symbol(symbol), shadowed(shadowed) {}
+        };
+
+        /* A name declared in the module. scopeEntry is the index of the innermost entry of the name on
+         * the scope stack, or -1 if the name is not in scope. The hash of the name is compared before
+         * the name itself. */
+        struct Name {
+            uint32_t hash;
+            uint32_t token;
+            int32_t scopeEntry;
+
+            Name(uint32_t hash, uint32_t token) : hash(hash), token(token), scopeEntry(-1) {}
+        };
+
+        /* A node to resolve, or the variable to declare or block to begin or end once the work
+         * items above it are done. */
+        struct Work {
+            ast::AstNode *node;
+            uint32_t step;
+
+            Work(ast::AstNode *node, uint32_t step) : node(node), step(step) {}
+        };
+
+        struct WorkPusher;
+
+        struct IsName;
+
+        Array<ScopeEntry> _scope;
+        Array<Name> _names;
+
+        /* The indices of _names by their hashes. */
+        HashIndex<Name> _nameTable;
+
+        /* The index of the first entry of each open block on the scope stack. */
+        Array<uint32_t> _blockStarts;
+        Array<ast::Symbol> _symbols;
+        Array<Work> _work;
+
+        /* The symbol of each native by its index, -1 if the module did not call it yet. */
+        Array<int32_t> _nativeSymbols;
+
+        // Set on each call to resolve.
+        ast::Module *_module;
+        Errors *_errors;
+        NativeFunctions *_natives;
+        bool _isInFunction;
+        uint32_t _numModuleVariables;
+
+        /* The number of slots used by the variables in scope and the maximum number of slots
+         * used so far by the function or module statements being resolved. */
+        uint32_t _numSlots;
+        uint32_t _maxSlots;
+
+        /* Returns the index of the name of the token in _names. The name is added if add is true,
+         * otherwise -1 is returned if the module declares no such name. */
+        int32_t findName(uint32_t token, bool add);
+
+        int32_t lookup(uint32_t name);
+
+        int32_t declare(uint32_t name, ast::SymbolType type, ast::AstNode *declaration, uint32_t slot);
+
+        void beginBlock();
+
+        void endBlock();
+
+        void pushBlock(FixedArray<ast::Statement *> &statements);
+
+        void resolveStatements(FixedArray<ast::Statement *> &statements);
+
+        void resolveNode(ast::AstNode *node);
+
+        void declareVariable(ast::Variable *variable);
+
+        void resolveAccess(ast::VariableAccess *access, const char *message);
+
+        void resolveCall(ast::VariableAccess *access);
+
+        void resolveFunction(ast::Function *function);
+
+    public:
+        Resolver(HeapAllocator &mem) : _scope(mem), _names(mem), _nameTable(mem), _blockStarts(mem), _symbols(mem), _work(mem), _nativeSymbols(mem),
+                                       _module(nullptr), _errors(nullptr), _natives(nullptr), _isInFunction(false), _numModuleVariables(0),
+                                       _numSlots(0), _maxSlots(0) {}
+
+        /* Resolves the names of the module and stores its symbols in Module::symbols. Unknown and
+         * duplicate names are reported in the errors. Returns false if there were errors. Functions
+         * whose bodies were skipped by the parser are not resolved, see Parser::setLazyFunctionBodies().
+         * A module that was reparsed has to be resolved again. The natives, if given, are stored in
+         * Module::natives, and must have been added with the table the module is type checked with. */
+        bool resolve(ast::Module *module, Errors &errors, NativeFunctions *natives = nullptr);
+    };
+}
+
+#endif //QAK_RESOLVER_H
@@ -96,7 +96,8 @@ namespace qak {
         }
 
         /* Creates a new Source with the given file name and source code. The name and
-         * source code are copied defensively.*/
+         * source code are copied defensively. The null terminator of the source code is
+         * copied as well, but is not part of the Source's data. */
         static Source *fromMemory(HeapAllocator &mem, const char *fileName, const char *sourceCode) {
             size_t dataLength = strlen(sourceCode) + 1;
             uint8_t *data = mem.alloc<uint8_t>(dataLength, QAK_SRC_LOC);
@@ -105,7 +106,7 @@ namespace qak {
             size_t fileNameLength = strlen(fileName) + 1;
             char *fileNameCopy = mem.alloc<char>(fileNameLength, QAK_SRC_LOC);
             memcpy(fileNameCopy, fileName, fileNameLength);
-            Source *source = mem.allocObject<Source>(QAK_SRC_LOC, mem, fileNameCopy, data, dataLength);
+            Source *source = mem.allocObject<Source>(QAK_SRC_LOC, mem, fileNameCopy, data, dataLength - 1);
             return source;
         }
     };
@@ -0,0 +1,1594 @@
+#include <cstdio>
+#include <cstdarg>
+#include "ssa.h"
+#include "hash.h"
+#include "io.h"
+#include "visitor.h"
+
+using namespace qak;
+
+using namespace qak::ast;
+
+using namespace qak::ssa;
+
+/* Loads and stores of local variables, only used while building, see SsaBuilder. The variable's
+ * index is the immediate, a store's value its operand. */
+#define QAK_SSA_OP_LOAD OpLast
+#define QAK_SSA_OP_STORE (OpLast + 1)
+
+#define QAK_TOKEN_TEXT(token) (int) (token).length(), (const char *) (token).source.data + (token).start
+
+static QAK_FORCE_INLINE bool isInteger(TypeId type) {
+    return type >= TypeInt8 && type <= TypeInt64;
+}
+
+static QAK_FORCE_INLINE bool isFloat(TypeId type) {
+    return type == TypeFloat32 || type == TypeFloat64;
+}
+
+static QAK_FORCE_INLINE bool isNumeric(TypeId type) {
+    return type >= TypeInt8 && type <= TypeFloat64;
+}
+
+/* Returns the numeric type operands are widened to. Numeric types are ordered from narrowest to widest. */
+static QAK_FORCE_INLINE TypeId widen(TypeId a, TypeId b) {
+    return a > b ? a : b;
+}
+
+static bytecode::Value constantValue(Literal *literal) {
+    bytecode::Value value;
+    value.i = 0;
+    LiteralValue &decoded = literal->decodedValue;
+    switch (literal->type) {
+        case BooleanLiteral:
+            value.i = decoded.booleanValue ? 1 : 0;
+            break;
+        case ByteLiteral:
+            value.i = decoded.byteValue;
+            break;
+        case ShortLiteral:
+            value.i = decoded.shortValue;
+            break;
+        case IntegerLiteral:
+            value.i = decoded.intValue;
+            break;
+        case LongLiteral:
+            value.i = decoded.longValue;
+            break;
+        case FloatLiteral:
+            value.f = decoded.floatValue;
+            break;
+        case DoubleLiteral:
+            value.f = decoded.doubleValue;
+            break;
+        case CharacterLiteral:
+            value.i = decoded.characterValue;
+            break;
+        case StringLiteral:
+            value.i = decoded.stringIndex;
+            break;
+        default:
+            break;
+    }
+    return value;
+}
+
+/* Computes the immediate dominator of each block with the algorithm of Cooper, Harvey and Kennedy,
+ * storing it in ssa::Block::dominator. Blocks that can not be reached from the entry block are dominated
+ * by a virtual root, like the entry block: the first of them in block order that is not reached from
+ * an earlier one, e.g. the block following a return, dominates the blocks it reaches. Such blocks
+ * dominate themselves. The virtual root has the index numBlocks in dominators, which receives the
+ * immediate dominator of each block. The order receives the blocks in reverse postorder. */
+static void computeDominators(HeapAllocator &mem, ssa::Block *blocks, uint32_t numBlocks, uint32_t *predecessors, Array<uint32_t> &dominators,
+                              Array<uint32_t> &order) {
+    uint32_t root = numBlocks;
+    Array<uint32_t> postorderNumbers(mem);
+    postorderNumbers.setSize(numBlocks + 1, QAK_SSA_NONE);
+    Array<uint32_t> postorder(mem);
+    Array<uint32_t> stack(mem);
+    Array<uint32_t> isRoot(mem);
+    isRoot.setSize(numBlocks, 0);
+
+    // Depth-first search from each block that was not reached yet, successor indices are kept on the stack.
+    for (uint32_t start = 0; start < numBlocks; start++) {
+        if (postorderNumbers[start] != QAK_SSA_NONE) continue;
+        isRoot[start] = 1;
+        postorderNumbers[start] = 0;
+        stack.add(start);
+        stack.add(0);
+        while (stack.size() > 0) {
+            uint32_t block = stack[stack.size() - 2];
+            uint32_t successor = stack[stack.size() - 1];
+            if (successor < blocks[block].numSuccessors) {
+                stack[stack.size() - 1]++;
+                uint32_t next = blocks[block].successors[successor];
+                if (postorderNumbers[next] == QAK_SSA_NONE) {
+                    postorderNumbers[next] = 0;
+                    stack.add(next);
+                    stack.add(0);
+                }
+            } else {
+                postorderNumbers[block] = (uint32_t) postorder.size();
+                postorder.add(block);
+                stack.removeAt(stack.size() - 1);
+                stack.removeAt(stack.size() - 1);
+            }
+        }
+    }
+    postorderNumbers[root] = numBlocks;
+
+    dominators.clear();
+    dominators.setSize(numBlocks + 1, QAK_SSA_NONE);
+    dominators[root] = root;
+    bool isChanged = true;
+    while (isChanged) {
+        isChanged = false;
+        for (int32_t i = (int32_t) postorder.size() - 1; i >= 0; i--) {
+            uint32_t block = postorder[i];
+            uint32_t dominator = isRoot[block] ? root : QAK_SSA_NONE;
+            ssa::Block &b = blocks[block];
+            for (uint32_t j = 0; j < b.numPredecessors; j++) {
+                uint32_t other = predecessors[b.firstPredecessor + j];
+                if (dominators[other] == QAK_SSA_NONE) continue;
+                if (dominator == QAK_SSA_NONE) {
+                    dominator = other;
+                    continue;
+                }
+                while (other != dominator) {
+                    while (postorderNumbers[other] < postorderNumbers[dominator]) other = dominators[other];
+                    while (postorderNumbers[dominator] < postorderNumbers[other]) dominator = dominators[dominator];
+                }
+            }
+            if (dominators[block] != dominator) {
+                dominators[block] = dominator;
+                isChanged = true;
+            }
+        }
+    }
+
+    order.clear();
+    for (int32_t i = (int32_t) postorder.size() - 1; i >= 0; i--) order.add(postorder[i]);
+    for (uint32_t i = 0; i < numBlocks; i++) blocks[i].dominator = dominators[i] == root ? i : dominators[i];
+}
+
+/* Returns the children of each block in the dominator tree, those of block i from children[offsets[i]]
+ * to children[offsets[i + 1]]. The children of the virtual root are those of block numBlocks, see
+ * computeDominators(). Children are in block order. */
+static void dominatorTree(HeapAllocator &mem, Array<uint32_t> &dominators, Array<uint32_t> &children, Array<uint32_t> &offsets) {
+    uint32_t numBlocks = (uint32_t) dominators.size() - 1;
+    offsets.clear();
+    offsets.setSize(numBlocks + 2, 0);
+    for (uint32_t i = 0; i < numBlocks; i++) offsets[dominators[i] + 1]++;
+    for (uint32_t i = 0; i <= numBlocks; i++) offsets[i + 1] += offsets[i];
+    children.clear();
+    children.setSize(numBlocks, 0);
+    Array<uint32_t> next(mem);
+    next.addAll(offsets);
+    for (uint32_t i = 0; i < numBlocks; i++) children[next[dominators[i]]++] = i;
+}
+
+uint32_t ssa::Function::size() {
+    uint32_t size = 0;
+    for (size_t i = 0; i < blocks.size(); i++) size += blocks[i].numInstructions;
+    return size;
+}
+
+/* Builds the blocks and instructions of a function, see SsaBuilder::build(). Visiting an expression
+ * returns the instruction computing its value. Statements return QAK_SSA_NONE. */
+struct SsaBuilder::NodeBuilder : public Visitor<NodeBuilder, uint32_t> {
+    SsaBuilder &builder;
+    Module *module;
+    TypeId returnType;
+    bool isModule;
+
+    NodeBuilder(SsaBuilder &builder, TypeId returnType, bool isModule) : builder(builder), module(builder._module), returnType(returnType),
+                                                                         isModule(isModule) {}
+
+    QAK_FORCE_INLINE TypeId typeOf(Expression *expression) {
+        return module->expressionTypes[expression->id];
+    }
+
+    uint32_t addBlock() {
+        builder._blocks.add(ssa::Block());
+        return (uint32_t) builder._blocks.size() - 1;
+    }
+
+    /* Makes the block the one instructions are added to. Each block is started once. */
+    void startBlock(uint32_t block) {
+        builder._block = block;
+        builder._blocks[block].firstInstruction = (uint32_t) builder._instructions.size();
+        builder._isTerminated = false;
+    }
+
+    /* Adds an instruction to the current block. Instructions following a return start a new block,
+     * which has no predecessors. */
+    uint32_t emit(uint32_t op, TypeId type, uint32_t token, uint32_t numOperands = 0, uint32_t a = 0, uint32_t b = 0) {
+        if (builder._isTerminated) startBlock(addBlock());
+        ssa::Instruction instruction((Opcode) op, type, builder._block, (uint32_t) builder._operands.size(), numOperands, token);
+        if (numOperands > 0) builder._operands.add(a);
+        if (numOperands > 1) builder._operands.add(b);
+        builder._instructions.add(instruction);
+        builder._blocks[builder._block].numInstructions++;
+        return (uint32_t) builder._instructions.size() - 1;
+    }
+
+    uint32_t emitConstant(TypeId type, bytecode::Value value, uint32_t token) {
+        uint32_t constant = emit(OpConstant, type, token);
+        builder._instructions[constant].immediate = value;
+        return constant;
+    }
+
+    uint32_t emitImmediate(uint32_t op, TypeId type, uint32_t token, int64_t immediate, uint32_t numOperands = 0, uint32_t a = 0) {
+        uint32_t instruction = emit(op, type, token, numOperands, a);
+        builder._instructions[instruction].immediate.i = immediate;
+        return instruction;
+    }
+
+    /* Ends the current block with a jump, unless it ended with a return. */
+    void jump(uint32_t target, uint32_t token) {
+        if (builder._isTerminated) return;
+        emit(OpJump, TypeNothing, token);
+        ssa::Block &block = builder._blocks[builder._block];
+        block.successors[0] = target;
+        block.numSuccessors = 1;
+        builder._isTerminated = true;
+    }
+
+    void branch(uint32_t condition, uint32_t whenTrue, uint32_t whenFalse, uint32_t token) {
+        emit(OpBranch, TypeNothing, token, 1, condition);
+        ssa::Block &block = builder._blocks[builder._block];
+        block.successors[0] = whenTrue;
+        block.successors[1] = whenFalse;
+        block.numSuccessors = 2;
+        builder._isTerminated = true;
+    }
+
+    uint32_t addVariable(TypeId type, uint32_t initial) {
+        builder._locals.add(Local(type, initial));
+        return (uint32_t) builder._locals.size() - 1;
+    }
+
+    /* Returns the variable of a local variable or parameter symbol. */
+    uint32_t variable(int32_t symbol) {
+        if (builder._symbolVariables[symbol] < 0) {
+            builder._symbolVariables[symbol] = (int32_t) addVariable(module->symbolTypes[symbol], QAK_SSA_NONE);
+            builder._usedSymbols.add((uint32_t) symbol);
+        }
+        return (uint32_t) builder._symbolVariables[symbol];
+    }
+
+    QAK_FORCE_INLINE bool isLocal(Symbol &symbol) {
+        return symbol.type == SymbolLocalVariable || symbol.type == SymbolParameter;
+    }
+
+    uint32_t unsupported(AstNode *node, const char *message) {
+        builder._errors->add(module->span(node), message);
+        bytecode::Value zero;
+        zero.i = 0;
+        return emitConstant(TypeError, zero, node->firstToken);
+    }
+
+    /* Builds the expression and converts its value to the type, which is the expression's type or a
+     * type it can be assigned to, like BytecodeCompiler. Integer literals are converted to float constants. */
+    uint32_t buildAs(Expression *expression, TypeId type) {
+        TypeId valueType = typeOf(expression);
+        if (!isInteger(valueType) || !isFloat(type)) return visit(expression);
+
+        if (expression->astType == AstLiteral) {
+            bytecode::Value value;
+            int64_t integer = constantValue(static_cast<Literal *>(expression)).i;
+            value.f = type == TypeFloat32 ? (double) (float) integer : (double) integer;
+            return emitConstant(type, value, expression->firstToken);
+        }
+        uint32_t value = visit(expression);
+        return emit(OpToFloat, type, expression->firstToken, 1, value);
+    }
+
+    /* Builds the value stored in a variable. The value of another variable is copied. */
+    uint32_t buildStored(Expression *expression, TypeId type, uint32_t token) {
+        uint32_t value = buildAs(expression, type);
+        if (builder._instructions[value].op == QAK_SSA_OP_LOAD) return emit(OpCopy, type, token, 1, value);
+        return value;
+    }
+
+    void buildBlock(FixedArray<Statement *> &statements) {
+        for (size_t i = 0; i < statements.size(); i++) visit(statements[i]);
+    }
+
+    uint32_t visitNode(AstNode *node) {
+        return unsupported(node, "Can not build this statement.");
+    }
+
+    uint32_t visitLiteral(Literal *node) {
+        return emitConstant(typeOf(node), constantValue(node), node->firstToken);
+    }
+
+    uint32_t visitVariableAccess(VariableAccess *node) {
+        Symbol &symbol = module->symbols[node->symbol];
+        if (symbol.type == SymbolFunction) return unsupported(node, "Functions can only be called.");
+        if (symbol.type == SymbolModuleVariable) return emitImmediate(OpGetGlobal, typeOf(node), node->firstToken, symbol.slot);
+        return emitImmediate(QAK_SSA_OP_LOAD, typeOf(node), node->firstToken, variable(node->symbol));
+    }
+
+    uint32_t visitUnaryOperation(UnaryOperation *node) {
+        TokenType op = module->tokens[node->firstToken].type;
+        if (op == Plus) return visit(node->value);
+        uint32_t value = visit(node->value);
+        return emit(op == Not ? OpNot : OpNeg, typeOf(node), node->firstToken, 1, value);
+    }
+
+    uint32_t buildAssignment(BinaryOperation *node) {
+        VariableAccess *target = static_cast<VariableAccess *>(node->left);
+        Symbol &symbol = module->symbols[target->symbol];
+        TypeId type = typeOf(node->left);
+        if (isLocal(symbol)) {
+            uint32_t value = buildStored(node->right, type, node->op);
+            emitImmediate(QAK_SSA_OP_STORE, TypeNothing, node->op, variable(target->symbol), 1, value);
+            return value;
+        }
+        uint32_t value = buildAs(node->right, type);
+        emitImmediate(OpSetGlobal, TypeNothing, node->op, symbol.slot, 1, value);
+        return value;
+    }
+
+    /* Chooses the opcode and operand type of the operation. Returns an error message if the
+     * operation can not be built, nullptr otherwise. */
+    const char *prepare(BinaryOperation *node, Operation &operation) {
+        TokenType op = module->tokens[node->op].type;
+        TypeId type = typeOf(node);
+        TypeId leftType = typeOf(node->left), rightType = typeOf(node->right);
+        operation.node = node;
+        operation.operandType = type;
+        operation.isSwapped = false;
+        switch (op) {
+            case Plus:
+                if (type == TypeString) return "String concatenation is not supported.";
+                operation.opcode = OpAdd;
+                break;
+            case Minus:
+                operation.opcode = OpSub;
+                break;
+            case Asterisk:
+                operation.opcode = OpMul;
+                break;
+            case ForwardSlash:
+                operation.opcode = OpDiv;
+                break;
+            case Percentage:
+                operation.opcode = OpRem;
+                break;
+            case And:
+                operation.opcode = OpAnd;
+                break;
+            case Or:
+                operation.opcode = OpOr;
+                break;
+            case Xor:
+                operation.opcode = OpXor;
+                break;
+            default:
+                // Comparisons of numbers widen the operands, other values are compared as is.
+                operation.operandType = isNumeric(leftType) && isNumeric(rightType) ? widen(leftType, rightType) : leftType;
+                switch (op) {
+                    case Equal:
+                        operation.opcode = OpEq;
+                        break;
+                    case NotEqual:
+                        operation.opcode = OpNe;
+                        break;
+                    case Greater:
+                        operation.isSwapped = true;
+                        // Falls through.
+                    case Less:
+                        operation.opcode = OpLt;
+                        break;
+                    case GreaterEqual:
+                        operation.isSwapped = true;
+                        // Falls through.
+                    case LessEqual:
+                        operation.opcode = OpLe;
+                        break;
+                    default:
+                        return "Can not build this operator.";
+                }
+        }
+        return nullptr;
+    }
+
+    /* Chains like a + b + c nest their left operands as deep as they are long, so the operations
+     * along the left operands are built in a loop. The instructions are added in the same order as
+     * if each left operand was built with buildAs(). */
+    uint32_t visitBinaryOperation(BinaryOperation *node) {
+        if (module->tokens[node->op].type == Assignment) return buildAssignment(node);
+        Array<Operation> &operations = builder._operations;
+        size_t base = operations.size();
+        Operation operation;
+        const char *error = prepare(node, operation);
+        if (error) return unsupported(node, error);
+
+        // Collects the operations, the innermost left operand that is not one of them is built first.
+        operations.add(operation);
+        Expression *expression = node->left;
+        while (expression->astType == AstBinaryOperation) {
+            BinaryOperation *left = static_cast<BinaryOperation *>(expression);
+            if (module->tokens[left->op].type == Assignment || prepare(left, operation)) break;
+            operations.add(operation);
+            expression = left->left;
+        }
+        uint32_t left = buildAs(expression, operations[operations.size() - 1].operandType);
+
+        uint32_t result = 0;
+        while (operations.size() > base) {
+            operation = operations[operations.size() - 1];
+            operations.removeAt(operations.size() - 1);
+            BinaryOperation *current = operation.node;
+            uint32_t right = buildAs(current->right, operation.operandType);
+            TypeId type = typeOf(current);
+            if (operation.isSwapped) result = emit(operation.opcode, type, current->op, 2, right, left);
+            else result = emit(operation.opcode, type, current->op, 2, left, right);
+            left = result;
+
+            // Converts the value to the operand type of the enclosing operation, like buildAs().
+            if (operations.size() > base && isInteger(type) && isFloat(operations[operations.size() - 1].operandType))
+                left = emit(OpToFloat, operations[operations.size() - 1].operandType, current->firstToken, 1, result);
+        }
+        return result;
+    }
+
+    /* The value of a ternary operation is stored in a temporary variable by both branches, so
+     * renaming merges it with a phi. */
+    uint32_t visitTernaryOperation(TernaryOperation *node) {
+        TypeId type = typeOf(node);
+        uint32_t temporary = addVariable(type, QAK_SSA_NONE);
+        uint32_t condition = visit(node->condition);
+        uint32_t whenTrue = addBlock(), whenFalse = addBlock(), end = addBlock();
+        branch(condition, whenTrue, whenFalse, node->firstToken);
+
+        startBlock(whenTrue);
+        emitImmediate(QAK_SSA_OP_STORE, TypeNothing, node->firstToken, temporary, 1, buildAs(node->trueValue, type));
+        jump(end, node->firstToken);
+        startBlock(whenFalse);
+        emitImmediate(QAK_SSA_OP_STORE, TypeNothing, node->firstToken, temporary, 1, buildAs(node->falseValue, type));
+        jump(end, node->firstToken);
+        startBlock(end);
+        return emitImmediate(QAK_SSA_OP_LOAD, type, node->firstToken, temporary);
+    }
+
+    uint32_t visitFunctionCall(FunctionCall *node) {
+        Expression *callee = node->variableAccess;
+        if (callee->astType != AstVariableAccess) return unsupported(node, "Only functions can be called.");
+        Symbol &symbol = module->symbols[static_cast<VariableAccess *>(callee)->symbol];
+        if (symbol.type != SymbolFunction && symbol.type != SymbolNative) return unsupported(node, "Only functions can be called.");
+        uint32_t index = symbol.slot;
+
+        // The arguments are built first, as the operands of the call must be contiguous.
+        Array<uint32_t> arguments(builder._mem);
+        Type function = builder._types->get(module->symbolTypes[static_cast<VariableAccess *>(callee)->symbol]);
+        for (size_t i = 0; i < node->arguments.size(); i++) {
+            arguments.add(buildAs(node->arguments[i], builder._types->parameter(function, (uint32_t) i)));
+        }
+        uint32_t call = emitImmediate(symbol.type == SymbolNative ? OpCallNative : OpCall, typeOf(node), node->firstToken, index);
+        ssa::Instruction &instruction = builder._instructions[call];
+        instruction.firstOperand = (uint32_t) builder._operands.size();
+        instruction.numOperands = (uint32_t) arguments.size();
+        builder._operands.addAll(arguments);
+        return call;
+    }
+
+    uint32_t visitVariable(Variable *node) {
+        Symbol &symbol = module->symbols[node->symbol];
+        TypeId type = module->symbolTypes[node->symbol];
+        if (symbol.type == SymbolModuleVariable) {
+            // Globals are zero before the module's statements run.
+            if (node->initializerExpression) {
+                emitImmediate(OpSetGlobal, TypeNothing, node->name, symbol.slot, 1, buildAs(node->initializerExpression, type));
+            }
+            return QAK_SSA_NONE;
+        }
+
+        // Variables declared in loops are zeroed on each iteration.
+        uint32_t value;
+        if (node->initializerExpression) {
+            value = buildStored(node->initializerExpression, type, node->name);
+        } else {
+            bytecode::Value zero;
+            zero.i = 0;
+            value = emitConstant(type, zero, node->name);
+        }
+        emitImmediate(QAK_SSA_OP_STORE, TypeNothing, node->name, variable(node->symbol), 1, value);
+        return QAK_SSA_NONE;
+    }
+
+    uint32_t visitWhile(While *node) {
+        uint32_t header = addBlock(), body = addBlock(), exit = addBlock();
+        jump(header, node->firstToken);
+        startBlock(header);
+        branch(visit(node->condition), body, exit, node->firstToken);
+        startBlock(body);
+        buildBlock(node->statements);
+        jump(header, node->firstToken);
+        startBlock(exit);
+        return QAK_SSA_NONE;
+    }
+
+    uint32_t visitIf(If *node) {
+        uint32_t condition = visit(node->condition);
+        uint32_t whenTrue = addBlock();
+        uint32_t whenFalse = node->falseBlock.size() > 0 ? addBlock() : QAK_SSA_NONE;
+        uint32_t end = addBlock();
+        branch(condition, whenTrue, whenFalse != QAK_SSA_NONE ? whenFalse : end, node->firstToken);
+        startBlock(whenTrue);
+        buildBlock(node->trueBlock);
+        jump(end, node->firstToken);
+        if (whenFalse != QAK_SSA_NONE) {
+            startBlock(whenFalse);
+            buildBlock(node->falseBlock);
+            jump(end, node->firstToken);
+        }
+        startBlock(end);
+        return QAK_SSA_NONE;
+    }
+
+    uint32_t visitReturn(Return *node) {
+        if (!node->returnValue) {
+            emit(OpReturn, TypeNothing, node->firstToken);
+        } else {
+            // The module's statements can return values of any type.
+            TypeId type = isModule ? typeOf(node->returnValue) : returnType;
+            emit(OpReturn, type, node->firstToken, 1, buildAs(node->returnValue, type));
+        }
+        builder._isTerminated = true;
+        return QAK_SSA_NONE;
+    }
+
+    uint32_t visitError(ErrorNode *node) {
+        return unsupported(node, "Can not build a module with errors.");
+    }
+};
+
+/* A value pushed on the stack of a variable while renaming, see SsaBuilder::Renamer. */
+struct SsaDefinition {
+    uint32_t value;
+    uint32_t variable;
+    int32_t previous;
+
+    SsaDefinition(uint32_t value, uint32_t variable, int32_t previous) : value(value), variable(variable), previous(previous) {}
+};
+
+/* Places phis and replaces loads and stores by the values stored, see SsaBuilder. */
+struct SsaBuilder::Renamer {
+    SsaBuilder &builder;
+    HeapAllocator &mem;
+    uint32_t numBlocks;
+    Array<uint32_t> dominators;
+    Array<uint32_t> order;
+
+    /* The predecessors of each block, see ssa::Block::firstPredecessor. */
+    Array<uint32_t> predecessors;
+
+    /* The phis of block i, from phis[phiOffsets[i]] to phis[phiOffsets[i + 1]]. */
+    Array<uint32_t> phis;
+    Array<uint32_t> phiOffsets;
+
+    /* The value each load is replaced by. */
+    Array<uint32_t> replacements;
+
+    /* The stacks of the variables' values, linked through SsaDefinition::previous from top. */
+    Array<SsaDefinition> definitions;
+    Array<int32_t> top;
+
+    /* The zero constants of each primitive type, added to the entry block as needed. */
+    Array<uint32_t> zeros;
+    Array<uint32_t> entryZeros;
+
+    Renamer(SsaBuilder &builder) : builder(builder), mem(builder._mem), numBlocks((uint32_t) builder._blocks.size()), dominators(mem),
+                                   order(mem), predecessors(mem), phis(mem), phiOffsets(mem), replacements(mem), definitions(mem), top(mem),
+                                   zeros(mem), entryZeros(mem) {}
+
+    void computePredecessors() {
+        Array<ssa::Block> &blocks = builder._blocks;
+        for (uint32_t i = 0; i < numBlocks; i++) {
+            for (uint32_t j = 0; j < blocks[i].numSuccessors; j++) blocks[blocks[i].successors[j]].numPredecessors++;
+        }
+        uint32_t offset = 0;
+        for (uint32_t i = 0; i < numBlocks; i++) {
+            blocks[i].firstPredecessor = offset;
+            offset += blocks[i].numPredecessors;
+            blocks[i].numPredecessors = 0;
+        }
+        predecessors.setSize(offset, 0);
+        for (uint32_t i = 0; i < numBlocks; i++) {
+            for (uint32_t j = 0; j < blocks[i].numSuccessors; j++) {
+                ssa::Block &successor = blocks[blocks[i].successors[j]];
+                predecessors[successor.firstPredecessor + successor.numPredecessors++] = i;
+            }
+        }
+    }
+
+    /* Places a phi for each variable at the iterated dominance frontier of the blocks storing it. */
+    void placePhis() {
+        Array<ssa::Block> &blocks = builder._blocks;
+        Array<ssa::Instruction> &instructions = builder._instructions;
+
+        // The dominance frontier of block i is frontiers[frontierOffsets[i]] to frontiers[frontierOffsets[i + 1]].
+        Array<uint32_t> frontierPairs(mem);
+        Array<uint32_t> lastAdded(mem);
+        lastAdded.setSize(numBlocks + 1, QAK_SSA_NONE);
+        for (uint32_t block = 0; block < numBlocks; block++) {
+            ssa::Block &b = blocks[block];
+            if (b.numPredecessors < 2) continue;
+            for (uint32_t i = 0; i < b.numPredecessors; i++) {
+                uint32_t runner = predecessors[b.firstPredecessor + i];
+                while (runner != dominators[block] && runner != numBlocks) {
+                    if (lastAdded[runner] != block) {
+                        lastAdded[runner] = block;
+                        frontierPairs.add(runner);
+                        frontierPairs.add(block);
+                    }
+                    runner = dominators[runner];
+                }
+            }
+        }
+        Array<uint32_t> frontierOffsets(mem);
+        frontierOffsets.setSize(numBlocks + 1, 0);
+        for (size_t i = 0; i < frontierPairs.size(); i += 2) frontierOffsets[frontierPairs[i] + 1]++;
+        for (uint32_t i = 0; i < numBlocks; i++) frontierOffsets[i + 1] += frontierOffsets[i];
+        Array<uint32_t> frontiers(mem);
+        frontiers.setSize(frontierPairs.size() / 2, 0);
+        Array<uint32_t> next(mem);
+        next.addAll(frontierOffsets);
+        for (size_t i = 0; i < frontierPairs.size(); i += 2) frontiers[next[frontierPairs[i]]++] = frontierPairs[i + 1];
+
+        // The blocks storing each variable, as pairs of variable and block.
+        uint32_t numVariables = (uint32_t) builder._locals.size();
+        Array<uint32_t> storeOffsets(mem);
+        storeOffsets.setSize(numVariables + 1, 0);
+        for (size_t i = 0; i < instructions.size(); i++) {
+            if (instructions[i].op == QAK_SSA_OP_STORE) storeOffsets[(uint32_t) instructions[i].immediate.i + 1]++;
+        }
+        for (uint32_t i = 0; i < numVariables; i++) storeOffsets[i + 1] += storeOffsets[i];
+        Array<uint32_t> stores(mem);
+        stores.setSize(storeOffsets[numVariables], 0);
+        next.clear();
+        next.addAll(storeOffsets);
+        for (size_t i = 0; i < instructions.size(); i++) {
+            if (instructions[i].op == QAK_SSA_OP_STORE) stores[next[(uint32_t) instructions[i].immediate.i]++] = instructions[i].block;
+        }
+
+        Array<uint32_t> phiPairs(mem);
+        Array<uint32_t> hasPhi(mem);
+        hasPhi.setSize(numBlocks, QAK_SSA_NONE);
+        Array<uint32_t> isQueued(mem);
+        isQueued.setSize(numBlocks, QAK_SSA_NONE);
+        Array<uint32_t> worklist(mem);
+        for (uint32_t variable = 0; variable < numVariables; variable++) {
+            worklist.clear();
+            for (uint32_t i = storeOffsets[variable]; i < storeOffsets[variable + 1]; i++) {
+                if (isQueued[stores[i]] == variable) continue;
+                isQueued[stores[i]] = variable;
+                worklist.add(stores[i]);
+            }
+            while (worklist.size() > 0) {
+                uint32_t block = worklist[worklist.size() - 1];
+                worklist.setSize(worklist.size() - 1, 0);
+                for (uint32_t i = frontierOffsets[block]; i < frontierOffsets[block + 1]; i++) {
+                    uint32_t frontier = frontiers[i];
+                    if (hasPhi[frontier] == variable) continue;
+                    hasPhi[frontier] = variable;
+                    ssa::Block &b = blocks[frontier];
+                    ssa::Instruction phi(OpPhi, builder._locals[variable].type, frontier, (uint32_t) builder._operands.size(), b.numPredecessors,
+                                    b.firstInstruction < instructions.size() ? instructions[b.firstInstruction].token : 0);
+                    phi.immediate.i = variable;
+                    for (uint32_t j = 0; j < b.numPredecessors; j++) builder._operands.add(QAK_SSA_NONE);
+                    instructions.add(phi);
+                    phiPairs.add(frontier);
+                    phiPairs.add((uint32_t) instructions.size() - 1);
+                    if (isQueued[frontier] != variable) {
+                        isQueued[frontier] = variable;
+                        worklist.add(frontier);
+                    }
+                }
+            }
+        }
+
+        phiOffsets.setSize(numBlocks + 1, 0);
+        for (size_t i = 0; i < phiPairs.size(); i += 2) phiOffsets[phiPairs[i] + 1]++;
+        for (uint32_t i = 0; i < numBlocks; i++) phiOffsets[i + 1] += phiOffsets[i];
+        phis.setSize(phiPairs.size() / 2, 0);
+        next.clear();
+        next.addAll(phiOffsets);
+        for (size_t i = 0; i < phiPairs.size(); i += 2) phis[next[phiPairs[i]]++] = phiPairs[i + 1];
+    }
+
+    void push(uint32_t variable, uint32_t value) {
+        definitions.add(SsaDefinition(value, variable, top[variable]));
+        top[variable] = (int32_t) definitions.size() - 1;
+    }
+
+    /* Returns the value of the variable at the current point of the walk. */
+    uint32_t current(uint32_t variable) {
+        if (top[variable] >= 0) return definitions[top[variable]].value;
+        Local &v = builder._locals[variable];
+        if (v.initial != QAK_SSA_NONE) return v.initial;
+        if (zeros[v.type] == QAK_SSA_NONE) {
+            ssa::Instruction zero(OpConstant, v.type, 0, 0, 0, builder._module->name);
+            builder._instructions.add(zero);
+            zeros[v.type] = (uint32_t) builder._instructions.size() - 1;
+            entryZeros.add(zeros[v.type]);
+        }
+        return zeros[v.type];
+    }
+
+    QAK_FORCE_INLINE uint32_t resolve(uint32_t value) {
+        return builder._instructions[value].op == QAK_SSA_OP_LOAD ? replacements[value] : value;
+    }
+
+    void renameBlock(uint32_t block) {
+        Array<ssa::Instruction> &instructions = builder._instructions;
+        Array<uint32_t> &operands = builder._operands;
+        ssa::Block &b = builder._blocks[block];
+        for (uint32_t i = phiOffsets[block]; i < phiOffsets[block + 1]; i++) push((uint32_t) instructions[phis[i]].immediate.i, phis[i]);
+        for (uint32_t id = b.firstInstruction; id < b.firstInstruction + b.numInstructions; id++) {
+            ssa::Instruction &instruction = instructions[id];
+            if (instruction.op == QAK_SSA_OP_LOAD) {
+                replacements[id] = current((uint32_t) instruction.immediate.i);
+            } else if (instruction.op == QAK_SSA_OP_STORE) {
+                push((uint32_t) instruction.immediate.i, resolve(operands[instruction.firstOperand]));
+            } else {
+                for (uint32_t j = 0; j < instruction.numOperands; j++) {
+                    operands[instruction.firstOperand + j] = resolve(operands[instruction.firstOperand + j]);
+                }
+            }
+        }
+        for (uint32_t i = 0; i < b.numSuccessors; i++) {
+            uint32_t successor = b.successors[i];
+            ssa::Block &s = builder._blocks[successor];
+            uint32_t index = 0;
+            while (predecessors[s.firstPredecessor + index] != block) index++;
+            for (uint32_t j = phiOffsets[successor]; j < phiOffsets[successor + 1]; j++) {
+                ssa::Instruction &phi = instructions[phis[j]];
+                operands[phi.firstOperand + index] = current((uint32_t) phi.immediate.i);
+            }
+        }
+    }
+
+    /* Renames the blocks in a preorder walk of the dominator tree, restoring the variables' stacks
+     * when a block's subtree is done. */
+    void rename() {
+        Array<uint32_t> children(mem);
+        Array<uint32_t> childOffsets(mem);
+        dominatorTree(mem, dominators, children, childOffsets);
+        replacements.setSize(builder._instructions.size(), QAK_SSA_NONE);
+        top.setSize(builder._locals.size(), -1);
+        zeros.setSize(QAK_NUM_PRIMITIVE_TYPES + 1, QAK_SSA_NONE);
+
+        // Entries are pairs of a block and QAK_SSA_NONE, or of a definition stack height to restore and the block.
+        Array<uint32_t> stack(mem);
+        for (uint32_t i = childOffsets[numBlocks + 1]; i > childOffsets[numBlocks]; i--) {
+            stack.add(children[i - 1]);
+            stack.add(QAK_SSA_NONE);
+        }
+        while (stack.size() > 0) {
+            uint32_t first = stack[stack.size() - 2];
+            uint32_t second = stack[stack.size() - 1];
+            stack.removeAt(stack.size() - 1);
+            stack.removeAt(stack.size() - 1);
+            if (second != QAK_SSA_NONE) {
+                while (definitions.size() > first) {
+                    SsaDefinition &definition = definitions[definitions.size() - 1];
+                    top[definition.variable] = definition.previous;
+                    definitions.setSize(definitions.size() - 1, definition);
+                }
+                continue;
+            }
+            stack.add((uint32_t) definitions.size());
+            stack.add(first);
+            renameBlock(first);
+            for (uint32_t i = childOffsets[first + 1]; i > childOffsets[first]; i--) {
+                stack.add(children[i - 1]);
+                stack.add(QAK_SSA_NONE);
+            }
+        }
+    }
+};
+
+ssa::Function *SsaBuilder::buildFunction(uint32_t name, ast::Function *function, FixedArray<Statement *> &statements, TypeId returnType,
+                                         bool isModule) {
+    _instructions.clear();
+    _operands.clear();
+    _blocks.clear();
+    _locals.clear();
+    for (size_t i = 0; i < _usedSymbols.size(); i++) _symbolVariables[_usedSymbols[i]] = -1;
+    _usedSymbols.clear();
+
+    NodeBuilder builder(*this, returnType, isModule);
+    builder.startBlock(builder.addBlock());
+    uint32_t numParameters = function ? (uint32_t) function->parameters.size() : 0;
+    for (uint32_t i = 0; i < numParameters; i++) {
+        int32_t symbol = function->parameters[i]->symbol;
+        uint32_t parameter = builder.emitImmediate(OpParameter, _module->symbolTypes[symbol], function->parameters[i]->firstToken, i);
+        _locals[builder.variable(symbol)].initial = parameter;
+    }
+    builder.buildBlock(statements);
+
+    // Functions that end without a return statement return the zero value of their return type.
+    if (!_isTerminated) {
+        if (returnType == TypeNothing) {
+            builder.emit(OpReturn, TypeNothing, name);
+        } else {
+            bytecode::Value zero;
+            zero.i = 0;
+            builder.emit(OpReturn, returnType, name, 1, builder.emitConstant(returnType, zero, name));
+        }
+    }
+
+    Renamer renamer(*this);
+    renamer.computePredecessors();
+    computeDominators(_mem, _blocks.buffer(), (uint32_t) _blocks.size(), renamer.predecessors.buffer(), renamer.dominators, renamer.order);
+    renamer.placePhis();
+    renamer.rename();
+
+    // Instructions are numbered in the order they are scheduled, without loads and stores. The zero
+    // constants of variables are scheduled after the parameters.
+    Array<uint32_t> numbers(_mem);
+    numbers.setSize(_instructions.size(), QAK_SSA_NONE);
+    Array<uint32_t> order(_mem);
+    for (uint32_t block = 0; block < _blocks.size(); block++) {
+        ssa::Block &b = _blocks[block];
+        uint32_t first = (uint32_t) order.size();
+        for (uint32_t i = renamer.phiOffsets[block]; i < renamer.phiOffsets[block + 1]; i++) order.add(renamer.phis[i]);
+        for (uint32_t id = b.firstInstruction; id < b.firstInstruction + b.numInstructions; id++) {
+            if (block == 0 && id == b.firstInstruction + numParameters) order.addAll(renamer.entryZeros);
+            uint32_t op = _instructions[id].op;
+            if (op != QAK_SSA_OP_LOAD && op != QAK_SSA_OP_STORE) order.add(id);
+        }
+        b.firstInstruction = first;
+        b.numInstructions = (uint32_t) order.size() - first;
+    }
+    for (uint32_t i = 0; i < order.size(); i++) numbers[order[i]] = i;
+
+    Array<ssa::Instruction> instructions(_mem);
+    Array<uint32_t> operands(_mem);
+    Array<uint32_t> schedule(_mem);
+    for (uint32_t i = 0; i < order.size(); i++) {
+        ssa::Instruction instruction = _instructions[order[i]];
+        uint32_t firstOperand = (uint32_t) operands.size();
+        for (uint32_t j = 0; j < instruction.numOperands; j++) operands.add(numbers[renamer.resolve(_operands[instruction.firstOperand + j])]);
+        instruction.firstOperand = firstOperand;
+        instructions.add(instruction);
+        schedule.add(i);
+    }
+
+    ssa::Function *result = _module->mem.allocObject<ssa::Function>(_module->mem, name, numParameters, returnType);
+    result->instructions.set(instructions);
+    result->operands.set(operands);
+    result->blocks.set(_blocks);
+    result->schedule.set(schedule);
+    result->predecessors.set(renamer.predecessors);
+    return result;
+}
+
+ssa::Program *SsaBuilder::build(Module *module, TypeTable &types, Errors &errors) {
+    size_t numErrors = errors.getErrors().size();
+    _module = module;
+    _types = &types;
+    _errors = &errors;
+    _symbolVariables.clear();
+    _symbolVariables.setSize(module->symbols.size(), -1);
+    _usedSymbols.clear();
+
+    ssa::Program *program = module->mem.allocObject<ssa::Program>(module);
+    Array<ssa::Function *> functions(_mem);
+    for (size_t i = 0; i < module->functions.size(); i++) {
+        ast::Function *function = module->functions[i];
+        TypeId returnType = types.get(module->symbolTypes[function->symbol]).returnType;
+        functions.add(buildFunction(function->name, function, function->statements, returnType, false));
+    }
+    program->functions.set(functions);
+    program->statements = buildFunction(module->name, nullptr, module->statements, TypeNothing, true);
+
+    _module = nullptr;
+    _types = nullptr;
+    _errors = nullptr;
+    return errors.getErrors().size() == numErrors ? program : nullptr;
+}
+
+/* Returns whether the instruction only computes a value from its operands, so instructions with the
+ * same opcode, type, immediate and operands compute the same value. */
+static QAK_FORCE_INLINE bool isPure(ssa::Instruction &instruction) {
+    switch (instruction.op) {
+        case OpConstant:
+        case OpParameter:
+        case OpCopy:
+        case OpAdd:
+        case OpSub:
+        case OpMul:
+        case OpDiv:
+        case OpRem:
+        case OpAnd:
+        case OpOr:
+        case OpXor:
+        case OpNeg:
+        case OpNot:
+        case OpToFloat:
+        case OpEq:
+        case OpNe:
+        case OpLt:
+        case OpLe:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Returns whether the instruction may fail, which integer division does if the divisor is zero. */
+static QAK_FORCE_INLINE bool mayFail(ssa::Instruction &instruction) {
+    return (instruction.op == OpDiv || instruction.op == OpRem) && !isFloat(instruction.type);
+}
+
+static QAK_FORCE_INLINE bool isCommutative(ssa::Instruction &instruction) {
+    switch (instruction.op) {
+        case OpAdd:
+        case OpMul:
+        case OpAnd:
+        case OpOr:
+        case OpXor:
+        case OpEq:
+        case OpNe:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Removes the instructions the predicate returns true for from the schedule of each block. Returns the
+ * number of instructions removed. */
+template<typename P>
+static uint32_t removeInstructions(ssa::Function *function, P &isRemoved) {
+    uint32_t numRemoved = 0;
+    for (size_t i = 0; i < function->blocks.size(); i++) {
+        ssa::Block &block = function->blocks[i];
+        uint32_t kept = 0;
+        for (uint32_t j = 0; j < block.numInstructions; j++) {
+            uint32_t id = function->schedule[block.firstInstruction + j];
+            if (isRemoved(id)) continue;
+            function->schedule[block.firstInstruction + kept++] = id;
+        }
+        numRemoved += block.numInstructions - kept;
+        block.numInstructions = kept;
+    }
+    return numRemoved;
+}
+
+/* Removes the instructions that are replaced by another value, see SsaOptimizer::_replacements. */
+struct IsReplaced {
+    Array<uint32_t> &replacements;
+
+    IsReplaced(Array<uint32_t> &replacements) : replacements(replacements) {}
+
+    bool operator()(uint32_t id) {
+        return replacements[id] != id;
+    }
+};
+
+/* Removes the instructions that are not marked. */
+struct IsUnmarked {
+    Array<uint8_t> &isMarked;
+
+    IsUnmarked(Array<uint8_t> &isMarked) : isMarked(isMarked) {}
+
+    bool operator()(uint32_t id) {
+        return !isMarked[id];
+    }
+};
+
+/* Removes the predecessor with the index from the block, along with the operands of its phis. */
+static void removePredecessor(ssa::Function *function, ssa::Block &block, uint32_t index) {
+    for (uint32_t i = index + 1; i < block.numPredecessors; i++) {
+        function->predecessors[block.firstPredecessor + i - 1] = function->predecessors[block.firstPredecessor + i];
+    }
+    block.numPredecessors--;
+    for (uint32_t i = 0; i < block.numInstructions; i++) {
+        ssa::Instruction &phi = function->instructions[function->schedule[block.firstInstruction + i]];
+        if (phi.op != OpPhi) break;
+        for (uint32_t j = index + 1; j < phi.numOperands; j++) function->operands[phi.firstOperand + j - 1] = function->operands[phi.firstOperand + j];
+        phi.numOperands--;
+    }
+}
+
+static void computeDominators(HeapAllocator &mem, ssa::Function *function) {
+    Array<uint32_t> dominators(mem);
+    Array<uint32_t> order(mem);
+    computeDominators(mem, &function->blocks[0], (uint32_t) function->blocks.size(), &function->predecessors[0], dominators, order);
+}
+
+static bool dominates(ssa::Function *function, uint32_t dominator, uint32_t block) {
+    while (true) {
+        if (block == dominator) return true;
+        uint32_t next = function->blocks[block].dominator;
+        if (next == block) return false;
+        block = next;
+    }
+}
+
+SsaOptimizer::SsaOptimizer(HeapAllocator &mem) : _mem(mem),
+                                                 _timings{PassTiming("unreachable code"), PassTiming("copy propagation"),
+                                                          PassTiming("loop invariants"), PassTiming("value numbering"), PassTiming("dead code")},
+                                                 _replacements(mem) {}
+
+uint32_t SsaOptimizer::resolve(uint32_t value) {
+    while (_replacements[value] != value) value = _replacements[value];
+    return value;
+}
+
+/* Replaces the operands of the scheduled instructions by their replacements. Returns the number of
+ * operands replaced. */
+uint32_t SsaOptimizer::replaceOperands(ssa::Function *function) {
+    uint32_t numReplaced = 0;
+    for (size_t i = 0; i < function->blocks.size(); i++) {
+        ssa::Block &block = function->blocks[i];
+        for (uint32_t j = 0; j < block.numInstructions; j++) {
+            ssa::Instruction &instruction = function->instructions[function->schedule[block.firstInstruction + j]];
+            for (uint32_t k = 0; k < instruction.numOperands; k++) {
+                uint32_t &operand = function->operands[instruction.firstOperand + k];
+                uint32_t replacement = resolve(operand);
+                if (replacement == operand) continue;
+                operand = replacement;
+                numReplaced++;
+            }
+        }
+    }
+    return numReplaced;
+}
+
+uint32_t SsaOptimizer::removeUnreachableCode(ssa::Function *function) {
+    uint32_t numChanges = 0;
+    uint32_t numBlocks = (uint32_t) function->blocks.size();
+
+    // Branches on constants become jumps.
+    for (uint32_t i = 0; i < numBlocks; i++) {
+        ssa::Block &block = function->blocks[i];
+        ssa::Instruction &terminator = function->terminator(block);
+        if (terminator.op != OpBranch) continue;
+        ssa::Instruction &condition = function->instructions[function->operand(terminator, 0)];
+        if (condition.op != OpConstant) continue;
+        uint32_t taken = block.successors[condition.immediate.i ? 0 : 1];
+        ssa::Block &other = function->blocks[block.successors[condition.immediate.i ? 1 : 0]];
+        uint32_t index = 0;
+        while (function->predecessor(other, index) != i) index++;
+        removePredecessor(function, other, index);
+        terminator.op = OpJump;
+        terminator.numOperands = 0;
+        block.successors[0] = taken;
+        block.numSuccessors = 1;
+        numChanges++;
+    }
+
+    Array<uint32_t> numbers(_mem);
+    numbers.setSize(numBlocks, QAK_SSA_NONE);
+    Array<uint32_t> worklist(_mem);
+    numbers[0] = 0;
+    worklist.add(0);
+    while (worklist.size() > 0) {
+        ssa::Block &block = function->blocks[worklist[worklist.size() - 1]];
+        worklist.setSize(worklist.size() - 1, 0);
+        for (uint32_t i = 0; i < block.numSuccessors; i++) {
+            if (numbers[block.successors[i]] != QAK_SSA_NONE) continue;
+            numbers[block.successors[i]] = 0;
+            worklist.add(block.successors[i]);
+        }
+    }
+
+    // Reachable blocks keep their order and are numbered from 0, their unreachable predecessors are removed.
+    uint32_t numReachable = 0;
+    for (uint32_t i = 0; i < numBlocks; i++) {
+        if (numbers[i] == QAK_SSA_NONE) {
+            numChanges += 1 + function->blocks[i].numInstructions;
+            continue;
+        }
+        numbers[i] = numReachable++;
+        ssa::Block &block = function->blocks[i];
+        for (uint32_t j = block.numPredecessors; j > 0; j--) {
+            if (numbers[function->predecessor(block, j - 1)] == QAK_SSA_NONE) removePredecessor(function, block, j - 1);
+        }
+    }
+    if (numReachable < numBlocks) {
+        for (uint32_t i = 0; i < numBlocks; i++) {
+            if (numbers[i] == QAK_SSA_NONE) continue;
+            ssa::Block &block = function->blocks[i];
+            for (uint32_t j = 0; j < block.numSuccessors; j++) block.successors[j] = numbers[block.successors[j]];
+            for (uint32_t j = 0; j < block.numPredecessors; j++) {
+                function->predecessors[block.firstPredecessor + j] = numbers[function->predecessor(block, j)];
+            }
+            for (uint32_t j = 0; j < block.numInstructions; j++) function->instructions[function->schedule[block.firstInstruction + j]].block = numbers[i];
+            function->blocks[numbers[i]] = block;
+        }
+        function->blocks.set(&function->blocks[0], numReachable);
+    }
+
+    // Phis of blocks left with a single predecessor copy the value of that predecessor.
+    for (uint32_t i = 0; i < numReachable; i++) {
+        ssa::Block &block = function->blocks[i];
+        if (block.numPredecessors != 1) continue;
+        for (uint32_t j = 0; j < block.numInstructions; j++) {
+            ssa::Instruction &phi = function->instructions[function->schedule[block.firstInstruction + j]];
+            if (phi.op != OpPhi) break;
+            phi.op = OpCopy;
+            numChanges++;
+        }
+    }
+
+    computeDominators(_mem, function);
+    return numChanges;
+}
+
+uint32_t SsaOptimizer::propagateCopies(ssa::Function *function) {
+    for (size_t i = 0; i < function->blocks.size(); i++) {
+        ssa::Block &block = function->blocks[i];
+        for (uint32_t j = 0; j < block.numInstructions; j++) {
+            uint32_t id = function->schedule[block.firstInstruction + j];
+            ssa::Instruction &instruction = function->instructions[id];
+            if (instruction.op == OpCopy) _replacements[id] = function->operand(instruction, 0);
+        }
+    }
+
+    // Replacing a phi can make other phis trivial, e.g. the phis of nested loops.
+    bool isChanged = true;
+    while (isChanged) {
+        isChanged = false;
+        for (size_t i = 0; i < function->blocks.size(); i++) {
+            ssa::Block &block = function->blocks[i];
+            for (uint32_t j = 0; j < block.numInstructions; j++) {
+                uint32_t id = function->schedule[block.firstInstruction + j];
+                ssa::Instruction &phi = function->instructions[id];
+                if (phi.op != OpPhi) break;
+                if (_replacements[id] != id) continue;
+                uint32_t value = QAK_SSA_NONE;
+                bool isTrivial = true;
+                for (uint32_t k = 0; k < phi.numOperands; k++) {
+                    uint32_t operand = resolve(function->operand(phi, k));
+                    if (operand == id || operand == value) continue;
+                    if (value != QAK_SSA_NONE) {
+                        isTrivial = false;
+                        break;
+                    }
+                    value = operand;
+                }
+                if (!isTrivial || value == QAK_SSA_NONE) continue;
+                _replacements[id] = value;
+                isChanged = true;
+            }
+        }
+    }
+
+    replaceOperands(function);
+    IsReplaced isReplaced(_replacements);
+    return removeInstructions(function, isReplaced);
+}
+
+/* The instructions of a block's dominators that compute a value, by their opcode, type, immediate and
+ * operands. Removing entries in the reverse order they were added keeps the probe sequences of the
+ * remaining entries intact, so leaving a block of the dominator tree removes its entries. */
+struct ValueTable {
+    ssa::Function *function;
+    Array<uint32_t> entries;
+    uint32_t mask;
+
+    ValueTable(HeapAllocator &mem, ssa::Function *function) : function(function), entries(mem), mask(0) {
+        uint32_t size = 16;
+        while (size < function->instructions.size() * 2) size *= 2;
+        entries.setSize(size, QAK_SSA_NONE);
+        mask = size - 1;
+    }
+
+    /* Returns the operand with the index, with the operands of commutative instructions ordered. */
+    uint32_t operand(ssa::Instruction &instruction, uint32_t index) {
+        if (instruction.numOperands == 2 && isCommutative(instruction)) {
+            uint32_t a = function->operand(instruction, 0), b = function->operand(instruction, 1);
+            return (index == 0) == (a < b) ? a : b;
+        }
+        return function->operand(instruction, index);
+    }
+
+    uint32_t hash(ssa::Instruction &instruction) {
+        uint64_t hash = instruction.op * 31u + instruction.type;
+        hash = hash * 0x9e3779b97f4a7c15ull + (uint64_t) instruction.immediate.i;
+        for (uint32_t i = 0; i < instruction.numOperands; i++) hash = hash * 0x9e3779b97f4a7c15ull + operand(instruction, i);
+        return (uint32_t) mixHash(hash);
+    }
+
+    bool isEqual(ssa::Instruction &a, ssa::Instruction &b) {
+        if (a.op != b.op || a.type != b.type || a.immediate.i != b.immediate.i || a.numOperands != b.numOperands) return false;
+        for (uint32_t i = 0; i < a.numOperands; i++) {
+            if (operand(a, i) != operand(b, i)) return false;
+        }
+        return true;
+    }
+
+    /* Returns the equal instruction in the table, or adds the instruction and returns QAK_SSA_NONE.
+     * The index of the entry added is stored in slot. */
+    uint32_t findOrAdd(uint32_t id, uint32_t &slot) {
+        ssa::Instruction &instruction = function->instructions[id];
+        slot = hash(instruction) & mask;
+        while (entries[slot] != QAK_SSA_NONE) {
+            if (isEqual(function->instructions[entries[slot]], instruction)) return entries[slot];
+            slot = (slot + 1) & mask;
+        }
+        entries[slot] = id;
+        return QAK_SSA_NONE;
+    }
+};
+
+uint32_t SsaOptimizer::numberValues(ssa::Function *function) {
+    uint32_t numBlocks = (uint32_t) function->blocks.size();
+    Array<uint32_t> dominators(_mem);
+    dominators.setSize(numBlocks + 1, numBlocks);
+    for (uint32_t i = 0; i < numBlocks; i++) {
+        if (function->blocks[i].dominator != i) dominators[i] = function->blocks[i].dominator;
+    }
+    Array<uint32_t> children(_mem);
+    Array<uint32_t> childOffsets(_mem);
+    dominatorTree(_mem, dominators, children, childOffsets);
+
+    ValueTable table(_mem, function);
+    Array<uint32_t> added(_mem);
+
+    // Entries are pairs of a block and QAK_SSA_NONE, or of the number of table entries to keep and the block.
+    Array<uint32_t> stack(_mem);
+    for (uint32_t i = childOffsets[numBlocks + 1]; i > childOffsets[numBlocks]; i--) {
+        stack.add(children[i - 1]);
+        stack.add(QAK_SSA_NONE);
+    }
+    while (stack.size() > 0) {
+        uint32_t first = stack[stack.size() - 2];
+        uint32_t second = stack[stack.size() - 1];
+        stack.removeAt(stack.size() - 1);
+        stack.removeAt(stack.size() - 1);
+        if (second != QAK_SSA_NONE) {
+            while (added.size() > first) {
+                table.entries[added[added.size() - 1]] = QAK_SSA_NONE;
+                added.setSize(added.size() - 1, 0);
+            }
+            continue;
+        }
+        stack.add((uint32_t) added.size());
+        stack.add(first);
+
+        // The operands of the block's instructions, other than phis, are defined in dominators, which were numbered.
+        ssa::Block &block = function->blocks[first];
+        for (uint32_t i = 0; i < block.numInstructions; i++) {
+            uint32_t id = function->schedule[block.firstInstruction + i];
+            ssa::Instruction &instruction = function->instructions[id];
+            if (instruction.op == OpPhi) continue;
+            for (uint32_t j = 0; j < instruction.numOperands; j++) {
+                uint32_t &operand = function->operands[instruction.firstOperand + j];
+                operand = resolve(operand);
+            }
+            if (!isPure(instruction)) continue;
+            uint32_t slot;
+            uint32_t equal = table.findOrAdd(id, slot);
+            if (equal != QAK_SSA_NONE) _replacements[id] = equal;
+            else added.add(slot);
+        }
+        for (uint32_t i = childOffsets[first + 1]; i > childOffsets[first]; i--) {
+            stack.add(children[i - 1]);
+            stack.add(QAK_SSA_NONE);
+        }
+    }
+
+    replaceOperands(function);
+    IsReplaced isReplaced(_replacements);
+    return removeInstructions(function, isReplaced);
+}
+
+uint32_t SsaOptimizer::hoistLoopInvariants(ssa::Function *function) {
+    uint32_t numBlocks = (uint32_t) function->blocks.size();
+    Array<uint32_t> dominators(_mem);
+    Array<uint32_t> order(_mem);
+    computeDominators(_mem, &function->blocks[0], numBlocks, &function->predecessors[0], dominators, order);
+
+    Array<uint32_t> loopOf(_mem);
+    loopOf.setSize(numBlocks, QAK_SSA_NONE);
+    Array<uint32_t> loopBlocks(_mem);
+    Array<uint32_t> storedGlobals(_mem);
+    Array<uint32_t> worklist(_mem);
+    Array<uint32_t> hoisted(_mem);
+
+    // Outer loops come first in reverse postorder, so each instruction is moved at most once, to the
+    // block before the outermost loop it is invariant in.
+    for (uint32_t i = 0; i < order.size(); i++) {
+        uint32_t header = order[i];
+        ssa::Block &h = function->blocks[header];
+        loopBlocks.clear();
+        loopBlocks.add(header);
+        loopOf[header] = header;
+        for (uint32_t j = 0; j < h.numPredecessors; j++) {
+            uint32_t latch = function->predecessor(h, j);
+            if (!dominates(function, header, latch)) continue;
+            worklist.add(latch);
+            while (worklist.size() > 0) {
+                uint32_t block = worklist[worklist.size() - 1];
+                worklist.setSize(worklist.size() - 1, 0);
+                if (loopOf[block] == header) continue;
+                loopOf[block] = header;
+                loopBlocks.add(block);
+                ssa::Block &b = function->blocks[block];
+                for (uint32_t k = 0; k < b.numPredecessors; k++) worklist.add(function->predecessor(b, k));
+            }
+        }
+
+        // The loop is entered from the block before it, which is its only predecessor outside of the loop.
+        bool hasBackEdge = false;
+        uint32_t preheader = QAK_SSA_NONE;
+        for (uint32_t j = 0; j < h.numPredecessors; j++) {
+            uint32_t predecessor = function->predecessor(h, j);
+            if (loopOf[predecessor] == header) {
+                hasBackEdge = true;
+            } else {
+                preheader = preheader == QAK_SSA_NONE ? predecessor : numBlocks;
+            }
+        }
+
+        // Instructions are moved before the jump to the header, so the block before the loop must end with it.
+        bool isMovable = hasBackEdge && preheader < numBlocks && function->terminator(function->blocks[preheader]).op == OpJump;
+        if (isMovable) {
+            bool hasCalls = false;
+            storedGlobals.clear();
+            for (size_t j = 0; j < loopBlocks.size(); j++) {
+                ssa::Block &b = function->blocks[loopBlocks[j]];
+                for (uint32_t k = 0; k < b.numInstructions; k++) {
+                    ssa::Instruction &instruction = function->instructions[function->schedule[b.firstInstruction + k]];
+                    if (instruction.op == OpCall) hasCalls = true;
+                    if (instruction.op == OpSetGlobal) storedGlobals.add((uint32_t) instruction.immediate.i);
+                }
+            }
+
+            // Blocks are visited in reverse postorder, so operands are visited before the instructions using them.
+            for (uint32_t j = i; j < order.size(); j++) {
+                uint32_t blockIndex = order[j];
+                if (loopOf[blockIndex] != header) continue;
+                ssa::Block &b = function->blocks[blockIndex];
+                for (uint32_t k = 0; k < b.numInstructions; k++) {
+                    uint32_t id = function->schedule[b.firstInstruction + k];
+                    ssa::Instruction &instruction = function->instructions[id];
+                    if (instruction.block != blockIndex) continue;
+                    if (instruction.op == OpGetGlobal) {
+                        if (hasCalls) continue;
+                        bool isStored = false;
+                        for (size_t l = 0; l < storedGlobals.size(); l++) isStored |= storedGlobals[l] == (uint32_t) instruction.immediate.i;
+                        if (isStored) continue;
+                    } else if (!isPure(instruction) || mayFail(instruction) || instruction.op == OpParameter) {
+                        continue;
+                    }
+                    bool isInvariant = true;
+                    for (uint32_t l = 0; l < instruction.numOperands && isInvariant; l++) {
+                        isInvariant = loopOf[function->instructions[function->operand(instruction, l)].block] != header;
+                    }
+                    if (!isInvariant) continue;
+                    instruction.block = preheader;
+                    hoisted.add(id);
+                }
+            }
+        }
+        for (size_t j = 0; j < loopBlocks.size(); j++) loopOf[loopBlocks[j]] = QAK_SSA_NONE;
+    }
+    if (hoisted.size() == 0) return 0;
+
+    // The moved instructions are scheduled before the terminators of the blocks they were moved to, in the order they were moved.
+    Array<uint32_t> schedule(_mem);
+    for (uint32_t i = 0; i < numBlocks; i++) {
+        ssa::Block &block = function->blocks[i];
+        uint32_t first = (uint32_t) schedule.size();
+        for (uint32_t j = 0; j + 1 < block.numInstructions; j++) {
+            uint32_t id = function->schedule[block.firstInstruction + j];
+            if (function->instructions[id].block == i) schedule.add(id);
+        }
+        for (size_t j = 0; j < hoisted.size(); j++) {
+            if (function->instructions[hoisted[j]].block == i) schedule.add(hoisted[j]);
+        }
+        schedule.add(function->schedule[block.firstInstruction + block.numInstructions - 1]);
+        block.firstInstruction = first;
+        block.numInstructions = (uint32_t) schedule.size() - first;
+    }
+    function->schedule.set(schedule);
+    return (uint32_t) hoisted.size();
+}
+
+uint32_t SsaOptimizer::removeDeadCode(ssa::Function *function) {
+    Array<uint8_t> isMarked(_mem);
+    isMarked.setSize(function->instructions.size(), 0);
+    Array<uint32_t> worklist(_mem);
+    for (size_t i = 0; i < function->blocks.size(); i++) {
+        ssa::Block &block = function->blocks[i];
+        for (uint32_t j = 0; j < block.numInstructions; j++) {
+            uint32_t id = function->schedule[block.firstInstruction + j];
+            ssa::Instruction &instruction = function->instructions[id];
+            if ((isPure(instruction) && !mayFail(instruction)) || instruction.op == OpPhi || instruction.op == OpGetGlobal) continue;
+            isMarked[id] = 1;
+            worklist.add(id);
+        }
+    }
+    while (worklist.size() > 0) {
+        ssa::Instruction &instruction = function->instructions[worklist[worklist.size() - 1]];
+        worklist.setSize(worklist.size() - 1, 0);
+        for (uint32_t i = 0; i < instruction.numOperands; i++) {
+            uint32_t operand = function->operand(instruction, i);
+            if (isMarked[operand]) continue;
+            isMarked[operand] = 1;
+            worklist.add(operand);
+        }
+    }
+    IsUnmarked isUnmarked(isMarked);
+    return removeInstructions(function, isUnmarked);
+}
+
+void SsaOptimizer::optimize(ssa::Function *function, uint32_t passes) {
+    for (uint32_t i = 0; i < QAK_SSA_NUM_PASSES; i++) {
+        if (!(passes & (1u << i))) continue;
+        _replacements.clear();
+        for (uint32_t j = 0; j < function->instructions.size(); j++) _replacements.add(j);
+
+        double start = io::timeMillis();
+        uint32_t numChanges = 0;
+        switch (1u << i) {
+            case PassUnreachableCode:
+                numChanges = removeUnreachableCode(function);
+                break;
+            case PassCopyPropagation:
+                numChanges = propagateCopies(function);
+                break;
+            case PassValueNumbering:
+                numChanges = numberValues(function);
+                break;
+            case PassLoopInvariants:
+                numChanges = hoistLoopInvariants(function);
+                break;
+            case PassDeadCode:
+                numChanges = removeDeadCode(function);
+                break;
+            default:
+                break;
+        }
+        _timings[i].millis += io::timeMillis() - start;
+        _timings[i].numChanges += numChanges;
+    }
+}
+
+void SsaOptimizer::optimize(ssa::Program *program, uint32_t passes) {
+    for (size_t i = 0; i < program->functions.size(); i++) optimize(program->functions[i], passes);
+    optimize(program->statements, passes);
+}
+
+void SsaOptimizer::resetTimings() {
+    for (uint32_t i = 0; i < QAK_SSA_NUM_PASSES; i++) {
+        _timings[i].millis = 0;
+        _timings[i].numChanges = 0;
+    }
+}
+
+void SsaOptimizer::printTimings() {
+    for (uint32_t i = 0; i < QAK_SSA_NUM_PASSES; i++) {
+        printf("%-18s %10.3f ms %8u changes\n", _timings[i].name, _timings[i].millis, _timings[i].numChanges);
+    }
+}
+
+#define QAK_SSA_OPCODE_NAME(name, text) text,
+
+const char *ssa::opcodeToString(Opcode op) {
+    static const char *names[] = {QAK_SSA_OPCODES(QAK_SSA_OPCODE_NAME) "last"};
+    return names[op];
+}
+
+#undef QAK_SSA_OPCODE_NAME
+
+static void append(Array<char> &output, const char *format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length < 0) return;
+    output.addAll(buffer, (size_t) length < sizeof(buffer) ? (size_t) length : sizeof(buffer) - 1);
+}
+
+static void dumpConstant(Module *module, ssa::Instruction &instruction, Array<char> &output) {
+    switch (instruction.type) {
+        case TypeBoolean:
+            append(output, instruction.immediate.i ? "true" : "false");
+            break;
+        case TypeFloat32:
+            append(output, "%.9g", instruction.immediate.f);
+            break;
+        case TypeFloat64:
+            append(output, "%.17g", instruction.immediate.f);
+            break;
+        case TypeString: {
+            InternedString &string = module->strings[instruction.immediate.i];
+            output.add('"');
+            for (uint32_t i = 0; i < string.length; i++) {
+                char c = (char) string.data[i];
+                if (c == '\n') append(output, "\\n");
+                else if (c == '"' || c == '\\') append(output, "\\%c", c);
+                else output.add(c);
+            }
+            output.add('"');
+            break;
+        }
+        default:
+            append(output, "%lld", (long long) instruction.immediate.i);
+            break;
+    }
+}
+
+/* Returns whether the instruction computes a value other instructions can use. */
+static QAK_FORCE_INLINE bool hasValue(ssa::Instruction &instruction) {
+    return instruction.type != TypeNothing && instruction.op != OpReturn;
+}
+
+static void dumpFunction(ssa::Program *program, ssa::Function *function, TypeTable &types, Array<char> &output, HeapAllocator &mem) {
+    Module *module = program->module;
+    Array<uint32_t> numbers(mem);
+    numbers.setSize(function->instructions.size(), QAK_SSA_NONE);
+    uint32_t number = 0;
+    for (size_t i = 0; i < function->blocks.size(); i++) {
+        ssa::Block &block = function->blocks[i];
+        for (uint32_t j = 0; j < block.numInstructions; j++) {
+            uint32_t id = function->schedule[block.firstInstruction + j];
+            if (hasValue(function->instructions[id])) numbers[id] = number++;
+        }
+    }
+
+    append(output, "%.*s (parameters: %u, blocks: %zu, instructions: %u)\n", QAK_TOKEN_TEXT(module->tokens[function->name]), function->numParameters,
+           function->blocks.size(), function->size());
+    for (uint32_t i = 0; i < function->blocks.size(); i++) {
+        ssa::Block &block = function->blocks[i];
+        append(output, "  b%u", i);
+        for (uint32_t j = 0; j < block.numPredecessors; j++) append(output, j == 0 ? " <- b%u" : ", b%u", function->predecessor(block, j));
+        append(output, ":\n");
+        for (uint32_t j = 0; j < block.numInstructions; j++) {
+            uint32_t id = function->schedule[block.firstInstruction + j];
+            ssa::Instruction &instruction = function->instructions[id];
+            Opcode op = (Opcode) instruction.op;
+            append(output, "    ");
+            if (hasValue(instruction)) append(output, "v%u: %s = ", numbers[id], types.name(instruction.type));
+            append(output, "%s", opcodeToString(op));
+            switch (op) {
+                case OpConstant:
+                    append(output, " ");
+                    dumpConstant(module, instruction, output);
+                    break;
+                case OpParameter:
+                    append(output, " %lld", (long long) instruction.immediate.i);
+                    break;
+                case OpGetGlobal:
+                case OpSetGlobal: {
+                    Token &name = module->tokens[module->variables[instruction.immediate.i]->name];
+                    append(output, " %.*s", QAK_TOKEN_TEXT(name));
+                    break;
+                }
+                case OpCall: {
+                    Token &name = module->tokens[module->functions[instruction.immediate.i]->name];
+                    append(output, " %.*s", QAK_TOKEN_TEXT(name));
+                    break;
+                }
+                case OpCallNative:
+                    append(output, " %s", module->natives->get((uint32_t) instruction.immediate.i).name);
+                    break;
+                default:
+                    break;
+            }
+            for (uint32_t k = 0; k < instruction.numOperands; k++) {
+                bool isFirst = k == 0 && op != OpSetGlobal && op != OpCall && op != OpCallNative;
+                append(output, isFirst ? " v%u" : ", v%u", numbers[function->operand(instruction, k)]);
+            }
+            if (op == OpJump) append(output, " b%u", block.successors[0]);
+            if (op == OpBranch) append(output, ", b%u, b%u", block.successors[0], block.successors[1]);
+            append(output, "\n");
+        }
+    }
+}
+
+void ssa::dump(ssa::Program *program, TypeTable &types, Array<char> &output, HeapAllocator &mem) {
+    for (size_t i = 0; i < program->functions.size(); i++) dumpFunction(program, program->functions[i], types, output, mem);
+    dumpFunction(program, program->statements, types, output, mem);
+}
@@ -0,0 +1,301 @@
+#ifndef QAK_SSA_H
+#define QAK_SSA_H
+
+#include "bytecode.h"
+
+/* Marks a missing instruction, block or variable. */
+#define QAK_SSA_NONE 0xffffffffu
+
+namespace qak {
+    namespace ssa {
+        /* The opcodes of the intermediate representation, see Opcode. Operations compute values of
+         * the instruction's type, e.g. Add of int8 values wraps around at 8 bits. Comparisons compare
+         * as floats if their operands are floats. */
+#define QAK_SSA_OPCODES(X) \
+    X(Constant, "constant")    /* The value in Instruction::immediate. */ \
+    X(Parameter, "parameter")  /* The parameter with the index in immediate. */ \
+    X(Phi, "phi")              /* The operand of the predecessor the block was entered from. */ \
+    X(Copy, "copy")            /* The operand. */ \
+    X(GetGlobal, "get_global") /* The module variable with the slot in immediate. */ \
+    X(SetGlobal, "set_global") /* Stores the operand in the module variable with the slot in immediate. */ \
+    X(Call, "call")            /* Calls the function with the index in immediate with the operands. */ \
+    X(CallNative, "call_native") /* Calls the native with the index in immediate, see ast::Module::natives. */ \
+    X(Add, "add") \
+    X(Sub, "sub") \
+    X(Mul, "mul") \
+    X(Div, "div")              /* Integer division and remainder fail if the divisor is zero. */ \
+    X(Rem, "rem") \
+    X(And, "and") \
+    X(Or, "or") \
+    X(Xor, "xor") \
+    X(Neg, "neg") \
+    X(Not, "not") \
+    X(ToFloat, "to_float")     /* Converts the integer operand to the instruction's float type. */ \
+    X(Eq, "eq") \
+    X(Ne, "ne") \
+    X(Lt, "lt") \
+    X(Le, "le") \
+    X(Jump, "jump")            /* Continues at the block's successor. */ \
+    X(Branch, "branch")        /* Continues at the block's first successor if the operand is true, else at the second. */ \
+    X(Return, "return")        /* Returns the operand, or nothing if there is none. */
+
+#define QAK_SSA_OPCODE_ENUM(name, text) Op##name,
+
+        enum Opcode {
+            QAK_SSA_OPCODES(QAK_SSA_OPCODE_ENUM)
+            OpLast
+        };
+
+#undef QAK_SSA_OPCODE_ENUM
+
+        /* Instructions are identified by their index in Function::instructions, which is also the
+         * value they compute. The operands are stored in Function::operands, from firstOperand to
+         * firstOperand + numOperands. The operands of a phi belong to the predecessors of its block,
+         * in the same order. */
+        struct Instruction {
+            uint16_t op;
+            TypeId type;
+            uint32_t block;
+            uint32_t firstOperand;
+            uint32_t numOperands;
+            bytecode::Value immediate;
+
+            /* The token the instruction was built from, used to report errors. */
+            uint32_t token;
+
+            Instruction(Opcode op, TypeId type, uint32_t block, uint32_t firstOperand, uint32_t numOperands, uint32_t token) :
+                    op((uint16_t) op), type(type), block(block), firstOperand(firstOperand), numOperands(numOperands), token(token) {
+                immediate.i = 0;
+            }
+        };
+
+        /* A basic block. Its instructions are stored in Function::schedule from firstInstruction to
+         * firstInstruction + numInstructions, phis first, and end with a Jump, Branch or Return. The
+         * predecessors are stored in Function::predecessors. The entry block is block 0. */
+        struct Block {
+            uint32_t firstInstruction;
+            uint32_t numInstructions;
+            uint32_t firstPredecessor;
+            uint32_t numPredecessors;
+            uint32_t successors[2];
+            uint32_t numSuccessors;
+
+            /* The immediate dominator of the block, the entry block for the entry block. */
+            uint32_t dominator;
+
+            Block() : firstInstruction(0), numInstructions(0), firstPredecessor(0), numPredecessors(0), numSuccessors(0), dominator(0) {
+                successors[0] = successors[1] = 0;
+            }
+        };
+
+        /* A function or the statements of a module in SSA form. All arrays are allocated in the
+         * module's memory. Passes that remove instructions only remove them from the schedule, so
+         * the indices of the remaining instructions stay the same. */
+        struct Function {
+            /* The name token of the function, or of the module for the module's statements. */
+            uint32_t name;
+            uint32_t numParameters;
+            TypeId returnType;
+            FixedArray<Instruction> instructions;
+            FixedArray<uint32_t> operands;
+            FixedArray<Block> blocks;
+            FixedArray<uint32_t> schedule;
+            FixedArray<uint32_t> predecessors;
+
+            Function(BumpAllocator &mem, uint32_t name, uint32_t numParameters, TypeId returnType) : name(name), numParameters(numParameters),
+                                                                                                     returnType(returnType), instructions(mem),
+                                                                                                     operands(mem), blocks(mem), schedule(mem),
+                                                                                                     predecessors(mem) {}
+
+            QAK_FORCE_INLINE uint32_t operand(Instruction &instruction, uint32_t index) {
+                return operands[instruction.firstOperand + index];
+            }
+
+            QAK_FORCE_INLINE uint32_t predecessor(Block &block, uint32_t index) {
+                return predecessors[block.firstPredecessor + index];
+            }
+
+            /* Returns the last instruction of the block, which is a Jump, Branch or Return. */
+            QAK_FORCE_INLINE Instruction &terminator(Block &block) {
+                return instructions[schedule[block.firstInstruction + block.numInstructions - 1]];
+            }
+
+            /* Returns the number of scheduled instructions. */
+            uint32_t size();
+        };
+
+        /* The functions and module statements of a module in SSA form. Module variables are stored
+         * in globals, by their ast::Symbol::slot, and only accessed through GetGlobal and SetGlobal. */
+        struct Program {
+            ast::Module *module;
+
+            /* The functions by their index in ast::Module::functions. */
+            FixedArray<Function *> functions;
+            Function *statements;
+
+            Program(ast::Module *module) : module(module), functions(module->mem), statements(nullptr) {}
+        };
+
+        /* The optimization passes, see SsaOptimizer::optimize(). */
+        enum Pass {
+            PassUnreachableCode = 1,
+            PassCopyPropagation = 2,
+            PassLoopInvariants = 4,
+            PassValueNumbering = 8,
+            PassDeadCode = 16,
+            PassAll = 31
+        };
+
+#define QAK_SSA_NUM_PASSES 5
+
+        /* The time a pass took and the number of instructions or blocks it removed, moved or replaced,
+         * summed over all functions it ran on. */
+        struct PassTiming {
+            const char *name;
+            double millis;
+            uint32_t numChanges;
+
+            PassTiming(const char *name) : name(name), millis(0), numChanges(0) {}
+        };
+
+        /* Returns the name of the opcode, e.g. "add". */
+        const char *opcodeToString(Opcode op);
+
+        /* Appends the text form of the program to the output, one line per block and instruction.
+         * Values are numbered in the order they are scheduled, so the text does not depend on
+         * the indices of removed instructions. */
+        void dump(Program *program, TypeTable &types, Array<char> &output, HeapAllocator &mem);
+    }
+
+    /* Builds the SSA form of a type checked module, see ssa::Program. Blocks are created for the
+     * branches of if statements, the condition and body of while statements, and the statements
+     * following a return, which are unreachable. Local variables are first accessed through loads
+     * and stores, which are then replaced by the values stored: phis are placed at the iterated
+     * dominance frontiers of the blocks that store a variable, and the loads are renamed by walking
+     * the dominator tree. Variables are zero before they are stored.
+     *
+     * Like the BytecodeCompiler, string concatenation and functions as values are not supported. */
+    class SsaBuilder {
+    private:
+        struct NodeBuilder;
+        struct Renamer;
+
+        /* A local variable, parameter or temporary value of the function being built. */
+        struct Local {
+            TypeId type;
+
+            /* The value of the variable before it is first stored, its Parameter instruction or
+             * QAK_SSA_NONE for the zero value of its type. */
+            uint32_t initial;
+
+            Local(TypeId type, uint32_t initial) : type(type), initial(initial) {}
+        };
+
+        /* A binary operation along the left operands of a chain, see NodeBuilder::visitBinaryOperation(). */
+        struct Operation {
+            ast::BinaryOperation *node;
+            ssa::Opcode opcode;
+            TypeId operandType;
+            bool isSwapped;
+        };
+
+        HeapAllocator &_mem;
+        Array<ssa::Instruction> _instructions;
+        Array<uint32_t> _operands;
+        Array<ssa::Block> _blocks;
+        Array<Local> _locals;
+
+        /* The variable of each symbol of the module, -1 if it has none in the function being built.
+         * The symbols that have one are in _usedSymbols. */
+        Array<int32_t> _symbolVariables;
+        Array<uint32_t> _usedSymbols;
+
+        /* The operations of the chains being built. */
+        Array<Operation> _operations;
+
+        /* The block of each instruction is the block that was current when it was added, so the
+         * instructions of a block are contiguous and in order. Phis are added by Renamer. */
+        uint32_t _block;
+
+        /* Whether the current block ended with a jump, branch or return. */
+        bool _isTerminated;
+
+        // Set on each call to build.
+        ast::Module *_module;
+        TypeTable *_types;
+        Errors *_errors;
+
+        ssa::Function *buildFunction(uint32_t name, ast::Function *function, FixedArray<ast::Statement *> &statements, TypeId returnType,
+                                     bool isModule);
+
+    public:
+        SsaBuilder(HeapAllocator &mem) : _mem(mem), _instructions(mem), _operands(mem), _blocks(mem), _locals(mem), _symbolVariables(mem),
+                                         _usedSymbols(mem), _operations(mem), _block(0), _isTerminated(false), _module(nullptr), _types(nullptr),
+                                         _errors(nullptr) {}
+
+        /* Builds the module, which must be type checked without errors with the types, see
+         * TypeChecker::check(). Unsupported constructs are reported in the errors, in which case
+         * nullptr is returned. The program is allocated in the module's memory. */
+        ssa::Program *build(ast::Module *module, TypeTable &types, Errors &errors);
+    };
+
+    /* Optimizes programs built by the SsaBuilder. The passes run in this order:
+     *
+     * - Unreachable code removal turns branches on constants into jumps, then removes the blocks
+     *   that can not be reached from the entry block, like the statements following a return.
+     * - Copy propagation replaces copies, and phis whose operands are all the same value, by
+     *   the value they copy.
+     * - Loop invariant code motion moves operations whose operands are defined outside of a while
+     *   loop to the block before the loop. Integer divisions are not moved, as they may fail when
+     *   the loop's body is never run. Module variables are read once before loops that don't
+     *   store them and don't call functions.
+     * - Global value numbering replaces an instruction by an equal instruction that dominates it,
+     *   e.g. the same constant or the same operation on the same operands, including those moved
+     *   out of different loops.
+     * - Dead code elimination removes instructions whose values are not used and that have no
+     *   effect. Integer divisions are kept, as they may fail.
+     *
+     * Each pass is timed, see timings(). */
+    class SsaOptimizer {
+    private:
+        HeapAllocator &_mem;
+        ssa::PassTiming _timings[QAK_SSA_NUM_PASSES];
+
+        /* The value each instruction is replaced by, or the instruction itself, see resolve(). */
+        Array<uint32_t> _replacements;
+
+        uint32_t resolve(uint32_t value);
+
+        uint32_t replaceOperands(ssa::Function *function);
+
+        uint32_t removeUnreachableCode(ssa::Function *function);
+
+        uint32_t propagateCopies(ssa::Function *function);
+
+        uint32_t numberValues(ssa::Function *function);
+
+        uint32_t hoistLoopInvariants(ssa::Function *function);
+
+        uint32_t removeDeadCode(ssa::Function *function);
+
+        void optimize(ssa::Function *function, uint32_t passes);
+
+    public:
+        SsaOptimizer(HeapAllocator &mem);
+
+        /* Runs the passes, a combination of ssa::Pass values, on the functions and statements of the program. */
+        void optimize(ssa::Program *program, uint32_t passes = ssa::PassAll);
+
+        /* Returns the timing of each pass in the order the passes run, summed over all calls of optimize(). */
+        ssa::PassTiming *timings() {
+            return _timings;
+        }
+
+        void resetTimings();
+
+        /* Prints the timing of each pass. */
+        void printTimings();
+    };
+}
+
+#endif //QAK_SSA_H
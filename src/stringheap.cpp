@@ -0,0 +1,166 @@
+#include "stringheap.h"
+
+using namespace qak;
+using namespace qak::strings;
+
+/* Two strings concatenated. The bytes are set once the rope is flattened. */
+struct qak::strings::Rope : Buffer {
+    String left;
+    String right;
+};
+
+/* Accepts the interned literal with the bytes, see HashIndex::find(). */
+struct IsLiteral {
+    const InternedString &string;
+
+    IsLiteral(const InternedString &string) : string(string) {}
+
+    QAK_FORCE_INLINE bool operator()(Buffer *buffer) const {
+        return buffer->length == string.length && memcmp(buffer->data, string.data, string.length) == 0;
+    }
+};
+
+String StringHeap::small(const uint8_t *data, uint32_t length) {
+    String string;
+    if (length > 0) memcpy(string.small, data, length);
+    string.small[15] = (uint8_t) length;
+    return string;
+}
+
+String StringHeap::large(Buffer *buffer) {
+    String string;
+    string.large.buffer = buffer;
+    string.large.length = buffer->length;
+    string.small[15] = QAK_STRING_LARGE_TAG;
+    return string;
+}
+
+/* Allocates a flat buffer of the given length, followed by its bytes. The arena only hands
+ * out multiples of 8 bytes, so buffers and ropes stay aligned. */
+Buffer *StringHeap::allocFlat(uint32_t length) {
+    Buffer *buffer = (Buffer *) _arena.alloc<uint64_t>((sizeof(Buffer) + length + 7) / 8);
+    buffer->data = (uint8_t *) (buffer + 1);
+    buffer->length = length;
+    buffer->hash = 0;
+    return buffer;
+}
+
+void StringHeap::reset() {
+    _arena.free();
+    _literals.clear();
+    _literalTable.clear();
+}
+
+String StringHeap::copy(const uint8_t *data, uint32_t length) {
+    if (length <= QAK_STRING_MAX_SMALL_LENGTH) return small(data, length);
+    Buffer *buffer = allocFlat(length);
+    memcpy(buffer + 1, data, length);
+    return large(buffer);
+}
+
+String StringHeap::literal(const uint8_t *data, uint32_t length) {
+    return literal(InternedString(data, length, hashBytes(data, length)));
+}
+
+String StringHeap::literal(const InternedString &string) {
+    if (string.length <= QAK_STRING_MAX_SMALL_LENGTH) return small(string.data, string.length);
+
+    _literalTable.reserve(_literals);
+    size_t slot;
+    int32_t found = _literalTable.find(_literals, string.hash, IsLiteral(string), slot);
+    if (found >= 0) return large(_literals[(size_t) found]);
+
+    Buffer *buffer = _arena.allocObject<Buffer>();
+    buffer->data = string.data;
+    buffer->length = string.length;
+    buffer->hash = string.hash;
+    _literalTable.set(slot, (int32_t) _literals.size());
+    _literals.add(buffer);
+    return large(buffer);
+}
+
+String StringHeap::concat(const String &a, const String &b) {
+    uint32_t lengthA = a.length(), lengthB = b.length();
+    if (lengthA == 0) return b;
+    if (lengthB == 0) return a;
+
+    uint32_t length = lengthA + lengthB;
+    if (length <= QAK_STRING_MAX_SMALL_LENGTH) {
+        String string = a;
+        memcpy(string.small + lengthA, b.small, lengthB);
+        string.small[15] = (uint8_t) length;
+        return string;
+    }
+
+    if (length < QAK_STRING_MIN_ROPE_LENGTH) {
+        Buffer *buffer = allocFlat(length);
+        uint8_t *bytes = (uint8_t *) (buffer + 1);
+        memcpy(bytes, data(a), lengthA);
+        memcpy(bytes + lengthA, data(b), lengthB);
+        return large(buffer);
+    }
+
+    Rope *rope = _arena.allocObject<Rope>();
+    rope->data = nullptr;
+    rope->length = length;
+    rope->hash = 0;
+    rope->left = a;
+    rope->right = b;
+    return large(rope);
+}
+
+/* Copies the bytes of the rope's leaves into a new buffer, left to right, and keeps it in the rope.
+ * The leaves are walked with an explicit stack, as ropes built by appending are as deep as the
+ * number of appends. */
+const uint8_t *StringHeap::flatten(Rope *rope) {
+    uint8_t *bytes = (uint8_t *) (allocFlat(rope->length) + 1);
+    uint32_t offset = 0;
+    _stack.clear();
+    _stack.add(rope->right);
+    _stack.add(rope->left);
+    while (_stack.size() > 0) {
+        String string = _stack[_stack.size() - 1];
+        _stack.removeAt(_stack.size() - 1);
+        if (string.isSmall()) {
+            memcpy(bytes + offset, string.small, string.small[15]);
+            offset += string.small[15];
+            continue;
+        }
+
+        Buffer *buffer = string.large.buffer;
+        if (buffer->data) {
+            memcpy(bytes + offset, buffer->data, buffer->length);
+            offset += buffer->length;
+            continue;
+        }
+        _stack.add(((Rope *) buffer)->right);
+        _stack.add(((Rope *) buffer)->left);
+    }
+    rope->data = bytes;
+    return bytes;
+}
+
+uint32_t StringHeap::hash(const String &string) {
+    if (string.isSmall()) return hashBytes(string.small, string.small[15]);
+    Buffer *buffer = string.large.buffer;
+    if (buffer->hash == 0) buffer->hash = hashBytes(data(string), buffer->length);
+    return buffer->hash;
+}
+
+bool StringHeap::equals(const String &a, const String &b) {
+    // Small strings are padded with zeros and can not be equal to long strings.
+    if (a.isSmall() || b.isSmall()) return a.words[0] == b.words[0] && a.words[1] == b.words[1];
+
+    Buffer *bufferA = a.large.buffer, *bufferB = b.large.buffer;
+    if (bufferA == bufferB) return true;
+    if (bufferA->length != bufferB->length) return false;
+    if (bufferA->hash != 0 && bufferB->hash != 0 && bufferA->hash != bufferB->hash) return false;
+    return memcmp(data(a), data(b), bufferA->length) == 0;
+}
+
+int32_t StringHeap::compare(const String &a, const String &b) {
+    uint32_t lengthA = a.length(), lengthB = b.length();
+    int result = memcmp(data(a), data(b), lengthA < lengthB ? lengthA : lengthB);
+    if (result != 0) return result;
+    return lengthA < lengthB ? -1 : lengthA > lengthB ? 1 : 0;
+}
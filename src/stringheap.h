@@ -0,0 +1,139 @@
+#ifndef QAK_STRINGHEAP_H
+#define QAK_STRINGHEAP_H
+
+#include "literals.h"
+
+// Longest string stored inline in a String.
+#define QAK_STRING_MAX_SMALL_LENGTH 15
+
+// Concatenations shorter than this are copied, longer ones create a rope.
+#define QAK_STRING_MIN_ROPE_LENGTH 64
+
+// Marks a String that references a strings::Buffer, see String::isSmall().
+#define QAK_STRING_LARGE_TAG 0xff
+
+namespace qak {
+    namespace strings {
+        /* The immutable bytes of a string longer than QAK_STRING_MAX_SMALL_LENGTH. The bytes of flat strings
+         * follow the buffer, those of literals are the bytes they were interned from. Ropes have no bytes
+         * until they are flattened. The hash is 0 until computed. */
+        struct Buffer {
+            const uint8_t *data;
+            uint32_t length;
+            uint32_t hash;
+        };
+
+        struct Rope;
+
+        /* Returns the hash of an interned literal, see HashIndex. */
+        struct BufferHash {
+            uint32_t operator()(Buffer *const &buffer) const {
+                return buffer->hash;
+            }
+        };
+    }
+
+    /* A string of bytes, 16 bytes large, copied by value. Strings of up to QAK_STRING_MAX_SMALL_LENGTH bytes
+     * are stored inline, followed by zeros and their length in the last byte. Longer strings reference
+     * a strings::Buffer owned by a StringHeap, and are only valid as long as it is not reset. */
+    struct String {
+        struct Large {
+            strings::Buffer *buffer;
+            uint32_t length;
+        };
+
+        union {
+            uint8_t small[16];
+            Large large;
+            uint64_t words[2];
+        };
+
+        String() {
+            words[0] = words[1] = 0;
+        }
+
+        QAK_FORCE_INLINE bool isSmall() const {
+            return small[15] != QAK_STRING_LARGE_TAG;
+        }
+
+        QAK_FORCE_INLINE uint32_t length() const {
+            return isSmall() ? small[15] : large.length;
+        }
+    };
+
+    /* Creates and operates on Strings. The buffers of long strings and the nodes of ropes are allocated
+     * in the heap's arena and freed all at once by reset(), so strings are never copied to be shared.
+     *
+     * Concatenations of QAK_STRING_MIN_ROPE_LENGTH bytes or more create a rope referencing both strings,
+     * so repeatedly appending to a string takes constant time per append. A rope is flattened into a
+     * single buffer the first time its bytes are needed, see data().
+     *
+     * String literals are interned. Their bytes are not copied, so they must stay valid as long as the
+     * heap, like the bytes of a source or the decoded literals in ast::Module::strings. Interned literals
+     * with the same bytes share their buffer, so they are compared by reference. */
+    class StringHeap {
+    private:
+        BumpAllocator _arena;
+
+        /* The interned literals, and their indices by their hashes. */
+        Array<strings::Buffer *> _literals;
+        HashIndex<strings::Buffer *, strings::BufferHash> _literalTable;
+
+        /* The strings left to copy while flattening a rope. */
+        Array<String> _stack;
+
+        StringHeap(const StringHeap &other) = delete;
+
+        strings::Buffer *allocFlat(uint32_t length);
+
+        const uint8_t *flatten(strings::Rope *rope);
+
+        static String small(const uint8_t *data, uint32_t length);
+
+        static String large(strings::Buffer *buffer);
+
+    public:
+        StringHeap(HeapAllocator &mem) : _arena(mem, 64 * 1024), _literals(mem), _literalTable(mem), _stack(mem) {}
+
+        /* Frees all strings and interned literals. */
+        void reset();
+
+        /* Returns a string holding a copy of the bytes. */
+        String copy(const uint8_t *data, uint32_t length);
+
+        /* Returns the interned literal with the bytes, which are not copied. */
+        String literal(const uint8_t *data, uint32_t length);
+
+        /* Returns the interned literal, reusing the hash computed by the StringPool. */
+        String literal(const InternedString &string);
+
+        /* Returns the concatenation of the strings. */
+        String concat(const String &a, const String &b);
+
+        /* Returns the bytes of the string, flattening it if it is a rope. The bytes of small strings are
+         * those stored in the string, so it must outlive the returned pointer. */
+        const uint8_t *data(const String &string) {
+            if (string.isSmall()) return string.small;
+            strings::Buffer *buffer = string.large.buffer;
+            if (buffer->data) return buffer->data;
+            return flatten((strings::Rope *) buffer);
+        }
+
+        /* Returns the FNV-1a hash of the bytes of the string, like InternedString::hash. The hash of long
+         * strings is computed once. */
+        uint32_t hash(const String &string);
+
+        bool equals(const String &a, const String &b);
+
+        /* Compares the bytes of the strings lexicographically, returns a negative number, 0 or a positive
+         * number if the first string is smaller, equal to or larger than the second string. */
+        int32_t compare(const String &a, const String &b);
+
+        /* Returns the number of literals interned since the last reset. */
+        size_t numLiterals() {
+            return _literals.size();
+        }
+    };
+}
+
+#endif //QAK_STRINGHEAP_H
@@ -217,18 +217,82 @@ const char *tokenizer::tokenTypeToString(TokenType type) {
     return nullptr;
 }
 
-void tokenizer::tokenize(Source &source, Array<Token> &tokens, Errors &errors) {
-    CharacterStream stream(source);
+/* Decodes the digits of a numeric literal of the given type into the value. Decimal integer
+ * literals must fit into the positive range of their type, e.g. 127 for byte literals, or be
+ * one larger, e.g. 128, which is decoded as the minimum of the type so -128b can be written.
+ * The parser only accepts the latter as the operand of a unary minus. Hexadecimal literals may
+ * set all bits of their type, e.g. 0xffffffff is a valid integer literal with the value -1.
+ * Returns false and adds an error if the value is out of range. */
+static bool decodeNumber(TokenType type, bool isHex, Span &digits, Span literal, LiteralValue &value, Errors &errors) {
+    const uint8_t *data = digits.source.data + digits.start;
+    uint32_t length = digits.length();
+
+    if (type == FloatLiteral) {
+        if (literals::parseFloat(data, length, &value.floatValue)) return true;
+        errors.add(literal, "Float literal is out of range.");
+        return false;
+    }
+
+    if (type == DoubleLiteral) {
+        if (literals::parseDouble(data, length, &value.doubleValue)) return true;
+        errors.add(literal, "Double literal is out of range.");
+        return false;
+    }
+
+    uint64_t max;
+    switch (type) {
+        case ByteLiteral:
+            max = isHex ? UINT8_MAX : INT8_MAX;
+            break;
+        case ShortLiteral:
+            max = isHex ? UINT16_MAX : INT16_MAX;
+            break;
+        case LongLiteral:
+            max = isHex ? UINT64_MAX : INT64_MAX;
+            break;
+        default:
+            max = isHex ? UINT32_MAX : INT32_MAX;
+            break;
+    }
 
+    uint64_t bits;
+    bool fits = isHex ? literals::parseHex(data, length, &bits) : literals::parseDecimal(data, length, &bits);
+    if (!fits || bits > (isHex ? max : max + 1)) {
+        errors.add(literal, isHex ? "%s is out of range, the maximum value is 0x%llx." : "%s is out of range, the maximum value is %llu.",
+                   tokenizer::tokenTypeToString(type), (unsigned long long) max);
+        return false;
+    }
+
+    switch (type) {
+        case ByteLiteral:
+            value.byteValue = (int8_t) (uint8_t) bits;
+            break;
+        case ShortLiteral:
+            value.shortValue = (int16_t) (uint16_t) bits;
+            break;
+        case LongLiteral:
+            value.longValue = (int64_t) bits;
+            break;
+        default:
+            value.intValue = (int32_t) (uint32_t) bits;
+            break;
+    }
+    return true;
+}
+
+/* Tokenizes the stream up to the first token starting at or after the byte index end. */
+static void tokenizeStream(CharacterStream &stream, uint32_t end, Array<Token> &tokens, Array<LiteralValue> &literalValues, Errors &errors) {
     while (stream.hasMore()) {
         stream.skipWhiteSpace();
-        if (!stream.hasMore()) break;
+        if (!stream.hasMore() || stream.getIndex() >= end) break;
         stream.startSpan();
 
         // Numbers
         if (stream.matchDigit(false)) {
             TokenType type = IntegerLiteral;
+            bool isHex = false;
             if (stream.match("0x", true)) {
+                isHex = true;
                 while (stream.matchHex(true));
             } else {
                 while (stream.matchDigit(true));
@@ -237,6 +301,11 @@ void tokenizer::tokenize(Source &source, Array<Token> &tokens, Errors &errors) {
                     while (stream.matchDigit(true));
                 }
             }
+            Span digits = stream.endSpan();
+            if (isHex) {
+                digits.start += 2;
+                if (digits.length() == 0) QAK_ERROR(stream.endSpan(), "Hexadecimal literal needs at least one digit.");
+            }
             if (stream.match("b", true)) {
                 if (type == FloatLiteral) QAK_ERROR(stream.endSpan(), "Byte literal can not have a decimal point.");
                 type = ByteLiteral;
@@ -251,7 +320,11 @@ void tokenizer::tokenize(Source &source, Array<Token> &tokens, Errors &errors) {
             } else if (stream.match("d", true)) {
                 type = DoubleLiteral;
             }
-            tokens.add({type, stream.endSpan()});
+
+            LiteralValue value;
+            if (!decodeNumber(type, isHex, digits, stream.endSpan(), value, errors)) return;
+            tokens.add({type, stream.endSpan(), (uint32_t) literalValues.size()});
+            literalValues.add(value);
             continue;
         }
 
@@ -294,7 +367,10 @@ void tokenizer::tokenize(Source &source, Array<Token> &tokens, Errors &errors) {
             Span identifier = stream.endSpan();
 
             if (identifier.matches(QAK_STR("true")) || identifier.matches(QAK_STR("false"))) {
-                tokens.add({BooleanLiteral, identifier});
+                LiteralValue value;
+                value.booleanValue = identifier.matches(QAK_STR("true"));
+                tokens.add({BooleanLiteral, identifier, (uint32_t) literalValues.size()});
+                literalValues.add(value);
             } else if (identifier.matches(QAK_STR("nothing"))) {
                 tokens.add({NothingLiteral, identifier});
             } else {
@@ -344,6 +420,19 @@ void tokenizer::tokenize(Source &source, Array<Token> &tokens, Errors &errors) {
     }
 }
 
+void tokenizer::tokenize(Source &source, Array<Token> &tokens, Array<LiteralValue> &literalValues, Errors &errors) {
+    CharacterStream stream(source);
+    tokenizeStream(stream, (uint32_t) source.size, tokens, literalValues, errors);
+}
+
+uint32_t tokenizer::tokenize(Source &source, uint32_t start, uint32_t &line, uint32_t end, Array<Token> &tokens, Array<LiteralValue> &literalValues,
+                             Errors &errors) {
+    CharacterStream stream(source, start, line);
+    tokenizeStream(stream, end, tokens, literalValues, errors);
+    line = stream.getLine();
+    return stream.getIndex();
+}
+
 void tokenizer::printTokens(Array<Token> &tokens, HeapAllocator &mem) {
     size_t lastLine = 1;
     for (size_t i = 0; i < tokens.size(); i++) {
@@ -3,6 +3,7 @@
 
 #include "array.h"
 #include "error.h"
+#include "literals.h"
 
 /* Used in places we pass a char* literal to a method that expects
  * the length as well. Doesn't work with dynamically allocated
@@ -67,6 +68,21 @@ namespace qak {
         CharacterStream(Source &source) : _source(source), _index(0), _line(1), _end((uint32_t) source.size), _spanStart(0), _spanLineStart(1) {
         }
 
+        /* Creates a stream starting at the byte index, which must be on the given line. */
+        CharacterStream(Source &source, uint32_t index, uint32_t line) : _source(source), _index(index), _line(line), _end((uint32_t) source.size),
+                                                                         _spanStart(index), _spanLineStart(line) {
+        }
+
+        /* Returns the current byte index into the source's data. */
+        QAK_FORCE_INLINE uint32_t getIndex() {
+            return _index;
+        }
+
+        /* Returns the current line number. */
+        QAK_FORCE_INLINE uint32_t getLine() {
+            return _line;
+        }
+
         /* Returns whether the stream has more UTF-8 characters */
         QAK_FORCE_INLINE bool hasMore() {
             return _index < _end;
@@ -265,13 +281,29 @@ namespace qak {
         /* The type of the token. */
         TokenType type;
 
-        Token(TokenType type, Span span) : Span(span), type(type) {}
+        /* The index of the decoded value of a boolean or numeric literal token
+         * in the literal values array passed to tokenizer::tokenize(). Only
+         * valid for literal tokens. */
+        uint32_t literalIndex;
+
+        Token(TokenType type, Span span) : Span(span), type(type), literalIndex(0) {}
+
+        Token(TokenType type, Span span, uint32_t literalIndex) : Span(span), type(type), literalIndex(literalIndex) {}
     };
 
     namespace tokenizer {
-        /* Tokenizes the Source and returns the tokens in the tokens array.
-         * Errors that occurred during tokenization are stored in the Errors instance. */
-        void tokenize(Source &source, Array<Token> &tokens, Errors &errors);
+        /* Tokenizes the Source and returns the tokens in the tokens array. The values
+         * of boolean and numeric literal tokens are decoded and stored in the literalValues
+         * array, see Token::literalIndex. Errors that occurred during tokenization, including
+         * numeric literals that are out of range for their type, are stored in the Errors instance. */
+        void tokenize(Source &source, Array<Token> &tokens, Array<LiteralValue> &literalValues, Errors &errors);
+
+        /* Tokenizes the source from the byte index start on the given line like tokenize(), appending to
+         * the tokens, but stops before the first token starting at or after the byte index end. Returns
+         * the index at which tokenization stopped and stores its line in line. Used to tokenize only the
+         * edited part of a source, see Parser::reparse(). */
+        uint32_t tokenize(Source &source, uint32_t start, uint32_t &line, uint32_t end, Array<Token> &tokens, Array<LiteralValue> &literalValues,
+                          Errors &errors);
 
         /* Returns a string representation for the token type, e.g. TokenType::Identifier
          * returns "Identifier". */
@@ -303,12 +335,21 @@ namespace qak {
         /* The index of the current token in the tokens array. */
         size_t _index;
 
+        /* The index after the last token of the stream in the tokens array. */
+        size_t _end;
+
     public:
-        TokenStream(Source &source, Array<Token> &tokens, Errors &errors) : _source(source), _tokens(tokens), _errors(errors), _index(0) {}
+        TokenStream(Source &source, Array<Token> &tokens, Errors &errors) : _source(source), _tokens(tokens), _errors(errors), _index(0),
+                                                                            _end(tokens.size()) {}
+
+        /* Creates a stream of the tokens from index start up to, but excluding, index end. */
+        TokenStream(Source &source, Array<Token> &tokens, size_t start, size_t end, Errors &errors) : _source(source), _tokens(tokens),
+                                                                                                     _errors(errors), _index(start),
+                                                                                                     _end(end) {}
 
         /* Returns whether there are more tokens in the stream. */
         QAK_FORCE_INLINE bool hasMore() {
-            return _index < _tokens.size();
+            return _index < _end;
         }
 
         /* Consumes the next token and returns it. */
@@ -327,7 +368,7 @@ namespace qak {
         QAK_FORCE_INLINE Token *expect(TokenType type) {
             bool result = match(type, true);
             if (!result) {
-                Token *token = (uint64_t) _index < _tokens.size() ? &_tokens[_index] : nullptr;
+                Token *token = _index < _end ? &_tokens[_index] : nullptr;
                 if (token == nullptr) {
                     Span errorSpan(_source, (uint32_t) _source.size - 1, (uint32_t) _source.lines().size() - 1,
                                    (uint32_t) _source.size - 1,
@@ -349,7 +390,7 @@ namespace qak {
         QAK_FORCE_INLINE Token *expect(const char *text, uint32_t len) {
             bool result = match(text, len, true);
             if (!result) {
-                Token *token = (uint64_t) _index < _tokens.size() ? &_tokens[_index] : nullptr;
+                Token *token = _index < _end ? &_tokens[_index] : nullptr;
                 if (token == nullptr) {
                     Span errorSpan(_source, (uint32_t) _source.size - 1, (uint32_t) _source.lines().size() - 1, (uint32_t) _source.size - 1,
                                    (uint32_t) _source.lines().size() - 1);
@@ -366,7 +407,7 @@ namespace qak {
 
         /* Matches and optionally consumes the next token in case of a match. Returns whether the token matched. */
         QAK_FORCE_INLINE bool match(TokenType type, bool consume) {
-            if (_index >= _tokens.size()) return false;
+            if (_index >= _end) return false;
             if (_tokens[_index].type == type) {
                 if (consume) _index++;
                 return true;
@@ -376,7 +417,7 @@ namespace qak {
 
         /* Matches and optionally consumes the next token in case of a match. Returns whether the token matched. */
         QAK_FORCE_INLINE bool match(const char *text, uint32_t len, bool consume) {
-            if (_index >= _tokens.size()) return false;
+            if (_index >= _end) return false;
             if (_tokens[_index].matches(text, len)) {
                 if (consume) _index++;
                 return true;
@@ -384,6 +425,11 @@ namespace qak {
             return false;
         }
 
+        /* Returns the index of the next token. */
+        QAK_FORCE_INLINE size_t getIndex() {
+            return _index;
+        }
+
         /* Returns the tokens of the underlying stream */
         QAK_FORCE_INLINE Array<Token> &getTokens() {
             return _tokens;
@@ -0,0 +1,860 @@
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include "transpiler.h"
+#include "bytecode.h"
+#include "visitor.h"
+
+using namespace qak;
+
+using namespace qak::ast;
+
+using qak::bytecode::Value;
+
+static QAK_FORCE_INLINE bool isInteger(TypeId type) {
+    return type >= TypeInt8 && type <= TypeInt64;
+}
+
+static QAK_FORCE_INLINE bool isFloat(TypeId type) {
+    return type == TypeFloat32 || type == TypeFloat64;
+}
+
+static QAK_FORCE_INLINE bool isNumeric(TypeId type) {
+    return type >= TypeInt8 && type <= TypeFloat64;
+}
+
+/* Returns the numeric type operands are widened to. Numeric types are ordered from narrowest to widest. */
+static QAK_FORCE_INLINE TypeId widen(TypeId a, TypeId b) {
+    return a > b ? a : b;
+}
+
+/* Returns the C type values of the type are stored in. */
+static const char *cType(TypeId type) {
+    static const char *types[] = {"void", "void", "uint8_t", "int8_t", "int16_t", "int32_t", "int64_t", "float", "double", "uint32_t", "uint32_t"};
+    return type <= TypeString ? types[type] : "void";
+}
+
+/* Returns the constant the generated code identifies the type with, see CTranspiler::writePrelude(). */
+static const char *cTypeConstant(TypeId type) {
+    static const char *constants[] = {"QAK_NOTHING", "QAK_NOTHING", "QAK_BOOLEAN", "QAK_INT8", "QAK_INT16", "QAK_INT32", "QAK_INT64", "QAK_FLOAT32",
+                                      "QAK_FLOAT64", "QAK_CHARACTER", "QAK_STRING"};
+    return type <= TypeString ? constants[type] : "QAK_NOTHING";
+}
+
+static Value constantValue(Literal *literal) {
+    Value value;
+    value.i = 0;
+    LiteralValue &decoded = literal->decodedValue;
+    switch (literal->type) {
+        case BooleanLiteral:
+            value.i = decoded.booleanValue ? 1 : 0;
+            break;
+        case ByteLiteral:
+            value.i = decoded.byteValue;
+            break;
+        case ShortLiteral:
+            value.i = decoded.shortValue;
+            break;
+        case IntegerLiteral:
+            value.i = decoded.intValue;
+            break;
+        case LongLiteral:
+            value.i = decoded.longValue;
+            break;
+        case FloatLiteral:
+            value.f = decoded.floatValue;
+            break;
+        case DoubleLiteral:
+            value.f = decoded.doubleValue;
+            break;
+        case CharacterLiteral:
+            value.i = decoded.characterValue;
+            break;
+        case StringLiteral:
+            value.i = decoded.stringIndex;
+            break;
+        default:
+            break;
+    }
+    return value;
+}
+
+/* The C helpers of the generated code. Integer operations take the line of the operation to
+ * report errors at. */
+static const char *prelude =
+        "#ifndef QAK_MAX_CALL_DEPTH\n"
+        "#define QAK_MAX_CALL_DEPTH %d\n"
+        "#endif\n"
+        "\n"
+        "enum {\n"
+        "    QAK_NOTHING = 1, QAK_BOOLEAN, QAK_INT8, QAK_INT16, QAK_INT32, QAK_INT64, QAK_FLOAT32, QAK_FLOAT64, QAK_CHARACTER, QAK_STRING\n"
+        "};\n"
+        "\n"
+        "typedef union {\n"
+        "    int64_t i;\n"
+        "    double f;\n"
+        "} qak_value;\n"
+        "\n"
+        "static qak_value qak_result;\n"
+        "static int qak_result_type = QAK_NOTHING;\n"
+        "static int qak_depth;\n"
+        "\n"
+        "static void qak_fail(const char *message, int line) {\n"
+        "    printf(\"Error (%%s:%%d): %%s\\n\", qak_file, line, message);\n"
+        "    exit(1);\n"
+        "}\n"
+        "\n"
+        "static inline void qak_enter(int line) {\n"
+        "    if (++qak_depth > QAK_MAX_CALL_DEPTH) qak_fail(\"Stack overflow.\", line);\n"
+        "}\n"
+        "\n"
+        "static inline void qak_leave(void) {\n"
+        "    qak_depth--;\n"
+        "}\n"
+        "\n"
+        "static inline int32_t qak_add_i32(int32_t a, int32_t b) { return (int32_t) ((uint32_t) a + (uint32_t) b); }\n"
+        "static inline int32_t qak_sub_i32(int32_t a, int32_t b) { return (int32_t) ((uint32_t) a - (uint32_t) b); }\n"
+        "static inline int32_t qak_mul_i32(int32_t a, int32_t b) { return (int32_t) ((uint32_t) a * (uint32_t) b); }\n"
+        "static inline int32_t qak_neg_i32(int32_t a) { return (int32_t) (0 - (uint32_t) a); }\n"
+        "static inline int64_t qak_add_i64(int64_t a, int64_t b) { return (int64_t) ((uint64_t) a + (uint64_t) b); }\n"
+        "static inline int64_t qak_sub_i64(int64_t a, int64_t b) { return (int64_t) ((uint64_t) a - (uint64_t) b); }\n"
+        "static inline int64_t qak_mul_i64(int64_t a, int64_t b) { return (int64_t) ((uint64_t) a * (uint64_t) b); }\n"
+        "static inline int64_t qak_neg_i64(int64_t a) { return (int64_t) (0 - (uint64_t) a); }\n"
+        "static inline int8_t qak_narrow8(int32_t a) { return (int8_t) (uint8_t) a; }\n"
+        "static inline int16_t qak_narrow16(int32_t a) { return (int16_t) (uint16_t) a; }\n"
+        "\n"
+        "/* The quotient of the smallest value and -1 wraps around to the smallest value. */\n"
+        "static inline int32_t qak_div_i32(int32_t a, int32_t b, int line) {\n"
+        "    if (b == 0) qak_fail(\"Division by zero.\", line);\n"
+        "    return (int32_t) (uint32_t) ((int64_t) a / b);\n"
+        "}\n"
+        "\n"
+        "static inline int32_t qak_rem_i32(int32_t a, int32_t b, int line) {\n"
+        "    if (b == 0) qak_fail(\"Division by zero.\", line);\n"
+        "    return (int32_t) ((int64_t) a %% b);\n"
+        "}\n"
+        "\n"
+        "static inline int64_t qak_div_i64(int64_t a, int64_t b, int line) {\n"
+        "    if (b == 0) qak_fail(\"Division by zero.\", line);\n"
+        "    return b == -1 ? qak_neg_i64(a) : a / b;\n"
+        "}\n"
+        "\n"
+        "static inline int64_t qak_rem_i64(int64_t a, int64_t b, int line) {\n"
+        "    if (b == 0) qak_fail(\"Division by zero.\", line);\n"
+        "    return b == -1 ? 0 : a %% b;\n"
+        "}\n"
+        "\n"
+        "static inline qak_value qak_integer(int64_t i) {\n"
+        "    qak_value value;\n"
+        "    value.i = i;\n"
+        "    return value;\n"
+        "}\n"
+        "\n"
+        "static inline qak_value qak_real(double f) {\n"
+        "    qak_value value;\n"
+        "    value.f = f;\n"
+        "    return value;\n"
+        "}\n"
+        "\n"
+        "static void qak_print(const char *name, int type, qak_value value) {\n"
+        "    static const char *names[] = {\"\", \"nothing\", \"boolean\", \"int8\", \"int16\", \"int32\", \"int64\", \"float32\", \"float64\", "
+        "\"character\", \"string\"};\n"
+        "    printf(\"%%s: %%s\", name, names[type]);\n"
+        "    switch (type) {\n"
+        "        case QAK_NOTHING:\n"
+        "            printf(\"\\n\");\n"
+        "            break;\n"
+        "        case QAK_BOOLEAN:\n"
+        "            printf(\" = %%s\\n\", value.i ? \"true\" : \"false\");\n"
+        "            break;\n"
+        "        case QAK_FLOAT32:\n"
+        "            printf(\" = %%.9g\\n\", value.f);\n"
+        "            break;\n"
+        "        case QAK_FLOAT64:\n"
+        "            printf(\" = %%.17g\\n\", value.f);\n"
+        "            break;\n"
+        "        case QAK_STRING:\n"
+        "            printf(\" = \\\"%%.*s\\\"\\n\", (int) qak_string_lengths[value.i], qak_strings[value.i]);\n"
+        "            break;\n"
+        "        default:\n"
+        "            printf(\" = %%lld\\n\", (long long) value.i);\n"
+        "            break;\n"
+        "    }\n"
+        "}\n"
+        "\n";
+
+/* A value used by the generated code. Temporaries are named t0, t1, ... within a function,
+ * symbols are local variables or parameters, constants are written as C literals. */
+enum OperandKind {
+    OperandNone,
+    OperandTemporary,
+    OperandSymbol,
+    OperandConstant
+};
+
+struct Operand {
+    OperandKind kind;
+    TypeId type;
+    uint32_t index;
+    Value value;
+
+    Operand() : kind(OperandNone), type(TypeNothing), index(0) {
+        value.i = 0;
+    }
+
+    Operand(OperandKind kind, TypeId type, uint32_t index) : kind(kind), type(type), index(index) {
+        value.i = 0;
+    }
+
+    Operand(TypeId type, Value value) : kind(OperandConstant), type(type), index(0), value(value) {}
+};
+
+/* Transpiles statements and expressions, see CTranspiler::transpile(). Visiting an expression
+ * writes the statements computing its value and returns the operand holding the value. Statements
+ * return an operand of kind OperandNone. */
+struct CTranspiler::NodeTranspiler : public Visitor<NodeTranspiler, Operand> {
+    CTranspiler &transpiler;
+    Module *module;
+    TypeId returnType;
+    bool isModule;
+    uint32_t numTemporaries;
+    uint32_t depth;
+
+    /* Whether the expression being visited is a statement, whose value is not used. */
+    bool isDiscarded;
+
+    /* A binary operation along the left operands of a chain, see visitBinaryOperation(). */
+    struct Operation {
+        BinaryOperation *node;
+        const char *cOperator;
+        TypeId operandType;
+    };
+
+    /* The arguments of the calls being transpiled. */
+    Array<Operand> arguments;
+
+    /* The operations of the chains being transpiled. */
+    Array<Operation> operations;
+
+    NodeTranspiler(CTranspiler &transpiler, TypeId returnType, bool isModule) : transpiler(transpiler), module(transpiler._module),
+                                                                                returnType(returnType), isModule(isModule), numTemporaries(0),
+                                                                                depth(1), isDiscarded(false), arguments(transpiler._mem),
+                                                                                operations(transpiler._mem) {}
+
+    QAK_FORCE_INLINE TypeId typeOf(Expression *expression) {
+        return module->expressionTypes[expression->id];
+    }
+
+    /* Returns the line number of the token, which errors of the generated code are reported at. */
+    QAK_FORCE_INLINE uint32_t line(uint32_t token) {
+        Token &t = module->tokens[token];
+        return t.source.lines()[t.startLine].lineNumber;
+    }
+
+    QAK_FORCE_INLINE void indent() {
+        for (uint32_t i = 0; i < depth; i++) transpiler.write("    ");
+    }
+
+    /* Starts the declaration of a new temporary of the type, the caller writes its initializer. */
+    Operand temporary(TypeId type) {
+        Operand operand(OperandTemporary, type, numTemporaries++);
+        indent();
+        transpiler.write("%s t%u = ", cType(type), operand.index);
+        return operand;
+    }
+
+    void writeOperand(Operand &operand) {
+        switch (operand.kind) {
+            case OperandTemporary:
+                transpiler.write("t%u", operand.index);
+                break;
+            case OperandSymbol:
+                transpiler.writeName(operand.index);
+                break;
+            case OperandConstant:
+                writeConstant(operand.type, operand.value);
+                break;
+            case OperandNone:
+                transpiler.write("0");
+                break;
+        }
+    }
+
+    /* Writes the value as a C literal of the type. Floats are written in hexadecimal, which is exact. */
+    void writeConstant(TypeId type, Value value) {
+        if (type == TypeFloat32) {
+            transpiler.write(value.f < 0 ? "(%af)" : "%af", value.f);
+        } else if (type == TypeFloat64) {
+            transpiler.write(value.f < 0 ? "(%a)" : "%a", value.f);
+        } else if (type == TypeInt64) {
+            if (value.i == INT64_MIN) transpiler.write("(-INT64_C(9223372036854775807) - 1)");
+            else transpiler.write(value.i < 0 ? "(INT64_C(%lld))" : "INT64_C(%lld)", (long long) value.i);
+        } else {
+            transpiler.write(value.i < 0 ? "(%lld)" : "%lld", (long long) value.i);
+        }
+    }
+
+    Operand unsupported(AstNode *node, const char *message) {
+        transpiler._errors->add(module->span(node), message);
+        return Operand();
+    }
+
+    /* Visits the expression and converts its value to the type, which is the expression's type or a
+     * type it can be assigned to. Integers only need to be converted to floats, C converts all other
+     * values implicitly. */
+    Operand compileAs(Expression *expression, TypeId type) {
+        Operand value = visit(expression);
+        TypeId valueType = typeOf(expression);
+        if (!isInteger(valueType) || !isFloat(type)) return value;
+
+        if (value.kind == OperandConstant) {
+            Value converted;
+            converted.f = type == TypeFloat32 ? (double) (float) (double) value.value.i : (double) value.value.i;
+            return Operand(type, converted);
+        }
+
+        Operand converted = temporary(type);
+        transpiler.write(type == TypeFloat32 ? "(float) (double) " : "(double) ");
+        writeOperand(value);
+        transpiler.write(";\n");
+        return converted;
+    }
+
+    void compileBlock(FixedArray<Statement *> &statements) {
+        for (size_t i = 0; i < statements.size(); i++) {
+            Statement *statement = statements[i];
+            bool isExpression = statement->astType >= AstTernaryOperation && statement->astType <= AstFunctionCall;
+            isDiscarded = isExpression;
+            Operand value = visit(statement);
+            isDiscarded = false;
+
+            // Keeps compilers from warning about values of expression statements that are not used.
+            bool isAssignment = statement->astType == AstBinaryOperation &&
+                                module->tokens[static_cast<BinaryOperation *>(statement)->op].type == Assignment;
+            if (isExpression && !isAssignment && value.kind == OperandTemporary) {
+                indent();
+                transpiler.write("(void) t%u;\n", value.index);
+            }
+        }
+    }
+
+    void compileNestedBlock(FixedArray<Statement *> &statements) {
+        depth++;
+        compileBlock(statements);
+        depth--;
+    }
+
+    Operand visitNode(AstNode *node) {
+        return unsupported(node, "Can not transpile this statement.");
+    }
+
+    Operand visitLiteral(Literal *node) {
+        isDiscarded = false;
+        return Operand(typeOf(node), constantValue(node));
+    }
+
+    Operand visitVariableAccess(VariableAccess *node) {
+        isDiscarded = false;
+        Symbol &symbol = module->symbols[node->symbol];
+        if (symbol.type == SymbolFunction) return unsupported(node, "Functions can only be called.");
+        if (symbol.type != SymbolModuleVariable) return Operand(OperandSymbol, typeOf(node), (uint32_t) node->symbol);
+
+        // Module variables are read into a temporary, a call later in the expression may assign them.
+        Operand value = temporary(typeOf(node));
+        transpiler.writeName((uint32_t) node->symbol);
+        transpiler.write(";\n");
+        return value;
+    }
+
+    Operand visitUnaryOperation(UnaryOperation *node) {
+        isDiscarded = false;
+        TokenType op = module->tokens[node->firstToken].type;
+        if (op == Plus) return visit(node->value);
+
+        TypeId type = typeOf(node);
+        Operand value = visit(node->value);
+        Operand result = temporary(type);
+        if (op == Not) {
+            transpiler.write("!");
+            writeOperand(value);
+        } else if (isFloat(type)) {
+            transpiler.write("-");
+            writeOperand(value);
+        } else {
+            if (type == TypeInt8 || type == TypeInt16) transpiler.write(type == TypeInt8 ? "qak_narrow8(" : "qak_narrow16(");
+            transpiler.write(type == TypeInt64 ? "qak_neg_i64(" : "qak_neg_i32(");
+            writeOperand(value);
+            transpiler.write(type == TypeInt8 || type == TypeInt16 ? "))" : ")");
+        }
+        transpiler.write(";\n");
+        return result;
+    }
+
+    Operand compileAssignment(BinaryOperation *node) {
+        int32_t symbol = static_cast<VariableAccess *>(node->left)->symbol;
+        TypeId type = typeOf(node->left);
+        Operand value = compileAs(node->right, type);
+        indent();
+        transpiler.writeName((uint32_t) symbol);
+        transpiler.write(" = ");
+        writeOperand(value);
+        transpiler.write(";\n");
+        if (module->symbols[symbol].type == SymbolModuleVariable) return value;
+        return Operand(OperandSymbol, type, (uint32_t) symbol);
+    }
+
+    void writeArithmetic(TokenType op, TypeId type, Operand &left, Operand &right, uint32_t token) {
+        static const char *operators[] = {"+", "-", "*", "/", "%"};
+        static const char *names[] = {"add", "sub", "mul", "div", "rem"};
+        size_t index = op - Plus;
+        if (isInteger(type)) {
+            if (type == TypeInt8 || type == TypeInt16) transpiler.write(type == TypeInt8 ? "qak_narrow8(" : "qak_narrow16(");
+            transpiler.write("qak_%s_%s(", names[index], type == TypeInt64 ? "i64" : "i32");
+            writeOperand(left);
+            transpiler.write(", ");
+            writeOperand(right);
+            if (op == ForwardSlash || op == Percentage) transpiler.write(", %u", line(token));
+            transpiler.write(type == TypeInt8 || type == TypeInt16 ? "))" : ")");
+        } else if (op == Percentage) {
+            transpiler.write(type == TypeFloat32 ? "(float) fmod(" : "fmod(");
+            writeOperand(left);
+            transpiler.write(", ");
+            writeOperand(right);
+            transpiler.write(")");
+        } else if (type == TypeFloat32) {
+            // Computed in double and rounded once, like the Interpreter does.
+            transpiler.write("(float) ((double) ");
+            writeOperand(left);
+            transpiler.write(" %s (double) ", operators[index]);
+            writeOperand(right);
+            transpiler.write(")");
+        } else {
+            writeOperand(left);
+            transpiler.write(" %s ", operators[index]);
+            writeOperand(right);
+        }
+    }
+
+    /* Chooses the C operator and operand type of the operation, arithmetic has no C operator.
+     * Returns an error message if the operation can not be transpiled, nullptr otherwise. */
+    const char *prepare(BinaryOperation *node, Operation &operation) {
+        TokenType op = module->tokens[node->op].type;
+        TypeId type = typeOf(node);
+        TypeId leftType = typeOf(node->left), rightType = typeOf(node->right);
+        operation.node = node;
+        operation.cOperator = nullptr;
+        operation.operandType = type;
+        switch (op) {
+            case Plus:
+            case Minus:
+            case Asterisk:
+            case ForwardSlash:
+            case Percentage:
+                if (type == TypeString) return "String concatenation is not supported.";
+                if (!isNumeric(type)) return "Can not transpile this operator.";
+                break;
+            case And:
+                operation.cOperator = "&";
+                break;
+            case Or:
+                operation.cOperator = "|";
+                break;
+            case Xor:
+                operation.cOperator = "^";
+                break;
+            default:
+                // Comparisons of numbers widen the operands, other values are compared as is.
+                operation.operandType = isNumeric(leftType) && isNumeric(rightType) ? widen(leftType, rightType) : leftType;
+                switch (op) {
+                    case Equal:
+                        operation.cOperator = "==";
+                        break;
+                    case NotEqual:
+                        operation.cOperator = "!=";
+                        break;
+                    case Less:
+                        operation.cOperator = "<";
+                        break;
+                    case LessEqual:
+                        operation.cOperator = "<=";
+                        break;
+                    case Greater:
+                        operation.cOperator = ">";
+                        break;
+                    case GreaterEqual:
+                        operation.cOperator = ">=";
+                        break;
+                    default:
+                        return "Can not transpile this operator.";
+                }
+        }
+        return nullptr;
+    }
+
+    /* Chains like a + b + c nest their left operands as deep as they are long, so the operations
+     * along the left operands are transpiled in a loop. The code is written in the same order as
+     * if each left operand was transpiled with compileAs(). */
+    Operand visitBinaryOperation(BinaryOperation *node) {
+        isDiscarded = false;
+        if (module->tokens[node->op].type == Assignment) return compileAssignment(node);
+        size_t base = operations.size();
+        Operation operation;
+        const char *error = prepare(node, operation);
+        if (error) return unsupported(node, error);
+
+        // Collects the operations, the innermost left operand that is not one of them is transpiled first.
+        operations.add(operation);
+        Expression *expression = node->left;
+        while (expression->astType == AstBinaryOperation) {
+            BinaryOperation *left = static_cast<BinaryOperation *>(expression);
+            if (module->tokens[left->op].type == Assignment || prepare(left, operation)) break;
+            operations.add(operation);
+            expression = left->left;
+        }
+        Operand left = compileAs(expression, operations[operations.size() - 1].operandType);
+
+        Operand result;
+        while (operations.size() > base) {
+            operation = operations[operations.size() - 1];
+            operations.removeAt(operations.size() - 1);
+            BinaryOperation *current = operation.node;
+            Operand right = compileAs(current->right, operation.operandType);
+            TypeId type = typeOf(current);
+            result = temporary(type);
+            if (operation.cOperator) {
+                writeOperand(left);
+                transpiler.write(" %s ", operation.cOperator);
+                writeOperand(right);
+            } else {
+                writeArithmetic(module->tokens[current->op].type, type, left, right, current->op);
+            }
+            transpiler.write(";\n");
+            left = result;
+
+            // Converts the value to the operand type of the enclosing operation, like compileAs().
+            if (operations.size() > base && isInteger(type) && isFloat(operations[operations.size() - 1].operandType)) {
+                TypeId operandType = operations[operations.size() - 1].operandType;
+                left = temporary(operandType);
+                transpiler.write(operandType == TypeFloat32 ? "(float) (double) " : "(double) ");
+                writeOperand(result);
+                transpiler.write(";\n");
+            }
+        }
+        return result;
+    }
+
+    Operand visitTernaryOperation(TernaryOperation *node) {
+        isDiscarded = false;
+        TypeId type = typeOf(node);
+        Operand condition = visit(node->condition);
+        Operand result(OperandTemporary, type, numTemporaries++);
+        indent();
+        transpiler.write("%s t%u;\n", cType(type), result.index);
+        indent();
+        transpiler.write("if (");
+        writeOperand(condition);
+        transpiler.write(") {\n");
+        compileBranch(result, node->trueValue);
+        indent();
+        transpiler.write("} else {\n");
+        compileBranch(result, node->falseValue);
+        indent();
+        transpiler.write("}\n");
+        return result;
+    }
+
+    void compileBranch(Operand &result, Expression *value) {
+        depth++;
+        Operand operand = compileAs(value, result.type);
+        indent();
+        transpiler.write("t%u = ", result.index);
+        writeOperand(operand);
+        transpiler.write(";\n");
+        depth--;
+    }
+
+    Operand visitFunctionCall(FunctionCall *node) {
+        bool isStatement = isDiscarded;
+        isDiscarded = false;
+        Expression *callee = node->variableAccess;
+        if (callee->astType == AstVariableAccess && module->symbols[static_cast<VariableAccess *>(callee)->symbol].type == SymbolNative)
+            return unsupported(node, "Native functions can not be transpiled.");
+        if (callee->astType != AstVariableAccess || module->symbols[static_cast<VariableAccess *>(callee)->symbol].type != SymbolFunction)
+            return unsupported(node, "Only functions can be called.");
+        uint32_t index = module->symbols[static_cast<VariableAccess *>(callee)->symbol].slot;
+        ast::Function *function = module->functions[index];
+        TypeId functionReturnType = transpiler._types->get(module->symbolTypes[function->symbol]).returnType;
+
+        size_t base = arguments.size();
+        for (size_t i = 0; i < node->arguments.size(); i++) {
+            arguments.add(compileAs(node->arguments[i], module->symbolTypes[function->parameters[i]->symbol]));
+        }
+
+        indent();
+        transpiler.write("qak_enter(%u);\n", line(node->firstToken));
+        Operand result;
+        if (functionReturnType == TypeNothing || isStatement) indent();
+        else result = temporary(functionReturnType);
+        transpiler.writeFunctionName(index);
+        transpiler.write("(");
+        for (size_t i = base; i < arguments.size(); i++) {
+            if (i > base) transpiler.write(", ");
+            writeOperand(arguments[i]);
+        }
+        transpiler.write(");\n");
+        indent();
+        transpiler.write("qak_leave();\n");
+        arguments.setSize(base, Operand());
+        return result;
+    }
+
+    Operand visitVariable(Variable *node) {
+        Symbol &symbol = module->symbols[node->symbol];
+        TypeId type = module->symbolTypes[node->symbol];
+        if (symbol.type == SymbolModuleVariable) {
+            // Module variables are static and thus zero before the module's statements run.
+            if (node->initializerExpression) {
+                Operand value = compileAs(node->initializerExpression, type);
+                indent();
+                transpiler.writeName((uint32_t) node->symbol);
+                transpiler.write(" = ");
+                writeOperand(value);
+                transpiler.write(";\n");
+            }
+            return Operand();
+        }
+
+        // Variables declared in loops are zeroed on each iteration.
+        Value zero;
+        zero.i = 0;
+        Operand value = node->initializerExpression ? compileAs(node->initializerExpression, type) : Operand(type, zero);
+        indent();
+        transpiler.write("%s ", cType(type));
+        transpiler.writeName((uint32_t) node->symbol);
+        transpiler.write(" = ");
+        writeOperand(value);
+        transpiler.write(";\n");
+        return Operand();
+    }
+
+    Operand visitWhile(While *node) {
+        // The condition's statements run before each iteration.
+        indent();
+        transpiler.write("for (;;) {\n");
+        depth++;
+        Expression *condition = node->condition;
+        if (condition->astType != AstLiteral || !static_cast<Literal *>(condition)->decodedValue.booleanValue) {
+            Operand value = visit(condition);
+            indent();
+            transpiler.write("if (!");
+            writeOperand(value);
+            transpiler.write(") break;\n");
+        }
+        compileBlock(node->statements);
+        depth--;
+        indent();
+        transpiler.write("}\n");
+        return Operand();
+    }
+
+    Operand visitIf(If *node) {
+        Operand condition = visit(node->condition);
+        indent();
+        transpiler.write("if (");
+        writeOperand(condition);
+        transpiler.write(") {\n");
+        compileNestedBlock(node->trueBlock);
+        if (node->falseBlock.size() > 0) {
+            indent();
+            transpiler.write("} else {\n");
+            compileNestedBlock(node->falseBlock);
+        }
+        indent();
+        transpiler.write("}\n");
+        return Operand();
+    }
+
+    Operand visitReturn(Return *node) {
+        if (!node->returnValue) {
+            indent();
+            transpiler.write("return;\n");
+            return Operand();
+        }
+
+        // The module's statements can return values of any type, which are stored for main().
+        TypeId type = isModule ? typeOf(node->returnValue) : returnType;
+        Operand value = compileAs(node->returnValue, type);
+        indent();
+        if (isModule) {
+            transpiler.write(isFloat(type) ? "qak_result.f = " : "qak_result.i = ");
+            writeOperand(value);
+            transpiler.write(";\n");
+            indent();
+            transpiler.write("qak_result_type = %s;\n", cTypeConstant(type));
+            indent();
+            transpiler.write("return;\n");
+        } else {
+            transpiler.write("return ");
+            writeOperand(value);
+            transpiler.write(";\n");
+        }
+        return Operand();
+    }
+
+    Operand visitError(ErrorNode *node) {
+        return unsupported(node, "Can not transpile a module with errors.");
+    }
+};
+
+void CTranspiler::write(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    va_list argsCopy;
+    va_copy(argsCopy, args);
+    char scratch[1];
+    int length = vsnprintf(scratch, 1, format, args);
+    size_t start = _output->size();
+    _output->setSize(start + length + 1, 0);
+    vsnprintf(_output->buffer() + start, length + 1, format, argsCopy);
+    _output->setSize(start + length, 0);
+    va_end(argsCopy);
+    va_end(args);
+}
+
+void CTranspiler::writeEscaped(const uint8_t *data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        uint8_t c = data[i];
+        if (c == '"' || c == '\\') write("\\%c", c);
+        else if (c == '\n') write("\\n");
+        else if (c == '\t') write("\\t");
+        // Octal escapes end after three digits, hexadecimal ones would consume the following characters.
+        else if (c < 32 || c >= 127 || c == '?') write("\\%03o", c);
+        else write("%c", c);
+    }
+}
+
+/* Appends the text of the token, with bytes that can not be part of a C identifier replaced by _. */
+static void writeIdentifier(Array<char> &output, Token &token) {
+    for (uint32_t i = token.start; i < token.end; i++) {
+        uint8_t c = token.source.data[i];
+        bool isIdentifier = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+        output.add(isIdentifier ? (char) c : '_');
+    }
+}
+
+void CTranspiler::writeName(uint32_t symbol) {
+    Symbol &s = _module->symbols[symbol];
+    uint32_t name = s.declaration->astType == AstVariable ? static_cast<Variable *>(s.declaration)->name : s.declaration->firstToken;
+    write(s.type == SymbolModuleVariable ? "g%u_" : "l%u_", s.slot);
+    writeIdentifier(*_output, _module->tokens[name]);
+}
+
+void CTranspiler::writeFunctionName(uint32_t function) {
+    write("f%u_", function);
+    writeIdentifier(*_output, _module->tokens[_module->functions[function]->name]);
+}
+
+void CTranspiler::writePrelude() {
+    Source &source = _module->tokens[_module->name].source;
+    write("/* Generated by qak from ");
+    writeEscaped((const uint8_t *) source.fileName, strlen(source.fileName));
+    write(". */\n");
+    write("#include <stdint.h>\n#include <stdio.h>\n#include <stdlib.h>\n#include <math.h>\n\n");
+
+    write("static const char qak_file[] = \"");
+    writeEscaped((const uint8_t *) source.fileName, strlen(source.fileName));
+    write("\";\n\n");
+
+    // C does not allow empty arrays, modules without strings get an unused empty string.
+    write("static const char *const qak_strings[] = {\n");
+    for (size_t i = 0; i < _module->strings.size(); i++) {
+        write("    \"");
+        writeEscaped(_module->strings[i].data, _module->strings[i].length);
+        write("\",\n");
+    }
+    if (_module->strings.size() == 0) write("    \"\"\n");
+    write("};\n\nstatic const uint32_t qak_string_lengths[] = {\n");
+    for (size_t i = 0; i < _module->strings.size(); i++) write("    %u,\n", _module->strings[i].length);
+    if (_module->strings.size() == 0) write("    0\n");
+    write("};\n\n");
+
+    write(prelude, QAK_DEFAULT_MAX_CALL_DEPTH);
+}
+
+void CTranspiler::writeFunction(ast::Function *function, bool isDeclaration) {
+    uint32_t index = _module->symbols[function->symbol].slot;
+    TypeId returnType = _types->get(_module->symbolTypes[function->symbol]).returnType;
+    write("static %s ", cType(returnType));
+    writeFunctionName(index);
+    write("(");
+    for (size_t i = 0; i < function->parameters.size(); i++) {
+        Parameter *parameter = function->parameters[i];
+        if (i > 0) write(", ");
+        write("%s ", cType(_module->symbolTypes[parameter->symbol]));
+        writeName((uint32_t) parameter->symbol);
+    }
+    if (function->parameters.size() == 0) write("void");
+    if (isDeclaration) {
+        write(");\n");
+        return;
+    }
+    write(") {\n");
+
+    NodeTranspiler transpiler(*this, returnType, false);
+    transpiler.compileBlock(function->statements);
+
+    // Functions that end without a return statement return the zero value of their return type.
+    FixedArray<Statement *> &statements = function->statements;
+    bool isReturning = statements.size() > 0 && statements[statements.size() - 1]->astType == AstReturn;
+    if (returnType != TypeNothing && !isReturning) write("    return 0;\n");
+    write("}\n\n");
+}
+
+void CTranspiler::writeMain() {
+    write("#ifndef QAK_NO_MAIN\nint main(void) {\n    qak_statements();\n");
+    for (size_t i = 0; i < _module->variables.size(); i++) {
+        Variable *variable = _module->variables[i];
+        TypeId type = _module->symbolTypes[variable->symbol];
+        Token &name = _module->tokens[variable->name];
+        write("    qak_print(\"");
+        writeEscaped(name.source.data + name.start, name.length());
+        write("\", %s, %s(", cTypeConstant(type), isFloat(type) ? "qak_real" : "qak_integer");
+        writeName((uint32_t) variable->symbol);
+        write("));\n");
+    }
+    write("    qak_print(\"result\", qak_result_type, qak_result);\n    return 0;\n}\n#endif\n");
+}
+
+bool CTranspiler::transpile(Module *module, TypeTable &types, Errors &errors, Array<char> &output) {
+    size_t numErrors = errors.getErrors().size();
+    _module = module;
+    _types = &types;
+    _errors = &errors;
+    _output = &output;
+
+    writePrelude();
+    for (size_t i = 0; i < module->variables.size(); i++) {
+        Variable *variable = module->variables[i];
+        write("static %s ", cType(module->symbolTypes[variable->symbol]));
+        writeName((uint32_t) variable->symbol);
+        write(";\n");
+    }
+    if (module->variables.size() > 0) write("\n");
+
+    // Functions are declared first, so they can call each other in any order.
+    for (size_t i = 0; i < module->functions.size(); i++) writeFunction(module->functions[i], true);
+    if (module->functions.size() > 0) write("\n");
+    for (size_t i = 0; i < module->functions.size(); i++) writeFunction(module->functions[i], false);
+
+    write("static void qak_statements(void) {\n");
+    NodeTranspiler transpiler(*this, TypeNothing, true);
+    transpiler.compileBlock(module->statements);
+    write("}\n\n");
+    writeMain();
+
+    _module = nullptr;
+    _types = nullptr;
+    _errors = nullptr;
+    _output = nullptr;
+    return errors.getErrors().size() == numErrors;
+}
@@ -0,0 +1,69 @@
+#ifndef QAK_TRANSPILER_H
+#define QAK_TRANSPILER_H
+
+#include "typechecker.h"
+
+namespace qak {
+    /* The default limit of nested calls of C code generated by CTranspiler. Deeper calls fail with
+     * a stack overflow. Generated code can be compiled with -DQAK_MAX_CALL_DEPTH=n to change it. */
+#define QAK_DEFAULT_MAX_CALL_DEPTH 16384
+
+    /* Transpiles a type checked module to a single C99 source file, which follows the semantics of
+     * the Interpreter. Each function becomes a static C function, module variables become static
+     * globals and the module's statements become the function qak_statements(). Types map to the
+     * fixed-width C types, e.g. int16 to int16_t. Characters are stored as uint32_t code points
+     * and strings as the index of their literal, like bytecode::Values.
+     *
+     * Expressions are split into statements that store each intermediate value in a temporary,
+     * so operands are evaluated from left to right, which C does not guarantee for the operands
+     * of an operator. Integer arithmetic wraps around and is done on unsigned integers, where
+     * overflow is defined. Division by zero and calls nested deeper than QAK_MAX_CALL_DEPTH print
+     * an error with the line of the failing operation and exit with status 1.
+     *
+     * The generated main() runs the module's statements, then prints each module variable and
+     * the module's result, one per line, e.g. "count: int32 = 3" and "result: nothing". Compile
+     * the file with -DQAK_NO_MAIN to call qak_statements() from other code instead.
+     *
+     * Like the BytecodeCompiler, functions can only be called and strings not concatenated. Natives
+     * are functions of the host process, so modules calling them can not be transpiled. */
+    class CTranspiler {
+    private:
+        struct NodeTranspiler;
+
+        HeapAllocator &_mem;
+
+        // Set on each call to transpile.
+        ast::Module *_module;
+        TypeTable *_types;
+        Errors *_errors;
+        Array<char> *_output;
+
+        /* Appends the formatted text to the output. */
+        void write(const char *format, ...);
+
+        /* Appends the bytes as the contents of a C string literal. */
+        void writeEscaped(const uint8_t *data, size_t length);
+
+        /* Appends the C name of the symbol or function. Names are prefixed with the slot of
+         * the symbol so they never clash with C keywords or each other. */
+        void writeName(uint32_t symbol);
+
+        void writeFunctionName(uint32_t function);
+
+        void writePrelude();
+
+        void writeFunction(ast::Function *function, bool isDeclaration);
+
+        void writeMain();
+
+    public:
+        CTranspiler(HeapAllocator &mem) : _mem(mem), _module(nullptr), _types(nullptr), _errors(nullptr), _output(nullptr) {}
+
+        /* Appends the C source of the module to the output. The module must be type checked
+         * without errors with the types, see TypeChecker::check(). Unsupported constructs are
+         * reported in the errors, in which case false is returned. */
+        bool transpile(ast::Module *module, TypeTable &types, Errors &errors, Array<char> &output);
+    };
+}
+
+#endif //QAK_TRANSPILER_H
@@ -0,0 +1,435 @@
+#include "typechecker.h"
+#include "natives.h"
+#include "visitor.h"
+
+using namespace qak;
+
+using namespace qak::ast;
+
+static QAK_FORCE_INLINE uint32_t hashFunction(TypeId returnType, TypeId *parameters, uint32_t numParameters) {
+    uint32_t hash = hashBytes((const uint8_t *) &returnType, sizeof(TypeId));
+    return hashBytes((const uint8_t *) parameters, numParameters * sizeof(TypeId), hash);
+}
+
+/* Accepts the primitive type with the name, see HashIndex::find(). */
+struct IsNamedType {
+    const uint8_t *name;
+    uint32_t length;
+
+    IsNamedType(const uint8_t *name, uint32_t length) : name(name), length(length) {}
+
+    QAK_FORCE_INLINE bool operator()(Type &type) const {
+        if (type.kind == TypeFunction || type.kind == TypeError) return false;
+        return strlen(type.name) == length && memcmp(type.name, name, length) == 0;
+    }
+};
+
+/* Accepts the function type with the return and parameter types, see HashIndex::find(). */
+struct IsFunctionType {
+    Array<TypeId> &typeParameters;
+    TypeId returnType;
+    TypeId *parameters;
+    uint32_t numParameters;
+
+    IsFunctionType(Array<TypeId> &typeParameters, TypeId returnType, TypeId *parameters, uint32_t numParameters) :
+            typeParameters(typeParameters), returnType(returnType), parameters(parameters), numParameters(numParameters) {}
+
+    QAK_FORCE_INLINE bool operator()(Type &type) const {
+        if (type.kind != TypeFunction || type.returnType != returnType || type.numParameters != numParameters) return false;
+        for (uint32_t i = 0; i < numParameters; i++) {
+            if (typeParameters[type.firstParameter + i] != parameters[i]) return false;
+        }
+        return true;
+    }
+};
+
+/* Accepts no type, so find() returns the empty slot a new type is added to. */
+struct IsNoType {
+    QAK_FORCE_INLINE bool operator()(Type &) const {
+        return false;
+    }
+};
+
+TypeTable::TypeTable(HeapAllocator &mem) : _types(mem), _parameters(mem), _table(mem) {
+    const char *names[] = {"<error>", "nothing", "boolean", "int8", "int16", "int32", "int64", "float32", "float64", "character", "string"};
+    for (uint32_t i = 0; i < QAK_NUM_PRIMITIVE_TYPES; i++) {
+        add(Type((TypeKind) i, names[i], hashBytes((const uint8_t *) names[i], (uint32_t) strlen(names[i])), TypeError, 0, 0));
+    }
+}
+
+TypeId TypeTable::add(Type type) {
+    _table.reserve(_types);
+    size_t slot;
+    _table.find(_types, type.hash, IsNoType(), slot);
+
+    TypeId id = (TypeId) _types.size();
+    _types.add(type);
+    _table.set(slot, (int32_t) id);
+    return id;
+}
+
+TypeId TypeTable::named(const uint8_t *name, uint32_t length) {
+    size_t slot;
+    int32_t found = _table.find(_types, hashBytes(name, length), IsNamedType(name, length), slot);
+    return found >= 0 ? (TypeId) found : (TypeId) TypeError;
+}
+
+TypeId TypeTable::function(TypeId returnType, TypeId *parameters, uint32_t numParameters) {
+    uint32_t hash = hashFunction(returnType, parameters, numParameters);
+    size_t slot;
+    int32_t found = _table.find(_types, hash, IsFunctionType(_parameters, returnType, parameters, numParameters), slot);
+    if (found >= 0) return (TypeId) found;
+
+    uint32_t firstParameter = (uint32_t) _parameters.size();
+    for (uint32_t i = 0; i < numParameters; i++) _parameters.add(parameters[i]);
+    return add(Type(TypeFunction, "function", hash, returnType, firstParameter, numParameters));
+}
+
+const char *TypeTable::name(TypeId type) {
+    return _types[type].name;
+}
+
+static QAK_FORCE_INLINE bool isInteger(TypeId type) {
+    return type >= TypeInt8 && type <= TypeInt64;
+}
+
+static QAK_FORCE_INLINE bool isNumeric(TypeId type) {
+    return type >= TypeInt8 && type <= TypeFloat64;
+}
+
+/* Returns the wider of two numeric types. Numeric types are ordered from narrowest to widest. */
+static QAK_FORCE_INLINE TypeId widen(TypeId a, TypeId b) {
+    return a > b ? a : b;
+}
+
+#define QAK_TOKEN_TEXT(token) (int) (token).length(), (const char *) (token).source.data + (token).start
+
+/* Infers the types of expressions and checks statements, see TypeChecker::check(). Visiting
+ * an expression records its type and returns it. Statements return TypeNothing. */
+struct TypeChecker::NodeChecker : public Visitor<NodeChecker, TypeId> {
+    TypeChecker &checker;
+    Module *module;
+    TypeTable &types;
+    Errors &errors;
+
+    NodeChecker(TypeChecker &checker) : checker(checker), module(checker._module), types(*checker._types), errors(*checker._errors) {}
+
+    QAK_FORCE_INLINE TypeId record(Expression *expression, TypeId type) {
+        expression->id = (uint32_t) checker._expressionTypes.size();
+        checker._expressionTypes.add(type);
+        return type;
+    }
+
+    void checkBlock(FixedArray<Statement *> &statements) {
+        for (size_t i = 0; i < statements.size(); i++) visit(statements[i]);
+    }
+
+    TypeId visitNode(AstNode *) {
+        return TypeNothing;
+    }
+
+    TypeId visitError(ErrorNode *node) {
+        return record(node, TypeError);
+    }
+
+    TypeId visitLiteral(Literal *node) {
+        TypeId type;
+        switch (node->type) {
+            case BooleanLiteral:
+                type = TypeBoolean;
+                break;
+            case ByteLiteral:
+                type = TypeInt8;
+                break;
+            case ShortLiteral:
+                type = TypeInt16;
+                break;
+            case IntegerLiteral:
+                type = TypeInt32;
+                break;
+            case LongLiteral:
+                type = TypeInt64;
+                break;
+            case FloatLiteral:
+                type = TypeFloat32;
+                break;
+            case DoubleLiteral:
+                type = TypeFloat64;
+                break;
+            case CharacterLiteral:
+                type = TypeCharacter;
+                break;
+            case StringLiteral:
+                type = TypeString;
+                break;
+            default:
+                type = TypeNothing;
+                break;
+        }
+        return record(node, type);
+    }
+
+    TypeId visitVariableAccess(VariableAccess *node) {
+        return record(node, node->symbol >= 0 ? checker._symbolTypes[node->symbol] : (TypeId) TypeError);
+    }
+
+    TypeId visitUnaryOperation(UnaryOperation *node) {
+        TypeId value = visit(node->value);
+        Token &op = module->tokens[node->firstToken];
+        TypeId type = TypeError;
+        if (value == TypeError) type = TypeError;
+        else if (op.type == Not && value == TypeBoolean) type = TypeBoolean;
+        else if (op.type != Not && isNumeric(value)) type = value;
+        else errors.add(op, "Operator '%.*s' can not be applied to %s.", QAK_TOKEN_TEXT(op), types.name(value));
+        return record(node, type);
+    }
+
+    TypeId binaryOperationType(BinaryOperation *node, Token &op, TypeId left, TypeId right) {
+        if (left == TypeError || right == TypeError) return TypeError;
+
+        switch (op.type) {
+            case Assignment: {
+                if (node->left->astType != AstVariableAccess) {
+                    errors.add(module->span(node->left), "Can only assign to variables.");
+                    return TypeError;
+                }
+                if (types.get(left).kind == TypeFunction) {
+                    Token &name = module->tokens[node->left->firstToken];
+                    errors.add(name, "Can not assign to function '%.*s'.", QAK_TOKEN_TEXT(name));
+                    return TypeError;
+                }
+                checker.checkAssignable(left, node->right, right);
+                return left;
+            }
+            case Plus:
+                if ((left == TypeString || right == TypeString) && left != TypeNothing && right != TypeNothing &&
+                    types.get(left).kind != TypeFunction && types.get(right).kind != TypeFunction)
+                    return TypeString;
+                // fallthrough
+            case Minus:
+            case Asterisk:
+            case ForwardSlash:
+            case Percentage:
+                if (isNumeric(left) && isNumeric(right)) return widen(left, right);
+                break;
+            case Less:
+            case LessEqual:
+            case Greater:
+            case GreaterEqual:
+                if ((isNumeric(left) && isNumeric(right)) || (left == TypeCharacter && right == TypeCharacter)) return TypeBoolean;
+                break;
+            case Equal:
+            case NotEqual:
+                if ((left == right && left != TypeNothing) || (isNumeric(left) && isNumeric(right))) return TypeBoolean;
+                break;
+            case And:
+            case Or:
+            case Xor:
+                if (left == TypeBoolean && right == TypeBoolean) return TypeBoolean;
+                if (isInteger(left) && isInteger(right)) return widen(left, right);
+                break;
+            default:
+                break;
+        }
+        errors.add(op, "Operator '%.*s' can not be applied to %s and %s.", QAK_TOKEN_TEXT(op), types.name(left), types.name(right));
+        return TypeError;
+    }
+
+    /* A chain of binary operations, like a + b + c, nests its left operands as deep as the chain is long,
+     * see Parser::setMaxNestingDepth(). The operations along the left operands are checked in a loop,
+     * innermost first, only right operands are checked recursively. */
+    TypeId visitBinaryOperation(BinaryOperation *node) {
+        Array<BinaryOperation *> &operations = checker._operations;
+        size_t base = operations.size();
+        Expression *expression = node;
+        while (expression->astType == AstBinaryOperation) {
+            operations.add(static_cast<BinaryOperation *>(expression));
+            expression = static_cast<BinaryOperation *>(expression)->left;
+        }
+
+        TypeId left = visit(expression);
+        while (operations.size() > base) {
+            BinaryOperation *operation = operations[operations.size() - 1];
+            operations.removeAt(operations.size() - 1);
+            TypeId right = visit(operation->right);
+            left = record(operation, binaryOperationType(operation, module->tokens[operation->op], left, right));
+        }
+        return left;
+    }
+
+    TypeId visitTernaryOperation(TernaryOperation *node) {
+        checker.checkCondition(node->condition, visit(node->condition));
+        TypeId trueValue = visit(node->trueValue);
+        TypeId falseValue = visit(node->falseValue);
+        TypeId type = TypeError;
+        if (trueValue == TypeError || falseValue == TypeError) type = TypeError;
+        else if (trueValue == falseValue) type = trueValue;
+        else if (isNumeric(trueValue) && isNumeric(falseValue)) type = widen(trueValue, falseValue);
+        else errors.add(module->span(node), "Expected values of the same type, got %s and %s.", types.name(trueValue), types.name(falseValue));
+        return record(node, type);
+    }
+
+    TypeId visitFunctionCall(FunctionCall *node) {
+        TypeId callee = visit(node->variableAccess);
+        Type function = types.get(callee);
+        if (callee != TypeError && function.kind != TypeFunction) {
+            Token &name = module->tokens[node->variableAccess->firstToken];
+            errors.add(name, "'%.*s' is not a function.", QAK_TOKEN_TEXT(name));
+        }
+        bool isCallable = function.kind == TypeFunction && node->arguments.size() == function.numParameters;
+        if (function.kind == TypeFunction && !isCallable) {
+            errors.add(module->span(node), "Expected %u arguments, got %zu.", function.numParameters, node->arguments.size());
+        }
+
+        for (uint32_t i = 0; i < node->arguments.size(); i++) {
+            Expression *argument = node->arguments[i];
+            TypeId type = visit(argument);
+            if (isCallable) checker.checkAssignable(types.parameter(function, i), argument, type);
+        }
+        return record(node, function.kind == TypeFunction ? function.returnType : (TypeId) TypeError);
+    }
+
+    TypeId visitVariable(Variable *node) {
+        TypeId type = node->typeSpecifier ? checker.typeOf(node->typeSpecifier) : (TypeId) TypeError;
+        if (node->initializerExpression) {
+            TypeId value = visit(node->initializerExpression);
+            if (node->typeSpecifier) {
+                checker.checkAssignable(type, node->initializerExpression, value);
+            } else if (value == TypeNothing) {
+                Token &name = module->tokens[node->name];
+                errors.add(module->span(node->initializerExpression), "Can not infer the type of '%.*s' from an expression without a value.",
+                           QAK_TOKEN_TEXT(name));
+            } else {
+                type = value;
+            }
+        } else if (!node->typeSpecifier) {
+            Token &name = module->tokens[node->name];
+            errors.add(name, "Variable '%.*s' needs a type or an initializer.", QAK_TOKEN_TEXT(name));
+        }
+        if (node->symbol >= 0) checker._symbolTypes[node->symbol] = type;
+        return TypeNothing;
+    }
+
+    TypeId visitWhile(While *node) {
+        checker.checkCondition(node->condition, visit(node->condition));
+        checkBlock(node->statements);
+        return TypeNothing;
+    }
+
+    TypeId visitIf(If *node) {
+        checker.checkCondition(node->condition, visit(node->condition));
+        checkBlock(node->trueBlock);
+        checkBlock(node->falseBlock);
+        return TypeNothing;
+    }
+
+    TypeId visitReturn(Return *node) {
+        TypeId value = node->returnValue ? visit(node->returnValue) : (TypeId) TypeNothing;
+
+        // The statements of the module can return values of any type.
+        if (!checker._function) return TypeNothing;
+
+        Token &name = module->tokens[checker._function->name];
+        if (node->returnValue && checker._returnType == TypeNothing) {
+            errors.add(module->span(node->returnValue), "Function '%.*s' can not return a value.", QAK_TOKEN_TEXT(name));
+        } else if (node->returnValue) {
+            checker.checkAssignable(checker._returnType, node->returnValue, value);
+        } else if (checker._returnType != TypeNothing && checker._returnType != TypeError) {
+            errors.add(module->span(node), "Expected a return value of type %s.", types.name(checker._returnType));
+        }
+        return TypeNothing;
+    }
+};
+
+TypeId TypeChecker::typeOf(TypeSpecifier *typeSpecifier) {
+    Token &name = _module->tokens[typeSpecifier->firstToken];
+    TypeId type = _types->named(name.source.data + name.start, name.length());
+    if (type == TypeError) _errors->add(name, "Unknown type '%.*s'.", QAK_TOKEN_TEXT(name));
+    return type;
+}
+
+bool TypeChecker::isAssignable(TypeId type, Expression *value, TypeId valueType) {
+    if (type == valueType || type == TypeError || valueType == TypeError) return true;
+
+    // Numeric types are ordered from narrowest to widest, assigning to a wider type never loses the value's magnitude.
+    if (isNumeric(type) && isNumeric(valueType) && valueType < type) return true;
+
+    // Integer literals can be assigned to narrower integer types if they fit.
+    if (!isInteger(type) || valueType != TypeInt32) return false;
+    int64_t sign = 1;
+    if (value->astType == AstUnaryOperation && _module->tokens[value->firstToken].type == Minus) {
+        value = static_cast<UnaryOperation *>(value)->value;
+        sign = -1;
+    }
+    if (value->astType != AstLiteral || static_cast<Literal *>(value)->type != IntegerLiteral) return false;
+    int64_t literal = sign * static_cast<Literal *>(value)->decodedValue.intValue;
+    if (type == TypeInt8) return literal >= INT8_MIN && literal <= INT8_MAX;
+    if (type == TypeInt16) return literal >= INT16_MIN && literal <= INT16_MAX;
+    return true;
+}
+
+void TypeChecker::checkAssignable(TypeId type, Expression *value, TypeId valueType) {
+    if (!isAssignable(type, value, valueType))
+        _errors->add(_module->span(value), "Expected a value of type %s, got %s.", _types->name(type), _types->name(valueType));
+}
+
+void TypeChecker::checkCondition(Expression *condition, TypeId type) {
+    if (type != TypeBoolean && type != TypeError)
+        _errors->add(_module->span(condition), "Expected a boolean condition, got %s.", _types->name(type));
+}
+
+void TypeChecker::declareFunction(Function *function) {
+    _parameterTypes.clear();
+    for (size_t i = 0; i < function->parameters.size(); i++) {
+        Parameter *parameter = function->parameters[i];
+        TypeId type = typeOf(parameter->typeSpecifier);
+        _parameterTypes.add(type);
+        if (parameter->symbol >= 0) _symbolTypes[parameter->symbol] = type;
+    }
+    TypeId returnType = function->returnType ? typeOf(function->returnType) : (TypeId) TypeNothing;
+    _returnTypes.add(returnType);
+    TypeId type = _types->function(returnType, _parameterTypes.buffer(), (uint32_t) _parameterTypes.size());
+    if (function->symbol >= 0) _symbolTypes[function->symbol] = type;
+}
+
+void TypeChecker::checkFunction(Function *function, TypeId returnType) {
+    if (!function->isBodyParsed) return;
+
+    NodeChecker checker(*this);
+    _function = function;
+    _returnType = returnType;
+    checker.checkBlock(function->statements);
+    _function = nullptr;
+}
+
+bool TypeChecker::check(Module *module, TypeTable &types, Errors &errors) {
+    size_t numErrors = errors.getErrors().size();
+    _types = &types;
+    _module = module;
+    _errors = &errors;
+    _function = nullptr;
+    _expressionTypes.clear();
+    _symbolTypes.clear();
+    _symbolTypes.setSize(module->symbols.size(), TypeError);
+    _returnTypes.clear();
+
+    // Natives are checked like functions, with the types they were added with.
+    for (size_t i = 0; i < module->symbols.size(); i++) {
+        if (module->symbols[i].type == SymbolNative) _symbolTypes[i] = module->natives->get(module->symbols[i].slot).type;
+    }
+
+    // Function types are known before any statement is checked, as calls may precede the called function.
+    FixedArray<Function *> &functions = module->functions;
+    for (size_t i = 0; i < functions.size(); i++) declareFunction(functions[i]);
+
+    // The statements declare the types of the module variables, which functions may access.
+    NodeChecker checker(*this);
+    checker.checkBlock(module->statements);
+    for (size_t i = 0; i < functions.size(); i++) checkFunction(functions[i], _returnTypes[i]);
+
+    module->expressionTypes.set(_expressionTypes);
+    module->symbolTypes.set(_symbolTypes);
+    _module = nullptr;
+    _errors = nullptr;
+    return errors.getErrors().size() == numErrors;
+}
@@ -0,0 +1,138 @@
+#ifndef QAK_TYPECHECKER_H
+#define QAK_TYPECHECKER_H
+
+#include "parser.h"
+
+namespace qak {
+    /* Types are identified by their index in a TypeTable. The primitive types have the same
+     * index in every table. TypeError is the type of expressions that could not be checked,
+     * operations on it are not reported again. */
+    typedef uint32_t TypeId;
+
+    enum TypeKind {
+        TypeError,
+        TypeNothing,
+        TypeBoolean,
+        TypeInt8,
+        TypeInt16,
+        TypeInt32,
+        TypeInt64,
+        TypeFloat32,
+        TypeFloat64,
+        TypeCharacter,
+        TypeString,
+        TypeFunction
+    };
+
+    /* The number of primitive types, which take the first indices of a TypeTable. The index of
+     * a primitive type is its TypeKind. */
+#define QAK_NUM_PRIMITIVE_TYPES TypeFunction
+
+    /* A type in a TypeTable. Function types store their parameter types in the table's parameter
+     * array, from firstParameter to firstParameter + numParameters. */
+    struct Type {
+        TypeKind kind;
+        const char *name;
+        uint32_t hash;
+        TypeId returnType;
+        uint32_t firstParameter;
+        uint32_t numParameters;
+
+        Type(TypeKind kind, const char *name, uint32_t hash, TypeId returnType, uint32_t firstParameter, uint32_t numParameters) :
+                kind(kind), name(name), hash(hash), returnType(returnType), firstParameter(firstParameter), numParameters(numParameters) {}
+    };
+
+    /* Stores each distinct type exactly once, so types can be compared by their TypeId. The
+     * table can be shared by the modules of a compiler, see TypeChecker::check(). */
+    class TypeTable {
+    private:
+        Array<Type> _types;
+        Array<TypeId> _parameters;
+
+        /* The indices of _types by their hashes. */
+        HashIndex<Type> _table;
+
+        TypeId add(Type type);
+
+        TypeTable(const TypeTable &other) = delete;
+
+    public:
+        TypeTable(HeapAllocator &mem);
+
+        QAK_FORCE_INLINE Type &get(TypeId type) {
+            return _types[type];
+        }
+
+        QAK_FORCE_INLINE TypeId parameter(Type &function, uint32_t index) {
+            return _parameters[function.firstParameter + index];
+        }
+
+        /* Returns the primitive type with the given name, or TypeError if there is none. */
+        TypeId named(const uint8_t *name, uint32_t length);
+
+        /* Returns the type of functions with the given return and parameter types. */
+        TypeId function(TypeId returnType, TypeId *parameters, uint32_t numParameters);
+
+        /* Returns the name of the type, e.g. "int32". Function types are named "function". */
+        const char *name(TypeId type);
+
+        size_t size() {
+            return _types.size();
+        }
+    };
+
+    /* Infers and checks the types of a resolved module, see Resolver::resolve(). The type of each
+     * expression is stored in Module::expressionTypes at the expression's Expression::id, the
+     * type of each symbol in Module::symbolTypes at the symbol's index.
+     *
+     * Variables without a type specifier take the type of their initializer. Arithmetic widens the
+     * narrower operand to the type of the wider one, integers widen to floats. Integer literals
+     * can initialize and be assigned to narrower integer types if their value fits. The + operator
+     * concatenates strings with values of any type. */
+    class TypeChecker {
+    private:
+        struct NodeChecker;
+
+        Array<TypeId> _expressionTypes;
+        Array<TypeId> _symbolTypes;
+        Array<TypeId> _parameterTypes;
+
+        /* The return type of each function by its index in Module::functions. */
+        Array<TypeId> _returnTypes;
+
+        /* The binary operations along the left operands of the chains being checked, see NodeChecker::visitBinaryOperation(). */
+        Array<ast::BinaryOperation *> _operations;
+
+        // Set on each call to check.
+        TypeTable *_types;
+        ast::Module *_module;
+        Errors *_errors;
+
+        /* The function whose body is checked and its return type, or nullptr for the module's statements. */
+        ast::Function *_function;
+        TypeId _returnType;
+
+        TypeId typeOf(ast::TypeSpecifier *typeSpecifier);
+
+        bool isAssignable(TypeId type, ast::Expression *value, TypeId valueType);
+
+        void checkAssignable(TypeId type, ast::Expression *value, TypeId valueType);
+
+        void checkCondition(ast::Expression *condition, TypeId type);
+
+        void declareFunction(ast::Function *function);
+
+        void checkFunction(ast::Function *function, TypeId returnType);
+
+    public:
+        TypeChecker(HeapAllocator &mem) : _expressionTypes(mem), _symbolTypes(mem), _parameterTypes(mem), _returnTypes(mem), _operations(mem), _types(nullptr),
+                                          _module(nullptr), _errors(nullptr), _function(nullptr), _returnType(TypeNothing) {}
+
+        /* Checks the types of the module, interning them in the table. Type errors are reported in the
+         * errors. Returns false if there were errors. Functions whose bodies were not parsed are only
+         * checked for their signatures. */
+        bool check(ast::Module *module, TypeTable &types, Errors &errors);
+    };
+}
+
+#endif //QAK_TYPECHECKER_H
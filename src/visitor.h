@@ -0,0 +1,262 @@
+#ifndef QAK_VISITOR_H
+#define QAK_VISITOR_H
+
+#include "parser.h"
+
+namespace qak {
+    namespace ast {
+        /* Calls the callback for each child of the node, in source order. Children that are
+         * not present, like a missing return type, are skipped. */
+        template<typename F>
+        QAK_FORCE_INLINE void forEachChild(AstNode *node, F &callback);
+
+        template<typename F, typename T>
+        QAK_FORCE_INLINE void forEachChild(FixedArray<T *> &nodes, F &callback) {
+            for (size_t i = 0; i < nodes.size(); i++) callback(nodes[i]);
+        }
+
+        template<typename F>
+        QAK_FORCE_INLINE void forEachChild(AstNode *node, F &callback) {
+            switch (node->astType) {
+                case AstParameter: {
+                    Parameter *parameter = static_cast<Parameter *>(node);
+                    if (parameter->typeSpecifier) callback(parameter->typeSpecifier);
+                    break;
+                }
+                case AstFunction: {
+                    Function *function = static_cast<Function *>(node);
+                    forEachChild(function->parameters, callback);
+                    if (function->returnType) callback(function->returnType);
+                    forEachChild(function->statements, callback);
+                    break;
+                }
+                case AstTernaryOperation: {
+                    TernaryOperation *operation = static_cast<TernaryOperation *>(node);
+                    callback(operation->condition);
+                    callback(operation->trueValue);
+                    callback(operation->falseValue);
+                    break;
+                }
+                case AstBinaryOperation: {
+                    BinaryOperation *operation = static_cast<BinaryOperation *>(node);
+                    callback(operation->left);
+                    callback(operation->right);
+                    break;
+                }
+                case AstUnaryOperation:
+                    callback(static_cast<UnaryOperation *>(node)->value);
+                    break;
+                case AstFunctionCall: {
+                    FunctionCall *call = static_cast<FunctionCall *>(node);
+                    callback(call->variableAccess);
+                    forEachChild(call->arguments, callback);
+                    break;
+                }
+                case AstVariable: {
+                    Variable *variable = static_cast<Variable *>(node);
+                    if (variable->typeSpecifier) callback(variable->typeSpecifier);
+                    if (variable->initializerExpression) callback(variable->initializerExpression);
+                    break;
+                }
+                case AstWhile: {
+                    While *whileNode = static_cast<While *>(node);
+                    callback(whileNode->condition);
+                    forEachChild(whileNode->statements, callback);
+                    break;
+                }
+                case AstIf: {
+                    If *ifNode = static_cast<If *>(node);
+                    callback(ifNode->condition);
+                    forEachChild(ifNode->trueBlock, callback);
+                    forEachChild(ifNode->falseBlock, callback);
+                    break;
+                }
+                case AstReturn: {
+                    Return *returnNode = static_cast<Return *>(node);
+                    if (returnNode->returnValue) callback(returnNode->returnValue);
+                    break;
+                }
+                case AstTypeDeclaration:
+                    forEachChild(static_cast<TypeDeclaration *>(node)->fields, callback);
+                    break;
+                case AstField:
+                    callback(static_cast<Field *>(node)->typeSpecifier);
+                    break;
+                case AstModule: {
+                    Module *module = static_cast<Module *>(node);
+                    forEachChild(module->functions, callback);
+                    forEachChild(module->statements, callback);
+                    forEachChild(module->types, callback);
+                    break;
+                }
+                case AstTypeSpecifier:
+                case AstLiteral:
+                case AstVariableAccess:
+                case AstError:
+                    break;
+            }
+        }
+
+        /* Dispatches a node to the visit method of its type at compile time. Derived is the
+         * class deriving from the visitor, which hides the visit methods for the node types it
+         * handles, e.g. R visitFunction(Function *node). The visit methods it does not hide
+         * call visitNode(), which returns R() by default.
+         *
+         * Visitors do not descend into children, see Walker. */
+        template<typename Derived, typename R = void>
+        struct Visitor {
+            QAK_FORCE_INLINE Derived &derived() {
+                return *static_cast<Derived *>(this);
+            }
+
+            QAK_FORCE_INLINE R visit(AstNode *node) {
+                switch (node->astType) {
+                    case AstTypeSpecifier:
+                        return derived().visitTypeSpecifier(static_cast<TypeSpecifier *>(node));
+                    case AstParameter:
+                        return derived().visitParameter(static_cast<Parameter *>(node));
+                    case AstFunction:
+                        return derived().visitFunction(static_cast<Function *>(node));
+                    case AstTernaryOperation:
+                        return derived().visitTernaryOperation(static_cast<TernaryOperation *>(node));
+                    case AstBinaryOperation:
+                        return derived().visitBinaryOperation(static_cast<BinaryOperation *>(node));
+                    case AstUnaryOperation:
+                        return derived().visitUnaryOperation(static_cast<UnaryOperation *>(node));
+                    case AstLiteral:
+                        return derived().visitLiteral(static_cast<Literal *>(node));
+                    case AstVariableAccess:
+                        return derived().visitVariableAccess(static_cast<VariableAccess *>(node));
+                    case AstFunctionCall:
+                        return derived().visitFunctionCall(static_cast<FunctionCall *>(node));
+                    case AstVariable:
+                        return derived().visitVariable(static_cast<Variable *>(node));
+                    case AstWhile:
+                        return derived().visitWhile(static_cast<While *>(node));
+                    case AstIf:
+                        return derived().visitIf(static_cast<If *>(node));
+                    case AstReturn:
+                        return derived().visitReturn(static_cast<Return *>(node));
+                    case AstModule:
+                        return derived().visitModule(static_cast<Module *>(node));
+                    case AstError:
+                        return derived().visitError(static_cast<ErrorNode *>(node));
+                    case AstTypeDeclaration:
+                        return derived().visitTypeDeclaration(static_cast<TypeDeclaration *>(node));
+                    case AstField:
+                        return derived().visitField(static_cast<Field *>(node));
+                }
+                return derived().visitNode(node);
+            }
+
+            R visitNode(AstNode *) {
+                return R();
+            }
+
+            R visitTypeSpecifier(TypeSpecifier *node) { return derived().visitNode(node); }
+
+            R visitParameter(Parameter *node) { return derived().visitNode(node); }
+
+            R visitFunction(Function *node) { return derived().visitNode(node); }
+
+            R visitTernaryOperation(TernaryOperation *node) { return derived().visitNode(node); }
+
+            R visitBinaryOperation(BinaryOperation *node) { return derived().visitNode(node); }
+
+            R visitUnaryOperation(UnaryOperation *node) { return derived().visitNode(node); }
+
+            R visitLiteral(Literal *node) { return derived().visitNode(node); }
+
+            R visitVariableAccess(VariableAccess *node) { return derived().visitNode(node); }
+
+            R visitFunctionCall(FunctionCall *node) { return derived().visitNode(node); }
+
+            R visitVariable(Variable *node) { return derived().visitNode(node); }
+
+            R visitWhile(While *node) { return derived().visitNode(node); }
+
+            R visitIf(If *node) { return derived().visitNode(node); }
+
+            R visitReturn(Return *node) { return derived().visitNode(node); }
+
+            R visitModule(Module *node) { return derived().visitNode(node); }
+
+            R visitError(ErrorNode *node) { return derived().visitNode(node); }
+
+            R visitTypeDeclaration(TypeDeclaration *node) { return derived().visitNode(node); }
+
+            R visitField(Field *node) { return derived().visitNode(node); }
+        };
+
+        /* Walks a tree in pre-order, calling the visit method of each node before its children
+         * as the pre hook. Returning false from it skips the node's children. Derived classes
+         * that set hasLeave to true also get leave(AstNode *node) called after the node's
+         * children as the post hook.
+         *
+         * The walk uses an explicit stack instead of recursion, so deeply nested trees can not
+         * overflow the native stack. The stack is kept between walks. */
+        template<typename Derived>
+        struct Walker : public Visitor<Derived, bool> {
+            /* An entry of the walk stack. Nodes are entered, then left once their children are done. */
+            struct Item {
+                AstNode *node;
+                bool isLeave;
+
+                Item(AstNode *node, bool isLeave) : node(node), isLeave(isLeave) {}
+            };
+
+            /* Pushes the children of a node onto the walk stack. */
+            struct ChildPusher {
+                Array<Item> &stack;
+
+                ChildPusher(Array<Item> &stack) : stack(stack) {}
+
+                QAK_FORCE_INLINE void operator()(AstNode *node) {
+                    stack.add(Item(node, false));
+                }
+            };
+
+            static const bool hasLeave = false;
+
+            Array<Item> stack;
+
+            Walker(HeapAllocator &mem) : stack(mem) {}
+
+            bool visitNode(AstNode *) {
+                return true;
+            }
+
+            void leave(AstNode *) {
+            }
+
+            void walk(AstNode *root) {
+                Derived &derived = this->derived();
+                ChildPusher pusher(stack);
+                stack.clear();
+                stack.add(Item(root, false));
+                while (stack.size() > 0) {
+                    Item item = stack[stack.size() - 1];
+                    stack.removeAt(stack.size() - 1);
+                    if (Derived::hasLeave && item.isLeave) {
+                        derived.leave(item.node);
+                        continue;
+                    }
+
+                    if (Derived::hasLeave) stack.add(Item(item.node, true));
+                    if (!derived.visit(item.node)) continue;
+
+                    // Children are pushed in source order, then reversed so the first child is on top.
+                    size_t first = stack.size();
+                    forEachChild(item.node, pusher);
+                    for (size_t i = first, j = stack.size(); i + 1 < j; i++, j--) {
+                        Item tmp = stack[i];
+                        stack[i] = stack[j - 1];
+                        stack[j - 1] = tmp;
+                    }
+                }
+            }
+        };
+    }
+}
+
+#endif //QAK_VISITOR_H